@@ -50,6 +50,22 @@ void Config::setSettingsFromJSON(const JSON::Value &pd, Setting &s)
 	}
 }
 
+void Config::setSignature(const JSON::Property &type, const JSON::Value &pd, const Setting &s)
+{
+	std::string signature = std::to_string(type.Key());
+
+	for (const JSON::Property &p : pd.getObject().getProperties())
+		signature += "," + std::to_string(p.Key()) + "=" + p.Get().to_string();
+
+	signatures[&s] = signature;
+}
+
+std::string Config::getSignature(const Setting *s) const
+{
+	auto it = signatures.find(s);
+	return it == signatures.end() ? "" : it->second;
+}
+
 void Config::setServerfromJSON(const JSON::Value &pd)
 {
 
@@ -92,7 +108,9 @@ void Config::setHTTPfromJSON(const JSON::Property &pd)
 		IO::OutputJSON &h = *_json.back();
 
 		setSettingsFromJSON(v, h);
-		_receivers.back()->setTags("DT");
+		setSignature(pd, v, h);
+		if (!outputs_only)
+			_receivers.back()->setTags("DT");
 	}
 }
 
@@ -110,6 +128,7 @@ void Config::setUDPfromJSON(const JSON::Property &pd)
 		_msg.push_back(std::unique_ptr<IO::OutputMessage>(new IO::UDPStreamer()));
 		IO::OutputMessage &o = *_msg.back();
 		setSettingsFromJSON(v, o);
+		setSignature(pd, v, o);
 	}
 }
 
@@ -127,6 +146,7 @@ void Config::setTCPfromJSON(const JSON::Property &pd)
 		_msg.push_back(std::unique_ptr<IO::OutputMessage>(new IO::TCPClientStreamer()));
 		IO::OutputMessage &tcp = *_msg.back();
 		setSettingsFromJSON(v, tcp);
+		setSignature(pd, v, tcp);
 	}
 }
 
@@ -143,6 +163,7 @@ void Config::setMQTTfromJSON(const JSON::Property &pd)
 		_msg.push_back(std::unique_ptr<IO::OutputMessage>(new IO::MQTTStreamer()));
 		IO::OutputMessage &mqtt = *_msg.back();
 		setSettingsFromJSON(v, mqtt);
+		setSignature(pd, v, mqtt);
 	}
 }
 void Config::setTCPListenerfromJSON(const JSON::Property &pd)
@@ -160,6 +181,7 @@ void Config::setTCPListenerfromJSON(const JSON::Property &pd)
 		IO::OutputMessage &tcp = *_msg.back();
 		tcp.Set("TIMEOUT", "0");
 		setSettingsFromJSON(v, tcp);
+		setSignature(pd, v, tcp);
 	}
 }
 
@@ -337,6 +359,62 @@ void Config::read(std::string &file_config)
 	}
 }
 
+void Config::readOutputs(const std::string &file_config)
+{
+	setOutputs(Util::Helper::readFile(file_config));
+}
+
+void Config::setOutputs(const std::string &str)
+{
+	std::string config;
+	int version = 0;
+
+	JSON::Parser parser(&AIS::KeyMap, JSON_DICT_SETTING);
+	std::shared_ptr<JSON::JSON> json = parser.parse(str);
+
+	const std::vector<JSON::Property> &props = json->getProperties();
+
+	for (const auto &p : props)
+	{
+		switch (p.Key())
+		{
+		case AIS::KEY_SETTING_CONFIG:
+			config = p.Get().to_string();
+			break;
+		case AIS::KEY_SETTING_VERSION:
+			version = Util::Parse::Integer(p.Get().to_string());
+			break;
+		}
+	}
+
+	if (version < 1 || version > 1 || config != "aiscatcher")
+		throw std::runtime_error("version and/or format of config file not supported (required version <=1)");
+
+	outputs_only = true;
+
+	for (const auto &p : props)
+	{
+		switch (p.Key())
+		{
+		case AIS::KEY_SETTING_UDP:
+			setUDPfromJSON(p);
+			break;
+		case AIS::KEY_SETTING_TCP:
+			setTCPfromJSON(p);
+			break;
+		case AIS::KEY_SETTING_MQTT:
+			setMQTTfromJSON(p);
+			break;
+		case AIS::KEY_SETTING_TCP_LISTENER:
+			setTCPListenerfromJSON(p);
+			break;
+		case AIS::KEY_SETTING_HTTP:
+			setHTTPfromJSON(p);
+			break;
+		}
+	}
+}
+
 void Config::setSharing(const std::vector<JSON::Property> &props)
 {
 
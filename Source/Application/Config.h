@@ -18,6 +18,7 @@
 #pragma once
 #include <iostream>
 #include <string.h>
+#include <map>
 #include <memory>
 
 #include "AIS-catcher.h"
@@ -57,8 +58,15 @@ class Config {
 
 	int &_own_mmsi;
 
+	// reading the outputs for running receivers, these are not changed
+	bool outputs_only = false;
+
+	// type and settings of each output as read from the file
+	std::map<const Setting *, std::string> signatures;
+
 	bool isActiveObject(const JSON::Value& pd);
 	void setSettingsFromJSON(const JSON::Value& pd, Setting& s);
+	void setSignature(const JSON::Property& type, const JSON::Value& pd, const Setting& s);
 	void setHTTPfromJSON(const JSON::Property& pd);
 	void setUDPfromJSON(const JSON::Property& pd);
 	void setTCPfromJSON(const JSON::Property& pd);
@@ -75,4 +83,9 @@ public:
 
 	void read(std::string& file_config);
 	void set(const std::string& str);
+	// only the UDP, TCP, MQTT, TCP listener and HTTP outputs, to replace them while running
+	void readOutputs(const std::string& file_config);
+	void setOutputs(const std::string& str);
+	// equal for outputs of the same type and settings, empty if s was not read from a file
+	std::string getSignature(const Setting* s) const;
 };
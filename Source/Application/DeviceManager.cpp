@@ -16,27 +16,81 @@
 */
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 
 #include "DeviceManager.h"
 #include "Logger.h"
 #include "Parse.h"
 #include "StringBuilder.h"
 
-std::vector<Device::Description> DeviceManager::device_list;
-
 void DeviceManager::refreshDevices()
 {
+	if (!probes.empty())
+		return;
+
+	Device::Device *families[] = {&_RTLSDR, &_AIRSPYHF, &_AIRSPY, &_SDRPLAY, &_HACKRF, &_SOAPYSDR, &_N2KSCAN, &_SerialPort, &_HYDRASDR};
+	const char *names[] = {"RTLSDR", "AIRSPYHF", "AIRSPY", "SDRPLAY", "HACKRF", "SOAPYSDR", "N2K", "SERIALPORT", "HYDRASDR"};
+	const int n = sizeof(families) / sizeof(families[0]);
+
+	probe_result.assign(n, std::vector<Device::Description>());
+	probe_done.assign(n, false);
+
+	for (int i = 0; i < n; i++)
+	{
+		probes.push_back(std::thread([this, families, i]()
+									 {
+			std::vector<Device::Description> list;
+
+			try
+			{
+				families[i]->getDeviceList(list);
+			}
+			catch (std::exception &e)
+			{
+				Warning() << "Device enumeration: " << e.what();
+			}
+
+			std::lock_guard<std::mutex> lock(probe_mtx);
+			probe_result[i] = list;
+			probe_done[i] = true;
+			probe_cv.notify_all(); }));
+	}
+
+	std::unique_lock<std::mutex> lock(probe_mtx);
+	probe_cv.wait_for(lock, std::chrono::seconds(PROBE_TIMEOUT), [this]()
+					  { return std::find(probe_done.begin(), probe_done.end(), false) == probe_done.end(); });
+
+	// merged in the fixed family order so device indices do not depend on timing
 	device_list.clear();
+	for (int i = 0; i < n; i++)
+	{
+		if (probe_done[i])
+			device_list.insert(device_list.end(), probe_result[i].begin(), probe_result[i].end());
+		else
+			Warning() << "Device enumeration: " << names[i] << " did not respond within " << PROBE_TIMEOUT << " seconds, skipped.";
+	}
+
+	listed = true;
+}
+
+// a configured input type only needs its own family, otherwise the full list is required
+void DeviceManager::listDevices(Type family)
+{
+	if (listed)
+		return;
+
+	if (family == Type::NONE)
+	{
+		refreshDevices();
+		return;
+	}
 
-	RTLSDR().getDeviceList(device_list);
-	AIRSPYHF().getDeviceList(device_list);
-	AIRSPY().getDeviceList(device_list);
-	SDRPLAY().getDeviceList(device_list);
-	HACKRF().getDeviceList(device_list);
-	SOAPYSDR().getDeviceList(device_list);
-	N2KSCAN().getDeviceList(device_list);
-	SerialPort().getDeviceList(device_list);
-	HYDRASDR().getDeviceList(device_list);
+	Device::Device *d = getDeviceByType(family);
+
+	device_list.clear();
+	if (d)
+		d->getDeviceList(device_list);
 }
 
 Device::Device *DeviceManager::getDeviceByType(Type type)
@@ -98,6 +152,8 @@ Device::Device *DeviceManager::getDeviceByType(Type type)
 
 bool DeviceManager::openDevice(int sample_rate, int bandwidth, int ppm, int frequency, TAG &tag)
 {
+	listDevices(type);
+
 	int idx = device_list.empty() ? -1 : 0;
 	uint64_t handle = device_list.empty() ? 0 : device_list[0].getHandle();
 
@@ -160,6 +216,8 @@ bool DeviceManager::openDevice(int sample_rate, int bandwidth, int ppm, int freq
 
 void DeviceManager::printAvailableDevices(bool JSON)
 {
+	refreshDevices();
+
 	if (!JSON)
 	{
 		Info() << "Found " << device_list.size() << " device(s):";
@@ -196,6 +254,8 @@ void DeviceManager::printAvailableDevices(bool JSON)
 
 void DeviceManager::selectDeviceByIndex(int index)
 {
+	refreshDevices();
+
 	if (index < 0 || index >= device_list.size())
 		throw std::runtime_error("device does not exist");
 
@@ -17,6 +17,10 @@
 
 #pragma once
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 #include "Common.h"
 
 #include "Device/FileRAW.h"
@@ -59,15 +63,32 @@ class DeviceManager
 
     Device::Device *getDeviceByType(Type type);
 
-    // Available devices
-    static std::vector<Device::Description> device_list;
+    // Available devices, enumerated on first use and only for the driver families that are needed
+    std::vector<Device::Description> device_list;
+    bool listed = false;
     Device::Device *device = nullptr;
 
+    // full enumeration probes all families in parallel, a family that does not answer in time is left out
+    // and its thread is joined on destruction
+    const int PROBE_TIMEOUT = 10;
+
+    std::vector<std::thread> probes;
+    std::vector<std::vector<Device::Description>> probe_result;
+    std::vector<bool> probe_done;
+    std::mutex probe_mtx;
+    std::condition_variable probe_cv;
+
+    void listDevices(Type family);
+
 public:
     ~DeviceManager()
     {
         if (device)
             device->Close();
+
+        for (auto &t : probes)
+            if (t.joinable())
+                t.join();
     }
 
     // Device accessors
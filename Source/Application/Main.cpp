@@ -19,6 +19,8 @@
 
 #include <iostream>
 #include <string.h>
+#include <algorithm>
+#include <map>
 #include <memory>
 
 #include "AIS-catcher.h"
@@ -29,11 +31,19 @@
 #include "JSON.h"
 #include "N2KStream.h"
 #include "PostgreSQL.h"
+#include "SQLite.h"
 #include "Logger.h"
 #include "Screen.h"
 #include "File.h"
+#include "SharedMemory.h"
+#include "Tuning.h"
+#include "Microbench.h"
+#include "MemoryBudget.h"
+#include "Alloc.h"
 
 static std::atomic<bool> stop;
+// SIGHUP re-reads the outputs of the config file instead of stopping
+static std::atomic<bool> reload, reloadable;
 
 void StopRequest()
 {
@@ -55,6 +65,11 @@ static void consoleHandler(int signal)
 		// Info() << "Termination request SIGPIPE ignored" ;
 		return;
 	}
+	if (signal == SIGHUP && reloadable)
+	{
+		reload = true;
+		return;
+	}
 	if (signal != SIGINT)
 		std::cerr << "Termination request: " << signal;
 
@@ -62,6 +77,100 @@ static void consoleHandler(int signal)
 }
 #endif
 
+// reload: an output read again with the same type and settings as a running one is dropped and the
+// running one moved to kept, what is left in running has to stop and in fresh has to start
+template <typename T>
+static void keepUnchanged(std::vector<T *> &running, std::vector<std::unique_ptr<T>> &fresh, std::map<const Setting *, std::string> &signature, const Config &rc, std::vector<T *> &kept)
+{
+	for (auto it = fresh.begin(); it != fresh.end();)
+	{
+		std::string s = rc.getSignature(it->get());
+		auto match = std::find_if(running.begin(), running.end(), [&](T *o)
+								  { return signature[o] == s; });
+
+		if (match != running.end())
+		{
+			kept.push_back(*match);
+			running.erase(match);
+			it = fresh.erase(it);
+		}
+		else
+		{
+			signature[it->get()] = s;
+			it++;
+		}
+	}
+}
+
+static void stopOutput(IO::OutputMessage *o)
+{
+	o->StopQueue();
+	o->Stop();
+}
+
+static void stopOutput(IO::OutputJSON *o)
+{
+	o->Stop();
+}
+
+// stops the disconnected outputs in remove and deletes them from all
+template <typename T>
+static void removeOutputs(const std::vector<T *> &remove, std::vector<std::unique_ptr<T>> &all, std::map<const Setting *, std::string> &signature)
+{
+	for (auto o : remove)
+	{
+		stopOutput(o);
+		signature.erase(o);
+	}
+
+	all.erase(std::remove_if(all.begin(), all.end(), [&](const std::unique_ptr<T> &o)
+							 { return std::find(remove.begin(), remove.end(), o.get()) != remove.end(); }),
+			  all.end());
+}
+
+// outputs that fail to start are reported and dropped
+template <typename T>
+static void startOutputs(std::vector<std::unique_ptr<T>> &fresh)
+{
+	for (auto it = fresh.begin(); it != fresh.end();)
+	{
+		try
+		{
+			(*it)->Start();
+			it++;
+		}
+		catch (std::exception &e)
+		{
+			Error() << "Reload: " << e.what();
+			(*it)->Stop();
+			it = fresh.erase(it);
+		}
+	}
+}
+
+// with the message lock held, outputs that fail to connect move to failed
+template <typename T>
+static void connectOutputs(std::vector<std::unique_ptr<T>> &fresh, std::vector<std::unique_ptr<Receiver>> &receivers, std::vector<std::unique_ptr<T>> &failed)
+{
+	for (auto it = fresh.begin(); it != fresh.end();)
+	{
+		try
+		{
+			for (auto &r : receivers)
+				(*it)->Connect(*r);
+			it++;
+		}
+		catch (std::exception &e)
+		{
+			Error() << "Reload: " << e.what();
+			for (auto &r : receivers)
+				(*it)->Disconnect(*r);
+			failed.push_back(std::move(*it));
+			it = fresh.erase(it);
+		}
+	}
+}
+
 static void printVersion()
 {
 	Info() << "AIS-catcher (build " << __DATE__ << ") " << VERSION_DESCRIBE << "\n"
@@ -75,18 +184,20 @@ static void Usage()
 	Info() << "use: AIS-catcher [options]";
 	Info() << "";
 	Info() << "\t[-a xxx - set tuner bandwidth in Hz (default: off)]";
-	Info() << "\t[-b benchmark demodulation models for time - for development purposes (default: off)]";
+	Info() << "\t[-b benchmark demodulation models for time, with messages/s, allocations per message and a comparison of the models (-m) on the same signal - for development purposes (default: off)]";
 	Info() << "\t[-c [AB/CD] - [optional: AB] select AIS channels and optionally the NMEA channel designations]";
-	Info() << "\t[-C [filename] - read configuration settings from file]";
+	Info() << "\t[-C [filename] - read configuration settings from file, SIGHUP reads the UDP, TCP, MQTT, TCP_LISTENER and HTTP outputs again and replaces them without stopping the receivers]";
 	Info() << "\t[-D [connection string] - write messages to PostgreSQL database]";
 	Info() << "\t[-e [baudrate] [serial port] - read NMEA from serial port at specified baudrate]";
 	Info() << "\t[-f [filename] write NMEA lines to file]";
 	Info() << "\t[-F run model optimized for speed at the cost of accuracy for slow hardware (default: off)]";
-	Info() << "\t[-G [LEVEL level] [SYSTEM on] - control logging (levels: DEBUG, INFO, WARNING, ERROR, CRITICAL) or enable system logging]";
+	Info() << "\t[-G [LEVEL level] [SYSTEM on] [ASYNC on/off] - control logging (levels: DEBUG, INFO, WARNING, ERROR, CRITICAL) or enable system logging]";
 	Info() << "\t[-h display this message and terminate (default: false)]";
 	Info() << "\t[-H [optional: url] - send messages via HTTP, for options see documentation]";
 	Info() << "\t[-i [interface] - read NMEA2000 data from socketCAN interface - Linux only]";
 	Info() << "\t[-I [interface] - push messages as NMEA2000 data to a socketCAN interface - Linux only]";
+	Info() << "\t[-J [MB] - memory budget for tables, buffers and caches, 0 for none (default: none, 64 on ARMV6 builds)]";
+	Info() << "\t[-K [filename] - write messages to SQLite database file]";
 	Info() << "\t[-m xx - run specific decoding model (default: 2), see README for more details]";
 	Info() << "\t[-M xxx - set additional meta data to generate: T = NMEA timestamp, D = decoder related (signal power, ppm) (default: none)]";
 	Info() << "\t[-n show NMEA messages on screen without detail (-o 1)]";
@@ -96,14 +207,25 @@ static void Usage()
 	Info() << "\t[-p xxx - set frequency correction for device in PPM (default: zero)]";
 	Info() << "\t[-P xxx.xx.xx.xx yyy - TCP destination address and port (default: off)]";
 	Info() << "\t[-q suppress NMEA messages to screen (-o 0)]";
+	Info() << "\t[-R [optional: name] - publish messages to a ring in shared memory for local readers, takes SIZE [64-1048576 KB] (default: ais-catcher, 4096 KB)]";
 	Info() << "\t[-s xxx - sample rate in Hz (default: based on SDR device)]";
 	Info() << "\t[-S xxx - TCP server for NMEA lines at port xxx]";
+	Info() << "\t[-N and -S take LISTENERS [1-64] - sockets on the port with SO_REUSEPORT, each with its own thread (Linux)]";
 	Info() << "\t[-T xx - auto terminate run with SDR after xxx seconds (default: off)]";
+	Info() << "\t[-U [optional: window in ms] [optional: reorder window in ms] - merge the copies of a message received by several inputs before JSON decoding, optionally after putting the messages of all inputs in time order (default: off, window 2000 ms, no reordering)]";
 	Info() << "\t[-u xxx.xx.xx.xx yyy - UDP destination address and port (default: off)]";
 	Info() << "\t[-v [option: xx] - enable verbose mode, optional to provide update frequency of xx seconds (default: false)]";
+	Info() << "\t[-W [optional: file] - benchmark the DSP alternatives on this host, save the fastest as defaults and terminate (default file: ~/.aiscatcher-tune)]";
+	Info() << "\t[-Y [optional: CU8 file] - benchmark the DSP stages, decoder and message decoding one by one, on the recording or synthetic input, write the results as JSON to stdout and terminate]";
 	Info() << "\t[-X connect to AIS community feed at www.aiscatcher.org (default: off)]";
 	Info() << "\t[-Q publish data to MQTT server]";
 	Info() << "\t[-Z lat lon - set receiver location (latitude and longitude in decimal degrees)]";
+	Info() << "\t[-D, -f, -H, -K, -Q and -u with a worker thread take AFFINITY [cores/off] PRIORITY [0-99] ]";
+	Info() << "\t[-f, -P, -Q, -S and -u with NMEA or binary messages take ASYNC_QUEUE [0 (off) or blocks] ASYNC_BATCH [1-1024] ASYNC_OVERFLOW [block/drop_oldest/drop_newest] ASYNC_SHARED [on/off] ]";
+	Info() << "\t[outputs take PROFILE [on/off] to report the time spent per message on /api/perf ]";
+	Info() << "\t[outputs take LATENCY [on/off] to report the capture to decode, JSON and send latency on /api/stat.json and /metrics ]";
+	Info() << "\t[-f and -u take IO_URING [on/off] to write through one shared io_uring instance - Linux only ]";
+	Info() << "\t[-u to a multicast group takes TTL [0-255] INTERFACE [address/name] LOOP [on/off] ]";
 
 	Info() << "";
 	Info() << "\tDevice selection:";
@@ -114,6 +236,7 @@ static void Usage()
 	Info() << "\t[-l list available devices and terminate (default: off)]";
 	Info() << "\t[-L list supported SDR hardware and terminate (default: off)]";
 	Info() << "\t[-r [optional: yy] filename - read IQ data from file or stdin (.), short for -r -ga FORMAT yy FILE filename";
+	Info() << "\t[-B workers file1 [file2 ...] - decode the files with the -r/-w receiver settings on a pool of workers (0: one per core), @name reads the file names from a list]";
 	Info() << "\t[-t [[protocol]] [host [port]] - read IQ data from remote RTL-TCP instance]";
 	Info() << "\t[-w filename - read IQ data from WAV file, short for -w -gw FILE filename]";
 	Info() << "\t[-x [server][port] - UDP input of NMEA messages at port on server";
@@ -122,23 +245,26 @@ static void Usage()
 	Info() << "";
 	Info() << "\tDevice specific settings:";
 	Info() << "";
-	Info() << "\t[-ga RAW file: FILE [filename] FORMAT [CF32/CS16/CU8/CS8] ]";
-	Info() << "\t[-gd HydraSDR: SENSITIVITY [0-21] LINEARITY [0-21] VGA [0-14] LNA [auto/0-14] MIXER [auto/0-14] BIASTEE [on/off] ]";
-	Info() << "\t[-ge Serial Port: PRINT [on/off] FLOWCONTROL [none/hardware/software] INIT_SEQ [string] ]";
+	Info() << "\t[-g.. all devices: AFFINITY [cores/off] PRIORITY [0-99] for the read thread, RUN_AFFINITY [cores/off] RUN_PRIORITY [0-99] for the decoding thread ]";
+	Info() << "\t[-g.. live devices: FIFO_ADAPTIVE [on/off] FIFO_LATENCY [1-1000 ms] FIFO_MAX [2-1024 blocks] ]";
+	Info() << "\t[-ga RAW file: FILE [filename] FORMAT [CF32/CS16/CU8/CS8] LOOP [on/off] MMAP [on/off] SPEED [0 (unlimited) or factor] BENCHMARK [on/off] REPEAT [1-1000000] ]";
+	Info() << "\t[-gd HydraSDR: SENSITIVITY [0-21] LINEARITY [0-21] VGA [0-14] LNA [auto/0-14] MIXER [auto/0-14] BIASTEE [on/off] PACKED [on/off] ]";
+	Info() << "\t[-ge Serial Port: PRINT [on/off] FLOWCONTROL [none/hardware/software] INIT_SEQ [string] BATCH [0-10000 ms] SHARED [on/off] ]";
 	Info() << "\t[-gf HACKRF: LNA [0-40] VGA [0-62] PREAMP [on/off] ]";
 	Info() << "\t[-gh Airspy HF+: TRESHOLD [low/high] PREAMP [on/off] ]";
-	Info() << "\t[-gm Airspy: SENSITIVITY [0-21] LINEARITY [0-21] VGA [0-14] LNA [auto/0-14] MIXER [auto/0-14] BIASTEE [on/off] ]";
-	Info() << "\t[-gr RTLSDRs: TUNER [auto/0.0-50.0] RTLAGC [on/off] BIASTEE [on/off] ]";
+	Info() << "\t[-gm Airspy: SENSITIVITY [0-21] LINEARITY [0-21] VGA [0-14] LNA [auto/0-14] MIXER [auto/0-14] BIASTEE [on/off] PACKED [on/off] ]";
+	Info() << "\t[-gr RTLSDRs: TUNER [auto/0.0-50.0] RTLAGC [on/off] BIASTEE [on/off] BUFFER_COUNT [1-100] ZERO_COPY [on/off] ]";
 	Info() << "\t[-gs SDRPLAY: GRDB [0-59] LNASTATE [0-9] AGC [on/off] ]";
-	Info() << "\t[-gt RTLTCP: HOST [address] PORT [port] TUNER [auto/0.0-50.0] RTLAGC [on/off] FREQOFFSET [-150-150] PROTOCOL [none/rtltcp] TIMEOUT [1-60] ]";
-	Info() << "\t[-gu SOAPYSDR: DEVICE [string] GAIN [string] AGC [on/off] STREAM [string] SETTING [string] CH [0+] PROBE [on/off] ANTENNA [string] ]";
-	Info() << "\t[-gw WAV file: FILE [filename] ]";
-	Info() << "\t[-gy SPYSERVER: HOST [address] PORT [port] GAIN [0-50] ]";
-	Info() << "\t[-gz ZMQ: ENDPOINT [endpoint] FORMAT [CF32/CS16/CU8/CS8] ]";
+	Info() << "\t[-gt RTLTCP: HOST [address] PORT [port] TUNER [auto/0.0-50.0] RTLAGC [on/off] FREQOFFSET [-150-150] PROTOCOL [none/rtltcp/iqlink] TIMEOUT [1-60] ]";
+	Info() << "\t[-gu SOAPYSDR: DEVICE [string] GAIN [string] AGC [on/off] STREAM [string] SETTING [string] CH [0+] PROBE [on/off] ANTENNA [string] FORMAT [CU8/CS8/CS16/CF32] ]";
+	Info() << "\t[-gw WAV file: FILE [filename] MMAP [on/off] SPEED [0 (unlimited) or factor] ]";
+	Info() << "\t[-gx UDP input: BATCH [1-1024] RCVBUF [bytes] INTERFACE [address/name] to join a multicast group given as server ]";
+	Info() << "\t[-gy SPYSERVER: HOST [address] PORT [port] GAIN [0-50] DIGITAL_GAIN [0-255] FORMAT [AUTO CU8 CS16 CF32] RATE [AUTO rate] ]";
+	Info() << "\t[-gz ZMQ: ENDPOINT [endpoint] FORMAT [CF32/CS16/CU8/CS8] HWM [messages] RCVBUF [bytes] BATCH [1-4096] DIRECT [on/off] ]";
 	Info() << "";
 	Info() << "\tModel specific settings:";
 	Info() << "";
-	Info() << "\t[-go Model: AFC_WIDE [on/off] FP_DS [on/off] PS_EMA [on/off] SOXR [on/off] SRC [on/off] DROOP [on/off] ]";
+	Info() << "\t[-go Model: AFC_WIDE [on/off] AFC_IDLE [on/off] FP_DS [on/off] PS_EMA [on/off] SOXR [on/off] SRC [on/off] RESAMPLE [on/off] GPU [on/off] CHANNELIZER [on/off] DROOP [on/off] SIMD [auto/scalar/sse/avx2/neon] HUGE_PAGES [on/off] FAST_FM [on/off] SQUELCH [on/off] SQUELCH_PRE [0-500 ms] SQUELCH_POST [0-500 ms] THREADS [on/off/shared] EXECUTOR_WORKERS [0-256] EXECUTOR_AFFINITY [on/off] DEDUP [on/off] WORKERS [0-32] PROFILE [on/off] IQ_SERVER [port] IQ_BITS [4/8] RTLTCP_SERVER [port] SHARE_FRONTEND [on/off] SHED [on/off] SHED_LOAD [10-100 %] DUMP [prefix] DUMP_TRIGGER [off/msg/crc] DUMP_PRE [0-5000 ms] DUMP_POST [0-5000 ms] DUMP_BUFFER [1-1024 MB] SPECTRUM [on/off] SPECTRUM_SIZE [64-8192] SPECTRUM_AVERAGE [1-64] SPECTRUM_INTERVAL [100-60000 ms] ]";
 }
 
 static void printBuildConfiguration()
@@ -179,6 +305,9 @@ static void printBuildConfiguration()
 #ifdef HASSOXR
 	other_support << "SOXR ";
 #endif
+#ifdef HASOPENCL
+	other_support << "OPENCL ";
+#endif
 #ifdef HASSYSLOG
 	other_support << "SYSLOG ";
 #endif
@@ -197,6 +326,9 @@ static void printBuildConfiguration()
 #ifdef HASZLIB
 	other_support << "ZLIB ";
 #endif
+#ifdef HASZSTD
+	other_support << "ZSTD ";
+#endif
 #ifdef HASSAMPLERATE
 	other_support << "LIBSAMPLERATE ";
 #endif
@@ -212,6 +344,7 @@ static void printBuildConfiguration()
 
 	// Output all other support messages on one line
 	Info() << other_support.str();
+	Info() << "DSP kernels: " << DSP::Kernels::getName();
 }
 
 // -------------------------------
@@ -257,6 +390,180 @@ static void Assert(bool b, std::string &context, std::string msg = "")
 	}
 }
 
+static const std::string MSG_NO_PARAMETER = "does not allow additional parameter.";
+
+// settings that apply to the current receiver, returns false if param is not one of them
+static bool parseReceiverSetting(Receiver &receiver, char *argv[], int ptr, int count)
+{
+	std::string param = std::string(argv[ptr]);
+	std::string arg1 = count >= 1 ? std::string(argv[ptr + 1]) : "";
+	std::string arg2 = count >= 2 ? std::string(argv[ptr + 2]) : "";
+	int argc = ptr + count + 1;
+
+	switch (param[1])
+	{
+	case 's':
+		Assert(count == 1, param, "does require one parameter [sample rate].");
+		receiver.setSampleRate(Util::Parse::Integer(arg1, 12500, 12288000));
+		break;
+	case 'm':
+		Assert(count == 1, param, "requires one parameter [model number].");
+		receiver.addModel(Util::Parse::Integer(arg1, 0, 9));
+		break;
+	case 'M':
+		Assert(count <= 1, param, "requires zero or one parameter [DT].");
+		receiver.clearTags();
+		receiver.setTags(arg1);
+		break;
+	case 'c':
+		Assert(count <= 2 && count >= 1, param, "requires one or two parameter [AB/CD]].");
+		if (count == 1)
+			receiver.setChannel(arg1);
+		if (count == 2)
+			receiver.setChannel(arg1, arg2);
+		break;
+	case 'F':
+		Assert(count == 0, param, MSG_NO_PARAMETER);
+		receiver.addModel(2)->Set("FP_DS", "ON").Set("PS_EMA", "ON");
+		receiver.removeTags("DT");
+		break;
+	case 'b':
+		Assert(count == 0, param, MSG_NO_PARAMETER);
+		receiver.Timing() = true;
+		break;
+	case 'Z':
+		Assert(count == 2, param, "Location Setting requires two parameters (lat/lon)");
+		receiver.setLatLon(Util::Parse::Float(arg1), Util::Parse::Float(arg2));
+		break;
+	case 'p':
+		Assert(count == 1, param, "requires one parameter [frequency offset].");
+		receiver.setPPM(Util::Parse::Integer(arg1, -150, 150));
+		break;
+	case 'a':
+		Assert(count == 1, param, "requires one parameter [bandwidth].");
+		receiver.setBandwidth(Util::Parse::Integer(arg1, 0, 20000000));
+		break;
+	case 'g':
+		Assert(count % 2 == 0 && param.length() == 3, param);
+		switch (param[2])
+		{
+		case 'e':
+			parseSettings(receiver.getDeviceManager().SerialPort(), argv, ptr, argc);
+			break;
+		case 'm':
+			parseSettings(receiver.getDeviceManager().AIRSPY(), argv, ptr, argc);
+			break;
+		case 'd':
+			parseSettings(receiver.getDeviceManager().HYDRASDR(), argv, ptr, argc);
+			break;					
+		case 'r':
+			parseSettings(receiver.getDeviceManager().RTLSDR(), argv, ptr, argc);
+			break;
+		case 'h':
+			parseSettings(receiver.getDeviceManager().AIRSPYHF(), argv, ptr, argc);
+			break;
+		case 's':
+			parseSettings(receiver.getDeviceManager().SDRPLAY(), argv, ptr, argc);
+			break;
+		case 'a':
+			parseSettings(receiver.getDeviceManager().RAW(), argv, ptr, argc);
+			break;
+		case 'w':
+			parseSettings(receiver.getDeviceManager().WAV(), argv, ptr, argc);
+			break;
+		case 't':
+			parseSettings(receiver.getDeviceManager().RTLTCP(), argv, ptr, argc);
+			break;
+		case 'y':
+			parseSettings(receiver.getDeviceManager().SpyServer(), argv, ptr, argc);
+			break;
+		case 'f':
+			parseSettings(receiver.getDeviceManager().HACKRF(), argv, ptr, argc);
+			break;
+		case 'u':
+			parseSettings(receiver.getDeviceManager().SOAPYSDR(), argv, ptr, argc);
+			break;
+		case 'z':
+			parseSettings(receiver.getDeviceManager().ZMQ(), argv, ptr, argc);
+			break;
+		case 'x':
+			parseSettings(receiver.getDeviceManager().UDP(), argv, ptr, argc);
+			break;
+		case 'o':
+			if (receiver.Count() == 0)
+				receiver.addModel(receiver.getDeviceManager().isTXTformatSet() ? 5 : 2);
+			parseSettings(*receiver.Model(receiver.Count() - 1), argv, ptr, argc);
+			break;
+		default:
+			throw std::runtime_error("invalid -g switch on command line");
+		}
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+// replays the recorded receiver settings on a new receiver for the next file in batch mode
+static void replayReceiverSettings(Receiver &receiver, char *argv[], const std::vector<std::pair<int, int>> &args)
+{
+	for (const auto &a : args)
+	{
+		int ptr = a.first, count = a.second;
+
+		switch (argv[ptr][1])
+		{
+		case 'r':
+			receiver.getDeviceManager().InputType() = Type::RAWFILE;
+			if (count == 2)
+				receiver.getDeviceManager().RAW().Set("FORMAT", argv[ptr + 1]);
+			break;
+		case 'w':
+			receiver.getDeviceManager().InputType() = Type::WAVFILE;
+			break;
+		case 'H':
+			receiver.setTags("DT");
+			break;
+		case 'v':
+			receiver.verbose = true;
+			break;
+		default:
+			parseReceiverSetting(receiver, argv, ptr, count);
+			break;
+		}
+	}
+}
+
+// adds a file name to the batch, @name reads the file names from a list (one per line)
+static void addBatchFile(const std::string &name, std::vector<std::string> &files)
+{
+	if (name.empty() || name[0] != '@')
+	{
+		files.push_back(name);
+		return;
+	}
+
+	std::ifstream list(name.substr(1));
+	if (!list)
+		throw std::runtime_error("cannot open batch list \"" + name.substr(1) + "\"");
+
+	std::string line;
+	while (std::getline(list, line))
+	{
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (!line.empty() && line[0] != '#')
+			files.push_back(line);
+	}
+}
+
+static void setBatchFile(Receiver &receiver, const std::string &file)
+{
+	if (receiver.getDeviceManager().InputType() == Type::WAVFILE)
+		receiver.getDeviceManager().WAV().Set("FILE", file);
+	else
+		receiver.getDeviceManager().RAW().Set("FILE", file);
+}
+
 int main(int argc, char *argv[])
 {
 	std::vector<std::unique_ptr<Receiver>> _receivers;
@@ -270,15 +577,33 @@ int main(int argc, char *argv[])
 	std::vector<std::unique_ptr<IO::OutputMessage>> msg;
 	std::vector<std::unique_ptr<IO::OutputJSON>> json;
 
-	bool list_devices = false, list_support = false, list_options = false;
+	AIS::Aggregator aggregator;
+	bool aggregate = false;
+	AIS::MessageMerge merge;
+	bool merging = false;
+
+	bool list_devices = false, list_support = false, list_options = false, autotune = false, microbench = false;
+	std::string file_tune = DSP::Tuning::defaultFile();
+	std::string file_microbench;
 	int timeout = 0, nrec = 0, exit_code = 0;
 	bool timeout_nomsg = false, list_devices_JSON = false, no_run = false, show_copyright = true;
 	int own_mmsi = -1;
 	int cb = -1;
 
+	// batch mode: one receiver per file, at most batch_workers running at the same time
+	std::vector<std::string> batch_files;
+	std::vector<std::pair<int, int>> batch_args;
+	int batch_workers = 0;
+
 	Config c(_receivers, nrec, msg, json, screen, servers, own_mmsi);
 	extern IO::OutputMessage *commm_feed;
 
+	// the outputs read from the config files, replaced on reload
+	std::vector<std::string> config_files;
+	std::vector<IO::OutputMessage *> config_msg;
+	std::vector<IO::OutputJSON *> config_json;
+	std::map<const Setting *, std::string> config_signature;
+
 	try
 	{
 		Logger::getInstance().setMaxBufferSize(50);
@@ -295,9 +620,14 @@ int main(int argc, char *argv[])
 		signal(SIGPIPE, consoleHandler);
 #endif
 
-		_receivers.back()->getDeviceManager().refreshDevices();
+		// defaults from an earlier autotune on this host, unless -W redoes it
+		bool retune = false;
+		for (int i = 1; i < argc; i++)
+			retune |= std::string(argv[i]) == "-W";
+
+		if (!retune && DSP::Tuning::get().load(file_tune))
+			Info() << "Autotune: loaded " << file_tune;
 
-		const std::string MSG_NO_PARAMETER = "does not allow additional parameter.";
 		int ptr = 1;
 
 		while (ptr < argc)
@@ -331,32 +661,26 @@ int main(int argc, char *argv[])
 				}
 				parseSettings(Logger::getInstance(), argv, ptr, argc);
 				break;
-			case 's':
-				Assert(count == 1, param, "does require one parameter [sample rate].");
-				receiver.setSampleRate(Util::Parse::Integer(arg1, 12500, 12288000));
-				break;
-			case 'm':
-				Assert(count == 1, param, "requires one parameter [model number].");
-				receiver.addModel(Util::Parse::Integer(arg1, 0, 9));
-				break;
-			case 'M':
-				Assert(count <= 1, param, "requires zero or one parameter [DT].");
-				receiver.clearTags();
-				receiver.setTags(arg1);
-				break;
-			case 'c':
-				Assert(count <= 2 && count >= 1, param, "requires one or two parameter [AB/CD]].");
-				if (count == 1)
-					receiver.setChannel(arg1);
-				if (count == 2)
-					receiver.setChannel(arg1, arg2);
-				break;
 			case 'C':
 				Assert(count == 1, param, "one parameter required: filename");
 
 				if (!arg1.empty())
 				{
+					int nmsg = (int)msg.size(), njson = (int)json.size();
 					c.read(arg1);
+					config_files.push_back(arg1);
+
+					for (int i = nmsg; i < (int)msg.size(); i++)
+						if (msg[i].get() != commm_feed)
+						{
+							config_msg.push_back(msg[i].get());
+							config_signature[msg[i].get()] = c.getSignature(msg[i].get());
+						}
+					for (int i = njson; i < (int)json.size(); i++)
+					{
+						config_json.push_back(json[i].get());
+						config_signature[json[i].get()] = c.getSignature(json[i].get());
+					}
 				}
 				break;
 			case 'N':
@@ -396,6 +720,16 @@ int main(int argc, char *argv[])
 					parseSettings(f, argv, ptr + (count % 2), argc);
 			}
 			break;
+			case 'R':
+			{
+				msg.push_back(std::unique_ptr<IO::OutputMessage>(new IO::SharedMemoryOutput()));
+				IO::OutputMessage &r = *msg.back();
+				if (count % 2 == 1)
+					r.Set("NAME", arg1);
+				if (count > 1)
+					parseSettings(r, argv, ptr + (count % 2), argc);
+			}
+			break;
 			case 'v':
 				Assert(count <= 1, param);
 				receiver.verbose = true;
@@ -412,6 +746,21 @@ int main(int argc, char *argv[])
 				if (count == 2)
 					timeout_nomsg = true;
 				break;
+			case 'J':
+				Assert(count == 1, param, "requires one parameter [MB].");
+				MemoryBudget::set((std::size_t)Util::Parse::Integer(arg1, 0, 65536) << 20);
+				break;
+			case 'U':
+				Assert(count <= 2, param, "requires zero, one or two parameters [window in ms] [reorder window in ms].");
+				aggregate = true;
+				if (count >= 1)
+					aggregator.setWindow(Util::Parse::Integer(arg1, 1, 60000));
+				if (count == 2)
+				{
+					merge.setWindow(Util::Parse::Integer(arg2, 1, 5000));
+					merging = true;
+				}
+				break;
 			case 'q':
 				Assert(count == 0, param, MSG_NO_PARAMETER);
 				screen.setScreen("0");
@@ -428,11 +777,6 @@ int main(int argc, char *argv[])
 					parseSettings(screen, argv, ptr + 1, argc);
 				}
 				break;
-			case 'F':
-				Assert(count == 0, param, MSG_NO_PARAMETER);
-				receiver.addModel(2)->Set("FP_DS", "ON").Set("PS_EMA", "ON");
-				receiver.removeTags("DT");
-				break;
 			case 't':
 				Assert(count <= 3, param, "requires one parameter [url], or two or three parameters [[protocol]] [host] [port].");
 				if (++nrec > 1)
@@ -474,6 +818,24 @@ int main(int argc, char *argv[])
 				}
 			}
 			break;
+			case 'K':
+			{
+				json.push_back(std::unique_ptr<IO::OutputJSON>(new IO::SQLite()));
+				IO::OutputJSON &d = *json.back();
+
+				if (count % 2 == 1)
+				{
+					d.Set("FILE", arg1);
+					if (count > 1)
+						parseSettings(d, argv, ptr + 1, argc);
+				}
+				else
+				{
+					if (count >= 2)
+						parseSettings(d, argv, ptr, argc);
+				}
+			}
+			break;
 			case 'y':
 				Assert(count <= 2, param, "requires one or two parameters [url] or [host] [port].");
 				if (++nrec > 1)
@@ -498,10 +860,6 @@ int main(int argc, char *argv[])
 				if (count == 2)
 					_receivers.back()->getDeviceManager().ZMQ().Set("FORMAT", arg1).Set("ENDPOINT", arg2);
 				break;
-			case 'b':
-				Assert(count == 0, param, MSG_NO_PARAMETER);
-				receiver.Timing() = true;
-				break;
 			case 'i':
 				Assert(count <= 1, param, "requires at most one option parameter.");
 				if (++nrec > 1)
@@ -513,6 +871,12 @@ int main(int argc, char *argv[])
 					_receivers.back()->getDeviceManager().N2KSCAN().Set("INTERFACE", arg1);
 				break;
 
+			case 'B':
+				Assert(count >= 2, param, "requires the number of workers and at least one file.");
+				batch_workers = Util::Parse::Integer(arg1, 0, 256);
+				for (int i = 2; i <= count; i++)
+					addBatchFile(argv[ptr + i], batch_files);
+				break;
 			case 'w':
 				Assert(count <= 1, param);
 				if (++nrec > 1)
@@ -557,6 +921,17 @@ int main(int argc, char *argv[])
 				Assert(count == 0, param, MSG_NO_PARAMETER);
 				list_support = true;
 				break;
+			case 'W':
+				Assert(count <= 1, param, "requires zero or one parameter [file].");
+				if (count == 1)
+					file_tune = arg1;
+				autotune = true;
+				break;
+			case 'Y':
+				Assert(count <= 1, param, "requires zero or one parameter [file].");
+				file_microbench = count == 1 ? arg1 : "";
+				microbench = true;
+				break;
 			case 'd':
 				if (++nrec > 1)
 				{
@@ -644,10 +1019,6 @@ int main(int argc, char *argv[])
 					receiver.setTags("DT");
 				}
 				break;
-			case 'Z':
-				Assert(count == 2, param, "Location Setting requires two parameters (lat/lon)");
-				receiver.setLatLon(Util::Parse::Float(arg1), Util::Parse::Float(arg2));
-				break;
 			case 'A':
 			case 'E':
 				throw std::runtime_error("Option -" + std::string(1, param[1]) + " is obsolete. Please use -I instead.");
@@ -685,70 +1056,14 @@ int main(int argc, char *argv[])
 				else
 					list_options = true;
 				break;
-			case 'p':
-				Assert(count == 1, param, "requires one parameter [frequency offset].");
-				receiver.setPPM(Util::Parse::Integer(arg1, -150, 150));
-				break;
-			case 'a':
-				Assert(count == 1, param, "requires one parameter [bandwidth].");
-				receiver.setBandwidth(Util::Parse::Integer(arg1, 0, 20000000));
-				break;
-			case 'g':
-				Assert(count % 2 == 0 && param.length() == 3, param);
-				switch (param[2])
-				{
-				case 'e':
-					parseSettings(receiver.getDeviceManager().SerialPort(), argv, ptr, argc);
-					break;
-				case 'm':
-					parseSettings(receiver.getDeviceManager().AIRSPY(), argv, ptr, argc);
-					break;
-				case 'd':
-					parseSettings(receiver.getDeviceManager().HYDRASDR(), argv, ptr, argc);
-					break;					
-				case 'r':
-					parseSettings(receiver.getDeviceManager().RTLSDR(), argv, ptr, argc);
-					break;
-				case 'h':
-					parseSettings(receiver.getDeviceManager().AIRSPYHF(), argv, ptr, argc);
-					break;
-				case 's':
-					parseSettings(receiver.getDeviceManager().SDRPLAY(), argv, ptr, argc);
-					break;
-				case 'a':
-					parseSettings(receiver.getDeviceManager().RAW(), argv, ptr, argc);
-					break;
-				case 'w':
-					parseSettings(receiver.getDeviceManager().WAV(), argv, ptr, argc);
-					break;
-				case 't':
-					parseSettings(receiver.getDeviceManager().RTLTCP(), argv, ptr, argc);
-					break;
-				case 'y':
-					parseSettings(receiver.getDeviceManager().SpyServer(), argv, ptr, argc);
-					break;
-				case 'f':
-					parseSettings(receiver.getDeviceManager().HACKRF(), argv, ptr, argc);
-					break;
-				case 'u':
-					parseSettings(receiver.getDeviceManager().SOAPYSDR(), argv, ptr, argc);
-					break;
-				case 'z':
-					parseSettings(receiver.getDeviceManager().ZMQ(), argv, ptr, argc);
-					break;
-				case 'o':
-					if (receiver.Count() == 0)
-						receiver.addModel(receiver.getDeviceManager().isTXTformatSet() ? 5 : 2);
-					parseSettings(*receiver.Model(receiver.Count() - 1), argv, ptr, argc);
-					break;
-				default:
-					throw std::runtime_error("invalid -g switch on command line");
-				}
-				break;
 			default:
-				throw std::runtime_error("unknown option on command line (" + std::string(1, param[1]) + ").");
+				if (!parseReceiverSetting(receiver, argv, ptr, count))
+					throw std::runtime_error("unknown option on command line (" + std::string(1, param[1]) + ").");
 			}
 
+			if (std::string("rwsmMcFbZpagHv").find(param[1]) != std::string::npos)
+				batch_args.push_back({ptr, count});
+
 			ptr += count + 1;
 		}
 
@@ -771,29 +1086,67 @@ int main(int argc, char *argv[])
 			printBuildConfiguration();
 		if (list_options)
 			Usage();
-		if (list_devices || list_support || list_options || no_run)
+		if (autotune)
+		{
+			DSP::Tuning::get().run(500);
+			if (!DSP::Tuning::get().save(file_tune))
+				throw std::runtime_error("cannot write autotune results to \"" + file_tune + "\"");
+			Info() << "Autotune: saved to " << file_tune;
+		}
+		if (microbench)
+		{
+			int failed;
+			std::cout << DSP::Microbench::run(300, file_microbench, failed);
+			if (failed)
+				throw std::runtime_error("microbench: " + std::to_string(failed) + " check(s) failed");
+		}
+
+		if (list_devices || list_support || list_options || no_run || autotune || microbench)
 			return 0;
 
 		// -------------
 		// set up the receiver and open the device
 
-		stat.resize(_receivers.size());
-		msg_count.resize(_receivers.size(), 0);
+		const bool batch = !batch_files.empty();
+
+		if (batch)
+		{
+			Type t = _receivers.back()->getDeviceManager().InputType();
+
+			if (_receivers.size() != 1)
+				throw std::runtime_error("batch mode (-B) requires a single receiver definition.");
+			if (t != Type::RAWFILE && t != Type::WAVFILE)
+				throw std::runtime_error("batch mode (-B) requires RAW (-r) or WAV (-w) file input.");
+
+			if (batch_workers == 0)
+				batch_workers = std::max(1, (int)std::thread::hardware_concurrency());
+
+			setBatchFile(*_receivers.back(), batch_files[0]);
+			Info() << "Batch: " << batch_files.size() << " file(s) on " << batch_workers << " worker(s)";
+		}
+
+		const int njobs = batch ? (int)batch_files.size() : (int)_receivers.size();
+
+		stat.resize(njobs);
+		msg_count.resize(njobs, 0);
 
 		int group = 0;
 
-		for (int i = 0; i < _receivers.size(); i++)
+		auto setupReceiver = [&](int i)
 		{
-
 			Receiver &r = *_receivers[i];
 			r.setOwnMMSI(own_mmsi);
+			if (aggregate)
+				r.setAggregator(&aggregator);
 
 			if (servers.size() > 0 && servers[0]->active())
 				r.setTags("DTM");
 
 			r.setupDevice();
-			// set up the decoding model(s), group is the last output group used
-			r.setupModel(group);
+			// set up the decoding model(s), group is the last output group used,
+			// all files in a batch share the output groups of the first
+			int g = 0;
+			r.setupModel(batch ? g : group);
 
 			// set up all the output and connect to the receiver outputs
 			for (auto &o : msg)
@@ -807,9 +1160,25 @@ int main(int argc, char *argv[])
 				if (s->active())
 					s->connect(r);
 
-			if (r.verbose || timeout_nomsg)
+			if (r.verbose || timeout_nomsg || r.Timing())
 				stat[i].connect(r);
-		}
+		};
+
+		// next file in the batch gets a receiver with the same settings
+		auto startBatchJob = [&]()
+		{
+			int i = (int)_receivers.size();
+
+			_receivers.push_back(std::unique_ptr<Receiver>(new Receiver()));
+			replayReceiverSettings(*_receivers.back(), argv, batch_args);
+			setBatchFile(*_receivers.back(), batch_files[i]);
+
+			setupReceiver(i);
+			_receivers.back()->play();
+		};
+
+		for (int i = 0; i < _receivers.size(); i++)
+			setupReceiver(i);
 
 		for (auto &o : msg)
 			o->Start();
@@ -817,6 +1186,116 @@ int main(int argc, char *argv[])
 		for (auto &j : json)
 			j->Start();
 
+		// outputs read again with the same settings keep running. The others are disconnected under the
+		// message lock, deliver what is queued and stop, before the new ones start, so that a listener
+		// can bind the same port. The devices and models keep running throughout.
+		auto reloadOutputs = [&]()
+		{
+			std::vector<std::unique_ptr<IO::OutputMessage>> new_msg;
+			std::vector<std::unique_ptr<IO::OutputJSON>> new_json;
+			std::vector<IO::OutputMessage *> kept_msg;
+			std::vector<IO::OutputJSON *> kept_json;
+
+			try
+			{
+				Config rc(_receivers, nrec, new_msg, new_json, screen, servers, own_mmsi);
+				for (auto &f : config_files)
+					rc.readOutputs(f);
+
+				keepUnchanged(config_msg, new_msg, config_signature, rc, kept_msg);
+				keepUnchanged(config_json, new_json, config_signature, rc, kept_json);
+			}
+			catch (std::exception &e)
+			{
+				Error() << "Reload: " << e.what() << " (outputs not changed)";
+				return;
+			}
+
+			int stopped = (int)(config_msg.size() + config_json.size());
+
+			{
+				std::lock_guard<std::mutex> lock(AIS::MessageMutex::getMutex());
+
+				for (auto &r : _receivers)
+				{
+					for (auto o : config_msg)
+						o->Disconnect(*r);
+					for (auto j : config_json)
+						j->Disconnect(*r);
+				}
+			}
+
+			for (auto &s : servers)
+			{
+				for (auto o : config_msg)
+					s->removeMetrics(o);
+				for (auto j : config_json)
+					s->removeMetrics(j);
+			}
+
+			removeOutputs(config_msg, msg, config_signature);
+			removeOutputs(config_json, json, config_signature);
+
+			startOutputs(new_msg);
+			startOutputs(new_json);
+
+			std::vector<std::unique_ptr<IO::OutputMessage>> failed_msg;
+			std::vector<std::unique_ptr<IO::OutputJSON>> failed_json;
+			{
+				std::lock_guard<std::mutex> lock(AIS::MessageMutex::getMutex());
+
+				connectOutputs(new_msg, _receivers, failed_msg);
+				connectOutputs(new_json, _receivers, failed_json);
+
+				for (auto &r : _receivers)
+					r->reconnectJSON();
+			}
+
+			for (auto &o : failed_msg)
+			{
+				stopOutput(o.get());
+				config_signature.erase(o.get());
+			}
+			for (auto &j : failed_json)
+			{
+				stopOutput(j.get());
+				config_signature.erase(j.get());
+			}
+
+			int started = (int)(new_msg.size() + new_json.size());
+			config_msg = kept_msg;
+			config_json = kept_json;
+
+			for (auto &o : new_msg)
+			{
+				for (auto &s : servers)
+					s->addMetrics(o.get());
+				config_msg.push_back(o.get());
+				msg.push_back(std::move(o));
+			}
+			for (auto &j : new_json)
+			{
+				for (auto &s : servers)
+					s->addMetrics(j.get());
+				config_json.push_back(j.get());
+				json.push_back(std::move(j));
+			}
+
+			Info() << "Reload: " << kept_msg.size() + kept_json.size() << " outputs unchanged, " << stopped << " stopped, " << started << " started.";
+		};
+
+		for (auto &s : servers)
+		{
+			for (auto &j : json)
+				s->addMetrics(j.get());
+			for (auto &o : msg)
+				s->addMetrics(o.get());
+			if (aggregate)
+				s->addMetrics(&aggregator);
+			if (merging)
+				s->addMetrics(&merge);
+		}
+
 		for (auto &s : servers)
 			if (s->active())
 			{
@@ -832,11 +1311,39 @@ int main(int argc, char *argv[])
 		for (auto &s : stat)
 			s.start();
 
+		// from here on log messages from the decoders are delivered by the logger thread
+		Logger::getInstance().startDispatcher();
+		Util::Clock::start();
+
+		if (merging)
+		{
+			AIS::MessageMutex::setMerge(&merge);
+			merge.start(AIS::MessageMutex::getMutex());
+		}
+
+		bool timing = false;
+		for (auto &r : _receivers)
+			timing |= r->Timing();
+
+		if (timing)
+			Util::AllocCount::start();
+
 		DBG("Starting receivers");
 		for (auto &r : _receivers)
 			r->play();
 
+		std::vector<bool> finished(_receivers.size(), false);
+		int batch_done = 0;
+
+		while (batch && (int)_receivers.size() < std::min(batch_workers, njobs))
+		{
+			startBatchJob();
+			finished.push_back(false);
+		}
+
 		stop = false;
+		reload = false;
+		reloadable = !config_files.empty() && !batch;
 		const int SLEEP = 50;
 		auto time_start = high_resolution_clock::now();
 		auto time_timeout_start = time_start;
@@ -852,8 +1359,47 @@ int main(int argc, char *argv[])
 		DBG("Entering main loop");
 		while (!stop)
 		{
-			for (auto &r : _receivers)
-				stop = stop || !(r->getDeviceManager().getDevice()->isStreaming());
+			if (batch)
+			{
+				int active = 0;
+
+				for (int i = 0; i < _receivers.size(); i++)
+				{
+					if (finished[i])
+						continue;
+
+					if (_receivers[i]->getDeviceManager().getDevice()->isStreaming())
+					{
+						active++;
+						continue;
+					}
+
+					_receivers[i]->stop();
+					finished[i] = true;
+					Info() << "Batch: finished " << batch_files[i] << " (" << ++batch_done << "/" << njobs << ")";
+				}
+
+				for (; !stop && active < batch_workers && (int)_receivers.size() < njobs; active++)
+				{
+					startBatchJob();
+					finished.push_back(false);
+				}
+
+				stop = stop || active == 0;
+			}
+			else
+				for (auto &r : _receivers)
+					stop = stop || !(r->getDeviceManager().getDevice()->isStreaming());
+
+			if (reload.exchange(false))
+			{
+				Info() << "Reload: reading the outputs from the config file.";
+				reloadOutputs();
+			}
+
+			for (auto &s : servers)
+				if (s->active())
+					s->tick();
 
 			if (iscallback) // don't go to sleep in case we are reading from a file
 				std::this_thread::sleep_for(std::chrono::milliseconds(SLEEP));
@@ -872,6 +1418,16 @@ int main(int argc, char *argv[])
 					Receiver &r = *_receivers[i];
 					if (r.verbose)
 					{
+						std::string status = stat[i].getDeviceStatus(), load = r.getLoadStatus();
+						if (!load.empty())
+							status += (status.empty() ? "" : ", ") + load;
+
+						if (!status.empty())
+						{
+							std::string name = "device #" + std::to_string(i);
+							Info() << "[" << name << "] " << std::string(37 - name.length(), ' ') << status;
+						}
+
 						for (int j = 0; j < r.Count(); j++)
 						{
 							stat[i].statistics[j].Stamp();
@@ -881,6 +1437,18 @@ int main(int argc, char *argv[])
 						}
 					}
 				}
+
+				if (aggregate)
+				{
+					std::string name = "aggregator";
+					Info() << "[" << name << "] " << std::string(37 - name.length(), ' ') << aggregator.getStatus();
+				}
+
+				if (merging)
+				{
+					std::string name = "merge";
+					Info() << "[" << name << "] " << std::string(37 - name.length(), ' ') << merge.getStatus();
+				}
 			}
 
 			if (timeout && timeout_nomsg)
@@ -912,11 +1480,17 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		reloadable = false;
+
+		double run_time = duration_cast<duration<double>>(high_resolution_clock::now() - time_start).count();
+		uint64_t messages = 0;
+
 		std::stringstream ss;
 		for (int i = 0; i < _receivers.size(); i++)
 		{
 			Receiver &r = *_receivers[i];
-			r.stop();
+			if (!finished[i])
+				r.stop();
 
 			// End Main loop
 			// -----------------
@@ -936,11 +1510,35 @@ int main(int argc, char *argv[])
 				for (int j = 0; j < r.Count(); j++)
 				{
 					std::string name = r.Model(j)->getName();
-					ss << "[" << r.Model(j)->getName() << "]: " << std::string(37 - name.length(), ' ') << r.Model(j)->getTotalTiming() << " ms" << "\n";
+					ss << "[" << r.Model(j)->getName() << "]: " << std::string(37 - name.length(), ' ') << r.Model(j)->getTotalTiming() << " ms" << r.Model(j)->getTimingDetails() << r.getJSONTimingDetails(j) << "\n";
+
+					uint64_t count = stat[i].statistics[j].getCount();
+					messages += count;
+					ss << "[" << r.Model(j)->getName() << "]: " << std::string(37 - name.length(), ' ') << count << " msgs in " << run_time << " s, " << (run_time > 0 ? count / run_time : 0) << " msgs/s\n";
 				}
 			Info() << ss.str();
 		}
 
+		// the stages with PROFILE on and the allocations over the whole run
+		if (timing)
+		{
+			ss.str("");
+			for (auto &s : Util::Perf::get().getStages())
+				ss << "[" << s.name << "]: " << std::string(MAX(37 - (int)s.name.length(), 1), ' ') << s.total_ns / 1e6 << " ms for " << s.samples << " items, " << (s.samples ? (double)s.total_ns / s.samples : 0) << " ns per item\n";
+
+			uint64_t allocs = Util::AllocCount::get();
+			ss << "[allocations]: " << std::string(37 - 11, ' ') << allocs << " allocations, " << (messages ? (double)allocs / messages : 0) << " per message\n";
+			ss << getModelComparison(_receivers);
+			Info() << ss.str();
+		}
+
+		// pass on what the merge still holds before the outputs stop
+		merge.stop();
+		AIS::MessageMutex::setMerge(nullptr);
+
+		for (auto &o : msg)
+			o->StopQueue();
+
 		for (auto &s : servers)
 			s->close();
 	}
@@ -949,8 +1547,14 @@ int main(int argc, char *argv[])
 		Error() << e.what();
 		for (auto &r : _receivers)
 			r->stop();
+		merge.stop();
+		AIS::MessageMutex::setMerge(nullptr);
+		for (auto &o : msg)
+			o->StopQueue();
 		exit_code = -1;
 	}
 
+	Util::Clock::stop();
+	Logger::getInstance().stopDispatcher();
 	return exit_code;
 }
@@ -22,9 +22,12 @@
 #include <algorithm>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
 #include <stdexcept>
 
 #include "Logger.h"
+#include "ZIP.h"
+#include "MemoryBudget.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -42,6 +45,87 @@ MapTiles::MapTiles() : minZoom(0), maxZoom(18)
     layerID = std::to_string((uintptr_t)this);
 }
 
+MapTiles::~MapTiles()
+{
+    MemoryBudget::account(MemoryBudget::CACHE, cache_reported, 0);
+}
+
+void MapTiles::setCacheSize(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_limit = bytes;
+    evict();
+}
+
+void MapTiles::evict()
+{
+    while (cache_bytes > cache_limit && !lru.empty())
+    {
+        cache_bytes -= footprint(*lru.back().second);
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+
+    MemoryBudget::account(MemoryBudget::CACHE, cache_reported, cache_bytes);
+}
+
+TilePtr MapTiles::getTile(int z, int x, int y)
+{
+    const uint64_t key = ((uint64_t)z << 56) | ((uint64_t)x << 28) | (uint64_t)y;
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            lru.splice(lru.begin(), lru, it->second);
+            hits++;
+            return it->second->second;
+        }
+    }
+
+    // load outside the lock so misses on different tiles proceed in parallel
+    misses++;
+    std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+
+    if (!loadTile(z, x, y, tile->data, tile->contentType) || tile->data.empty())
+    {
+        tile->data.clear();
+        tile->contentType.clear();
+    }
+    else
+    {
+        // FNV-1a of the content, stable across restarts
+        uint64_t h = 14695981039346656037ULL;
+        for (unsigned char c : tile->data)
+            h = (h ^ c) * 1099511628211ULL;
+
+        char buf[40];
+        snprintf(buf, sizeof(buf), "\"%016llx-%zx\"", (unsigned long long)h, tile->data.size());
+        tile->etag = buf;
+
+        // images are already compressed, gzipping them again only costs time
+        if (tile->contentType.compare(0, 6, "image/") != 0)
+        {
+            ZIP &zip = ZIP::local();
+            if (zip.zip((const char *)tile->data.data(), tile->data.size()))
+                tile->zipped.assign(zip.getOutputPtr(), zip.getOutputPtr() + zip.getOutputLength());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = index.find(key);
+    if (it != index.end())
+        return it->second->second;
+
+    lru.emplace_front(key, tile);
+    index[key] = lru.begin();
+    cache_bytes += footprint(*tile);
+    evict();
+
+    return tile;
+}
+
 bool MapTiles::isValidCoordinate(int z, int x, int y) const
 {
     if (z < minZoom || z > maxZoom)
@@ -59,10 +143,69 @@ MBTilesSupport::MBTilesSupport() : db(nullptr) {}
 
 MBTilesSupport::~MBTilesSupport()
 {
+    for (Reader &r : pool)
+    {
+        sqlite3_finalize(r.stmt);
+        sqlite3_close(r.db);
+    }
+
     if (db)
         sqlite3_close(db);
 }
 
+bool MBTilesSupport::acquire(Reader &r)
+{
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        pool_free.wait(lock, [this]
+                       { return !pool.empty() || pool_open < POOL_MAX; });
+
+        if (!pool.empty())
+        {
+            r = pool.back();
+            pool.pop_back();
+            return true;
+        }
+        pool_open++;
+    }
+
+    // each reader has its own connection, no locking needed inside SQLite
+    const char *query = "SELECT tile_data FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?";
+
+    if (sqlite3_open_v2(filename.c_str(), &r.db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(r.db, query, -1, &r.stmt, nullptr) != SQLITE_OK)
+    {
+        Error() << "MBTILES: Failed to open reader: " << sqlite3_errmsg(r.db);
+        release(r, false);
+        return false;
+    }
+    return true;
+}
+
+void MBTilesSupport::release(Reader &r, bool ok)
+{
+    if (ok)
+    {
+        sqlite3_reset(r.stmt);
+        sqlite3_clear_bindings(r.stmt);
+    }
+    else
+    {
+        sqlite3_finalize(r.stmt);
+        sqlite3_close(r.db);
+        r = Reader();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (ok)
+            pool.push_back(r);
+        else
+            pool_open--;
+    }
+    pool_free.notify_one();
+}
+
 void MBTilesSupport::loadMetadata()
 {
     sqlite3_stmt *stmt;
@@ -109,8 +252,10 @@ void MBTilesSupport::loadMetadata()
     sqlite3_finalize(stmt);
 }
 
-bool MBTilesSupport::open(const std::string &filename)
+bool MBTilesSupport::open(const std::string &file)
 {
+    filename = file;
+
     if (sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
     {
         return false;
@@ -145,48 +290,43 @@ int MBTilesSupport::getMBTilesZoom(int olZoom) const
     return zoomMapping[olZoom];
 }
 
-const std::vector<unsigned char> &MBTilesSupport::getTile(int z, int x, int y, std::string &contentType)
+bool MBTilesSupport::loadTile(int z, int x, int y, std::vector<unsigned char> &data, std::string &contentType)
 {
-    contentType.clear();
-    tileData.clear();
-
     int mbtilesZoom = getMBTilesZoom(z);
     if (mbtilesZoom == -1)
-    {
-        return tileData;
-    }
+        return false;
 
     int tmsY = (1 << mbtilesZoom) - 1 - y;
 
-    sqlite3_stmt *stmt;
-    const char *query = "SELECT tile_data FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?";
-
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
-    {
-        Error() << "MBTILES: Failed to prepare SQL statement: " << sqlite3_errmsg(db);
-        return tileData;
-    }
+    Reader r;
+    if (!acquire(r))
+        return false;
 
-    sqlite3_bind_int(stmt, 1, mbtilesZoom);
-    sqlite3_bind_int(stmt, 2, x);
-    sqlite3_bind_int(stmt, 3, tmsY);
+    sqlite3_bind_int(r.stmt, 1, mbtilesZoom);
+    sqlite3_bind_int(r.stmt, 2, x);
+    sqlite3_bind_int(r.stmt, 3, tmsY);
 
-    int result = sqlite3_step(stmt);
+    int result = sqlite3_step(r.stmt);
     if (result == SQLITE_ROW)
     {
-        const void *data = sqlite3_column_blob(stmt, 0);
-        int size = sqlite3_column_bytes(stmt, 0);
+        const unsigned char *blob = (const unsigned char *)sqlite3_column_blob(r.stmt, 0);
+        int size = sqlite3_column_bytes(r.stmt, 0);
 
-        tileData.resize(size);
-        std::memcpy(tileData.data(), data, size);
+        data.assign(blob, blob + size);
 
         contentType = format == "png" ? "image/png" : format == "jpg" || format == "jpeg" ? "image/jpeg"
                                                     : format == "pbf"                       ? "application/x-protobuf"
                                                                                             : "application/octet-stream";
     }
+    else if (result != SQLITE_DONE)
+    {
+        Error() << "MBTILES: Failed to read tile: " << sqlite3_errmsg(r.db);
+        release(r, false);
+        return false;
+    }
 
-    sqlite3_finalize(stmt);
-    return tileData;
+    release(r, true);
+    return result == SQLITE_ROW;
 }
 
 std::string MBTilesSupport::generatePluginCode(bool overlay) const
@@ -435,13 +575,10 @@ bool FileSystemTiles::isValidTile(int z, int x, int y) const
     return false;
 }
 
-const std::vector<unsigned char> &FileSystemTiles::getTile(int z, int x, int y, std::string &contentType)
+bool FileSystemTiles::loadTile(int z, int x, int y, std::vector<unsigned char> &data, std::string &contentType)
 {
-    contentType.clear();
-    tileData.clear();
-
     if (!isValidCoordinate(z, x, y))
-        return tileData;
+        return false;
 
     std::string baseTilePath = basePath + "/" + std::to_string(z) + "/" +
                                 std::to_string(x) + "/" + std::to_string(y);
@@ -467,16 +604,17 @@ const std::vector<unsigned char> &FileSystemTiles::getTile(int z, int x, int y,
             std::streamsize fileSize = file.tellg();
             file.seekg(0, std::ios::beg);
 
-            tileData.resize(fileSize);
-            if (file.read(reinterpret_cast<char *>(tileData.data()), fileSize))
+            data.resize(fileSize);
+            if (file.read(reinterpret_cast<char *>(data.data()), fileSize))
             {
                 contentType = extPair.second;
-                break;
+                return true;
             }
         }
     }
 
-    return tileData;
+    data.clear();
+    return false;
 }
 
 std::string FileSystemTiles::generatePluginCode(bool overlay) const
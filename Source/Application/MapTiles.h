@@ -19,34 +19,72 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
 
 #ifdef HASSQLITE
 #include <cstdint>
 #include <sqlite3.h>
 #endif
 
+// encoded tile as served, shared between the cache and requests in flight
+struct Tile
+{
+    std::vector<unsigned char> data;
+    // gzipped copy for uncompressed formats (e.g. pbf), empty otherwise
+    std::vector<unsigned char> zipped;
+    std::string contentType;
+    std::string etag;
+};
+
+typedef std::shared_ptr<const Tile> TilePtr;
+
 class MapTiles
 {
+    // LRU of tiles bounded by the total number of bytes, missing tiles are cached as empty entries
+    std::mutex cache_mutex;
+    std::list<std::pair<uint64_t, TilePtr>> lru;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, TilePtr>>::iterator> index;
+    size_t cache_bytes = 0;
+    size_t cache_limit = 32 * 1024 * 1024;
+    size_t cache_reported = 0;
+    std::atomic<long> hits{0}, misses{0};
+
+    static size_t footprint(const Tile &t) { return t.data.size() + t.zipped.size() + 128; }
+    void evict();
+
 protected:
     std::string name;
     std::string attribution;
     std::string layerID;
     std::string format;
 
-    std::vector<unsigned char> tileData;
-
     int minZoom;
     int maxZoom;
 
 public:
     MapTiles();
-    virtual ~MapTiles() = default;
+    virtual ~MapTiles();
 
     virtual bool open(const std::string &source) = 0;
     virtual bool isValidTile(int z, int x, int y) const = 0;
-    virtual const std::vector<unsigned char> &getTile(int z, int x, int y, std::string &s) = 0;
     virtual std::string generatePluginCode(bool overlay) const = 0;
 
+    // reads a tile from the source, must be safe to call from several threads
+    virtual bool loadTile(int z, int x, int y, std::vector<unsigned char> &data, std::string &contentType) = 0;
+
+    // cached lookup, returns an empty tile if not available
+    TilePtr getTile(int z, int x, int y);
+
+    void setCacheSize(size_t bytes);
+    long getCacheHits() const { return hits; }
+    long getCacheMisses() const { return misses; }
+
     std::string getName() const { return name; }
     std::string getAttribution() const { return attribution; }
     int getMinZoom() const { return minZoom; }
@@ -63,15 +101,31 @@ class MBTilesSupport : public MapTiles
 private:
     sqlite3 *db;
     std::vector<int> zoomMapping;
+    std::string filename;
+
+    // read-only connections with a prepared tile query, checked out per cache miss
+    struct Reader
+    {
+        sqlite3 *db = nullptr;
+        sqlite3_stmt *stmt = nullptr;
+    };
+
+    std::mutex pool_mutex;
+    std::condition_variable pool_free;
+    std::vector<Reader> pool;
+    int pool_open = 0;
+    const int POOL_MAX = 4;
 
     void loadMetadata();
+    bool acquire(Reader &r);
+    void release(Reader &r, bool ok);
 public:
     MBTilesSupport();
     ~MBTilesSupport() override;
 
     bool open(const std::string &filename) override;
     bool isValidTile(int z, int x, int y) const override;
-    const std::vector<unsigned char> &getTile(int z, int x, int y, std::string &contentType) override;
+    bool loadTile(int z, int x, int y, std::vector<unsigned char> &data, std::string &contentType) override;
     std::string generatePluginCode(bool overlay) const override;
 
     int getMBTilesZoom(int olZoom) const;
@@ -99,6 +153,6 @@ public:
 
     bool open(const std::string &directoryPath) override;
     bool isValidTile(int z, int x, int y) const override;
-    const std::vector<unsigned char> &getTile(int z, int x, int y, std::string &contentType) override;
+    bool loadTile(int z, int x, int y, std::vector<unsigned char> &data, std::string &contentType) override;
     std::string generatePluginCode(bool overlay) const override;
 };
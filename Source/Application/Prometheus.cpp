@@ -15,7 +15,13 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <chrono>
+
 #include "Prometheus.h"
+#include "StreamHelpers.h"
+#include "Wakeups.h"
+#include "MemoryBudget.h"
+#include "Helper.h"
 
 const std::string ShippingClassNames[] = {
 	"Other",							  // CLASS_OTHER
@@ -35,6 +41,9 @@ const std::string ShippingClassNames[] = {
 };
 
 PromotheusCounter::PromotheusCounter()
+	: level_hist({-50, -45, -40, -35, -30, -25, -20, -15, -10, -5, 0, 5, 10}),
+	  ppm_hist({-50, -20, -10, -5, -2, -1, 0, 1, 2, 5, 10, 20, 50}),
+	  latency_hist({0.5, 1, 2, 5, 10, 30, 60, 300})
 {
 	Reset();
 	Clear();
@@ -49,6 +58,7 @@ void PromotheusCounter::Clear()
 
 	_count = 0;
 	_distance = 0;
+	generation++;
 
 	m.unlock();
 }
@@ -85,6 +95,14 @@ void PromotheusCounter::Receive(const JSON::JSON *json, int len, TAG &tag)
 {
 	AIS::Message &data = *((AIS::Message *)json[0].binary);
 
+	if (tag.level != LEVEL_UNDEFINED && tag.level < 1000)
+		level_hist.add(tag.level);
+	if (tag.ppm != PPM_UNDEFINED && tag.ppm < 1000)
+		ppm_hist.add(tag.ppm);
+
+	double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+	latency_hist.add(MAX(0.0, now - (double)data.getRxTimeUnix()));
+
 	if (ppm.size() > 32768 || level.size() > 32768)
 	{
 		return;
@@ -93,6 +111,7 @@ void PromotheusCounter::Receive(const JSON::JSON *json, int len, TAG &tag)
 	m.lock();
 
 	Add(data, tag);
+	generation++;
 
 	m.unlock();
 }
@@ -102,12 +121,21 @@ void PromotheusCounter::Reset()
 	m.lock();
 	ppm = "# HELP ais_msg_ppm\n# TYPE ais_msg_ppm gauge\n";
 	level = "# HELP ais_msg_level\n# TYPE ais_msg_level gauge\n";
+	generation++;
 	m.unlock();
 }
 
 std::string PromotheusCounter::toPrometheus()
 {
 	m.lock();
+
+	if (rendered == generation)
+	{
+		std::string element = cache;
+		m.unlock();
+		return element + getHistograms();
+	}
+
 	std::string element;
 
 	element += "# HELP ais_stat_count Total number of messages\n";
@@ -135,6 +163,23 @@ std::string PromotheusCounter::toPrometheus()
 	}
 
 	element += ppm + level;
+
+	cache = element;
+	rendered = generation;
 	m.unlock();
-	return element;
+
+	return element + getHistograms();
+}
+
+std::string PromotheusCounter::getHistograms()
+{
+	return "# HELP ais_msg_level_db Signal level of the received messages\n# TYPE ais_msg_level_db histogram\n" + level_hist.toPrometheus("ais_msg_level_db") +
+		   "# HELP ais_msg_ppm_error Frequency offset of the received messages\n# TYPE ais_msg_ppm_error histogram\n" + ppm_hist.toPrometheus("ais_msg_ppm_error") +
+		   "# HELP ais_msg_latency_seconds Time from reception to output, rx time has a resolution of one second\n# TYPE ais_msg_latency_seconds histogram\n" + latency_hist.toPrometheus("ais_msg_latency_seconds") +
+		   // stages with PROFILE on
+		   Util::Perf::get().getPrometheus() +
+		   Wakeups::toPrometheus() +
+		   MemoryBudget::toPrometheus() +
+		   "# HELP ais_memory_rss_bytes Resident set size of the process\n# TYPE ais_memory_rss_bytes gauge\n" +
+		   "ais_memory_rss_bytes " + std::to_string(Util::Helper::getMemoryConsumption()) + "\n";
 }
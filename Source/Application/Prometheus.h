@@ -22,8 +22,9 @@
 
 #include "AIS-catcher.h"
 #include "JSONAIS.h"
+#include "Histogram.h"
 
-class PromotheusCounter : public StreamIn<JSON::JSON> {
+class PromotheusCounter : public StreamIn<JSON::JSON>, public JSON::KeySet {
 	std::mutex m;
 
 	int _LONG_RANGE_CUTOFF = 2500;
@@ -37,8 +38,16 @@ class PromotheusCounter : public StreamIn<JSON::JSON> {
 	std::string ppm;
 	std::string level;
 
+	// signal level (dB), ppm and the delay from reception to this output (s, rx time has second resolution)
+	BucketHistogram level_hist, ppm_hist, latency_hist;
+
+	// the counter section is rendered again only when a message or Reset changed it
+	uint64_t generation = 0, rendered = ~(uint64_t)0;
+	std::string cache;
+
 	void Add(const AIS::Message& m, const TAG& tag, bool new_vessel = false);
 	void Clear();
+	std::string getHistograms();
 
 public:
 	void setCutOff(int c) { _LONG_RANGE_CUTOFF = c; }
@@ -52,5 +61,6 @@ public:
 	void setCutoff(int cutoff) { _LONG_RANGE_CUTOFF = cutoff; }
 
 	void Receive(const JSON::JSON* json, int len, TAG& tag);
+	bool getKeys(std::vector<int>& keys) { return true; }
 	std::string toPrometheus();
 };
@@ -204,12 +204,34 @@ void Receiver::setupModel(int &group)
 			throw std::runtime_error("Decoding model and input format not consistent.");
 	}
 
-	// build the decoder models
+	// the load is measured over all models, they decide themselves what to switch off
+	load.setRate(device->getSampleRate());
+	load.setCallback([this](float l)
+					 { for (auto &m : models) m->updateLoad(l); });
+	*device >> load;
+
+	// build the decoder models, models with the same front-end settings decode from the first one built
+	std::vector<AIS::ModelFrontend *> frontends;
+
 	for (auto &m : models)
 	{
 		m->setDesignation(ChannelNMEA);
 		m->setMode(ChannelMode);
 		m->setOwnMMSI(own_mmsi);
+		m->setInput(&load.out);
+
+		AIS::ModelFrontend *f = m->getFrontend();
+		if (f)
+		{
+			bool shared = false;
+			for (AIS::ModelFrontend *other : frontends)
+				if ((shared = f->shareFrontend(*other)))
+					break;
+
+			if (!shared)
+				frontends.push_back(f);
+		}
+
 		m->buildModel(ChannelNMEA[0], ChannelNMEA[1], device->getSampleRate(), timing, device);
 	}
 
@@ -223,25 +245,85 @@ void Receiver::setupModel(int &group)
 	for (int i = 0; i < models.size(); i++)
 	{
 		uint32_t mask = 1 << group;
+		jsonais[i].setTiming(timing);
+		jsonais[i].setAggregator(aggregator);
 		jsonais[i].out.setGroupOut(mask);
 		models[i]->Output().out.setGroupOut(mask);
 		models[i]->OutputADSB().out.setGroupOut(mask);
 		group++;
 	}
+
+	yield.clear();
+	if (timing)
+		for (int i = 0; i < models.size(); i++)
+		{
+			yield.push_back(std::unique_ptr<ModelYield>(new ModelYield()));
+			models[i]->Output().out.Connect(yield.back().get());
+		}
+}
+
+void Receiver::reconnectJSON()
+{
+	for (int i = 0; i < (int)jsonais.size() && i < (int)json_route.size(); i++)
+	{
+		std::vector<int> keys;
+		bool all = !JSON::KeySet::getKeys(jsonais[i].out.getConnections(), keys);
+
+		switch (json_route[i])
+		{
+		case JSONRoute::MODEL:
+			// the workers read the key set without the lock
+			if (!jsonais[i].covers(keys, all))
+				Warning() << "Receiver: JSON fields of model " << models[i]->getName() << " are fixed at start, restart to decode the fields of the new outputs.";
+			break;
+		case JSONRoute::NONE:
+			if (!jsonais[i].out.isConnected())
+				break;
+
+			models[i]->Output() >> jsonais[i];
+			json_route[i] = JSONRoute::OUTPUT;
+			// fall through
+		case JSONRoute::OUTPUT:
+			// no consumers left gives an empty set and the decoder skips the work
+			if (all)
+				jsonais[i].setAllKeys();
+			else
+				jsonais[i].setKeys(keys);
+			break;
+		}
+	}
 }
 
 void Receiver::play()
 {
 
 	// connect the JSON output where and if needed
+	json_route.assign(jsonais.size(), JSONRoute::NONE);
+
 	for (int i = 0; i < jsonais.size(); i++)
 	{
 		if (jsonais[i].out.isConnected())
 		{
-			models[i]->Output() >> jsonais[i];
+			// only decode the fields the consumers ask for
+			std::vector<int> keys;
+			if (JSON::KeySet::getKeys(jsonais[i].out.getConnections(), keys))
+				jsonais[i].setKeys(keys);
+			else
+				jsonais[i].setAllKeys();
+
+			if (models[i]->setJSONAIS(&jsonais[i]))
+				json_route[i] = JSONRoute::MODEL;
+			else
+			{
+				models[i]->Output() >> jsonais[i];
+				json_route[i] = JSONRoute::OUTPUT;
+			}
 		}
 	}
 
+	for (auto &m : models)
+		m->start();
+
 	auto* device = deviceManager.getDevice();
 	device->Play();
 
@@ -263,6 +345,9 @@ void Receiver::stop()
 	auto* device = deviceManager.getDevice();
 	if (device)
 		device->Stop();
+
+	for (auto &m : models)
+		m->stop();
 }
 
 //-----------------------------------
@@ -274,7 +359,7 @@ void Receiver::stop()
 
 void OutputStatistics::connect(Receiver &r)
 {
-
+	device = r.getDeviceManager().getDevice();
 	statistics.resize(r.Count());
 
 	for (int i = 0; i < r.Count(); i++)
@@ -285,3 +370,134 @@ void OutputStatistics::connect(Receiver &r)
 }
 
 void OutputStatistics::start() {}
+
+//-----------------------------------
+// compare the models on the same signal
+
+void ModelYield::Receive(const AIS::Message *data, int len, TAG &tag)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	for (int i = 0; i < len; i++)
+	{
+		payloads.insert(data[i].getHash());
+		count++;
+	}
+}
+
+std::string getModelComparison(std::vector<std::unique_ptr<Receiver>> &receivers)
+{
+	struct Row
+	{
+		std::string name, settings;
+		uint64_t messages = 0, unique = 0, only = 0, crc_errors = 0;
+		double ms = 0, signal = 0;
+	};
+
+	std::vector<Row> rows;
+
+	for (auto &r : receivers)
+	{
+		if (!r->Timing() || !r->getYield(0))
+			continue;
+
+		if (rows.empty())
+		{
+			rows.resize(r->Count());
+			for (int j = 0; j < r->Count(); j++)
+			{
+				rows[j].name = "#" + std::to_string(j) + " " + r->Model(j)->getName();
+				rows[j].settings = r->Model(j)->Get();
+			}
+		}
+		else if ((int)rows.size() != r->Count())
+			continue;
+
+		for (int j = 0; j < r->Count(); j++)
+		{
+			const std::unordered_set<uint64_t> &p = r->getYield(j)->getPayloads();
+
+			// messages none of the other models on this signal decoded
+			uint64_t only = 0;
+			for (uint64_t h : p)
+			{
+				bool other = false;
+				for (int k = 0; k < r->Count() && !other; k++)
+					other = k != j && r->getYield(k)->getPayloads().count(h);
+				only += !other;
+			}
+
+			Row &row = rows[j];
+			row.messages += r->getYield(j)->getCount();
+			row.unique += p.size();
+			row.only += only;
+			row.crc_errors += r->Model(j)->getCRCErrors();
+			row.ms += r->Model(j)->getTotalTiming();
+			row.signal += r->getSignalSeconds();
+		}
+	}
+
+	if (rows.empty())
+		return "";
+
+	auto column = [](std::string s, int w)
+	{ return s.length() < (size_t)w ? std::string(w - s.length(), ' ') + s : " " + s; };
+
+	std::string str = "model comparison, decoding time per second of signal (cpu):\n";
+	str += std::string(32, ' ') + column("msgs", 10) + column("unique", 10) + column("only", 8) + column("crc fail", 10) + column("cpu", 10) + "\n";
+
+	for (auto &row : rows)
+	{
+		std::string name = row.name.substr(0, 32);
+		std::string cpu = "-";
+		if (row.signal > 0)
+		{
+			cpu.clear();
+			Util::Convert::appendFixed(cpu, row.ms / 1000 / row.signal, 4);
+		}
+
+		str += name + std::string(32 - name.length(), ' ') + column(std::to_string(row.messages), 10) + column(std::to_string(row.unique), 10) +
+			   column(std::to_string(row.only), 8) + column(std::to_string(row.crc_errors), 10) + column(cpu, 10) + "\n";
+	}
+
+	for (auto &row : rows)
+		str += row.name + ": " + row.settings + "\n";
+
+	return str;
+}
+
+std::string Receiver::getLoadStatus()
+{
+	float l = load.getLoad();
+	if (l <= 0)
+		return "";
+
+	std::string str = "load: " + std::to_string((int)(100 * l)) + "%";
+	for (auto &m : models)
+		if (m->getShedLevel())
+			str += ", " + m->getName() + " shed level " + std::to_string(m->getShedLevel());
+
+	return str;
+}
+
+std::string OutputStatistics::getDeviceStatus()
+{
+	if (!device)
+		return "";
+
+	Device::Device::Statistics st = device->getStatistics();
+
+	if (!st.overruns && !st.fifo_blocks && !st.latency_max)
+		return "";
+
+	std::string str = "overruns: " + std::to_string(st.overruns) + ", dropped: " + std::to_string(st.dropped) + " samples";
+	if (st.fifo_blocks)
+	{
+		str += ", fifo max: " + std::to_string(st.fifo_max) + "/" + std::to_string(st.fifo_blocks) + " x " + std::to_string(st.fifo_block_size / 1024) + "KB";
+		if (st.fifo_grows)
+			str += " (grown " + std::to_string(st.fifo_grows) + "x)";
+	}
+	str += ", latency p99: " + std::to_string(st.latency_p99 / 1000) + " ms, max: " + std::to_string(st.latency_max / 1000) + " ms";
+
+	return str;
+}
@@ -22,6 +22,7 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <unordered_set>
 
 #include "AIS-catcher.h"
 #include "Signals.h"
@@ -40,11 +41,30 @@ class Receiver;
 //--------------------------------------------
 class OutputStatistics
 {
+	Device::Device *device = nullptr;
+
 public:
 	std::vector<IO::StreamCounter> statistics;
 
 	void connect(Receiver &r);
 	void start();
+
+	// overruns, buffer use and latency of the device, empty if there is nothing to report
+	std::string getDeviceStatus();
+};
+
+// Messages of a model by content, to compare the yield of models on the same signal (-b)
+class ModelYield : public StreamIn<AIS::Message>
+{
+	std::mutex mtx;
+	uint64_t count = 0;
+	std::unordered_set<uint64_t> payloads;
+
+public:
+	void Receive(const AIS::Message *data, int len, TAG &tag);
+
+	uint64_t getCount() { return count; }
+	const std::unordered_set<uint64_t> &getPayloads() { return payloads; }
 };
 
 // Hardware + Model with output connectors for messages and JSON
@@ -63,9 +83,26 @@ class Receiver
 	AIS::Mode ChannelMode = AIS::Mode::AB;
 	std::string ChannelNMEA = "AB";
 
+	// real-time load of the models on the device thread
+	Util::LoadMeter load;
+
+	// decoded messages per model with timing on
+	std::vector<std::unique_ptr<ModelYield>> yield;
+
 	// Output
 	std::vector<AIS::JSONAIS> jsonais;
 
+	// how the JSON decoder of each model is fed: not at all, from the model output under the
+	// message lock, or by the model itself (NMEA workers, decoding outside the lock)
+	enum class JSONRoute
+	{
+		NONE,
+		OUTPUT,
+		MODEL
+	};
+	std::vector<JSONRoute> json_route;
+	AIS::Aggregator *aggregator = nullptr;
+
 	TAG tag;
 
 public:
@@ -81,6 +118,8 @@ public:
 	void setChannel(std::string mode) { setChannel(mode, ""); }
 	void setChannel(std::string mode, std::string NMEA);
 	void setOwnMMSI(int m) { own_mmsi = m; }
+	// shared by all receivers, merges copies of a transmission before JSON decoding
+	void setAggregator(AIS::Aggregator *a) { aggregator = a; }
 	void setTags(const std::string &s);
 	void removeTags(const std::string &s);
 	void clearTags() { tag.mode = 0; }
@@ -92,12 +131,22 @@ public:
 
 	bool &Timing() { return timing; }
 
+	float getLoad() { return load.getLoad(); }
+	double getSignalSeconds() { return load.getSignal(); }
+	ModelYield *getYield(int i) { return i < (int)yield.size() ? yield[i].get() : nullptr; }
+	// load and shed level of the models, empty if not measured
+	std::string getLoadStatus();
+
 	// Receiver output are Messages or JSON
 	Connection<AIS::Message> &Output(int i) { return models[i]->Output().out; }
 	Connection<AIS::GPS> &OutputGPS(int i) { return models[i]->OutputGPS().out; }
 	Connection<Plane::ADSB> &OutputADSB(int i) { return models[i]->OutputADSB().out; }
 
 	Connection<JSON::JSON> &OutputJSON(int i) { return jsonais[i].out; }
+	std::string getJSONTimingDetails(int i) { return jsonais[i].getTimingDetails(); }
+
+	// connects the JSON decoders after the outputs changed while running, with the message lock held
+	void reconnectJSON();
 
 	void setSampleRate(int s) { sample_rate = s; }
 	void setBandwidth(int b) { bandwidth = b; }
@@ -118,3 +167,7 @@ public:
 	void play();
 	void stop();
 };
+
+// Decode yield against decoding time per model, over the receivers with timing on. Models are matched by
+// their index, so the receivers of a batch (-B) add up to one row per model.
+std::string getModelComparison(std::vector<std::unique_ptr<Receiver>> &receivers);
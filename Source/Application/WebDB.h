@@ -9,9 +9,10 @@ namespace WebDB {
         const unsigned char* data;
         const size_t size;
         const char* mime_type;
+        const char* etag;
         
-        FileData(const unsigned char* d, const size_t s, const char* m) 
-            : data(d), size(s), mime_type(m) {}
+        FileData(const unsigned char* d, const size_t s, const char* m, const char* e) 
+            : data(d), size(s), mime_type(m), etag(e) {}
     };
 
     extern std::unordered_map<std::string, FileData> files;
@@ -21,6 +21,8 @@
 #include "JSONAIS.h"
 #include "Helper.h"
 #include "JSONBuilder.h"
+#include "Wakeups.h"
+#include "MemoryBudget.h"
 
 IO::OutputMessage *commm_feed = nullptr;
 
@@ -31,6 +33,16 @@ void SSEStreamer::Receive(const JSON::JSON *data, int len, TAG &tag)
 		AIS::Message *m = (AIS::Message *)data[0].binary;
 		std::time_t now = std::time(nullptr);
 
+		// the events are routed to the subscribers by the last known position of the ship
+		const bool position = tag.lat != 0 && tag.lon != 0;
+		JSON::JSONBuilder json;
+
+		auto add = [&json](IO::SSEEvent &e, const char *key)
+		{
+			e.add(key, json.str());
+			json.clear();
+		};
+
 		if (!m->NMEA.empty())
 		{
 			JSON::JSONBuilder nmeaArray;
@@ -66,30 +78,47 @@ void SSEStreamer::Receive(const JSON::JSON *data, int len, TAG &tag)
 			}
 			nmeaArray.endArray();
 
-			JSON::JSONBuilder json;
-			json.start();
+			auto e = std::make_shared<IO::SSEEvent>();
+			e->mmsi = m->mmsi();
+			e->position = position;
+			e->lat = tag.lat;
+			e->lon = tag.lon;
+
 			json.add("mmsi", m->mmsi());
+			add(*e, "mmsi");
 			json.add("timestamp", (long long)now);
+			add(*e, "timestamp");
 			json.addString("channel", std::string(1, m->getChannel()));
+			add(*e, "channel");
 			json.add("type", m->type());
+			add(*e, "type");
 			json.addString("shipname", tag.shipname);
+			add(*e, "shipname");
 			json.key("nmea");
 			json.valueRaw(nmeaArray.take());
-			json.end();
+			add(*e, "nmea");
 
-			server->sendSSE(1, "nmea", json.str());
+			server->sendSSE(1, "nmea", e);
 		}
 
-		if (tag.lat != 0 && tag.lon != 0)
+		if (position)
 		{
-			JSON::JSONBuilder json;
-			json.start();
+			auto e = std::make_shared<IO::SSEEvent>();
+			e->mmsi = m->mmsi();
+			e->position = true;
+			e->lat = tag.lat;
+			e->lon = tag.lon;
+
 			json.add("mmsi", m->mmsi());
+			add(*e, "mmsi");
 			json.addString("channel", std::string(1, m->getChannel()));
+			add(*e, "channel");
 			json.add("lat", tag.lat);
+			add(*e, "lat");
 			json.add("lon", tag.lon);
-			json.end();
-			server->sendSSE(2, "nmea", json.str());
+			add(*e, "lon");
+
+			server->sendSSE(2, "nmea", e);
 		}
 	}
 }
@@ -103,6 +132,8 @@ WebViewer::WebViewer()
 	JSON::StringBuilder::stringify(Util::Helper::getOS(), os);
 	hardware.clear();
 	JSON::StringBuilder::stringify(Util::Helper::getHardware(), hardware);
+
+	station_stats.setSize(256);
 }
 
 std::string WebViewer::decodeNMEAtoJSON(const std::string &nmea_input, bool enhanced)
@@ -217,6 +248,7 @@ void WebViewer::addMBTilesSource(const std::string &filepath, bool overlay)
 	auto source = std::make_shared<MBTilesSupport>();
 	if (source->open(filepath))
 	{
+		source->setCacheSize((size_t)tile_cache << 20);
 		mapSources.push_back(source);
 		plugin_code += source->generatePluginCode(overlay);
 	}
@@ -232,6 +264,7 @@ void WebViewer::addFileSystemTilesSource(const std::string &directoryPath, bool
 	auto source = std::make_shared<FileSystemTiles>();
 	if (source->open(directoryPath))
 	{
+		source->setCacheSize((size_t)tile_cache << 20);
 		mapSources.push_back(source);
 		plugin_code += source->generatePluginCode(overlay);
 	}
@@ -243,9 +276,13 @@ void WebViewer::addFileSystemTilesSource(const std::string &directoryPath, bool
 
 bool WebViewer::Save()
 {
+	const std::string tmp = backup_filename + ".tmp";
+
 	try
 	{
-		std::ofstream infile(backup_filename, std::ios::binary);
+		uint64_t seq = ships.getSequence();
+
+		std::ofstream infile(tmp, std::ios::binary);
 		if (!counter.Save(infile))
 			return false;
 		if (!hist_second.Save(infile))
@@ -260,7 +297,76 @@ bool WebViewer::Save()
 		if (!ships.Save(infile))
 			return false;
 
+		backup_size = infile.tellp();
 		infile.close();
+
+		if (!infile)
+			return false;
+
+		// the old backup stays in place until the new one is complete
+#ifdef _WIN32
+		std::remove(backup_filename.c_str());
+#endif
+		if (std::rename(tmp.c_str(), backup_filename.c_str()) != 0)
+			return false;
+
+		// everything in the journal is now in the backup
+		std::ofstream(journalFile(), std::ios::binary | std::ios::trunc);
+		journal_seq = seq;
+	}
+	catch (const std::exception &e)
+	{
+		Error() << e.what();
+		return false;
+	}
+	return true;
+}
+
+// one record per backup: magic, length of the body, counter, changed history buckets and ships
+static const int JOURNAL_MAGIC = 0x4a524e4c;
+
+bool WebViewer::SaveJournal()
+{
+	if (!backup_journal || backup_size == 0)
+		return Save();
+
+	try
+	{
+		std::ofstream file(journalFile(), std::ios::binary | std::ios::in | std::ios::out);
+		if (!file.is_open())
+			file.open(journalFile(), std::ios::binary);
+
+		file.seekp(0, std::ios::end);
+		std::streamoff begin = file.tellp();
+
+		// the ships are sent again next time unless the record is complete
+		uint64_t seq = journal_seq;
+
+		int magic = JOURNAL_MAGIC, length = 0;
+		file.write((const char *)&magic, sizeof(int));
+		file.write((const char *)&length, sizeof(int));
+
+		if (!counter.Save(file) || !hist_second.SaveChanges(file) || !hist_minute.SaveChanges(file) ||
+			!hist_hour.SaveChanges(file) || !hist_day.SaveChanges(file) || !ships.SaveChanges(file, seq))
+			return false;
+
+		std::streamoff size = file.tellp();
+		length = (int)(size - begin - 2 * sizeof(int));
+
+		file.seekp(begin + (std::streamoff)sizeof(int));
+		file.write((const char *)&length, sizeof(int));
+		file.close();
+
+		if (!file)
+			return false;
+
+		journal_seq = seq;
+
+		if (size >= backup_size)
+		{
+			Info() << "Server: compacting backup journal into " << backup_filename;
+			return Save();
+		}
 	}
 	catch (const std::exception &e)
 	{
@@ -270,6 +376,46 @@ bool WebViewer::Save()
 	return true;
 }
 
+// replays the complete records after a restore, returns the number of records
+int WebViewer::LoadJournal()
+{
+	std::ifstream file(journalFile(), std::ios::binary);
+	if (!file)
+		return 0;
+
+	file.seekg(0, std::ios::end);
+	std::streamoff size = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	int n = 0;
+
+	while (true)
+	{
+		std::streamoff begin = file.tellg();
+		int magic = 0, length = 0;
+
+		if (begin + 2 * (std::streamoff)sizeof(int) > size || !file.read((char *)&magic, sizeof(int)) || !file.read((char *)&length, sizeof(int)))
+			break;
+
+		// a record cut short by a crash ends the journal
+		if (magic != JOURNAL_MAGIC || length <= 0 || begin + 2 * (std::streamoff)sizeof(int) + length > size)
+		{
+			Warning() << "Server: backup journal ends with an incomplete record, ignored.";
+			break;
+		}
+
+		if (!counter.Load(file) || !hist_second.LoadChanges(file) || !hist_minute.LoadChanges(file) ||
+			!hist_hour.LoadChanges(file) || !hist_day.LoadChanges(file) || !ships.LoadChanges(file))
+		{
+			Warning() << "Server: could not read record " << n + 1 << " of the backup journal.";
+			break;
+		}
+		n++;
+	}
+
+	return n;
+}
+
 void WebViewer::Clear()
 {
 	counter.Clear();
@@ -309,7 +455,21 @@ bool WebViewer::Load()
 				Warning() << "Server: Could not load ship database from backup";
 		}
 
+		infile.clear();
+		infile.seekg(0, std::ios::end);
+		backup_size = infile.tellg();
 		infile.close();
+
+		int n = LoadJournal();
+		if (n > 0)
+		{
+			Info() << "Server: replayed " << n << " records of the backup journal";
+
+			// starts a clean journal, a damaged tail is not appended to
+			if (!Save())
+				Error() << "Server failed to write backup.";
+		}
+		journal_seq = ships.getSequence();
 	}
 	catch (const std::exception &e)
 	{
@@ -388,7 +548,9 @@ void WebViewer::BackupService()
 				break;
 			}
 
-			if (!Save())
+			Wakeups::add(Wakeups::SERVICE);
+
+			if (!SaveJournal())
 				Error() << "Server failed to write backup.";
 		}
 	}
@@ -401,6 +563,91 @@ void WebViewer::BackupService()
 	Info() << "Server: stopping backup service.";
 }
 
+// encodes the changes of the last second once and hands the frame to all websocket subscribers
+void WebViewer::PushService()
+{
+	std::time_t ships_epoch = 0;
+	uint64_t ships_seq = 0;
+	std::time_t planes_since = 0;
+	std::vector<char> frame;
+
+	try
+	{
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m);
+
+				cv.wait(lock, [&]
+						{ return !run || hasWebSocket(WS_SHIPS | WS_PLANES); });
+
+				if (cv.wait_for(lock, std::chrono::seconds(1), [&]
+								{ return !run; }))
+				{
+					break;
+				}
+			}
+
+			Wakeups::add(Wakeups::SERVICE);
+
+			if (hasWebSocket(WS_SHIPS))
+			{
+				frame.clear();
+				Util::Serialize::Uint8(WS_SHIPS, frame);
+				Util::Serialize::Uint8(BINARY_VERSION, frame);
+				ships.getBinaryDelta(frame, ships_epoch, ships_seq);
+				sendWebSocket(WS_SHIPS, frame.data(), frame.size());
+			}
+
+			if (hasWebSocket(WS_PLANES))
+			{
+				std::time_t now = time(nullptr);
+
+				frame.clear();
+				Util::Serialize::Uint8(WS_PLANES, frame);
+				Util::Serialize::Uint8(BINARY_VERSION, frame);
+				planes.getBinaryDelta(frame, planes_since);
+				sendWebSocket(WS_PLANES, frame.data(), frame.size());
+
+				planes_since = now;
+			}
+		}
+	}
+	catch (std::exception &e)
+	{
+		Error() << "WebClient PushService: " << e.what();
+		std::terminate();
+	}
+}
+
+std::string WebViewer::getDevicePrometheus()
+{
+	if (devices.empty())
+		return "";
+
+	std::string overruns, dropped, fifo, blocks, grows, p99;
+
+	for (int i = 0; i < (int)devices.size(); i++)
+	{
+		Device::Device::Statistics st = devices[i]->getStatistics();
+		std::string label = "{device=\"" + std::to_string(i) + "\"} ";
+
+		overruns += "ais_device_overruns" + label + std::to_string(st.overruns) + "\n";
+		dropped += "ais_device_dropped_samples" + label + std::to_string(st.dropped) + "\n";
+		fifo += "ais_device_fifo_max" + label + std::to_string(st.fifo_max) + "\n";
+		blocks += "ais_device_fifo_bytes" + label + std::to_string((long long)st.fifo_blocks * st.fifo_block_size) + "\n";
+		grows += "ais_device_fifo_grows" + label + std::to_string(st.fifo_grows) + "\n";
+		p99 += "ais_device_latency_p99_microseconds" + label + std::to_string(st.latency_p99) + "\n";
+	}
+
+	return "# HELP ais_device_overruns Blocks from the device that were lost because the buffer was full\n# TYPE ais_device_overruns counter\n" + overruns +
+		   "# HELP ais_device_dropped_samples Samples from the device that were lost\n# TYPE ais_device_dropped_samples counter\n" + dropped +
+		   "# HELP ais_device_fifo_max Largest number of blocks waiting in the device buffer\n# TYPE ais_device_fifo_max gauge\n" + fifo +
+		   "# HELP ais_device_fifo_bytes Size of the device buffer\n# TYPE ais_device_fifo_bytes gauge\n" + blocks +
+		   "# HELP ais_device_fifo_grows Number of times the adaptive device buffer was enlarged after an overrun\n# TYPE ais_device_fifo_grows counter\n" + grows +
+		   "# HELP ais_device_latency_p99_microseconds 99th percentile of the time from the arrival of a block until it has been processed\n# TYPE ais_device_latency_p99_microseconds gauge\n" + p99;
+}
+
 void WebViewer::connect(Receiver &r)
 {
 	bool rec_details = false;
@@ -413,6 +660,8 @@ void WebViewer::connect(Receiver &r)
 				auto *device = r.getDeviceManager().getDevice();
 
 				sample_rate += device->getRateDescription() + "<br>";
+				threads += device->getThreadDescription() + newline;
+				devices.push_back(device);
 
 				JSON::StringBuilder::stringify(device->getProduct(), product, false);
 				JSON::StringBuilder::stringify(device->getVendor().empty() ? "-" : device->getVendor(), vendor, false);
@@ -424,8 +673,9 @@ void WebViewer::connect(Receiver &r)
 				rec_details = true;
 			}
 			model += r.Model(j)->getName() + newline;
+			addSpectrum(*r.Model(j));
 
-			r.OutputJSON(j).Connect((StreamIn<JSON::JSON> *)&ships);
+			r.OutputJSON(j).Connect(shipsInput());
 			r.OutputGPS(j).Connect((StreamIn<AIS::GPS> *)&ships);
 			r.OutputADSB(j).Connect((StreamIn<Plane::ADSB> *)&planes);
 
@@ -438,18 +688,49 @@ void WebViewer::connect(AIS::Model &m, Connection<JSON::JSON> &json, Device::Dev
 	if (m.Output().out.canConnect(groups_in))
 	{
 
-		json.Connect((StreamIn<JSON::JSON> *)&ships);
+		json.Connect(shipsInput());
 		device >> raw_counter;
 
 		sample_rate = device.getRateDescription();
+		threads = device.getThreadDescription();
+		devices.assign(1, &device);
 		setDeviceDescription(device.getProduct(), device.getVendor().empty() ? "-" : device.getVendor(), device.getSerial().empty() ? "-" : device.getSerial());
 		model = m.getName();
+		addSpectrum(m);
+	}
+}
+
+StreamIn<JSON::JSON> *WebViewer::shipsInput()
+{
+	if (!profile)
+		return &ships;
+
+	if (!probe_ships.out.isConnected())
+	{
+		probe_ships.attach("web viewer ships");
+		probe_ships.out.Connect((StreamIn<JSON::JSON> *)&ships);
 	}
+	return &probe_ships;
+}
+
+void WebViewer::addSpectrum(AIS::Model &m)
+{
+	AIS::ModelFrontend *f = m.getFrontend();
+
+	if (!f || !f->getSpectrum().isOn())
+		return;
+
+	const std::string prefix = "{\"receiver\":" + std::to_string(spectra.size()) + ",\"spectrum\":";
+	spectra.push_back(&f->getSpectrum());
+
+	f->getSpectrum().setCallback([this, prefix](const std::string &json)
+								 { sendSSE(4, "spectrum", prefix + json + "}"); });
 }
 
 void WebViewer::Reset()
 {
 	counter_session.Clear();
+	station_stats.Clear();
 	hist_second.Clear();
 	hist_minute.Clear();
 	hist_hour.Clear();
@@ -462,6 +743,16 @@ void WebViewer::Reset()
 
 void WebViewer::start()
 {
+	// a memory budget caps the plane table and the tile caches unless DB_MEMORY sets the tables
+	if (MemoryBudget::isSet())
+	{
+		if (!db_memory)
+			planes.setMemoryCap(MemoryBudget::limit(MemoryBudget::PLANES, 0));
+
+		for (auto &source : mapSources)
+			source->setCacheSize(MIN((std::size_t)tile_cache << 20, MemoryBudget::limit(MemoryBudget::CACHE, 0) / 2 / mapSources.size()));
+	}
+
 	ships.setup();
 
 	if (backup_filename.empty())
@@ -491,10 +782,17 @@ void WebViewer::start()
 
 	ships >> counter;
 	ships >> counter_session;
+	ships >> station_stats;
 
 	if (supportPrometheus)
 		ships >> dataPrometheus;
 
+	if (!message_log_dir.empty())
+	{
+		message_log.open(message_log_dir);
+		ships >> message_log;
+	}
+
 	if (firstport && lastport)
 	{
 		for (port = firstport; port <= lastport; port++)
@@ -523,6 +821,18 @@ void WebViewer::start()
 			thread_running = true;
 		}
 	}
+
+	if (websocket)
+	{
+		push_thread = std::thread(&WebViewer::PushService, this);
+		thread_running = true;
+	}
+
+	if (replication_port)
+		replication_server.Start(&ships, replication_port);
+
+	if (!replication_source.empty())
+		replication_client.Start(&ships, replication_source);
 }
 
 void WebViewer::stopThread()
@@ -538,6 +848,9 @@ void WebViewer::stopThread()
         if (backup_thread.joinable())
             backup_thread.join();
 
+        if (push_thread.joinable())
+            push_thread.join();
+
         thread_running = false;
     }
 }
@@ -547,12 +860,90 @@ void WebViewer::close()
 
 	stopThread();
 
+	for (auto *s : spectra)
+		s->setCallback(nullptr);
+
+	stopWorkers();
+
+	replication_client.Stop();
+	replication_server.Stop();
+
+	message_log.close();
+
 	if (!backup_filename.empty() && !Save())
 	{
 		Error() << "Statistics - cannot write file.";
 	}
 }
 
+// clients that accept zstd get their own entries
+bool WebViewer::ResponseFromCache(IO::TCPServerConnection &c, const std::string &key, uint64_t version, const std::string &type)
+{
+	auto it = response_cache.find(acceptsZstd() ? key + "#zstd" : key);
+
+	if (it == response_cache.end() || it->second.version != version || it->second.time != time(nullptr))
+		return false;
+
+	const CachedResponse &entry = it->second;
+	ResponseEncoded(c, type, entry.content.data(), entry.content.size(), entry.encoding);
+	return true;
+}
+
+void WebViewer::ResponseToCache(IO::TCPServerConnection &c, const std::string &key, uint64_t version, const std::string &type, const std::string &content, bool gzip)
+{
+	std::time_t now = time(nullptr);
+	const std::string entry_key = acceptsZstd() ? key + "#zstd" : key;
+
+	std::size_t bytes = 0;
+
+	// entries are only valid within the second they were created
+	for (auto it = response_cache.begin(); it != response_cache.end();)
+	{
+		if (it->second.time != now)
+			it = response_cache.erase(it);
+		else
+		{
+			if (it->first != entry_key)
+				bytes += it->second.content.size();
+			++it;
+		}
+	}
+
+	CachedResponse &entry = response_cache[entry_key];
+	entry.version = version;
+	entry.time = now;
+	entry.encoding = gzip ? Compress(content, entry.content) : nullptr;
+
+	if (!entry.encoding)
+		entry.content = content;
+
+	MemoryBudget::account(MemoryBudget::CACHE, response_cache_reported, bytes + entry.content.size());
+
+	ResponseEncoded(c, type, entry.content.data(), entry.content.size(), entry.encoding);
+}
+
+// removes name=value from the arguments and returns the value, empty if not present
+static std::string takeArgument(std::string &args, const std::string &name)
+{
+	std::string::size_type start = 0;
+
+	while (start < args.size())
+	{
+		std::string::size_type end = args.find('&', start);
+		if (end == std::string::npos)
+			end = args.size();
+
+		if (args.compare(start, name.size() + 1, name + "=") == 0)
+		{
+			std::string value = args.substr(start + name.size() + 1, end - start - name.size() - 1);
+			args.erase(start > 0 ? start - 1 : start, end - start + (start > 0 || end < args.size() ? 1 : 0));
+			return value;
+		}
+		start = end + 1;
+	}
+	return "";
+}
+
 void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response, bool gzip)
 {
 
@@ -622,20 +1013,44 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 	}
 	else if (r == "/kml" && KML)
 	{
-		std::string content = ships.getKML();
-		Response(c, "application/vnd.google-earth.kml+xml", content, use_zlib & gzip);
+		ResponseChunked(c, "application/vnd.google-earth.kml+xml", ships.writeKML(), use_zlib & gzip);
 	}
 	else if (r == "/metrics")
 	{
 		if (supportPrometheus)
 		{
-			std::string content = dataPrometheus.toPrometheus();
+			std::string content = dataPrometheus.toPrometheus() + ships.getPrometheus() + planes.getHashStatsPrometheus();
+			{
+				std::lock_guard<std::mutex> lock(metrics_mtx);
+				for (auto o : metrics)
+					content += o->getPrometheus();
+				for (auto o : metrics_msg)
+					content += o->getPrometheus();
+				content += IO::OutputMessage::getQueuePrometheus(metrics_msg);
+			}
+			content += IO::Uring::getInstance().getPrometheus();
+			if (metrics_aggregator)
+				content += metrics_aggregator->getPrometheus();
+			if (metrics_merge)
+				content += metrics_merge->getPrometheus();
+			if (replication_port)
+				content += replication_server.getPrometheus();
+			if (!replication_source.empty())
+				content += replication_client.getPrometheus();
+			if (message_log.isOpen())
+				content += message_log.getPrometheus();
+			content += getDevicePrometheus();
 			Response(c, "text/plain", content, use_zlib & gzip);
 			dataPrometheus.Reset();
 		}
 	}
 	else if (r == "/api/stat.json" || r == "/stat.json")
 	{
+		const std::string key = r + (use_zlib & gzip ? "#gzip" : "");
+		const uint64_t version = counter.getVersion() + counter_session.getVersion() + ships.getVersion();
+
+		if (ResponseFromCache(c, key, version, "application/json"))
+			return;
 
 		JSON::JSONBuilder json;
 		json.start();
@@ -666,9 +1081,49 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 		json.key("station_link");
 		json.valueRaw(station_link);
 		json.addString("sample_rate", sample_rate);
+		json.addString("threads", threads);
+
+		json.key("devices");
+		json.startArray();
+		for (auto d : devices)
+		{
+			Device::Device::Statistics st = d->getStatistics();
+
+			json.start();
+			json.add("overruns", st.overruns);
+			json.add("dropped", (unsigned long long)st.dropped);
+			json.add("fifo_max", st.fifo_max);
+			json.add("fifo_blocks", st.fifo_blocks);
+			json.add("fifo_block_size", st.fifo_block_size);
+			json.add("fifo_grows", st.fifo_grows);
+			json.add("latency_p99_us", (unsigned long long)st.latency_p99);
+			json.add("latency_max_us", (unsigned long long)st.latency_max);
+			json.end();
+		}
+		json.endArray();
+
+		json.key("latency");
+		json.startArray();
+		for (auto &l : Util::Perf::get().getLatencies())
+		{
+			json.start();
+			json.addString("output", l.name);
+			json.add("count", (unsigned long long)l.count);
+			json.add("decode_p99_us", (unsigned long long)l.decode_p99);
+			json.add("json_p99_us", (unsigned long long)l.json_p99);
+			json.add("send_p99_us", (unsigned long long)l.send_p99);
+			json.add("total_p50_us", (unsigned long long)l.total_p50);
+			json.add("total_p99_us", (unsigned long long)l.total_p99);
+			json.add("total_max_us", (unsigned long long)l.total_max);
+			json.end();
+		}
+		json.endArray();
 		json.add("msg_rate", hist_second.getAverage());
+		json.add("wakeups_per_second", Wakeups::getRate());
 		json.add("vessel_count", ships.getCount());
 		json.add("vessel_max", ships.getMaxCount());
+		json.add("db_memory", (unsigned long long)ships.getMemory());
+		json.add("db_memory_limit", (unsigned long long)ships.getMemoryLimit());
 		json.addString("product", product);
 		json.addString("vendor", vendor);
 		json.addString("serial", serial);
@@ -678,6 +1133,12 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 		json.addString("build_describe", VERSION_DESCRIBE);
 		json.addString("run_time", std::to_string((long int)time(nullptr) - (long int)time_start));
 		json.add("memory", Util::Helper::getMemoryConsumption());
+		json.add("memory_budget", (unsigned long long)MemoryBudget::get());
+		json.key("memory_use");
+		json.start();
+		for (int i = 0; i < MemoryBudget::COUNT; i++)
+			json.add(MemoryBudget::name((MemoryBudget::Part)i), (unsigned long long)MemoryBudget::getUsage((MemoryBudget::Part)i));
+		json.end();
 		json.key("os");
 		json.valueRaw(os);
 		json.key("hardware");
@@ -706,22 +1167,225 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 		json.addString("received", received);
 		json.end();
 
+		ResponseToCache(c, key, version, "application/json", json.str(), use_zlib & gzip);
+	}
+	else if (r == "/api/perf")
+	{
+		JSON::JSONBuilder json;
+		json.start();
+		json.key("stages");
+		json.startArray();
+		for (auto &s : Util::Perf::get().getStages())
+		{
+			json.start();
+			json.addString("name", s.name);
+			json.add("calls", (unsigned long long)s.calls);
+			json.add("samples", (unsigned long long)s.samples);
+			json.add("total_ns", (unsigned long long)s.total_ns);
+			json.add("p99_ns", (unsigned long long)s.p99_ns);
+			json.end();
+		}
+		json.endArray();
+
+		json.key("queues");
+		json.startArray();
+		{
+			std::lock_guard<std::mutex> lock(metrics_mtx);
+			for (int i = 0; i < (int)metrics_msg.size(); i++)
+			{
+				Util::AsyncStream<AIS::Message> *q = metrics_msg[i]->getQueue();
+				if (!q)
+					continue;
+
+				json.start();
+				json.add("output", i);
+				json.add("size", q->getQueueSize());
+				json.add("depth", q->getDepth());
+				json.add("depth_max", q->getMaxDepth());
+				json.add("delivered", q->getDelivered());
+				json.add("dropped", q->getDropped());
+				json.end();
+			}
+		}
+		json.endArray();
+		json.end();
+
+		Response(c, "application/json", json.str(), use_zlib & gzip);
+	}
+	else if (r == "/api/stations.json")
+	{
+		// stations by message count, page from 0 with size entries per page
+		const std::string page_str = takeArgument(a, "page");
+		const std::string size_str = takeArgument(a, "size");
+
+		int page = page_str.empty() ? 0 : (int)MIN(1000000L, MAX(0L, std::strtol(page_str.c_str(), nullptr, 10)));
+		int size = size_str.empty() ? 100 : MIN(1000, MAX(1, (int)std::strtol(size_str.c_str(), nullptr, 10)));
+
+		Response(c, "application/json", station_stats.toJSON(page, size), use_zlib & gzip);
+	}
+	else if (r == "/api/spectrum" && !spectra.empty())
+	{
+		// the last spectrum per receiver, null until the first one is in
+		JSON::JSONBuilder json;
+		json.start().key("spectra").startArray();
+		for (auto *s : spectra)
+		{
+			const std::string str = s->getJSON();
+			json.valueRaw(str.empty() ? "null" : str);
+		}
+		json.endArray().end();
+
+		Response(c, "application/json", json.str(), use_zlib & gzip);
+	}
+	else if (r == "/api/spectrum/sse" && !spectra.empty())
+	{
+		IO::SSEConnection *sse = upgradeSSE(c, 4);
+		for (int i = 0; i < (int)spectra.size(); i++)
+		{
+			const std::string str = spectra[i]->getJSON();
+			if (!str.empty())
+				sse->SendEvent("spectrum", "{\"receiver\":" + std::to_string(i) + ",\"spectrum\":" + str + "}");
+		}
+	}
+	else if (r == "/api/memory")
+	{
+		// bytes per subsystem, the heap beyond the accounted parts is unattributed
+		uint64_t total = MemoryBudget::getTotal(), heap = MemoryBudget::getHeap();
+
+		JSON::JSONBuilder json;
+		json.start();
+		json.add("budget", (unsigned long long)MemoryBudget::get());
+		json.key("parts");
+		json.start();
+		for (int i = 0; i < MemoryBudget::COUNT; i++)
+			json.add(MemoryBudget::name((MemoryBudget::Part)i), (unsigned long long)MemoryBudget::getUsage((MemoryBudget::Part)i));
+		json.end();
+		json.add("total", (unsigned long long)total);
+		json.add("heap", (unsigned long long)heap);
+		json.add("unattributed", (unsigned long long)(heap > total ? heap - total : 0));
+		json.add("rss", (unsigned long long)Util::Helper::getMemoryConsumption());
+		json.key("ships");
+		json.valueRaw(ships.getMemoryJSON());
+		json.key("planes");
+		json.valueRaw(planes.getMemoryJSON());
+		json.end();
+
 		Response(c, "application/json", json.str(), use_zlib & gzip);
 	}
 	else if (r == "/api/ships.json" || r == "/ships.json")
 	{
-		std::string content = ships.getJSON();
-		Response(c, "application/json", content, use_zlib & gzip);
+		ResponseDeferred(c, "application/json", [this]()
+						 { return ships.getJSON(); }, use_zlib & gzip);
 	}
 	else if (r == "/api/ships_array.json")
 	{
-		std::string content = ships.getJSONcompact();
+		// optional area: bbox=lat_min,lon_min,lat_max,lon_max or radius=lat,lon,nmi, and fields=mmsi,lat,lon
+		Area area;
+		Projection projection;
+		const std::string key = r + "?" + a + (use_zlib & gzip ? "#gzip" : "");
+		const uint64_t version = ships.getVersion();
+
+		if (ResponseFromCache(c, key, version, "application/json"))
+			return;
+
+		const std::string fields = takeArgument(a, "fields");
+
+		if ((!fields.empty() && !projection.parse(fields)) || (!a.empty() && !area.parse(a)))
+			Response(c, "application/json", "{\"count\":0,\"values\":[],\"error\":true}");
+		else if (!projection.empty())
+			ResponseToCache(c, key, version, "application/json", ships.getJSONcompact(projection, a.empty() ? nullptr : &area), use_zlib & gzip);
+		else if (a.empty())
+			ResponseToCache(c, key, version, "application/json", ships.getJSONcompact(), use_zlib & gzip);
+		else
+			ResponseToCache(c, key, version, "application/json", ships.getJSONcompact(area), use_zlib & gzip);
+	}
+	else if (r == "/api/ships_delta.json")
+	{
+		// argument: epoch,seq as returned by the previous call, empty for a full update
+		std::stringstream ss(a);
+		long long since_epoch = 0;
+		unsigned long long since_seq = 0;
+		char sep;
+
+		if (!(ss >> since_epoch >> sep >> since_seq) || sep != ',')
+			since_epoch = since_seq = 0;
+
+		std::string content = ships.getJSONdelta((std::time_t)since_epoch, (uint64_t)since_seq);
 		Response(c, "application/json", content, use_zlib & gzip);
 	}
+	else if (r == "/api/ships_delta.bin")
+	{
+		// as ships_delta.json in the encoding of the websocket frames
+		std::stringstream ss(a);
+		long long since_epoch = 0;
+		unsigned long long since_seq = 0;
+		char sep;
+
+		if (!(ss >> since_epoch >> sep >> since_seq) || sep != ',')
+			since_epoch = since_seq = 0;
+
+		std::time_t epoch = (std::time_t)since_epoch;
+		uint64_t seq = (uint64_t)since_seq;
+
+		binary.clear();
+		Util::Serialize::Uint8(WS_SHIPS, binary);
+		Util::Serialize::Uint8(BINARY_VERSION, binary);
+		ships.getBinaryDelta(binary, epoch, seq);
+		Response(c, "application/octet-stream", binary.data(), binary.size(), use_zlib & gzip);
+	}
+	else if (r == "/api/planes.bin")
+	{
+		binary.clear();
+		Util::Serialize::Uint8(WS_PLANES, binary);
+		Util::Serialize::Uint8(BINARY_VERSION, binary);
+		planes.getBinaryDelta(binary, 0);
+		Response(c, "application/octet-stream", binary.data(), binary.size(), use_zlib & gzip);
+	}
 	else if (r == "/api/planes_array.json")
 	{
-		std::string content = planes.getCompactArray();
-		Response(c, "application/json", content, use_zlib & gzip);
+		const std::string key = r + (use_zlib & gzip ? "#gzip" : "");
+		const uint64_t version = planes.getVersion();
+
+		if (!ResponseFromCache(c, key, version, "application/json"))
+			ResponseToCache(c, key, version, "application/json", planes.getCompactArray(), use_zlib & gzip);
+	}
+	else if (r == "/api/plane_path.json")
+	{
+		std::stringstream ss(a);
+		std::string hexident_str;
+		JSON::JSONBuilder json;
+		json.start();
+		int count = 0;
+		const int MAX_HEXIDENT_COUNT = 100;
+
+		while (std::getline(ss, hexident_str, ','))
+		{
+			if (++count > MAX_HEXIDENT_COUNT)
+			{
+				Error() << "Server - plane path count exceeds limit: " << MAX_HEXIDENT_COUNT;
+				break;
+			}
+
+			try
+			{
+				long hexident = std::stol(hexident_str);
+				if (hexident >= 0 && hexident <= 0xFFFFFF)
+				{
+					json.key(std::to_string(hexident));
+					json.valueRaw(planes.getTrailJSON((uint32_t)hexident));
+				}
+			}
+			catch (const std::invalid_argument &)
+			{
+				Error() << "Server - plane path hexident invalid: " << hexident_str;
+			}
+			catch (const std::out_of_range &)
+			{
+				Error() << "Server - plane path hexident out of range: " << hexident_str;
+			}
+		}
+		json.end();
+		Response(c, "application/json", json.str(), use_zlib & gzip);
 	}
 	else if (r == "/sb")
 	{
@@ -731,16 +1395,33 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 	}
 	else if (r == "/api/ships_full.json")
 	{
-		std::string content = ships.getJSON(true);
-		Response(c, "application/json", content, use_zlib & gzip);
-	}
-	else if (r == "/api/sse" && realtime)
-	{
-		upgradeSSE(c, 1);
+		// optional: fields=mmsi,lat,lon
+		Projection projection;
+		const std::string fields = takeArgument(a, "fields");
+
+		if (fields.empty())
+			ResponseDeferred(c, "application/json", [this]()
+							 { return ships.getJSON(true); }, use_zlib & gzip);
+		else if (!projection.parse(fields))
+			Response(c, "application/json", "{\"count\":0,\"ships\":[],\"error\":true}");
+		else
+		{
+			const std::string key = r + "?" + projection.key + (use_zlib & gzip ? "#gzip" : "");
+			const uint64_t version = ships.getVersion();
+
+			if (!ResponseFromCache(c, key, version, "application/json"))
+				ResponseToCache(c, key, version, "application/json", ships.getJSON(projection, true), use_zlib & gzip);
+		}
 	}
-	else if (r == "/api/signal" && realtime)
+	else if ((r == "/api/sse" || r == "/api/signal") && realtime)
 	{
-		upgradeSSE(c, 2);
+		// optional: bbox=lat_min,lon_min,lat_max,lon_max&mmsi=a,b,c&fields=mmsi,lat,lon
+		IO::SSESubscription subscription;
+
+		if (!subscription.parse(a))
+			Response(c, "application/text", "Invalid subscription");
+		else
+			upgradeSSE(c, r == "/api/sse" ? 1 : 2, subscription);
 	}
 	else if (r == "/api/log" && showlog)
 	{
@@ -751,10 +1432,48 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 			s->SendEvent("log", m.toJSON());
 		}
 	}
+	else if (r == "/api/ws" && websocket)
+	{
+		// argument: "ships", "planes" or both, default is both
+		int topics = (a.find("ships") != std::string::npos ? WS_SHIPS : 0) | (a.find("planes") != std::string::npos ? WS_PLANES : 0);
+		if (!topics)
+			topics = WS_SHIPS | WS_PLANES;
+
+		IO::WebSocketConnection *w = upgradeWebSocket(c, topics);
+
+		// a full state first, the pushed deltas are applied on top of it
+		if (w && (topics & WS_SHIPS))
+		{
+			std::time_t epoch = 0;
+			uint64_t seq = 0;
+
+			binary.clear();
+			Util::Serialize::Uint8(WS_SHIPS, binary);
+			Util::Serialize::Uint8(BINARY_VERSION, binary);
+			ships.getBinaryDelta(binary, epoch, seq);
+			w->Queue(IO::WebSocketConnection::Encode(binary.data(), binary.size()));
+		}
+
+		if (w && (topics & WS_PLANES))
+		{
+			binary.clear();
+			Util::Serialize::Uint8(WS_PLANES, binary);
+			Util::Serialize::Uint8(BINARY_VERSION, binary);
+			planes.getBinaryDelta(binary, 0);
+			w->Queue(IO::WebSocketConnection::Encode(binary.data(), binary.size()));
+		}
+
+		// the push service sleeps while nobody is subscribed
+		if (w)
+			cv.notify_all();
+	}
 	else if (r == "/api/binmsgs.json")
 	{
-		std::string content = ships.getBinaryMessagesJSON();
-		Response(c, "application/json", content, use_zlib & gzip);
+		const std::string key = r + (use_zlib & gzip ? "#gzip" : "");
+		const uint64_t version = ships.getBinaryVersion();
+
+		if (!ResponseFromCache(c, key, version, "application/json"))
+			ResponseToCache(c, key, version, "application/json", ships.getBinaryMessagesJSON(), use_zlib & gzip);
 	}
 	else if (r == "/custom/plugins.js")
 	{
@@ -809,9 +1528,7 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 	}
 	else if (r == "/api/allpath.json")
 	{
-
-		std::string content = ships.getAllPathJSON();
-		Response(c, "application/json", content, use_zlib & gzip);
+		ResponseChunked(c, "application/json", ships.writeAllPathJSON(), use_zlib & gzip);
 	}
 	else if (r == "/api/path.geojson")
 	{
@@ -851,18 +1568,22 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 	}
 	else if (r == "/api/allpath.geojson")
 	{
-		std::string content = ships.getAllPathGeoJSON();
-		Response(c, "application/json", content, use_zlib & gzip);
+		ResponseChunked(c, "application/json", ships.writeAllPathGeoJSON(), use_zlib & gzip);
 	}
 	else if (r == "/geojson" && GeoJSON)
 	{
-		std::string content = ships.getGeoJSON();
-		Response(c, "application/json", content, use_zlib & gzip);
+		Area area;
+
+		if (a.empty())
+			ResponseChunked(c, "application/json", ships.writeGeoJSON(), use_zlib & gzip);
+		else if (area.parse(a))
+			Response(c, "application/json", ships.getGeoJSON(area), use_zlib & gzip);
+		else
+			Response(c, "application/json", "{\"type\":\"FeatureCollection\",\"features\":[],\"error\":true}");
 	}
 	else if (r == "/allpath.geojson" && GeoJSON)
 	{
-		std::string content = ships.getAllPathGeoJSON();
-		Response(c, "application/json", content, use_zlib & gzip);
+		ResponseChunked(c, "application/json", ships.writeAllPathGeoJSON(), use_zlib & gzip);
 	}
 	else if (r == "/api/message")
 	{
@@ -921,22 +1642,52 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 			Response(c, "application/text", "Vessel not available");
 		}
 	}
+	else if (r == "/api/history")
+	{
+		// argument: mmsi[,from[,to]] with times in unix seconds, by default the last 24 hours
+		const int MAX_MESSAGES = 10000;
+
+		std::stringstream ss(a);
+		long long mmsi = 0, from, to;
+		char comma;
+		std::time_t now = time(nullptr);
+
+		to = now;
+		from = now - 24 * 3600;
+
+		if (!message_log.isOpen())
+			Response(c, "application/json", std::string("{\"error\":\"Message log is disabled\"}"));
+		else if (!(ss >> mmsi) || mmsi < 1 || mmsi > 999999999 || ((ss >> comma) && (comma != ',' || !(ss >> from) || ((ss >> comma) && (comma != ',' || !(ss >> to))))))
+			Response(c, "application/json", std::string("{\"error\":\"Invalid request\"}"));
+		else
+			ResponseDeferred(c, "application/json", [this, mmsi, from, to]()
+							 { return message_log.getJSON((uint32_t)mmsi, (std::time_t)from, (std::time_t)to, MAX_MESSAGES); }, use_zlib & gzip);
+	}
 	else if (r == "/api/history_full.json")
 	{
+		// optional: since=unix time, only the intervals from the one containing since on, as given by "until"
+		const std::string key = r + "?" + a + (use_zlib & gzip ? "#gzip" : "");
+		const uint64_t version = counter.getVersion() + counter_session.getVersion();
+
+		if (ResponseFromCache(c, key, version, "application/json"))
+			return;
+
+		const std::string since_str = takeArgument(a, "since");
+		long int since = since_str.empty() ? 0 : std::strtol(since_str.c_str(), nullptr, 10);
 
 		JSON::JSONBuilder json;
 		json.start();
 		json.key("second");
-		json.valueRaw(hist_second.toJSON());
+		json.valueRaw(hist_second.toJSON(since));
 		json.key("minute");
-		json.valueRaw(hist_minute.toJSON());
+		json.valueRaw(hist_minute.toJSON(since));
 		json.key("hour");
-		json.valueRaw(hist_hour.toJSON());
+		json.valueRaw(hist_hour.toJSON(since));
 		json.key("day");
-		json.valueRaw(hist_day.toJSON());
+		json.valueRaw(hist_day.toJSON(since));
 		json.end();
 
-		Response(c, "application/json", json.str() + "\n\n", use_zlib & gzip);
+		ResponseToCache(c, key, version, "application/json", json.str() + "\n\n", use_zlib & gzip);
 	}
 	else if (r.substr(0, 6) == "/tiles")
 	{
@@ -951,12 +1702,19 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 
 				if (source->isValidTile(z, x, y))
 				{
-					std::string contentType;
-					const std::vector<unsigned char> &data = source->getTile(z, x, y, contentType);
+					TilePtr tile = source->getTile(z, x, y);
 
-					if (!data.empty())
+					if (!tile->data.empty())
 					{
-						Response(c, contentType, (char *)data.data(), data.size(), use_zlib & gzip, true);
+						// the gzipped copy is a different representation and gets its own ETag
+						bool zipped = use_zlib && acceptsGzip() && !tile->zipped.empty();
+						const std::vector<unsigned char> &data = zipped ? tile->zipped : tile->data;
+						std::string etag = zipped ? tile->etag.substr(0, tile->etag.size() - 1) + "-gz\"" : tile->etag;
+
+						if (getIfNoneMatch() == etag)
+							ResponseNotModified(c, etag);
+						else
+							ResponseRaw(c, tile->contentType, (const char *)data.data(), data.size(), zipped, true, etag);
 						return;
 					}
 				}
@@ -975,7 +1733,12 @@ void WebViewer::Request(IO::TCPServerConnection &c, const std::string &response,
 		if (it != WebDB::files.end())
 		{
 			const WebDB::FileData &file = it->second;
-			ResponseRaw(c, file.mime_type, (char *)file.data, file.size, true, std::string(file.mime_type) != "text/html");
+
+			// assets are stored compressed, repeat visits are answered from the ETag
+			if (getIfNoneMatch() == file.etag)
+				ResponseNotModified(c, file.etag);
+			else
+				ResponseRaw(c, file.mime_type, (char *)file.data, file.size, true, std::string(file.mime_type) != "text/html", file.etag);
 		}
 		else
 		{
@@ -1034,6 +1797,10 @@ Setting &WebViewer::Set(std::string option, std::string arg)
 		ships.setLat(Util::Parse::Float(arg));
 		planes.setLat(Util::Parse::Float(arg));
 	}
+	else if (option == "STATIONS")
+	{
+		station_stats.setSize(Util::Parse::Integer(arg, 0, 65536, option));
+	}
 	else if (option == "CUTOFF")
 	{
 		int cutoff = Util::Parse::Integer(arg, 0, 10000, option);
@@ -1065,6 +1832,10 @@ Setting &WebViewer::Set(std::string option, std::string arg)
 		ships.setMsgSave(b);
 		plugins += "message_save=" + (b ? std::string("true;\n") : std::string("false;\n"));
 	}
+	else if (option == "MSG_BUFFER")
+	{
+		ships.setMsgBufferSize(Util::Parse::Integer(arg, 1, 1024, option) * 1024 * 1024);
+	}
 	else if (option == "LON")
 	{
 		ships.setLon(Util::Parse::Float(arg));
@@ -1090,6 +1861,45 @@ Setting &WebViewer::Set(std::string option, std::string arg)
 	{
 		ships.setTimeHistory(Util::Parse::Integer(arg, 5, 12 * 3600, option));
 	}
+	else if (option == "BINARY_MAX")
+	{
+		// binary messages kept for /api/binmsgs.json, the latest per DAC, FI and MMSI
+		ships.setBinaryMax(Util::Parse::Integer(arg, 1, 65536, option));
+	}
+	else if (option == "WORKERS")
+	{
+		setWorkers(Util::Parse::Integer(arg, 0, 16, option));
+	}
+	else if (option == "DB_MEMORY")
+	{
+		// in MB, the ship and plane tables can each grow up to this size
+		std::size_t n = (std::size_t)Util::Parse::Integer(arg, 0, 65536, option) << 20;
+		db_memory = n;
+		ships.setMemoryCap(n);
+		planes.setMemoryCap(n);
+	}
+	else if (option == "REPLICATION_PORT")
+	{
+		replication_port = Util::Parse::Integer(arg, 1, 0xFFFF, option);
+	}
+	else if (option == "REPLICATE_FROM")
+	{
+		// follower: the ship table is copied from another instance (host:port)
+		replication_source = arg;
+	}
+	else if (option == "MESSAGE_LOG")
+	{
+		message_log_dir = arg;
+	}
+	else if (option == "MESSAGE_LOG_DAYS")
+	{
+		message_log.setRetention(Util::Parse::Integer(arg, 1, 3650, option));
+	}
+	else if (option == "MESSAGE_LOG_SEGMENT")
+	{
+		// in MB per segment file
+		message_log.setSegmentSize((uint64_t)Util::Parse::Integer(arg, 1, 1024, option) << 20);
+	}
 	else if (option == "FILE")
 	{
 		backup_filename = arg;
@@ -1115,10 +1925,24 @@ Setting &WebViewer::Set(std::string option, std::string arg)
 	{
 		addFileSystemTilesSource(arg, true);
 	}
+	else if (option == "TILE_CACHE")
+	{
+		tile_cache = Util::Parse::Integer(arg, 0, 4096, option);
+		for (auto &source : mapSources)
+			source->setCacheSize((size_t)tile_cache << 20);
+	}
 	else if (option == "BACKUP")
 	{
 		backup_interval = Util::Parse::Integer(arg, 5, 2 * 24 * 60, option);
 	}
+	else if (option == "BACKUP_JOURNAL")
+	{
+		backup_journal = Util::Parse::Switch(arg);
+	}
+	else if (option == "WEBSOCKET")
+	{
+		websocket = Util::Parse::Switch(arg);
+	}
 	else if (option == "REALTIME")
 	{
 		realtime = Util::Parse::Switch(arg);
@@ -1191,10 +2015,18 @@ Setting &WebViewer::Set(std::string option, std::string arg)
 	{
 		supportPrometheus = Util::Parse::Switch(arg);
 	}
+	else if (option == "PROFILE")
+	{
+		profile = Util::Parse::Switch(arg);
+	}
 	else if (option == "REUSE_PORT")
 	{
 		setReusePort(Util::Parse::Switch(arg));
 	}
+	else if (option == "LISTENERS")
+	{
+		setListeners(Util::Parse::Integer(arg, 1, 64, option));
+	}
 	else if (!filter.SetOption(option, arg))
 	{
 		throw std::runtime_error("unrecognized setting for HTML service: " + option + " " + arg);
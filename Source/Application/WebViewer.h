@@ -21,6 +21,7 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <unordered_map>
 
 #include "AIS-catcher.h"
 
@@ -31,11 +32,13 @@
 #include "HTTPServer.h"
 #include "DB.h"
 #include "PlaneDB.h"
+#include "Replication.h"
+#include "MessageLog.h"
 #include "History.h"
 #include "Receiver.h"
 #include "MapTiles.h"
 
-class SSEStreamer : public StreamIn<JSON::JSON>
+class SSEStreamer : public StreamIn<JSON::JSON>, public JSON::KeySet
 {
 	IO::HTTPServer *server = nullptr;
 
@@ -46,6 +49,7 @@ public:
 	virtual ~SSEStreamer() = default;
 
 	void Receive(const JSON::JSON *data, int len, TAG &tag);
+	bool getKeys(std::vector<int> &keys) { return true; }
 	void setSSE(IO::HTTPServer *s) { server = s; }
 	void setObfuscate(bool o) { obfuscate = o; }
 };
@@ -100,16 +104,55 @@ class WebViewer : public IO::HTTPServer, public Setting
 	bool port_set = false;
 	bool use_zlib = true;
 	bool realtime = false;
+	bool websocket = true;
 	bool showlog = false;
 	bool showdecoder = false;
 	bool KML = false;
 	bool GeoJSON = false;
 	bool supportPrometheus = false;
+	// outputs can be replaced while the server runs, see removeMetrics
+	std::mutex metrics_mtx;
+	std::vector<IO::OutputJSON *> metrics;
+	std::vector<IO::OutputMessage *> metrics_msg;
+	AIS::Aggregator *metrics_aggregator = nullptr;
+	AIS::MessageMerge *metrics_merge = nullptr;
+	int replication_port = 0;
+	std::string replication_source;
+	Replication::Server replication_server;
+	Replication::Client replication_client;
+	std::string message_log_dir;
+	MessageLog message_log;
+	std::vector<Device::Device *> devices;
+	std::string getDevicePrometheus();
 	bool thread_running = false;
 	bool aboutPresent = false;
 
 	std::vector<char> binary;
+
+	// topics of /api/ws and the .bin endpoints, frames start with the topic and the format version
+	const static int WS_SHIPS = 1;
+	const static int WS_PLANES = 2;
+	const static int BINARY_VERSION = 2;
+
+	// serialized responses of the polled endpoints, keyed by endpoint, query and encoding.
+	// An entry is reused within the same second as long as the source has not changed.
+	struct CachedResponse
+	{
+		uint64_t version = 0;
+		std::time_t time = 0;
+		const char *encoding = nullptr;
+		std::string content;
+	};
+	std::unordered_map<std::string, CachedResponse> response_cache;
+	std::size_t response_cache_reported = 0;
+
+	bool ResponseFromCache(IO::TCPServerConnection &c, const std::string &key, uint64_t version, const std::string &type);
+	void ResponseToCache(IO::TCPServerConnection &c, const std::string &key, uint64_t version, const std::string &type, const std::string &content, bool gzip);
 	std::vector<std::shared_ptr<MapTiles>> mapSources;
+	// tile cache per source in MB
+	int tile_cache = 32;
+	// DB_MEMORY in bytes, 0 if the tables follow the memory budget
+	std::size_t db_memory = 0;
 
 	std::string params;
 	std::string plugin_code;
@@ -121,6 +164,11 @@ class WebViewer : public IO::HTTPServer, public Setting
 	DB ships;
 	PlaneDB planes;
 
+	// PROFILE on times the ship table updates, reported with the other stages on /api/perf and -b
+	bool profile = false;
+	Util::Probe<JSON::JSON> probe_ships;
+	StreamIn<JSON::JSON> *shipsInput();
+
 	// history of 180 minutes and 180 seconds
 	History<60, 60> hist_minute;
 	History<60, 1> hist_second;
@@ -128,27 +176,45 @@ class WebViewer : public IO::HTTPServer, public Setting
 	History<90, 86400> hist_day;
 
 	Counter counter, counter_session;
+	// per contributing station, for servers that aggregate many stations
+	StationStatistics station_stats;
+
+	// spectrum taps of the connected front-ends, pushed on SSE channel 4
+	std::vector<DSP::Spectrum *> spectra;
+	void addSpectrum(AIS::Model &m);
 	SSEStreamer sse_streamer;
 	WebViewerLogger logger;
 	PromotheusCounter dataPrometheus;
 	ByteCounter raw_counter;
 
 	std::time_t time_start;
-	std::string sample_rate, product, vendor, model, serial, station = "\"\"", station_link = "\"\"";
+	std::string sample_rate, threads, product, vendor, model, serial, station = "\"\"", station_link = "\"\"";
 	std::string backup_filename = "";
 	std::string os, hardware;
 
 	std::mutex m;
 	std::condition_variable cv;
 	std::thread backup_thread;
+	std::thread push_thread;
 
 	void BackupService();
+	void PushService();
 	void addPlugin(const std::string &str);
 
 	bool Load();
 	bool Save();
 	void Clear();
 
+	// backups append the changes to a journal next to the backup file, it is compacted into the
+	// backup file when it has grown to the size of the backup
+	bool backup_journal = true;
+	uint64_t journal_seq = 0;
+	std::streamoff backup_size = 0;
+
+	std::string journalFile() { return backup_filename + ".journal"; }
+	bool SaveJournal();
+	int LoadJournal();
+
 	void stopThread();
 	AIS::Filter filter;
 
@@ -169,14 +235,39 @@ public:
 			logger.Stop();
 
 		stopThread();
+		MemoryBudget::account(MemoryBudget::CACHE, response_cache_reported, 0);
 	}
 
 	bool &active() { return run; }
 	void connect(Receiver &r);
+	void addMetrics(IO::OutputJSON *o)
+	{
+		std::lock_guard<std::mutex> lock(metrics_mtx);
+		metrics.push_back(o);
+	}
+	void addMetrics(IO::OutputMessage *o)
+	{
+		std::lock_guard<std::mutex> lock(metrics_mtx);
+		metrics_msg.push_back(o);
+	}
+	// before the output is destroyed
+	void removeMetrics(IO::OutputJSON *o)
+	{
+		std::lock_guard<std::mutex> lock(metrics_mtx);
+		metrics.erase(std::remove(metrics.begin(), metrics.end(), o), metrics.end());
+	}
+	void removeMetrics(IO::OutputMessage *o)
+	{
+		std::lock_guard<std::mutex> lock(metrics_mtx);
+		metrics_msg.erase(std::remove(metrics_msg.begin(), metrics_msg.end(), o), metrics_msg.end());
+	}
+	void addMetrics(AIS::Aggregator *a) { metrics_aggregator = a; }
+	void addMetrics(AIS::MessageMerge *m) { metrics_merge = m; }
 	void connect(AIS::Model &model, Connection<JSON::JSON> &json, Device::Device &device);
 	void start();
 	void close();
 	void Reset();
+	void tick() { message_log.tick(); }
 
 	void setDeviceDescription(std::string p, std::string v, std::string s)
 	{
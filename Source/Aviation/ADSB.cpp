@@ -16,6 +16,8 @@
 */
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include "ADSB.h"
 
@@ -65,19 +67,99 @@ namespace Plane
     // software style CRC calculation as used in READSB
     // https://github.com/wiedehopf/readsb/blob/dev/crc.c
 
-    uint32_t ADSB::calcCRC()
+    static uint32_t CRC(const uint8_t *data, int n)
     {
         uint32_t rem = 0;
 
-        for (int i = 0; i < len - 3; ++i)
+        for (int i = 0; i < n; ++i)
         {
-            rem = (rem << 8) ^ crc_table2[msg[i] ^ ((rem & 0xff0000) >> 16)];
+            rem = (rem << 8) ^ crc_table2[data[i] ^ ((rem & 0xff0000) >> 16)];
             rem = rem & 0xffffff;
         }
 
         return rem;
     }
 
+    uint32_t ADSB::calcCRC()
+    {
+        return CRC(msg, len - 3);
+    }
+
+    // syndromes of all one and two bit errors in a 112 bit message, sorted for binary search.
+    // The CRC is linear so the syndrome only depends on the error pattern. Errors in the
+    // DF field are not corrected and ambiguous syndromes are left out.
+    struct Syndrome
+    {
+        uint32_t syndrome;
+        int8_t bit1, bit2;
+
+        bool operator<(const Syndrome &s) const { return syndrome < s.syndrome; }
+    };
+
+    static uint32_t syndrome(const uint8_t *m)
+    {
+        return CRC(m, 11) ^ (((uint32_t)m[11] << 16) | ((uint32_t)m[12] << 8) | m[13]);
+    }
+
+    static std::vector<Syndrome> buildSyndromes()
+    {
+        std::vector<Syndrome> table;
+        uint8_t m[14] = {0};
+
+        for (int i = 5; i < 112; i++)
+        {
+            m[i >> 3] ^= 0x80 >> (i & 7);
+            table.push_back({syndrome(m), (int8_t)i, -1});
+
+            for (int j = i + 1; j < 112; j++)
+            {
+                m[j >> 3] ^= 0x80 >> (j & 7);
+                table.push_back({syndrome(m), (int8_t)i, (int8_t)j});
+                m[j >> 3] ^= 0x80 >> (j & 7);
+            }
+
+            m[i >> 3] ^= 0x80 >> (i & 7);
+        }
+
+        std::sort(table.begin(), table.end());
+
+        std::vector<Syndrome> unique;
+        for (int i = 0; i < table.size(); i++)
+        {
+            bool duplicate = (i > 0 && table[i - 1].syndrome == table[i].syndrome) || (i + 1 < table.size() && table[i + 1].syndrome == table[i].syndrome);
+
+            if (!duplicate)
+                unique.push_back(table[i]);
+        }
+
+        return unique;
+    }
+
+    bool ADSB::fixErrors()
+    {
+        if (len != 14)
+            return false;
+
+        uint32_t s = calcCRC() ^ crc;
+
+        if (!s)
+            return true;
+
+        static const std::vector<Syndrome> table = buildSyndromes();
+
+        auto it = std::lower_bound(table.begin(), table.end(), Syndrome{s, 0, 0});
+
+        if (it == table.end() || it->syndrome != s)
+            return false;
+
+        msg[it->bit1 >> 3] ^= 0x80 >> (it->bit1 & 7);
+        if (it->bit2 >= 0)
+            msg[it->bit2 >> 3] ^= 0x80 >> (it->bit2 & 7);
+
+        setCRC();
+        return true;
+    }
+
     void ADSB::Callsign()
     {
         static const char *cs_table = "#ABCDEFGHIJKLMNOPQRSTUVWXYZ##### ###############0123456789######";
@@ -176,25 +258,11 @@ namespace Plane
         case 0:  // Short Air-Air Surveillance
         case 4:  // Surveillance, Altitude Reply
         case 20: // Comm-B, Altitude Reply
-        {
-            setCRCandICAO();
-            altitude = decodeAC13Field();
-        }
-        break;
-
         case 5:  // Surveillance, Identity Reply
         case 21: // Comm-B, Identity Reply, ground or air
-        {
             setCRCandICAO();
-
-            int a = ((msg[3] & 0x80) >> 5) | ((msg[2] & 0x02) >> 0) | ((msg[2] & 0x08) >> 3);
-            int b = ((msg[3] & 0x02) << 1) | ((msg[3] & 0x08) >> 2) | ((msg[3] & 0x20) >> 5);
-            int c = ((msg[2] & 0x01) << 2) | ((msg[2] & 0x04) >> 1) | ((msg[2] & 0x10) >> 4);
-            int d = ((msg[3] & 0x01) << 2) | ((msg[3] & 0x04) >> 1) | ((msg[3] & 0x10) >> 4);
-
-            squawk = a * 1000 + b * 100 + c * 10 + d;
             break;
-        }
+
         case 11: // All-Call Reply, ground or air
         {
             hexident = getBits(8, 24);
@@ -216,69 +284,109 @@ namespace Plane
             break;
         }
         case 18: // Extended Squitter/Supplementary
+            fixErrors();
             break;
         case 17: // Extended Squitter
+            if (!fixErrors())
+            {
+                hexident = getBits(8, 24);
+                hexident_status = HEXINDENT_DIRECT;
+
+                status = STATUS_ERROR;
+                return;
+            }
+
             hexident = getBits(8, 24);
             hexident_status = HEXINDENT_DIRECT;
 
-            if (!verifyCRC())
+            message_subtypes |= 1 << getBits(32, 5);
+            break;
+        }
+
+        fields_pending = true;
+    }
+
+    void ADSB::DecodeFields(uint32_t fields)
+    {
+        if (!fields_pending)
+            return;
+
+        fields_pending = false;
+
+        switch (df)
+        {
+        case 0:
+        case 4:
+        case 20:
+            if (fields & FIELD_ALTITUDE)
+                altitude = decodeAC13Field();
+            break;
+
+        case 5:
+        case 21:
+            if (fields & FIELD_SQUAWK)
             {
-                status = STATUS_ERROR;
-                return;
+                int a = ((msg[3] & 0x80) >> 5) | ((msg[2] & 0x02) >> 0) | ((msg[2] & 0x08) >> 3);
+                int b = ((msg[3] & 0x02) << 1) | ((msg[3] & 0x08) >> 2) | ((msg[3] & 0x20) >> 5);
+                int c = ((msg[2] & 0x01) << 2) | ((msg[2] & 0x04) >> 1) | ((msg[2] & 0x10) >> 4);
+                int d = ((msg[3] & 0x01) << 2) | ((msg[3] & 0x04) >> 1) | ((msg[3] & 0x10) >> 4);
+
+                squawk = a * 1000 + b * 100 + c * 10 + d;
             }
+            break;
 
+        case 17:
+        {
             int TC = getBits(32, 5);
             int ST = getBits(37, 3); // ME message subtype
 
-            message_subtypes |= 1 << TC;
-
             switch (TC)
             {
             case 1: // Aircraft Identification
             case 2:
             case 3:
             case 4:
-
-                category = TC * 10 + ST;
-                Callsign();
+                if (fields & FIELD_IDENT)
+                {
+                    category = TC * 10 + ST;
+                    Callsign();
+                }
                 break;
 
             case 19: // Airborne Velocity
-                if (ST >= 1 && ST <= 4)
+                // ignore ST 3/4, unknown aircraft speed
+                if ((ST == 1 || ST == 2) && (fields & FIELD_VELOCITY))
                 {
-                    if (ST == 1 || ST == 2)
+                    int Vew = getBits(46, 10);
+                    int Vns = getBits(57, 10);
+
+                    if (Vew && Vns)
                     {
-                        int Vew = getBits(46, 10);
-                        int Vns = getBits(57, 10);
-
-                        if (Vew && Vns)
-                        {
-                            bool Dew = getBits(45, 1);
-                            bool Dns = getBits(56, 1);
-
-                            Vew = Dew ? -(Vew - 1) : (Vew - 1);
-                            Vns = Dns ? -(Vns - 1) : (Vns - 1);
-
-                            speed = sqrt(Vns * Vns + Vew * Vew);
-                            heading = atan2(Vew, Vns) * 360.0 / (2 * PI);
-                            if (heading < 0)
-                                heading += 360;
-
-                            if (ST == 2)
-                                speed *= 4;
-                        }
-
-                        int VR = getBits(69, 9);
-                        if (VR)
-                        {
-                            bool Svr = getBits(68, 1);
-                            vertrate = (VR - 1) * 64 * (Svr ? -1 : 1);
-                        }
-                        airborne = 1;
+                        bool Dew = getBits(45, 1);
+                        bool Dns = getBits(56, 1);
+
+                        Vew = Dew ? -(Vew - 1) : (Vew - 1);
+                        Vns = Dns ? -(Vns - 1) : (Vns - 1);
+
+                        speed = sqrt(Vns * Vns + Vew * Vew);
+                        heading = atan2(Vew, Vns) * 360.0 / (2 * PI);
+                        if (heading < 0)
+                            heading += 360;
+
+                        if (ST == 2)
+                            speed *= 4;
+                    }
+
+                    int VR = getBits(69, 9);
+                    if (VR)
+                    {
+                        bool Svr = getBits(68, 1);
+                        vertrate = (VR - 1) * 64 * (Svr ? -1 : 1);
                     }
-                    // ignore ST 3/4, unknown aircraft speed
                 }
 
+                if (ST == 1 || ST == 2)
+                    airborne = 1;
                 break;
 
             case 5: // Surface Position
@@ -288,17 +396,18 @@ namespace Plane
             {
                 airborne = 0;
 
-                if (getBits(44, 1))
+                if ((fields & FIELD_VELOCITY) && getBits(44, 1))
                     heading = getBits(45, 7) * 360 / 128.0;
 
-                decodeMovement();
-
-                CPR &cpr = getBits(53, 1) ? odd : even;
+                if (fields & FIELD_POSITION)
+                {
+                    CPR &cpr = getBits(53, 1) ? odd : even;
 
-                cpr.lat = getBits(54, 17);
-                cpr.lon = getBits(71, 17);
-                cpr.timestamp = rxtime;
-                cpr.airborne = false;
+                    cpr.lat = getBits(54, 17);
+                    cpr.lon = getBits(71, 17);
+                    cpr.timestamp = rxtime;
+                    cpr.airborne = false;
+                }
             }
             break;
 
@@ -313,20 +422,25 @@ namespace Plane
             case 17:
             case 18:
             {
-                altitude = decodeAC12Field();
+                if (fields & FIELD_ALTITUDE)
+                    altitude = decodeAC12Field();
                 airborne = 1;
 
-                CPR &cpr = getBits(53, 1) ? odd : even;
+                if (fields & FIELD_POSITION)
+                {
+                    CPR &cpr = getBits(53, 1) ? odd : even;
 
-                cpr.lat = getBits(54, 17);
-                cpr.lon = getBits(71, 17);
-                cpr.timestamp = rxtime;
-                cpr.airborne = true;
+                    cpr.lat = getBits(54, 17);
+                    cpr.lon = getBits(71, 17);
+                    cpr.timestamp = rxtime;
+                    cpr.airborne = true;
+                }
             }
             break;
             }
             break;
         }
+        }
     }
 
     int ADSB::MOD(int a, int b)
@@ -337,6 +451,14 @@ namespace Plane
         return res;
     }
 
+    double ADSB::MOD(double a, double b)
+    {
+        double res = std::fmod(a, b);
+        if (res < 0)
+            res += b;
+        return res;
+    }
+
     int ADSB::NL(double lat)
     {
         lat = std::abs(lat);
@@ -352,16 +474,33 @@ namespace Plane
         return std::floor(2 * PI / acos(tmp));
     }
 
+    // global decoding needs an even/odd pair received within the time window, otherwise the
+    // message is decoded locally against the last position of the plane if that is recent and valid
     bool ADSB::decodeCPR(FLOAT32 ref_lat, FLOAT32 ref_lon, bool use_even, bool &updated,  FLOAT32 &lt, FLOAT32 &ln)
     {
-        if (!even.Valid() || !odd.Valid() || (even.airborne != odd.airborne))
+        const CPR &cpr = use_even ? even : odd;
+        const CPR &other = use_even ? odd : even;
+
+        if (!cpr.Valid())
             return false;
 
-        if (even.airborne)
+        if (other.Valid() && other.airborne == cpr.airborne && std::abs((double)(cpr.timestamp - other.timestamp)) <= (cpr.airborne ? CPR_MAX_TIMEDIFF : CPR_MAX_TIMEDIFF_SURFACE))
         {
-            return decodeCPR_airborne(use_even, updated, lt, ln);
+            bool ok = cpr.airborne ? decodeCPR_airborne(use_even, updated, lt, ln) : decodeCPR_surface(ref_lat, ref_lon, use_even, updated, lt, ln);
+            if (ok)
+                return true;
         }
-        return decodeCPR_surface(ref_lat, ref_lon, use_even, updated, lt, ln);
+
+        if (position_status != ValueStatus::VALID || lat == LAT_UNDEFINED || lon == LON_UNDEFINED)
+            return false;
+
+        if (position_timestamp == TIME_UNDEFINED || cpr.timestamp - position_timestamp > CPR_MAX_REFERENCE_AGE)
+            return false;
+
+        if (cpr.airborne)
+            return decodeCPR_airborne_reference(use_even, lat, lon, updated, lt, ln);
+
+        return decodeCPR_surface_reference(use_even, lat, lon, updated, lt, ln);
     }
 
     bool ADSB::decodeCPR_airborne(bool use_even, bool &updated, FLOAT32 &lt, FLOAT32 &ln)
@@ -407,16 +546,20 @@ namespace Plane
 
         CPR &cpr = use_even ? even : odd;
         double d_lat = use_even ? 360.0 / 60 : 360.0 / 59;
-        int j = std::floor(ref_lat / d_lat) + std::floor(0.5 + MOD(ref_lat, d_lat) / d_lat - cpr.lat / CPR_SCALE + 0.5);
+        int j = (int)std::floor(ref_lat / d_lat) + (int)std::floor(0.5 + MOD((double)ref_lat, d_lat) / d_lat - cpr.lat / CPR_SCALE);
 
         lt = d_lat * (j + cpr.lat / CPR_SCALE);
 
-        int ni = NL(lt) - (use_even ? 0 : 1);
-        double d_lon = ni > 0 ? 360 / ni : 360;
+        int ni = MAX(NL(lt) - (use_even ? 0 : 1), 1);
+        double d_lon = 360.0 / ni;
 
-        int m = std::floor(ref_lon / d_lon) + std::floor(0.5 + (MOD(ref_lon, d_lon) / d_lon) - cpr.lon / CPR_SCALE);
+        int m = (int)std::floor(ref_lon / d_lon) + (int)std::floor(0.5 + MOD((double)ref_lon, d_lon) / d_lon - cpr.lon / CPR_SCALE);
 
         ln = d_lon * (m + cpr.lon / CPR_SCALE);
+
+        if (ln > 180.0)
+            ln -= 360.0;
+
         position_timestamp = cpr.timestamp;
         updated = true;
         return true;
@@ -471,14 +614,14 @@ namespace Plane
 
         CPR &cpr = use_even ? even : odd;
         double d_lat = use_even ? 90.0 / 60 : 90.0 / 59;
-        int j = std::floor(ref_lat / d_lat) + std::floor(0.5 + MOD(ref_lat, d_lat) / d_lat - cpr.lat / CPR_SCALE + 0.5);
+        int j = (int)std::floor(ref_lat / d_lat) + (int)std::floor(0.5 + MOD((double)ref_lat, d_lat) / d_lat - cpr.lat / CPR_SCALE);
 
         lt = d_lat * (j + cpr.lat / CPR_SCALE);
 
-        int ni = NL(lt) - (use_even ? 0 : 1);
-        double d_lon = ni > 0 ? 90 / ni : 90;
+        int ni = MAX(NL(lt) - (use_even ? 0 : 1), 1);
+        double d_lon = 90.0 / ni;
 
-        int m = std::floor(ref_lon / d_lon) + std::floor(0.5 + (MOD(ref_lon, d_lon) / d_lon) - cpr.lon / CPR_SCALE);
+        int m = (int)std::floor(ref_lon / d_lon) + (int)std::floor(0.5 + MOD((double)ref_lon, d_lon) / d_lon - cpr.lon / CPR_SCALE);
 
         ln = d_lon * (m + cpr.lon / CPR_SCALE);
         position_timestamp = cpr.timestamp;
@@ -24,17 +24,29 @@
 #include <sstream>
 
 #include "Common.h"
+#include "Clock.h"
 
 namespace Plane
 {
     static constexpr double BEAST_CLOCK_MHZ = 12.0;
     // CPR position update related constants
-    static constexpr double CPR_MAX_TIMEDIFF = 10.0; // Maximum time difference between even/odd messages
+    static constexpr double CPR_MAX_TIMEDIFF = 10.0;         // Maximum time difference between even/odd messages
+    static constexpr double CPR_MAX_TIMEDIFF_SURFACE = 50.0; // Same for surface positions
+    static constexpr double CPR_MAX_REFERENCE_AGE = 300.0;   // Maximum age of the last position for local decoding
     static constexpr int NZ = 15;                    // Number of geographic latitude zones
     static constexpr double AirDlat0 = 360.0 / 60;   // Even message latitude zone size
     static constexpr double AirDlat1 = 360.0 / 59;   // Odd message latitude zone size
 
-    extern uint32_t crc_table[112];
+    // groups of fields that are decoded from a frame on request, see ADSB::DecodeFields
+    enum Fields : uint32_t
+    {
+        FIELD_ALTITUDE = 1,
+        FIELD_SQUAWK = 2,
+        FIELD_IDENT = 4,    // callsign and category
+        FIELD_VELOCITY = 8, // speed, heading and vertical rate
+        FIELD_POSITION = 16,
+        FIELD_ALL = 31
+    };
 
     enum class ValueStatus
     {
@@ -82,6 +94,7 @@ namespace Plane
         } CPR_history[3];
 
         int CPR_history_idx = 0;
+        int trail_ptr = -1; // newest trail block in PlaneDB
 
         uint8_t msg[14]; // Raw message
         int df;          // Downlink format
@@ -117,7 +130,7 @@ namespace Plane
 
         void Stamp(std::time_t t = (std::time_t)0L)
         {
-            std::time(&rxtime);
+            rxtime = Util::Clock::now();
             if ((long int)t != 0 && t < rxtime)
                 setRxTimeUnix(t);
         }
@@ -125,7 +138,11 @@ namespace Plane
         void setRxTimeUnix(std::time_t t) { rxtime = t; }
         std::time_t getRxTimeUnix() const { return rxtime; }
 
+        // frame type, CRC and ICAO address only, the other fields follow with DecodeFields
         void Decode();
+        // decodes the requested fields of a frame that went through Decode, once
+        void DecodeFields(uint32_t fields = FIELD_ALL);
+        bool fields_pending = false;
 
         void clear()
         {
@@ -171,6 +188,8 @@ namespace Plane
             callsign[0] = '\0';
             last_group = GROUP_OUT_UNDEFINED;
             group_mask = 0;
+            fields_pending = false;
+            trail_ptr = -1;
         }
 
         std::string getRaw() const
@@ -245,12 +264,16 @@ namespace Plane
             return (computed == crc);
         }
 
+        // corrects up to two bit errors in DF17/18 via the CRC syndrome, false if not correctable
+        bool fixErrors();
+
         void Callsign();
         int decodeAC12Field();
         int decodeAC13Field();
         double decodeMovement();
 
         static int MOD(int a, int b);
+        static double MOD(double a, double b);
         static int NL(double lat);
 
         bool decodeCPR(FLOAT32 ref_lat, FLOAT32 ref_lon, bool is_even, bool &, FLOAT32 &lt, FLOAT32 &ln);
@@ -15,177 +15,285 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
+
 #include "Basestation.h"
 
-void Basestation::processLine()
+bool Basestation::parseInt(const Field &f, int &v)
 {
-	Plane::ADSB msg;
-	msg.clear();
-	msg.Stamp();
-	TAG tag;
+	const char *p = f.p, *e = f.p + f.len;
+	bool neg = false;
+
+	if (p < e && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+
+	if (p == e)
+		return false;
 
-	std::vector<std::string> fields;
-	std::stringstream ss(line);
-	std::string field;
-	while (std::getline(ss, field, ','))
+	int n = 0;
+	for (; p < e; p++)
 	{
-		if (!field.empty() && field.front() == '"' && field.size() >= 2 && field.back() == '"')
-			field = field.substr(1, field.size() - 2);
-		fields.push_back(field);
+		if (*p < '0' || *p > '9' || n > 100000000)
+			return false;
+		n = n * 10 + (*p - '0');
 	}
 
-	if (fields.size() < 10 || fields[0] != "MSG")
-		return;
+	v = neg ? -n : n;
+	return true;
+}
 
-	// Message Type (Field 1)
-	int type = std::stoi(fields[1]);
-	switch (type)
+bool Basestation::parseHex(const Field &f, uint32_t &v)
+{
+	const char *p = f.p, *e = f.p + f.len;
+
+	// TIS-B and other non-ICAO addresses are prefixed with ~
+	if (p < e && *p == '~')
+		p++;
+
+	if (p == e || e - p > 8)
+		return false;
+
+	uint32_t n = 0;
+	for (; p < e; p++)
 	{
-	case 1:
-	case 2:
-	case 3:
-	case 4:
-		msg.message_types = 1 << 17;
-		break;
-	case 5:
-		msg.message_types = 1 << 4;
-		break;
-	case 6:
-		msg.message_types = 1 << 5;
-		break;
-	case 7:
-		msg.message_types = 1 << 16;
-		break;
-	case 8:
-		msg.message_types = 1 << 11;
-		break;
+		char c = *p;
+		int d = c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+		if (d < 0)
+			return false;
+		n = (n << 4) | d;
 	}
 
-	if (!fields[4].empty())
+	v = n;
+	return true;
+}
+
+// decimal notation as written by SBS feeds, no exponent
+bool Basestation::parseFloat(const Field &f, float &v)
+{
+	const char *p = f.p, *e = f.p + f.len;
+	bool neg = false, digits = false;
+
+	if (p < e && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+
+	double n = 0, scale = 1;
+
+	for (; p < e && *p >= '0' && *p <= '9'; p++, digits = true)
+		n = n * 10 + (*p - '0');
+
+	if (p < e && *p == '.')
+		for (p++; p < e && *p >= '0' && *p <= '9'; p++, digits = true)
+			n += (*p - '0') * (scale /= 10);
+
+	if (p != e || !digits)
+		return false;
+
+	v = (float)(neg ? -n : n);
+	return true;
+}
+
+// "yyyy/mm/dd" and "hh:mm:ss.sss" in UTC
+std::time_t Basestation::parseDateTime(const Field &date, const Field &time)
+{
+	auto num = [](const char *p, int n)
+	{
+		int v = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (p[i] < '0' || p[i] > '9')
+				return -1;
+			v = v * 10 + (p[i] - '0');
+		}
+		return v;
+	};
+
+	if (date.len < 10 || time.len < 8 || date.p[4] != '/' || date.p[7] != '/' || time.p[2] != ':' || time.p[5] != ':')
+		return 0;
+
+	int y = num(date.p, 4), m = num(date.p + 5, 2), d = num(date.p + 8, 2);
+	int hh = num(time.p, 2), mm = num(time.p + 3, 2), ss = num(time.p + 6, 2);
+
+	if (y < 1970 || m < 1 || m > 12 || d < 1 || d > 31 || hh < 0 || mm < 0 || ss < 0)
+		return 0;
+
+	// days since 1970-01-01 of the proleptic Gregorian calendar
+	y -= m <= 2;
+	long era = y / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	long days = era * 146097 + doe - 719468;
+
+	return (std::time_t)(days * 86400 + hh * 3600 + mm * 60 + ss);
+}
+
+void Basestation::processLine(const char *s, const char *e)
+{
+	Field fields[MAX_FIELDS];
+	int n = 0;
+
+	// split in place, surrounding quotes are removed
+	while (n < MAX_FIELDS)
 	{
-		if (fields[4][0] == '~')
-			msg.hexident = std::stoul(fields[4].substr(1), nullptr, 16);
-		else
-			msg.hexident = std::stoul(fields[4], nullptr, 16);
+		const char *c = (const char *)std::memchr(s, ',', e - s);
+		const char *end = c ? c : e;
+
+		Field &f = fields[n++];
+		f.p = s;
+		f.len = (int)(end - s);
+
+		if (f.len >= 2 && f.p[0] == '"' && f.p[f.len - 1] == '"')
+		{
+			f.p++;
+			f.len -= 2;
+		}
+
+		if (!c)
+			break;
+		s = c + 1;
 	}
 
-	// Timestamps (Fields 7-10)
-	if (!fields[6].empty() && !fields[7].empty())
+	if (n < 10 || fields[0].len != 3 || std::memcmp(fields[0].p, "MSG", 3) != 0)
+		return;
+
+	batch.emplace_back();
+	Plane::ADSB &msg = batch.back();
+
+	msg.clear();
+	msg.Stamp();
+
+	int v;
+	float lat, lon;
+
+	// Message Type (Field 1)
+	if (parseInt(fields[1], v))
 	{
-		std::string datetime = fields[6] + " " + fields[7];
-		msg.timestamp = Util::Parse::DateTime(datetime);
+		switch (v)
+		{
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+			msg.message_types = 1 << 17;
+			break;
+		case 5:
+			msg.message_types = 1 << 4;
+			break;
+		case 6:
+			msg.message_types = 1 << 5;
+			break;
+		case 7:
+			msg.message_types = 1 << 16;
+			break;
+		case 8:
+			msg.message_types = 1 << 11;
+			break;
+		}
 	}
 
+	uint32_t hexident;
+	if (parseHex(fields[4], hexident))
+		msg.hexident = hexident;
+
+	// Timestamps (Fields 7-10)
+	if (fields[6].len && fields[7].len)
+		msg.timestamp = parseDateTime(fields[6], fields[7]);
+
 	// Callsign (Field 10)
-	if (fields.size() > 10 && !fields[10].empty())
+	if (n > 10 && fields[10].len)
 	{
-		std::strncpy(msg.callsign, fields[10].c_str(), 8);
-		msg.callsign[8] = '\0'; // Ensure null termination
+		int len = MIN(fields[10].len, 8);
+		std::memcpy(msg.callsign, fields[10].p, len);
+		msg.callsign[len] = '\0';
 	}
 
 	// Altitude (Field 11)
-	if (fields.size() > 11 && !fields[11].empty())
-	{
-		msg.altitude = std::stoi(fields[11]);
-	}
+	if (n > 11 && parseInt(fields[11], v))
+		msg.altitude = v;
 
 	// Groundspeed (Field 12)
-	if (fields.size() > 12 && !fields[12].empty())
-	{
-		msg.speed = std::stof(fields[12]);
-	}
+	if (n > 12)
+		parseFloat(fields[12], msg.speed);
 
 	// Track (Field 13)
-	if (fields.size() > 13 && !fields[13].empty())
-	{
-		msg.heading = std::stof(fields[13]);
-	}
+	if (n > 13)
+		parseFloat(fields[13], msg.heading);
 
 	// Position (Fields 14,15)
-	if (fields.size() > 15 && !fields[14].empty() && !fields[15].empty())
+	if (n > 15 && parseFloat(fields[14], lat) && parseFloat(fields[15], lon))
 	{
-		msg.lat = std::stof(fields[14]);
-		msg.lon = std::stof(fields[15]);
+		msg.lat = lat;
+		msg.lon = lon;
 		msg.position_status = Plane::ValueStatus::VALID;
-		std::time(&msg.position_timestamp);
+		msg.position_timestamp = now;
 	}
 
 	// Vertical Rate (Field 16)
-	if (fields.size() > 16 && !fields[16].empty())
-	{
-		msg.vertrate = std::stoi(fields[16]);
-	}
+	if (n > 16 && parseInt(fields[16], v))
+		msg.vertrate = v;
 
 	// Squawk (Field 17)
-	if (fields.size() > 17 && !fields[17].empty())
-	{
-		msg.squawk = std::stoi(fields[17]);
-	}
+	if (n > 17 && parseInt(fields[17], v))
+		msg.squawk = v;
 
 	// Ground (Field 21) - properly set airborne status
-	if (fields.size() > 21 && !fields[21].empty())
-	{
-		if (fields[21] == "-1")
-			msg.airborne = 0; // On ground
-		else
-			msg.airborne = 1; // Airborne
-	}
+	if (n > 21 && fields[21].len)
+		msg.airborne = (fields[21].len == 2 && fields[21].p[0] == '-' && fields[21].p[1] == '1') ? 0 : 1;
 	else
-	{
 		msg.airborne = 2; // Unknown status
-	}
 
 	msg.setCountryCode();
-
-	// Send message to next processing stage
-	Send(&msg, 1, tag);
 }
 
 void Basestation::Receive(const RAW *data, int len, TAG &tag)
 {
+	std::time(&now);
+
 	for (int j = 0; j < len; j++)
 	{
-		for (int i = 0; i < data[j].size; i++)
+		const char *p = (const char *)data[j].data;
+		const char *end = p + data[j].size;
+
+		while (p < end)
 		{
-			char c = ((char *)(data[j].data))[i];
-			if (c == '\n')
+			const char *nl = (const char *)std::memchr(p, '\n', end - p);
+			const char *e = nl ? nl : end;
+
+			if (dropping || (int)(line.size() + (e - p)) > MAX_BASESTATION_LINE_LEN)
 			{
-				if (dropping)
-				{
-					dropping = false;
-					line.clear();
-					continue;
-				}
-
-				if (line.length() > 0)
-				{
-					try
-					{
-						processLine();
-					}
-					catch (const std::exception &e)
-					{
-						Error() << "Error processing line: " << line << " " << e.what() << std::endl;
-					}
-					line.clear();
-				}
+				dropping = true;
+				line.clear();
 			}
-			else
+			else if (!nl || !line.empty())
 			{
-				if (c == '\r')
-					continue;
+				line.append(p, e - p);
+			}
+
+			if (!nl)
+				break;
 
-				if (dropping)
-					continue;
+			// complete line, in the buffer itself unless it started in a previous one
+			if (!dropping)
+			{
+				const char *s = line.empty() ? p : line.data();
+				const char *le = line.empty() ? e : line.data() + line.size();
 
-				if (line.size() >= MAX_BASESTATION_LINE_LEN)
-				{
-					dropping = true;
-					continue;
-				}
+				while (le > s && le[-1] == '\r')
+					le--;
 
-				line.push_back(c);
+				if (le > s)
+					processLine(s, le);
 			}
+
+			dropping = false;
+			line.clear();
+			p = nl + 1;
 		}
 	}
+
+	if (!batch.empty())
+	{
+		Send(batch.data(), (int)batch.size(), tag);
+		batch.clear();
+	}
 }
@@ -17,9 +17,8 @@
 
 #pragma once
 
-#include <iomanip>
-#include <sstream>
 #include <vector>
+#include <ctime>
 
 #include "Message.h"
 #include "Stream.h"
@@ -29,11 +28,28 @@
 
 class Basestation : public SimpleStreamInOut<RAW, Plane::ADSB>
 {
+    // a line that continues in the next buffer, complete lines are parsed in place
     std::string line;
     bool dropping = false;
     const int MAX_BASESTATION_LINE_LEN = 8192;
+    static const int MAX_FIELDS = 22;
 
-    void processLine();
+    struct Field
+    {
+        const char *p;
+        int len;
+    };
+
+    // lines parsed from one call to Receive are sent downstream as a single batch
+    std::vector<Plane::ADSB> batch;
+    std::time_t now = 0;
+
+    static bool parseInt(const Field &f, int &v);
+    static bool parseHex(const Field &f, uint32_t &v);
+    static bool parseFloat(const Field &f, float &v);
+    static std::time_t parseDateTime(const Field &date, const Field &time);
+
+    void processLine(const char *s, const char *e);
 
 public:
     virtual ~Basestation() {}
@@ -16,6 +16,7 @@
 */
 
 #include <cmath>
+#include <cstring>
 
 #include "Beast.h"
 #include "Logger.h"
@@ -34,7 +35,7 @@ void RAW1090::ProcessByte(uint8_t byte, TAG &tag)
         if (byte == '*')
         {
             msg.clear();
-            msg.Stamp();
+            msg.setRxTimeUnix(now);
             state = State::READ_MSG;
             nibbles = 0;
         }
@@ -45,7 +46,7 @@ void RAW1090::ProcessByte(uint8_t byte, TAG &tag)
             if (msg.len > 0)
             {
                 msg.Decode();
-                Send(&msg, 1, tag);
+                batch.push_back(msg);
             }
             state = State::WAIT_START;
             return;
@@ -80,27 +81,60 @@ void RAW1090::ProcessByte(uint8_t byte, TAG &tag)
 
 void RAW1090::Receive(const RAW *data, int len, TAG &tag)
 {
+    std::time(&now);
+
     for (int j = 0; j < len; j++)
     {
-        for (int i = 0; i < data[j].size; i++)
+        const uint8_t *p = (const uint8_t *)data[j].data;
+        const uint8_t *end = p + data[j].size;
+
+        while (p < end)
         {
-            uint8_t c = ((uint8_t *)(data[j].data))[i];
-            ProcessByte(c, tag);
+            // skip to the next frame start in one go
+            if (state == State::WAIT_START)
+            {
+                p = (const uint8_t *)std::memchr(p, '*', end - p);
+                if (!p)
+                    break;
+            }
+            ProcessByte(*p++, tag);
         }
     }
+
+    if (!batch.empty())
+    {
+        Send(batch.data(), (int)batch.size(), tag);
+        batch.clear();
+    }
 }
 
 // Beast implementation
 void Beast::Receive(const RAW *data, int len, TAG &tag)
 {
+    std::time(&now);
+
     for (int j = 0; j < len; j++)
     {
-        for (int i = 0; i < data[j].size; i++)
+        const uint8_t *p = (const uint8_t *)data[j].data;
+        const uint8_t *end = p + data[j].size;
+
+        while (p < end)
         {
-            uint8_t c = ((uint8_t *)(data[j].data))[i];
-            ProcessByte(c, tag);
+            if (state == State::WAIT_ESCAPE)
+            {
+                p = (const uint8_t *)std::memchr(p, BEAST_ESCAPE, end - p);
+                if (!p)
+                    break;
+            }
+            ProcessByte(*p++, tag);
         }
     }
+
+    if (!batch.empty())
+    {
+        Send(batch.data(), (int)batch.size(), tag);
+        batch.clear();
+    }
 }
 
 void Beast::Clear()
@@ -147,7 +181,7 @@ void Beast::ProcessByte(uint8_t byte, TAG &tag)
         if (byte >= 0x31 && byte <= 0x33)
         { // Valid types: '1', '2', '3'
             msg.clear();
-            msg.Stamp();
+            msg.setRxTimeUnix(now);
             msg.msgtype = byte;
 
             state = State::READ_TIMESTAMP;
@@ -206,7 +240,7 @@ void Beast::ProcessByte(uint8_t byte, TAG &tag)
             {
                 Error() << "Unknown message type: " << msg.msgtype;
             }
-            Send(&msg, 1, tag);
+            batch.push_back(msg);
 
             state = State::WAIT_ESCAPE;
             buffer.clear();
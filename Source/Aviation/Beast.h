@@ -36,6 +36,10 @@ class RAW1090 : public SimpleStreamInOut<RAW, Plane::ADSB>
     State state = State::WAIT_START;
     uint8_t nibbles = 0;
 
+    // frames decoded from one call to Receive are sent downstream as a single batch
+    std::vector<Plane::ADSB> batch;
+    std::time_t now = 0;
+
 public:
     virtual ~RAW1090() {}
 
@@ -66,6 +70,9 @@ class Beast : public SimpleStreamInOut<RAW, Plane::ADSB>
     State state = State::WAIT_ESCAPE;
     int bytes_read = 0;
 
+    std::vector<Plane::ADSB> batch;
+    std::time_t now = 0;
+
 public:
     virtual ~Beast() {}
 
@@ -15,6 +15,8 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
+
 #include "AIS-catcher.h"
 #include "DBMS/PostgreSQL.h"
 
@@ -22,43 +24,568 @@ namespace IO
 {
 
 #ifdef HASPSQL
-	void PostgreSQL::post()
+	// columns per table in COPY mode, as in addVesselPosition etc.
+	static const std::vector<int> POS_KEYS = {AIS::KEY_MMSI, AIS::KEY_STATUS, AIS::KEY_TURN, AIS::KEY_SPEED, AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_COURSE, AIS::KEY_HEADING};
+	static const std::vector<int> STATIC_KEYS = {AIS::KEY_MMSI, AIS::KEY_IMO, AIS::KEY_CALLSIGN, AIS::KEY_SHIPNAME, AIS::KEY_SHIPTYPE, AIS::KEY_TO_PORT, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN, AIS::KEY_TO_STARBOARD, AIS::KEY_ETA, AIS::KEY_DRAUGHT, AIS::KEY_DESTINATION};
+	static const std::vector<int> BS_KEYS = {AIS::KEY_MMSI, AIS::KEY_LAT, AIS::KEY_LON};
+	static const std::vector<int> SAR_KEYS = {AIS::KEY_MMSI, AIS::KEY_ALT, AIS::KEY_SPEED, AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_COURSE};
+	static const std::vector<int> ATON_KEYS = {AIS::KEY_MMSI, AIS::KEY_AID_TYPE, AIS::KEY_NAME, AIS::KEY_LON, AIS::KEY_LAT, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN, AIS::KEY_TO_PORT, AIS::KEY_TO_STARBOARD};
+	static const std::vector<int> VESSEL_KEYS = {AIS::KEY_MMSI, AIS::KEY_SIGNAL_POWER, AIS::KEY_PPM, AIS::KEY_IMO, AIS::KEY_CALLSIGN, AIS::KEY_SHIPNAME, AIS::KEY_SHIPTYPE, AIS::KEY_TO_PORT, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN, AIS::KEY_TO_STARBOARD, AIS::KEY_ETA, AIS::KEY_DRAUGHT, AIS::KEY_DESTINATION, AIS::KEY_STATUS, AIS::KEY_TURN, AIS::KEY_SPEED, AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_COURSE, AIS::KEY_HEADING, AIS::KEY_AID_TYPE, AIS::KEY_ALT};
+
+	static std::string columns(const std::vector<int> &keys, const std::string &extra = ",station_id,received_at")
+	{
+		std::string s;
+		for (int k : keys)
+			s += (s.empty() ? "" : ",") + AIS::KeyMap[k][JSON_DICT_FULL];
+		return s + extra;
+	}
+
+	// COPY text format, NULL is \N and backslash, tab and newlines are escaped
+	static std::string copyEscape(const std::string &input)
+	{
+		std::string output;
+		for (const char c : input)
+		{
+			switch (c)
+			{
+			case '\\':
+				output += "\\\\";
+				break;
+			case '\t':
+				output += "\\t";
+				break;
+			case '\n':
+				output += "\\n";
+				break;
+			case '\r':
+				output += "\\r";
+				break;
+			default:
+				output += c;
+			}
+		}
+		return output;
+	}
+
+	std::string PostgreSQL::copyValue(const JSON::Value &v)
+	{
+		if (v.isString())
+			return copyEscape(v.getString());
+
+		std::string s;
+		builder.to_string(s, v);
+		return s;
+	}
+
+	// the keys listed in ais_keys as a JSON object, or all properties of the message if the table is empty
+	std::string PostgreSQL::jsonProperties(const JSON::JSON *data)
+	{
+		std::string json;
+
+		for (const auto &p : data[0].getProperties())
+		{
+			if (p.Key() < 0 || p.Key() >= db_keys.size() || (!all_keys && db_keys[p.Key()] == -1))
+				continue;
+
+			const std::string &name = AIS::KeyMap[p.Key()][JSON_DICT_FULL];
+			if (name.empty())
+				continue;
+
+			json += json.empty() ? "{\"" : ",\"";
+			json += name + "\":";
+			builder.to_string(json, p.Get());
+		}
+
+		return json.empty() ? json : json + "}";
+	}
+
+	std::string PostgreSQL::copyRow(const JSON::JSON *data, const std::vector<int> &keys, const std::string &s, const std::string &t)
 	{
+		std::string row;
+
+		for (int i = 0; i < keys.size(); i++)
+		{
+			const JSON::Value *v = data[0].getValue(keys[i]);
+
+			if (i)
+				row += '\t';
+			row += v ? copyValue(*v) : "\\N";
+		}
+		return row + '\t' + s + '\t' + t;
+	}
+
+	bool PostgreSQL::exec(Writer &w, const std::string &s, ExecStatusType status)
+	{
+		PGresult *res = PQexec(w.con, s.c_str());
+		bool ok = PQresultStatus(res) == status;
+
+		if (!ok)
+			Error() << "DBMS: Error writing PostgreSQL: " << PQerrorMessage(w.con);
+
+		PQclear(res);
+		return ok;
+	}
+
+	bool PostgreSQL::copy(Writer &w, const std::string &table, const std::string &columns, const std::vector<Row> &rows, const std::vector<std::string> &ids, const std::string &id_column)
+	{
+		if (rows.empty())
+			return true;
+
+		PGconn *con = w.con;
+
+		if (!exec(w, "COPY " + table + " (" + columns + "," + id_column + ") FROM STDIN", PGRES_COPY_IN))
+			return false;
+
+		std::string buffer;
+		bool ok = true;
+
+		for (const Row &r : rows)
+		{
+			buffer += r.data;
+			buffer += '\t';
+			buffer += r.msg < 0 || r.msg >= ids.size() ? "\\N" : ids[r.msg];
+			buffer += '\n';
+
+			if (buffer.size() > 65536)
+			{
+				ok &= PQputCopyData(con, buffer.data(), (int)buffer.size()) == 1;
+				buffer.clear();
+			}
+		}
+
+		if (!buffer.empty())
+			ok &= PQputCopyData(con, buffer.data(), (int)buffer.size()) == 1;
+
+		PQputCopyEnd(con, ok ? nullptr : "write failed");
+
+		PGresult *res;
+		while ((res = PQgetResult(con)) != nullptr)
+		{
+			if (PQresultStatus(res) != PGRES_COMMAND_OK)
+				ok = false;
+			PQclear(res);
+		}
+
+		if (!ok)
+			Error() << "DBMS: Error writing PostgreSQL (" << table << "): " << PQerrorMessage(con);
+
+		return ok;
+	}
+
+	// one transaction per interval: ids for ais_message are taken from its sequence so all
+	// tables can be loaded with COPY, vessels go through a staging table to be merged
+	bool PostgreSQL::postCOPY(Writer &w)
+	{
+		std::vector<std::string> ids;
+		std::vector<Row> vessels;
+		Batch &writing = w.writing;
+		PGconn *con = w.con;
+
+		for (auto &v : writing.vessels)
+		{
+			Row r;
+			r.msg = v.second.msg;
+
+			for (int i = 0; i < v.second.values.size(); i++)
+			{
+				if (i)
+					r.data += '\t';
+				r.data += v.second.values[i].empty() ? "\\N" : v.second.values[i];
+			}
+			r.data += '\t' + v.second.station + '\t' + v.second.received_at + '\t';
+			Util::Convert::appendInt(r.data, v.second.count);
+			r.data += '\t';
+			Util::Convert::appendInt(r.data, v.second.types);
+			r.data += '\t';
+			Util::Convert::appendInt(r.data, v.second.channels);
+			vessels.push_back(r);
+		}
+
+		bool ok = exec(w, "BEGIN");
+
+		if (ok && !writing.messages.empty())
+		{
+			const int n = writing.messages.size();
+			PGresult *res = PQexec(con, ("SELECT nextval('ais_message_id_seq') FROM generate_series(1," + std::to_string(n) + ")").c_str());
+
+			ok = PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == n;
+			if (ok)
+				for (int i = 0; i < n; i++)
+					ids.push_back(PQgetvalue(res, i, 0));
+			else
+				Error() << "DBMS: Error reserving message ids: " << PQerrorMessage(con);
+
+			PQclear(res);
+		}
+
+		ok = ok && copy(w, "ais_message", JSONB ? "mmsi,station_id,type,received_at,channel,signal_level,ppm,properties" : "mmsi,station_id,type,received_at,channel,signal_level,ppm", writing.messages, ids, "id");
+		ok = ok && copy(w, "ais_nmea", "mmsi,station_id,received_at,nmea", writing.nmea, ids);
+		ok = ok && copy(w, "ais_vessel_pos", columns(POS_KEYS), writing.pos, ids);
+		ok = ok && copy(w, "ais_vessel_static", columns(STATIC_KEYS), writing.vstatic, ids);
+		ok = ok && copy(w, "ais_basestation", columns(BS_KEYS), writing.bs, ids);
+		ok = ok && copy(w, "ais_sar_position", columns(SAR_KEYS), writing.sar, ids);
+		ok = ok && copy(w, "ais_aton", columns(ATON_KEYS), writing.aton, ids);
+		ok = ok && copy(w, "ais_property", "key,value", writing.property, ids);
+
+		if (ok && !vessels.empty())
+		{
+			const std::string cols = columns(VESSEL_KEYS, ",station_id,received_at,count,msg_types,channels");
+			std::string set = "msg_id=EXCLUDED.msg_id,station_id=EXCLUDED.station_id,received_at=EXCLUDED.received_at,count=ais_vessel.count+EXCLUDED.count,msg_types=ais_vessel.msg_types|EXCLUDED.msg_types,channels=ais_vessel.channels|EXCLUDED.channels";
+
+			// only the fields present in the messages are updated
+			for (int k : VESSEL_KEYS)
+			{
+				const std::string &c = AIS::KeyMap[k][JSON_DICT_FULL];
+				if (k != AIS::KEY_MMSI)
+					set += "," + c + "=COALESCE(EXCLUDED." + c + ",ais_vessel." + c + ")";
+			}
+
+			ok = exec(w, "CREATE TEMP TABLE IF NOT EXISTS ais_vessel_stage (LIKE ais_vessel) ON COMMIT DELETE ROWS") &&
+				 copy(w, "ais_vessel_stage", cols, vessels, ids) &&
+				 exec(w, "INSERT INTO ais_vessel (" + cols + ",msg_id) SELECT " + cols + ",msg_id FROM ais_vessel_stage ON CONFLICT (mmsi) DO UPDATE SET " + set);
+		}
+
+		if (ok)
+			ok = exec(w, "COMMIT");
+		else
+			exec(w, "ROLLBACK");
+
+		return ok;
+	}
+
+	// Batch in the spill file: the row vectors and vessel rows as counts followed by their fields
+	static void putInt(std::string &out, int64_t v)
+	{
+		out.append((const char *)&v, sizeof(v));
+	}
+
+	static void putString(std::string &out, const std::string &s)
+	{
+		putInt(out, s.size());
+		out += s;
+	}
+
+	static bool getInt(const std::string &in, size_t &pos, int64_t &v)
+	{
+		if (pos + sizeof(v) > in.size())
+			return false;
+		std::memcpy(&v, in.data() + pos, sizeof(v));
+		pos += sizeof(v);
+		return true;
+	}
+
+	static bool getString(const std::string &in, size_t &pos, std::string &s)
+	{
+		int64_t len;
+		if (!getInt(in, pos, len) || len < 0 || pos + len > in.size())
+			return false;
+		s.assign(in, pos, len);
+		pos += len;
+		return true;
+	}
+
+	void PostgreSQL::Batch::serialize(std::string &out) const
+	{
+		for (auto *rows : {&messages, &nmea, &pos, &vstatic, &bs, &sar, &aton, &property})
+		{
+			putInt(out, rows->size());
+			for (const Row &r : *rows)
+			{
+				putInt(out, r.msg);
+				putString(out, r.data);
+			}
+		}
+
+		putInt(out, vessels.size());
+		for (const auto &v : vessels)
+		{
+			putInt(out, v.first);
+			putInt(out, v.second.msg);
+			putInt(out, v.second.count);
+			putInt(out, v.second.types);
+			putInt(out, v.second.channels);
+			putString(out, v.second.station);
+			putString(out, v.second.received_at);
+			putInt(out, v.second.values.size());
+			for (const auto &value : v.second.values)
+				putString(out, value);
+		}
+	}
+
+	std::size_t PostgreSQL::Batch::memory() const
+	{
+		std::size_t n = 0;
+
+		for (auto *rows : {&messages, &nmea, &pos, &vstatic, &bs, &sar, &aton, &property})
+			for (const Row &r : *rows)
+				n += sizeof(Row) + r.data.capacity();
+
+		for (const auto &v : vessels)
+		{
+			n += sizeof(VesselRow) + v.second.values.capacity() * sizeof(std::string);
+			for (const auto &value : v.second.values)
+				n += value.capacity();
+		}
+		return n;
+	}
+
+	void PostgreSQL::reportMemory(Writer &w)
+	{
+		std::size_t n;
+		{
+			const std::lock_guard<std::mutex> lock(w.mtx);
+			n = COPY ? w.batch.memory() : (std::size_t)MAX((std::streamoff)0, (std::streamoff)w.sql.tellp());
+		}
+		MemoryBudget::account(MemoryBudget::QUEUES, w.memory_reported, n);
+	}
+
+	bool PostgreSQL::Batch::deserialize(const std::string &in)
+	{
+		size_t p = 0;
+		int64_t n, x;
+
+		clear();
+
+		for (auto *rows : {&messages, &nmea, &pos, &vstatic, &bs, &sar, &aton, &property})
+		{
+			if (!getInt(in, p, n))
+				return false;
+
+			for (int64_t i = 0; i < n; i++)
+			{
+				Row r;
+				if (!getInt(in, p, x) || !getString(in, p, r.data))
+					return false;
+				r.msg = (int)x;
+				rows->push_back(std::move(r));
+			}
+		}
+
+		if (!getInt(in, p, n))
+			return false;
+
+		for (int64_t i = 0; i < n; i++)
+		{
+			int64_t mmsi, msg, count, types, channels, values;
+
+			if (!getInt(in, p, mmsi) || !getInt(in, p, msg) || !getInt(in, p, count) || !getInt(in, p, types) || !getInt(in, p, channels))
+				return false;
+
+			VesselRow &v = vessels[(int)mmsi];
+			v.msg = (int)msg;
+			v.count = (int)count;
+			v.types = (int)types;
+			v.channels = (int)channels;
+
+			if (!getString(in, p, v.station) || !getString(in, p, v.received_at) || !getInt(in, p, values))
+				return false;
+
+			v.values.resize(values);
+			for (auto &value : v.values)
+				if (!getString(in, p, value))
+					return false;
+		}
+		return p == in.size();
+	}
+
+	// segment in the spill file: kind (0 SQL, 1 COPY), messages, payload length and payload
+	bool PostgreSQL::spill(Writer &w, int kind, int n, const std::string &payload)
+	{
+		const std::lock_guard<std::mutex> lock(w.spill_mtx);
+		const uint64_t size = 3 * sizeof(int32_t) + payload.size();
+
+		if (w.spill_bytes + size > SPILL_MAX)
+			return false;
+
+		std::ofstream file(w.spill_file, std::ios::binary | std::ios::app);
+		int32_t header[3] = {kind, n, (int32_t)payload.size()};
+
+		file.write((const char *)header, sizeof(header));
+		file.write(payload.data(), payload.size());
+		file.close();
+
+		if (!file)
+		{
+			Error() << "DBMS: cannot write spill file " << w.spill_file;
+			return false;
+		}
+
+		w.spill_bytes += size;
+		w.spilled += n;
+		return true;
+	}
+
+	bool PostgreSQL::unspill(Writer &w, int &kind, int &n, std::string &payload, std::streamoff &next)
+	{
+		const std::lock_guard<std::mutex> lock(w.spill_mtx);
+
+		std::ifstream file(w.spill_file, std::ios::binary);
+		int32_t header[3];
+
+		if (!file.seekg(w.spill_read) || !file.read((char *)header, sizeof(header)) || header[2] < 0)
+			return false;
+
+		payload.resize(header[2]);
+		if (!file.read(&payload[0], header[2]))
+			return false;
+
+		kind = header[0];
+		n = header[1];
+		next = w.spill_read + (std::streamoff)sizeof(header) + header[2];
+		return true;
+	}
+
+	// the segments before next are in the database, the file is emptied once all are
+	void PostgreSQL::commitSpill(Writer &w, std::streamoff next)
+	{
+		const std::lock_guard<std::mutex> lock(w.spill_mtx);
+
+		uint64_t done = next - w.spill_read;
+		w.spill_read = next;
+		w.spill_bytes = w.spill_bytes > done ? w.spill_bytes - done : 0;
+
+		if (w.spill_bytes == 0)
+		{
+			std::ofstream(w.spill_file, std::ios::binary | std::ios::trunc);
+			w.spill_read = 0;
+		}
+	}
 
-		if (PQstatus(con) != CONNECTION_OK)
+	void PostgreSQL::post(Writer &w)
+	{
+		if (PQstatus(w.con) != CONNECTION_OK)
 		{
 			Warning() << "DBMS: Connection to PostgreSQL lost. Attempting to reset...";
-			PQreset(con);
+			PQreset(w.con);
 
-			if (PQstatus(con) != CONNECTION_OK)
+			if (PQstatus(w.con) != CONNECTION_OK)
 			{
 				Error() << "DBMS: Could not reset connection. Aborting post.";
-				conn_fails++;
+				w.conn_fails++;
 				return;
 			}
 			else
 			{
 				Warning() << "DBMS: Connection successfully reset.";
-				conn_fails = 0;
+				w.conn_fails = 0;
 			}
 		}
 
+		auto start = high_resolution_clock::now();
+		int n, kind = COPY ? 1 : 0;
+
 		{
-			const std::lock_guard<std::mutex> lock(queue_mutex);
-			sql_trans = "DO $$\nDECLARE\n\tm_id INTEGER;\nBEGIN\n" + sql.str() + "\nEND $$;\n";
-			sql.str("");
+			const std::lock_guard<std::mutex> lock(w.mtx);
+
+			if (COPY)
+				std::swap(w.batch, w.writing);
+			else
+			{
+				w.sql_trans = w.sql.str();
+				w.sql.str("");
+			}
+			n = w.pending.exchange(0);
 		}
 
-		PGresult *res;
-		res = PQexec(con, sql_trans.c_str());
+		// spilled data goes first so the rows of a vessel stay in order
+		bool from_spill = false;
+		std::streamoff next = 0;
 
-		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		if (w.spill_bytes > 0)
 		{
-			Error() << "DBMS: Error writing PostgreSQL: " << PQerrorMessage(con);
-			conn_fails = 1;
+			std::string payload;
+
+			if (n > 0)
+			{
+				if (COPY)
+					w.writing.serialize(payload);
+
+				if (!spill(w, kind, n, COPY ? payload : w.sql_trans))
+				{
+					Warning() << "DBMS: spill file full, data lost.";
+					w.dropped += n;
+				}
+			}
+
+			if (!unspill(w, kind, n, payload, next) || (kind == 1 && !w.writing.deserialize(payload)))
+			{
+				Error() << "DBMS: spill file " << w.spill_file << " is damaged, remaining data skipped.";
+				commitSpill(w, w.spill_read + (std::streamoff)w.spill_bytes);
+				w.writing.clear();
+				return;
+			}
+
+			if (kind == 0)
+				w.sql_trans = payload;
+
+			from_spill = true;
 		}
 
-		PQclear(res);
+		if (n == 0)
+		{
+			if (from_spill)
+				commitSpill(w, next);
+			return;
+		}
+
+		bool ok;
+
+		if (kind == 1)
+			ok = postCOPY(w);
+		else
+		{
+			PGresult *res;
+			res = PQexec(w.con, ("DO $$\nDECLARE\n\tm_id INTEGER;\nBEGIN\n" + w.sql_trans + "\nEND $$;\n").c_str());
+
+			ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+			if (!ok)
+				Error() << "DBMS: Error writing PostgreSQL: " << PQerrorMessage(w.con);
+
+			PQclear(res);
+		}
+
+		if (ok)
+		{
+			w.written += n;
+			if (from_spill)
+			{
+				commitSpill(w, next);
+				w.spill_attempts = 0;
+			}
+		}
+		else
+		{
+			// with the connection still up the statement or its data failed, a segment that keeps
+			// failing is skipped so it does not hold up the spill file
+			bool lost = PQstatus(w.con) != CONNECTION_OK;
+
+			if (from_spill && !lost && ++w.spill_attempts >= SPILL_ATTEMPTS)
+			{
+				Error() << "DBMS: segment of spill file " << w.spill_file << " rejected " << SPILL_ATTEMPTS << " times, " << n << " messages skipped.";
+				commitSpill(w, next);
+				w.spill_attempts = 0;
+				w.dropped += n;
+			}
+			else if (!from_spill && !spill_dir.empty())
+			{
+				std::string payload;
+				if (kind == 1)
+					w.writing.serialize(payload);
+
+				if (!spill(w, kind, n, kind == 1 ? payload : w.sql_trans))
+					w.dropped += n;
+			}
+
+			w.errors++;
+			if (lost)
+				w.conn_fails = 1;
+		}
+
+		w.writing.clear();
+
+		auto us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+		w.commit_us.add(us);
+		w.flush_time = 1e-6f * us;
 	}
 #endif
 	PostgreSQL::~PostgreSQL()
@@ -66,44 +593,69 @@ namespace IO
 #ifdef HASPSQL
 		if (running)
 		{
-
 			running = false;
 			terminate = true;
-			run_thread.join();
+
+			for (auto &w : writers)
+				if (w->thread.joinable())
+					w->thread.join();
 
 			Debug() << "DBMS: stop thread and database closed.";
 		}
-		if (con != nullptr)
-			PQfinish(con);
+
+		for (auto &w : writers)
+		{
+			if (w->con != nullptr)
+				PQfinish(w->con);
+			MemoryBudget::account(MemoryBudget::QUEUES, w->memory_reported, 0);
+		}
 #endif
 	}
 
 #ifdef HASPSQL
 
-	void PostgreSQL::process()
+	void PostgreSQL::process(Writer &w)
 	{
+		policy.apply("PostgreSQL");
 
 		while (!terminate)
 		{
 
-			for (int i = 0; !terminate && i < (conn_fails == 0 ? INTERVAL : 2) && sql.tellp() < 32768 * 16; i++)
+			for (int i = 0; !terminate && i < (w.conn_fails == 0 ? INTERVAL : 2) && !(w.spill_bytes && w.conn_fails == 0) && w.sql.tellp() < 32768 * 16 && w.pending < MAX_PENDING / 2; i++)
 			{
 				SleepSystem(1000);
+				reportMemory(w);
 			}
 
-			if (sql.tellp())
-				post();
+			if (w.pending || (w.spill_bytes && w.conn_fails == 0))
+				post(w);
+
+			reportMemory(w);
 
 			if (terminate)
 				break;
 
-			if (MAX_FAILS < 1000 && conn_fails > MAX_FAILS)
+			if (MAX_FAILS < 1000 && w.conn_fails > MAX_FAILS)
 			{
 				Error() << "DBMS: max attemtps reached to connect to DBMS. Terminating.";
 				StopRequest();
 			}
 		}
 	}
+
+	PGconn *PostgreSQL::connect()
+	{
+		PGconn *con = PQconnectdb(conn_string.c_str());
+
+		if (con == nullptr || PQstatus(con) != CONNECTION_OK)
+		{
+			std::string err = con ? PQerrorMessage(con) : "out of memory";
+			if (con)
+				PQfinish(con);
+			throw std::runtime_error("DBMS: cannot open database :" + err);
+		}
+		return con;
+	}
 #endif
 
 	void PostgreSQL::setup()
@@ -112,17 +664,35 @@ namespace IO
 
 		db_keys.resize(AIS::KeyMap.size(), -1);
 		Debug() << "Connecting to ProgreSQL database: \"" + conn_string + "\"\n";
-		con = PQconnectdb(conn_string.c_str());
 
-		if (con == nullptr || PQstatus(con) != CONNECTION_OK)
-			throw std::runtime_error("DBMS: cannot open database :" + std::string(PQerrorMessage(con)));
+		for (int i = (int)writers.size(); i < WRITERS; i++)
+		{
+			std::unique_ptr<Writer> w(new Writer());
+			w->id = i;
+			w->con = connect();
 
-		conn_fails = 0;
+			if (!spill_dir.empty())
+			{
+				w->spill_file = spill_dir + "/aiscatcher-pg-" + std::to_string(i) + ".spill";
 
+				// left over from an earlier run, written back first
+				std::ifstream f(w->spill_file, std::ios::binary | std::ios::ate);
+				if (f && f.tellg() > 0)
+				{
+					w->spill_bytes = f.tellg();
+					Info() << "DBMS: " << w->spill_bytes << " bytes in spill file " << w->spill_file << " to be written.";
+				}
+			}
+			writers.push_back(std::move(w));
+		}
+
+		PGconn *con = writers[0]->con;
 		PGresult *res = PQexec(con, "SELECT key_id, key_str FROM ais_keys");
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
 		{
-			throw std::runtime_error("DBMS: error fetching ais_keys table: " + std::string(PQerrorMessage(con)));
+			std::string err = PQerrorMessage(con);
+			PQclear(res);
+			throw std::runtime_error("DBMS: error fetching ais_keys table: " + err);
 		}
 
 		int key_count = 0;
@@ -130,22 +700,21 @@ namespace IO
 		{
 			int id = atoi(PQgetvalue(res, row, 0));
 			std::string name = PQgetvalue(res, row, 1);
-			bool found = false;
-			for (int i = 0; i < db_keys.size(); i++)
+			int key = AIS::KeyIndex::get(JSON_DICT_FULL).find(name);
+
+			if (key >= 0)
 			{
-				if (AIS::KeyMap[i][JSON_DICT_FULL] == name)
-				{
-					db_keys[i] = id;
-					found = true;
-					key_count++;
-					break;
-				}
+				db_keys[key] = id;
+				key_count++;
 			}
-			if (!found)
+			else
 				throw std::runtime_error("DBMS: The requested key \"" + name + "\" in ais_keys is not defined.");
 		}
+		PQclear(res);
 
-		if (key_count > 0 && !MSGS)
+		all_keys = JSONB && key_count == 0;
+
+		if ((key_count > 0 || JSONB) && !MSGS)
 		{
 			Info() << "DBMS: no messages logged in combination with property logging. MSGS ON auto activated.";
 			MSGS = true;
@@ -157,7 +726,8 @@ namespace IO
 			running = true;
 			terminate = false;
 
-			run_thread = std::thread(&PostgreSQL::process, this);
+			for (auto &w : writers)
+				w->thread = std::thread(&PostgreSQL::process, this, std::ref(*w));
 
 			Debug() << "DBMS: start thread, filter: " << Util::Convert::toString(filter.isOn());
 			
@@ -171,7 +741,11 @@ namespace IO
 					<< ", BS " << Util::Convert::toString(BS)
 					<< ", SAR " << Util::Convert::toString(SAR)
 					<< ", ATON " << Util::Convert::toString(ATON)
-					<< ", NMEA " << Util::Convert::toString(NMEA);
+					<< ", NMEA " << Util::Convert::toString(NMEA)
+					<< ", COPY " << Util::Convert::toString(COPY)
+					<< ", PROPERTIES " << (JSONB ? "JSONB" : "ROWS")
+					<< ", WRITERS " << WRITERS
+					<< ", SPILL " << (spill_dir.empty() ? "none" : spill_dir);
 		}
 #else
 		throw std::runtime_error("DBMS: no support for PostgeSQL build in.");
@@ -431,25 +1005,54 @@ namespace IO
 
 	void PostgreSQL::Receive(const JSON::JSON *data, int len, TAG &tag)
 	{
+		const AIS::Message *msg = (AIS::Message *)data[0].binary;
+
+		if (!filter.include(*msg))
+			return;
 
-		const std::lock_guard<std::mutex> lock(queue_mutex);
+		Writer &w = writerFor(msg);
+		const std::lock_guard<std::mutex> lock(w.mtx);
 
-		if (sql.tellp() > 32768 * 24)
+		if (w.sql.tellp() > 32768 * 24 || w.pending >= MAX_PENDING)
 		{
-			Warning() << "DBMS: writing to database slow or failed, data lost.";
-			sql.str("");
+			std::string payload;
+			if (COPY)
+				w.batch.serialize(payload);
+
+			if (spill_dir.empty() || !spill(w, COPY ? 1 : 0, w.pending, COPY ? payload : w.sql.str()))
+			{
+				Warning() << "DBMS: writing to database slow or failed, data lost.";
+				w.dropped += w.pending;
+			}
+			w.sql.str("");
+			w.batch.clear();
+			w.pending = 0;
 		}
-		const AIS::Message *msg = (AIS::Message *)data[0].binary;
 
-		if (!filter.include(*msg))
+		w.pending++;
+
+		if (COPY)
+		{
+			ReceiveCOPY(w, data, msg, tag);
 			return;
+		}
 
 		std::string m_id = MSGS ? "m_id" : " NULL";
 		std::string s_id = std::to_string(station_id ? station_id : msg->getStation());
 
-		if (MSGS)
+		if (MSGS && JSONB)
 		{
-			sql << "\tINSERT INTO ais_message (mmsi, station_id, type, received_at,channel, signal_level, ppm) "
+			std::string json = jsonProperties(data);
+
+			w.sql << "\tINSERT INTO ais_message (mmsi, station_id, type, received_at,channel, signal_level, ppm, properties) "
+				<< "VALUES (" << msg->mmsi() << ',' + s_id << ',' << msg->type() << ",\'" << Util::Convert::toTimestampStr(msg->getRxTimeUnix()) << "\',\'"
+				<< (char)msg->getChannel() << "\'," << tag.level << ',' << tag.ppm << ','
+				<< (json.empty() ? "NULL" : "\'" + escape(json) + "\'::jsonb")
+				<< ") RETURNING id INTO m_id;\n";
+		}
+		else if (MSGS)
+		{
+			w.sql << "\tINSERT INTO ais_message (mmsi, station_id, type, received_at,channel, signal_level, ppm) "
 				<< "VALUES (" << msg->mmsi() << ',' + s_id << ',' << msg->type() << ",\'" << Util::Convert::toTimestampStr(msg->getRxTimeUnix()) << "\',\'"
 				<< (char)msg->getChannel() << "\'," << tag.level << ',' << tag.ppm
 				<< ") RETURNING id INTO m_id;\n";
@@ -460,7 +1063,7 @@ namespace IO
 			for (auto s : msg->NMEA)
 			{
 
-				sql << "\tINSERT INTO ais_nmea (msg_id,station_id,mmsi,received_at,nmea) VALUES (" << m_id << ',' << s_id << ',' << msg->mmsi() << ",\'" << Util::Convert::toTimestampStr(msg->getRxTimeUnix()) << "\',\'" << s << "\');\n";
+				w.sql << "\tINSERT INTO ais_nmea (msg_id,station_id,mmsi,received_at,nmea) VALUES (" << m_id << ',' << s_id << ',' << msg->mmsi() << ",\'" << Util::Convert::toTimestampStr(msg->getRxTimeUnix()) << "\',\'" << s << "\');\n";
 			}
 		}
 
@@ -470,41 +1073,47 @@ namespace IO
 		case 2:
 		case 3:
 		case 27:
-			sql << addVesselPosition(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addVesselPosition(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 4:
-			sql << addBasestation(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addBasestation(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 5:
-			sql << addVesselStatic(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addVesselStatic(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 9:
-			sql << addSARposition(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addSARposition(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 18:
-			sql << addVesselPosition(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addVesselPosition(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 19:
-			sql << addVesselPosition(data, msg, m_id, s_id);
-			sql << addVesselStatic(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addVesselPosition(data, msg, m_id, s_id);
+			w.sql << addVesselStatic(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 21:
-			sql << addATON(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addATON(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		case 24:
-			sql << addVesselStatic(data, msg, m_id, s_id);
-			sql << addVessel(data, msg, m_id, s_id);
+			w.sql << addVesselStatic(data, msg, m_id, s_id);
+			w.sql << addVessel(data, msg, m_id, s_id);
 			break;
 		default:
 			break;
 		}
+		if (JSONB)
+		{
+			w.sql << "\n";
+			return;
+		}
+
 		// TO DO: types, etc
 		for (const auto &p : data[0].getProperties())
 		{
@@ -512,21 +1121,188 @@ namespace IO
 			{
 				if (p.Get().isString())
 				{
-					sql << "INSERT INTO ais_property (msg_id, key, value) VALUES (" << m_id << "\'" << db_keys[p.Key()] << "\',\'" << escape(p.Get().getString()) << "\');\n";
+					w.sql << "INSERT INTO ais_property (msg_id, key, value) VALUES (" << m_id << "\'" << db_keys[p.Key()] << "\',\'" << escape(p.Get().getString()) << "\');\n";
 				}
 				else
 				{
 					std::string temp;
 					builder.to_string(temp, p.Get());
 					temp = temp.substr(0, 20);
-					sql << "INSERT INTO ais_property (msg_id, key, value) VALUES  (" << m_id << "\',\'" + temp + "\');\n";
+					w.sql << "INSERT INTO ais_property (msg_id, key, value) VALUES  (" << m_id << "\',\'" + temp + "\');\n";
 				}
 			}
 		}
-		sql << "\n";
+		w.sql << "\n";
+	}
+
+	void PostgreSQL::ReceiveCOPY(Writer &w, const JSON::JSON *data, const AIS::Message *msg, TAG &tag)
+	{
+		const std::string s_id = std::to_string(station_id ? station_id : msg->getStation());
+		const std::string t = Util::Convert::toTimestampStr(msg->getRxTimeUnix());
+		const std::string mmsi = std::to_string(msg->mmsi());
+		Batch &batch = w.batch;
+		int m = -1;
+
+		if (MSGS)
+		{
+			m = batch.messages.size();
+			std::string row = mmsi + '\t' + s_id + '\t';
+			Util::Convert::appendInt(row, msg->type());
+			row += '\t' + t + '\t' + copyEscape(std::string(1, msg->getChannel())) + '\t';
+			Util::Convert::appendFixed(row, tag.level);
+			row += '\t';
+			Util::Convert::appendFixed(row, tag.ppm);
+			batch.messages.push_back({m, std::move(row)});
+
+			if (JSONB)
+			{
+				std::string json = jsonProperties(data);
+				batch.messages.back().data += '\t' + (json.empty() ? "\\N" : copyEscape(json));
+			}
+		}
+
+		if (NMEA)
+			for (auto &s : msg->NMEA)
+				batch.nmea.push_back({m, mmsi + '\t' + s_id + '\t' + t + '\t' + copyEscape(s)});
+
+		bool vessel = true;
+
+		switch (msg->type())
+		{
+		case 1:
+		case 2:
+		case 3:
+		case 18:
+		case 27:
+			if (VP)
+				batch.pos.push_back({m, copyRow(data, POS_KEYS, s_id, t)});
+			break;
+		case 4:
+			if (BS)
+				batch.bs.push_back({m, copyRow(data, BS_KEYS, s_id, t)});
+			break;
+		case 5:
+		case 24:
+			if (VS)
+				batch.vstatic.push_back({m, copyRow(data, STATIC_KEYS, s_id, t)});
+			break;
+		case 9:
+			if (SAR)
+				batch.sar.push_back({m, copyRow(data, SAR_KEYS, s_id, t)});
+			break;
+		case 19:
+			if (VP)
+				batch.pos.push_back({m, copyRow(data, POS_KEYS, s_id, t)});
+			if (VS)
+				batch.vstatic.push_back({m, copyRow(data, STATIC_KEYS, s_id, t)});
+			break;
+		case 21:
+			if (ATON)
+				batch.aton.push_back({m, copyRow(data, ATON_KEYS, s_id, t)});
+			break;
+		default:
+			vessel = false;
+			break;
+		}
+
+		// one row per vessel and batch, later messages overwrite the fields they contain
+		if (VD && vessel)
+		{
+			VesselRow &v = batch.vessels[msg->mmsi()];
+
+			if (v.values.empty())
+				v.values.resize(VESSEL_KEYS.size());
+
+			for (const auto &p : data[0].getProperties())
+				for (int i = 0; i < VESSEL_KEYS.size(); i++)
+					if (VESSEL_KEYS[i] == p.Key())
+						v.values[i] = copyValue(p.Get());
+
+			v.values[0] = mmsi;
+
+			int ch = msg->getChannel() - 'A';
+			if (ch < 0 || ch > 4)
+				ch = 4;
+
+			v.msg = m;
+			v.count++;
+			v.types |= 1 << msg->type();
+			v.channels |= 1 << ch;
+			v.station = s_id;
+			v.received_at = t;
+		}
+
+		if (JSONB)
+			return;
+
+		for (const auto &p : data[0].getProperties())
+		{
+			if (p.Key() >= 0 && p.Key() < db_keys.size() && db_keys[p.Key()] != -1)
+			{
+				std::string value = p.Get().isString() ? p.Get().getString() : copyValue(p.Get());
+				batch.property.push_back({m, std::to_string(db_keys[p.Key()]) + '\t' + copyEscape(value.substr(0, 20))});
+			}
+		}
 	}
 #endif
 
+	std::string PostgreSQL::getPrometheus()
+	{
+		std::string element;
+		long pending = 0, written = 0, errors = 0, spilled = 0, dropped = 0;
+		float flush_time = 0;
+
+#ifdef HASPSQL
+		for (auto &w : writers)
+		{
+			pending += w->pending;
+			written += w->written;
+			errors += w->errors;
+			spilled += w->spilled;
+			dropped += w->dropped;
+			flush_time = std::max(flush_time, (float)w->flush_time);
+		}
+#endif
+
+		element += "# HELP ais_dbms_pending Messages waiting to be written to the database\n";
+		element += "# TYPE ais_dbms_pending gauge\n";
+		element += "ais_dbms_pending " + std::to_string(pending) + "\n";
+		element += "# HELP ais_dbms_written Messages written to the database\n";
+		element += "# TYPE ais_dbms_written counter\n";
+		element += "ais_dbms_written " + std::to_string(written) + "\n";
+		element += "# HELP ais_dbms_errors Failed writes to the database\n";
+		element += "# TYPE ais_dbms_errors counter\n";
+		element += "ais_dbms_errors " + std::to_string(errors) + "\n";
+		element += "# HELP ais_dbms_flush_seconds Duration of the last write to the database\n";
+		element += "# TYPE ais_dbms_flush_seconds gauge\n";
+		element += "ais_dbms_flush_seconds " + std::to_string(flush_time) + "\n";
+		element += "# HELP ais_dbms_spilled Messages written to the spill file\n";
+		element += "# TYPE ais_dbms_spilled counter\n";
+		element += "ais_dbms_spilled " + std::to_string(spilled) + "\n";
+		element += "# HELP ais_dbms_dropped Messages lost on a full queue\n";
+		element += "# TYPE ais_dbms_dropped counter\n";
+		element += "ais_dbms_dropped " + std::to_string(dropped) + "\n";
+
+#ifdef HASPSQL
+		element += "# HELP ais_dbms_writer_pending Messages waiting per writer connection\n";
+		element += "# TYPE ais_dbms_writer_pending gauge\n";
+		for (auto &w : writers)
+			element += "ais_dbms_writer_pending{writer=\"" + std::to_string(w->id) + "\"} " + std::to_string(w->pending) + "\n";
+
+		element += "# HELP ais_dbms_spill_bytes Bytes in the spill file waiting to be written back\n";
+		element += "# TYPE ais_dbms_spill_bytes gauge\n";
+		for (auto &w : writers)
+			element += "ais_dbms_spill_bytes{writer=\"" + std::to_string(w->id) + "\"} " + std::to_string(w->spill_bytes) + "\n";
+
+		element += "# HELP ais_dbms_commit_microseconds Duration of the writes to the database\n";
+		element += "# TYPE ais_dbms_commit_microseconds histogram\n";
+		for (auto &w : writers)
+			element += w->commit_us.toPrometheus("ais_dbms_commit_microseconds", "writer=\"" + std::to_string(w->id) + "\"", 5, 26);
+#endif
+
+		return element;
+	}
+
 	Setting &PostgreSQL::Set(std::string option, std::string arg)
 	{
 
@@ -534,6 +1310,12 @@ namespace IO
 
 		if (option == "CONN_STR")
 			conn_string = arg;
+		else if (option == "AFFINITY" || option == "PRIORITY")
+			policy.Set(option, arg);
+		else if (option == "PROFILE")
+			profile = Util::Parse::Switch(arg);
+		else if (option == "LATENCY")
+			latency = Util::Parse::Switch(arg);
 		else if (option == "GROUPS_IN")
 			StreamIn<JSON::JSON>::setGroupsIn(Util::Parse::Integer(arg));
 		else if (option == "STATION_ID")
@@ -558,6 +1340,25 @@ namespace IO
 			ATON = Util::Parse::Switch(arg);
 		else if (option == "SAR")
 			SAR = Util::Parse::Switch(arg);
+		else if (option == "COPY")
+			COPY = Util::Parse::Switch(arg);
+		else if (option == "WRITERS")
+			WRITERS = Util::Parse::Integer(arg, 1, 16);
+		else if (option == "SPILL")
+			spill_dir = arg;
+		else if (option == "SPILL_MAX")
+			SPILL_MAX = (uint64_t)Util::Parse::Integer(arg, 1, 1048576) << 20;
+		else if (option == "PROPERTIES")
+		{
+			Util::Convert::toUpper(arg);
+
+			if (arg == "JSONB")
+				JSONB = true;
+			else if (arg == "ROWS")
+				JSONB = false;
+			else
+				throw std::runtime_error("DBMS: PROPERTIES should be ROWS or JSONB, got " + arg);
+		}
 		else
 		{
 			filter.Set(option, arg);
@@ -20,6 +20,11 @@
 #include <iostream>
 #include <iomanip>
 #include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 
 #ifdef HASPSQL
 #include <libpq-fe.h>
@@ -31,18 +36,15 @@
 #include "JSON/JSON.h"
 #include "JSON/StringBuilder.h"
 #include "MsgOut.h"
+#include "Histogram.h"
+#include "MemoryBudget.h"
 
 namespace IO {
 
 	class PostgreSQL : public OutputJSON {
 		JSON::StringBuilder builder;
-		std::string sql_trans;
-		std::stringstream sql;
 		AIS::Filter filter;
 		int station_id = 0;
-#ifdef HASPSQL
-		int conn_fails = 0;
-#endif
 		int MAX_FAILS = 10;
 
 		std::string escape(const std::string& input) {
@@ -56,28 +58,113 @@ namespace IO {
 		}
 
 #ifdef HASPSQL
-		PGconn* con = nullptr;
 		std::vector<int> db_keys;
-		bool terminate = false, running = false;
+		bool all_keys = false;
+		std::atomic<bool> terminate{false};
+		bool running = false;
+
+		// COPY mode: rows in COPY text format per table, the msg_id column is added when written
+		struct Row {
+			int msg;
+			std::string data;
+		};
+
+		struct VesselRow {
+			int msg = -1, count = 0, types = 0, channels = 0;
+			std::string station, received_at;
+			std::vector<std::string> values;
+		};
+
+		struct Batch {
+			std::vector<Row> messages, nmea, pos, vstatic, bs, sar, aton, property;
+			std::unordered_map<int, VesselRow> vessels;
+
+			void clear() {
+				messages.clear();
+				nmea.clear(); pos.clear(); vstatic.clear(); bs.clear(); sar.clear(); aton.clear(); property.clear();
+				vessels.clear();
+			}
 
+			// for the spill file
+			void serialize(std::string& out) const;
+			bool deserialize(const std::string& in);
+			// bytes held by the rows
+			std::size_t memory() const;
+		};
+
+		// Messages are assigned to a writer by MMSI so the rows of a vessel are written in order by one
+		// connection. Each writer has its own queue of at most MAX_PENDING messages, a full queue is
+		// appended to the spill file of the writer (SPILL) and written back in order once the database
+		// keeps up, or dropped without a spill directory.
+		struct Writer {
+			int id = 0;
+			PGconn* con = nullptr;
+			std::thread thread;
+			int conn_fails = 0;
+
+			std::mutex mtx;
+			std::stringstream sql;
+			std::string sql_trans;
+			Batch batch, writing;
+			std::atomic<int> pending{0};
+
+			std::mutex spill_mtx;
+			std::string spill_file;
+			std::streamoff spill_read = 0;
+			std::atomic<uint64_t> spill_bytes{0};
+			// times the database rejected the first segment of the spill file over a working connection
+			int spill_attempts = 0;
+
+			std::atomic<long> written{0}, errors{0}, spilled{0}, dropped{0};
+			std::atomic<float> flush_time{0};
+			LogHistogram commit_us;
+
+			// queued bytes as accounted in MemoryBudget::QUEUES, only touched by the writer thread
+			std::size_t memory_reported = 0;
+		};
+
+		std::vector<std::unique_ptr<Writer>> writers;
+
+		std::string copyValue(const JSON::Value& v);
+		std::string jsonProperties(const JSON::JSON* data);
+		std::string copyRow(const JSON::JSON* data, const std::vector<int>& keys, const std::string& s, const std::string& t);
+		bool exec(Writer& w, const std::string& s, ExecStatusType status = PGRES_COMMAND_OK);
+		bool copy(Writer& w, const std::string& table, const std::string& columns, const std::vector<Row>& rows, const std::vector<std::string>& ids, const std::string& id_column = "msg_id");
+		bool postCOPY(Writer& w);
+		void ReceiveCOPY(Writer& w, const JSON::JSON* data, const AIS::Message* msg, TAG& tag);
+
+		bool spill(Writer& w, int kind, int n, const std::string& payload);
+		bool unspill(Writer& w, int& kind, int& n, std::string& payload, std::streamoff& next);
+		void commitSpill(Writer& w, std::streamoff next);
+		Writer& writerFor(const AIS::Message* msg) { return *writers[msg->mmsi() % writers.size()]; }
+		void reportMemory(Writer& w);
 #endif
 
+		bool COPY = false;
+		// PROPERTIES JSONB: the properties go into ais_message.properties instead of a row each in ais_property
+		bool JSONB = false;
+		const int MAX_PENDING = 50000;
+
+		int WRITERS = 1;
+		std::string spill_dir;
+		uint64_t SPILL_MAX = (uint64_t)1024 << 20;
+		const int SPILL_ATTEMPTS = 3;
+
 		bool MSGS = false, NMEA = false, VP = false, VS = false, BS = false, ATON = false, SAR = false, VD = true;
 		std::string conn_string = "dbname=ais";
-		std::thread run_thread;
-
-		std::mutex queue_mutex;
+		Util::ThreadPolicy policy;
 
 		int INTERVAL = 10;
 #ifdef HASPSQL
-		void post();
+		PGconn* connect();
+		void post(Writer& w);
 #endif
 	public:
 		PostgreSQL() : builder(&AIS::KeyMap, JSON_DICT_FULL) {}
 		~PostgreSQL();
 
 #ifdef HASPSQL
-		void process();
+		void process(Writer& w);
 
 		std::string addVesselPosition(const JSON::JSON* data, const AIS::Message* msg, const std::string& m, const std::string& s);
 		std::string addVesselStatic(const JSON::JSON* data, const AIS::Message* msg, const std::string& m, const std::string& s);
@@ -96,5 +183,6 @@ namespace IO {
 
 
 		Setting& Set(std::string option, std::string arg);
+		std::string getPrometheus() override;
 	};
 }
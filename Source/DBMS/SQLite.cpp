@@ -0,0 +1,554 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "AIS-catcher.h"
+#include <algorithm>
+
+#include "DBMS/SQLite.h"
+
+namespace IO
+{
+	// columns per table, followed by station_id, received_at and msg_id
+	static const std::vector<int> POS_KEYS = {AIS::KEY_MMSI, AIS::KEY_STATUS, AIS::KEY_TURN, AIS::KEY_SPEED, AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_COURSE, AIS::KEY_HEADING};
+	static const std::vector<int> STATIC_KEYS = {AIS::KEY_MMSI, AIS::KEY_IMO, AIS::KEY_CALLSIGN, AIS::KEY_SHIPNAME, AIS::KEY_SHIPTYPE, AIS::KEY_TO_PORT, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN, AIS::KEY_TO_STARBOARD, AIS::KEY_ETA, AIS::KEY_DRAUGHT, AIS::KEY_DESTINATION};
+	static const std::vector<int> BS_KEYS = {AIS::KEY_MMSI, AIS::KEY_LAT, AIS::KEY_LON};
+	static const std::vector<int> SAR_KEYS = {AIS::KEY_MMSI, AIS::KEY_ALT, AIS::KEY_SPEED, AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_COURSE};
+	static const std::vector<int> ATON_KEYS = {AIS::KEY_MMSI, AIS::KEY_AID_TYPE, AIS::KEY_NAME, AIS::KEY_LON, AIS::KEY_LAT, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN, AIS::KEY_TO_PORT, AIS::KEY_TO_STARBOARD};
+	static const std::vector<int> VESSEL_KEYS = {AIS::KEY_MMSI, AIS::KEY_SIGNAL_POWER, AIS::KEY_PPM, AIS::KEY_IMO, AIS::KEY_CALLSIGN, AIS::KEY_SHIPNAME, AIS::KEY_SHIPTYPE, AIS::KEY_TO_PORT, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN, AIS::KEY_TO_STARBOARD, AIS::KEY_ETA, AIS::KEY_DRAUGHT, AIS::KEY_DESTINATION, AIS::KEY_STATUS, AIS::KEY_TURN, AIS::KEY_SPEED, AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_COURSE, AIS::KEY_HEADING, AIS::KEY_AID_TYPE, AIS::KEY_ALT};
+
+	std::string SQLite::toString(const JSON::Value &v)
+	{
+		if (v.isString())
+			return v.getString();
+
+		std::string s;
+		builder.to_string(s, v);
+		return s;
+	}
+
+	void SQLite::addRow(std::vector<Row> &table, const JSON::JSON *data, const std::vector<int> &keys, int m, const std::string &s, const std::string &t)
+	{
+		Row r;
+		r.msg = m;
+		r.values.resize(keys.size() + 2);
+		r.null.resize(keys.size() + 2, true);
+
+		for (int i = 0; i < keys.size(); i++)
+		{
+			const JSON::Value *v = data[0].getValue(keys[i]);
+
+			if (v)
+			{
+				r.values[i] = toString(*v);
+				r.null[i] = false;
+			}
+		}
+
+		r.values[keys.size()] = s;
+		r.values[keys.size() + 1] = t;
+		r.null[keys.size()] = r.null[keys.size() + 1] = false;
+
+		table.push_back(std::move(r));
+	}
+
+#ifdef HASSQLITE
+	static const char *SCHEMA =
+		"CREATE TABLE IF NOT EXISTS ais_message (id INTEGER PRIMARY KEY AUTOINCREMENT, mmsi INTEGER, received_at TEXT, published_at TEXT DEFAULT CURRENT_TIMESTAMP, station_id INTEGER, type INTEGER, channel TEXT, signal_level REAL, ppm REAL);"
+		"CREATE TABLE IF NOT EXISTS ais_nmea (mmsi INTEGER, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, nmea TEXT);"
+		"CREATE TABLE IF NOT EXISTS ais_basestation (mmsi INTEGER, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, lat REAL, lon REAL);"
+		"CREATE TABLE IF NOT EXISTS ais_sar_position (mmsi INTEGER, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, alt INTEGER, speed INTEGER, lat REAL, lon REAL, course INTEGER);"
+		"CREATE TABLE IF NOT EXISTS ais_aton (mmsi INTEGER, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, aid_type INTEGER, name TEXT, lon REAL, lat REAL, to_bow INTEGER, to_stern INTEGER, to_port INTEGER, to_starboard INTEGER);"
+		"CREATE TABLE IF NOT EXISTS ais_vessel_pos (mmsi INTEGER, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, status INTEGER, turn REAL, speed REAL, lat REAL, lon REAL, course REAL, heading REAL);"
+		"CREATE TABLE IF NOT EXISTS ais_vessel_static (mmsi INTEGER, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, imo INTEGER, callsign TEXT, shipname TEXT, shiptype INTEGER, to_port INTEGER, to_bow INTEGER, to_stern INTEGER, to_starboard INTEGER, eta TEXT, draught REAL, destination TEXT);"
+		"CREATE TABLE IF NOT EXISTS ais_vessel (mmsi INTEGER PRIMARY KEY, signalpower REAL, ppm REAL, received_at TEXT, station_id INTEGER, msg_id INTEGER REFERENCES ais_message(id) ON DELETE SET NULL, imo INTEGER, callsign TEXT, shipname TEXT, shiptype INTEGER, to_port INTEGER, to_bow INTEGER, to_stern INTEGER, to_starboard INTEGER, eta TEXT, draught REAL, destination TEXT, status INTEGER, turn REAL, speed REAL, lat REAL, lon REAL, course REAL, heading REAL, aid_type INTEGER, alt INTEGER, count INTEGER, msg_types INTEGER, channels INTEGER);"
+		"CREATE TABLE IF NOT EXISTS ais_keys (key_id INTEGER PRIMARY KEY AUTOINCREMENT, key_str TEXT);"
+		"CREATE TABLE IF NOT EXISTS ais_property (msg_id INTEGER REFERENCES ais_message(id), key INTEGER REFERENCES ais_keys(key_id), value TEXT);";
+
+	static std::string columns(const std::vector<int> &keys, const std::string &extra = "")
+	{
+		std::string s;
+		for (int k : keys)
+			s += AIS::KeyMap[k][JSON_DICT_FULL] + ",";
+		return s + "station_id,received_at" + extra + ",msg_id";
+	}
+
+	static std::string insertSQL(const std::string &table, const std::string &cols)
+	{
+		std::string values;
+		for (int i = std::count(cols.begin(), cols.end(), ',') + 1; i > 0; i--)
+			values += values.empty() ? "?" : ",?";
+
+		return "INSERT INTO " + table + " (" + cols + ") VALUES (" + values + ")";
+	}
+
+	std::string SQLite::getFilename(std::time_t t)
+	{
+		if (!ROTATE)
+			return filename;
+
+		char date[16];
+		std::strftime(date, sizeof(date), "_%Y%m%d", std::gmtime(&t));
+
+		std::size_t dot = filename.find_last_of('.');
+		std::size_t slash = filename.find_last_of("/\\");
+
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return filename + date;
+
+		return filename.substr(0, dot) + date + filename.substr(dot);
+	}
+
+	void SQLite::exec(const std::string &s)
+	{
+		char *err = nullptr;
+
+		if (sqlite3_exec(db, s.c_str(), nullptr, nullptr, &err) != SQLITE_OK)
+		{
+			std::string e = err ? err : "unknown error";
+			sqlite3_free(err);
+			throw std::runtime_error("DBMS: SQLite error: " + e);
+		}
+	}
+
+	void SQLite::open(const std::string &name)
+	{
+		close();
+
+		if (sqlite3_open(name.c_str(), &db) != SQLITE_OK)
+		{
+			std::string e = db ? sqlite3_errmsg(db) : "out of memory";
+			close();
+			throw std::runtime_error("DBMS: cannot open SQLite database \"" + name + "\": " + e);
+		}
+
+		try
+		{
+			// WAL with NORMAL sync only syncs at checkpoints, which keeps write amplification low on SD cards
+			exec("PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;");
+			exec(SCHEMA);
+
+			std::string vessel = insertSQL("ais_vessel", columns(VESSEL_KEYS, ",count,msg_types,channels"));
+			vessel += " ON CONFLICT(mmsi) DO UPDATE SET msg_id=excluded.msg_id,station_id=excluded.station_id,received_at=excluded.received_at,count=ais_vessel.count+excluded.count,msg_types=ais_vessel.msg_types|excluded.msg_types,channels=ais_vessel.channels|excluded.channels";
+
+			// only the fields present in the messages are updated
+			for (int k : VESSEL_KEYS)
+			{
+				const std::string &c = AIS::KeyMap[k][JSON_DICT_FULL];
+				if (k != AIS::KEY_MMSI)
+					vessel += "," + c + "=COALESCE(excluded." + c + ",ais_vessel." + c + ")";
+			}
+
+			const std::string sql[STMT_COUNT] = {
+				insertSQL("ais_message", "mmsi,station_id,type,received_at,channel,signal_level,ppm"),
+				insertSQL("ais_nmea", "mmsi,station_id,received_at,nmea,msg_id"),
+				insertSQL("ais_vessel_pos", columns(POS_KEYS)),
+				insertSQL("ais_vessel_static", columns(STATIC_KEYS)),
+				insertSQL("ais_basestation", columns(BS_KEYS)),
+				insertSQL("ais_sar_position", columns(SAR_KEYS)),
+				insertSQL("ais_aton", columns(ATON_KEYS)),
+				vessel};
+
+			for (int i = 0; i < STMT_COUNT; i++)
+				if (sqlite3_prepare_v2(db, sql[i].c_str(), -1, &stmt[i], nullptr) != SQLITE_OK)
+					throw std::runtime_error("DBMS: SQLite cannot prepare statement: " + std::string(sqlite3_errmsg(db)));
+		}
+		catch (const std::exception &)
+		{
+			close();
+			throw;
+		}
+
+		current = name;
+		Info() << "DBMS: writing to SQLite database \"" << name << "\"";
+	}
+
+	void SQLite::close()
+	{
+		for (auto &s : stmt)
+		{
+			if (s)
+				sqlite3_finalize(s);
+			s = nullptr;
+		}
+
+		if (db)
+			sqlite3_close(db);
+
+		db = nullptr;
+		current.clear();
+	}
+
+	void SQLite::insert(Statement s, const Row &r, const std::vector<sqlite3_int64> &ids)
+	{
+		sqlite3_stmt *st = stmt[s];
+		int n = 0;
+
+		sqlite3_reset(st);
+
+		for (int i = 0; i < r.values.size(); i++)
+		{
+			if (r.null[i])
+				sqlite3_bind_null(st, ++n);
+			else
+				sqlite3_bind_text(st, ++n, r.values[i].c_str(), (int)r.values[i].size(), SQLITE_STATIC);
+		}
+
+		// message rows get their id assigned by the database
+		if (s != STMT_MESSAGE)
+		{
+			if (r.msg < 0 || r.msg >= ids.size())
+				sqlite3_bind_null(st, ++n);
+			else
+				sqlite3_bind_int64(st, ++n, ids[r.msg]);
+		}
+
+		if (sqlite3_step(st) != SQLITE_DONE)
+			throw std::runtime_error("DBMS: SQLite error: " + std::string(sqlite3_errmsg(db)));
+	}
+
+	void SQLite::post()
+	{
+		auto start = high_resolution_clock::now();
+		int n;
+
+		{
+			const std::lock_guard<std::mutex> lock(queue_mutex);
+			std::swap(batch, writing);
+			n = pending.exchange(0);
+		}
+
+		try
+		{
+			const std::string name = getFilename(std::time(nullptr));
+
+			if (!db || name != current)
+				open(name);
+
+			std::vector<sqlite3_int64> ids;
+
+			exec("BEGIN");
+
+			try
+			{
+				for (const Row &r : writing.messages)
+				{
+					insert(STMT_MESSAGE, r, ids);
+					ids.push_back(sqlite3_last_insert_rowid(db));
+				}
+
+				for (const Row &r : writing.nmea)
+					insert(STMT_NMEA, r, ids);
+				for (const Row &r : writing.pos)
+					insert(STMT_POS, r, ids);
+				for (const Row &r : writing.vstatic)
+					insert(STMT_STATIC, r, ids);
+				for (const Row &r : writing.bs)
+					insert(STMT_BS, r, ids);
+				for (const Row &r : writing.sar)
+					insert(STMT_SAR, r, ids);
+				for (const Row &r : writing.aton)
+					insert(STMT_ATON, r, ids);
+
+				for (auto &v : writing.vessels)
+				{
+					Row &r = v.second.row;
+
+					r.values.push_back(std::to_string(v.second.count));
+					r.values.push_back(std::to_string(v.second.types));
+					r.values.push_back(std::to_string(v.second.channels));
+					r.null.resize(r.values.size(), false);
+
+					insert(STMT_VESSEL, r, ids);
+				}
+
+				exec("COMMIT");
+			}
+			catch (const std::exception &)
+			{
+				sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+				throw;
+			}
+
+			written += n;
+		}
+		catch (const std::exception &e)
+		{
+			Error() << e.what();
+			errors++;
+		}
+
+		writing.clear();
+		flush_time = 1e-6f * duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+	}
+
+	void SQLite::process()
+	{
+		policy.apply("SQLite");
+		while (!terminate)
+		{
+			for (int i = 0; !terminate && i < INTERVAL && pending < MAX_PENDING / 2; i++)
+			{
+				SleepSystem(1000);
+				reportMemory();
+			}
+
+			if (pending)
+				post();
+
+			reportMemory();
+		}
+	}
+#endif
+
+	void SQLite::reportMemory()
+	{
+		std::size_t n;
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			n = batch.memory();
+		}
+		MemoryBudget::account(MemoryBudget::QUEUES, memory_reported, n);
+	}
+
+	SQLite::~SQLite()
+	{
+#ifdef HASSQLITE
+		if (running)
+		{
+			terminate = true;
+			run_thread.join();
+			running = false;
+
+			Debug() << "DBMS: stop thread and SQLite database closed.";
+		}
+		close();
+#endif
+		MemoryBudget::account(MemoryBudget::QUEUES, memory_reported, 0);
+	}
+
+	void SQLite::Start()
+	{
+#ifdef HASSQLITE
+		open(getFilename(std::time(nullptr)));
+
+		if (!running)
+		{
+			running = true;
+			terminate = false;
+
+			run_thread = std::thread(&SQLite::process, this);
+
+			Debug() << "DBMS: start SQLite thread, filter: " << Util::Convert::toString(filter.isOn())
+					<< ", V " << Util::Convert::toString(VD)
+					<< ", VP " << Util::Convert::toString(VP)
+					<< ", MSGS " << Util::Convert::toString(MSGS)
+					<< ", VS " << Util::Convert::toString(VS)
+					<< ", BS " << Util::Convert::toString(BS)
+					<< ", SAR " << Util::Convert::toString(SAR)
+					<< ", ATON " << Util::Convert::toString(ATON)
+					<< ", NMEA " << Util::Convert::toString(NMEA)
+					<< ", ROTATE " << Util::Convert::toString(ROTATE);
+		}
+#else
+		throw std::runtime_error("DBMS: no support for SQLite build in.");
+#endif
+	}
+
+	void SQLite::Receive(const JSON::JSON *data, int len, TAG &tag)
+	{
+		const AIS::Message *msg = (AIS::Message *)data[0].binary;
+
+		if (!filter.include(*msg))
+			return;
+
+		const std::lock_guard<std::mutex> lock(queue_mutex);
+
+		if (pending >= MAX_PENDING)
+		{
+			Warning() << "DBMS: writing to SQLite database slow or failed, data lost.";
+			batch.clear();
+			pending = 0;
+		}
+
+		pending++;
+
+		const std::string s_id = std::to_string(station_id ? station_id : msg->getStation());
+		const std::string t = Util::Convert::toTimestampStr(msg->getRxTimeUnix());
+		const std::string mmsi = std::to_string(msg->mmsi());
+		int m = -1;
+
+		if (MSGS)
+		{
+			m = batch.messages.size();
+
+			Row r;
+			r.values = {mmsi, s_id, std::to_string(msg->type()), t, std::string(1, msg->getChannel()), std::to_string(tag.level), std::to_string(tag.ppm)};
+			r.null.resize(r.values.size(), false);
+			batch.messages.push_back(std::move(r));
+		}
+
+		if (NMEA)
+			for (auto &s : msg->NMEA)
+			{
+				Row r;
+				r.msg = m;
+				r.values = {mmsi, s_id, t, s};
+				r.null.resize(r.values.size(), false);
+				batch.nmea.push_back(std::move(r));
+			}
+
+		bool vessel = true;
+
+		switch (msg->type())
+		{
+		case 1:
+		case 2:
+		case 3:
+		case 18:
+		case 27:
+			if (VP)
+				addRow(batch.pos, data, POS_KEYS, m, s_id, t);
+			break;
+		case 4:
+			if (BS)
+				addRow(batch.bs, data, BS_KEYS, m, s_id, t);
+			break;
+		case 5:
+		case 24:
+			if (VS)
+				addRow(batch.vstatic, data, STATIC_KEYS, m, s_id, t);
+			break;
+		case 9:
+			if (SAR)
+				addRow(batch.sar, data, SAR_KEYS, m, s_id, t);
+			break;
+		case 19:
+			if (VP)
+				addRow(batch.pos, data, POS_KEYS, m, s_id, t);
+			if (VS)
+				addRow(batch.vstatic, data, STATIC_KEYS, m, s_id, t);
+			break;
+		case 21:
+			if (ATON)
+				addRow(batch.aton, data, ATON_KEYS, m, s_id, t);
+			break;
+		default:
+			vessel = false;
+			break;
+		}
+
+		// one row per vessel and batch, later messages overwrite the fields they contain
+		if (VD && vessel)
+		{
+			VesselRow &v = batch.vessels[msg->mmsi()];
+			Row &r = v.row;
+
+			if (r.values.empty())
+			{
+				r.values.resize(VESSEL_KEYS.size() + 2);
+				r.null.resize(VESSEL_KEYS.size() + 2, true);
+			}
+
+			for (int i = 0; i < VESSEL_KEYS.size(); i++)
+			{
+				const JSON::Value *p = data[0].getValue(VESSEL_KEYS[i]);
+
+				if (p)
+				{
+					r.values[i] = toString(*p);
+					r.null[i] = false;
+				}
+			}
+
+			int ch = msg->getChannel() - 'A';
+			if (ch < 0 || ch > 4)
+				ch = 4;
+
+			r.values[0] = mmsi;
+			r.values[VESSEL_KEYS.size()] = s_id;
+			r.values[VESSEL_KEYS.size() + 1] = t;
+			r.null[0] = r.null[VESSEL_KEYS.size()] = r.null[VESSEL_KEYS.size() + 1] = false;
+			r.msg = m;
+
+			v.count++;
+			v.types |= 1 << msg->type();
+			v.channels |= 1 << ch;
+		}
+	}
+
+	std::string SQLite::getPrometheus()
+	{
+		std::string element;
+
+		element += "# HELP ais_sqlite_pending Messages waiting to be written to the SQLite database\n";
+		element += "# TYPE ais_sqlite_pending gauge\n";
+		element += "ais_sqlite_pending " + std::to_string(pending) + "\n";
+		element += "# HELP ais_sqlite_written Messages written to the SQLite database\n";
+		element += "# TYPE ais_sqlite_written counter\n";
+		element += "ais_sqlite_written " + std::to_string(written) + "\n";
+		element += "# HELP ais_sqlite_errors Failed writes to the SQLite database\n";
+		element += "# TYPE ais_sqlite_errors counter\n";
+		element += "ais_sqlite_errors " + std::to_string(errors) + "\n";
+		element += "# HELP ais_sqlite_flush_seconds Duration of the last write to the SQLite database\n";
+		element += "# TYPE ais_sqlite_flush_seconds gauge\n";
+		element += "ais_sqlite_flush_seconds " + std::to_string(flush_time) + "\n";
+
+		return element;
+	}
+
+	Setting &SQLite::Set(std::string option, std::string arg)
+	{
+		Util::Convert::toUpper(option);
+
+		if (option == "FILE")
+			filename = arg;
+		else if (option == "AFFINITY" || option == "PRIORITY")
+			policy.Set(option, arg);
+		else if (option == "PROFILE")
+			profile = Util::Parse::Switch(arg);
+		else if (option == "LATENCY")
+			latency = Util::Parse::Switch(arg);
+		else if (option == "GROUPS_IN")
+			StreamIn<JSON::JSON>::setGroupsIn(Util::Parse::Integer(arg));
+		else if (option == "STATION_ID")
+			station_id = Util::Parse::Integer(arg);
+		else if (option == "INTERVAL")
+			INTERVAL = Util::Parse::Integer(arg, 1, 1800);
+		else if (option == "ROTATE")
+			ROTATE = Util::Parse::Switch(arg);
+		else if (option == "NMEA")
+			NMEA = Util::Parse::Switch(arg);
+		else if (option == "VP")
+			VP = Util::Parse::Switch(arg);
+		else if (option == "V")
+			VD = Util::Parse::Switch(arg);
+		else if (option == "VS")
+			VS = Util::Parse::Switch(arg);
+		else if (option == "MSGS")
+			MSGS = Util::Parse::Switch(arg);
+		else if (option == "BS")
+			BS = Util::Parse::Switch(arg);
+		else if (option == "ATON")
+			ATON = Util::Parse::Switch(arg);
+		else if (option == "SAR")
+			SAR = Util::Parse::Switch(arg);
+		else
+			filter.Set(option, arg);
+
+		return *this;
+	}
+}
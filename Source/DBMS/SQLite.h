@@ -0,0 +1,156 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef HASSQLITE
+#include <sqlite3.h>
+#endif
+
+#include "Stream.h"
+#include "Keys.h"
+#include "AIS.h"
+#include "JSON/JSON.h"
+#include "JSON/StringBuilder.h"
+#include "MsgOut.h"
+#include "MemoryBudget.h"
+
+namespace IO
+{
+	// writes messages to a local SQLite file with the tables from create.sql,
+	// rows are collected in Receive and written in one transaction per interval
+	class SQLite : public OutputJSON
+	{
+		JSON::StringBuilder builder;
+		AIS::Filter filter;
+		int station_id = 0;
+
+		std::string filename = "ais.db", current;
+		bool ROTATE = false;
+		int INTERVAL = 5;
+		const int MAX_PENDING = 50000;
+
+		bool MSGS = false, NMEA = false, VP = false, VS = false, BS = false, ATON = false, SAR = false, VD = true;
+
+		// values are stored as text and converted by the column affinity, msg refers to the message in the batch
+		struct Row
+		{
+			int msg = -1;
+			std::vector<std::string> values;
+			std::vector<bool> null;
+		};
+
+		struct VesselRow
+		{
+			Row row;
+			int count = 0, types = 0, channels = 0;
+		};
+
+		struct Batch
+		{
+			std::vector<Row> messages, nmea, pos, vstatic, bs, sar, aton;
+			std::unordered_map<int, VesselRow> vessels;
+
+			void clear()
+			{
+				messages.clear();
+				nmea.clear(); pos.clear(); vstatic.clear(); bs.clear(); sar.clear(); aton.clear();
+				vessels.clear();
+			}
+
+			// bytes held by the rows
+			std::size_t memory() const
+			{
+				std::size_t n = 0;
+				auto row = [&n](const Row &r)
+				{
+					n += sizeof(Row) + r.values.capacity() * sizeof(std::string) + r.null.capacity() / 8;
+					for (const auto &v : r.values)
+						n += v.capacity();
+				};
+
+				for (auto *rows : {&messages, &nmea, &pos, &vstatic, &bs, &sar, &aton})
+					for (const Row &r : *rows)
+						row(r);
+				for (const auto &v : vessels)
+					row(v.second.row);
+				return n;
+			}
+		} batch, writing;
+
+		std::mutex queue_mutex;
+		std::thread run_thread;
+		Util::ThreadPolicy policy;
+		std::atomic<bool> terminate{false};
+		bool running = false;
+
+		// statistics for /metrics
+		std::atomic<int> pending{0};
+		std::atomic<long> written{0}, errors{0};
+		std::atomic<float> flush_time{0};
+
+		// queued bytes as accounted in MemoryBudget::QUEUES
+		std::size_t memory_reported = 0;
+		void reportMemory();
+
+#ifdef HASSQLITE
+		sqlite3 *db = nullptr;
+
+		enum Statement
+		{
+			STMT_MESSAGE = 0,
+			STMT_NMEA,
+			STMT_POS,
+			STMT_STATIC,
+			STMT_BS,
+			STMT_SAR,
+			STMT_ATON,
+			STMT_VESSEL,
+			STMT_COUNT
+		};
+
+		sqlite3_stmt *stmt[STMT_COUNT] = {};
+
+		std::string getFilename(std::time_t t);
+		void open(const std::string &name);
+		void close();
+		void exec(const std::string &s);
+		void insert(Statement s, const Row &r, const std::vector<sqlite3_int64> &ids);
+		void post();
+		void process();
+#endif
+
+		void addRow(std::vector<Row> &table, const JSON::JSON *data, const std::vector<int> &keys, int m, const std::string &s, const std::string &t);
+		std::string toString(const JSON::Value &v);
+
+	public:
+		SQLite() : builder(&AIS::KeyMap, JSON_DICT_FULL) {}
+		~SQLite();
+
+		void Receive(const JSON::JSON *data, int len, TAG &tag);
+
+		void Start();
+		void setMap(int m) { builder.setMap(m); }
+
+		Setting &Set(std::string option, std::string arg);
+		std::string getPrometheus() override;
+	};
+}
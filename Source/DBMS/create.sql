@@ -18,7 +18,8 @@ CREATE TABLE ais_message (
     type smallint,
     channel character(1),
     signal_level real,
-    ppm real
+    ppm real,
+    properties jsonb
 );
 
 CREATE TABLE ais_nmea (
@@ -140,6 +141,17 @@ CREATE TABLE ais_property (
     value varchar(20)
 );
 
+/*
+With PROPERTIES JSONB the properties are written to ais_message.properties, one row per message, instead of
+ais_property. Only the keys in ais_keys are stored, all properties of the message if ais_keys is empty.
+
+CREATE INDEX ais_message_properties ON ais_message USING GIN (properties jsonb_path_ops);
+
+Existing databases:
+
+ALTER TABLE ais_message ADD COLUMN properties jsonb;
+*/
+
 /*
 INSERT INTO ais_keys (key_str) VALUES ('destination');
 */
@@ -0,0 +1,153 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <stdexcept>
+
+#include "Channelizer.h"
+#include "Kernels.h"
+#include "FFT.h"
+
+namespace DSP {
+
+	void Channelizer::setParams(int m, int L) {
+		if (m < 4 || (m & (m - 1)) != 0 || L < 1)
+			throw std::runtime_error("Channelizer: number of channels must be a power of two and at least 4.");
+
+		M = m;
+		D = M / 2;
+		N = M * L;
+		logM = FFT::log2(M);
+		plan.setSize(M);
+		phase = 0;
+
+		// windowed sinc (Blackman-Harris) with the -6 dB point at the output Nyquist frequency fs / M,
+		// normalized to unit gain at DC
+		std::vector<FLOAT32> h(N);
+		double sum = 0;
+
+		for (int n = 0; n < N; n++) {
+			double x = n - (N - 1) / 2.0;
+			double s = x == 0 ? 2.0 / M : std::sin(2 * PI * x / M) / (PI * x);
+			double a = 2 * PI * n / (N - 1);
+			double w = 0.35875 - 0.48829 * std::cos(a) + 0.14128 * std::cos(2 * a) - 0.01168 * std::cos(3 * a);
+
+			h[n] = (FLOAT32)(s * w);
+			sum += h[n];
+		}
+
+		// reversed so that the window of the last N samples is multiplied element by element
+		std::vector<FLOAT32> g(N);
+		for (int n = 0; n < N; n++)
+			g[n] = (FLOAT32)(h[N - 1 - n] / sum);
+
+		Kernels::duplicateTaps(g, taps);
+
+		buffer.assign(N - 1, 0.0f);
+		acc.resize(2 * M);
+		fft_data.resize(M);
+		FFT::calcOmega(omega, M);
+
+		// element r of a folded window is branch M - 1 - r, put in bit reversed order for the FFT
+		rev.resize(M);
+		for (int r = 0; r < M; r++)
+			rev[r] = plan.index(M - 1 - r);
+
+		output.assign(M, Util::AlignedVector<CFLOAT32>());
+		channels.assign(M, Connection<CFLOAT32>());
+	}
+
+	// sum_r u_r exp(2 pi j k r / M) for the folded window in acc, in branch order M - 1 - r
+	CFLOAT32 Channelizer::bin(int k) {
+		FLOAT32 re = 0, im = 0;
+
+		if (k == 0) {
+			for (int r = 0; r < 2 * M; r += 2) {
+				re += acc[r];
+				im += acc[r + 1];
+			}
+			return CFLOAT32(re, im);
+		}
+
+		for (int r = 0; r < M; r++) {
+			const CFLOAT32& w = omega[((M - k) * (M - 1 - r)) & (M - 1)];
+			FLOAT32 a = acc[2 * r], b = acc[2 * r + 1];
+
+			re += a * w.real() - b * w.imag();
+			im += a * w.imag() + b * w.real();
+		}
+		return CFLOAT32(re, im);
+	}
+
+	// Channel k at output sample m is
+	//     y_k[m] = sum_n h[n] x[mD - n] exp(-2 pi j k (mD - n) / M)
+	//            = (-1)^(km) sum_r u_r exp(2 pi j k r / M),  u_r = sum_p h[r + pM] x[mD - r - pM]
+	// so after folding the filtered window into the M branches u_r, one forward FFT gives all
+	// channels with channel k in bin -k.
+	void Channelizer::Receive(const CFLOAT32* data, int len, TAG& tag) {
+		buffer.insert(buffer.end(), data, data + len);
+
+		int n_out = ((int)buffer.size() - N) / D + 1;
+		if (n_out <= 0) return;
+
+		active.clear();
+		for (int k = 0; k < M; k++)
+			if (channels[k].isConnected()) {
+				active.push_back(k);
+				if (output[k].size() < n_out) output[k].resize(n_out);
+			}
+
+		// a DFT bin costs about M operations and the FFT M log2(M), so the FFT only pays off for many channels
+		bool use_fft = active.size() >= logM;
+
+		for (int i = 0; i < n_out; i++) {
+			const FLOAT32* x = (const FLOAT32*)(buffer.data() + i * D);
+			const FLOAT32* t = taps.data();
+
+			std::fill(acc.begin(), acc.end(), 0.0f);
+
+			for (int p = 0; p < N; p += M, x += 2 * M, t += 2 * M)
+				for (int r = 0; r < 2 * M; r++)
+					acc[r] += t[r] * x[r];
+
+			if (use_fft) {
+				for (int r = 0; r < M; r++)
+					fft_data[rev[r]] = CFLOAT32(acc[2 * r], acc[2 * r + 1]);
+
+				plan.execute(fft_data);
+			}
+
+			for (int k : active) {
+				CFLOAT32 y;
+
+				if (use_fft)
+					y = fft_data[(M - k) & (M - 1)];
+				else
+					y = bin(k);
+
+				output[k][i] = (phase & k & 1) ? -y : y;
+			}
+
+			phase ^= 1;
+		}
+
+		buffer.erase(buffer.begin(), buffer.begin() + n_out * D);
+
+		for (int k = 0; k < M; k++)
+			if (channels[k].isConnected()) channels[k].Send(output[k].data(), n_out, tag);
+	}
+}
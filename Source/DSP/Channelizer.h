@@ -0,0 +1,60 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "Stream.h"
+#include "Aligned.h"
+#include "Common.h"
+#include "FFT.h"
+
+namespace DSP
+{
+	// Polyphase FFT channelizer: splits the input into M channels spaced fs / M apart and decimates
+	// each by M / 2 (oversampled by 2, so a channel can hold signals up to the edge between two bins).
+	// Channel k is centered at k * fs / M, negative k refer to channels below the center frequency.
+	// All channels come out of one FFT of size M per output sample, only connected channels are sent.
+	class Channelizer : public StreamIn<CFLOAT32>
+	{
+		int M = 0, D = 0, N = 0, logM = 0;
+		int phase = 0;
+
+		// prototype low pass, reversed (see Receive)
+		std::vector<FLOAT32> taps, acc;
+		std::vector<CFLOAT32> buffer, fft_data, omega;
+		std::vector<int> rev, active;
+		FFT::Plan<FLOAT32> plan;
+
+		std::vector<Util::AlignedVector<CFLOAT32>> output;
+		std::vector<Connection<CFLOAT32>> channels;
+
+		int index(int k) const { return ((k % M) + M) % M; }
+		CFLOAT32 bin(int k);
+
+	public:
+		virtual ~Channelizer() {}
+
+		// M channels (a power of two >= 4) and L taps per polyphase branch
+		void setParams(int m, int L = 8);
+
+		Connection<CFLOAT32> &channel(int k) { return channels[index(k)]; }
+
+		void Receive(const CFLOAT32 *data, int len, TAG &tag);
+	};
+}
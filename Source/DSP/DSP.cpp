@@ -15,8 +15,10 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <chrono>
 #include <cassert>
+#include <cmath>
 #include <complex>
 #include <cstring>
 
@@ -55,6 +57,39 @@ namespace DSP {
 		}
 	}
 
+	void ScatterPLL::ReceiveBlock(const CFLOAT32* data, int len, TAG& tag) {
+		const int n = (int)out.size();
+		int groups = 0;
+
+		for (auto& p : phases)
+			if (p.size() < len / n + 1) p.resize(len / n + 1);
+		if (levels.size() < len / n + 1) levels.resize(len / n + 1);
+
+		for (int i = 0; i < len; i++) {
+			sample[lastSymbol] = data[i];
+			if (tag.mode & 1)
+				level += std::norm(data[i]);
+
+			if (++lastSymbol == n) {
+				for (int j = 0; j < n; j++)
+					phases[j][groups] = sample[j];
+
+				levels[groups++] = level / n;
+				level = 0.0f;
+				lastSymbol = 0;
+			}
+		}
+
+		if (groups == 0) return;
+
+		// index of the first sample, the Interleave stage reconstructs the others
+		tag.sample_idx = sample_idx;
+		sample_idx += (long)groups * n;
+
+		for (int j = 0; j < n; j++)
+			out[j].Send(phases[j].data(), groups, tag);
+	}
+
 	// Downsample moving average
 	void DownsampleMovingAverage::Receive(const CFLOAT32* data, int len, TAG& tag) {
 		if (output.size() < BLOCK_SIZE) output.resize(BLOCK_SIZE);
@@ -115,6 +150,63 @@ namespace DSP {
 		Send(output.data(), len / 2, tag);
 	}
 
+	int Downsample2CIC5Cascade::run(State& s, const CFLOAT32* data, CFLOAT32* out, int len) {
+		CFLOAT32 h0 = s.h0, h1 = s.h1, h2 = s.h2, h3 = s.h3, h4 = s.h4;
+		CFLOAT32 z, r0, r1, r2, r3, r4;
+
+		for (int i = 0, j = 0; i < len; i += 2, j++) {
+			z = data[i];
+			MA1(0);
+			MA1(1);
+			MA1(2);
+			MA1(3);
+			MA1(4);
+			out[j] = z * (FLOAT32)0.03125f;
+			z = data[i + 1];
+			MA2(0);
+			MA2(1);
+			MA2(2);
+			MA2(3);
+			MA2(4);
+		}
+
+		s.h0 = h0;
+		s.h1 = h1;
+		s.h2 = h2;
+		s.h3 = h3;
+		s.h4 = h4;
+
+		return len / 2;
+	}
+
+	void Downsample2CIC5Cascade::Receive(const CFLOAT32* data, int len, TAG& tag) {
+		const int n = (int)state.size();
+		assert(n > 0 && len % (1 << n) == 0);
+
+		if (output.size() < len >> n) output.resize(len >> n);
+		if (buffer.size() < TILE / 2) buffer.resize(TILE / 2);
+
+		CFLOAT32* out = output.data();
+
+		for (int i = 0; i < len; i += TILE) {
+			int m = std::min(TILE, len - i);
+
+			if (n == 1) {
+				out += run(state[0], data + i, out, m);
+				continue;
+			}
+
+			m = run(state[0], data + i, buffer.data(), m);
+
+			for (int k = 1; k < n - 1; k++)
+				m = run(state[k], buffer.data(), buffer.data(), m);
+
+			out += run(state[n - 1], buffer.data(), out, m);
+		}
+
+		Send(output.data(), len >> n, tag);
+	}
+
 	void Decimate2::Receive(const CFLOAT32* data, int len, TAG& tag) {
 		assert(len % 2 == 0);
 
@@ -213,6 +305,20 @@ namespace DSP {
 
 		if (output.size() < len) output.resize(len);
 
+		// fixed tap set: history and block in one buffer, the first taps.size() - 1 samples are the history
+		if (block) {
+			const int nh = (int)taps.size() - 1;
+
+			if (buffer.size() < len + nh) buffer.resize(len + nh);
+
+			std::copy(data, data + len, buffer.begin() + nh);
+			block(taps.data(), buffer.data(), output.data(), len);
+			std::copy(buffer.begin() + len, buffer.begin() + len + nh, buffer.begin());
+
+			Send(output.data(), len, tag);
+			return;
+		}
+
 		if (len < taps.size()) {
 			for (j = 0; j < len; j++) {
 				for (i = 1; i < taps.size(); i++)
@@ -247,6 +353,20 @@ namespace DSP {
 
 		if (output.size() < len) output.resize(len);
 
+		// fixed tap set: history and block in one buffer, the first taps.size() - 1 samples are the history
+		if (block) {
+			const int nh = (int)taps.size() - 1;
+
+			if (buffer.size() < len + nh) buffer.resize(len + nh);
+
+			std::copy(data, data + len, buffer.begin() + nh);
+			block(taps.data(), buffer.data(), output.data(), len);
+			std::copy(buffer.begin() + len, buffer.begin() + len + nh, buffer.begin());
+
+			Send(output.data(), len, tag);
+			return;
+		}
+
 		if (len < taps.size()) {
 			for (j = 0; j < len; j++) {
 				for (i = 1; i < taps.size(); i++)
@@ -289,26 +409,42 @@ namespace DSP {
 	}
 
 	// Rotate +/- 25K Hz
+	void Rotate::setRotation(float a) {
+		table_re.resize(nTable);
+		table_im.resize(nTable);
+
+		for (int k = 0; k < nTable; k++) {
+			std::complex<double> p = std::polar(1.0, (double)a * k);
+			table_re[k] = (FLOAT32)p.real();
+			table_im[k] = (FLOAT32)p.imag();
+		}
+
+		angle = a;
+		mult_table = std::polar(1.0, angle * nTable);
+		rot = 1.0;
+	}
+
 	void Rotate::Receive(const CFLOAT32* data, int len, TAG& tag) {
 		if (output_up.size() < len) output_up.resize(len);
 		if (output_down.size() < len) output_down.resize(len);
 
-		for (int i = 0; i < len; i++) {
-			FLOAT32 RR = data[i].real() * rot.real(), II = data[i].imag() * rot.imag();
-			FLOAT32 RI = data[i].real() * rot.imag(), IR = data[i].imag() * rot.real();
+		// runs of at most nTable samples starting at phase rot, so there is no dependency between samples
+		for (int i = 0; i < len; i += nTable) {
+			int n = std::min(nTable, len - i);
+			CFLOAT32 r((FLOAT32)rot.real(), (FLOAT32)rot.imag());
+
+			Kernels::splitRotate(data + i, table_re.data(), table_im.data(), r, output_up.data() + i, output_down.data() + i, n);
 
-			output_up[i].real(RR - II);
-			output_up[i].imag(IR + RI);
-			output_down[i].real(RR + II);
-			output_down[i].imag(IR - RI);
+			if (n == nTable)
+				rot *= mult_table;
+			else
+				rot *= std::polar(1.0, angle * n);
 
-			rot *= mult;
+			rot /= std::abs(rot);
 		}
 
 		up.Send(output_up.data(), len, tag);
 		down.Send(output_down.data(), len, tag);
-
-		rot /= std::abs(rot);
 	}
 
 	void SOXR::setParams(int sample_rate, int out_rate) {
@@ -404,13 +540,94 @@ namespace DSP {
 	}
 
 
+	static double besselI0(double x) {
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 50; k++) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+			if (term < 1e-12 * sum) break;
+		}
+		return sum;
+	}
+
+	void Resample::setParams(int sample_rate, int out_rate, int passband) {
+		if (sample_rate <= 0 || out_rate <= 0 || 2 * passband >= out_rate || out_rate > sample_rate)
+			throw std::runtime_error("Resample: rates not supported.");
+
+		int g = sample_rate, r = out_rate;
+		while (r) {
+			int t = g % r;
+			g = r;
+			r = t;
+		}
+		L = out_rate / g;
+		M = sample_rate / g;
+
+		// Kaiser design for 70 dB stopband, the transition runs from the passband to its alias
+		const double A = 70.0, beta = 0.1102 * (A - 8.7);
+		const double transition = (double)(out_rate - 2 * passband) / sample_rate;
+
+		K = std::max(4, (int)std::ceil((A - 8.0) / (2.285 * 2.0 * PI * transition)));
+
+		const int N = K * L;
+		const double fc = 0.5 / M; // cutoff at half the output rate, relative to the rate L x input
+		const double mid = (N - 1) / 2.0;
+
+		std::vector<double> h(N);
+		double sum = 0.0;
+
+		for (int n = 0; n < N; n++) {
+			double t = n - mid;
+			double sinc = t == 0 ? 2.0 * fc : std::sin(2.0 * PI * fc * t) / (PI * t);
+			double w = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - (t / mid) * (t / mid)))) / besselI0(beta);
+			h[n] = sinc * w;
+			sum += h[n];
+		}
+
+		// taps per phase in time order, oldest input sample first
+		phases.assign(L, std::vector<FLOAT32>());
+		for (int p = 0; p < L; p++) {
+			std::vector<FLOAT32> taps(K);
+			for (int k = 0; k < K; k++)
+				taps[K - 1 - k] = (FLOAT32)(h[p + k * L] * L / sum);
+			Kernels::duplicateTaps(taps, phases[p]);
+		}
+
+		buffer.assign(K - 1, 0.0f);
+		output.resize(outputSize);
+		phase = idx_in = idx_out = 0;
+	}
+
+	void Resample::Receive(const CFLOAT32* data, int len, TAG& tag) {
+		if (buffer.size() < len + K - 1) buffer.resize(len + K - 1);
+
+		std::copy(data, data + len, buffer.begin() + K - 1);
+
+		while (idx_in < len) {
+			output[idx_out] = Kernels::dotComplex(phases[phase].data(), &buffer[idx_in], K);
+
+			if (++idx_out == outputSize) {
+				Send(output.data(), outputSize, tag);
+				idx_out = 0;
+			}
+
+			phase += M;
+			idx_in += phase / L;
+			phase %= L;
+		}
+
+		idx_in -= len;
+
+		std::copy(buffer.begin() + len, buffer.begin() + len + K - 1, buffer.begin());
+	}
+
 	// square the signal, find the mid-point between two peaks
 	FLOAT32 SquareFreqOffsetCorrection::correctFrequency() {
 		FLOAT32 max_val = 0.0, fz = -1;
 		int delta = (int)(9600.0 / 48000.0 * N);
 		int wi = 0;
 
-		FFT::fft(fft_data);
+		plan.execute(fft_data.data());
 
 		if (wide) {
 			if (cumsum.size() < N) cumsum.resize(N);
@@ -446,20 +663,34 @@ namespace DSP {
 		}
 
 		FLOAT32 f = fz / 2.0f / N;
-		CFLOAT32 rot_step = std::polar(1.0f, (float)(f * 2 * PI));
+		rot_step = std::polar(1.0f, (float)(f * 2 * PI));
 
+		applyCorrection();
+		return f * 48000.0f / 162.0f;
+	}
+
+	void SquareFreqOffsetCorrection::applyCorrection() {
 		for (int i = 0; i < N; i++) {
 			rot *= rot_step;
 			output[i] *= rot;
 		}
 
 		rot /= std::abs(rot);
-		return f * 48000.0f / 162.0f;
+	}
+
+	// block power against a floor that follows drops immediately and rises slowly
+	bool SquareFreqOffsetCorrection::isIdle() {
+		if (floor < 0 || energy < floor)
+			floor = energy;
+		else
+			floor += 0.01f * (energy - floor);
+
+		return energy < idle_ratio * floor;
 	}
 
 	void SquareFreqOffsetCorrection::setParams(int n, int w) {
 		N = n;
-		logN = FFT::log2(N);
+		plan.setSize(N);
 		window = w;
 	}
 
@@ -468,138 +699,175 @@ namespace DSP {
 		if (output.size() < N) output.resize(N);
 
 		for (int i = 0; i < len; i++) {
-			fft_data[FFT::rev(count, logN)] = data[i] * data[i];
+			fft_data[plan.index(count)] = data[i] * data[i];
 			output[count] = data[i];
+			energy += std::norm(data[i]);
 
 			if (++count == N) {
-				tag.ppm = correctFrequency();
+				if (skip_idle && isIdle())
+					applyCorrection();
+				else
+					ppm = correctFrequency();
+
+				tag.ppm = ppm;
 				Send(output.data(), N, tag);
 				count = 0;
+				energy = 0;
 			}
 		}
 	}
 
 
+	// Squelch
+	void Squelch::process(int& n_out) {
+		total++;
+
+		if (floor < 0 || energy < floor)
+			floor = energy;
+		else
+			floor += 0.01f * (energy - floor);
+
+		if (energy > ratio * floor) {
+			if (!open) {
+				// release the blocks before the burst, oldest first
+				for (int b = n_history; b > 0; b--) {
+					int idx = (history_idx - b + pre) % pre;
+					std::memcpy(output.data() + n_out, history.data() + idx * BLOCK, BLOCK * sizeof(CFLOAT32));
+					n_out += BLOCK;
+					passed++;
+				}
+				n_history = 0;
+				open = true;
+			}
+			hang = post;
+		}
+		else if (open && hang-- <= 0)
+			open = false;
+
+		if (open) {
+			std::memcpy(output.data() + n_out, block.data(), BLOCK * sizeof(CFLOAT32));
+			n_out += BLOCK;
+			passed++;
+		}
+		else if (pre > 0) {
+			std::memcpy(history.data() + history_idx * BLOCK, block.data(), BLOCK * sizeof(CFLOAT32));
+			history_idx = (history_idx + 1) % pre;
+			n_history = MIN(n_history + 1, pre);
+		}
+	}
+
+	void Squelch::Receive(const CFLOAT32* data, int len, TAG& tag) {
+		// worst case: all complete blocks plus the history
+		int max_out = (len / BLOCK + 1 + pre) * BLOCK;
+		if (output.size() < max_out) output.resize(max_out);
+		if (block.size() < BLOCK) block.resize(BLOCK);
+		if (history.size() < pre * BLOCK) history.resize(pre * BLOCK);
+
+		int n_out = 0;
+
+		for (int i = 0; i < len; i++) {
+			block[count] = data[i];
+			energy += std::norm(data[i]);
+
+			if (++count == BLOCK) {
+				process(n_out);
+				count = 0;
+				energy = 0;
+			}
+		}
+
+		if (n_out > 0) Send(output.data(), n_out, tag);
+	}
+
 	// ----------------------------------------------------------------------------
 	// CIC5 downsampling optimized for Raspberry Pi 1
 	// Idea: I and Q signals can be downsampled in parallel and, if stored
 	// as int16, can be worked in parallel with int32 operations.
 	// Self invented so might be more clever approaches
+	// The filter runs as FIR (1, 5, 10, 10, 5, 1) on the packed samples, which is
+	// bit-exact with the recursive form and lets the SIMD kernels do several outputs at once.
 	// ----------------------------------------------------------------------------
 
-	int DS_UINT16::Run(uint32_t* data, int len, int shift) {
-		uint32_t z, r0, r1, r2, r3, r4;
-		uint32_t mask = 0xFFFFU >> shift;
-		mask |= mask << 16;
-		uint32_t* out = data;
+	// filters len samples in the tile, moves the last samples to the history
+	int DS_UINT16::filter(uint32_t* out, int len, int shift) {
+		Kernels::cic5Packed(tile + HISTORY, out, len >> 1, shift);
+		std::memmove(tile, tile + len, HISTORY * sizeof(uint32_t));
+		return len >> 1;
+	}
 
-		len >>= 1;
+	int DS_UINT16::Run(uint32_t* data, int len, int shift) {
+		int n = 0;
 
-		for (int i = 0; i < len; i++) {
-			z = *data++;
-			MA1(0);
-			MA1(1);
-			MA1(2);
-			MA1(3);
-			MA1(4);
-			// divide by 2^shift and clean up contamination from I to Q
-			*out++ = (z >> shift) & mask;
-			z = *data++;
-			MA2(0);
-			MA2(1);
-			MA2(2);
-			MA2(3);
-			MA2(4);
+		// the output of a tile goes to the part of data that has been read
+		for (int i = 0; i < len; i += TILE) {
+			int m = std::min(TILE, len - i);
+			std::memcpy(tile + HISTORY, data + i, m * sizeof(uint32_t));
+			n += filter(data + n, m, shift);
 		}
-		return len;
+		return n;
 	}
 
-	// special version of the above but includes the initial conversion from CU8 to avoid extra loop
+	// special version of the above but includes the initial conversion from CU8
 	int DS_UINT16::Run(uint8_t* in, uint32_t* out, int len, int shift) {
-		uint32_t z, r0, r1, r2, r3, r4;
-		uint32_t mask = 0xFFFFU >> shift;
-		mask |= mask << 16;
+		int n = 0;
 
-		len >>= 1;
+		for (int i = 0; i < len; i += TILE) {
+			int m = std::min(TILE, len - i);
+			uint32_t* t = tile + HISTORY;
 
-		for (int i = 0; i < len; i++) {
-			z = (uint32_t)*in++;
-			z |= (uint32_t)*in++ << 16;
-			MA1(0);
-			MA1(1);
-			MA1(2);
-			MA1(3);
-			MA1(4);
-			*out++ = (z >> shift) & mask;
-			z = (uint32_t)*in++;
-			z |= (uint32_t)*in++ << 16;
-			MA2(0);
-			MA2(1);
-			MA2(2);
-			MA2(3);
-			MA2(4);
+			for (int k = 0; k < m; k++, in += 2)
+				t[k] = (uint32_t)in[0] | ((uint32_t)in[1] << 16);
+
+			n += filter(out + n, m, shift);
 		}
-		return len;
+		return n;
 	}
 
-	// special version of the above but includes the initial conversion from CS8 to avoid extra loop
+	// special version of the above but includes the initial conversion from CS8
 	int DS_UINT16::Run(int8_t* in, uint32_t* out, int len, int shift) {
-		uint32_t z, r0, r1, r2, r3, r4;
-		uint32_t mask = 0xFFFFU >> shift;
-		mask |= mask << 16;
 		const uint32_t mask_uint = (1 << 7) | (1 << 23);
+		int n = 0;
 
-		len >>= 1;
+		for (int i = 0; i < len; i += TILE) {
+			int m = std::min(TILE, len - i);
+			uint32_t* t = tile + HISTORY;
 
-		for (int i = 0; i < len; i++) {
-			z = (uint8_t)*in++;
-			z |= (uint32_t)((uint8_t)*in++) << 16;
-			z ^= mask_uint; // from int to uint in parallel by flipping sign bits
-			MA1(0);
-			MA1(1);
-			MA1(2);
-			MA1(3);
-			MA1(4);
-			*out++ = (z >> shift) & mask;
-			z = (uint8_t)*in++;
-			z |= (uint32_t)((uint8_t)*in++) << 16;
-			z ^= mask_uint;
-			MA2(0);
-			MA2(1);
-			MA2(2);
-			MA2(3);
-			MA2(4);
+			// from int to uint in parallel by flipping sign bits
+			for (int k = 0; k < m; k++, in += 2)
+				t[k] = ((uint32_t)(uint8_t)in[0] | ((uint32_t)(uint8_t)in[1] << 16)) ^ mask_uint;
+
+			n += filter(out + n, m, shift);
 		}
-		return len;
+		return n;
 	}
 
 	// special version of the above but includes the last conversion to CFLOAT32
 	int DS_UINT16::Run(uint32_t* in, CFLOAT32* out, int len, int shift) {
-		uint32_t z, r0, r1, r2, r3, r4;
-		uint32_t mask = 0xFFFFU >> shift;
-		mask |= mask << 16;
 		const uint32_t mask_uint = (1U << 15) | (1U << 31);
-		len >>= 1;
+		uint32_t z[TILE / 2];
+		int n = 0;
+
+		for (int i = 0; i < len; i += TILE) {
+			int m = std::min(TILE, len - i);
+			std::memcpy(tile + HISTORY, in + i, m * sizeof(uint32_t));
+			m = filter(z, m, shift);
+
+			// uint to int in parallel by flipping sign bit
+			for (int k = 0; k < m; k++, n++) {
+				uint32_t v = z[k] ^ mask_uint;
+				out[n].real(((int16_t)(v & 0xFFFFU)) / 32768.0f);
+				out[n].imag(((int16_t)(v >> 16)) / 32768.0f);
+			}
+		}
+		return n;
+	}
 
+	// pack CS16 into two unsigned 16-bit lanes, dropping "shift" bits to leave headroom for the CIC5 stages
+	int DS_UINT16::Pack(int16_t* in, uint32_t* out, int len, int shift) {
 		for (int i = 0; i < len; i++) {
-			z = *in++;
-			MA1(0);
-			MA1(1);
-			MA1(2);
-			MA1(3);
-			MA1(4);
-			z = (z >> shift) & mask;
-
-			z ^= mask_uint; // uint to int in parallel by flipping sign bit
-			out[i].real(((int16_t)(z & 0xFFFFU)) / 32768.0f);
-			out[i].imag(((int16_t)(z >> 16)) / 32768.0f);
-
-			z = *in++;
-			MA2(0);
-			MA2(1);
-			MA2(2);
-			MA2(3);
-			MA2(4);
+			uint32_t re = (uint16_t)(*in++ ^ 0x8000);
+			uint32_t im = (uint16_t)(*in++ ^ 0x8000);
+			*out++ = (re >> shift) | ((im >> shift) << 16);
 		}
 		return len;
 	}
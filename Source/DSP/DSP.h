@@ -18,6 +18,7 @@
 #pragma once
 
 #include <assert.h>
+#include <atomic>
 #ifdef HASSOXR
 #include <soxr.h>
 #endif
@@ -25,8 +26,11 @@
 #include <samplerate.h>
 #endif
 #include "Filters.h"
+#include "Kernels.h"
+#include "FFT.h"
 
 #include "Stream.h"
+#include "Aligned.h"
 #include "Signals.h"
 
 namespace DSP
@@ -79,20 +83,39 @@ namespace DSP
 		FLOAT32 level = 0.0f;
 		long sample_idx = 0;
 
+		// block mode: each output receives one contiguous block of its own phase per input block
+		bool block = false;
+		std::vector<std::vector<CFLOAT32>> phases;
+		std::vector<FLOAT32> levels;
+
+		void ReceiveBlock(const CFLOAT32 *data, int len, TAG &tag);
+
 	public:
 		virtual ~ScatterPLL() {}
 		void setConnections(int n)
 		{
 			out.resize(n);
 			sample.resize(n);
+			phases.resize(n);
 		}
 
+		void setBlockMode(bool b) { block = b; }
+
+		// signal level per group of samples of the last block (if tag.mode & 1)
+		const std::vector<FLOAT32> &getLevels() const { return levels; }
+
 		// Streams out
 		std::vector<Connection<CFLOAT32>> out;
 
 		// Streams in
 		void Receive(const CFLOAT32 *data, int len, TAG &tag)
 		{
+			if (block)
+			{
+				ReceiveBlock(data, len, tag);
+				return;
+			}
+
 			for (int i = 0; i < len; i++)
 			{
 				sample[lastSymbol] = data[i];
@@ -116,6 +139,101 @@ namespace DSP
 		}
 	};
 
+	// Counterpart of ScatterPLL in block mode: collects the equal length blocks of the
+	// phase branches and passes them on sample by sample in the original interleaved order.
+	// Decoders signal each other on a found message, so they need to see the same sequence.
+	template <typename T>
+	class Interleave
+	{
+		class Input : public StreamIn<T>
+		{
+			Interleave<T> *parent = nullptr;
+			int idx = 0;
+
+		public:
+			void setParent(Interleave<T> *p, int i)
+			{
+				parent = p;
+				idx = i;
+			}
+			void Receive(const T *data, int len, TAG &tag) { parent->Collect(idx, data, len, tag); }
+		};
+
+		std::vector<Input> in;
+		std::vector<std::vector<T>> buffer;
+		const std::vector<FLOAT32> *levels = nullptr;
+		int received = 0;
+
+		// outputs with a skip hook are only fed from sample next[j] onwards
+		std::vector<StreamSkip<T> *> skip;
+		std::vector<int> next;
+
+		void Collect(int idx, const T *data, int len, TAG &tag)
+		{
+			buffer[idx].assign(data, data + len);
+
+			if (++received < (int)in.size())
+				return;
+
+			received = 0;
+
+			const int n = (int)in.size();
+			const long base = tag.sample_idx;
+
+			for (int j = 0; j < n; j++)
+				next[j] = 0;
+
+			for (int k = 0; k < len; k++)
+			{
+				if (levels && (tag.mode & 1))
+					tag.sample_lvl = (*levels)[k];
+
+				for (int j = 0; j < n; j++)
+				{
+					if (skip[j])
+					{
+						if (next[j] > k)
+							continue;
+
+						int s = skip[j]->Skip(&buffer[j][k], len - k);
+						if (s > 0)
+						{
+							next[j] = k + s;
+							continue;
+						}
+					}
+
+					tag.sample_idx = base + (long)k * n + j;
+					out[j].Send(&buffer[j][k], 1, tag);
+				}
+			}
+		}
+
+	public:
+		virtual ~Interleave() {}
+
+		void setConnections(int n)
+		{
+			in.resize(n);
+			out.resize(n);
+			buffer.resize(n);
+			skip.assign(n, nullptr);
+			next.assign(n, 0);
+
+			for (int i = 0; i < n; i++)
+				in[i].setParent(this, i);
+		}
+
+		void setLevels(const std::vector<FLOAT32> *l) { levels = l; }
+		// s must be the only receiver connected to output i
+		void setSkip(int i, StreamSkip<T> *s) { skip[i] = s; }
+
+		StreamIn<T> &input(int i) { return in[i]; }
+
+		// Streams out
+		std::vector<Connection<T>> out;
+	};
+
 	class DownsampleMovingAverage : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
 		CFLOAT32 D;
@@ -126,7 +244,7 @@ namespace DSP
 		int out_rate = 0;
 		const int BLOCK_SIZE = 8192;
 
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 	public:
 		virtual ~DownsampleMovingAverage() {}
@@ -141,16 +259,44 @@ namespace DSP
 	class Downsample2CIC5 : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
 		CFLOAT32 h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 	public:
 		virtual ~Downsample2CIC5() {}
 		void Receive(const CFLOAT32 *data, int len, TAG &tag);
 	};
 
+	// n stages of Downsample2CIC5 in one pass, the input is processed in tiles so that the
+	// intermediate stages stay in cache (decimated in place in a buffer of half a tile)
+	class Downsample2CIC5Cascade : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
+	{
+		static const int TILE = 4096;
+
+		struct State
+		{
+			CFLOAT32 h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+		};
+
+		std::vector<State> state;
+		Util::AlignedVector<CFLOAT32> output, buffer;
+
+		static int run(State &s, const CFLOAT32 *data, CFLOAT32 *out, int len);
+
+	public:
+		virtual ~Downsample2CIC5Cascade() {}
+
+		void setStages(int n)
+		{
+			assert(n > 0 && TILE % (1 << n) == 0);
+			state.assign(n, State());
+		}
+
+		void Receive(const CFLOAT32 *data, int len, TAG &tag);
+	};
+
 	class Decimate2 : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 	public:
 		virtual ~Decimate2() {}
@@ -159,7 +305,7 @@ namespace DSP
 
 	class Upsample : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 		FLOAT32 alpha = 0, increment = 1.0f;
 		CFLOAT32 a = 0.0f;
@@ -179,10 +325,10 @@ namespace DSP
 
 	class DownsampleKFilter : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
-		std::vector<CFLOAT32> buffer;
-		std::vector<FLOAT32> taps;
+		Util::AlignedVector<CFLOAT32> buffer;
+		std::vector<FLOAT32> taps, taps2;
 
 		int idx_in = 0;
 		int idx_out = 0;
@@ -193,20 +339,21 @@ namespace DSP
 
 		inline CFLOAT32 dot(const CFLOAT32 *data)
 		{
-			CFLOAT32 x = 0.0f;
-			for (int i = 0; i < taps.size(); i++)
-				x += taps[i] * *data++;
-			return x;
+			return Kernels::dotComplex(taps2.data(), data, (int)taps.size());
 		}
 
 	public:
 		virtual ~DownsampleKFilter() {}
 		void setParams(const std::vector<FLOAT32> &t, int k)
 		{
-			taps = t;
+			setTaps(t);
 			K = k;
 		}
-		void setTaps(const std::vector<FLOAT32> &t) { taps = t; }
+		void setTaps(const std::vector<FLOAT32> &t)
+		{
+			taps = t;
+			Kernels::duplicateTaps(taps, taps2);
+		}
 		void setK(int k) { K = k; }
 
 		// StreamIn
@@ -215,17 +362,15 @@ namespace DSP
 
 	class FilterComplex : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
-		std::vector<CFLOAT32> buffer;
-		std::vector<FLOAT32> taps;
+		Util::AlignedVector<CFLOAT32> buffer;
+		std::vector<FLOAT32> taps, taps2;
+		Filters::Symmetric<CFLOAT32>::Func block = nullptr;
 
 		inline CFLOAT32 dot(const CFLOAT32 *data)
 		{
-			CFLOAT32 x = 0.0f;
-			for (int i = 0; i < taps.size(); i++)
-				x += taps[i] * *data++;
-			return x;
+			return Kernels::dotComplex(taps2.data(), data, (int)taps.size());
 		}
 
 	public:
@@ -234,7 +379,9 @@ namespace DSP
 		void setTaps(const std::vector<FLOAT32> &t)
 		{
 			taps = t;
-			buffer.resize(taps.size() * 2, 0.0f);
+			Kernels::duplicateTaps(taps, taps2);
+			buffer.assign(taps.size() * 2, 0.0f);
+			block = Filters::Symmetric<CFLOAT32>::select(taps);
 		}
 
 		// StreamIn
@@ -243,17 +390,14 @@ namespace DSP
 
 	class Filter : public SimpleStreamInOut<FLOAT32, FLOAT32>
 	{
-		std::vector<FLOAT32> output;
-		std::vector<FLOAT32> buffer;
+		Util::AlignedVector<FLOAT32> output;
+		Util::AlignedVector<FLOAT32> buffer;
 		std::vector<FLOAT32> taps;
+		Filters::Symmetric<FLOAT32>::Func block = nullptr;
 
 		inline FLOAT32 dot(const FLOAT32 *data)
 		{
-			FLOAT32 x = 0.0f;
-			for (int i = 0; i < taps.size(); i++)
-				x += taps[i] * *data++;
-
-			return x;
+			return Kernels::dotReal(taps.data(), data, (int)taps.size());
 		}
 
 	public:
@@ -261,7 +405,8 @@ namespace DSP
 		void setTaps(const std::vector<FLOAT32> &t)
 		{
 			taps = t;
-			buffer.resize(taps.size() * 2, 0.0f);
+			buffer.assign(taps.size() * 2, 0.0f);
+			block = Filters::Symmetric<FLOAT32>::select(taps);
 		}
 
 		// StreamIn
@@ -271,7 +416,7 @@ namespace DSP
 	class FilterCIC5 : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
 		CFLOAT32 h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 	public:
 		virtual ~FilterCIC5() {}
@@ -280,7 +425,7 @@ namespace DSP
 
 	class FilterComplex3Tap : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 		FLOAT32 alpha = 0.0f;
 		FLOAT32 beta = 1.0f;
@@ -301,13 +446,19 @@ namespace DSP
 
 	class Rotate : public StreamIn<CFLOAT32>
 	{
-		std::vector<CFLOAT32> output_up, output_down;
-		CFLOAT32 rot = 1.0f, mult = 1.0f;
+		// phasors mult^k for k < nTable in SoA layout, the phase at the start of each table run is kept in double
+		static const int nTable = 256;
+
+		Util::AlignedVector<CFLOAT32> output_up, output_down;
+		std::vector<FLOAT32> table_re, table_im;
+		std::complex<double> rot = 1.0, mult_table = 1.0;
+		double angle = 0;
 
 	public:
+		Rotate() { setRotation(0.0f); }
 		virtual ~Rotate() {}
 
-		void setRotation(float angle) { mult = std::polar(1.0f, angle); }
+		void setRotation(float a);
 
 		// Streams out
 		Connection<CFLOAT32> up;
@@ -322,8 +473,8 @@ namespace DSP
 #ifdef HASSOXR
 		soxr_t m_soxr;
 
-		std::vector<CFLOAT32> output;
-		std::vector<CFLOAT32> out_soxr;
+		Util::AlignedVector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> out_soxr;
 
 		int count = 0;
 		const int N = 16384;
@@ -337,8 +488,8 @@ namespace DSP
 	class SRC : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
 #ifdef HASSAMPLERATE
-		std::vector<CFLOAT32> output;
-		std::vector<CFLOAT32> out_src;
+		Util::AlignedVector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> out_src;
 
 		SRC_STATE *state = nullptr;
 		int count = 0;
@@ -360,42 +511,197 @@ namespace DSP
 		virtual void Receive(const CFLOAT32 *data, int len, TAG &tag);
 	};
 
+	// Polyphase rational resampler, in/out rate reduced to L/M. The filter bank is a Kaiser windowed sinc with
+	// the transition band between the passband and its first alias at the output rate, computed once in
+	// setParams. Every output sample is one dot product of K taps with the input (SIMD kernels).
+	class Resample : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
+	{
+		Util::AlignedVector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> buffer;
+		std::vector<std::vector<FLOAT32>> phases;
+
+		int L = 1, M = 1, K = 1;
+		int phase = 0;
+		int idx_in = 0;
+		int idx_out = 0;
+
+		static const int outputSize = 16384 / 2;
+
+	public:
+		virtual ~Resample() {}
+		// passband in Hz, the AIS channels at +/- 25K of the center
+		void setParams(int sample_rate, int out_rate, int passband = 35000);
+		int getTaps() { return K; }
+		// taps of phase p in the layout of Kernels::duplicateTaps
+		const std::vector<FLOAT32> &getPhase(int p) { return phases[p]; }
+
+		// StreamIn
+		void Receive(const CFLOAT32 *data, int len, TAG &tag);
+	};
+
 	class SquareFreqOffsetCorrection : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
-		std::vector<CFLOAT32> fft_data;
+		Util::AlignedVector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> fft_data;
 		std::vector<FLOAT32> cumsum;
 
-		CFLOAT32 rot = 1.0f;
+		CFLOAT32 rot = 1.0f, rot_step = 1.0f;
 		int N = 2048;
-		int logN = 11;
+		FFT::Plan<FLOAT32> plan{2048};
 		int count = 0;
 		int window = 750;
 		bool wide = false;
 
+		// skip the estimate for blocks with power close to the noise floor, the last correction is kept
+		std::atomic<bool> skip_idle{false};
+		FLOAT32 idle_ratio = 2.0f;
+		FLOAT32 energy = 0, floor = -1, ppm = 0;
+
 		FLOAT32 correctFrequency();
+		bool isIdle();
+		void applyCorrection();
 
 	public:
 		virtual ~SquareFreqOffsetCorrection() {}
 		void setWide(bool b) { wide = b; }
+		void setSkipIdle(bool b) { skip_idle = b; }
 		void setParams(int, int);
 		void Receive(const CFLOAT32 *data, int len, TAG &tag);
 	};
 
+	// Power squelch for a 48K channel: blocks with power near the noise floor are dropped so the decoders
+	// only run on bursts. The noise floor follows drops immediately and rises slowly. Up to 'pre' blocks
+	// before a burst are kept in a history and sent when it opens, and 'post' blocks after the burst
+	// are passed before it closes, so the training sequence and the ramp down reach the decoders.
+	class Squelch : public SimpleStreamInOut<CFLOAT32, CFLOAT32>
+	{
+		static const int BLOCK = 480;
+		const FLOAT32 ratio = 2.0f;
+
+		Util::AlignedVector<CFLOAT32> output, block, history;
+		int count = 0, pre = 3, post = 3;
+
+		// ring of the last 'pre' closed blocks, n_history of them valid
+		int history_idx = 0, n_history = 0;
+
+		FLOAT32 energy = 0, floor = -1;
+		int hang = 0;
+		bool open = false;
+
+		long passed = 0, total = 0;
+
+		void process(int &n_out);
+
+	public:
+		virtual ~Squelch() {}
+
+		// margins in ms, rounded up to whole blocks of 10 ms
+		void setMargins(int pre_ms, int post_ms)
+		{
+			pre = (pre_ms + 9) / 10;
+			post = (post_ms + 9) / 10;
+		}
+
+		float getPassed() { return total ? (float)passed / total : 0; }
+
+		void Receive(const CFLOAT32 *data, int len, TAG &tag);
+	};
+
+	// CIC5 decimation by 2 of I/Q as two 16-bit lanes in an uint32 (Kernels::cic5Packed). The input is
+	// taken in tiles behind the last 5 samples of the previous one, so the stages can run in place.
 	class DS_UINT16
 	{
-		uint32_t h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+		static const int HISTORY = 5;
+		static const int TILE = 2048;
+
+		uint32_t tile[HISTORY + TILE] = {0};
+
+		int filter(uint32_t *out, int len, int shift);
 
 	public:
 		int Run(uint32_t *, int, int);
 		int Run(uint8_t *, uint32_t *, int, int);
 		int Run(int8_t *, uint32_t *, int, int);
 		int Run(uint32_t *, CFLOAT32 *, int, int);
+
+		static int Pack(int16_t *, uint32_t *, int, int);
+	};
+
+	// Fixed point CIC5 decimation by 2^n for CU8, CS8 and CS16 input.
+	// Samples stay packed as two 16-bit unsigned lanes until the final stage, which converts to CFLOAT32.
+	// 8-bit input needs at least 2 stages to reach 16 bits, CS16 input is prescaled to 11 bits.
+	template <typename T>
+	class DownsampleFixedPoint : public SimpleStreamInOut<T, CFLOAT32>
+	{
+		Util::AlignedVector<CFLOAT32> output;
+		std::vector<uint32_t> buffer;
+
+		std::vector<DS_UINT16> DS;
+		std::vector<int> shift;
+
+		static const int PRESCALE_CS16 = 5;
+
+		// first stage includes the conversion from the input format
+		int load(const CU8 *data, uint32_t *buf, int len) { return DS[0].Run((uint8_t *)data, buf, len, shift[0]); }
+		int load(const CS8 *data, uint32_t *buf, int len) { return DS[0].Run((int8_t *)data, buf, len, shift[0]); }
+		int load(const CS16 *data, uint32_t *buf, int len) { return DS_UINT16::Pack((int16_t *)data, buf, len, PRESCALE_CS16); }
+
+		static int inputBits(const CU8 *) { return 8; }
+		static int inputBits(const CS8 *) { return 8; }
+		static int inputBits(const CS16 *) { return 16 - PRESCALE_CS16; }
+
+		static bool isFused(const CS16 *) { return false; }
+		static bool isFused(const void *) { return true; }
+
+	public:
+		virtual ~DownsampleFixedPoint() {}
+
+		static int minStages() { return inputBits((const T *)nullptr) == 8 ? 2 : 1; }
+
+		void setStages(int n)
+		{
+			assert(n >= minStages());
+
+			DS.assign(n, DS_UINT16());
+			shift.resize(n);
+
+			// each stage adds 5 bits, keep at most 11 bits going into the next stage and end at 16 bits
+			int bits = inputBits((const T *)nullptr);
+			for (int i = 0; i < n - 1; i++)
+			{
+				shift[i] = MAX(0, bits + 5 - 11);
+				bits += 5 - shift[i];
+			}
+			shift[n - 1] = bits + 5 - 16;
+		}
+
+		void Receive(const T *data, int len, TAG &tag)
+		{
+			const int n = (int)DS.size();
+			assert(n > 0 && len % (1 << n) == 0);
+
+			if (output.size() < len >> n)
+				output.resize(len >> n);
+			if (buffer.size() < len)
+				buffer.resize(len);
+
+			uint32_t *buf = buffer.data();
+			int i = isFused((const T *)nullptr) ? 1 : 0;
+
+			len = load(data, buf, len);
+
+			for (; i < n - 1; i++)
+				len = DS[i].Run(buf, len, shift[i]);
+
+			len = DS[n - 1].Run(buf, output.data(), len, shift[n - 1]);
+
+			this->Send(output.data(), len, tag);
+		}
 	};
 
 	class Downsample32_CU8 : public SimpleStreamInOut<CU8, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 		std::vector<uint32_t> buffer;
 
 		DS_UINT16 DS1, DS2, DS3, DS4, DS5;
@@ -407,7 +713,7 @@ namespace DSP
 
 	class Downsample32_CS8 : public SimpleStreamInOut<CS8, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 		std::vector<uint32_t> buffer;
 
 		DS_UINT16 DS1, DS2, DS3, DS4, DS5;
@@ -419,7 +725,7 @@ namespace DSP
 
 	class Downsample16_CU8 : public SimpleStreamInOut<CU8, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 		std::vector<uint32_t> buffer;
 
 		DS_UINT16 DS1, DS2, DS3, DS4;
@@ -431,7 +737,7 @@ namespace DSP
 
 	class Downsample16_CS8 : public SimpleStreamInOut<CS8, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 		std::vector<uint32_t> buffer;
 
 		DS_UINT16 DS1, DS2, DS3, DS4;
@@ -442,7 +748,7 @@ namespace DSP
 
 	class Downsample8_CU8 : public SimpleStreamInOut<CU8, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 		std::vector<uint32_t> buffer;
 
 		DS_UINT16 DS1, DS2, DS3;
@@ -454,7 +760,7 @@ namespace DSP
 
 	class Downsample8_CS8 : public SimpleStreamInOut<CS8, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 		std::vector<uint32_t> buffer;
 
 		DS_UINT16 DS1, DS2, DS3;
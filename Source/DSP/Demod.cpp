@@ -21,22 +21,41 @@
 
 #include "Demod.h"
 #include "DSP.h"
+#include "Kernels.h"
 
 namespace Demod {
 
 	void FM::Receive(const CFLOAT32* data, int len, TAG& tag) {
 		if (output.size() < len) output.resize(len);
 
-		for (int i = 0; i < len; i++) {
-			auto p = data[i] * std::conj(prev);
-			output[i] = atan2f(p.imag(), p.real()) / PI;
-			prev = data[i];
+		if (fast && len > 0) {
+			DSP::Kernels::fastFM(data, prev, output.data(), len);
+			prev = data[len - 1];
+		}
+		else {
+			for (int i = 0; i < len; i++) {
+				auto p = data[i] * std::conj(prev);
+				output[i] = atan2f(p.imag(), p.real()) / PI;
+				prev = data[i];
+			}
 		}
 
 		Send(output.data(), len, tag);
 	}
 
+	PhaseSearchEMA::PhaseSearchEMA() {
+		for (int j = 0; j < nPhases / 2; j++) {
+			coef_re[j] = coef_re[nPhases - 1 - j] = phase[j].real();
+			coef_im[j] = phase[j].imag();
+			coef_im[nPhases - 1 - j] = -phase[j].imag();
+		}
+	}
+
 	void PhaseSearchEMA::Receive(const CFLOAT32* data, int len, TAG& tag) {
+		if (output.size() < len) output.resize(len);
+
+		const DSP::Kernels::PhaseEMAFunc phaseEMA = DSP::Kernels::get().phaseEMA;
+
 		for (int i = 0; i < len; i++) {
 			FLOAT32 re = 0, im = 0;
 
@@ -63,21 +82,8 @@ namespace Demod {
 			rot = (rot + 1) & 3;
 
 			// Determining the phase is approached as a linear classification problem.
-			for (int j = 0; j < nPhases / 2; j++) {
-				FLOAT32 t, a = re * phase[j].real(), b = im * phase[j].imag();
-
-				t = a + b;
-				bits[j] = (bits[j] << 1) | (t > 0);
-				ma[j] = weight * ma[j] + (1 - weight) * std::abs(t);
-
-				t = a - b;
-				bits[nPhases - 1 - j] = (bits[nPhases - 1 - j] << 1) | (t > 0);
-				ma[nPhases - 1 - j] = weight * ma[nPhases - 1 - j] + (1 - weight) * std::abs(t);
-
-				// prevent error propagation of inf and nan in input
-				if (std::isinf(ma[j]) || std::isnan(ma[j])) ma[j] = 0;
-				if (std::isinf(ma[nPhases - 1 - j]) || std::isnan(ma[nPhases - 1 - j])) ma[nPhases - 1 - j] = 0;
-			}
+			bit_idx = (bit_idx + 1) & (nBits - 1);
+			bits[bit_idx] = phaseEMA(re, im, coef_re, coef_im, ma, weight, nPhases);
 
 			// we look at previous [max_idx - nSearch, max_idx + nSearch]
 			int idx = (max_idx - nSearch + nPhases) & (nPhases - 1);
@@ -95,16 +101,18 @@ namespace Demod {
 			}
 
 			// determine the bit
-			bool b2 = (bits[max_idx] >> (nDelay + 1)) & 1;
-			bool b1 = (bits[max_idx] >> nDelay) & 1;
-
-			FLOAT32 b = b1 ^ b2 ? 1.0f : -1.0f;
+			bool b2 = (bits[(bit_idx - nDelay - 1) & (nBits - 1)] >> max_idx) & 1;
+			bool b1 = (bits[(bit_idx - nDelay) & (nBits - 1)] >> max_idx) & 1;
 
-			Send(&b, 1, tag);
+			output[i] = b1 ^ b2 ? 1.0f : -1.0f;
 		}
+
+		Send(output.data(), len, tag);
 	}
 
 	void PhaseSearch::Receive(const CFLOAT32* data, int len, TAG& tag) {
+		if (output.size() < len) output.resize(len);
+
 		for (int i = 0; i < len; i++) {
 			FLOAT32 re = 0, im = 0;
 
@@ -167,9 +175,9 @@ namespace Demod {
 			bool b2 = (bits[max_idx] >> (nDelay + 1)) & 1;
 			bool b1 = (bits[max_idx] >> nDelay) & 1;
 
-			FLOAT32 b = b1 ^ b2 ? 1.0f : -1.0f;
-
-			Send(&b, 1, tag);
+			output[i] = b1 ^ b2 ? 1.0f : -1.0f;
 		}
+
+		Send(output.data(), len, tag);
 	}
 }
@@ -21,6 +21,7 @@
 
 #include "Filters.h"
 #include "Stream.h"
+#include "Aligned.h"
 
 namespace Demod {
 	// needs to be a power of two for the Fast version
@@ -31,11 +32,14 @@ namespace Demod {
 	};
 
 	class FM : public SimpleStreamInOut<CFLOAT32, FLOAT32> {
-		std::vector<FLOAT32> output;
+		Util::AlignedVector<FLOAT32> output;
 		CFLOAT32 prev = 0.0;
+		// polynomial atan2 from the DSP kernels instead of atan2f
+		bool fast = false;
 
 	public:
 		void Receive(const CFLOAT32* data, int len, TAG& tag);
+		void setFast(bool b) { fast = b; }
 	};
 
 	class PhaseSearch : public SimpleStreamInOut<CFLOAT32, FLOAT32> {
@@ -48,6 +52,8 @@ namespace Demod {
 		FLOAT32 memory[nPhases][maxHistory];
 		char bits[nPhases];
 
+		Util::AlignedVector<FLOAT32> output;
+
 		int max_idx = 0;
 		int rot = 0;
 		int last = 0;
@@ -72,16 +78,29 @@ namespace Demod {
 
 		FLOAT32 weight = 0.85f;
 
+		static const int nBits = 8;
+
+		// coefficients per phase, second half mirrored with negated imaginary part: all phases are one dot product
+		FLOAT32 coef_re[nPhases], coef_im[nPhases];
 		FLOAT32 ma[nPhases] = { 0 };
-		char bits[nPhases] = { 0 };
+
+		// bit k of bits[s] is the decision for phase k at symbol s (ring of nBits symbols)
+		unsigned bits[nBits] = { 0 };
+		int bit_idx = 0;
+
+		Util::AlignedVector<FLOAT32> output;
 
 		int max_idx = 0, rot = 0;
 
 	public:
+		PhaseSearchEMA();
 		virtual ~PhaseSearchEMA() {}
 
 		void Receive(const CFLOAT32* data, int len, TAG& tag);
-		void setParams(int d) { nDelay = d; }
+		void setParams(int d) {
+			assert(d + 1 < nBits);
+			nDelay = d;
+		}
 		void setWeight(FLOAT32 w) { weight = w; }
 	};
 }
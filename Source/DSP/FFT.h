@@ -60,42 +60,80 @@ namespace FFT {
 	}
 
 
-	// Radix-2 FFT, standard algorithm with inner loops reversed and twiddle factors pre-computed
+	// Precomputed FFT of a fixed size N (a power of two). Twiddle factors and the bit reversal
+	// permutation are computed once in the constructor. Input is expected in bit reversed order:
+	// element i goes to position index(i). Stages are radix-4 (25% fewer multiplications than
+	// radix-2 and half the passes over the data), with one radix-2 stage first if log2(N) is odd.
+	// A plan is not shared between threads, each user keeps its own.
 	template <typename T>
-	void fft(std::vector<std::complex<T>>& x) {
-		std::complex<T> t;
+	class Plan {
+		int N = 0, logN = 0;
 
-		static std::vector<std::complex<T>> Omega;
-		static int N = 0, logN;
+		std::vector<int> reversed;
+		// per radix-4 stage of quarter size m: W^j, W^2j, W^3j for j < m with W = exp(-2 pi i / 4m)
+		std::vector<std::complex<T>> twiddles;
 
-		if (N != x.size()) {
-			N = (int)x.size();
+	public:
+		Plan() {}
+		Plan(int n) { setSize(n); }
+
+		void setSize(int n) {
+			N = n;
 			logN = log2(N);
-			calcOmega(Omega, N);
-		}
 
-		int m = 2, m2 = 1;
-		int w, r = N;
+			reversed.resize(N);
+			for (int i = 0; i < N; i++)
+				reversed[i] = rev(i, logN);
 
-		for (int s = 0; s < logN; s++) {
-			w = 0;
-			r >>= 1;
+			twiddles.clear();
+			for (int m = (logN & 1) ? 2 : 1; m < N; m <<= 2)
+				for (int j = 0; j < m; j++)
+					for (int q = 1; q <= 3; q++)
+						twiddles.push_back(std::polar(T(1), T(-2.0 * PI * q * j / (4.0 * m))));
+		}
 
-			for (int j = 0; j < m2; j++) {
-				const std::complex<T>& o = Omega[w];
+		int size() const { return N; }
+		int index(int i) const { return reversed[i]; }
 
-				for (int k = 0; k < N; k += m) {
-					t = o * x[k + j + m2];
+		void execute(std::vector<std::complex<T>>& x) const { execute(x.data()); }
 
-					x[k + j + m2] = x[k + j] - t;
-					x[k + j] += t;
-				}
+		void execute(std::complex<T>* x) const {
+			int m = 1;
 
-				w += r;
+			if (logN & 1) {
+				for (int k = 0; k < N; k += 2) {
+					std::complex<T> t = x[k + 1];
+					x[k + 1] = x[k] - t;
+					x[k] += t;
+				}
+				m = 2;
 			}
 
-			m2 = m;
-			m <<= 1;
+			const std::complex<T>* w = twiddles.data();
+
+			// combine four DFTs of size m into one of size 4m, in bit reversed order the second and third quarter
+			// hold the odd-even and even-odd subsequences
+			for (; m < N; w += 3 * m, m <<= 2) {
+				for (int k = 0; k < N; k += 4 * m) {
+					std::complex<T>* a = x + k;
+
+					for (int j = 0; j < m; j++) {
+						std::complex<T> s0 = a[j], s2 = a[j + m] * w[3 * j + 1];
+						std::complex<T> s1 = a[j + 2 * m] * w[3 * j], s3 = a[j + 3 * m] * w[3 * j + 2];
+
+						std::complex<T> e0 = s0 + s2, e1 = s0 - s2;
+						std::complex<T> o0 = s1 + s3, o1 = s1 - s3;
+
+						// o1 * -i
+						std::complex<T> r1(o1.imag(), -o1.real());
+
+						a[j] = e0 + o0;
+						a[j + m] = e1 + r1;
+						a[j + 2 * m] = e0 - o0;
+						a[j + 3 * m] = e1 - r1;
+					}
+				}
+			}
 		}
-	}
+	};
 }
@@ -63,4 +63,46 @@ namespace Filters {
 		-8.11999274e-03f, -1.92265407e-03f, 1.12710642e-03f, 1.60068516e-03f,
 		9.52682178e-04f, 2.98382002e-04f, 2.54561241e-05f
 	};
+
+	// block FIR for the symmetric tap sets above with the length known at compile time,
+	// out[i] = sum_k taps[k] * x[i + k] with the mirrored samples added before the multiply
+	template <typename T>
+	struct Symmetric
+	{
+		typedef void (*Func)(const FLOAT32 *taps, const T *x, T *out, int n);
+
+		template <int N>
+		static void run(const FLOAT32 *taps, const T *x, T *out, int n)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				T s = (N & 1) ? taps[N / 2] * x[i + N / 2] : T(0);
+
+				for (int k = 0; k < N / 2; k++)
+					s += taps[k] * (x[i + k] + x[i + N - 1 - k]);
+
+				out[i] = s;
+			}
+		}
+
+		// nullptr if the taps are not symmetric or have no specialization
+		static Func select(const std::vector<FLOAT32> &t)
+		{
+			const int n = (int)t.size();
+
+			for (int i = 0; i < n / 2; i++)
+				if (t[i] != t[n - 1 - i])
+					return nullptr;
+
+			switch (n)
+			{
+			case 17:
+				return run<17>;
+			case 37:
+				return run<37>;
+			default:
+				return nullptr;
+			}
+		}
+	};
 }
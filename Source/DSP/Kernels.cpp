@@ -0,0 +1,938 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+
+#include "Kernels.h"
+#include "Convert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_X86
+#define TARGET_SSE __attribute__((target("sse,sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define KERNELS_X86
+#define TARGET_SSE
+#define TARGET_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace DSP
+{
+	namespace Kernels
+	{
+		// ----------------------------------------------------------------------------
+		// Scalar reference versions
+
+		static CFLOAT32 dotComplexScalar(const FLOAT32 *taps2, const CFLOAT32 *data, int n)
+		{
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			FLOAT32 re = 0.0f, im = 0.0f;
+
+			for (int i = 0; i < 2 * n; i += 2)
+			{
+				re += taps2[i] * d[i];
+				im += taps2[i + 1] * d[i + 1];
+			}
+			return CFLOAT32(re, im);
+		}
+
+		static FLOAT32 dotRealScalar(const FLOAT32 *taps, const FLOAT32 *data, int n)
+		{
+			FLOAT32 x = 0.0f;
+			for (int i = 0; i < n; i++)
+				x += taps[i] * data[i];
+			return x;
+		}
+
+		// atan on [0, 1], minimax polynomial in z^2
+		static const float ATAN_C1 = 0.99997726f, ATAN_C3 = -0.33262347f, ATAN_C5 = 0.19354346f;
+		static const float ATAN_C7 = -0.11643287f, ATAN_C9 = 0.05265332f, ATAN_C11 = -0.01172120f;
+
+		// arg(re + j im) / PI via atan on the octant, 0 for re = im = 0
+		static inline FLOAT32 fastArg(FLOAT32 re, FLOAT32 im)
+		{
+			FLOAT32 ax = std::fabs(re), ay = std::fabs(im);
+			FLOAT32 mx = ax > ay ? ax : ay, mn = ax > ay ? ay : ax;
+			FLOAT32 z = mx > 0 ? mn / mx : 0.0f, z2 = z * z;
+
+			FLOAT32 r = z * (ATAN_C1 + z2 * (ATAN_C3 + z2 * (ATAN_C5 + z2 * (ATAN_C7 + z2 * (ATAN_C9 + z2 * ATAN_C11)))));
+			if (ay > ax)
+				r = (FLOAT32)(PI / 2) - r;
+			if (re < 0)
+				r = (FLOAT32)PI - r;
+			if (im < 0)
+				r = -r;
+
+			return r * (FLOAT32)(1.0 / PI);
+		}
+
+		static void fastFMScalar(const CFLOAT32 *data, CFLOAT32 prev, FLOAT32 *out, int n)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				CFLOAT32 p = data[i] * std::conj(prev);
+				out[i] = fastArg(p.real(), p.imag());
+				prev = data[i];
+			}
+		}
+
+		static unsigned phaseEMAScalar(FLOAT32 re, FLOAT32 im, const FLOAT32 *cr, const FLOAT32 *ci, FLOAT32 *ma, FLOAT32 weight, int n)
+		{
+			const FLOAT32 w1 = 1 - weight;
+			unsigned mask = 0;
+
+			for (int k = 0; k < n; k++)
+			{
+				FLOAT32 t = re * cr[k] + im * ci[k];
+				FLOAT32 m = weight * ma[k] + w1 * std::abs(t);
+
+				mask |= (unsigned)(t > 0) << k;
+				ma[k] = std::isinf(m) || std::isnan(m) ? 0 : m;
+			}
+			return mask;
+		}
+
+		static void splitRotateScalar(const CFLOAT32 *data, const FLOAT32 *tr, const FLOAT32 *ti, CFLOAT32 rot, CFLOAT32 *up, CFLOAT32 *down, int n)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				FLOAT32 pr = rot.real() * tr[i] - rot.imag() * ti[i];
+				FLOAT32 pi = rot.real() * ti[i] + rot.imag() * tr[i];
+
+				FLOAT32 RR = data[i].real() * pr, II = data[i].imag() * pi;
+				FLOAT32 RI = data[i].real() * pi, IR = data[i].imag() * pr;
+
+				up[i] = CFLOAT32(RR - II, IR + RI);
+				down[i] = CFLOAT32(RR + II, IR - RI);
+			}
+		}
+
+		static inline uint32_t maskPacked(int shift)
+		{
+			uint32_t mask = 0xFFFFU >> shift;
+			return mask | (mask << 16);
+		}
+
+		static void cic5PackedScalar(const uint32_t *in, uint32_t *out, int n, int shift)
+		{
+			const uint32_t mask = maskPacked(shift);
+
+			for (int j = 0; j < n; j++)
+			{
+				const uint32_t *x = in + 2 * j;
+				uint32_t z = x[0] + x[-5] + 5 * (x[-1] + x[-4]) + 10 * (x[-2] + x[-3]);
+				out[j] = (z >> shift) & mask;
+			}
+		}
+
+		static inline int16_t scale12(uint32_t x) { return (int16_t)(((int)x - 2048) * 16); }
+		static inline int16_t negate16(int16_t x) { return x == INT16_MIN ? INT16_MAX : (int16_t)-x; }
+
+		static void unpack12FS4Scalar(const uint32_t *in, CS16 *out, int n)
+		{
+			for (int i = 0; i + 8 <= n; i += 8, in += 3, out += 8)
+			{
+				out[0] = CS16(scale12(in[0] >> 20), 0);
+				out[1] = CS16(0, scale12((in[0] >> 8) & 0xfff));
+				out[2] = CS16(negate16(scale12(((in[0] & 0xff) << 4) | (in[1] >> 28))), 0);
+				out[3] = CS16(0, negate16(scale12((in[1] >> 16) & 0xfff)));
+				out[4] = CS16(scale12((in[1] >> 4) & 0xfff), 0);
+				out[5] = CS16(0, scale12(((in[1] & 0xf) << 8) | (in[2] >> 24)));
+				out[6] = CS16(negate16(scale12((in[2] >> 12) & 0xfff)), 0);
+				out[7] = CS16(0, negate16(scale12(in[2] & 0xfff)));
+			}
+		}
+
+		static const Table tableScalar = {ISA::SCALAR, "SCALAR", dotComplexScalar, dotRealScalar, fastFMScalar, phaseEMAScalar, splitRotateScalar, cic5PackedScalar, unpack12FS4Scalar};
+
+#ifdef KERNELS_X86
+		// ----------------------------------------------------------------------------
+		// SSE: 2 complex or 4 real samples per iteration
+
+		TARGET_SSE static CFLOAT32 dotComplexSSE(const FLOAT32 *taps2, const CFLOAT32 *data, int n)
+		{
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			__m128 acc = _mm_setzero_ps();
+			int i = 0, len = 2 * n;
+
+			for (; i + 4 <= len; i += 4)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(taps2 + i), _mm_loadu_ps(d + i)));
+
+			// acc = [re im re im]
+			float r[4];
+			_mm_storeu_ps(r, acc);
+			FLOAT32 re = r[0] + r[2], im = r[1] + r[3];
+
+			for (; i < len; i += 2)
+			{
+				re += taps2[i] * d[i];
+				im += taps2[i + 1] * d[i + 1];
+			}
+			return CFLOAT32(re, im);
+		}
+
+		TARGET_SSE static FLOAT32 dotRealSSE(const FLOAT32 *taps, const FLOAT32 *data, int n)
+		{
+			__m128 acc = _mm_setzero_ps();
+			int i = 0;
+
+			for (; i + 4 <= n; i += 4)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(taps + i), _mm_loadu_ps(data + i)));
+
+			float r[4];
+			_mm_storeu_ps(r, acc);
+			FLOAT32 x = (r[0] + r[1]) + (r[2] + r[3]);
+
+			for (; i < n; i++)
+				x += taps[i] * data[i];
+			return x;
+		}
+
+		// same steps as fastArg on 4 lanes, selections by masks
+		TARGET_SSE static inline __m128 fastArgSSE(__m128 re, __m128 im)
+		{
+			const __m128 sign = _mm_set1_ps(-0.0f);
+
+			__m128 ax = _mm_andnot_ps(sign, re), ay = _mm_andnot_ps(sign, im);
+			__m128 mx = _mm_max_ps(ax, ay), mn = _mm_min_ps(ax, ay);
+			__m128 z = _mm_and_ps(_mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, _mm_setzero_ps()));
+			__m128 z2 = _mm_mul_ps(z, z);
+
+			__m128 r = _mm_add_ps(_mm_set1_ps(ATAN_C9), _mm_mul_ps(z2, _mm_set1_ps(ATAN_C11)));
+			r = _mm_add_ps(_mm_set1_ps(ATAN_C7), _mm_mul_ps(z2, r));
+			r = _mm_add_ps(_mm_set1_ps(ATAN_C5), _mm_mul_ps(z2, r));
+			r = _mm_add_ps(_mm_set1_ps(ATAN_C3), _mm_mul_ps(z2, r));
+			r = _mm_add_ps(_mm_set1_ps(ATAN_C1), _mm_mul_ps(z2, r));
+			r = _mm_mul_ps(z, r);
+
+			__m128 m = _mm_cmpgt_ps(ay, ax);
+			r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps((float)(PI / 2)), r)), _mm_andnot_ps(m, r));
+			m = _mm_cmplt_ps(re, _mm_setzero_ps());
+			r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps((float)PI), r)), _mm_andnot_ps(m, r));
+			r = _mm_xor_ps(r, _mm_and_ps(sign, _mm_cmplt_ps(im, _mm_setzero_ps())));
+
+			return _mm_mul_ps(r, _mm_set1_ps((float)(1.0 / PI)));
+		}
+
+		TARGET_SSE static void fastFMSSE(const CFLOAT32 *data, CFLOAT32 prev, FLOAT32 *out, int n)
+		{
+			if (n <= 0)
+				return;
+
+			CFLOAT32 p = data[0] * std::conj(prev);
+			out[0] = fastArg(p.real(), p.imag());
+
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			int i = 1;
+
+			for (; i + 4 <= n; i += 4)
+			{
+				// samples i..i+3 and i-1..i+2, split into real and imaginary parts
+				__m128 a0 = _mm_loadu_ps(d + 2 * i), a1 = _mm_loadu_ps(d + 2 * i + 4);
+				__m128 b0 = _mm_loadu_ps(d + 2 * i - 2), b1 = _mm_loadu_ps(d + 2 * i + 2);
+
+				__m128 ar = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), ai = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+				__m128 br = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)), bi = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m128 re = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+				__m128 im = _mm_sub_ps(_mm_mul_ps(ai, br), _mm_mul_ps(ar, bi));
+
+				_mm_storeu_ps(out + i, fastArgSSE(re, im));
+			}
+
+			for (; i < n; i++)
+			{
+				p = data[i] * std::conj(data[i - 1]);
+				out[i] = fastArg(p.real(), p.imag());
+			}
+		}
+
+		TARGET_SSE static unsigned phaseEMASSE(FLOAT32 re, FLOAT32 im, const FLOAT32 *cr, const FLOAT32 *ci, FLOAT32 *ma, FLOAT32 weight, int n)
+		{
+			const __m128 sign = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+			const __m128 vre = _mm_set1_ps(re), vim = _mm_set1_ps(im);
+			const __m128 w = _mm_set1_ps(weight), w1 = _mm_set1_ps(1 - weight);
+
+			unsigned mask = 0;
+			int k = 0;
+
+			for (; k + 4 <= n; k += 4)
+			{
+				__m128 t = _mm_add_ps(_mm_mul_ps(vre, _mm_loadu_ps(cr + k)), _mm_mul_ps(vim, _mm_loadu_ps(ci + k)));
+				__m128 m = _mm_add_ps(_mm_mul_ps(w, _mm_loadu_ps(ma + k)), _mm_mul_ps(w1, _mm_andnot_ps(sign, t)));
+
+				mask |= (unsigned)_mm_movemask_ps(_mm_cmpgt_ps(t, zero)) << k;
+				// m - m is only zero for finite values
+				_mm_storeu_ps(ma + k, _mm_and_ps(m, _mm_cmpeq_ps(_mm_sub_ps(m, m), zero)));
+			}
+
+			if (k < n)
+				mask |= phaseEMAScalar(re, im, cr + k, ci + k, ma + k, weight, n - k) << k;
+
+			return mask;
+		}
+
+		TARGET_SSE static void splitRotateSSE(const CFLOAT32 *data, const FLOAT32 *tr, const FLOAT32 *ti, CFLOAT32 rot, CFLOAT32 *up, CFLOAT32 *down, int n)
+		{
+			const __m128 rr = _mm_set1_ps(rot.real()), ri = _mm_set1_ps(rot.imag());
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			FLOAT32 *u = (FLOAT32 *)up, *w = (FLOAT32 *)down;
+			int i = 0;
+
+			for (; i + 4 <= n; i += 4)
+			{
+				__m128 t_r = _mm_loadu_ps(tr + i), t_i = _mm_loadu_ps(ti + i);
+				__m128 pr = _mm_sub_ps(_mm_mul_ps(rr, t_r), _mm_mul_ps(ri, t_i));
+				__m128 pi = _mm_add_ps(_mm_mul_ps(rr, t_i), _mm_mul_ps(ri, t_r));
+
+				__m128 a0 = _mm_loadu_ps(d + 2 * i), a1 = _mm_loadu_ps(d + 2 * i + 4);
+				__m128 dr = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), di = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m128 RR = _mm_mul_ps(dr, pr), II = _mm_mul_ps(di, pi);
+				__m128 RI = _mm_mul_ps(dr, pi), IR = _mm_mul_ps(di, pr);
+
+				__m128 re = _mm_sub_ps(RR, II), im = _mm_add_ps(IR, RI);
+				_mm_storeu_ps(u + 2 * i, _mm_unpacklo_ps(re, im));
+				_mm_storeu_ps(u + 2 * i + 4, _mm_unpackhi_ps(re, im));
+
+				re = _mm_add_ps(RR, II), im = _mm_sub_ps(IR, RI);
+				_mm_storeu_ps(w + 2 * i, _mm_unpacklo_ps(re, im));
+				_mm_storeu_ps(w + 2 * i + 4, _mm_unpackhi_ps(re, im));
+			}
+
+			splitRotateScalar(data + i, tr + i, ti + i, rot, up + i, down + i, n - i);
+		}
+
+		// the filter on all lanes of x[k..k+3], the even lanes are the outputs
+		TARGET_SSE static inline __m128i cic5SSE(const uint32_t *x)
+		{
+			__m128i a = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(x - 1)), _mm_loadu_si128((const __m128i *)(x - 4)));
+			__m128i b = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(x - 2)), _mm_loadu_si128((const __m128i *)(x - 3)));
+			__m128i z = _mm_add_epi32(_mm_loadu_si128((const __m128i *)x), _mm_loadu_si128((const __m128i *)(x - 5)));
+
+			// 5a + 10b = 5 (a + 2b)
+			a = _mm_add_epi32(a, _mm_slli_epi32(b, 1));
+			return _mm_add_epi32(z, _mm_add_epi32(a, _mm_slli_epi32(a, 2)));
+		}
+
+		TARGET_SSE static void cic5PackedSSE(const uint32_t *in, uint32_t *out, int n, int shift)
+		{
+			const __m128i mask = _mm_set1_epi32((int)maskPacked(shift)), count = _mm_cvtsi32_si128(shift);
+			int j = 0;
+
+			for (; j + 4 <= n; j += 4)
+			{
+				const uint32_t *x = in + 2 * j;
+				__m128 lo = _mm_castsi128_ps(cic5SSE(x)), hi = _mm_castsi128_ps(cic5SSE(x + 4));
+				__m128i z = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+
+				_mm_storeu_si128((__m128i *)(out + j), _mm_and_si128(_mm_srl_epi32(z, count), mask));
+			}
+
+			cic5PackedScalar(in + 2 * j, out + j, n - j, shift);
+		}
+
+		// the byte shuffle needs SSSE3, so SSE uses the scalar unpack
+		static const Table tableSSE = {ISA::SSE, "SSE", dotComplexSSE, dotRealSSE, fastFMSSE, phaseEMASSE, splitRotateSSE, cic5PackedSSE, unpack12FS4Scalar};
+
+		// ----------------------------------------------------------------------------
+		// AVX2 + FMA: 4 complex or 8 real samples per iteration
+
+		TARGET_AVX2 static CFLOAT32 dotComplexAVX2(const FLOAT32 *taps2, const CFLOAT32 *data, int n)
+		{
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			__m256 acc = _mm256_setzero_ps();
+			int i = 0, len = 2 * n;
+
+			for (; i + 8 <= len; i += 8)
+				acc = _mm256_fmadd_ps(_mm256_loadu_ps(taps2 + i), _mm256_loadu_ps(d + i), acc);
+
+			__m128 h = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+			float r[4];
+			_mm_storeu_ps(r, h);
+			FLOAT32 re = r[0] + r[2], im = r[1] + r[3];
+
+			for (; i < len; i += 2)
+			{
+				re += taps2[i] * d[i];
+				im += taps2[i + 1] * d[i + 1];
+			}
+			return CFLOAT32(re, im);
+		}
+
+		TARGET_AVX2 static FLOAT32 dotRealAVX2(const FLOAT32 *taps, const FLOAT32 *data, int n)
+		{
+			__m256 acc = _mm256_setzero_ps();
+			int i = 0;
+
+			for (; i + 8 <= n; i += 8)
+				acc = _mm256_fmadd_ps(_mm256_loadu_ps(taps + i), _mm256_loadu_ps(data + i), acc);
+
+			__m128 h = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+			float r[4];
+			_mm_storeu_ps(r, h);
+			FLOAT32 x = (r[0] + r[1]) + (r[2] + r[3]);
+
+			for (; i < n; i++)
+				x += taps[i] * data[i];
+			return x;
+		}
+
+		TARGET_AVX2 static inline __m256 fastArgAVX2(__m256 re, __m256 im)
+		{
+			const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+
+			__m256 ax = _mm256_andnot_ps(sign, re), ay = _mm256_andnot_ps(sign, im);
+			__m256 mx = _mm256_max_ps(ax, ay), mn = _mm256_min_ps(ax, ay);
+			__m256 z = _mm256_and_ps(_mm256_div_ps(mn, mx), _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+			__m256 z2 = _mm256_mul_ps(z, z);
+
+			__m256 r = _mm256_fmadd_ps(z2, _mm256_set1_ps(ATAN_C11), _mm256_set1_ps(ATAN_C9));
+			r = _mm256_fmadd_ps(z2, r, _mm256_set1_ps(ATAN_C7));
+			r = _mm256_fmadd_ps(z2, r, _mm256_set1_ps(ATAN_C5));
+			r = _mm256_fmadd_ps(z2, r, _mm256_set1_ps(ATAN_C3));
+			r = _mm256_fmadd_ps(z2, r, _mm256_set1_ps(ATAN_C1));
+			r = _mm256_mul_ps(z, r);
+
+			r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps((float)(PI / 2)), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+			r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps((float)PI), r), _mm256_cmp_ps(re, zero, _CMP_LT_OQ));
+			r = _mm256_xor_ps(r, _mm256_and_ps(sign, _mm256_cmp_ps(im, zero, _CMP_LT_OQ)));
+
+			return _mm256_mul_ps(r, _mm256_set1_ps((float)(1.0 / PI)));
+		}
+
+		TARGET_AVX2 static void fastFMAVX2(const CFLOAT32 *data, CFLOAT32 prev, FLOAT32 *out, int n)
+		{
+			if (n <= 0)
+				return;
+
+			CFLOAT32 p = data[0] * std::conj(prev);
+			out[0] = fastArg(p.real(), p.imag());
+
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			int i = 1;
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256 a0 = _mm256_loadu_ps(d + 2 * i), a1 = _mm256_loadu_ps(d + 2 * i + 8);
+				__m256 b0 = _mm256_loadu_ps(d + 2 * i - 2), b1 = _mm256_loadu_ps(d + 2 * i + 6);
+
+				// shuffles work per 128-bit lane, the samples come out as 0 1 4 5 2 3 6 7
+				__m256 ar = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), ai = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+				__m256 br = _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)), bi = _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m256 re = _mm256_fmadd_ps(ar, br, _mm256_mul_ps(ai, bi));
+				__m256 im = _mm256_fmsub_ps(ai, br, _mm256_mul_ps(ar, bi));
+
+				__m256 r = fastArgAVX2(re, im);
+				r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+
+				_mm256_storeu_ps(out + i, r);
+			}
+
+			for (; i < n; i++)
+			{
+				p = data[i] * std::conj(data[i - 1]);
+				out[i] = fastArg(p.real(), p.imag());
+			}
+		}
+
+		TARGET_AVX2 static unsigned phaseEMAAVX2(FLOAT32 re, FLOAT32 im, const FLOAT32 *cr, const FLOAT32 *ci, FLOAT32 *ma, FLOAT32 weight, int n)
+		{
+			const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+			const __m256 vre = _mm256_set1_ps(re), vim = _mm256_set1_ps(im);
+			const __m256 w = _mm256_set1_ps(weight), w1 = _mm256_set1_ps(1 - weight);
+
+			unsigned mask = 0;
+			int k = 0;
+
+			for (; k + 8 <= n; k += 8)
+			{
+				__m256 t = _mm256_add_ps(_mm256_mul_ps(vre, _mm256_loadu_ps(cr + k)), _mm256_mul_ps(vim, _mm256_loadu_ps(ci + k)));
+				__m256 m = _mm256_add_ps(_mm256_mul_ps(w, _mm256_loadu_ps(ma + k)), _mm256_mul_ps(w1, _mm256_andnot_ps(sign, t)));
+
+				mask |= (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ)) << k;
+				_mm256_storeu_ps(ma + k, _mm256_and_ps(m, _mm256_cmp_ps(_mm256_sub_ps(m, m), zero, _CMP_EQ_OQ)));
+			}
+
+			if (k < n)
+				mask |= phaseEMAScalar(re, im, cr + k, ci + k, ma + k, weight, n - k) << k;
+
+			return mask;
+		}
+
+		TARGET_AVX2 static void splitRotateAVX2(const CFLOAT32 *data, const FLOAT32 *tr, const FLOAT32 *ti, CFLOAT32 rot, CFLOAT32 *up, CFLOAT32 *down, int n)
+		{
+			const __m256 rr = _mm256_set1_ps(rot.real()), ri = _mm256_set1_ps(rot.imag());
+			// the in-lane deinterleave below gives the sample order 0 1 4 5 2 3 6 7, the table is permuted to match
+			const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			FLOAT32 *u = (FLOAT32 *)up, *w = (FLOAT32 *)down;
+			int i = 0;
+
+			for (; i + 8 <= n; i += 8)
+			{
+				__m256 t_r = _mm256_permutevar8x32_ps(_mm256_loadu_ps(tr + i), order);
+				__m256 t_i = _mm256_permutevar8x32_ps(_mm256_loadu_ps(ti + i), order);
+				__m256 pr = _mm256_sub_ps(_mm256_mul_ps(rr, t_r), _mm256_mul_ps(ri, t_i));
+				__m256 pi = _mm256_add_ps(_mm256_mul_ps(rr, t_i), _mm256_mul_ps(ri, t_r));
+
+				__m256 a0 = _mm256_loadu_ps(d + 2 * i), a1 = _mm256_loadu_ps(d + 2 * i + 8);
+				__m256 dr = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), di = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m256 RR = _mm256_mul_ps(dr, pr), II = _mm256_mul_ps(di, pi);
+				__m256 RI = _mm256_mul_ps(dr, pi), IR = _mm256_mul_ps(di, pr);
+
+				// unpack within lanes restores the original order
+				__m256 re = _mm256_sub_ps(RR, II), im = _mm256_add_ps(IR, RI);
+				_mm256_storeu_ps(u + 2 * i, _mm256_unpacklo_ps(re, im));
+				_mm256_storeu_ps(u + 2 * i + 8, _mm256_unpackhi_ps(re, im));
+
+				re = _mm256_add_ps(RR, II), im = _mm256_sub_ps(IR, RI);
+				_mm256_storeu_ps(w + 2 * i, _mm256_unpacklo_ps(re, im));
+				_mm256_storeu_ps(w + 2 * i + 8, _mm256_unpackhi_ps(re, im));
+			}
+
+			splitRotateScalar(data + i, tr + i, ti + i, rot, up + i, down + i, n - i);
+		}
+
+		TARGET_AVX2 static inline __m256i cic5AVX2(const uint32_t *x)
+		{
+			__m256i a = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(x - 1)), _mm256_loadu_si256((const __m256i *)(x - 4)));
+			__m256i b = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(x - 2)), _mm256_loadu_si256((const __m256i *)(x - 3)));
+			__m256i z = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)x), _mm256_loadu_si256((const __m256i *)(x - 5)));
+
+			a = _mm256_add_epi32(a, _mm256_slli_epi32(b, 1));
+			return _mm256_add_epi32(z, _mm256_add_epi32(a, _mm256_slli_epi32(a, 2)));
+		}
+
+		TARGET_AVX2 static void cic5PackedAVX2(const uint32_t *in, uint32_t *out, int n, int shift)
+		{
+			const __m256i mask = _mm256_set1_epi32((int)maskPacked(shift));
+			const __m128i count = _mm_cvtsi32_si128(shift);
+			int j = 0;
+
+			for (; j + 8 <= n; j += 8)
+			{
+				const uint32_t *x = in + 2 * j;
+				__m256 lo = _mm256_castsi256_ps(cic5AVX2(x)), hi = _mm256_castsi256_ps(cic5AVX2(x + 8));
+
+				// even lanes per 128-bit half, then the 64-bit pairs back in order
+				__m256 e = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+				__m256i z = _mm256_castpd_si256(_mm256_permute4x64_pd(_mm256_castps_pd(e), _MM_SHUFFLE(3, 1, 2, 0)));
+
+				_mm256_storeu_si256((__m256i *)(out + j), _mm256_and_si256(_mm256_srl_epi32(z, count), mask));
+			}
+
+			cic5PackedScalar(in + 2 * j, out + j, n - j, shift);
+		}
+
+		// two groups of 12 bytes per iteration, one per 128-bit lane. The shuffle puts the bytes of sample k
+		// in word k: the even samples are the upper 12 bits of their word, the odd ones the lower 12 bits.
+		TARGET_AVX2 static void unpack12FS4AVX2(const uint32_t *in, CS16 *out, int n)
+		{
+			const __m256i bytes = _mm256_setr_epi8(2, 3, 1, 2, 7, 0, 6, 7, 4, 5, 11, 4, 9, 10, 8, 9, 2, 3, 1, 2, 7, 0, 6, 7, 4, 5, 11, 4, 9, 10, 8, 9);
+			const __m256i low = _mm256_set1_epi16(0x0fff), offset = _mm256_set1_epi16(2048), zero = _mm256_setzero_si256();
+			// x0 0 0 x1 per pair of samples, -1 clears the byte
+			const __m256i iq_lo = _mm256_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, 4, 5, -1, -1, -1, -1, 6, 7, 0, 1, -1, -1, -1, -1, 2, 3, 4, 5, -1, -1, -1, -1, 6, 7);
+			const __m256i iq_hi = _mm256_setr_epi8(8, 9, -1, -1, -1, -1, 10, 11, 12, 13, -1, -1, -1, -1, 14, 15, 8, 9, -1, -1, -1, -1, 10, 11, 12, 13, -1, -1, -1, -1, 14, 15);
+
+			const uint8_t *p = (const uint8_t *)in;
+			const int groups = n / 8;
+			int g = 0;
+
+			// each lane loads 16 bytes for its 12, the last groups are left to the scalar version
+			for (; g + 2 < groups; g += 2)
+			{
+				__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + 12 * g))), _mm_loadu_si128((const __m128i *)(p + 12 * g + 12)), 1);
+				v = _mm256_shuffle_epi8(v, bytes);
+				v = _mm256_blend_epi16(_mm256_srli_epi16(v, 4), _mm256_and_si256(v, low), 0xAA);
+				v = _mm256_slli_epi16(_mm256_sub_epi16(v, offset), 4);
+				v = _mm256_blend_epi16(v, _mm256_subs_epi16(zero, v), 0xCC);
+
+				__m256i lo = _mm256_shuffle_epi8(v, iq_lo), hi = _mm256_shuffle_epi8(v, iq_hi);
+				_mm256_storeu_si256((__m256i *)(out + 8 * g), _mm256_permute2x128_si256(lo, hi, 0x20));
+				_mm256_storeu_si256((__m256i *)(out + 8 * g + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+			}
+
+			unpack12FS4Scalar(in + 3 * g, out + 8 * g, n - 8 * g);
+		}
+
+		static const Table tableAVX2 = {ISA::AVX2, "AVX2", dotComplexAVX2, dotRealAVX2, fastFMAVX2, phaseEMAAVX2, splitRotateAVX2, cic5PackedAVX2, unpack12FS4AVX2};
+
+		static bool hasSSE()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			return (info[3] & (1 << 25)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse");
+#endif
+		}
+
+		static bool hasAVX2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+
+			__cpuid(info, 1);
+			bool fma = (info[2] & (1 << 12)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+				return false;
+
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}
+#endif
+
+#ifdef KERNELS_NEON
+		// ----------------------------------------------------------------------------
+		// NEON: 2 complex or 4 real samples per iteration
+
+		static CFLOAT32 dotComplexNEON(const FLOAT32 *taps2, const CFLOAT32 *data, int n)
+		{
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			float32x4_t acc = vdupq_n_f32(0.0f);
+			int i = 0, len = 2 * n;
+
+			for (; i + 4 <= len; i += 4)
+				acc = vmlaq_f32(acc, vld1q_f32(taps2 + i), vld1q_f32(d + i));
+
+			// acc = [re im re im]
+			float32x2_t h = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+			FLOAT32 re = vget_lane_f32(h, 0), im = vget_lane_f32(h, 1);
+
+			for (; i < len; i += 2)
+			{
+				re += taps2[i] * d[i];
+				im += taps2[i + 1] * d[i + 1];
+			}
+			return CFLOAT32(re, im);
+		}
+
+		static FLOAT32 dotRealNEON(const FLOAT32 *taps, const FLOAT32 *data, int n)
+		{
+			float32x4_t acc = vdupq_n_f32(0.0f);
+			int i = 0;
+
+			for (; i + 4 <= n; i += 4)
+				acc = vmlaq_f32(acc, vld1q_f32(taps + i), vld1q_f32(data + i));
+
+			float32x2_t h = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+			FLOAT32 x = vget_lane_f32(h, 0) + vget_lane_f32(h, 1);
+
+			for (; i < n; i++)
+				x += taps[i] * data[i];
+			return x;
+		}
+
+		static inline float32x4_t fastArgNEON(float32x4_t re, float32x4_t im)
+		{
+			const float32x4_t zero = vdupq_n_f32(0.0f);
+
+			float32x4_t ax = vabsq_f32(re), ay = vabsq_f32(im);
+			float32x4_t mx = vmaxq_f32(ax, ay), mn = vminq_f32(ax, ay);
+
+			// division by reciprocal estimate and two Newton steps, also available on ARMv7
+			float32x4_t inv = vrecpeq_f32(mx);
+			inv = vmulq_f32(vrecpsq_f32(mx, inv), inv);
+			inv = vmulq_f32(vrecpsq_f32(mx, inv), inv);
+
+			uint32x4_t valid = vcgtq_f32(mx, zero);
+			float32x4_t z = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_f32(mn, inv)), valid));
+			float32x4_t z2 = vmulq_f32(z, z);
+
+			float32x4_t r = vmlaq_f32(vdupq_n_f32(ATAN_C9), z2, vdupq_n_f32(ATAN_C11));
+			r = vmlaq_f32(vdupq_n_f32(ATAN_C7), z2, r);
+			r = vmlaq_f32(vdupq_n_f32(ATAN_C5), z2, r);
+			r = vmlaq_f32(vdupq_n_f32(ATAN_C3), z2, r);
+			r = vmlaq_f32(vdupq_n_f32(ATAN_C1), z2, r);
+			r = vmulq_f32(z, r);
+
+			r = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32((float)(PI / 2)), r), r);
+			r = vbslq_f32(vcltq_f32(re, zero), vsubq_f32(vdupq_n_f32((float)PI), r), r);
+			r = vbslq_f32(vcltq_f32(im, zero), vnegq_f32(r), r);
+
+			return vmulq_f32(r, vdupq_n_f32((float)(1.0 / PI)));
+		}
+
+		static void fastFMNEON(const CFLOAT32 *data, CFLOAT32 prev, FLOAT32 *out, int n)
+		{
+			if (n <= 0)
+				return;
+
+			CFLOAT32 p = data[0] * std::conj(prev);
+			out[0] = fastArg(p.real(), p.imag());
+
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			int i = 1;
+
+			for (; i + 4 <= n; i += 4)
+			{
+				float32x4x2_t a = vld2q_f32(d + 2 * i), b = vld2q_f32(d + 2 * i - 2);
+
+				float32x4_t re = vmlaq_f32(vmulq_f32(a.val[0], b.val[0]), a.val[1], b.val[1]);
+				float32x4_t im = vmlsq_f32(vmulq_f32(a.val[1], b.val[0]), a.val[0], b.val[1]);
+
+				vst1q_f32(out + i, fastArgNEON(re, im));
+			}
+
+			for (; i < n; i++)
+			{
+				p = data[i] * std::conj(data[i - 1]);
+				out[i] = fastArg(p.real(), p.imag());
+			}
+		}
+
+		static unsigned phaseEMANEON(FLOAT32 re, FLOAT32 im, const FLOAT32 *cr, const FLOAT32 *ci, FLOAT32 *ma, FLOAT32 weight, int n)
+		{
+			const float32x4_t zero = vdupq_n_f32(0.0f);
+			const float32x4_t vre = vdupq_n_f32(re), vim = vdupq_n_f32(im);
+			const float32x4_t w = vdupq_n_f32(weight), w1 = vdupq_n_f32(1 - weight);
+			const uint32_t lanes[4] = {1, 2, 4, 8};
+			const uint32x4_t lane_bits = vld1q_u32(lanes);
+
+			unsigned mask = 0;
+			int k = 0;
+
+			for (; k + 4 <= n; k += 4)
+			{
+				float32x4_t t = vaddq_f32(vmulq_f32(vre, vld1q_f32(cr + k)), vmulq_f32(vim, vld1q_f32(ci + k)));
+				float32x4_t m = vaddq_f32(vmulq_f32(w, vld1q_f32(ma + k)), vmulq_f32(w1, vabsq_f32(t)));
+
+				// movemask by pairwise adds, also available on ARMv7
+				uint32x4_t b = vandq_u32(vcgtq_f32(t, zero), lane_bits);
+				uint32x2_t h = vpadd_u32(vget_low_u32(b), vget_high_u32(b));
+				mask |= (unsigned)vget_lane_u32(vpadd_u32(h, h), 0) << k;
+
+				uint32x4_t finite = vceqq_f32(vsubq_f32(m, m), zero);
+				vst1q_f32(ma + k, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(m), finite)));
+			}
+
+			if (k < n)
+				mask |= phaseEMAScalar(re, im, cr + k, ci + k, ma + k, weight, n - k) << k;
+
+			return mask;
+		}
+
+		static void splitRotateNEON(const CFLOAT32 *data, const FLOAT32 *tr, const FLOAT32 *ti, CFLOAT32 rot, CFLOAT32 *up, CFLOAT32 *down, int n)
+		{
+			const float32x4_t rr = vdupq_n_f32(rot.real()), ri = vdupq_n_f32(rot.imag());
+			const FLOAT32 *d = (const FLOAT32 *)data;
+			FLOAT32 *u = (FLOAT32 *)up, *w = (FLOAT32 *)down;
+			int i = 0;
+
+			for (; i + 4 <= n; i += 4)
+			{
+				float32x4_t t_r = vld1q_f32(tr + i), t_i = vld1q_f32(ti + i);
+				float32x4_t pr = vmlsq_f32(vmulq_f32(rr, t_r), ri, t_i);
+				float32x4_t pi = vmlaq_f32(vmulq_f32(rr, t_i), ri, t_r);
+
+				float32x4x2_t a = vld2q_f32(d + 2 * i), r;
+
+				float32x4_t RR = vmulq_f32(a.val[0], pr), II = vmulq_f32(a.val[1], pi);
+				float32x4_t RI = vmulq_f32(a.val[0], pi), IR = vmulq_f32(a.val[1], pr);
+
+				r.val[0] = vsubq_f32(RR, II);
+				r.val[1] = vaddq_f32(IR, RI);
+				vst2q_f32(u + 2 * i, r);
+
+				r.val[0] = vaddq_f32(RR, II);
+				r.val[1] = vsubq_f32(IR, RI);
+				vst2q_f32(w + 2 * i, r);
+			}
+
+			splitRotateScalar(data + i, tr + i, ti + i, rot, up + i, down + i, n - i);
+		}
+
+		static void cic5PackedNEON(const uint32_t *in, uint32_t *out, int n, int shift)
+		{
+			const uint32x4_t mask = vdupq_n_u32(maskPacked(shift));
+			const int32x4_t count = vdupq_n_s32(-shift);
+			int j = 0;
+
+			// vld2q splits even and odd lanes, the even ones of x - k are x[2i - k]
+			for (; j + 4 <= n; j += 4)
+			{
+				const uint32_t *x = in + 2 * j;
+				uint32x4_t a = vaddq_u32(vld2q_u32(x - 1).val[0], vld2q_u32(x - 4).val[0]);
+				uint32x4_t b = vaddq_u32(vld2q_u32(x - 2).val[0], vld2q_u32(x - 3).val[0]);
+				uint32x4_t z = vaddq_u32(vld2q_u32(x).val[0], vld2q_u32(x - 5).val[0]);
+
+				z = vmlaq_n_u32(z, a, 5);
+				z = vmlaq_n_u32(z, b, 10);
+
+				vst1q_u32(out + j, vandq_u32(vshlq_u32(z, count), mask));
+			}
+
+			cic5PackedScalar(in + 2 * j, out + j, n - j, shift);
+		}
+
+		// same steps as the AVX2 version with one group of 12 bytes per iteration, vtbl2 gives 0 for index 255
+		static void unpack12FS4NEON(const uint32_t *in, CS16 *out, int n)
+		{
+			static const uint8_t bytes[16] = {2, 3, 1, 2, 7, 0, 6, 7, 4, 5, 11, 4, 9, 10, 8, 9};
+			static const uint8_t iq[4][8] = {{0, 1, 255, 255, 255, 255, 2, 3}, {4, 5, 255, 255, 255, 255, 6, 7}, {8, 9, 255, 255, 255, 255, 10, 11}, {12, 13, 255, 255, 255, 255, 14, 15}};
+			static const uint16_t odd[8] = {0, 0xffff, 0, 0xffff, 0, 0xffff, 0, 0xffff};
+			static const uint16_t neg[8] = {0, 0, 0xffff, 0xffff, 0, 0, 0xffff, 0xffff};
+
+			const uint8x8_t b0 = vld1_u8(bytes), b1 = vld1_u8(bytes + 8);
+			const uint16x8_t odd_mask = vld1q_u16(odd), neg_mask = vld1q_u16(neg);
+
+			const uint8_t *p = (const uint8_t *)in;
+			const int groups = n / 8;
+			int g = 0;
+
+			for (; g + 1 < groups; g++)
+			{
+				uint8x16_t x = vld1q_u8(p + 12 * g);
+				uint8x8x2_t t = {{vget_low_u8(x), vget_high_u8(x)}};
+
+				uint16x8_t v = vreinterpretq_u16_u8(vcombine_u8(vtbl2_u8(t, b0), vtbl2_u8(t, b1)));
+				v = vbslq_u16(odd_mask, vandq_u16(v, vdupq_n_u16(0x0fff)), vshrq_n_u16(v, 4));
+
+				int16x8_t s = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(v), vdupq_n_s16(2048)), 4);
+				s = vbslq_s16(neg_mask, vqnegq_s16(s), s);
+
+				uint8x16_t y = vreinterpretq_u8_s16(s);
+				uint8x8x2_t u = {{vget_low_u8(y), vget_high_u8(y)}};
+				uint8_t *o = (uint8_t *)(out + 8 * g);
+
+				for (int k = 0; k < 4; k++)
+					vst1_u8(o + 8 * k, vtbl2_u8(u, vld1_u8(iq[k])));
+			}
+
+			unpack12FS4Scalar(in + 3 * g, out + 8 * g, n - 8 * g);
+		}
+
+		static const Table tableNEON = {ISA::NEON, "NEON", dotComplexNEON, dotRealNEON, fastFMNEON, phaseEMANEON, splitRotateNEON, cic5PackedNEON, unpack12FS4NEON};
+#endif
+
+		// ----------------------------------------------------------------------------
+		// Dispatch
+
+		const Table *active = &tableScalar;
+
+		static const Table *getTable(ISA isa)
+		{
+			switch (isa)
+			{
+#ifdef KERNELS_X86
+			case ISA::SSE:
+				return &tableSSE;
+			case ISA::AVX2:
+				return &tableAVX2;
+#endif
+#ifdef KERNELS_NEON
+			case ISA::NEON:
+				return &tableNEON;
+#endif
+			case ISA::SCALAR:
+				return &tableScalar;
+			default:
+				return nullptr;
+			}
+		}
+
+		bool isSupported(ISA isa)
+		{
+			switch (isa)
+			{
+			case ISA::SCALAR:
+				return true;
+#ifdef KERNELS_X86
+			case ISA::SSE:
+				return hasSSE();
+			case ISA::AVX2:
+				return hasAVX2();
+#endif
+#ifdef KERNELS_NEON
+			case ISA::NEON:
+				return true;
+#endif
+			default:
+				return false;
+			}
+		}
+
+		ISA detect()
+		{
+			if (isSupported(ISA::AVX2))
+				return ISA::AVX2;
+			if (isSupported(ISA::NEON))
+				return ISA::NEON;
+			if (isSupported(ISA::SSE))
+				return ISA::SSE;
+
+			return ISA::SCALAR;
+		}
+
+		bool select(ISA isa)
+		{
+			const Table *t = getTable(isa);
+
+			if (!t || !isSupported(isa))
+				return false;
+
+			active = t;
+			return true;
+		}
+
+		bool select(std::string name)
+		{
+			Util::Convert::toUpper(name);
+
+			if (name == "AUTO")
+				return select(detect());
+			if (name == "SCALAR" || name == "OFF")
+				return select(ISA::SCALAR);
+			if (name == "SSE")
+				return select(ISA::SSE);
+			if (name == "AVX2")
+				return select(ISA::AVX2);
+			if (name == "NEON")
+				return select(ISA::NEON);
+
+			return false;
+		}
+
+		static struct AutoSelect
+		{
+			AutoSelect() { select(detect()); }
+		} autoselect;
+	}
+}
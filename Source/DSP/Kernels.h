@@ -0,0 +1,100 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+
+// Inner loops of the DSP chain with vectorized variants (SSE, AVX2, NEON).
+// The variant is selected once at startup based on the CPU features, the
+// scalar version is always available as fallback.
+
+namespace DSP
+{
+	namespace Kernels
+	{
+		enum class ISA
+		{
+			SCALAR,
+			SSE,
+			AVX2,
+			NEON
+		};
+
+		// real taps against complex data, taps are stored duplicated: t0 t0 t1 t1 ...
+		typedef CFLOAT32 (*DotComplexFunc)(const FLOAT32 *taps2, const CFLOAT32 *data, int n);
+		typedef FLOAT32 (*DotRealFunc)(const FLOAT32 *taps, const FLOAT32 *data, int n);
+		// FM discriminator arg(data[i] * conj(data[i - 1])) / PI with a polynomial atan2, data[-1] is prev.
+		// The absolute error is below 1e-6 (after scaling by 1 / PI).
+		typedef void (*FastFMFunc)(const CFLOAT32 *data, CFLOAT32 prev, FLOAT32 *out, int n);
+		// one symbol for all n (<= 32) phases: t[k] = re * cr[k] + im * ci[k], ma[k] is the EMA of |t[k]|
+		// (reset to 0 if not finite) and bit k of the result is t[k] > 0
+		typedef unsigned (*PhaseEMAFunc)(FLOAT32 re, FLOAT32 im, const FLOAT32 *cr, const FLOAT32 *ci, FLOAT32 *ma, FLOAT32 weight, int n);
+		// up[i] = data[i] * p[i] and down[i] = data[i] * conj(p[i]) with phasor p[i] = rot * (tr[i] + j ti[i])
+		typedef void (*SplitRotateFunc)(const CFLOAT32 *data, const FLOAT32 *tr, const FLOAT32 *ti, CFLOAT32 rot, CFLOAT32 *up, CFLOAT32 *down, int n);
+		// CIC5 decimation by 2 of I/Q packed as two 16-bit lanes, in uint32 arithmetic like DS_UINT16:
+		// out[j] = ((x[0] + 5 x[-1] + 10 x[-2] + 10 x[-3] + 5 x[-4] + x[-5]) >> shift) & mask with x = in + 2j,
+		// so in[-5..-1] must hold the history. out may not overlap in.
+		typedef void (*CIC5PackedFunc)(const uint32_t *in, uint32_t *out, int n, int shift);
+		// n (a multiple of 8) real 12-bit offset binary samples packed 8 per 3 words as in libairspy, to I/Q
+		// shifted by fs/4: x0, j x1, -x2, -j x3, ... scaled to 16 bits. -32768 negates to 32767.
+		typedef void (*Unpack12FS4Func)(const uint32_t *in, CS16 *out, int n);
+
+		struct Table
+		{
+			ISA isa;
+			const char *name;
+			DotComplexFunc dotComplex;
+			DotRealFunc dotReal;
+			FastFMFunc fastFM;
+			PhaseEMAFunc phaseEMA;
+			SplitRotateFunc splitRotate;
+			CIC5PackedFunc cic5Packed;
+			Unpack12FS4Func unpack12FS4;
+		};
+
+		extern const Table *active;
+
+		bool isSupported(ISA isa);
+		bool select(ISA isa);
+		bool select(std::string name);
+		ISA detect();
+
+		inline const Table &get() { return *active; }
+		inline std::string getName() { return active->name; }
+
+		inline CFLOAT32 dotComplex(const FLOAT32 *taps2, const CFLOAT32 *data, int n) { return active->dotComplex(taps2, data, n); }
+		inline FLOAT32 dotReal(const FLOAT32 *taps, const FLOAT32 *data, int n) { return active->dotReal(taps, data, n); }
+		inline void fastFM(const CFLOAT32 *data, CFLOAT32 prev, FLOAT32 *out, int n) { active->fastFM(data, prev, out, n); }
+		inline unsigned phaseEMA(FLOAT32 re, FLOAT32 im, const FLOAT32 *cr, const FLOAT32 *ci, FLOAT32 *ma, FLOAT32 weight, int n) { return active->phaseEMA(re, im, cr, ci, ma, weight, n); }
+		inline void splitRotate(const CFLOAT32 *data, const FLOAT32 *tr, const FLOAT32 *ti, CFLOAT32 rot, CFLOAT32 *up, CFLOAT32 *down, int n) { active->splitRotate(data, tr, ti, rot, up, down, n); }
+		inline void cic5Packed(const uint32_t *in, uint32_t *out, int n, int shift) { active->cic5Packed(in, out, n, shift); }
+		inline void unpack12FS4(const uint32_t *in, CS16 *out, int n) { active->unpack12FS4(in, out, n); }
+
+		// layout expected by dotComplex
+		inline void duplicateTaps(const std::vector<FLOAT32> &taps, std::vector<FLOAT32> &taps2)
+		{
+			taps2.resize(taps.size() * 2);
+			for (int i = 0; i < taps.size(); i++)
+				taps2[2 * i] = taps2[2 * i + 1] = taps[i];
+		}
+	}
+}
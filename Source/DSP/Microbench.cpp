@@ -0,0 +1,574 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "AIS-catcher.h"
+#include "Microbench.h"
+#include "DSP.h"
+#include "Demod.h"
+#include "Filters.h"
+#include "Kernels.h"
+#include "AIS.h"
+#include "JSONAIS.h"
+#include "JSON/Parser.h"
+#include "Convert.h"
+#include "Logger.h"
+
+namespace DSP
+{
+	template <typename T>
+	class Sink : public StreamIn<T>
+	{
+	public:
+		long count = 0;
+		void Receive(const T *data, int len, TAG &tag) { count += len; }
+	};
+
+	// a stage result: time per item, an item is a sample, a message or a call depending on the stage
+	struct Result
+	{
+		std::string stage, input, unit;
+		int block;
+		uint64_t items;
+		double seconds;
+	};
+
+	// calls f(i) for the i-th block until ms milliseconds have passed
+	template <typename F>
+	static double measure(F f, int ms, long &calls)
+	{
+		using namespace std::chrono;
+
+		steady_clock::time_point start = steady_clock::now();
+		double elapsed;
+		calls = 0;
+
+		do
+		{
+			for (int i = 0; i < 16; i++)
+				f(calls++);
+			elapsed = duration<double>(steady_clock::now() - start).count();
+		} while (elapsed * 1000 < ms);
+
+		return elapsed;
+	}
+
+	// IQ in blocks of the given size taken in turn from the input, which is a whole number of blocks
+	template <typename S>
+	static Result runIQ(const std::string &name, const std::string &input, S &stage, const std::vector<CFLOAT32> &iq, int block, int ms)
+	{
+		TAG tag;
+		long calls;
+		int nblocks = (int)(iq.size() / block);
+
+		double t = measure([&](long i)
+						   { stage.Receive(iq.data() + (i % nblocks) * block, block, tag); },
+						   ms, calls);
+
+		return {name, input, "sample", block, (uint64_t)calls * block, t};
+	}
+
+	// the HDLC frame of a message as a decoder sees it after the demodulator: one soft bit per
+	// symbol, training sequence, flags, bit stuffing, the FCS and NRZI
+	static void appendFrame(const AIS::Message &msg, std::vector<FLOAT32> &out)
+	{
+		std::vector<int> bits;
+		int n = msg.getLength() / 8;
+		uint16_t crc = 0xFFFF;
+
+		for (int i = 0; i < n; i++)
+			for (int k = 0; k < 8; k++)
+			{
+				int b = (msg.getData()[i] >> k) & 1;
+				crc = (b ^ crc) & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+				bits.push_back(b);
+			}
+
+		crc = ~crc;
+		for (int k = 0; k < 16; k++)
+			bits.push_back((crc >> k) & 1);
+
+		std::vector<int> frame;
+		for (int i = 0; i < 24; i++)
+			frame.push_back(i & 1);
+
+		const int flag[8] = {0, 1, 1, 1, 1, 1, 1, 0};
+		frame.insert(frame.end(), flag, flag + 8);
+
+		int ones = 0;
+		for (int b : bits)
+		{
+			frame.push_back(b);
+			ones = b ? ones + 1 : 0;
+			if (ones == 5)
+			{
+				frame.push_back(0);
+				ones = 0;
+			}
+		}
+
+		frame.insert(frame.end(), flag, flag + 8);
+		frame.insert(frame.end(), 24, 0);
+
+		// NRZI: a zero is a transition
+		bool level = out.empty() || out.back() > 0;
+		for (int b : frame)
+		{
+			if (!b)
+				level = !level;
+			out.push_back(level ? 1.0f : -1.0f);
+		}
+	}
+
+	// checks of the optimized code paths against plain reference code on random input
+	struct Check
+	{
+		std::string name;
+		bool ok;
+	};
+
+	static uint32_t random32(uint32_t &seed)
+	{
+		seed = seed * 1664525 + 1013904223;
+		return seed ^ (seed >> 16);
+	}
+
+	// DS_UINT16 on every supported kernel, in blocks that do and do not line up with its tiles, against
+	// the CIC5 as FIR on the whole stream
+	static bool checkCIC5Packed()
+	{
+		const int LEN = 3 * 2048 + 1000;
+		const int shift = 5;
+		const uint32_t mask = (0xFFFFU >> shift) | ((0xFFFFU >> shift) << 16);
+
+		uint32_t seed = 1;
+		std::vector<uint32_t> in(LEN + 5, 0);
+		for (int i = 5; i < LEN + 5; i++)
+			in[i] = (random32(seed) & 0x7FF) | ((random32(seed) & 0x7FF) << 16);
+
+		std::vector<uint32_t> ref(LEN / 2);
+		for (int j = 0; j < LEN / 2; j++)
+		{
+			const uint32_t *x = in.data() + 5 + 2 * j;
+			ref[j] = ((x[0] + 5 * x[-1] + 10 * x[-2] + 10 * x[-3] + 5 * x[-4] + x[-5]) >> shift) & mask;
+		}
+
+		const Kernels::Table *active = Kernels::active;
+		const Kernels::ISA isas[] = {Kernels::ISA::SCALAR, Kernels::ISA::SSE, Kernels::ISA::AVX2, Kernels::ISA::NEON};
+		const int blocks[] = {32, 2048, 3000, LEN};
+		bool ok = true;
+
+		for (Kernels::ISA isa : isas)
+		{
+			if (!Kernels::select(isa))
+				continue;
+
+			for (int block : blocks)
+			{
+				DS_UINT16 ds;
+				std::vector<uint32_t> out;
+
+				for (int i = 0; i < LEN; i += block)
+				{
+					int m = MIN(block, LEN - i);
+					std::vector<uint32_t> data(in.begin() + 5 + i, in.begin() + 5 + i + m);
+					out.insert(out.end(), data.begin(), data.begin() + ds.Run(data.data(), m, shift));
+				}
+
+				if (out != ref)
+				{
+					Error() << "Microbench: cic5Packed (" << Kernels::getName() << ", block " << block << ") differs from the reference.";
+					ok = false;
+				}
+			}
+		}
+
+		Kernels::active = active;
+		return ok;
+	}
+
+	// getUint, getInt and getText against reading bit by bit
+	static bool checkMessageFields()
+	{
+		uint8_t data[MAX_AIS_BYTES];
+		uint32_t seed = 2;
+		for (int i = 0; i < MAX_AIS_BYTES; i++)
+			data[i] = (uint8_t)(random32(seed) >> 8);
+
+		AIS::Message msg;
+		msg.setData(data, MAX_AIS_LENGTH);
+
+		auto bits = [&](int start, int len)
+		{
+			unsigned u = 0;
+			for (int i = start; i < start + len; i++)
+				u = (u << 1) | (i < MAX_AIS_LENGTH ? (data[i >> 3] >> (7 - (i & 7))) & 1 : 0);
+			return u;
+		};
+
+		std::string text, ref;
+
+		for (int k = 0; k < 100000; k++)
+		{
+			int len = 1 + random32(seed) % 32;
+			int start = random32(seed) % (MAX_AIS_LENGTH - len + 1);
+			unsigned u = bits(start, len);
+			int i = (int)(len < 32 && (u >> (len - 1)) ? u | (~0U << len) : u);
+
+			if (msg.getUint(start, len) != u || msg.getInt(start, len) != i)
+			{
+				Error() << "Microbench: Message::getUint/getInt(" << start << ", " << len << ") differs from the reference.";
+				return false;
+			}
+
+			// 0 ends the string, 1 - 31 map to 65 and up, a trailing partial character is read in full
+			len = 1 + random32(seed) % 120;
+			start = random32(seed) % (MAX_AIS_LENGTH - len);
+			ref.clear();
+			for (int s = start; s < start + len; s += 6)
+			{
+				int c = s + 6 <= MAX_AIS_LENGTH ? bits(s, 6) : 0;
+				if (!c)
+					break;
+				ref += (char)(c & 32 ? c : c | 64);
+			}
+
+			msg.getText(start, len, text);
+			if (text != ref)
+			{
+				Error() << "Microbench: Message::getText(" << start << ", " << len << ") differs from the reference.";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// buildNMEA of messages of every length that fits in whole letters: each line has a valid checksum
+	// and the payloads read back with appendLetters give the original bits
+	static bool checkNMEA()
+	{
+		uint8_t data[MAX_AIS_BYTES];
+		uint32_t seed = 3;
+		TAG tag;
+
+		for (int length = 1; length <= MAX_AIS_LENGTH / 6 * 6; length++)
+		{
+			for (int i = 0; i < MAX_AIS_BYTES; i++)
+				data[i] = (uint8_t)(random32(seed) >> 8);
+
+			AIS::Message msg, back;
+			msg.setData(data, length);
+			msg.setChannel('A');
+			msg.buildNMEA(tag);
+
+			back.clear();
+			bool ok = true;
+
+			for (const std::string &line : msg.NMEA)
+			{
+				std::size_t star = line.find('*');
+				std::vector<std::size_t> comma;
+				for (std::size_t i = 0; i < star && star != std::string::npos; i++)
+					if (line[i] == ',')
+						comma.push_back(i);
+
+				if (line.compare(0, 6, "!AIVDM") != 0 || star == std::string::npos || star + 3 > line.size() || comma.size() != 6)
+				{
+					ok = false;
+					break;
+				}
+
+				int c = 0;
+				for (std::size_t i = 1; i < star; i++)
+					c ^= line[i];
+
+				ok &= std::strtol(line.substr(star + 1, 2).c_str(), nullptr, 16) == c;
+
+				back.appendLetters(line.data() + comma[4] + 1, (int)(comma[5] - comma[4] - 1));
+				if (&line == &msg.NMEA.back())
+					back.reduceLength(line[comma[5] + 1] - '0');
+			}
+
+			for (int i = 0; ok && i < length; i += 8)
+				ok = back.getLength() == length && back.getUint(i, MIN(8, length - i)) == msg.getUint(i, MIN(8, length - i));
+
+			if (!ok)
+			{
+				Error() << "Microbench: buildNMEA of a " << length << " bit message does not read back.";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// the parser names the offending token, as before the single-pass parser
+	static bool checkParserErrors()
+	{
+		const char *inputs[][2] = {{"{\"class\":tru}", "illegal identifier : \"tru\""}, {"{\"class\":nul,\"x\":1}", "illegal identifier : \"nul\""}, {"{\"class\":@}", "illegal character '@'"}};
+		JSON::Parser parser(&AIS::KeyMap, JSON_DICT_FULL);
+
+		for (auto &input : inputs)
+		{
+			std::string error;
+			try
+			{
+				parser.parse(input[0]);
+			}
+			catch (const std::exception &e)
+			{
+				error = e.what();
+			}
+
+			if (error.find(input[1]) == std::string::npos)
+			{
+				Error() << "Microbench: parsing " << input[0] << " gives \"" << error << "\", expected " << input[1] << ".";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static void appendResult(std::string &json, const Result &r)
+	{
+		using Util::Convert;
+
+		json += json.back() == '[' ? "\n" : ",\n";
+		json += "{\"stage\":\"" + r.stage + "\",\"input\":\"" + r.input + "\",\"unit\":\"" + r.unit + "\",\"block\":";
+		Convert::appendInt(json, r.block);
+		json += ",\"items\":";
+		Convert::appendUInt(json, r.items);
+		json += ",\"ns_per_item\":";
+		Convert::appendFixed(json, r.items ? r.seconds * 1e9 / r.items : 0, 3);
+		json += '}';
+
+		Info() << "Microbench: " << r.stage << " (" << r.input << ", block " << r.block << ") " << (r.items ? r.seconds * 1e9 / r.items : 0) << " ns/" << r.unit;
+	}
+
+	std::string Microbench::run(int ms, const std::string &file, int &failed)
+	{
+		const int N = 16384;
+		std::vector<Result> results;
+
+		std::vector<Check> checks = {{"cic5Packed", checkCIC5Packed()}, {"Message fields", checkMessageFields()}, {"buildNMEA", checkNMEA()}, {"JSON parser errors", checkParserErrors()}};
+
+		// IQ input, a recording or noise with a tone
+		std::vector<CFLOAT32> iq;
+		std::string input = "synthetic";
+
+		if (!file.empty())
+		{
+			std::ifstream in(file, std::ios::in | std::ios::binary);
+			if (!in)
+				throw std::runtime_error("Microbench: cannot open \"" + file + "\".");
+
+			std::vector<uint8_t> raw(N * 2 * 64);
+			in.read((char *)raw.data(), raw.size());
+			std::size_t n = (std::size_t)in.gcount() / 2 / N * N;
+
+			if (n == 0)
+				throw std::runtime_error("Microbench: \"" + file + "\" holds less than one block of CU8 samples.");
+
+			for (std::size_t i = 0; i < n; i++)
+				iq.push_back(CFLOAT32(raw[2 * i] - 127.5f, raw[2 * i + 1] - 127.5f) / 128.0f);
+
+			input = "recorded";
+		}
+		else
+		{
+			uint32_t seed = 12345;
+			for (int i = 0; i < N * 16; i++)
+			{
+				seed = seed * 1664525 + 1013904223;
+				FLOAT32 noise_i = (int)(seed >> 24) / 256.0f - 0.5f;
+				seed = seed * 1664525 + 1013904223;
+				FLOAT32 noise_q = (int)(seed >> 24) / 256.0f - 0.5f;
+				iq.push_back(CFLOAT32(0.3f * std::cos(i * 0.01f) + 0.1f * noise_i, 0.3f * std::sin(i * 0.01f) + 0.1f * noise_q));
+			}
+		}
+
+		// front-end at 1536K, blocks of N
+		{
+			Downsample2CIC5 stage;
+			Sink<CFLOAT32> sink;
+			stage >> sink;
+			results.push_back(runIQ("Downsample2CIC5", input, stage, iq, N, ms));
+		}
+		{
+			DownsampleKFilter stage;
+			Sink<CFLOAT32> sink;
+			stage.setParams(Filters::BlackmanHarris_28_3, 3);
+			stage >> sink;
+			results.push_back(runIQ("DownsampleKFilter", input, stage, iq, N, ms));
+		}
+
+		// the stages at 96K and 48K see the block after a downsampling of 16 and 32
+		{
+			Rotate stage;
+			Sink<CFLOAT32> up, down;
+			stage.setRotation((float)(PI * 25000.0 / 48000.0));
+			stage.up >> up;
+			stage.down >> down;
+			results.push_back(runIQ("Rotate", input, stage, iq, N / 16, ms));
+		}
+		{
+			FilterComplex stage;
+			Sink<CFLOAT32> sink;
+			stage.setTaps(Filters::Receiver);
+			stage >> sink;
+			results.push_back(runIQ("FilterComplex", input, stage, iq, N / 32, ms));
+		}
+		{
+			SquareFreqOffsetCorrection stage;
+			Sink<CFLOAT32> sink;
+			stage.setParams(512, 187);
+			stage >> sink;
+			results.push_back(runIQ("SquareFreqOffsetCorrection", input, stage, iq, N / 32, ms));
+		}
+		{
+			Demod::FM stage;
+			Sink<FLOAT32> sink;
+			stage >> sink;
+			results.push_back(runIQ("FM", input, stage, iq, N / 32, ms));
+
+			Demod::FM fast;
+			fast.setFast(true);
+			fast >> sink;
+			results.push_back(runIQ("FM fast", input, fast, iq, N / 32, ms));
+		}
+		{
+			Demod::PhaseSearchEMA stage;
+			Sink<FLOAT32> sink;
+			stage >> sink;
+			results.push_back(runIQ("PhaseSearchEMA", input, stage, iq, N / 32, ms));
+		}
+
+		// messages: positions, base station, static and voyage, class B position and static
+		const struct
+		{
+			const char *payload;
+			int fill;
+		} payloads[] = {
+			{"15MgK45P3@G?fl0E`JbR0OwT0@MS", 0},
+			{"177KQJ5000G?tO`K>RA1wUbN0TKH", 0},
+			{"403OviQuMGCqWrRO9>E6fE700@GO", 0},
+			{"55?MbV02;H;s<HtKR20EHE:0@T4@Dn2222222216L961O5Gf0NSQEp6ClRp888888888880", 2},
+			{"B52K>;h00Fc>jpUlNV@ikwpUoP06", 0},
+			{"H42O55i18tMET00000000000000", 2},
+		};
+
+		std::vector<AIS::Message> messages;
+		for (auto &p : payloads)
+		{
+			AIS::Message msg;
+			msg.clear();
+			msg.appendLetters(p.payload, (int)strlen(p.payload));
+			msg.reduceLength(p.fill);
+			msg.setChannel('A');
+			msg.Stamp();
+			messages.push_back(msg);
+		}
+
+		// decoder on the soft bits of the frames with noise between them
+		{
+			std::vector<FLOAT32> bits;
+			for (int r = 0; r < 8; r++)
+				for (auto &m : messages)
+				{
+					for (int i = 0; i < 37; i++)
+						bits.push_back((i * 7919) % 13 < 6 ? 1.0f : -1.0f);
+					appendFrame(m, bits);
+				}
+
+			const int block = N / 32;
+			bits.resize((bits.size() + block - 1) / block * block, 1.0f);
+
+			AIS::Decoder decoder;
+			Sink<AIS::Message> sink;
+			decoder >> sink;
+
+			TAG tag;
+			long calls;
+			int nblocks = (int)(bits.size() / block);
+
+			double t = measure([&](long i)
+							   { decoder.Receive(bits.data() + (i % nblocks) * block, block, tag); },
+							   ms, calls);
+
+			results.push_back({"AIS::Decoder", "synthetic", "sample", block, (uint64_t)calls * block, t});
+
+			if (sink.count == 0)
+				Warning() << "Microbench: the decoder did not decode the synthetic frames.";
+			else
+				results.push_back({"AIS::Decoder", "synthetic", "message", block, (uint64_t)sink.count, t});
+		}
+
+		// the fields of a position report as the JSON decoder reads them
+		{
+			const int fields[][2] = {{0, 6}, {6, 2}, {8, 30}, {38, 4}, {42, 8}, {50, 10}, {60, 1}, {61, 28}, {89, 27}, {116, 12}, {128, 9}, {137, 6}, {143, 2}, {148, 1}, {149, 19}};
+			const int nfields = sizeof(fields) / sizeof(fields[0]);
+
+			unsigned sum = 0;
+			long calls;
+			double t = measure([&](long i)
+							   {
+				const AIS::Message &m = messages[i % 2];
+				for (int f = 0; f < nfields; f++)
+					sum += m.getUint(fields[f][0], fields[f][1]); },
+							   ms, calls);
+
+			volatile unsigned keep = sum;
+			(void)keep;
+
+			results.push_back({"Message::getUint", "payloads", "call", 1, (uint64_t)calls * nfields, t});
+		}
+
+		{
+			AIS::JSONAIS jsonais;
+			TAG tag;
+			long calls;
+
+			double t = measure([&](long i)
+							   { jsonais.Decode(messages[i % messages.size()], tag); },
+							   ms, calls);
+
+			results.push_back({"JSONAIS::ProcessMsg", "payloads", "message", 1, (uint64_t)calls, t});
+		}
+
+		std::string json = "{\"version\":\"" + std::string(VERSION) + "\",\"simd\":\"" + Kernels::getName() + "\",\"threads\":" + std::to_string(std::thread::hardware_concurrency()) + ",\"ms\":" + std::to_string(ms) + ",\"checks\":[";
+
+		failed = 0;
+		for (auto &c : checks)
+		{
+			json += json.back() == '[' ? "\n" : ",\n";
+			json += "{\"check\":\"" + c.name + "\",\"ok\":" + (c.ok ? "true" : "false") + "}";
+			failed += !c.ok;
+		}
+
+		json += "\n],\"results\":[";
+		for (auto &r : results)
+			appendResult(json, r);
+		json += "\n]}\n";
+
+		return json;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+// Microbenchmarks of the building blocks of the decoding chain, each stage on its own at the block
+// size it sees in the models: the front-end and channel filters, the rotation, the FM and coherent
+// demodulators, the frequency correction, the AIS decoder, the field access of Message and the JSON
+// decoding. The IQ stages run on a CU8 recording if one is given, otherwise on noise with a tone.
+// The decoder runs on synthetic frames, the message stages on a fixed set of payloads. The results
+// are JSON so runs on different hosts and builds can be compared. Before the timings a few of the
+// optimized paths are checked against plain reference code, -Y fails if one of them differs.
+
+namespace DSP
+{
+	class Microbench
+	{
+	public:
+		// runs every stage for about ms milliseconds and returns the results as JSON, failed is the
+		// number of checks that did not pass
+		static std::string run(int ms, const std::string &file, int &failed);
+	};
+}
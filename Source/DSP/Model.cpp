@@ -16,6 +16,8 @@
 */
 
 #include <cassert>
+#include <iomanip>
+#include <sstream>
 
 #include "Model.h"
 #include "Parse.h"
@@ -24,15 +26,171 @@
 namespace AIS
 {
 	std::mutex MessageMutex::mtx;
+	MessageMerge *MessageMutex::merge = nullptr;
 	std::mutex MessageMutexADSB::mtx;
 
+	void DecoderDedup::Receive(const AIS::Message *data, int len, TAG &tag)
+	{
+		if (!on)
+		{
+			Send(data, len, tag);
+			return;
+		}
+
+		for (int i = 0; i < len; i++)
+		{
+			const AIS::Message &m = data[i];
+			uint64_t hash = m.getHash();
+
+			bool duplicate = false;
+
+			for (const Sent &s : sent)
+			{
+				if (s.hash == hash && overlap(m, s.start, s.end))
+				{
+					duplicate = true;
+					break;
+				}
+			}
+
+			for (auto &h : held)
+			{
+				if (!duplicate && h->hash == hash && overlap(m, h->msg.getStartIdx(), h->msg.getEndIdx()))
+				{
+					duplicate = true;
+
+					if (tag.level > h->tag.level)
+						h->set(m, tag, hash);
+				}
+			}
+
+			if (!duplicate)
+			{
+				held.push_back(pool.get());
+				held.back()->set(m, tag, hash);
+			}
+		}
+	}
+
+	void DecoderDedup::Flush()
+	{
+		for (auto &h : held)
+		{
+			sent[sent_ptr] = {h->hash, h->msg.getStartIdx(), h->msg.getEndIdx()};
+			sent_ptr = (sent_ptr + 1) % (int)sent.size();
+
+			Send(&h->msg, 1, h->tag);
+			pool.put(std::move(h));
+		}
+		held.clear();
+	}
+
+	bool ModelFrontend::shareFrontend(ModelFrontend &m)
+	{
+		// the servers hang off the front-end of the model that defines them
+		if (!share_frontend || !m.share_frontend || m.frontend_source || iq_server || rtltcp.getPort() || spectrum.isOn())
+			return false;
+
+		if (mode != m.mode || fixedpointDS != m.fixedpointDS || droop_compensation != m.droop_compensation || SOXR_DS != m.SOXR_DS ||
+			SAMPLERATE_DS != m.SAMPLERATE_DS || MA_DS != m.MA_DS || RS_DS != m.RS_DS || GPU_DS != m.GPU_DS || channelizer != m.channelizer || allowDSK != m.allowDSK)
+			return false;
+
+		frontend_source = &m;
+		m.frontend_followers.push_back(this);
+		return true;
+	}
+
 	void ModelFrontend::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
 	{
 		device = dev;
+		rate = sample_rate;
+
+		if (frontend_source)
+		{
+			if (!frontend_source->F_a || !frontend_source->F_b)
+				throw std::runtime_error("Model: internal error. Shared front-end not built.");
+
+			C_a = frontend_source->F_a;
+			C_b = frontend_source->F_b;
+		}
+		else
+		{
+			buildFrontend(sample_rate, timerOn);
+
+			F_a = C_a;
+			F_b = C_b;
+		}
+
+		if (mode == AIS::Mode::X)
+			return;
 
+		if (threaded)
+		{
+			async_a.setShared(shared);
+			async_b.setShared(shared);
+
+			*C_a >> async_a;
+			*C_b >> async_b;
+
+			C_a = &async_a.out;
+			C_b = &async_b.out;
+		}
+
+		if (timerOn)
+		{
+			*C_a >> timer_a;
+			*C_b >> timer_b;
+
+			C_a = &timer_a.out;
+			C_b = &timer_b.out;
+		}
+
+		if (profile)
+		{
+			probe_a.attach(name + " channel " + std::string(1, CH1));
+			probe_b.attach(name + " channel " + std::string(1, CH2));
+
+			*C_a >> probe_a;
+			*C_b >> probe_b;
+
+			C_a = &probe_a.out;
+			C_b = &probe_b.out;
+		}
+
+		// add wav-write to dump 48K channels
+		if (dump)
+		{
+			*C_a >> convertA >> wavA;
+			*C_b >> convertB >> wavB;
+		}
+
+		// the squelch goes last so that the timers and the dump see the full channel
+		if (squelch)
+		{
+			SQ_a.setMargins(squelch_pre, squelch_post);
+			SQ_b.setMargins(squelch_pre, squelch_post);
+
+			*C_a >> SQ_a;
+			*C_b >> SQ_b;
+
+			C_a = &SQ_a.out;
+			C_b = &SQ_b.out;
+		}
+
+		return;
+	}
+
+	void ModelFrontend::buildFrontend(int sample_rate, bool timerOn)
+	{
 		ROT.setRotation((float)(PI * 25000.0 / 48000.0));
 
-		Connection<RAW> &physical = timerOn ? (*device >> timer).out : device->out;
+		Connection<RAW> &physical = connectDevice(timerOn);
+
+		if (rtltcp.getPort())
+		{
+			rtltcp.open(device->getSampleRate(), device->getFrequency());
+			physical >> rtltcp;
+		}
 
 		if (mode == AIS::Mode::X)
 		{
@@ -40,6 +198,9 @@ namespace AIS
 			if (sample_rate < 12000 || sample_rate > 192000)
 				throw std::runtime_error("Model: sample rate must be between 12k and 192k (inclusive).");
 
+			if (iq_server)
+				throw std::runtime_error("Model: IQ_SERVER is not available in this mode.");
+
 			physical >> convert;
 
 			const std::vector<uint32_t> definedRates = {48000, 96000, 192000};
@@ -65,31 +226,35 @@ namespace AIS
 			{
 			case 192000:
 				FDC.setTaps(-1.1f);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_2 >> DS2_1 >> FCIC5_a;
+					convert >> DS2 >> FCIC5_a;
 				else
-					convert >> DS2_2 >> DS2_1 >> FDC >> FCIC5_a;
+					convert >> DS2 >> FDC >> FCIC5_a;
 				break;
 			case 192000 - 1:
 				FDC.setTaps(-1.1f);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> US >> DS2_2 >> DS2_1 >> FCIC5_a;
+					convert >> US >> DS2 >> FCIC5_a;
 				else
-					convert >> US >> DS2_2 >> DS2_1 >> FDC >> FCIC5_a;
+					convert >> US >> DS2 >> FDC >> FCIC5_a;
 				break;
 			case 96000:
 				FDC.setTaps(-0.8f);
+				DS2.setStages(1);
 				if (!droop_compensation)
-					convert >> DS2_1 >> FCIC5_a;
+					convert >> DS2 >> FCIC5_a;
 				else
-					convert >> DS2_1 >> FDC >> FCIC5_a;
+					convert >> DS2 >> FDC >> FCIC5_a;
 				break;
 			case 96000 - 1:
 				FDC.setTaps(-0.8f);
+				DS2.setStages(1);
 				if (!droop_compensation)
-					convert >> US >> DS2_1 >> FCIC5_a;
+					convert >> US >> DS2 >> FCIC5_a;
 				else
-					convert >> US >> DS2_1 >> FDC >> FCIC5_a;
+					convert >> US >> DS2 >> FDC >> FCIC5_a;
 				break;
 			case 48000:
 				convert >> FCIC5_a;
@@ -111,20 +276,70 @@ namespace AIS
 		if (sample_rate < 96000 || sample_rate > 12288000)
 			throw std::runtime_error("Model: sample rate must be between 96K and 12288K (inclusive).");
 
-		if (SOXR_DS)
+		if (GPU_DS && !gpu.open(sample_rate, 96000))
+			Warning() << "Model: no OpenCL device or sample rate not a multiple of 96K, front-end stays on the CPU.";
+
+		if (gpu.isOpen())
+		{
+			Info() << "Model: front-end on OpenCL device " << gpu.getDevice();
+			physical >> gpu >> IQ;
+		}
+		else if (SOXR_DS)
 		{
 			sox.setParams(sample_rate, 96000);
-			physical >> convert >> sox >> ROT;
+			physical >> convert >> sox >> IQ;
 		}
 		else if (SAMPLERATE_DS)
 		{
 			src.setParams(sample_rate, 96000);
-			physical >> convert >> src >> ROT;
+			physical >> convert >> src >> IQ;
 		}
 		else if (MA_DS)
 		{
 			DS_MA.setRates(sample_rate, 96000);
-			physical >> convert >> DS_MA >> ROT;
+			physical >> convert >> DS_MA >> IQ;
+		}
+		else if (RS_DS)
+		{
+			// halve the rate with the CIC cascade while it stays well above 96K, the polyphase filter does the rest
+			int stages = 0, r = sample_rate;
+			while (r % 2 == 0 && r / 2 >= 4 * 96000)
+			{
+				r /= 2;
+				stages++;
+			}
+
+			RS.setParams(r, 96000);
+
+			if (stages)
+			{
+				DS2_pre.setStages(stages);
+				physical >> convert >> DS2_pre >> RS >> IQ;
+			}
+			else
+				physical >> convert >> RS >> IQ;
+		}
+		else if (channelizer && sample_rate > 96000)
+		{
+			// channels of 48K spaced around the center, channel 0 at 96K contains AIS A and B
+			uint32_t bucket = 192000;
+			while (bucket < sample_rate)
+				bucket *= 2;
+
+			if (bucket != sample_rate)
+				Warning() << "sample rate " << sample_rate / 1000 << "K upsampled to " << bucket / 1000 << "K.";
+
+			CH.setParams(2 * bucket / 96000);
+
+			if (bucket != sample_rate)
+			{
+				US.setParams(sample_rate, bucket);
+				physical >> convert >> US >> CH;
+			}
+			else
+				physical >> convert >> CH;
+
+			CH.channel(0) >> IQ;
 		}
 		else
 		{
@@ -161,200 +376,255 @@ namespace AIS
 				// 2^7
 			case 12288000:
 				FDC.setTaps(-2.0f);
+				DS2.setStages(7);
 				if (!droop_compensation)
-					convert >> DS2_7 >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2 >> IQ;
 				else
-					convert >> DS2_7 >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 12288000 - 1:
 				FDC.setTaps(-2.0f);
+				DS2_pre.setStages(5);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_7 >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> IQ;
 				else
-					convert >> DS2_7 >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 2^6
 			case 6144000:
 				FDC.setTaps(-2.0f);
+				DS2.setStages(6);
 				if (!droop_compensation)
-					convert >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2 >> IQ;
 				else
-					convert >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 6144000 - 1:
 				FDC.setTaps(-2.0f);
+				DS2_pre.setStages(4);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> IQ;
 				else
-					convert >> DS2_6 >> DS2_5 >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 2^5
 			case 3072000:
 				FDC.setTaps(-1.5f);
+				DS2.setStages(5);
 				if (!droop_compensation)
-					convert >> DS2_5 >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2 >> IQ;
 				else
-					convert >> DS2_5 >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 3072000 - 1:
 				FDC.setTaps(-1.5f);
+				DS2_pre.setStages(3);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_5 >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> IQ;
 				else
-					convert >> DS2_5 >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 2^3 * 3
 			case 2304000:
+				DS2.setStages(3);
 				if (!droop_compensation)
-					convert >> DS2_3 >> DS2_2 >> DS2_1 >> DSK >> ROT;
+					convert >> DS2 >> DSK >> IQ;
 				else
-					convert >> DS2_3 >> DS2_2 >> DS2_1 /* >> FDC */ >> DSK >> ROT;
+					convert >> DS2 /* >> FDC */ >> DSK >> IQ;
 				break;
 			case 2304000 - 1:
+				DS2.setStages(3);
 				if (!droop_compensation)
-					convert >> DS2_3 >> DS2_2 >> DS2_1 >> US >> DSK >> ROT;
+					convert >> DS2 >> US >> DSK >> IQ;
 				else
-					convert >> DS2_3 >> DS2_2 >> DS2_1 >> US /* >> FDC */ >> DSK >> ROT;
+					convert >> DS2 >> US /* >> FDC */ >> DSK >> IQ;
 				break;
 
 				// 2^4
 			case 1536000:
 				FDC.setTaps(-1.2f);
-				if (!fixedpointDS)
-				{
-					if (!droop_compensation)
-						convert >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
-					else
-						convert >> DS2_4 >> DS2_3 >> DS2_2 >> DS2_1 >> FDC >> ROT;
-				}
+				DS2.setStages(4);
+				if (!droop_compensation)
+					convert >> DS2 >> IQ;
 				else
-				{
-					if (!droop_compensation)
-						convert.outCU8 >> DS16_CU8 >> ROT;
-					else
-						convert.outCU8 >> DS16_CU8 >> FDC >> ROT;
-				}
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 1536000 - 1:
 				FDC.setTaps(-1.2f);
+				DS2_pre.setStages(2);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> IQ;
 				else
-					convert >> DS2_4 >> DS2_3 >> US >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 2^2 * 3
 			case 1152000:
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_2 >> DS2_1 >> DSK >> ROT;
+					convert >> DS2 >> DSK >> IQ;
 				else
-					convert >> DS2_2 >> DS2_1 /* >> FDC */ >> DSK >> ROT;
+					convert >> DS2 /* >> FDC */ >> DSK >> IQ;
 				break;
 			case 1152000 - 1:
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_2 >> DS2_1 >> US >> DSK >> ROT;
+					convert >> DS2 >> US >> DSK >> IQ;
 				else
-					convert >> DS2_2 >> DS2_1 /* >> FDC */ >> US >> DSK >> ROT;
+					convert >> DS2 /* >> FDC */ >> US >> DSK >> IQ;
 				break;
 
 				// 2^3
 			case 768000:
 				FDC.setTaps(-1.2f);
+				DS2.setStages(3);
 				if (!droop_compensation)
-					convert >> DS2_3 >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2 >> IQ;
 				else
-					convert >> DS2_3 >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 768000 - 1:
 				FDC.setTaps(-1.2f);
+				DS2_pre.setStages(1);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_3 >> US >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> IQ;
 				else
-					convert >> DS2_3 >> US >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2_pre >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 2 * 3
 			case 576000:
+				DS2.setStages(1);
 				if (!droop_compensation)
-					convert >> DS2_1 >> DSK >> ROT;
+					convert >> DS2 >> DSK >> IQ;
 				else
-					convert >> DS2_1 /* >> FDC */ >> DSK >> ROT;
+					convert >> DS2 /* >> FDC */ >> DSK >> IQ;
 				break;
 			case 576000 - 1:
+				DS2.setStages(1);
 				if (!droop_compensation)
-					convert >> DS2_1 >> US >> DSK >> ROT;
+					convert >> DS2 >> US >> DSK >> IQ;
 				else
-					convert >> DS2_1 /* >> FDC */ >> US >> DSK >> ROT;
+					convert >> DS2 /* >> FDC */ >> US >> DSK >> IQ;
 				break;
 
 				// 2^2
 			case 384000:
 				FDC.setTaps(-1.1f);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> DS2_2 >> DS2_1 >> ROT;
+					convert >> DS2 >> IQ;
 				else
-					convert >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 384000 - 1:
 				FDC.setTaps(-1.1f);
+				DS2.setStages(2);
 				if (!droop_compensation)
-					convert >> US >> DS2_2 >> DS2_1 >> ROT;
+					convert >> US >> DS2 >> IQ;
 				else
-					convert >> US >> DS2_2 >> DS2_1 >> FDC >> ROT;
+					convert >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 3
 			case 288000:
-				convert >> DSK >> ROT;
+				convert >> DSK >> IQ;
 				break;
 			case 288000 - 1:
-				convert >> US >> DSK >> ROT;
+				convert >> US >> DSK >> IQ;
 				break;
 
 				// 2^1
 			case 192000:
 				FDC.setTaps(-0.8f);
+				DS2.setStages(1);
 				if (!droop_compensation)
-					convert >> DS2_1 >> ROT;
+					convert >> DS2 >> IQ;
 				else
-					convert >> DS2_1 >> FDC >> ROT;
+					convert >> DS2 >> FDC >> IQ;
 				break;
 			case 192000 - 1:
 				FDC.setTaps(-0.8f);
+				DS2.setStages(1);
 				if (!droop_compensation)
-					convert >> US >> DS2_1 >> ROT;
+					convert >> US >> DS2 >> IQ;
 				else
-					convert >> US >> DS2_1 >> FDC >> ROT;
+					convert >> US >> DS2 >> FDC >> IQ;
 				break;
 
 				// 2^0
 			case 96000:
-				convert >> ROT;
+				convert >> IQ;
 				break;
 
 			default:
 				throw std::runtime_error("Model: internal error. Sample rate should be supported.");
 			}
+
+			// fixed point alternative for the decimation by 2 stages if input is CU8, CS8 or CS16.
+			// The float chain above stays in place for the other formats.
+			if (fixedpointDS && !interpolated)
+			{
+				int stages = 0;
+				for (uint32_t r = bucket / 96000; r % 2 == 0; r /= 2)
+					stages++;
+
+				StreamIn<CFLOAT32> *next = &IQ;
+
+				if ((bucket / 96000) % 3 == 0)
+					next = &DSK;
+				else if (droop_compensation)
+					next = &FDC;
+
+				if (stages >= DSFP_CU8.minStages())
+				{
+					DSFP_CU8.setStages(stages);
+					DSFP_CS8.setStages(stages);
+
+					convert.outCU8 >> DSFP_CU8;
+					convert.outCS8 >> DSFP_CS8;
+					DSFP_CU8.out.Connect(next);
+					DSFP_CS8.out.Connect(next);
+				}
+
+				if (stages >= DSFP_CS16.minStages())
+				{
+					DSFP_CS16.setStages(stages);
+
+					convert.outCS16 >> DSFP_CS16;
+					DSFP_CS16.out.Connect(next);
+				}
+			}
+		}
+
+		// the 96K band centered between channel A and B, also streamed to remote AIS-catchers if requested
+		if (iq_server)
+		{
+			iqlink.open();
+			IQ >> iqlink;
 		}
 
+		if (spectrum.isOn())
+		{
+			spectrum.start(96000, device ? device->getFrequency() : 0);
+			IQ >> spectrum;
+		}
+		IQ >> ROT;
+
 		ROT.up >> DS2_a >> FCIC5_a;
 		ROT.down >> DS2_b >> FCIC5_b;
 
 		// pick up point for downstream decoders
 		C_a = &FCIC5_a.out;
 		C_b = &FCIC5_b.out;
-
-		// add wav-write to dump 48K channels
-		if (dump)
-		{
-			*C_a >> convertA >> wavA;
-			*C_b >> convertB >> wavB;
-		}
-
-		return;
 	}
 
 	Setting &ModelFrontend::Set(std::string option, std::string arg)
@@ -370,20 +640,53 @@ namespace AIS
 		else if (option == "SOXR")
 		{
 			SOXR_DS = Util::Parse::Switch(arg);
+			channelizer = false;
 			SAMPLERATE_DS = false;
 			MA_DS = false;
+			RS_DS = false;
+#ifndef HASSOXR
+			// the built-in resampler takes the place of libsoxr if not included
+			std::swap(SOXR_DS, RS_DS);
+#endif
 		}
 		else if (option == "SRC")
 		{
 			SAMPLERATE_DS = Util::Parse::Switch(arg);
+			channelizer = false;
 			SOXR_DS = false;
 			MA_DS = false;
+			RS_DS = false;
+#ifndef HASSAMPLERATE
+			std::swap(SAMPLERATE_DS, RS_DS);
+#endif
 		}
 		else if (option == "MA")
 		{
 			MA_DS = Util::Parse::Switch(arg);
+			channelizer = false;
 			SAMPLERATE_DS = false;
 			SOXR_DS = false;
+			RS_DS = false;
+		}
+		else if (option == "RESAMPLE")
+		{
+			RS_DS = Util::Parse::Switch(arg);
+			channelizer = false;
+			SAMPLERATE_DS = false;
+			SOXR_DS = false;
+			MA_DS = false;
+		}
+		else if (option == "CHANNELIZER")
+		{
+			channelizer = Util::Parse::Switch(arg);
+			SOXR_DS = false;
+			SAMPLERATE_DS = false;
+			MA_DS = false;
+			RS_DS = false;
+		}
+		else if (option == "GPU")
+		{
+			GPU_DS = Util::Parse::Switch(arg);
 		}
 		else if (option == "DSK")
 		{
@@ -393,10 +696,97 @@ namespace AIS
 		{
 			droop_compensation = Util::Parse::Switch(arg);
 		}
+		else if (option == "THREADS")
+		{
+			Util::Convert::toUpper(arg);
+			shared = arg == "SHARED";
+			threaded = shared || Util::Parse::Switch(arg);
+		}
+		else if (option == "EXECUTOR_WORKERS")
+		{
+			Util::Executor::get().setWorkers(Util::Parse::Integer(arg, 0, 256, option));
+		}
+		else if (option == "EXECUTOR_AFFINITY")
+		{
+			Util::Executor::get().setAffinity(Util::Parse::Switch(arg));
+		}
+		else if (option == "SQUELCH")
+		{
+			squelch = Util::Parse::Switch(arg);
+		}
+		else if (option == "SQUELCH_PRE")
+		{
+			squelch_pre = Util::Parse::Integer(arg, 0, 500, option);
+		}
+		else if (option == "SQUELCH_POST")
+		{
+			squelch_post = Util::Parse::Integer(arg, 0, 500, option);
+		}
+		else if (option == "FAST_FM")
+		{
+			fastFM = Util::Parse::Switch(arg);
+		}
+		else if (option == "SIMD")
+		{
+			if (!DSP::Kernels::select(arg))
+				throw std::runtime_error("Model: SIMD kernel \"" + arg + "\" not supported on this system.");
+		}
+		else if (option == "HUGE_PAGES")
+		{
+			// process wide, like SIMD, applies to the buffers allocated from here on
+			Util::AlignedMemory::hugePages() = Util::Parse::Switch(arg);
+		}
 		else if (option == "STATION_ID")
 		{
 			station = Util::Parse::Integer(arg);
 		}
+		else if (option == "IQ_SERVER")
+		{
+			iqlink.setPort(Util::Parse::Integer(arg, 1, 65535, option));
+			iq_server = true;
+		}
+		else if (option == "RTLTCP_SERVER")
+		{
+			rtltcp.setPort(Util::Parse::Integer(arg, 1, 65535, option));
+		}
+		else if (option == "IQ_BITS")
+		{
+			int bits = Util::Parse::Integer(arg, 4, 8, option);
+			if (bits != 4 && bits != 8)
+				throw std::runtime_error("Model: IQ_BITS must be 4 or 8.");
+			iqlink.setBits(bits);
+		}
+		else if (option == "SPECTRUM")
+		{
+			spectrum.setOn(Util::Parse::Switch(arg));
+		}
+		else if (option == "SPECTRUM_SIZE")
+		{
+			int n = Util::Parse::Integer(arg, 64, 8192, option);
+			if (n & (n - 1))
+				throw std::runtime_error("Model: SPECTRUM_SIZE must be a power of two.");
+			spectrum.setSize(n);
+		}
+		else if (option == "SPECTRUM_AVERAGE")
+		{
+			spectrum.setAverage(Util::Parse::Integer(arg, 1, 64, option));
+		}
+		else if (option == "SPECTRUM_INTERVAL")
+		{
+			spectrum.setInterval(Util::Parse::Integer(arg, 100, 60000, option));
+		}
+		else if (option == "SHARE_FRONTEND")
+		{
+			share_frontend = Util::Parse::Switch(arg);
+		}
+		else if (option == "SHED")
+		{
+			shed = Util::Parse::Switch(arg);
+		}
+		else if (option == "SHED_LOAD")
+		{
+			shed_load = Util::Parse::Integer(arg, 10, 100, option);
+		}
 		else if (option == "DUMP")
 		{
 			wavA.setValue("FILE", arg + "_A.wav");
@@ -405,31 +795,112 @@ namespace AIS
 			wavB.setValue("RATE", "48000");
 			dump = true;
 		}
+		else if (option == "DUMP_TRIGGER" || option == "DUMP_PRE" || option == "DUMP_POST" || option == "DUMP_BUFFER")
+		{
+			wavA.setValue(option.substr(5), arg);
+			wavB.setValue(option.substr(5), arg);
+		}
 		else
 			Model::Set(option, arg);
 
 		return *this;
 	}
 
+	// one level down as soon as the load is above the threshold, one level back after 5 s well below it
+	void ModelFrontend::updateLoad(float load)
+	{
+		if (!shed)
+			return;
+
+		int percent = (int)(100 * load);
+
+		if (percent > shed_load && shed_level < getShedLevels())
+		{
+			applyShed(++shed_level);
+			shed_hold = 0;
+			Warning() << "Model " << name << ": load " << percent << "%, optional decoding off (level " << shed_level << ").";
+		}
+		else if (shed_level > 0 && percent < shed_load * 7 / 10)
+		{
+			if (++shed_hold < 5)
+				return;
+
+			applyShed(--shed_level);
+			shed_hold = 0;
+			Info() << "Model " << name << ": load " << percent << "%, optional decoding restored (level " << shed_level << ").";
+		}
+		else
+			shed_hold = 0;
+	}
+
+	// the front-end is timed with the model that built it, a model on a shared front-end only counts its channels
+	float ModelFrontend::getTotalTiming()
+	{
+		if (frontend_source)
+			return timer_a.getTotalTiming() + timer_b.getTotalTiming();
+
+		float total = Model::getTotalTiming();
+
+		for (ModelFrontend *f : frontend_followers)
+			if (!f->threaded)
+				total -= f->timer_a.getTotalTiming() + f->timer_b.getTotalTiming();
+
+		return total;
+	}
+
+	// breakdown of the total time into front-end and decoding per channel, plus throughput
+	std::string ModelFrontend::getTimingDetails()
+	{
+		if (timer_a.getCount() == 0)
+			return "";
+
+		if (frontend_source)
+			return " (shares the front-end of " + frontend_source->getName() + ")";
+
+		float total = getTotalTiming(), time_a = timer_a.getTotalTiming(), time_b = timer_b.getTotalTiming();
+
+		// with threads on, the channels are timed on their own thread and not part of the total
+		float frontend = threaded ? total : total - time_a - time_b;
+		double samples = (double)timer_a.getCount() * rate / 48000.0;
+		double speed = total > 0 ? samples / (total / 1000.0) : 0;
+
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1) << " (front-end " << frontend << " ms, channel A " << time_a << " ms, channel B " << time_b << " ms, "
+		   << speed / 1e6 << " MS/s, " << speed / rate << "x real-time";
+
+		if (squelch)
+			ss << ", squelch open A " << 100.0f * SQ_a.getPassed() << "% B " << 100.0f * SQ_b.getPassed() << "%";
+
+		ss << ")";
+
+		return ss.str();
+	}
+
 	std::string ModelFrontend::Get()
 	{
 
 		std::string str;
 
-		if (SOXR_DS)
+		if (gpu.isOpen())
+			return "gpu " + gpu.getDevice() + " " + Model::Get();
+		else if (SOXR_DS)
 			return "soxr ON " + Model::Get();
 		else if (SAMPLERATE_DS)
 			return "src ON " + Model::Get();
 		else if (MA_DS)
 			return "MA ON " + Model::Get();
+		else if (RS_DS)
+			return "resample ON " + Model::Get();
+		else if (channelizer)
+			return "channelizer ON " + Model::Get();
 
-		return "droop " + Util::Convert::toString(droop_compensation) + " fp_ds " + Util::Convert::toString(fixedpointDS) + " dsk " + Util::Convert::toString(allowDSK) + " " + Model::Get();
+		return "droop " + Util::Convert::toString(droop_compensation) + " fp_ds " + Util::Convert::toString(fixedpointDS) + " dsk " + Util::Convert::toString(allowDSK) + " simd " + DSP::Kernels::getName() + (Util::AlignedMemory::hugePages() ? " huge_pages ON" : "") + " fast_fm " + Util::Convert::toString(fastFM) + " squelch " + Util::Convert::toString(squelch) +  " threads " + (shared ? std::string("SHARED") : Util::Convert::toString(threaded)) + (spectrum.isOn() ? " spectrum ON" : "") + " " + Model::Get();
 	}
 
 	void ModelBase::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
 	{
-		ModelFrontend::buildModel(CH1, CH2, sample_rate, timerOn, dev);
 		setName("Base (non-coherent)");
+		ModelFrontend::buildModel(CH1, CH2, sample_rate, timerOn, dev);
 
 		assert(C_a != NULL && C_b != NULL);
 
@@ -438,6 +909,10 @@ namespace AIS
 
 		DEC_a.setOrigin(CH1, station, own_mmsi);
 		DEC_b.setOrigin(CH2, station, own_mmsi);
+		connectDecoders(DEC_a, DEC_b);
+
+		FM_a.setFast(fastFM);
+		FM_b.setFast(fastFM);
 
 		*C_a >> FM_a >> FR_a >> sampler_a >> DEC_a >> output;
 		*C_b >> FM_b >> FR_b >> sampler_b >> DEC_b >> output;
@@ -450,8 +925,8 @@ namespace AIS
 
 	void ModelStandard::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
 	{
-		ModelFrontend::buildModel(CH1, CH2, sample_rate, timerOn, dev);
 		setName("Standard (non-coherent)");
+		ModelFrontend::buildModel(CH1, CH2, sample_rate, timerOn, dev);
 
 		assert(C_a != NULL && C_b != NULL);
 
@@ -464,6 +939,9 @@ namespace AIS
 		DEC_a.resize(nSymbolsPerSample);
 		DEC_b.resize(nSymbolsPerSample);
 
+		FM_a.setFast(fastFM);
+		FM_b.setFast(fastFM);
+
 		*C_a >> FM_a >> FR_a >> S_a;
 		*C_b >> FM_b >> FR_b >> S_b;
 
@@ -471,6 +949,7 @@ namespace AIS
 		{
 			DEC_a[i].setOrigin(CH1, station, own_mmsi);
 			DEC_b[i].setOrigin(CH2, station, own_mmsi);
+			connectDecoders(DEC_a[i], DEC_b[i]);
 
 			S_a.out[i] >> DEC_a[i] >> output;
 			S_b.out[i] >> DEC_b[i] >> output;
@@ -490,9 +969,9 @@ namespace AIS
 
 	void ModelDefault::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
 	{
+		setName("AIS engine " VERSION);
 		ModelFrontend::buildModel(CH1, CH2, sample_rate, timerOn, dev);
 
-		setName("AIS engine " VERSION);
 
 		assert(C_a != NULL && C_b != NULL);
 
@@ -502,6 +981,15 @@ namespace AIS
 		S_a.setConnections(nSymbolsPerSample);
 		S_b.setConnections(nSymbolsPerSample);
 
+		// phase search per block, decoders are fed in the original sample order
+		S_a.setBlockMode(true);
+		S_b.setBlockMode(true);
+
+		I_a.setConnections(nSymbolsPerSample);
+		I_b.setConnections(nSymbolsPerSample);
+		I_a.setLevels(&S_a.getLevels());
+		I_b.setLevels(&S_b.getLevels());
+
 		DEC_a.resize(nSymbolsPerSample);
 		DEC_b.resize(nSymbolsPerSample);
 
@@ -525,30 +1013,47 @@ namespace AIS
 			CGF_b.setWide(true);
 		}
 
+		CGF_a.setSkipIdle(CGF_idle);
+		CGF_b.setSkipIdle(CGF_idle);
+
 		*C_a >> CGF_a >> FC_a >> S_a;
 		*C_b >> CGF_b >> FC_b >> S_b;
 
+		// messages found by more than one decoder go out once, after the block has passed all decoders
+		FC_a >> dedup_a.BlockEnd();
+		FC_b >> dedup_b.BlockEnd();
+		dedup_a >> output;
+		dedup_b >> output;
+
 		for (int i = 0; i < nSymbolsPerSample; i++)
 		{
 			DEC_a[i].setOrigin(CH1, station, own_mmsi);
 			DEC_b[i].setOrigin(CH2, station, own_mmsi);
+			connectDecoders(DEC_a[i], DEC_b[i]);
 
 			if (!PS_EMA)
 			{
 				CD_a[i].setParams(nHistory, nDelay);
 				CD_b[i].setParams(nHistory, nDelay);
 
-				S_a.out[i] >> CD_a[i] >> DEC_a[i] >> output;
-				S_b.out[i] >> CD_b[i] >> DEC_b[i] >> output;
+				S_a.out[i] >> CD_a[i] >> I_a.input(i);
+				S_b.out[i] >> CD_b[i] >> I_b.input(i);
 			}
 			else
 			{
 				CD_EMA_a[i].setParams(nDelay);
 				CD_EMA_b[i].setParams(nDelay);
 
-				S_a.out[i] >> CD_EMA_a[i] >> DEC_a[i] >> output;
-				S_b.out[i] >> CD_EMA_b[i] >> DEC_b[i] >> output;
+				S_a.out[i] >> CD_EMA_a[i] >> I_a.input(i);
+				S_b.out[i] >> CD_EMA_b[i] >> I_b.input(i);
 			}
+
+			I_a.out[i] >> DEC_a[i] >> dedup_a;
+			I_b.out[i] >> DEC_b[i] >> dedup_b;
+
+			I_a.setSkip(i, &DEC_a[i]);
+			I_b.setSkip(i, &DEC_b[i]);
+
 			for (int j = 0; j < nSymbolsPerSample; j++)
 			{
 				if (i != j)
@@ -562,6 +1067,13 @@ namespace AIS
 		return;
 	}
 
+	// 1: no frequency estimate on idle blocks
+	void ModelDefault::applyShed(int level)
+	{
+		CGF_a.setSkipIdle(CGF_idle || level >= 1);
+		CGF_b.setSkipIdle(CGF_idle || level >= 1);
+	}
+
 	Setting &ModelDefault::Set(std::string option, std::string arg)
 	{
 		Util::Convert::toUpper(option);
@@ -575,6 +1087,16 @@ namespace AIS
 		{
 			CGF_wide = Util::Parse::Switch(arg);
 		}
+		else if (option == "AFC_IDLE")
+		{
+			CGF_idle = Util::Parse::Switch(arg);
+		}
+		else if (option == "DEDUP")
+		{
+			bool b = Util::Parse::Switch(arg);
+			dedup_a.setActive(b);
+			dedup_b.setActive(b);
+		}
 		else
 			ModelFrontend::Set(option, arg);
 
@@ -583,14 +1105,14 @@ namespace AIS
 
 	std::string ModelDefault::Get()
 	{
-		return "ps_ema " + Util::Convert::toString(PS_EMA) + " afc_wide " + Util::Convert::toString(CGF_wide) + " " + ModelFrontend::Get();
+		return "ps_ema " + Util::Convert::toString(PS_EMA) + " afc_wide " + Util::Convert::toString(CGF_wide) + " afc_idle " + Util::Convert::toString(CGF_idle) + " dedup " + Util::Convert::toString(dedup_a.isActive()) + " " + ModelFrontend::Get();
 	}
 
 	void ModelChallenger::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
 	{
+		setName("Challenger " VERSION);
 		ModelFrontend::buildModel(CH1, CH2, sample_rate, timerOn, dev);
 
-		setName("Challenger " VERSION);
 
 		assert(C_a != NULL && C_b != NULL);
 
@@ -624,6 +1146,9 @@ namespace AIS
 			CGF_b.setWide(true);
 		}
 
+		CGF_a.setSkipIdle(CGF_idle);
+		CGF_b.setSkipIdle(CGF_idle);
+
 		*C_a >> CGF_a >> throttle_a;
 		*C_b >> CGF_b >> throttle_b;
 
@@ -631,9 +1156,18 @@ namespace AIS
 		throttle_a.out[0] >> FC_a >> S_a;
 		throttle_b.out[0] >> FC_b >> S_b;
 
+		FM_af.setFast(fastFM);
+		FM_bf.setFast(fastFM);
+
 		// needs to be fixed for signal level
-		throttle_a.out[0] >> FM_af >> FR_af >> S_af;
-		throttle_b.out[0] >> FM_bf >> FR_bf >> S_bf;
+		throttle_a.out[0] >> gate_af >> FM_af >> FR_af >> S_af;
+		throttle_b.out[0] >> gate_bf >> FM_bf >> FR_bf >> S_bf;
+
+		// messages found by more than one decoder go out once, after the block has passed all decoders
+		throttle_a.out[0] >> dedup_a.BlockEnd();
+		throttle_b.out[0] >> dedup_b.BlockEnd();
+		dedup_a >> output;
+		dedup_b >> output;
 
 		for (int i = 0; i < nSymbolsPerSample; i++)
 		{
@@ -643,14 +1177,17 @@ namespace AIS
 			DEC_b[i].setOrigin(CH2, station, own_mmsi);
 			DEC_bf[i].setOrigin(CH2, station, own_mmsi);
 
+			connectDecoders(DEC_a[i], DEC_b[i]);
+			connectDecoders(DEC_af[i], DEC_bf[i]);
+
 			CD_EMA_a[i].setParams(nDelay);
 			CD_EMA_b[i].setParams(nDelay);
 
-			S_a.out[i] >> CD_EMA_a[i] >> DEC_a[i] >> output;
-			S_b.out[i] >> CD_EMA_b[i] >> DEC_b[i] >> output;
+			S_a.out[i] >> CD_EMA_a[i] >> DEC_a[i] >> dedup_a;
+			S_b.out[i] >> CD_EMA_b[i] >> DEC_b[i] >> dedup_b;
 
-			S_af.out[i] >> DEC_af[i] >> output;
-			S_bf.out[i] >> DEC_bf[i] >> output;
+			S_af.out[i] >> DEC_af[i] >> dedup_a;
+			S_bf.out[i] >> DEC_bf[i] >> dedup_b;
 
 			for (int j = 0; j < nSymbolsPerSample; j++)
 			{
@@ -674,6 +1211,16 @@ namespace AIS
 		return;
 	}
 
+	// 1: FM decoders off, 2: no frequency estimate on idle blocks
+	void ModelChallenger::applyShed(int level)
+	{
+		gate_af.setOpen(level < 1);
+		gate_bf.setOpen(level < 1);
+
+		CGF_a.setSkipIdle(CGF_idle || level >= 2);
+		CGF_b.setSkipIdle(CGF_idle || level >= 2);
+	}
+
 	Setting &ModelChallenger::Set(std::string option, std::string arg)
 	{
 		Util::Convert::toUpper(option);
@@ -687,6 +1234,16 @@ namespace AIS
 		{
 			CGF_wide = Util::Parse::Switch(arg);
 		}
+		else if (option == "AFC_IDLE")
+		{
+			CGF_idle = Util::Parse::Switch(arg);
+		}
+		else if (option == "DEDUP")
+		{
+			bool b = Util::Parse::Switch(arg);
+			dedup_a.setActive(b);
+			dedup_b.setActive(b);
+		}
 		else
 			ModelFrontend::Set(option, arg);
 
@@ -695,7 +1252,7 @@ namespace AIS
 
 	std::string ModelChallenger::Get()
 	{
-		return "ps_ema " + Util::Convert::toString(PS_EMA) + " afc_wide " + Util::Convert::toString(CGF_wide) + " " + ModelFrontend::Get();
+		return "ps_ema " + Util::Convert::toString(PS_EMA) + " afc_wide " + Util::Convert::toString(CGF_wide) + " afc_idle " + Util::Convert::toString(CGF_idle) + " dedup " + Util::Convert::toString(dedup_a.isActive()) + " " + ModelFrontend::Get();
 	}
 
 	void ModelDiscriminator::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
@@ -714,7 +1271,7 @@ namespace AIS
 		DEC_a.resize(nSymbolsPerSample);
 		DEC_b.resize(nSymbolsPerSample);
 
-		Connection<RAW> &physical = timerOn ? (*device >> timer).out : device->out;
+		Connection<RAW> &physical = connectDevice(timerOn);
 
 		if (sample_rate == 48000)
 		{
@@ -756,15 +1313,299 @@ namespace AIS
 		return;
 	}
 
+	NMEAShards &NMEAShards::get()
+	{
+		static NMEAShards pool;
+		return pool;
+	}
+
+	int NMEAShards::join(ModelNMEA *m, int n)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		while ((int)shards.size() < n)
+		{
+			shards.push_back(std::unique_ptr<Shard>(new Shard()));
+			Shard &s = *shards.back();
+			s.worker = std::thread(&NMEAShards::work, this, std::ref(s));
+		}
+
+		if (!merger.joinable())
+			merger = std::thread(&NMEAShards::merge, this);
+
+		users++;
+		return assigned++ % n;
+	}
+
+	bool NMEAShards::pending(ModelNMEA *m)
+	{
+		if (emitting == m)
+			return true;
+
+		for (auto &s : shards)
+		{
+			for (auto &j : s->jobs)
+				if (j.model == m)
+					return true;
+			for (auto &i : s->out)
+				if (i->model == m)
+					return true;
+		}
+		return false;
+	}
+
+	void NMEAShards::leave(ModelNMEA *m)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		cv_done.wait(lock, [&]
+					 { return !pending(m); });
+
+		if (--users > 0)
+			return;
+
+		stopping = true;
+		for (auto &s : shards)
+			s->cv.notify_one();
+		cv_merge.notify_one();
+		lock.unlock();
+
+		for (auto &s : shards)
+			s->worker.join();
+		merger.join();
+
+		lock.lock();
+		shards.clear();
+		assigned = 0;
+		stopping = false;
+	}
+
+	void NMEAShards::push(ModelNMEA *m, int shard, const RAW *data, int len, TAG &tag)
+	{
+		// copy outside the lock, the device owns the buffers
+		Job job;
+		job.model = m;
+		job.format = len ? data[0].format : Format::TXT;
+		job.tag = tag;
+
+		for (int i = 0; i < len; i++)
+			job.data.insert(job.data.end(), (char *)data[i].data, (char *)data[i].data + data[i].size);
+
+		std::unique_lock<std::mutex> lock(mtx);
+		Shard &s = *shards[shard];
+
+		cv_done.wait(lock, [&]
+					 { return (int)s.jobs.size() < MAX_JOBS || stopping; });
+
+		if (stopping)
+			return;
+
+		job.seq = next_seq++;
+		s.jobs.push_back(std::move(job));
+		s.cv.notify_one();
+	}
+
+	void NMEAShards::work(Shard &s)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			s.cv.wait(lock, [&]
+					  { return !s.jobs.empty() || stopping; });
+
+			if (s.jobs.empty())
+				break;
+
+			// references to deque elements stay valid when the producer appends
+			Job &job = s.jobs.front();
+			lock.unlock();
+
+			Items items;
+			RAW r = {job.format, job.data.data(), (int)job.data.size()};
+			job.model->parse(r, job.tag, items);
+
+			lock.lock();
+			for (auto &i : items)
+			{
+				i->seq = job.seq;
+				s.out.push_back(std::move(i));
+			}
+			s.jobs.pop_front();
+
+			cv_merge.notify_one();
+			cv_done.notify_all();
+		}
+	}
+
+	void NMEAShards::merge()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			// oldest available result, it can go out if no shard is still working on an older job
+			Shard *next = nullptr;
+			uint64_t low = UINT64_MAX;
+			bool busy = false;
+
+			for (auto &s : shards)
+			{
+				if (!s->jobs.empty())
+				{
+					low = MIN(low, s->jobs.front().seq);
+					busy = true;
+				}
+				if (!s->out.empty() && (!next || s->out.front()->seq < next->out.front()->seq))
+					next = s.get();
+			}
+
+			if (next && next->out.front()->seq < low)
+			{
+				std::unique_ptr<Item> item = std::move(next->out.front());
+				next->out.pop_front();
+				emitting = item->model;
+				lock.unlock();
+
+				item->model->emit(*item);
+				pool.put(std::move(item));
+
+				lock.lock();
+				emitting = nullptr;
+				cv_done.notify_all();
+				continue;
+			}
+
+			if (stopping && !busy && !next)
+				break;
+
+			cv_merge.wait(lock);
+		}
+	}
+
+	void ModelNMEA::ShardCollect::Receive(const Message *data, int len, TAG &tag)
+	{
+		for (int i = 0; i < len; i++)
+		{
+			std::unique_ptr<NMEAShards::Item> item = NMEAShards::get().pool.get();
+			item->reset(&model, tag);
+			item->msg = data[i];
+			item->has_msg = true;
+
+			if (model.jsonais && model.jsonais->include(item->msg))
+			{
+				item->json.copyAll(model.jsonais->Decode(item->msg, item->tag));
+				item->has_json = true;
+			}
+			items->push_back(std::move(item));
+		}
+	}
+
+	// positions are queued too so they keep their place between the messages
+	void ModelNMEA::ShardCollectGPS::Receive(const GPS *data, int len, TAG &tag)
+	{
+		for (int i = 0; i < len; i++)
+		{
+			std::unique_ptr<NMEAShards::Item> item = NMEAShards::get().pool.get();
+			item->reset(&model, tag);
+			item->lat = data[i].getLat();
+			item->lon = data[i].getLon();
+			item->nmea = data[i].getNMEA();
+			item->gps_json = data[i].getJSON();
+			model.shard_collect.items->push_back(std::move(item));
+		}
+	}
+
+	void ModelNMEA::parse(const RAW &r, TAG &tag, NMEAShards::Items &items)
+	{
+		shard_collect.items = &items;
+		nmea.Receive(&r, 1, tag);
+		shard_collect.items = nullptr;
+	}
+
+	void ModelNMEA::emit(NMEAShards::Item &item)
+	{
+		if (!item.has_msg)
+		{
+			GPS gps(item.lat, item.lon, item.nmea, item.gps_json);
+			output_gps.Receive(&gps, 1, item.tag);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(MessageMutex::getMutex());
+
+		output.Send(&item.msg, 1, item.tag);
+
+		if (item.has_json)
+		{
+			item.json.binary = (void *)&item.msg;
+			jsonais->Send(&item.json, 1, item.tag);
+		}
+	}
+
+	bool ModelNMEA::setJSONAIS(JSONAIS *j)
+	{
+		if (!workers)
+			return false;
+
+		jsonais = j;
+		return true;
+	}
+
+	void ModelNMEA::stop()
+	{
+		if (shard != -1)
+		{
+			NMEAShards::get().leave(this);
+			shard = -1;
+		}
+	}
+
 	void ModelNMEA::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
 	{
 		setName("NMEA input");
 		device = dev;
-		*device >> nmea >> output;
-		nmea.outGPS >> output_gps;
+
+		if (workers)
+		{
+			shard = NMEAShards::get().join(this, workers);
+			*device >> shard_input;
+			nmea >> shard_collect;
+			nmea.outGPS >> shard_collect_gps;
+		}
+		else
+		{
+			*device >> nmea >> output;
+			nmea.outGPS >> output_gps;
+		}
 
 		nmea.setStation(station);
 		nmea.setOwnMMSI(own_mmsi);
+		nmea.setTiming(timerOn);
+	}
+
+	std::string ModelNMEA::getTimingDetails()
+	{
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1);
+
+		if (nmea.getAISCount() > 0)
+		{
+			float time = nmea.getAISTiming();
+			double speed = time > 0 ? nmea.getAISCount() / (time / 1000.0) : 0;
+
+			ss << " (AIS payload " << time << " ms for " << nmea.getAISCount() << " msgs, " << speed / 1e3 << "k msgs/s)";
+		}
+
+		if (nmea.getJSONCount() > 0)
+		{
+			float time = nmea.getJSONTiming();
+			double speed = time > 0 ? nmea.getJSONCount() / (time / 1000.0) : 0;
+
+			ss << " (JSON parser " << time << " ms for " << nmea.getJSONCount() << " lines, " << speed / 1e3 << "k lines/s)";
+		}
+
+		return ss.str();
 	}
 
 	Setting &ModelNMEA::Set(std::string option, std::string arg)
@@ -800,6 +1641,10 @@ namespace AIS
 		{
 			nmea.setGPS(Util::Parse::Switch(arg));
 		}
+		else if (option == "WORKERS")
+		{
+			workers = Util::Parse::Integer(arg, 0, 32);
+		}
 		else
 			Model::Set(option, arg);
 
@@ -808,7 +1653,7 @@ namespace AIS
 
 	std::string ModelNMEA::Get()
 	{
-		return "nmea_refresh " + Util::Convert::toString(nmea.getRegenerate()) + " uuid " + nmea.getUUID() + " ID " + std::to_string(nmea.getStation()) + " stamp " + Util::Convert::toString(nmea.getStamp()) + " crc_check " + Util::Convert::toString(nmea.getCRCcheck()) + " VDO " + Util::Convert::toString(nmea.getVDO()) + Model::Get();
+		return "nmea_refresh " + Util::Convert::toString(nmea.getRegenerate()) + " uuid " + nmea.getUUID() + " ID " + std::to_string(nmea.getStation()) + " stamp " + Util::Convert::toString(nmea.getStamp()) + " crc_check " + Util::Convert::toString(nmea.getCRCcheck()) + " VDO " + Util::Convert::toString(nmea.getVDO()) + " workers " + std::to_string(workers) + Model::Get();
 	}
 
 	void ModelN2K::buildModel(char CH1, char CH2, int sample_rate, bool timerOn, Device::Device *dev)
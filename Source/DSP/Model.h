@@ -17,6 +17,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 #include "AIS-catcher.h"
 
 #include "Common.h"
@@ -26,10 +33,17 @@
 #include "N2K.h"
 #include "Basestation.h"
 #include "Beast.h"
+#include "JSONAIS.h"
+#include "Merge.h"
 
 #include "DSP.h"
+#include "Channelizer.h"
+#include "Spectrum.h"
+#include "OpenCL.h"
 #include "Demod.h"
+#include "Tuning.h"
 #include "StreamHelpers.h"
+#include "IQLink.h"
 
 #include "Device/Device.h"
 
@@ -53,25 +67,100 @@ namespace AIS
 	};
 
 	// idea is to avoid that message threads from different devices cause issues downstream (e.g. with sending UDP or updating the database).
-	// can also be done further downstream
+	// can also be done further downstream. With a merge set the messages of all models go through its
+	// thread in time order instead.
 	class MessageMutex : public SimpleStreamInOut<AIS::Message, AIS::Message>
 	{
 		static std::mutex mtx;
+		static MessageMerge *merge;
 
 	public:
 		virtual ~MessageMutex() {}
+		static std::mutex &getMutex() { return mtx; }
+		static void setMerge(MessageMerge *m) { merge = m; }
+
 		virtual void Receive(const AIS::Message *data, int len, TAG &tag)
 		{
+			if (merge)
+			{
+				for (int i = 0; i < len; i++)
+					merge->push(out, data[i], tag);
+				return;
+			}
+
 			std::lock_guard<std::mutex> lock(mtx);
 			Send(data, len, tag);
 		}
 		virtual void Receive(AIS::Message *data, int len, TAG &tag)
 		{
+			if (merge)
+			{
+				for (int i = 0; i < len; i++)
+					merge->push(out, data[i], tag);
+				return;
+			}
+
 			std::lock_guard<std::mutex> lock(mtx);
 			Send(data, len, tag);
 		}
 	};
 
+	// Several decoders of a channel (phases, demodulators) often find the same message. Messages are
+	// held until the end of the input block and only the copy with the highest level is passed on,
+	// a later copy that overlaps in time with a message that was passed on is dropped as well.
+	class DecoderDedup : public SimpleStreamInOut<AIS::Message, AIS::Message>
+	{
+		struct Held
+		{
+			AIS::Message msg;
+			TAG tag;
+			uint64_t hash = 0;
+
+			void set(const AIS::Message &m, const TAG &t, uint64_t h)
+			{
+				msg = m;
+				tag = t;
+				hash = h;
+			}
+		};
+
+		struct Sent
+		{
+			uint64_t hash;
+			long start, end;
+		};
+
+		class BlockInput : public StreamIn<CFLOAT32>
+		{
+			DecoderDedup &dedup;
+
+		public:
+			BlockInput(DecoderDedup &d) : dedup(d) {}
+			void Receive(const CFLOAT32 *data, int len, TAG &tag) { dedup.Flush(); }
+		} block_end;
+
+		std::vector<std::unique_ptr<Held>> held;
+		ObjectPool<Held> pool;
+		std::vector<Sent> sent = std::vector<Sent>(32, Sent{0, 0, -1});
+		int sent_ptr = 0;
+		bool on = true;
+
+		static bool overlap(const AIS::Message &m, long start, long end) { return m.getStartIdx() <= end && start <= m.getEndIdx(); }
+
+	public:
+		DecoderDedup() : block_end(*this) {}
+		virtual ~DecoderDedup() {}
+
+		// to be connected after the decoders on the input of the channel, called when a block has been processed
+		StreamIn<CFLOAT32> &BlockEnd() { return block_end; }
+
+		void setActive(bool b) { on = b; }
+		bool isActive() const { return on; }
+
+		void Receive(const AIS::Message *data, int len, TAG &tag);
+		void Flush();
+	};
+
 	// idea is to avoid that message threads from different devices cause issues downstream (e.g. with sending UDP or updating the database).
 	// can also be done further downstream
 	class MessageMutexADSB : public SimpleStreamInOut<Plane::ADSB, Plane::ADSB>
@@ -92,6 +181,25 @@ namespace AIS
 		}
 	};
 
+	// GPS positions go out under the message lock, so the outputs can be swapped while running
+	class MessageMutexGPS : public SimpleStreamInOut<GPS, GPS>
+	{
+	public:
+		virtual ~MessageMutexGPS() {}
+		virtual void Receive(const GPS *data, int len, TAG &tag)
+		{
+			std::lock_guard<std::mutex> lock(MessageMutex::getMutex());
+			Send(data, len, tag);
+		}
+		virtual void Receive(GPS *data, int len, TAG &tag)
+		{
+			std::lock_guard<std::mutex> lock(MessageMutex::getMutex());
+			Send(data, len, tag);
+		}
+	};
+
+	class ModelFrontend;
+
 	// Abstract demodulation model
 	class Model : public Setting
 	{
@@ -105,9 +213,31 @@ namespace AIS
 
 		Device::Device *device;
 		Util::Timer<RAW> timer;
+
+		// PROFILE: time spent per block downstream of the device, reported on /api/perf
+		bool profile = false;
+		Util::Probe<RAW> probe_raw;
+
+		// the receiver can put a stage between the device and the models
+		Connection<RAW> *input = nullptr;
+
+		Connection<RAW> &connectDevice(bool timerOn)
+		{
+			Connection<RAW> *c = input ? input : &device->out;
+
+			if (timerOn)
+				c = &(*c >> timer).out;
+
+			if (profile)
+			{
+				probe_raw.attach(name + " raw");
+				c = &(*c >> probe_raw).out;
+			}
+			return *c;
+		}
 		MessageMutex output;
 		MessageMutexADSB outputADSB;
-		Util::PassThrough<GPS> output_gps;
+		MessageMutexGPS output_gps;
 
 	public:
 		virtual ~Model() {}
@@ -120,7 +250,10 @@ namespace AIS
 		void setName(std::string s) { name = s; }
 		std::string getName() { return name; }
 
-		float getTotalTiming() { return timer.getTotalTiming(); }
+		virtual float getTotalTiming() { return timer.getTotalTiming(); }
+		virtual std::string getTimingDetails() { return ""; }
+		// messages that failed the CRC check, for models that decode from samples
+		virtual uint64_t getCRCErrors() { return 0; }
 
 		void setMode(Mode m) { mode = m; }
 		void setOwnMMSI(int m) { own_mmsi = m; }
@@ -133,6 +266,8 @@ namespace AIS
 				station = Util::Parse::Integer(arg);
 			else if (option == "OWN_MMSI")
 				own_mmsi = Util::Parse::Integer(arg);
+			else if (option == "PROFILE")
+				profile = Util::Parse::Switch(arg);
 			else
 				throw std::runtime_error("Model: unknown setting.");
 
@@ -141,6 +276,22 @@ namespace AIS
 
 		virtual std::string Get() { return ""; }
 		virtual ModelClass getClass() { return ModelClass::IQ; }
+
+		// models that run the common front-end downsampling, to share it between models on one receiver
+		virtual ModelFrontend *getFrontend() { return nullptr; }
+
+		// called before the device plays, also when playing again after stop()
+		virtual void start() {}
+		// called after the device has stopped, to flush and stop worker threads
+		virtual void stop() {}
+
+		void setInput(Connection<RAW> *c) { input = c; }
+		// real-time load of the receiver, once per second from the device thread
+		virtual void updateLoad(float load) {}
+		virtual int getShedLevel() { return 0; }
+
+		// lets the model run the JSON decoding itself, returns false if it should be connected to the output instead
+		virtual bool setJSONAIS(JSONAIS *j) { return false; }
 	};
 
 	// Common front-end downsampling
@@ -149,41 +300,141 @@ namespace AIS
 	private:
 		DSP::SOXR sox;
 		DSP::SRC src;
+		DSP::Resample RS;
 		DSP::DownsampleKFilter DSK;
-		DSP::Downsample2CIC5 DS2_1, DS2_2, DS2_3, DS2_4, DS2_5, DS2_6, DS2_7;
+		// decimation by 2^n, DS2_pre runs before the upsampler if the input rate is interpolated
+		DSP::Downsample2CIC5Cascade DS2, DS2_pre;
 		DSP::Downsample2CIC5 DS2_a, DS2_b;
 		DSP::Upsample US;
 		DSP::FilterCIC5 FCIC5_a, FCIC5_b;
 		DSP::FilterComplex3Tap FDC;
 		DSP::DownsampleMovingAverage DS_MA;
+		DSP::Channelizer CH;
+		DSP::OpenCLDownsample gpu;
 		// fixed point downsamplers
-		DSP::Downsample16_CU8 DS16_CU8;
+		DSP::DownsampleFixedPoint<CU8> DSFP_CU8;
+		DSP::DownsampleFixedPoint<CS8> DSFP_CS8;
+		DSP::DownsampleFixedPoint<CS16> DSFP_CS16;
 
 		Util::ConvertRAW convert;
 
+		// the front-end of another model with identical settings this model decodes from, and vice versa
+		ModelFrontend *frontend_source = nullptr;
+		std::vector<ModelFrontend *> frontend_followers;
+		Connection<CFLOAT32> *F_a = nullptr, *F_b = nullptr;
+		bool share_frontend = true;
+
+		void buildFrontend(int sample_rate, bool timerOn);
+
 	protected:
-		bool fixedpointDS = false;
+		bool fixedpointDS = DSP::Tuning::get().fixedpoint;
 		bool droop_compensation = true;
 		bool SOXR_DS = false;
 		bool SAMPLERATE_DS = false;
 		bool MA_DS = false;
+		bool RS_DS = false;
+		bool GPU_DS = false;
+		bool channelizer = false;
 		bool allowDSK = false;
+		bool fastFM = DSP::Tuning::get().fast_fm;
 
 		const int nSymbolsPerSample = 48000 / 9600;
 
 		Connection<CFLOAT32> *C_a = nullptr, *C_b = nullptr;
+		Util::PassThrough<CFLOAT32> IQ;
 		DSP::Rotate ROT;
 
+		// compressed IQ link to decode the band on another AIS-catcher
+		IO::IQLinkServer iqlink;
+		bool iq_server = false;
+
+		// the raw device samples for other decoders in rtl_tcp format
+		IO::RTLTCPServer rtltcp;
+
+		// averaged spectrum of the band for the web viewer
+		DSP::Spectrum spectrum;
+
+		// skip decoding of idle channel time
+		DSP::Squelch SQ_a, SQ_b;
+		bool squelch = false;
+		int squelch_pre = 30, squelch_post = 30;
+
+		// optionally decode channels A and B on separate threads or as tasks on the shared executor
+		bool threaded = false, shared = false;
+		Util::AsyncPassThrough<CFLOAT32> async_a, async_b;
+
+		// timing of the decoding stages after the front-end, for -b
+		Util::Timer<CFLOAT32> timer_a, timer_b;
+		Util::Probe<CFLOAT32> probe_a, probe_b;
+		int rate = 0;
+
+		// optional parts of the decoding that are switched off, in order, when the receiver cannot keep up
+		bool shed = false;
+		int shed_load = 90, shed_level = 0, shed_hold = 0;
+
+		virtual int getShedLevels() { return 0; }
+		virtual void applyShed(int level) {}
+
 		// dump 48K channels to WAV files
 		Util::WriteWAV wavA, wavB;
 		Util::ConvertToRAW convertA, convertB;
 		bool dump = false;
 
+		// CRC failures over all decoders, the decoders of both channels can run on different threads
+		struct CRCCounter : public SignalIn<DecoderSignals>
+		{
+			std::atomic<uint64_t> count{0};
+
+			void Signal(const DecoderSignals &in)
+			{
+				if (in == DecoderSignals::CRCError)
+					count.fetch_add(1, std::memory_order_relaxed);
+			}
+		} crc_errors;
+
+		// the decoders of channel A and B report CRC failures and start the bursts of a triggered dump
+		void connectDecoders(AIS::Decoder &a, AIS::Decoder &b)
+		{
+			a.DecoderMessage.Connect(crc_errors);
+			b.DecoderMessage.Connect(crc_errors);
+
+			if (dump && wavA.getTrigger())
+			{
+				a.DecoderMessage.Connect(wavA);
+				b.DecoderMessage.Connect(wavB);
+			}
+		}
+
 	public:
 		void buildModel(char, char, int, bool, Device::Device *);
 
 		Setting &Set(std::string option, std::string arg);
 		std::string Get();
+
+		float getTotalTiming();
+		std::string getTimingDetails();
+		uint64_t getCRCErrors() { return crc_errors.count.load(std::memory_order_relaxed); }
+
+		void updateLoad(float load);
+		int getShedLevel() { return shed_level; }
+
+		ModelFrontend *getFrontend() { return this; }
+		DSP::Spectrum &getSpectrum() { return spectrum; }
+		// call before buildModel, true if this model will decode from the front-end of m, built earlier
+		bool shareFrontend(ModelFrontend &m);
+
+		void start()
+		{
+			async_a.start();
+			async_b.start();
+		}
+
+		void stop()
+		{
+			async_a.stop();
+			async_b.stop();
+			spectrum.stop();
+		}
 	};
 
 	// Standard demodulation model, FM with brute-force timing recovery
@@ -221,6 +472,11 @@ namespace AIS
 		DSP::FilterComplex FC_a, FC_b;
 		std::vector<AIS::Decoder> DEC_a, DEC_b;
 		DSP::ScatterPLL S_a, S_b;
+		DSP::Interleave<FLOAT32> I_a, I_b;
+		DecoderDedup dedup_a, dedup_b;
+
+		int getShedLevels() { return 1; }
+		void applyShed(int level);
 
 	protected:
 		int nHistory = 12;
@@ -228,6 +484,8 @@ namespace AIS
 
 		bool PS_EMA = true;
 		bool CGF_wide = true;
+		// keep the last frequency estimate for blocks without signal
+		bool CGF_idle = false;
 
 	public:
 		void buildModel(char, char, int, bool, Device::Device *);
@@ -248,9 +506,14 @@ namespace AIS
 
 		std::vector<AIS::Decoder> DEC_a, DEC_b, DEC_af, DEC_bf;
 		DSP::ScatterPLL S_a, S_b;
+		DecoderDedup dedup_a, dedup_b;
 
 		DSP::Deinterleave<CFLOAT32> throttle_a, throttle_b;
 		DSP::Deinterleave<FLOAT32> S_af, S_bf;
+		Util::Gate<CFLOAT32> gate_af, gate_bf;
+
+		int getShedLevels() { return 2; }
+		void applyShed(int level);
 
 	protected:
 		int nHistory = 12;
@@ -258,6 +521,8 @@ namespace AIS
 
 		bool PS_EMA = true;
 		bool CGF_wide = true;
+		// keep the last frequency estimate for blocks without signal
+		bool CGF_idle = false;
 
 	public:
 		void buildModel(char, char, int, bool, Device::Device *);
@@ -283,16 +548,138 @@ namespace AIS
 		ModelClass getClass() { return ModelClass::FM; }
 	};
 
+	class ModelNMEA;
+
+	// Parser pool shared by NMEA inputs. Every feed is pinned to one shard so its data is parsed
+	// in order, the shards parse and decode to JSON in parallel. A single merge thread forwards
+	// the results downstream in order of arrival while holding the MessageMutex lock.
+	class NMEAShards
+	{
+	public:
+		// an AIS message with its JSON, or a GPS position if has_msg is false, recycled through the pool
+		struct Item
+		{
+			ModelNMEA *model = nullptr;
+			uint64_t seq = 0;
+			TAG tag;
+
+			Message msg;
+			bool has_msg = false;
+			JSON::JSON json;
+			bool has_json = false;
+
+			float lat = 0, lon = 0;
+			std::string nmea, gps_json;
+
+			void reset(ModelNMEA *m, const TAG &t)
+			{
+				model = m;
+				tag = t;
+				has_msg = has_json = false;
+			}
+		};
+
+		ObjectPool<Item> pool;
+
+		typedef std::vector<std::unique_ptr<Item>> Items;
+
+	private:
+		struct Job
+		{
+			ModelNMEA *model;
+			uint64_t seq;
+			Format format;
+			std::vector<char> data;
+			TAG tag;
+		};
+
+		struct Shard
+		{
+			// the job in progress stays at the front until its results are queued
+			std::deque<Job> jobs;
+			std::deque<std::unique_ptr<Item>> out;
+			std::condition_variable cv;
+			std::thread worker;
+		};
+
+		const int MAX_JOBS = 256;
+
+		std::vector<std::unique_ptr<Shard>> shards;
+		std::mutex mtx;
+		std::condition_variable cv_merge, cv_done;
+		std::thread merger;
+
+		uint64_t next_seq = 0;
+		int users = 0, assigned = 0;
+		bool stopping = false;
+		ModelNMEA *emitting = nullptr;
+
+		void work(Shard &s);
+		void merge();
+		bool pending(ModelNMEA *m);
+
+	public:
+		static NMEAShards &get();
+
+		int join(ModelNMEA *m, int n);
+		void leave(ModelNMEA *m);
+		void push(ModelNMEA *m, int shard, const RAW *data, int len, TAG &tag);
+	};
+
 	// Standard demodulation model for FM discriminator input
 	class ModelNMEA : public Model
 	{
+		friend class NMEAShards;
+
 		NMEA nmea;
 
+		// optionally parse on the shared parser pool instead of the device thread
+		int workers = 0, shard = -1;
+		JSONAIS *jsonais = nullptr;
+
+		class ShardInput : public StreamIn<RAW>
+		{
+			ModelNMEA &model;
+
+		public:
+			ShardInput(ModelNMEA &m) : model(m) {}
+			void Receive(const RAW *data, int len, TAG &tag) { NMEAShards::get().push(&model, model.shard, data, len, tag); }
+		} shard_input;
+
+		class ShardCollect : public StreamIn<Message>
+		{
+			ModelNMEA &model;
+
+		public:
+			NMEAShards::Items *items = nullptr;
+
+			ShardCollect(ModelNMEA &m) : model(m) {}
+			void Receive(const Message *data, int len, TAG &tag);
+		} shard_collect;
+
+		class ShardCollectGPS : public StreamIn<GPS>
+		{
+			ModelNMEA &model;
+
+		public:
+			ShardCollectGPS(ModelNMEA &m) : model(m) {}
+			void Receive(const GPS *data, int len, TAG &tag);
+		} shard_collect_gps;
+
+		void parse(const RAW &r, TAG &tag, NMEAShards::Items &items);
+		void emit(NMEAShards::Item &item);
+
 	public:
+		ModelNMEA() : shard_input(*this), shard_collect(*this), shard_collect_gps(*this) {}
+
 		void buildModel(char, char, int, bool, Device::Device *);
 		Setting &Set(std::string option, std::string arg);
 		std::string Get();
 		ModelClass getClass() { return ModelClass::TXT; }
+		std::string getTimingDetails();
+
+		bool setJSONAIS(JSONAIS *j);
+		void stop();
 	};
 
 	class ModelN2K : public Model
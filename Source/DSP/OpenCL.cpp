@@ -0,0 +1,432 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#ifdef HASOPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+#include "OpenCL.h"
+#include "DSP.h"
+#include "Logger.h"
+
+namespace DSP
+{
+#ifdef HASOPENCL
+
+	// convert: one work item per sample, written after the history of the previous block
+	// decimate: one work item per output sample, a plain FIR at every D-th input sample
+	static const char *source = R"(
+__kernel void convert(__global const uchar *in, int format, __global float2 *out, int offset)
+{
+	int i = get_global_id(0);
+	float2 v;
+
+	if (format == 0)
+	{
+		uchar2 s = vload2(i, in);
+		v = (float2)((int)s.x - 128, (int)s.y - 128) / 128.0f;
+	}
+	else if (format == 1)
+	{
+		char2 s = vload2(i, (__global const char *)in);
+		v = (float2)(s.x, s.y) / 128.0f;
+	}
+	else if (format == 2)
+	{
+		short2 s = vload2(i, (__global const short *)in);
+		v = (float2)(s.x, s.y) / 32768.0f;
+	}
+	else
+		v = vload2(i, (__global const float *)in);
+
+	out[offset + i] = v;
+}
+
+__kernel void decimate(__global const float2 *in, __global const float *taps, int K, int start, int D, __global float2 *out)
+{
+	int j = get_global_id(0);
+	__global const float2 *x = in + start + j * D;
+	float2 acc = (float2)(0.0f, 0.0f);
+
+	for (int k = 0; k < K; k++)
+		acc += taps[k] * x[k];
+
+	out[j] = acc;
+}
+)";
+
+	struct OpenCLDownsample::State
+	{
+		cl_context context = NULL;
+		cl_command_queue queue = NULL;
+		cl_program program = NULL;
+		cl_kernel convert = NULL, decimate = NULL;
+		cl_mem taps = NULL;
+
+		// per slot: the raw samples, history plus converted samples and the decimated output
+		cl_mem raw[2] = {NULL, NULL}, samples[2] = {NULL, NULL}, output[2] = {NULL, NULL};
+		size_t raw_size[2] = {0, 0}, samples_size[2] = {0, 0}, output_size[2] = {0, 0};
+		int valid[2] = {0, 0};
+
+		std::vector<CFLOAT32> result[2];
+		cl_event done[2] = {NULL, NULL};
+		bool pending[2] = {false, false};
+		int count[2] = {0, 0};
+
+		int slot = 0, start = 0, sample_size = 1;
+		bool failed = false;
+		std::string device;
+
+		bool build(cl_device_id dev, const std::vector<FLOAT32> &taps);
+	};
+
+	static bool check(cl_int err, const char *what)
+	{
+		if (err != CL_SUCCESS)
+			Error() << "OpenCL: " << what << " failed (" << err << ").";
+		return err == CL_SUCCESS;
+	}
+
+	// the first GPU, any other device if there is none
+	static cl_device_id findDevice()
+	{
+		cl_uint n = 0;
+		if (clGetPlatformIDs(0, NULL, &n) != CL_SUCCESS || n == 0)
+			return NULL;
+
+		std::vector<cl_platform_id> platforms(n);
+		clGetPlatformIDs(n, platforms.data(), NULL);
+
+		const cl_device_type types[] = {CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ALL};
+
+		for (cl_device_type type : types)
+			for (cl_platform_id p : platforms)
+			{
+				cl_device_id d;
+				if (clGetDeviceIDs(p, type, 1, &d, NULL) == CL_SUCCESS)
+					return d;
+			}
+
+		return NULL;
+	}
+
+	// grows a device buffer, the content is not kept
+	static bool reserve(cl_context context, cl_mem &mem, size_t &size, size_t needed, cl_mem_flags flags)
+	{
+		if (needed <= size)
+			return true;
+
+		if (mem)
+			clReleaseMemObject(mem);
+
+		cl_int err;
+		mem = clCreateBuffer(context, flags, needed, NULL, &err);
+		size = err == CL_SUCCESS ? needed : 0;
+		return check(err, "clCreateBuffer");
+	}
+
+	bool OpenCLDownsample::State::build(cl_device_id dev, const std::vector<FLOAT32> &h)
+	{
+		cl_int err;
+		int K = (int)h.size();
+
+		char name[256] = {0};
+		clGetDeviceInfo(dev, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+		device = name;
+
+		context = clCreateContext(NULL, 1, &dev, NULL, NULL, &err);
+		if (!check(err, "clCreateContext"))
+			return false;
+
+		queue = clCreateCommandQueue(context, dev, 0, &err);
+		if (!check(err, "clCreateCommandQueue"))
+			return false;
+
+		program = clCreateProgramWithSource(context, 1, &source, NULL, &err);
+		if (!check(err, "clCreateProgramWithSource"))
+			return false;
+
+		if (clBuildProgram(program, 1, &dev, "-cl-fast-relaxed-math", NULL, NULL) != CL_SUCCESS)
+		{
+			char log[2048] = {0};
+			clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log, NULL);
+			Error() << "OpenCL: kernels do not build: " << log;
+			return false;
+		}
+
+		convert = clCreateKernel(program, "convert", &err);
+		if (!check(err, "clCreateKernel"))
+			return false;
+
+		decimate = clCreateKernel(program, "decimate", &err);
+		if (!check(err, "clCreateKernel"))
+			return false;
+
+		taps = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, K * sizeof(FLOAT32), (void *)h.data(), &err);
+		if (!check(err, "clCreateBuffer"))
+			return false;
+
+		// zero history in front of the first block
+		std::vector<CFLOAT32> zeros(K, 0.0f);
+		samples[1] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, K * sizeof(CFLOAT32), zeros.data(), &err);
+		if (!check(err, "clCreateBuffer"))
+			return false;
+
+		samples_size[1] = K * sizeof(CFLOAT32);
+		valid[1] = K - 1;
+		return true;
+	}
+
+	bool OpenCLDownsample::isAvailable()
+	{
+		return findDevice() != NULL;
+	}
+
+	bool OpenCLDownsample::open(int sample_rate, int out_rate)
+	{
+		release();
+
+		if (out_rate <= 0 || sample_rate % out_rate)
+			return false;
+
+		cl_device_id dev = findDevice();
+		if (!dev)
+			return false;
+
+		D = sample_rate / out_rate;
+
+		// same low pass as the polyphase resampler, which for an integer factor has one phase
+		Resample design;
+		design.setParams(sample_rate, out_rate);
+		K = design.getTaps();
+		taps.resize(K);
+		for (int k = 0; k < K; k++)
+			taps[k] = design.getPhase(0)[2 * k];
+
+		state.reset(new State());
+		if (!state->build(dev, taps))
+		{
+			release();
+			return false;
+		}
+
+		return true;
+	}
+
+	std::string OpenCLDownsample::getDevice()
+	{
+		return state ? state->device : "";
+	}
+
+	void OpenCLDownsample::release()
+	{
+		if (!state)
+			return;
+
+		State &st = *state;
+
+		if (st.queue)
+			clFinish(st.queue);
+
+		for (int s = 0; s < 2; s++)
+		{
+			if (st.done[s])
+				clReleaseEvent(st.done[s]);
+			if (st.raw[s])
+				clReleaseMemObject(st.raw[s]);
+			if (st.samples[s])
+				clReleaseMemObject(st.samples[s]);
+			if (st.output[s])
+				clReleaseMemObject(st.output[s]);
+		}
+
+		if (st.taps)
+			clReleaseMemObject(st.taps);
+		if (st.convert)
+			clReleaseKernel(st.convert);
+		if (st.decimate)
+			clReleaseKernel(st.decimate);
+		if (st.program)
+			clReleaseProgram(st.program);
+		if (st.queue)
+			clReleaseCommandQueue(st.queue);
+		if (st.context)
+			clReleaseContext(st.context);
+
+		state.reset();
+	}
+
+	void OpenCLDownsample::submit(const char *data, int n, int format)
+	{
+		State &st = *state;
+		int s = st.slot, p = s ^ 1;
+		size_t size = (size_t)n * st.sample_size;
+
+		// outputs whose window of K samples lies within history and block
+		int c = n - 1 - st.start >= 0 ? (n - 1 - st.start) / D + 1 : 0;
+
+		if (!reserve(st.context, st.raw[s], st.raw_size[s], size, CL_MEM_READ_ONLY) ||
+			!reserve(st.context, st.samples[s], st.samples_size[s], (K - 1 + n) * sizeof(CFLOAT32), CL_MEM_READ_WRITE) ||
+			!reserve(st.context, st.output[s], st.output_size[s], std::max(c, 1) * sizeof(CFLOAT32), CL_MEM_WRITE_ONLY))
+		{
+			st.failed = true;
+			return;
+		}
+
+		if ((int)st.result[s].size() < c)
+			st.result[s].resize(c);
+
+		cl_int offset = K - 1, kK = K, kD = D, kstart = st.start, kformat = format;
+		size_t global_n = n, global_c = c;
+		cl_int err = CL_SUCCESS;
+
+		err |= clEnqueueWriteBuffer(st.queue, st.raw[s], CL_FALSE, 0, size, data, 0, NULL, NULL);
+		err |= clEnqueueCopyBuffer(st.queue, st.samples[p], st.samples[s], (st.valid[p] - (K - 1)) * sizeof(CFLOAT32), 0, (K - 1) * sizeof(CFLOAT32), 0, NULL, NULL);
+
+		err |= clSetKernelArg(st.convert, 0, sizeof(cl_mem), &st.raw[s]);
+		err |= clSetKernelArg(st.convert, 1, sizeof(cl_int), &kformat);
+		err |= clSetKernelArg(st.convert, 2, sizeof(cl_mem), &st.samples[s]);
+		err |= clSetKernelArg(st.convert, 3, sizeof(cl_int), &offset);
+		err |= clEnqueueNDRangeKernel(st.queue, st.convert, 1, NULL, &global_n, NULL, 0, NULL, NULL);
+
+		if (c > 0)
+		{
+			err |= clSetKernelArg(st.decimate, 0, sizeof(cl_mem), &st.samples[s]);
+			err |= clSetKernelArg(st.decimate, 1, sizeof(cl_mem), &st.taps);
+			err |= clSetKernelArg(st.decimate, 2, sizeof(cl_int), &kK);
+			err |= clSetKernelArg(st.decimate, 3, sizeof(cl_int), &kstart);
+			err |= clSetKernelArg(st.decimate, 4, sizeof(cl_int), &kD);
+			err |= clSetKernelArg(st.decimate, 5, sizeof(cl_mem), &st.output[s]);
+			err |= clEnqueueNDRangeKernel(st.queue, st.decimate, 1, NULL, &global_c, NULL, 0, NULL, NULL);
+			err |= clEnqueueReadBuffer(st.queue, st.output[s], CL_FALSE, 0, c * sizeof(CFLOAT32), st.result[s].data(), 0, NULL, &st.done[s]);
+		}
+		else
+			err |= clEnqueueMarkerWithWaitList(st.queue, 0, NULL, &st.done[s]);
+
+		if (!check(err, "enqueue"))
+		{
+			st.failed = true;
+			return;
+		}
+
+		clFlush(st.queue);
+
+		st.valid[s] = K - 1 + n;
+		st.start += c * D - n;
+		st.count[s] = c;
+		st.pending[s] = true;
+		st.slot = p;
+	}
+
+	void OpenCLDownsample::deliver(int s, TAG &tag)
+	{
+		State &st = *state;
+
+		if (!st.pending[s])
+			return;
+
+		clWaitForEvents(1, &st.done[s]);
+		clReleaseEvent(st.done[s]);
+		st.done[s] = NULL;
+		st.pending[s] = false;
+
+		if (st.count[s] > 0)
+			Send(st.result[s].data(), st.count[s], tag);
+	}
+
+	void OpenCLDownsample::Receive(const RAW *data, int len, TAG &tag)
+	{
+		if (!state || state->failed)
+			return;
+
+		State &st = *state;
+
+		for (int i = 0; i < len; i++)
+		{
+			int format;
+
+			switch (data[i].format)
+			{
+			case Format::CU8:
+				format = 0;
+				st.sample_size = sizeof(CU8);
+				break;
+			case Format::CS8:
+				format = 1;
+				st.sample_size = sizeof(CS8);
+				break;
+			case Format::CS16:
+				format = 2;
+				st.sample_size = sizeof(CS16);
+				break;
+			case Format::CF32:
+				format = 3;
+				st.sample_size = sizeof(CFLOAT32);
+				break;
+			default:
+				Error() << "OpenCL: input format not supported, use CU8, CS8, CS16 or CF32.";
+				st.failed = true;
+				return;
+			}
+
+			// two halves in flight, the decoders work on the first while the device computes the second
+			int n = data[i].size / st.sample_size;
+			if (n <= 0)
+				continue;
+
+			int half = n >= 2 * minimum_half ? n / 2 : n;
+			const char *ptr = (const char *)data[i].data;
+
+			int first = st.slot;
+			submit(ptr, half, format);
+			if (half < n && !st.failed)
+				submit(ptr + (size_t)half * st.sample_size, n - half, format);
+
+			if (st.failed)
+				return;
+
+			deliver(first, tag);
+			deliver(first ^ 1, tag);
+		}
+	}
+
+#else
+
+	struct OpenCLDownsample::State
+	{
+	};
+
+	bool OpenCLDownsample::isAvailable() { return false; }
+	bool OpenCLDownsample::open(int sample_rate, int out_rate) { return false; }
+	std::string OpenCLDownsample::getDevice() { return ""; }
+	void OpenCLDownsample::release() { state.reset(); }
+	void OpenCLDownsample::submit(const char *data, int n, int format) {}
+	void OpenCLDownsample::deliver(int slot, TAG &tag) {}
+	void OpenCLDownsample::Receive(const RAW *data, int len, TAG &tag) {}
+
+#endif
+
+	OpenCLDownsample::OpenCLDownsample() {}
+	OpenCLDownsample::~OpenCLDownsample() { release(); }
+}
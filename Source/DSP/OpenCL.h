@@ -0,0 +1,61 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Stream.h"
+#include "Common.h"
+
+// Front-end on an OpenCL device (HASOPENCL): the raw device samples are converted and decimated to the
+// output rate by one FIR filter on the GPU, only the narrowband output comes back to the decoders.
+// Each block is double-buffered in two halves: the decoders work on the output of the first half
+// while the device computes the second, the block is complete when Receive returns.
+
+namespace DSP
+{
+	class OpenCLDownsample : public SimpleStreamInOut<RAW, CFLOAT32>
+	{
+		struct State;
+		std::unique_ptr<State> state;
+
+		std::vector<FLOAT32> taps;
+		int D = 1, K = 1;
+
+		static const int minimum_half = 4096;
+
+		void release();
+		void submit(const char *data, int n, int format);
+		void deliver(int slot, TAG &tag);
+
+	public:
+		OpenCLDownsample();
+		virtual ~OpenCLDownsample();
+
+		// false if there is no OpenCL device or out_rate does not divide the sample rate
+		bool open(int sample_rate, int out_rate);
+		bool isOpen() { return state != nullptr; }
+		std::string getDevice();
+
+		static bool isAvailable();
+
+		void Receive(const RAW *data, int len, TAG &tag);
+	};
+}
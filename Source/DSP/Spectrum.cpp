@@ -0,0 +1,204 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include "Spectrum.h"
+#include "StreamHelpers.h"
+#include "Logger.h"
+
+namespace DSP
+{
+	void Spectrum::setCallback(std::function<void(const std::string &)> f)
+	{
+		std::lock_guard<std::mutex> lock(result_mtx);
+		callback = f;
+	}
+
+	void Spectrum::start(int rate, uint32_t freq)
+	{
+		if (!on || worker.joinable())
+			return;
+
+		sample_rate = rate;
+		frequency = freq;
+
+		plan.setSize(N);
+		fft_data.resize(N);
+		power.resize(N);
+		capture.resize((size_t)N * average);
+
+		window.resize(N);
+		for (int i = 0; i < N; i++)
+			window[i] = 0.5f - 0.5f * cosf(2.0f * (float)PI * i / (N - 1));
+
+		captured = 0;
+		skip = 0;
+		full = false;
+		stopping = false;
+
+		worker = std::thread(&Spectrum::loop, this);
+	}
+
+	void Spectrum::stop()
+	{
+		if (!worker.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		cv.notify_one();
+		worker.join();
+	}
+
+	void Spectrum::loop()
+	{
+		if (!Util::ThreadPolicy::setBackground())
+			Debug() << "Spectrum: cannot lower thread priority.";
+
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			cv.wait(lock, [this]
+					{ return stopping || full.load(std::memory_order_acquire); });
+
+			if (stopping)
+				break;
+
+			lock.unlock();
+			process();
+			full.store(false, std::memory_order_release);
+			lock.lock();
+		}
+	}
+
+	void Spectrum::process()
+	{
+		std::fill(power.begin(), power.end(), 0.0f);
+
+		for (int f = 0; f < average; f++)
+		{
+			const CFLOAT32 *frame = capture.data() + (size_t)f * N;
+
+			for (int i = 0; i < N; i++)
+				fft_data[plan.index(i)] = frame[i] * window[i];
+
+			plan.execute(fft_data);
+
+			for (int i = 0; i < N; i++)
+				power[i] += std::norm(fft_data[i]);
+		}
+
+		// dB relative to a full scale tone, the window sums to about N / 2
+		FLOAT32 gain = 0;
+		for (int i = 0; i < N; i++)
+			gain += window[i];
+
+		const FLOAT32 scale = 1.0f / (average * gain * gain);
+
+		std::string s;
+		s.reserve(32 + N * 7);
+		s = "{\"time\":" + std::to_string((long long)std::time(nullptr)) + ",\"sample_rate\":" + std::to_string(sample_rate) +
+			",\"frequency\":" + std::to_string(frequency) + ",\"size\":" + std::to_string(N) + ",\"average\":" + std::to_string(average) +
+			",\"skipped\":" + std::to_string(getSkipped()) + ",\"bins\":[";
+
+		// lowest frequency first
+		char buf[16];
+		for (int i = 0; i < N; i++)
+		{
+			FLOAT32 p = power[(i + N / 2) % N] * scale;
+			snprintf(buf, sizeof(buf), i ? ",%.1f" : "%.1f", p > 1e-20f ? 10.0f * log10f(p) : -200.0f);
+			s += buf;
+		}
+		s += "]}";
+
+		std::function<void(const std::string &)> f;
+		{
+			std::lock_guard<std::mutex> lock(result_mtx);
+			json = s;
+			version++;
+			f = callback;
+		}
+
+		if (f)
+			f(s);
+	}
+
+	std::string Spectrum::getJSON()
+	{
+		std::lock_guard<std::mutex> lock(result_mtx);
+		return json;
+	}
+
+	uint64_t Spectrum::getVersion()
+	{
+		std::lock_guard<std::mutex> lock(result_mtx);
+		return version;
+	}
+
+	void Spectrum::Receive(const CFLOAT32 *data, int len, TAG &tag)
+	{
+		if (!worker.joinable())
+			return;
+
+		const int total = N * average;
+		const long period = (long)sample_rate * interval_ms / 1000;
+
+		while (len > 0)
+		{
+			if (skip > 0)
+			{
+				int n = (int)MIN(skip, (long)len);
+				skip -= n;
+				data += n;
+				len -= n;
+				continue;
+			}
+
+			// the worker is not done with the previous capture, try again next interval
+			if (captured == 0 && full.load(std::memory_order_acquire))
+			{
+				skipped.fetch_add(1, std::memory_order_relaxed);
+				skip = MAX(period, 1L);
+				continue;
+			}
+
+			int n = MIN(total - captured, len);
+			std::memcpy(capture.data() + captured, data, n * sizeof(CFLOAT32));
+			captured += n;
+			data += n;
+			len -= n;
+
+			if (captured == total)
+			{
+				captured = 0;
+				skip = MAX(period - total, 0L);
+
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					full.store(true, std::memory_order_release);
+				}
+				cv.notify_one();
+			}
+		}
+	}
+}
@@ -0,0 +1,93 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Stream.h"
+#include "Common.h"
+#include "FFT.h"
+
+namespace DSP
+{
+	// Averaged power spectrum of the front-end output for the web viewer. Once per interval the decoding
+	// thread copies 'average' frames of N samples into the capture buffer, unless the worker still holds
+	// the previous one, in which case the capture is skipped. The worker runs at background priority,
+	// applies a Hann window, averages |X|^2 over the frames and publishes the result in dB as JSON.
+	class Spectrum : public StreamIn<CFLOAT32>
+	{
+		int N = 1024, average = 8, interval_ms = 1000;
+		int sample_rate = 0;
+		uint32_t frequency = 0;
+		bool on = false;
+
+		// filled by the decoding thread while !full, read by the worker while full
+		std::vector<CFLOAT32> capture;
+		int captured = 0;
+		long skip = 0;
+		std::atomic<bool> full{false};
+		std::atomic<uint64_t> skipped{0};
+
+		FFT::Plan<FLOAT32> plan;
+		std::vector<FLOAT32> window, power;
+		std::vector<CFLOAT32> fft_data;
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::thread worker;
+		bool stopping = false;
+
+		std::mutex result_mtx;
+		std::string json;
+		uint64_t version = 0;
+		std::function<void(const std::string &)> callback;
+
+		void loop();
+		void process();
+
+	public:
+		virtual ~Spectrum() { stop(); }
+
+		// N a power of two
+		void setSize(int n) { N = n; }
+		void setAverage(int n) { average = n; }
+		void setInterval(int ms) { interval_ms = ms; }
+		void setOn(bool b) { on = b; }
+		bool isOn() { return on; }
+
+		// called with every new spectrum from the worker thread
+		void setCallback(std::function<void(const std::string &)> f);
+
+		void start(int rate, uint32_t freq);
+		void stop();
+
+		// the last spectrum, empty if none yet
+		std::string getJSON();
+		uint64_t getVersion();
+		uint64_t getSkipped() { return skipped.load(std::memory_order_relaxed); }
+
+		void Receive(const CFLOAT32 *data, int len, TAG &tag);
+	};
+}
@@ -0,0 +1,255 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "AIS-catcher.h"
+#include "Tuning.h"
+#include "DSP.h"
+#include "Demod.h"
+#include "Kernels.h"
+#include "Logger.h"
+#include "StreamHelpers.h"
+
+namespace DSP
+{
+	template <typename T>
+	class Sink : public StreamIn<T>
+	{
+	public:
+		void Receive(const T *data, int len, TAG &tag) {}
+	};
+
+	// calls of f per second, repeated for at least ms milliseconds
+	template <typename F>
+	static double benchmark(F f, int ms)
+	{
+		using namespace std::chrono;
+
+		steady_clock::time_point start = steady_clock::now();
+		long n = 0;
+		double elapsed;
+
+		do
+		{
+			f();
+			n++;
+			elapsed = duration<double>(steady_clock::now() - start).count();
+		} while (elapsed * 1000 < ms);
+
+		return n / elapsed;
+	}
+
+	Tuning &Tuning::get()
+	{
+		static Tuning t;
+		return t;
+	}
+
+	std::string Tuning::defaultFile()
+	{
+#ifdef _WIN32
+		const char *dir = std::getenv("LOCALAPPDATA");
+		return dir ? std::string(dir) + "\\aiscatcher-tune.txt" : "";
+#else
+		const char *dir = std::getenv("HOME");
+		return dir ? std::string(dir) + "/.aiscatcher-tune" : "";
+#endif
+	}
+
+	// the results only hold for the same build on the same processor
+	std::string Tuning::getHost()
+	{
+		std::string s = std::string(VERSION) + "/" + std::to_string(std::thread::hardware_concurrency());
+
+		const Kernels::ISA isas[] = {Kernels::ISA::SSE, Kernels::ISA::AVX2, Kernels::ISA::NEON};
+		const char *names[] = {"SSE", "AVX2", "NEON"};
+
+		for (int i = 0; i < 3; i++)
+			if (Kernels::isSupported(isas[i]))
+				s += std::string("/") + names[i];
+
+		return s;
+	}
+
+	bool Tuning::load(const std::string &file)
+	{
+		std::ifstream in(file);
+		if (file.empty() || !in)
+			return false;
+
+		std::string line, h, s;
+		bool fp = false, fm = false;
+
+		while (std::getline(in, line))
+		{
+			std::istringstream ss(line);
+			std::string key, value;
+
+			if (!(ss >> key >> value) || key[0] == '#')
+				continue;
+
+			if (key == "host")
+				h = value;
+			else if (key == "simd")
+				s = value;
+			else if (key == "fp_ds")
+				fp = value == "on";
+			else if (key == "fast_fm")
+				fm = value == "on";
+		}
+
+		if (h != getHost())
+			return false;
+
+		if (!s.empty() && !Kernels::select(s))
+			return false;
+
+		simd = s;
+		fixedpoint = fp;
+		fast_fm = fm;
+		loaded = true;
+
+		return true;
+	}
+
+	bool Tuning::save(const std::string &file)
+	{
+		std::ofstream out(file);
+		if (file.empty() || !out)
+			return false;
+
+		out << "# AIS-catcher autotune results, remove the file to return to the defaults\n";
+		out << "host " << getHost() << "\n";
+		out << "simd " << simd << "\n";
+		out << "fp_ds " << (fixedpoint ? "on" : "off") << "\n";
+		out << "fast_fm " << (fast_fm ? "on" : "off") << "\n";
+
+		return (bool)out;
+	}
+
+	void Tuning::run(int ms)
+	{
+		TAG tag;
+		const int N = 16384;
+
+		// synthetic input: noise with a tone
+		std::vector<CU8> raw(N * 16);
+		std::vector<CFLOAT32> iq(N);
+		uint32_t seed = 12345;
+
+		for (int i = 0; i < (int)raw.size(); i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			raw[i] = CU8((uint8_t)(128 + 40 * std::cos(i * 0.01f) + (int)(seed >> 28) - 8), (uint8_t)(128 + 40 * std::sin(i * 0.01f) + (int)((seed >> 24) & 15) - 8));
+		}
+		for (int i = 0; i < N; i++)
+			iq[i] = CFLOAT32(raw[i].real() - 127.5f, raw[i].imag() - 127.5f) / 128.0f;
+
+		// SIMD kernels on the inner loops of the decoding chain
+		std::vector<FLOAT32> taps(64, 0.01f), taps2, tr(N, 0.7f), ti(N, 0.7f), fm(N);
+		std::vector<CFLOAT32> up(N), down(N);
+		std::vector<uint32_t> packed(N + 5, 0x00800080), decimated(N / 2);
+		Kernels::duplicateTaps(taps, taps2);
+
+		const Kernels::ISA isas[] = {Kernels::ISA::SCALAR, Kernels::ISA::SSE, Kernels::ISA::AVX2, Kernels::ISA::NEON};
+		double best = 0;
+
+		for (Kernels::ISA isa : isas)
+		{
+			if (!Kernels::select(isa))
+				continue;
+
+			double r = benchmark([&]()
+								 {
+				for (int i = 0; i + 64 <= N; i += 16)
+					Kernels::dotComplex(taps2.data(), iq.data() + i, 64);
+				Kernels::splitRotate(iq.data(), tr.data(), ti.data(), CFLOAT32(1.0f, 0.0f), up.data(), down.data(), N);
+				Kernels::fastFM(iq.data(), iq[0], fm.data(), N);
+				Kernels::cic5Packed(packed.data() + 5, decimated.data(), N / 2, 3); },
+								 ms);
+
+			Info() << "Autotune: SIMD " << Kernels::getName() << " " << (int)r << " blocks/s";
+
+			if (r > best)
+			{
+				best = r;
+				simd = Kernels::getName();
+			}
+		}
+
+		Kernels::select(simd);
+
+		// front-end from 1536K CU8 to 96K, float or fixed point CIC5 stages
+		{
+			Sink<CFLOAT32> sink_float, sink_fixed;
+
+			Util::ConvertRAW convert;
+			Downsample2CIC5Cascade DS2;
+			FilterComplex3Tap FDC_float, FDC_fixed;
+			DownsampleFixedPoint<CU8> DSFP;
+
+			DS2.setStages(4);
+			DSFP.setStages(4);
+			FDC_float.setTaps(-1.2f);
+			FDC_fixed.setTaps(-1.2f);
+
+			convert >> DS2 >> FDC_float >> sink_float;
+			DSFP >> FDC_fixed >> sink_fixed;
+
+			RAW r = {Format::CU8, raw.data(), (int)(raw.size() * sizeof(CU8))};
+
+			double r_float = benchmark([&]()
+									   { convert.Receive(&r, 1, tag); },
+									   ms);
+			double r_fixed = benchmark([&]()
+									   { DSFP.Receive(raw.data(), (int)raw.size(), tag); },
+									   ms);
+
+			fixedpoint = r_fixed > r_float;
+			Info() << "Autotune: front-end float " << (int)r_float << ", fixed point " << (int)r_fixed << " blocks/s";
+		}
+
+		// FM discriminator
+		{
+			Sink<FLOAT32> sink_exact, sink_fast;
+			Demod::FM exact, fast;
+
+			fast.setFast(true);
+			exact >> sink_exact;
+			fast >> sink_fast;
+
+			double r_exact = benchmark([&]()
+									   { exact.Receive(iq.data(), N, tag); },
+									   ms);
+			double r_fast = benchmark([&]()
+									  { fast.Receive(iq.data(), N, tag); },
+									  ms);
+
+			fast_fm = r_fast > r_exact;
+			Info() << "Autotune: FM exact " << (int)r_exact << ", fast " << (int)r_fast << " blocks/s";
+		}
+
+		Info() << "Autotune: SIMD " << simd << ", FP_DS " << (fixedpoint ? "on" : "off") << ", FAST_FM " << (fast_fm ? "on" : "off");
+	}
+}
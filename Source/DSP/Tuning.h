@@ -0,0 +1,50 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+// Picks the fastest implementation of the DSP stages that have alternatives with equivalent decoding:
+// the SIMD kernels, the fixed point or float front-end and the fast or exact FM discriminator.
+// run() benchmarks them on synthetic input and saves the choices, later startups load the file
+// before the command line is parsed so they become the defaults of the models (-go overrides).
+
+namespace DSP
+{
+	class Tuning
+	{
+		static std::string getHost();
+
+	public:
+		bool loaded = false;
+		std::string simd;
+		bool fixedpoint = false;
+		bool fast_fm = false;
+
+		static Tuning &get();
+		// in the home directory, empty if there is none
+		static std::string defaultFile();
+
+		// false if there is no file or it was written on another host or version
+		bool load(const std::string &file);
+		bool save(const std::string &file);
+
+		// benchmarks every candidate for about ms milliseconds
+		void run(int ms);
+	};
+}
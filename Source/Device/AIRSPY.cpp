@@ -20,6 +20,7 @@
 #include <iomanip>
 
 #include "AIRSPY.h"
+#include "Kernels.h"
 
 namespace Device
 {
@@ -34,7 +35,12 @@ namespace Device
 		if (airspy_open_sn(&dev, h) != AIRSPY_SUCCESS)
 			throw std::runtime_error("AIRSPY: cannot open device.");
 
-		if (real_mode)
+		if (packed)
+		{
+			airspy_set_packing(dev, 1);
+			airspy_set_sample_type(dev, AIRSPY_SAMPLE_RAW);
+		}
+		else if (real_mode)
 			airspy_set_sample_type(dev, AIRSPY_SAMPLE_FLOAT32_REAL);
 
 		setDefaultRate();
@@ -48,7 +54,12 @@ namespace Device
 		if (airspy_open_file_descriptor(&dev, fd) != AIRSPY_SUCCESS)
 			throw std::runtime_error("AIRSPY: cannot open device.");
 
-		if (real_mode)
+		if (packed)
+		{
+			airspy_set_packing(dev, 1);
+			airspy_set_sample_type(dev, AIRSPY_SAMPLE_RAW);
+		}
+		else if (real_mode)
 			airspy_set_sample_type(dev, AIRSPY_SAMPLE_FLOAT32_REAL);
 
 		setDefaultRate();
@@ -110,12 +121,37 @@ namespace Device
 	void AIRSPY::callback(CFLOAT32 *data, int len)
 	{
 		RAW r = {real_mode ? Format::F32_FS4 : Format::CF32, data, (int)(len * (real_mode ? sizeof(FLOAT32) : sizeof(CFLOAT32)))};
+		steady_clock::time_point t = steady_clock::now();
+		Send(&r, 1, tag);
+		countLatency(t);
+	}
+
+	void AIRSPY::callbackPacked(const uint32_t *data, int len)
+	{
+		// whole groups of 8 samples, libairspy delivers 2^17 samples per transfer
+		len &= ~7;
+		if ((int)unpacked.size() < len)
+			unpacked.resize(len);
+
+		DSP::Kernels::unpack12FS4(data, unpacked.data(), len);
+
+		RAW r = {Format::CS16, unpacked.data(), (int)(len * sizeof(CS16))};
+		steady_clock::time_point t = steady_clock::now();
 		Send(&r, 1, tag);
+		countLatency(t);
 	}
 
 	int AIRSPY::callback_static(airspy_transfer_t *tf)
 	{
-		((AIRSPY *)tf->ctx)->callback((CFLOAT32 *)tf->samples, tf->sample_count);
+		AIRSPY *d = (AIRSPY *)tf->ctx;
+
+		if (tf->dropped_samples)
+			d->countDropped(tf->dropped_samples);
+
+		if (d->packed)
+			d->callbackPacked((const uint32_t *)tf->samples, tf->sample_count);
+		else
+			d->callback((CFLOAT32 *)tf->samples, tf->sample_count);
 		return 0;
 	}
 
@@ -196,7 +232,7 @@ namespace Device
 
 	void AIRSPY::applyBandwidth()
 	{
-		if (tuner_bandwidth >= 0 && real_mode)
+		if (tuner_bandwidth >= 0 && (real_mode || packed))
 		{
 			int i, j;
 
@@ -292,11 +328,16 @@ namespace Device
 		{
 			bias_tee = Util::Parse::Switch(arg);
 		}
-		else if (option == "REAL_MODE")
+		else if (option == "REAL_MODE" || option == "PACKED")
 		{
-			real_mode = Util::Parse::Switch(arg);
+			if (option == "PACKED")
+				packed = Util::Parse::Switch(arg);
+			else
+				real_mode = Util::Parse::Switch(arg);
 
-			if (real_mode)
+			if (packed)
+				format = Format::CS16;
+			else if (real_mode)
 				format = Format::F32_FS4;
 			else
 				format = Format::CF32;
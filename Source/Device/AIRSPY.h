@@ -40,6 +40,8 @@ namespace Device
 		int gain = 17;
 
 		bool real_mode = false;
+		// 12-bit packed USB transfers, real mode samples unpacked by AIS-catcher
+		bool packed = false;
 		bool explicit_gain = false;
 		bool mixer_AGC = true;
 		bool LNA_AGC = true;
@@ -57,8 +59,11 @@ namespace Device
 		std::vector<uint32_t> rates;
 		uint64_t serial;
 
+		std::vector<CS16> unpacked;
+
 		static int callback_static(airspy_transfer_t *tf);
 		void callback(CFLOAT32 *, int);
+		void callbackPacked(const uint32_t *, int);
 
 		void setBiasTee(bool);
 		void setLNA_AGC(int);
@@ -101,12 +101,19 @@ namespace Device
 	void AIRSPYHF::callback(CFLOAT32 *data, int len)
 	{
 		RAW r = {Format::CF32, data, (int)(len * sizeof(CFLOAT32))};
+		steady_clock::time_point t = steady_clock::now();
 		Send(&r, 1, tag);
+		countLatency(t);
 	}
 
 	int AIRSPYHF::callback_static(airspyhf_transfer_t *tf)
 	{
-		((AIRSPYHF *)tf->ctx)->callback((CFLOAT32 *)tf->samples, tf->sample_count);
+		AIRSPYHF *d = (AIRSPYHF *)tf->ctx;
+
+		if (tf->dropped_samples)
+			d->countDropped(tf->dropped_samples);
+
+		d->callback((CFLOAT32 *)tf->samples, tf->sample_count);
 		return 0;
 	}
 
@@ -31,6 +31,7 @@
 #include "Common.h"
 #include "Parse.h"
 #include "Convert.h"
+#include "StreamHelpers.h"
 
 namespace Device {
 
@@ -62,11 +63,80 @@ namespace Device {
 		uint32_t sample_rate = 0;
 		Type DeviceType = Type::NONE;
 
+		// policy_read for the thread that reads from the hardware or socket, policy_run for the thread running the decoders
+		Util::ThreadPolicy policy_read, policy_run;
+
+		// adaptive FIFO: blocks hold fifo_latency ms of samples and the ring grows on overrun up to fifo_max blocks
+		bool fifo_adaptive = false;
+		int fifo_latency = 20, fifo_max = 64;
+
+		// drops reported by the driver and the time spent in callbacks that run the decoders directly
+		std::atomic<long> lost_events{0};
+		std::atomic<uint64_t> lost_samples{0};
+		LogHistogram callback_latency;
+
+		void countDropped(uint64_t samples) {
+			lost_events++;
+			lost_samples += samples;
+		}
+
+		void countLatency(const steady_clock::time_point &t) {
+			callback_latency.add(duration_cast<microseconds>(steady_clock::now() - t).count());
+		}
+
+		// capture time of a block for the output latency: devices with a FIFO take the time the block at
+		// the front was filled, the other blocks are stamped when they are sent on
+		bool stamped = false;
+
+		void stampCapture(FIFO& fifo) {
+			tag.capture_us = fifo.getStamp();
+			stamped = tag.capture_us != 0;
+		}
+
+		void Send(RAW* data, int len, TAG& t) {
+			if (!stamped)
+				t.capture_us = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+			stamped = false;
+			SimpleStreamOut<RAW>::Send(data, len, t);
+		}
+
+		void initFIFO(FIFO& fifo, int block, int count) {
+			if (fifo_adaptive && sample_rate) {
+				uint64_t bytes = (uint64_t)sample_rate * Util::bytesPerSample(format) * fifo_latency / 1000;
+				int size = MAX(1, (int)((bytes + 8192) / 16384)) * 16384;
+
+				// start with at least the buffering of the fixed configuration
+				count = MAX(count, (int)(((uint64_t)block * count + size - 1) / size));
+				block = size;
+				fifo.setMaxBlocks(MAX(count, fifo_max));
+			}
+			else
+				fifo.setMaxBlocks(0);
+
+			// with a memory budget the ring, also once grown, stays within the share for the input
+			if (MemoryBudget::isSet()) {
+				int cap = MAX(2, (int)(MemoryBudget::limit(MemoryBudget::FIFO, 0) / block));
+				count = MIN(count, cap);
+				if (fifo_adaptive && sample_rate)
+					fifo.setMaxBlocks(MIN(MAX(count, fifo_max), cap));
+			}
+
+			fifo.Init(block, count);
+		}
+
 		uint32_t getCorrectedFrequency() {
 			return (uint32_t)((float)frequency * (1.0f - freq_offset / 1000000.0f));
 		}
 
 	public:
+		// overruns and buffer use, latency in microseconds from the arrival of a block until it has been processed
+		struct Statistics {
+			long overruns = 0;
+			uint64_t dropped = 0;
+			int fifo_max = 0, fifo_blocks = 0, fifo_block_size = 0, fifo_grows = 0;
+			uint64_t latency_p99 = 0, latency_max = 0;
+		};
+
 		// DeviceBase
 		Device() {}
 		Device(Format f, uint32_t s, Type t) : format(f), sample_rate(s), DeviceType(t) {}
@@ -111,6 +181,21 @@ namespace Device {
 				else
 					setFormat(f);
 			}
+			else if (option == "AFFINITY" || option == "PRIORITY") {
+				policy_read.Set(option, arg);
+			}
+			else if (option == "RUN_AFFINITY" || option == "RUN_PRIORITY") {
+				policy_run.Set(option.substr(4), arg);
+			}
+			else if (option == "FIFO_ADAPTIVE") {
+				fifo_adaptive = Util::Parse::Switch(arg);
+			}
+			else if (option == "FIFO_LATENCY") {
+				fifo_latency = Util::Parse::Integer(arg, 1, 1000, option);
+			}
+			else if (option == "FIFO_MAX") {
+				fifo_max = Util::Parse::Integer(arg, 2, 1024, option);
+			}
 			else
 				throw std::runtime_error("Invalid Device setting: \"" + option + "\"");
 
@@ -123,10 +208,42 @@ namespace Device {
 			if (tuner_bandwidth) str += " bw " + std::to_string(tuner_bandwidth / 1000) + "K";
 			if (freq_offset) str += " freqoffset " + std::to_string(freq_offset);
 			str += " format " + Util::Convert::toString(format);
+			if (fifo_adaptive) str += " fifo_latency " + std::to_string(fifo_latency) + " fifo_max " + std::to_string(fifo_max);
+			str += policy_read.Get() + policy_run.Get("run_");
 
 			return str;
 		}
 
+		// devices with a FIFO between the driver and the decoders
+		virtual FIFO* getFIFO() { return nullptr; }
+
+		Statistics getStatistics() {
+			Statistics st;
+			FIFO* fifo = getFIFO();
+			LogHistogram& latency = fifo && fifo->getLatency().getCount() ? fifo->getLatency() : callback_latency;
+
+			st.overruns = lost_events;
+			st.dropped = lost_samples;
+
+			if (fifo) {
+				st.overruns += fifo->getOverruns();
+				st.dropped += fifo->getDropped() / Util::bytesPerSample(format);
+				st.fifo_max = fifo->getMaxFilled();
+				st.fifo_blocks = fifo->Blocks();
+				st.fifo_block_size = fifo->BlockSize();
+				st.fifo_grows = fifo->getGrows();
+			}
+
+			st.latency_p99 = latency.percentile(99);
+			st.latency_max = latency.getMax();
+			return st;
+		}
+
+		std::string getThreadDescription() {
+			std::string str = policy_read.Get() + policy_run.Get("run_");
+			return str.empty() ? "-" : str.substr(1);
+		}
+
 		virtual std::string getProduct() {
 			return "";
 		}
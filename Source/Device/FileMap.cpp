@@ -0,0 +1,157 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "FileMap.h"
+
+namespace Device
+{
+
+	void FileMap::open(const std::string &filename)
+	{
+		close();
+
+#ifdef _WIN32
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("FILE: cannot open \"" + filename + "\".");
+
+		LARGE_INTEGER sz;
+		if (!GetFileSizeEx(file, &sz))
+		{
+			close();
+			throw std::runtime_error("FILE: cannot determine size of \"" + filename + "\".");
+		}
+
+		length = (uint64_t)sz.QuadPart;
+		if (length == 0)
+			return;
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping != NULL)
+			ptr = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+#else
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("FILE: cannot open \"" + filename + "\".");
+
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			throw std::runtime_error("FILE: cannot determine size of \"" + filename + "\".");
+		}
+
+		length = (uint64_t)st.st_size;
+		if (length == 0)
+		{
+			::close(fd);
+			return;
+		}
+
+		void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+
+		if (p != MAP_FAILED)
+		{
+			ptr = (uint8_t *)p;
+			madvise(p, length, MADV_SEQUENTIAL);
+		}
+#endif
+		if (!ptr)
+		{
+			close();
+			throw std::runtime_error("FILE: cannot map \"" + filename + "\" into memory.");
+		}
+	}
+
+	void FileMap::close()
+	{
+#ifdef _WIN32
+		if (ptr)
+			UnmapViewOfFile(ptr);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (ptr)
+			munmap(ptr, length);
+#endif
+		ptr = nullptr;
+		length = 0;
+	}
+
+	void ReplayClock::reset(Format f, uint32_t rate)
+	{
+		int bps = 0;
+
+		switch (f)
+		{
+		case Format::CU8:
+		case Format::CS8:
+			bps = 2;
+			break;
+		case Format::CS16:
+			bps = 4;
+			break;
+		case Format::CF32:
+			bps = 8;
+			break;
+		default:
+			break;
+		}
+
+		bytes_per_second = (double)bps * rate;
+		bytes = 0;
+		start = std::chrono::high_resolution_clock::now();
+	}
+
+	void ReplayClock::wait(uint64_t n)
+	{
+		bytes += n;
+
+		if (speed <= 0 || bytes_per_second <= 0)
+			return;
+
+		auto target = start + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(bytes / bytes_per_second / speed));
+		std::this_thread::sleep_until(target);
+	}
+
+	void ReplayClock::report(const std::string &name)
+	{
+		if (bytes_per_second <= 0)
+			return;
+
+		double wall = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		double signal = bytes / bytes_per_second;
+
+		Info() << "FILE: end of " << name << ", " << signal << " s of signal in " << wall << " s wall time (" << (wall > 0 ? signal / wall : 0) << "x realtime)";
+	}
+}
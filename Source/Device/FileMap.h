@@ -0,0 +1,68 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "Common.h"
+
+namespace Device
+{
+
+	// read-only view of a file in memory, pages are private to the process so receivers
+	// further down the chain can still write into the blocks they are handed
+	class FileMap
+	{
+		uint8_t *ptr = nullptr;
+		uint64_t length = 0;
+
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#endif
+
+	public:
+		~FileMap() { close(); }
+
+		void open(const std::string &filename);
+		void close();
+
+		uint8_t *data() { return ptr; }
+		uint64_t size() { return length; }
+	};
+
+	// paces file replay to a multiple of the sample rate (speed 0 is as fast as possible) and
+	// keeps track of signal time against wall time
+	class ReplayClock
+	{
+		double speed = 0;
+		double bytes_per_second = 0;
+		uint64_t bytes = 0;
+		std::chrono::high_resolution_clock::time_point start;
+
+	public:
+		void setSpeed(double s) { speed = s; }
+		double getSpeed() { return speed; }
+
+		// no pacing or report for formats without a fixed sample size
+		void reset(Format f, uint32_t rate);
+		void wait(uint64_t n);
+		void report(const std::string &name);
+	};
+}
@@ -15,9 +15,12 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
 #include "FileRAW.h"
+#include "Alloc.h"
 
 namespace Device
 {
@@ -27,6 +30,7 @@ namespace Device
 
 	void RAWFile::ReadAsync()
 	{
+		policy_read.apply("RAW read");
 
 		try
 		{
@@ -43,6 +47,7 @@ namespace Device
 							std::memset(buffer.data() + bytesRead, 0, buffer.size() - bytesRead);
 	
 						fifo.Push(buffer.data(), buffer.size(), true);
+						clock.wait(bytesRead);
 					}
 				}
 				else
@@ -71,6 +76,7 @@ namespace Device
 
 	void RAWFile::Run()
 	{
+		policy_run.apply("RAW run");
 		RAW r = {getFormat(), fifo.Front(), fifo.BlockSize()};
 
 		try
@@ -83,13 +89,17 @@ namespace Device
 					r.data = fifo.Front(nblocks);
 					r.size = nblocks * fifo.BlockSize();
 
+					stampCapture(fifo);
 					Send(&r, 1, tag);
 					fifo.Pop(nblocks);
 				}
 				else
 				{
 					if (eoi && isStreaming())
+					{
 						done = true;
+						clock.report(filename);
+					}
 					else if (isStreaming() && getFormat() != Format::TXT)
 						Error() << "FILE: timeout.";
 				}
@@ -102,13 +112,150 @@ namespace Device
 		}
 	}
 
+	// blocks are handed out straight from the mapped file, only the last one is
+	// copied so it can be padded with zeros to a full block like in ReadAsync
+	void RAWFile::RunMapped()
+	{
+		policy_run.apply("RAW run");
+		RAW r = {getFormat(), nullptr, 0};
+		uint64_t offset = 0;
+
+		try
+		{
+			while (isStreaming())
+			{
+				if (offset >= map.size())
+				{
+					if (loop && map.size() > 0)
+						offset = 0;
+					else
+					{
+						done = true;
+						clock.report(filename);
+						break;
+					}
+				}
+
+				uint64_t n = std::min((uint64_t)BUFFER_SIZE, map.size() - offset);
+
+				if (n < BUFFER_SIZE)
+				{
+					std::memcpy(buffer.data(), map.data() + offset, n);
+					std::memset(buffer.data() + n, 0, BUFFER_SIZE - n);
+					r.data = buffer.data();
+				}
+				else
+					r.data = map.data() + offset;
+
+				r.size = BUFFER_SIZE;
+				Send(&r, 1, tag);
+
+				offset += n;
+				clock.wait(n);
+			}
+		}
+		catch (std::exception &e)
+		{
+			Error() << "RAWFile RunMapped: " << e.what();
+			std::terminate();
+		}
+	}
+
+	// the file is passed on in blocks that end at a line end, timed from the first to the last block
+	void RAWFile::RunBenchmark()
+	{
+		policy_run.apply("RAW run");
+
+		const std::size_t BLOCK = 65536;
+		RAW r = {getFormat(), nullptr, 0};
+
+		uint64_t lines = std::count(buffer.begin(), buffer.end(), '\n');
+		uint64_t allocs = Util::AllocCount::get();
+		int passes = 0;
+
+		Util::AllocCount::start();
+		auto time_start = std::chrono::steady_clock::now();
+
+		try
+		{
+			for (; passes < repeat && isStreaming(); passes++)
+			{
+				std::size_t offset = 0;
+
+				while (offset < buffer.size() && isStreaming())
+				{
+					std::size_t n = MIN(BLOCK, buffer.size() - offset);
+
+					if (offset + n < buffer.size())
+					{
+						std::size_t k = n;
+						while (k > 0 && buffer[offset + k - 1] != '\n')
+							k--;
+						if (k > 0)
+							n = k;
+					}
+
+					r.data = buffer.data() + offset;
+					r.size = n;
+					Send(&r, 1, tag);
+
+					offset += n;
+				}
+			}
+		}
+		catch (std::exception &e)
+		{
+			Error() << "RAWFile RunBenchmark: " << e.what();
+			std::terminate();
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+		allocs = Util::AllocCount::get() - allocs;
+		lines *= passes;
+
+		Info() << "FILE: benchmark " << passes << " x " << filename << ", " << lines << " lines, " << (double)buffer.size() * passes / 1e6 << " MB in "
+			   << seconds << " s, " << (seconds > 0 ? lines / seconds / 1e3 : 0) << "k lines/s, " << (lines ? (double)allocs / lines : 0) << " allocations per line";
+
+		done = true;
+	}
+
 	void RAWFile::Play()
 	{
 		Device::Play();
 
 		bool is_stdin = (filename == "." || filename == "stdin");
+		bool is_text = getFormat() == Format::TXT || getFormat() == Format::BASESTATION || getFormat() == Format::BEAST || getFormat() == Format::RAW1090;
+
+		done = false;
+		clock.reset(getFormat(), getSampleRate());
 
-		if (getFormat() != Format::TXT && getFormat() != Format::BASESTATION && getFormat() != Format::BEAST && getFormat() != Format::RAW1090)
+		if (benchmark)
+		{
+			if (is_stdin || !is_text)
+				throw std::runtime_error("FILE: BENCHMARK requires a text file.");
+
+			std::ifstream in(filename, std::ios::in | std::ios::binary);
+			if (!in)
+				throw std::runtime_error("FILE: Cannot open input.");
+
+			buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			if (!buffer.empty() && buffer.back() != '\n')
+				buffer.push_back('\n');
+
+			run_thread = std::thread(&RAWFile::RunBenchmark, this);
+			return;
+		}
+
+		if (mapped && !is_stdin && !is_text)
+		{
+			map.open(filename);
+			buffer.resize(BUFFER_SIZE);
+
+			run_thread = std::thread(&RAWFile::RunMapped, this);
+			return;
+		}
+
+		if (!is_text)
 		{
 			fifo.Init(BUFFER_SIZE, BUFFER_COUNT);
 			buffer.resize(BUFFER_SIZE);
@@ -116,6 +263,7 @@ namespace Device
 		else
 		{
 			fifo.Init(TXT_BLOCK_SIZE, BUFFER_SIZE);
+			fifo.setTimeout(0);
 
 			if(is_stdin)
 				buffer.resize(TXT_BLOCK_SIZE);
@@ -135,8 +283,6 @@ namespace Device
 		if (!file || file->fail())
 			throw std::runtime_error("FILE: Cannot open input.");
 
-		done = false;
-
 		read_thread = std::thread(&RAWFile::ReadAsync, this);
 		run_thread = std::thread(&RAWFile::Run, this);
 	}
@@ -157,6 +303,8 @@ namespace Device
 
 	void RAWFile::Close()
 	{
+		map.close();
+
 		if (file && file != &std::cin)
 		{
 			delete file;
@@ -180,6 +328,22 @@ namespace Device
 		{
 			TXT_BLOCK_SIZE = Util::Parse::Integer(arg, 1, 16384);
 		}
+		else if (option == "MMAP")
+		{
+			mapped = Util::Parse::Switch(arg);
+		}
+		else if (option == "BENCHMARK")
+		{
+			benchmark = Util::Parse::Switch(arg);
+		}
+		else if (option == "REPEAT")
+		{
+			repeat = Util::Parse::Integer(arg, 1, 1000000);
+		}
+		else if (option == "SPEED")
+		{
+			clock.setSpeed(Util::Parse::Float(arg, 0, 1000));
+		}
 		else
 			Device::Set(option, arg);
 
@@ -188,6 +352,6 @@ namespace Device
 
 	std::string RAWFile::Get()
 	{
-		return Device::Get() + " file " + filename + " loop " + Util::Convert::toString(loop);
+		return Device::Get() + " file " + filename + " loop " + Util::Convert::toString(loop) + " mmap " + Util::Convert::toString(mapped) + " speed " + Util::Convert::toString((FLOAT32)clock.getSpeed()) + " benchmark " + Util::Convert::toString(benchmark) + " repeat " + std::to_string(repeat);
 	}
 }
\ No newline at end of file
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "Device.h"
+#include "FileMap.h"
 
 namespace Device {
 
@@ -33,8 +34,15 @@ namespace Device {
 		bool eoi = false;
 		bool done = false;
 		bool loop = false;
+		bool mapped = false;
+
+		// text read into memory and replayed REPEAT times as fast as the decoding allows
+		bool benchmark = false;
+		int repeat = 1;
 
 		FIFO fifo;
+		FileMap map;
+		ReplayClock clock;
 
 		static const uint32_t BUFFER_SIZE = 24 * 16 * 16384;
 		uint32_t BUFFER_COUNT = 2;
@@ -42,6 +50,8 @@ namespace Device {
 
 		void ReadAsync();
 		void Run();
+		void RunMapped();
+		void RunBenchmark();
 
 	public:
 		RAWFile() : Device(Format::CU8, 1536000, Type::RAWFILE) {}
@@ -56,6 +66,7 @@ namespace Device {
 		// Settings
 		Setting& Set(std::string option, std::string arg);
 		std::string Get();
+		FIFO *getFIFO() { return &fifo; }
 		std::string getProduct() { return "File (RAW)"; }
 		std::string getVendor() { return "File"; }
 		std::string getSerial() { return filename; }
@@ -94,15 +94,53 @@ namespace Device {
 		if (chunk.ID != 0x61746164) throw std::runtime_error("no Data in WAV-file.");
 
 		Device::setSampleRate(header.dwSamplesPerSec);
+
+		if (mapped) {
+			offset = (uint64_t)file.tellg();
+			file.close();
+
+			map.open(filename);
+			data_end = std::min(offset + chunk.size, map.size());
+		}
 	}
 
 	void WAVFile::Close() {
 		Device::Close();
 
 		file.close();
+		map.close();
+	}
+
+	void WAVFile::Play() {
+		Device::Play();
+		clock.reset(getFormat(), getSampleRate());
+	}
+
+	// full blocks are sent from the mapped file directly, the last one is padded with zeros
+	bool WAVFile::nextMapped() {
+		if (offset >= data_end || !Device::isStreaming()) return false;
+
+		uint64_t n = std::min((uint64_t)buffer_size, data_end - offset);
+		RAW r = { getFormat(), map.data() + offset, buffer_size };
+
+		if (n < buffer_size) {
+			buffer.assign(buffer_size, 0);
+			std::memcpy(buffer.data(), map.data() + offset, n);
+			r.data = buffer.data();
+		}
+
+		Send(&r, 1, tag);
+
+		offset += n;
+		clock.wait(n);
+
+		if (offset >= data_end) clock.report(filename);
+		return true;
 	}
 
 	bool WAVFile::isStreaming() {
+		if (mapped) return nextMapped();
+
 		if (file.eof() || !Device::isStreaming()) return false;
 
 		if (buffer.size() != buffer_size) buffer.resize(buffer_size);
@@ -113,6 +151,9 @@ namespace Device {
 		RAW r = { getFormat(), buffer.data(), (int)buffer.size() };
 		Send(&r, 1, tag);
 
+		clock.wait(file.gcount());
+		if (file.eof()) clock.report(filename);
+
 		return true;
 	}
 
@@ -121,6 +162,10 @@ namespace Device {
 
 		if (option == "FILE")
 			filename = arg;
+		else if (option == "MMAP")
+			mapped = Util::Parse::Switch(arg);
+		else if (option == "SPEED")
+			clock.setSpeed(Util::Parse::Float(arg, 0, 1000));
 		else
 			Device::Set(option, arg);
 
@@ -128,6 +173,6 @@ namespace Device {
 	}
 
 	std::string WAVFile::Get() {
-		return Device::Get() + " file " + filename;
+		return Device::Get() + " file " + filename + " mmap " + Util::Convert::toString(mapped) + " speed " + Util::Convert::toString((FLOAT32)clock.getSpeed());
 	}
 }
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "Device.h"
+#include "FileMap.h"
 
 namespace Device
 {
@@ -30,12 +31,20 @@ namespace Device
 		std::vector<uint8_t> buffer;
 		const int buffer_size = 16 * 16384;
 
+		bool mapped = false;
+		FileMap map;
+		uint64_t offset = 0, data_end = 0;
+		ReplayClock clock;
+
+		bool nextMapped();
+
 	public:
 		WAVFile() : Device(Format::CU8, 1536000, Type::WAVFILE) {}
 
 		// Control
 		void Close();
 		void Open(uint64_t);
+		void Play();
 		bool isCallback() { return false; }
 		bool isStreaming();
 
@@ -79,7 +79,9 @@ namespace Device
 	void HACKRF::callback(uint8_t *data, int len)
 	{
 		RAW r = {Format::CS8, data, len};
+		steady_clock::time_point t = steady_clock::now();
 		Send(&r, 1, tag);
+		countLatency(t);
 	}
 
 	void HACKRF::applySettings()
@@ -21,6 +21,7 @@
 #include <iomanip>
 
 #include "HYDRASDR.h"
+#include "Kernels.h"
 
 namespace Device
 {
@@ -35,7 +36,12 @@ namespace Device
 		if (hydrasdr_open_sn(&dev, h) != HYDRASDR_SUCCESS)
 			throw std::runtime_error("HYDRASDR: cannot open device.");
 
-		if (real_mode)
+		if (packed)
+		{
+			hydrasdr_set_packing(dev, 1);
+			hydrasdr_set_sample_type(dev, HYDRASDR_SAMPLE_RAW);
+		}
+		else if (real_mode)
 			hydrasdr_set_sample_type(dev, HYDRASDR_SAMPLE_FLOAT32_REAL);
 		else
 			hydrasdr_set_sample_type(dev, HYDRASDR_SAMPLE_FLOAT32_IQ);
@@ -51,7 +57,12 @@ namespace Device
 		if (hydrasdr_open_fd(&dev, fd) != HYDRASDR_SUCCESS)
 			throw std::runtime_error("HYDRASDR: cannot open device.");
 
-		if (real_mode)
+		if (packed)
+		{
+			hydrasdr_set_packing(dev, 1);
+			hydrasdr_set_sample_type(dev, HYDRASDR_SAMPLE_RAW);
+		}
+		else if (real_mode)
 			hydrasdr_set_sample_type(dev, HYDRASDR_SAMPLE_FLOAT32_REAL);
 		else
 			hydrasdr_set_sample_type(dev, HYDRASDR_SAMPLE_FLOAT32_IQ);
@@ -115,12 +126,34 @@ namespace Device
 	void HYDRASDR::callback(CFLOAT32 *data, int len)
 	{
 		RAW r = {real_mode ? Format::F32_FS4 : Format::CF32, data, (int)(len * (real_mode ? sizeof(FLOAT32) : sizeof(CFLOAT32)))};
+		steady_clock::time_point t = steady_clock::now();
 		Send(&r, 1, tag);
+		countLatency(t);
+	}
+
+	void HYDRASDR::callbackPacked(const uint32_t *data, int len)
+	{
+		// whole groups of 8 samples, libairspy delivers 2^17 samples per transfer
+		len &= ~7;
+		if ((int)unpacked.size() < len)
+			unpacked.resize(len);
+
+		DSP::Kernels::unpack12FS4(data, unpacked.data(), len);
+
+		RAW r = {Format::CS16, unpacked.data(), (int)(len * sizeof(CS16))};
+		steady_clock::time_point t = steady_clock::now();
+		Send(&r, 1, tag);
+		countLatency(t);
 	}
 
 	int HYDRASDR::callback_static(hydrasdr_transfer *tf)
 	{
-		((HYDRASDR *)tf->ctx)->callback((CFLOAT32 *)tf->samples, tf->sample_count);
+		HYDRASDR *d = (HYDRASDR *)tf->ctx;
+
+		if (d->packed)
+			d->callbackPacked((const uint32_t *)tf->samples, tf->sample_count);
+		else
+			d->callback((CFLOAT32 *)tf->samples, tf->sample_count);
 		return 0;
 	}
 
@@ -202,7 +235,7 @@ namespace Device
 
 	void HYDRASDR::applyBandwidth()
 	{
-		if (tuner_bandwidth >= 0 && real_mode)
+		if (tuner_bandwidth >= 0 && (real_mode || packed))
 		{
 			int i, j;
 
@@ -300,11 +333,16 @@ namespace Device
 		{
 			bias_tee = Util::Parse::Switch(arg);
 		}
-		else if (option == "REAL_MODE")
+		else if (option == "REAL_MODE" || option == "PACKED")
 		{
-			real_mode = Util::Parse::Switch(arg);
+			if (option == "PACKED")
+				packed = Util::Parse::Switch(arg);
+			else
+				real_mode = Util::Parse::Switch(arg);
 
-			if (real_mode)
+			if (packed)
+				format = Format::CS16;
+			else if (real_mode)
 				format = Format::F32_FS4;
 			else
 				format = Format::CF32;
@@ -347,6 +385,6 @@ namespace Device
 			break;
 		}
 
-		return Device::Get() + str + " biastee " + Util::Convert::toString(bias_tee) + " real_mode " + Util::Convert::toString(real_mode) + " ";
+		return Device::Get() + str + " biastee " + Util::Convert::toString(bias_tee) + " real_mode " + Util::Convert::toString(real_mode) + " packed " + Util::Convert::toString(packed) + " ";
 	}
 }
@@ -50,6 +50,8 @@ namespace Device
 
 		bool bias_tee = false;
 		bool real_mode = false;
+		// 12-bit packed USB transfers, real mode samples unpacked by AIS-catcher
+		bool packed = false;
 
 #ifdef HASHYDRASDR
 
@@ -58,8 +60,11 @@ namespace Device
 		std::vector<uint32_t> rates;
 		uint64_t serial;
 
+		std::vector<CS16> unpacked;
+
 		static int callback_static(hydrasdr_transfer *tf);
 		void callback(CFLOAT32 *, int);
+		void callbackPacked(const uint32_t *, int);
 
 		void setBiasTee(bool);
 		void setLNA_AGC(int);
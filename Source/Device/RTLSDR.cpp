@@ -75,7 +75,8 @@ namespace Device
 
 	void RTLSDR::Play()
 	{
-		fifo.Init(BUFFER_SIZE, BUFFER_COUNT);
+		if (!zero_copy)
+			initFIFO(fifo, BUFFER_SIZE, BUFFER_COUNT);
 
 		applySettings();
 
@@ -85,7 +86,8 @@ namespace Device
 		rtlsdr_reset_buffer(dev);
 
 		async_thread = std::thread(&RTLSDR::RunAsync, this);
-		run_thread = std::thread(&RTLSDR::Run, this);
+		if (!zero_copy)
+			run_thread = std::thread(&RTLSDR::Run, this);
 
 		SleepSystem(10);
 	}
@@ -109,7 +111,9 @@ namespace Device
 
 	void RTLSDR::RunAsync()
 	{
-		rtlsdr_read_async(dev, (rtlsdr_read_async_cb_t) & (RTLSDR::callback_static), this, 0, BUFFER_SIZE);
+		policy_read.apply("RTLSDR read");
+		// in zero copy mode the driver buffers are the only buffers, so let librtlsdr allocate BUFFER_COUNT of them
+		rtlsdr_read_async(dev, (rtlsdr_read_async_cb_t) & (RTLSDR::callback_static), this, zero_copy ? BUFFER_COUNT : 0, BUFFER_SIZE);
 
 		// did we terminate too early?
 		if (isStreaming())
@@ -121,6 +125,7 @@ namespace Device
 
 	void RTLSDR::Run()
 	{
+		policy_run.apply("RTLSDR run");
 		try
 		{
 			while (isStreaming())
@@ -129,6 +134,7 @@ namespace Device
 				{
 					RAW r = {Format::CU8, fifo.Front(), fifo.BlockSize()};
 
+					stampCapture(fifo);
 					Send(&r, 1, tag);
 					fifo.Pop();
 				}
@@ -148,7 +154,26 @@ namespace Device
 
 	void RTLSDR::callback(CU8 *buf, int len)
 	{
-		if (isStreaming() && !fifo.Push((char *)buf, len))
+		if (!isStreaming())
+			return;
+
+		if (zero_copy)
+		{
+			// the buffer is handed to the chain by reference and returned to librtlsdr when we return
+			try
+			{
+				RAW r = {Format::CU8, buf, len};
+				steady_clock::time_point t = steady_clock::now();
+				Send(&r, 1, tag);
+				countLatency(t);
+			}
+			catch (std::exception &e)
+			{
+				Error() << "RTLSDR callback: " << e.what();
+				StopRequest();
+			}
+		}
+		else if (!fifo.Push((char *)buf, len))
 			Error() << "RTLSDR: buffer overrun.";
 	}
 
@@ -268,6 +293,10 @@ namespace Device
 		{
 			BUFFER_COUNT = Util::Parse::Integer(arg, 1, 100);
 		}
+		else if (option == "ZERO_COPY")
+		{
+			zero_copy = Util::Parse::Switch(arg);
+		}
 		else if (option == "RTLAGC")
 		{
 			RTL_AGC = Util::Parse::Switch(arg);
@@ -286,7 +315,7 @@ namespace Device
 	{
 		std::string str = " tuner " + Util::Convert::toString(tuner_AGC, tuner_Gain);
 		str += " rtlagc " + Util::Convert::toString(RTL_AGC) + " biastee " + Util::Convert::toString(bias_tee);
-		str += " buffer_count " + std::to_string(BUFFER_COUNT);
+		str += " buffer_count " + std::to_string(BUFFER_COUNT) + " zero_copy " + Util::Convert::toString(zero_copy);
 
 		return Device::Get() + str;
 	}
@@ -42,6 +42,7 @@ namespace Device
 		FLOAT32 tuner_Gain = 33.0;
 		bool bias_tee = false;
 		uint32_t BUFFER_COUNT = 24;
+		bool zero_copy = false;
 
 #ifdef HASRTLSDR
 
@@ -95,6 +96,8 @@ namespace Device
 		std::string getSerial() { return serial; }
 
 		void setFormat(Format f) {}
+
+		FIFO *getFIFO() { return &fifo; }
 #endif
 
 	public:
@@ -53,6 +53,10 @@ namespace Device
 		case PROTOCOL::WS:
 			session = tcp.add(&ws);
 			break;
+		case PROTOCOL::IQLINK:
+			session = tcp.add(&iqlink);
+			iqlink.setValue("RATE", std::to_string(sample_rate));
+			break;
 		case PROTOCOL::WSMQTT:
 			session = tcp.add(&ws);
 			session = ws.add(&mqtt);
@@ -78,11 +82,12 @@ namespace Device
 
 		if (getFormat() != Format::TXT && getFormat() != Format::BASESTATION && getFormat() != Format::BEAST && getFormat() != Format::RAW1090)
 		{
-			fifo.Init(BUFFER_SIZE);
+			initFIFO(fifo, BUFFER_SIZE, 2);
 		}
 		else
 		{
 			fifo.Init(1, BUFFER_SIZE);
+			fifo.setTimeout(0);
 		}
 
 		lost = false;
@@ -111,6 +116,7 @@ namespace Device
 
 	void RTLTCP::RunAsync()
 	{
+		policy_read.apply("RTLTCP read");
 		if (buffer.size() < TRANSFER_SIZE)
 			buffer.resize(TRANSFER_SIZE);
 
@@ -132,6 +138,7 @@ namespace Device
 
 	void RTLTCP::Run()
 	{
+		policy_run.apply("RTLTCP run");
 		std::vector<char> output(fifo.BlockSize());
 		RAW r = {getFormat(), NULL, fifo.BlockSize()};
 
@@ -143,6 +150,7 @@ namespace Device
 				r.data = fifo.Front(nblocks);
 				r.size = nblocks * fifo.BlockSize();
 
+				stampCapture(fifo);
 				Send(&r, 1, tag);
 				fifo.Pop(nblocks);
 			}
@@ -222,6 +230,11 @@ namespace Device
 			case PROTOCOL::RAW1090:
 				setFormat(Format::RAW1090);
 				break;
+			case PROTOCOL::IQLINK:
+				// the remote end sends the decimated 96K band
+				setFormat(Format::CF32);
+				setSampleRate(96000);
+				break;
 			default:
 				throw std::runtime_error("RTLTCP: unsupported protocol: " + arg);
 			}
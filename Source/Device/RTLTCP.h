@@ -37,6 +37,7 @@ namespace Device
 		Protocol::GPSD gpsd;
 		Protocol::RTLTCP rtltcp;
 		Protocol::WebSocket ws;
+		Protocol::IQLink iqlink;
 		Protocol::ProtocolBase *session = &tcp;
 
 		const int TRANSFER_SIZE = 16384;
@@ -80,6 +81,7 @@ namespace Device
 		// Settings
 		Setting &Set(std::string option, std::string arg);
 		std::string Get();
+		FIFO *getFIFO() { return &fifo; }
 
 		std::string getProduct() { return "RTLTCP"; }
 		std::string getSerial() { return /*"P" + port*/ ""; }
@@ -106,7 +106,7 @@ namespace Device {
 	}
 
 	void SDRPLAY::Play() {
-		fifo.Init(16 * 16384, 8);
+		initFIFO(fifo, 16 * 16384, 8);
 
 		deviceParams->devParams->fsFreq.fsHz = sample_rate;
 		chParams->tunerParams.ifType = sdrplay_api_IF_Zero;
@@ -176,9 +176,11 @@ namespace Device {
 	}
 
 	void SDRPLAY::Run() {
+		policy_run.apply("SDRPLAY run");
 		while (isStreaming()) {
 			if (fifo.Wait()) {
 				RAW r = { Format::CF32, fifo.Front(), fifo.BlockSize() };
+				stampCapture(fifo);
 				Send(&r, 1, tag);
 				fifo.Pop();
 			}
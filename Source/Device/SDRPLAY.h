@@ -78,6 +78,8 @@ namespace Device {
 		std::string getSerial() { return device.SerNo; }
 
 		void setFormat(Format f) {}
+
+		FIFO *getFIFO() { return &fifo; }
 #endif
 		// Settings
 		Setting& Set(std::string option, std::string arg);
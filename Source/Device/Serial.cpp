@@ -25,6 +25,13 @@
 #include <limits.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#endif
+
 #include "Serial.h"
 #include "Helper.h"
 
@@ -61,11 +68,175 @@ namespace Device
 	// Initialize static member
 	std::vector<std::string> SerialPort::device_list;
 
+#ifdef __linux__
+	// one epoll thread that reads all serial ports with SHARED on, the thread runs while ports are registered
+	class SerialPoller
+	{
+		int epfd = -1;
+		std::thread thread;
+		std::mutex mtx;
+		std::map<int, SerialPort *> ports;
+		std::atomic<bool> stop{false};
+
+		// the thread takes AFFINITY/PRIORITY of the port that started it
+		void run()
+		{
+			epoll_event events[16];
+
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if (!ports.empty())
+					ports.begin()->second->policy_read.apply("Serial poll");
+			}
+
+			while (!stop)
+			{
+				int n = epoll_wait(epfd, events, 16, 50);
+
+				std::lock_guard<std::mutex> lock(mtx);
+
+				for (int i = 0; i < n; i++)
+				{
+					auto it = ports.find(events[i].data.fd);
+					if (it != ports.end() && !it->second->lost && !it->second->readAvailable())
+						epoll_ctl(epfd, EPOLL_CTL_DEL, it->first, nullptr);
+				}
+
+				for (auto &p : ports)
+					p.second->onIdle();
+			}
+		}
+
+	public:
+		~SerialPoller()
+		{
+			if (epfd != -1)
+				close(epfd);
+		}
+
+		static SerialPoller &get()
+		{
+			static SerialPoller poller;
+			return poller;
+		}
+
+		void add(int fd, SerialPort *port)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+
+			if (epfd == -1 && (epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+				throw std::runtime_error(std::string("Serial: epoll_create1 failed: ") + strerror(errno));
+
+			epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.fd = fd;
+
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+				throw std::runtime_error(std::string("Serial: epoll_ctl failed: ") + strerror(errno));
+
+			ports[fd] = port;
+
+			if (!thread.joinable())
+			{
+				stop = false;
+				thread = std::thread(&SerialPoller::run, this);
+			}
+		}
+
+		void remove(int fd)
+		{
+			bool last;
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+
+				epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+				ports.erase(fd);
+				last = ports.empty();
+			}
+
+			if (last && thread.joinable())
+			{
+				stop = true;
+				thread.join();
+			}
+		}
+	};
+#endif
+
+	// with BATCH on, only complete lines are forwarded, a partial line is held until it completes or the window expires
+	void SerialPort::onData(char *data, int len)
+	{
+		if (!batch)
+		{
+			RAW r = {getFormat(), data, len};
+			Dump(r);
+			Send(&r, 1, tag);
+			return;
+		}
+
+		if (pending.empty())
+			pending_since = std::chrono::steady_clock::now();
+
+		pending.append(data, len);
+
+		std::size_t end = pending.find_last_of('\n');
+		if (end != std::string::npos)
+			flush((int)end + 1);
+		else if (pending.size() >= BUFFER_SIZE)
+			flush((int)pending.size());
+	}
+
+	void SerialPort::onIdle()
+	{
+		if (!pending.empty() && std::chrono::steady_clock::now() - pending_since >= std::chrono::milliseconds(batch))
+			flush((int)pending.size());
+	}
+
+	void SerialPort::flush(int len)
+	{
+		RAW r = {getFormat(), (void *)pending.data(), len};
+		Dump(r);
+		Send(&r, 1, tag);
+
+		pending.erase(0, len);
+		pending_since = std::chrono::steady_clock::now();
+	}
+
+#ifndef _WIN32
+	// SHARED: drain the non-blocking descriptor, false if the port has failed
+	bool SerialPort::readAvailable()
+	{
+		char buffer[16384];
+
+		while (true)
+		{
+			int nread = read(serial_fd, buffer, sizeof(buffer));
+
+			if (nread > 0)
+			{
+				onData(buffer, nread);
+				continue;
+			}
+
+			if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				return true;
+
+			if (nread == 0)
+				Error() << "Serial read encountered an error: unexpected end." << std::endl;
+			else
+				Error() << "Serial read encountered an error: " << strerror(errno) << std::endl;
+
+			lost = true;
+			return false;
+		}
+	}
+#endif
+
 	void SerialPort::ReadAsync()
 	{
+		policy_read.apply("Serial read");
 
 		char buffer[16384];
-		RAW r = {getFormat(), buffer, 0};
 
 #ifdef _WIN32
 		Debug() << "Serial: starting thread" << std::endl;
@@ -77,12 +248,11 @@ namespace Device
 			{
 				if (bytesRead > 0)
 				{
-					r.size = bytesRead;
-					Dump(r);
-					Send(&r, 1, tag);
+					onData(buffer, bytesRead);
 				}
 				else
 				{
+					onIdle();
 					SleepSystem(100);
 				}
 			}
@@ -104,6 +274,11 @@ namespace Device
 			FD_SET(serial_fd, &read_fds);
 
 			struct timeval timeout = {1, 0};
+			if (batch)
+			{
+				timeout.tv_sec = batch / 1000;
+				timeout.tv_usec = (batch % 1000) * 1000;
+			}
 
 			int rslt = select(serial_fd + 1, &read_fds, NULL, NULL, &timeout);
 			if (rslt > 0)
@@ -111,9 +286,7 @@ namespace Device
 				int nread = read(serial_fd, buffer, sizeof(buffer));
 				if (nread > 0)
 				{
-					r.size = nread;
-					Dump(r);
-					Send(&r, 1, tag);
+					onData(buffer, nread);
 				}
 				else
 				{
@@ -133,6 +306,8 @@ namespace Device
 				Error() << "Serial read encountered an error: " << strerror(errno) << std::endl;
 				lost = true;
 			}
+			else
+				onIdle();
 		}
 #endif
 	}
@@ -336,8 +511,9 @@ namespace Device
 		if (flowcontrol == FlowControl::SOFTWARE)
 			Info() << "Serial: software flow control enabled";
 
-		tty.c_cc[VMIN] = 1;
-		tty.c_cc[VTIME] = 0;
+		// with BATCH a read returns after 255 bytes or a gap in the input, instead of per byte
+		tty.c_cc[VMIN] = batch ? 255 : 1;
+		tty.c_cc[VTIME] = batch ? MIN(255, MAX(1, batch / 100)) : 0;
 
 		if (tcsetattr(serial_fd, TCSANOW, &tty) < 0)
 		{
@@ -377,15 +553,39 @@ namespace Device
 		Device::Play();
 
 		lost = false;
+		pending.clear();
+
+#ifdef __linux__
+		if (shared)
+		{
+			fcntl(serial_fd, F_SETFL, fcntl(serial_fd, F_GETFL) | O_NONBLOCK);
+			SerialPoller::get().add(serial_fd, this);
+			polled = true;
+			return;
+		}
+#else
+		if (shared)
+			Warning() << "Serial: SHARED is only available on Linux, using a read thread per port.";
+#endif
 		read_thread = std::thread(&SerialPort::ReadAsync, this);
 	}
 	void SerialPort::Stop()
 	{
 		lost = true;
+#ifdef __linux__
+		if (polled)
+		{
+			SerialPoller::get().remove(serial_fd);
+			polled = false;
+		}
+#endif
 		if (read_thread.joinable())
 		{
 			read_thread.join();
 		}
+
+		if (!pending.empty())
+			flush((int)pending.size());
 	}
 
 	Setting &SerialPort::Set(std::string option, std::string arg)
@@ -411,6 +611,14 @@ namespace Device
 		{
 			print = Util::Parse::Switch(arg);
 		}
+		else if (option == "BATCH")
+		{
+			batch = Util::Parse::Integer(arg, 0, 10000, option);
+		}
+		else if (option == "SHARED")
+		{
+			shared = Util::Parse::Switch(arg);
+		}
 		else if (option == "INIT_SEQ")
 		{
 			init_sequence = arg;
@@ -457,7 +665,9 @@ namespace Device
 			   " baudrate " + std::to_string(baudrate) +
 			   " flowcontrol " + fc_str +
 			   " port " + port +
-			   " print " + Util::Convert::toString(print);
+			   " print " + Util::Convert::toString(print) +
+			   (batch ? " batch " + std::to_string(batch) : "") +
+			   (shared ? " shared ON" : "");
 	}
 	void SerialPort::getDeviceList(std::vector<Description> &DeviceList)
 	{
@@ -22,6 +22,7 @@
 #include <vector>
 #include <thread>
 #include <string>
+#include <chrono>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -33,6 +34,7 @@
 
 namespace Device
 {
+	class SerialPoller;
 
 	class SerialPort : public Device
 	{
@@ -81,6 +83,13 @@ namespace Device
 		bool print = false;
 		std::string init_sequence;
 
+		// BATCH: input is collected for up to batch ms and forwarded as complete lines, with SHARED the port is
+		// read from one epoll thread for all shared ports instead of its own thread (Linux)
+		int batch = 0;
+		bool shared = false, polled = false;
+		std::string pending;
+		std::chrono::steady_clock::time_point pending_since;
+
 		static const uint32_t BUFFER_SIZE = 16 * 16384;
 
 		// Static vector to store device paths (handle = vector index)
@@ -89,6 +98,13 @@ namespace Device
 		void ReadAsync();
 		void Dump(RAW &r);
 
+		void onData(char *data, int len);
+		void onIdle();
+		void flush(int len);
+		bool readAvailable();
+
+		friend class SerialPoller;
+
 	public:
 		SerialPort() : Device(Format::TXT, 288000, Type::SERIALPORT), port(""), baudrate(38400) {};
 		~SerialPort();
@@ -45,8 +45,6 @@ namespace Device {
 	}
 
 	void SOAPYSDR::Play() {
-		fifo.Init(BUFFER_SIZE, 8);
-
 		try {
 			dev = SoapySDR::Device::make(device_args);
 		}
@@ -55,6 +53,9 @@ namespace Device {
 		}
 
 		applySettings();
+		negotiateFormat();
+
+		initFIFO(fifo, BUFFER_SIZE, 8);
 
 		Device::Play();
 		lost = false;
@@ -81,13 +82,75 @@ namespace Device {
 		}
 	}
 
+	static bool toFormat(const std::string& s, Format& f) {
+		if (s == SOAPY_SDR_CU8)
+			f = Format::CU8;
+		else if (s == SOAPY_SDR_CS8)
+			f = Format::CS8;
+		else if (s == SOAPY_SDR_CS16)
+			f = Format::CS16;
+		else if (s == SOAPY_SDR_CF32)
+			f = Format::CF32;
+		else
+			return false;
+
+		return true;
+	}
+
+	static std::string toSoapyFormat(Format f) {
+		switch (f) {
+		case Format::CU8:
+			return SOAPY_SDR_CU8;
+		case Format::CS8:
+			return SOAPY_SDR_CS8;
+		case Format::CS16:
+			return SOAPY_SDR_CS16;
+		default:
+			return SOAPY_SDR_CF32;
+		}
+	}
+
+	// prefer the format the driver delivers without converting, the model front-end accepts all raw formats
+	void SOAPYSDR::negotiateFormat() {
+		if (auto_format) {
+			double full_scale = 0;
+			Format f;
+
+			stream_format = Format::CF32;
+
+			try {
+				if (toFormat(dev->getNativeStreamFormat(SOAPY_SDR_RX, channel, full_scale), f)) {
+					stream_format = f;
+				}
+				else {
+					for (const auto& s : dev->getStreamFormats(SOAPY_SDR_RX, channel))
+						if (s == SOAPY_SDR_CS16) stream_format = Format::CS16;
+				}
+			}
+			catch (std::exception& e) {
+				Warning() << "SOAPYSDR: cannot query stream formats, using CF32." << std::endl;
+			}
+		}
+
+		Device::setFormat(stream_format);
+	}
+
+	void SOAPYSDR::setFormat(Format f) {
+		if (f != Format::CU8 && f != Format::CS8 && f != Format::CS16 && f != Format::CF32)
+			throw std::runtime_error("SOAPYSDR: format not supported, use CU8, CS8, CS16 or CF32.");
+
+		stream_format = f;
+		auto_format = false;
+	}
+
 	void SOAPYSDR::RunAsync() {
+		policy_read.apply("SOAPYSDR read");
 		std::vector<size_t> channels;
 		channels.push_back(channel);
 
 		SoapySDR::Stream* stream;
 		try {
-			stream = dev->setupStream(SOAPY_SDR_RX, "CF32", channels, stream_args);
+			stream = dev->setupStream(SOAPY_SDR_RX, toSoapyFormat(stream_format), channels, stream_args);
 		}
 		catch (std::exception& e) {
 			Error()  << "SOAPYSDR: " << e.what() << std::endl;
@@ -95,9 +158,11 @@ namespace Device {
 			return;
 		}
 
-		const int BUFFER_SIZE = dev->getStreamMTU(stream);
+		// one transfer unit per read, in the format delivered by the driver
+		const int MTU = dev->getStreamMTU(stream);
+		const int bytes_per_sample = Util::bytesPerSample(stream_format);
 
-		std::vector<CFLOAT32> input(BUFFER_SIZE);
+		std::vector<char> input((size_t)MTU * bytes_per_sample);
 		void* buffers[] = { input.data() };
 		long long timeNs = 0;
 		int flags = 0;
@@ -106,14 +171,14 @@ namespace Device {
 			dev->activateStream(stream);
 
 			while (isStreaming()) {
-				int ret = dev->readStream(stream, buffers, BUFFER_SIZE, flags, timeNs);
+				int ret = dev->readStream(stream, buffers, MTU, flags, timeNs);
 
 				if (ret < 0) {
 					Error()  << "SOAPYSDR: error reading stream: " << SoapySDR_errToStr(ret) << std::endl;
 					lost = true;
 					skip_unmake = true;
 				}
-				if (ret > 0 && isStreaming() && !fifo.Push((char*)input.data(), ret * sizeof(CFLOAT32)))
+				if (ret > 0 && isStreaming() && !fifo.Push(input.data(), ret * bytes_per_sample))
 					Error()  << "SOAPYSDR: buffer overrun." << std::endl;
 			}
 		}
@@ -131,9 +196,11 @@ namespace Device {
 	}
 
 	void SOAPYSDR::Run() {
+		policy_run.apply("SOAPYSDR run");
 		while (isStreaming()) {
 			if (fifo.Wait()) {
-				RAW r = { Format::CF32, fifo.Front(), fifo.BlockSize() };
+				RAW r = { stream_format, fifo.Front(), fifo.BlockSize() };
+				stampCapture(fifo);
 				Send(&r, 1, tag);
 				fifo.Pop();
 			}
@@ -24,6 +24,7 @@
 #include <SoapySDR/Modules.hpp>
 #include <SoapySDR/Registry.hpp>
 #include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.h>
 #endif
 
 namespace Device {
@@ -80,6 +81,12 @@ namespace Device {
 		void applySettings();
 		int findRate(const std::vector<double>&);
 
+		// stream format requested from the driver, the native one unless set explicitly
+		bool auto_format = true;
+		Format stream_format = Format::CF32;
+
+		void negotiateFormat();
+
 	public:
 		// Control
 		void Open(uint64_t h);
@@ -92,7 +99,9 @@ namespace Device {
 
 		void getDeviceList(std::vector<Description>& DeviceList);
 
-		void setFormat(Format f) {}
+		void setFormat(Format f);
+
+		FIFO *getFIFO() { return &fifo; }
 #endif
 
 	public:
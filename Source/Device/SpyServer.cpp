@@ -32,8 +32,7 @@ namespace Device
 	//---------------------------------------
 	// Device SPYSERVER
 
-	// TO DO: implement formats (currently sets CS16 as output but accepts most return types),
-	//        channels, digital gain and recovery in case we get off sync with headers if needed
+	// TO DO: channels and recovery in case we get off sync with headers if needed
 
 	void SpyServer::Open(uint64_t h)
 	{
@@ -57,7 +56,7 @@ namespace Device
 		}
 
 		uint32_t distance = device_info.MaximumSampleRate;
-		uint32_t new_rate = 0;
+		uint32_t new_rate = 0, lowest_rate = 0;
 
 		for (int i = device_info.MinimumIQDecimation; i <= device_info.DecimationStageCount; i++)
 		{
@@ -72,6 +71,7 @@ namespace Device
 					new_rate = rate;
 					distance = d;
 				}
+				lowest_rate = rate;
 			}
 		}
 		if (_sample_rates.size() == 0)
@@ -80,7 +80,52 @@ namespace Device
 			throw std::runtime_error("SPYSERVER: no sample rate > 96Khz available. Highest sample rate = " +
 									 std::to_string(device_info.MaximumSampleRate >> device_info.MinimumIQDecimation) + " Hz.");
 		}
+
+		// the model only needs the 96K band around the AIS channels, so let the server decimate as far as possible
+		if (auto_rate)
+		{
+			new_rate = lowest_rate;
+			Info() << "SPYSERVER: requesting " << new_rate << " Hz from server (decimation stage " << _sample_rates.back().second << ").";
+		}
 		sample_rate = new_rate;
+
+		negotiateFormat();
+	}
+
+	void SpyServer::negotiateFormat()
+	{
+		switch (device_info.ForcedIQFormat)
+		{
+		case STREAM_FORMAT_INVALID:
+			break;
+		case STREAM_FORMAT_UINT8:
+			stream_format = Format::CU8;
+			return;
+		case STREAM_FORMAT_INT16:
+			stream_format = Format::CS16;
+			return;
+		case STREAM_FORMAT_FLOAT:
+			stream_format = Format::CF32;
+			return;
+		default:
+			client.disconnect();
+			throw std::runtime_error("SPYSERVER: server forces an IQ format that is not supported.");
+		}
+
+		// 8 bits per component is ample for the FM demodulators after server side decimation and halves the traffic of CS16
+		if (auto_format)
+			stream_format = Format::CU8;
+
+		Info() << "SPYSERVER: requesting " << Util::Convert::toString(stream_format) << " samples from server.";
+	}
+
+	void SpyServer::setFormat(Format f)
+	{
+		if (f != Format::CU8 && f != Format::CS16 && f != Format::CF32)
+			throw std::runtime_error("SPYSERVER: format not supported, use CU8, CS16 or CF32.");
+
+		stream_format = f;
+		auto_format = false;
 	}
 
 	void SpyServer::Close()
@@ -93,7 +138,7 @@ namespace Device
 	{
 		Device::Play();
 
-		fifo.Init(16 * 16384, 8);
+		initFIFO(fifo, 16 * 16384, 8);
 		lost = false;
 
 		applySettings();
@@ -223,8 +268,8 @@ namespace Device
 	void SpyServer::applySettings()
 	{
 		sendSetting(SETTING_STREAMING_MODE, {STREAM_MODE_IQ_ONLY});
-		sendSetting(SETTING_IQ_DIGITAL_GAIN, {0x0});
-		Device::setFormat(Format::CS16);
+		sendSetting(SETTING_IQ_DIGITAL_GAIN, {digital_gain});
+		Device::setFormat(stream_format);
 		sendStreamFormat();
 		setFreq(getCorrectedFrequency());
 		setRate(sample_rate);
@@ -300,6 +345,7 @@ namespace Device
 
 	void SpyServer::RunAsync()
 	{
+		policy_read.apply("SpyServer read");
 		std::vector<char> data(BUFFER_SIZE);
 
 		while (isStreaming())
@@ -353,11 +399,13 @@ namespace Device
 
 	void SpyServer::Run()
 	{
+		policy_run.apply("SpyServer run");
 		while (isStreaming())
 		{
 			if (fifo.Wait())
 			{
 				RAW r = {getFormat(), fifo.Front(), fifo.BlockSize()};
+				stampCapture(fifo);
 				Send(&r, 1, tag);
 				fifo.Pop();
 			}
@@ -444,6 +492,9 @@ namespace Device
 	{
 		Util::Convert::toUpper(option);
 
+		std::string value = arg;
+		Util::Convert::toUpper(value);
+
 		client.setValue(option, arg);
 
 		if (option == "URL")
@@ -462,6 +513,18 @@ namespace Device
 		{
 			tuner_gain = Util::Parse::Float(arg, 0, 50);
 		}
+		else if (option == "DIGITAL_GAIN")
+		{
+			digital_gain = Util::Parse::Integer(arg, 0, 255);
+		}
+		else if (option == "FORMAT" && value == "AUTO")
+		{
+			auto_format = true;
+		}
+		else if ((option == "RATE" || option == "SAMPLE_RATE") && value == "AUTO")
+		{
+			auto_rate = true;
+		}
 		else if (option == "HOST")
 		{
 			host = arg;
@@ -478,6 +541,6 @@ namespace Device
 
 	std::string SpyServer::Get()
 	{
-		return Device::Get() + " host " + host + " port " + port + " gain " + std::to_string(tuner_gain);
+		return Device::Get() + " host " + host + " port " + port + " gain " + std::to_string(tuner_gain) + " digital_gain " + std::to_string(digital_gain);
 	}
 }
@@ -210,6 +210,14 @@ namespace Device {
 
 		std::vector<std::pair<double, uint32_t>> _sample_rates;
 
+		// rate and format are negotiated with the server unless set explicitly
+		bool auto_rate = true;
+		bool auto_format = true;
+		Format stream_format = Format::CU8;
+		uint32_t digital_gain = 0;
+
+		void negotiateFormat();
+
 		bool sendSetting(uint32_t type, const std::vector<uint32_t>& params);
 		void sendStreamFormat();
 		bool setFreq(uint32_t f);
@@ -238,8 +246,14 @@ namespace Device {
 		// Settings
 		Setting& Set(std::string option, std::string arg);
 		std::string Get();
+		FIFO *getFIFO() { return &fifo; }
 
 		std::string getProduct() { return "SPYSERVER"; }
-		void setFormat(Format f) {}
+		void setFormat(Format f);
+		void setSampleRate(uint32_t s)
+		{
+			auto_rate = false;
+			Device::setSampleRate(s);
+		}
 	};
 }
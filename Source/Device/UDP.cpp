@@ -16,8 +16,15 @@
 */
 
 #include <cstring>
+#include <vector>
 #ifndef _WIN32
 #include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#endif
+#ifdef __linux__
+#include <sys/uio.h>
 #endif
 
 #include "UDP.h"
@@ -39,6 +46,43 @@ namespace Device
 		}
 	}
 
+	void UDP::joinGroup()
+	{
+		if (address->ai_family == AF_INET)
+		{
+			struct ip_mreq mreq;
+			memset(&mreq, 0, sizeof(mreq));
+			mreq.imr_multiaddr = ((struct sockaddr_in *)address->ai_addr)->sin_addr;
+			mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+			if (!iface.empty() && inet_pton(AF_INET, iface.c_str(), &mreq.imr_interface) != 1)
+				throw std::runtime_error("UDP: multicast interface needs to be an IPv4 address: " + iface);
+
+			if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *)&mreq, sizeof(mreq)) != 0)
+				throw std::runtime_error("UDP: cannot join multicast group " + server);
+		}
+		else
+		{
+			struct ipv6_mreq mreq;
+			memset(&mreq, 0, sizeof(mreq));
+			mreq.ipv6mr_multiaddr = ((struct sockaddr_in6 *)address->ai_addr)->sin6_addr;
+
+			if (!iface.empty())
+			{
+#ifndef _WIN32
+				mreq.ipv6mr_interface = if_nametoindex(iface.c_str());
+#endif
+				if (mreq.ipv6mr_interface == 0)
+					mreq.ipv6mr_interface = Util::Parse::Integer(iface, 1, 1 << 30, "INTERFACE");
+			}
+
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, (char *)&mreq, sizeof(mreq)) != 0)
+				throw std::runtime_error("UDP: cannot join multicast group " + server);
+		}
+
+		Info() << "UDP: joined multicast group " << server << " port " << port << (iface.empty() ? "" : " on " + iface);
+	}
+
 	void UDP::StartServer()
 	{
 
@@ -61,6 +105,12 @@ namespace Device
 			throw std::runtime_error("UDP: cannot create socket.");
 		}
 
+		multicast = false;
+		if (address->ai_family == AF_INET)
+			multicast = IN_MULTICAST(ntohl(((struct sockaddr_in *)address->ai_addr)->sin_addr.s_addr));
+		else if (address->ai_family == AF_INET6)
+			multicast = IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)address->ai_addr)->sin6_addr);
+
 #ifndef _WIN32
 		int optval = 1;
 		if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) != 0)
@@ -68,6 +118,11 @@ namespace Device
 			throw std::runtime_error("UDP: cannot set socket option.");
 		}
 
+		if (rcvbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0)
+		{
+			throw std::runtime_error("UDP: cannot set receive buffer size.");
+		}
+
 		r = fcntl(sock, F_GETFL, 0);
 		r = fcntl(sock, F_SETFL, r | O_NONBLOCK);
 
@@ -78,13 +133,36 @@ namespace Device
 #else
 		u_long mode = 1; // 1 to enable non-blocking socket
 		ioctlsocket(sock, FIONBIO, &mode);
+
+		if (rcvbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf, sizeof(rcvbuf)) != 0)
+		{
+			throw std::runtime_error("UDP: cannot set receive buffer size.");
+		}
+#endif
+
+		struct sockaddr_storage local;
+		memcpy(&local, address->ai_addr, address->ai_addrlen);
+
+#ifdef _WIN32
+		// Windows cannot bind to a group address, the membership does the filtering
+		if (multicast)
+		{
+			if (address->ai_family == AF_INET)
+				((struct sockaddr_in *)&local)->sin_addr.s_addr = htonl(INADDR_ANY);
+			else
+				((struct sockaddr_in6 *)&local)->sin6_addr = in6addr_any;
+		}
 #endif
 
-		if (bind(sock, address->ai_addr, address->ai_addrlen) != 0)
+		if (bind(sock, (struct sockaddr *)&local, address->ai_addrlen) != 0)
 		{
 			Debug() << "UDP: binding to " << server << " port " << port << ": " << strerror(errno);
 			throw std::runtime_error("UDP: cannot bind to port.");
 		}
+
+		if (multicast)
+			joinGroup();
+
 		SleepSystem(100);
 		Debug() << "UDP: server opened at port " << port;
 	}
@@ -120,24 +198,50 @@ namespace Device
 
 	void UDP::Run()
 	{
+		policy_read.apply("UDP read");
 		Debug() << "UDP: starting thread.\n";
-		char buffer[16384];
-		RAW r = {getFormat(), buffer, 0};
-		int nread;
+
+		std::vector<char> buffer(batch * DATAGRAM_SIZE);
+		std::vector<RAW> r(batch);
+
+		for (int i = 0; i < batch; i++)
+			r[i] = {getFormat(), buffer.data() + i * DATAGRAM_SIZE, 0};
+
+#ifdef __linux__
+		std::vector<struct mmsghdr> msgs(batch);
+		std::vector<struct iovec> iov(batch);
+
+		memset(msgs.data(), 0, batch * sizeof(struct mmsghdr));
+		for (int i = 0; i < batch; i++)
+		{
+			iov[i].iov_base = r[i].data;
+			iov[i].iov_len = DATAGRAM_SIZE;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+#endif
+		int n;
 		try
 		{
 			while (isStreaming())
 			{
 				do
 				{
-					nread = recv(sock, buffer, sizeof(buffer), 0);
+					n = 0;
+#ifdef __linux__
+					int nread = recvmmsg(sock, msgs.data(), batch, 0, nullptr);
+
+					for (; n < nread; n++)
+						r[n].size = msgs[n].msg_len;
+#else
+					int nread;
+					while (n < batch && (nread = recv(sock, (char *)r[n].data, DATAGRAM_SIZE, 0)) > 0)
+						r[n++].size = nread;
+#endif
+					if (n > 0)
+						Send(r.data(), n, tag);
 
-					if (nread > 0)
-					{
-						r.size = nread;
-						Send(&r, 1, tag);
-					}
-				} while (nread > 0);
+				} while (n == batch);
 
 				struct timeval tv;
 				fd_set fds;
@@ -180,6 +284,18 @@ namespace Device
 		{
 			server = arg;
 		}
+		else if (option == "BATCH")
+		{
+			batch = Util::Parse::Integer(arg, 1, 1024);
+		}
+		else if (option == "RCVBUF")
+		{
+			rcvbuf = Util::Parse::Integer(arg, 0, 64 * 1024 * 1024);
+		}
+		else if (option == "INTERFACE")
+		{
+			iface = arg;
+		}
 		else if (option == "FORMAT")
 		{
 			throw std::runtime_error("UDP: format cannot be changed and need to be TXT.");
@@ -192,6 +308,6 @@ namespace Device
 
 	std::string UDP::Get()
 	{
-		return Device::Get() + " server " + server + " port " + port;
+		return Device::Get() + " server " + server + " port " + port + " batch " + std::to_string(batch) + " rcvbuf " + std::to_string(rcvbuf) + (iface.empty() ? "" : " interface " + iface);
 	}
 }
@@ -56,6 +56,17 @@ namespace Device {
 		SOCKET sock;
 		bool lost = false;
 
+		// datagrams received per call (recvmmsg on Linux) and forwarded as one block
+		int batch = 32;
+		int rcvbuf = 0;
+		const static int DATAGRAM_SIZE = 16384;
+
+		// a multicast group as server is joined on INTERFACE (IPv4 address, IPv6 name or index)
+		std::string iface;
+		bool multicast = false;
+
+		void joinGroup();
+
 		std::thread run_thread;
 
 		void StartServer();
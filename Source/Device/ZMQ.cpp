@@ -29,6 +29,13 @@ namespace Device {
 	void ZMQ::Open(uint64_t handle) {
 		context = zmq_ctx_new();
 		subscriber = zmq_socket(context, ZMQ_SUB);
+
+		// buffer sizes only take effect for connections made afterwards
+		if (hwm && zmq_setsockopt(subscriber, ZMQ_RCVHWM, &hwm, sizeof(hwm)) != 0)
+			throw std::runtime_error("ZMQ: cannot set socket option ZMQ_RCVHWM.");
+		if (rcvbuf && zmq_setsockopt(subscriber, ZMQ_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0)
+			throw std::runtime_error("ZMQ: cannot set socket option ZMQ_RCVBUF.");
+
 		int rc = zmq_connect(subscriber, endpoint.c_str());
 
 		if (rc != 0) {
@@ -51,7 +58,7 @@ namespace Device {
 	}
 
 	void ZMQ::Play() {
-		fifo.Init(BUFFER_SIZE);
+		initFIFO(fifo, BUFFER_SIZE, 2);
 
 		Device::Play();
 
@@ -60,7 +67,7 @@ namespace Device {
 		Device::Play();
 
 		async_thread = std::thread(&ZMQ::RunAsync, this);
-		run_thread = std::thread(&ZMQ::Run, this);
+		if (!direct) run_thread = std::thread(&ZMQ::Run, this);
 
 		SleepSystem(10);
 	}
@@ -75,21 +82,45 @@ namespace Device {
 		}
 	}
 
+	void ZMQ::forward(zmq_msg_t& msg) {
+		int len = (int)zmq_msg_size(&msg);
+		if (len <= 0) return;
+
+		if (direct) {
+			RAW r = { getFormat(), zmq_msg_data(&msg), len };
+			Send(&r, 1, tag);
+		}
+		else if (!fifo.Push((char*)zmq_msg_data(&msg), len))
+			Error() << "ZMQ: buffer overrun." << std::endl;
+	}
+
 	void ZMQ::RunAsync() {
-		std::vector<char> data(BUFFER_SIZE);
+		policy_read.apply("ZMQ read");
+
+		// messages are received in place, parts of multi-part messages are forwarded one by one
+		zmq_msg_t msg;
+		zmq_msg_init(&msg);
 
 		while (isStreaming()) {
-			int len = zmq_recv(subscriber, data.data(), BUFFER_SIZE, 0);
-			if (len > 0 && !fifo.Push(data.data(), len)) Error() << "ZMQ: buffer overrun." << std::endl;
+			if (zmq_msg_recv(&msg, subscriber, 0) < 0) continue;
+			forward(msg);
+
+			// drain what is already queued before blocking again
+			for (int i = 1; i < batch && isStreaming() && zmq_msg_recv(&msg, subscriber, ZMQ_DONTWAIT) >= 0; i++)
+				forward(msg);
 		}
+
+		zmq_msg_close(&msg);
 	}
 
 	void ZMQ::Run() {
+		policy_run.apply("ZMQ run");
 		std::vector<char> output(fifo.BlockSize());
 
 		while (isStreaming()) {
 			if (fifo.Wait()) {
 				RAW r = { getFormat(), fifo.Front(), fifo.BlockSize() };
+				stampCapture(fifo);
 				Send(&r, 1, tag);
 				fifo.Pop();
 			}
@@ -110,6 +141,22 @@ namespace Device {
 			endpoint = arg;
 			return *this;
 		}
+		else if (option == "HWM") {
+			hwm = Util::Parse::Integer(arg, 0, 1000000, option);
+			return *this;
+		}
+		else if (option == "RCVBUF") {
+			rcvbuf = Util::Parse::Integer(arg, 0, 256 * 1024 * 1024, option);
+			return *this;
+		}
+		else if (option == "BATCH") {
+			batch = Util::Parse::Integer(arg, 1, 4096, option);
+			return *this;
+		}
+		else if (option == "DIRECT") {
+			direct = Util::Parse::Switch(arg);
+			return *this;
+		}
 
 		Device::Set(option, arg);
 
@@ -117,7 +164,7 @@ namespace Device {
 	}
 
 	std::string ZMQ::Get() {
-		return Device::Get() + " endpoint " + endpoint;
+		return Device::Get() + " endpoint " + endpoint + " hwm " + std::to_string(hwm) + " rcvbuf " + std::to_string(rcvbuf) + " batch " + std::to_string(batch) + " direct " + Util::Convert::toString(direct);
 	}
 #endif
 }
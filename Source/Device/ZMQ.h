@@ -48,6 +48,16 @@ namespace Device {
 		FIFO fifo;
 		int timeout = 100;
 
+		// socket buffering, 0 keeps the ZMQ defaults
+		int hwm = 0;
+		int rcvbuf = 0;
+
+		// messages drained per wake-up and forwarding straight from the ZMQ message without FIFO
+		int batch = 64;
+		bool direct = false;
+
+		void forward(zmq_msg_t& msg);
+
 	public:
 		ZMQ() : Device(Format::CU8, 288000, Type::ZMQ) {}
 		// Control
@@ -63,6 +73,7 @@ namespace Device {
 		// Settings
 		Setting& Set(std::string option, std::string arg);
 		std::string Get();
+		FIFO *getFIFO() { return &fifo; }
 
 		std::string getProduct() { return "ZMQ"; }
 #endif
@@ -6,6 +6,7 @@ var interval,
     overlapmaps = {},
     station = {},
     shipsDB = {},
+    shipsDelta = { epoch: 0, seq: 0, values: {} },
     binaryDB = {},
     planesDB = {},
     fetch_binary = false,
@@ -2624,207 +2625,159 @@ function updateDistanceCircles() {
     }
 }
 
-/*
-let view_offset = 0;
- 
-function readUint8(view) {
-const val = view.getUint8(view_offset);
-view_offset += 1;
-return val;
-}
- 
-function readUint16(view) {
-const val = view.getUint16(view_offset);
-view_offset += 2;
-return val;
-}
- 
-function readUint32(view) {
-const val = view.getUint32(view_offset);
-view_offset += 4;
-return val;
-}
- 
-function readUint64(view) {
-const high = readUint32(view);
-const low = readUint32(view);
-return high * 2 ** 32 + low;
-}
- 
-function readInt8(view) {
-const val = view.getInt8(view_offset);
-view_offset += 1;
-return val;
-}
- 
-function readInt16(view) {
-const val = view.getInt16(view_offset);
-view_offset += 2;
-return val;
-}
- 
-function readInt32(view) {
-const val = view.getInt32(view_offset);
-view_offset += 4;
-return val;
-}
- 
-function readInt64(view) {
-const high = readInt32(view);
-const low = readUint32(view);
-return high * 2 ** 32 + low;
-}
- 
-function readString(view) {
-const length = readUint8(view);
-let str = "";
-for (let i = 0; i < length; i++) {
-    str += String.fromCharCode(readUint8(view));
-}
-return str;
-}
- 
-function readFloat(view) {
-return readInt16(view) / 1000.0;
-}
- 
-function readFloatLow(view) {
-return readInt16(view) / 10.0;
-}
- 
-function readLatLon(view) {
-const lat = readInt32(view) / 6000000.0;
-const lon = readInt32(view) / 6000000.0;
-return { lat, lon };
-}
- 
-function deserialize(view, time) {
-function setNullIf(value, condition) {
-    if (value == condition) return null;
-    return value;
-}
- 
-function setNullIfLess(value, condition) {
-    if (value < condition) return null;
-    return value;
-}
- 
-function setNullIfGreater(value, condition) {
-    if (value > condition) return null;
-    return value;
-}
- 
-// Now, deserialize the Ship structure
-const ship = {};
-ship.mmsi = readUint32(view);
-const latLon = readLatLon(view);
-ship.lat = setNullIfGreater(latLon.lat, 90);
-ship.lon = setNullIfGreater(latLon.lon, 180);
-ship.distance = setNullIfLess(readFloatLow(view), 0);
-ship.bearing = setNullIfLess(readFloatLow(view), 0);
-ship.level = setNullIfGreater(readFloatLow(view), 1023);
-ship.count = readInt16(view);
-ship.ppm = setNullIfGreater(readFloatLow(view), 1023);
- 
-let approx_validated = readInt8(view);
-ship.approx = (approx_validated & 1) == 1;
-ship.validated = (approx_validated >> 1) & (1 == 1);
- 
-ship.heading = setNullIfGreater(readFloatLow(view), 510);
-ship.cog = setNullIfGreater(readFloatLow(view), 359.9);
-ship.speed = setNullIfLess(readFloatLow(view), 0);
-ship.to_bow = setNullIf(readInt16(view), -1);
-ship.to_stern = setNullIf(readInt16(view), -1);
-ship.to_starboard = setNullIf(readInt16(view), -1);
-ship.to_port = setNullIf(readInt16(view), -1);
-ship.last_group = readUint64(view);
-ship.group_mask = readUint64(view);
-ship.shiptype = readInt16(view);
- 
-let shipclass_mmsitype = readUint8(view);
-ship.shipclass = shipclass_mmsitype >> 4;
-ship.mmsi_type = shipclass_mmsitype & 15;
- 
-ship.msg_type = readUint32(view);
-ship.channels = readInt8(view);
-ship.country = String.fromCharCode(readInt8(view), readInt8(view));
-ship.status = readInt8(view);
-ship.draught = setNullIfLess(readFloatLow(view), 0);
- 
-ship.eta_month = setNullIf(readInt8(view), 0);
-ship.eta_day = setNullIf(readInt8(view), 0);
-ship.eta_hour = setNullIf(readInt8(view), 24);
-ship.eta_minute = setNullIf(readInt8(view), 60);
- 
-ship.imo = setNullIf(readInt32(view), 0);
-ship.callsign = readString(view);
-ship.shipname = readString(view);
-ship.destination = readString(view);
-ship.received = readUint64(view);
-ship.last_signal = time - ship.received;
- 
-return ship;
-}
- 
-async function fetchShipsBinary(noDoubleFetch = true) {
-if (isFetchingShips && noDoubleFetch) {
-    console.log("A fetch operation is already running.");
-    return false;
-}
- 
-let ships = {};
-station = {};
-let arrayBuffer;
- 
-isFetchingShips = true;
-try {
-    response = await fetch("sb");
-    const blob = await response.blob();
-    arrayBuffer = await blob.arrayBuffer();
-} catch (error) {
-    setPulseError();
-    console.log("failed loading ships: " + error);
-    return false;
-} finally {
-    isFetchingShips = false;
-}
- 
-center = {};
- 
-setPulseOk();
- 
-shipsDB2 = {};
-let view = new DataView(arrayBuffer);
-view_offset = 0;
- 
-let time = readUint64(view);
-let count = readInt32(view);
- 
-let hasstation = readInt8(view) == 1;
-if (hasstation) {
-    station = readLatLon(view);
-    let own_mmsi = readUint32(view);
-}
- 
-while (view_offset < view.byteLength) {
-    const ship = deserialize(view, time);
-    if (includeShip(ship)) {
-        const entry = {};
-        entry.raw = ship;
-        shipsDB2[ship.mmsi] = entry;
+// decoder for the binary encoding of api/ships_delta.bin, api/planes.bin and api/ws (Util::Serialize, big endian)
+const BINARY_VERSION = 2;
+
+class BinaryReader {
+    constructor(buffer) {
+        this.view = new DataView(buffer);
+        this.offset = 0;
+    }
+
+    more() {
+        return this.offset < this.view.byteLength;
+    }
+
+    uint8() {
+        return this.view.getUint8(this.offset++);
+    }
+
+    int8() {
+        return this.view.getInt8(this.offset++);
+    }
+
+    int16() {
+        const val = this.view.getInt16(this.offset);
+        this.offset += 2;
+        return val;
+    }
+
+    uint32() {
+        const val = this.view.getUint32(this.offset);
+        this.offset += 4;
+        return val;
+    }
+
+    int32() {
+        const val = this.view.getInt32(this.offset);
+        this.offset += 4;
+        return val;
+    }
+
+    uint64() {
+        const high = this.uint32();
+        return high * 2 ** 32 + this.uint32();
+    }
+
+    floatLow() {
+        return this.int16() / 10.0;
+    }
+
+    latlon() {
+        const lat = this.int32() / 6000000.0;
+        const lon = this.int32() / 6000000.0;
+        return lat > 90 || lon > 180 ? { lat: null, lon: null } : { lat, lon };
+    }
+
+    string() {
+        const length = this.uint8();
+        let str = "";
+        for (let i = 0; i < length; i++) str += String.fromCharCode(this.uint8());
+        return str;
     }
 }
- 
-if (String(settings.center_point).toUpperCase() == "STATION") {
-    center = station;
-} else if (settings.center_point in shipsDB) {
-    let ship = shipsDB[settings.center_point].raw;
-    center = { lat: ship.lat, lon: ship.lon };
+
+function nullIf(value, condition) {
+    return value == condition ? null : value;
 }
- 
-return true;
+
+// header of a frame, returns the topic or -1 if the version is not supported
+function readBinaryHeader(r) {
+    const topic = r.uint8();
+    return r.uint8() == BINARY_VERSION ? topic : -1;
+}
+
+// Ship::Serialize followed by the sequence number, fields as in api/ships_delta.json
+function readBinaryShip(r, time) {
+    const s = {};
+
+    s.mmsi = r.uint32();
+    const ll = r.latlon();
+    s.lat = ll.lat;
+    s.lon = ll.lon;
+    s.distance = r.int32() / 10.0;
+    s.bearing = r.floatLow();
+    if (s.lat == null || s.distance < 0 || s.bearing < 0) s.distance = s.bearing = null;
+    s.level = nullIf(r.floatLow(), 1024);
+    s.count = r.int32();
+    s.ppm = nullIf(r.floatLow(), 1024);
+    s.approx = (r.uint8() & 1) == 1;
+    s.heading = nullIf(r.floatLow(), 511);
+    s.cog = nullIf(r.floatLow(), 360);
+    s.speed = nullIf(r.floatLow(), -1);
+    s.to_bow = nullIf(r.int16(), -1);
+    s.to_stern = nullIf(r.int16(), -1);
+    s.to_starboard = nullIf(r.int16(), -1);
+    s.to_port = nullIf(r.int16(), -1);
+    s.last_group = r.uint64();
+    s.group_mask = r.uint64();
+    s.shiptype = r.int16();
+    const c = r.uint8();
+    s.shipclass = c >> 4;
+    s.mmsi_type = c & 15;
+    s.msg_type = r.uint32();
+    s.channels = r.int8();
+    s.country = String.fromCharCode(r.uint8(), r.uint8());
+    s.status = r.int8();
+    s.draught = nullIf(r.floatLow(), -1);
+    s.eta_month = nullIf(r.int8(), 0);
+    s.eta_day = nullIf(r.int8(), 0);
+    s.eta_hour = nullIf(r.int8(), 24);
+    s.eta_minute = nullIf(r.int8(), 60);
+    s.imo = nullIf(r.int32(), 0);
+    s.callsign = r.string();
+    s.shipname = r.string();
+    s.destination = r.string();
+    s.last_signal = time - r.uint64();
+    s.flags = r.uint32();
+    s.validated = s.flags & 3;
+    s.altitude = nullIf(r.int32(), 4095);
+    s.received_stations = nullIf(r.int32(), -1);
+    s.seq = r.uint64();
+
+    return s;
+}
+
+// plane as in PlaneDB::getBinaryDelta, fields as in api/planes_array.json
+function readBinaryPlane(r, time) {
+    const p = {};
+
+    p.hexident = r.uint32();
+    const ll = r.latlon();
+    p.lat = ll.lat;
+    p.lon = ll.lon;
+    p.altitude = nullIf(r.int32(), -1000000);
+    p.speed = nullIf(r.floatLow(), -1);
+    p.heading = nullIf(r.floatLow(), 511);
+    p.vertrate = nullIf(r.int32(), -10000);
+    p.squawk = nullIf(r.int32(), -1);
+    p.callsign = r.string();
+    p.airborne = r.int8();
+    p.nMessages = r.int32();
+    p.last_signal = time - r.uint64();
+    p.category = nullIf(r.int16(), -1);
+    p.level = nullIf(r.floatLow(), 1024);
+    const country = String.fromCharCode(r.uint8(), r.uint8());
+    p.country = country[0] == " " ? null : country;
+    p.distance = nullIf(r.floatLow(), -1);
+    p.message_types = r.uint32();
+    p.message_subtypes = r.uint32();
+    p.group_mask = r.uint64();
+    p.last_group = r.uint64();
+    p.bearing = nullIf(r.int16(), -1);
+
+    return p;
 }
-*/
 
 function sanitizeString(input) {
     const map = {
@@ -2892,11 +2845,12 @@ async function fetchShips(noDoubleFetch = true) {
         return false;
     }
 
-    let ships = {};
+    let buffer;
 
     isFetchingShips = true;
     try {
-        response = await fetch("api/ships_array.json");
+        response = await fetch("api/ships_delta.bin?" + shipsDelta.epoch + "," + shipsDelta.seq);
+        buffer = await response.arrayBuffer();
     } catch (error) {
         setPulseError();
         console.log("failed loading ships: " + error);
@@ -2904,66 +2858,62 @@ async function fetchShips(noDoubleFetch = true) {
     } finally {
         isFetchingShips = false;
     }
-    ships = await response.json();
+
+    const r = new BinaryReader(buffer);
+    if (readBinaryHeader(r) != 1) {
+        setPulseError();
+        console.log("failed loading ships: unsupported format");
+        return false;
+    }
 
     setPulseOk();
 
-    const keys = [
-        "mmsi",
-        "lat",
-        "lon",
-        "distance",
-        "bearing",
-        "level",
-        "count",
-        "ppm",
-        "approx",
-        "heading",
-        "cog",
-        "speed",
-        "to_bow",
-        "to_stern",
-        "to_starboard",
-        "to_port",
-        "last_group",
-        "group_mask",
-        "shiptype",
-        "mmsi_type",
-        "shipclass",
-        "msg_type",
-        "country",
-        "status",
-        "draught",
-        "eta_month",
-        "eta_day",
-        "eta_hour",
-        "eta_minute",
-        "imo",
-        "callsign",
-        "shipname",
-        "destination",
-        "last_signal",
-        "flags",
-        "validated",
-        "channels",
-        "altitude",
-        "received_stations"
-    ];
+    const time = r.uint64();
+    const epoch = r.uint64();
+    const seq = r.uint64();
+    const removed = r.uint64();
+    const full = r.int8() == 1;
+    r.int32(); // count
 
-    shipsDB = {};
     station = {};
+    if (r.int8() == 1) {
+        station = r.latlon();
+        station.mmsi = r.uint32();
+    }
 
-    ships.values.forEach((v) => {
-        const s = Object.fromEntries(keys.map((k, i) => [k, v[i]]));
+    // server only sends the ships updated since the previous call, merge with the local copy
+    const now = Date.now();
 
-        const flags = s.flags;
-        s.validated2 = (flags & 3) == 2 ? -1 : flags & 3;
+    if (full) shipsDelta.values = {};
+
+    while (r.more()) {
+        const s = readBinaryShip(r, time);
+        shipsDelta.values[s.mmsi] = { s: s, time: now };
+    }
+
+    // ships with a sequence number up to "removed" have expired or were dropped by the server
+    for (const mmsi in shipsDelta.values) {
+        if (shipsDelta.values[mmsi].s.seq <= removed) delete shipsDelta.values[mmsi];
+    }
+
+    shipsDelta.epoch = epoch;
+    shipsDelta.seq = seq;
+
+    shipsDB = {};
 
+    const values = Object.values(shipsDelta.values);
+
+    values.forEach((e) => {
+        const s = Object.assign({}, e.s);
+
+        // age of the last signal as if just received from the server
+        s.last_signal += Math.floor((now - e.time) / 1000);
+
+        const flags = s.flags;
 
         s.repeat = (flags >> 2) & 3;
         s.virtual_aid = (flags >> 4) & 1;
         s.approximate = (flags >> 5) & 1;
-        s.channels2 = (flags >> 6) & 0b1111;
         s.cs_unit = (flags >> 10) & 3; // 0=unknown, 1=SOTDMA, 2=Carrier Sense
         s.raim = (flags >> 12) & 3; // 0=unknown, 1=false, 2=true
         s.dte = (flags >> 14) & 3; // 0=unknown, 1=ready, 2=not ready
@@ -2975,14 +2925,6 @@ async function fetchShips(noDoubleFetch = true) {
         s.off_position = (flags >> 26) & 3; // 0=unknown, 1=on position, 2=off position
         s.maneuver = (flags >> 28) & 3; // 0=not available, 1=no special, 2=special
 
-        // Check for discrepancies and show error
-        if (s.validated !== s.validated2) {
-            console.log(`Mismatch in validated: ${s.validated} != ${s.validated2}`);
-        }
-        if (s.channels !== s.channels2) {
-            console.log(`Mismatch in channels: ${s.channels} != ${s.channels2}`);
-        }
-
         if (includeShip(s)) {
             s.shipname = sanitizeString(s.shipname);
             s.callsign = sanitizeString(s.callsign);
@@ -2993,8 +2935,6 @@ async function fetchShips(noDoubleFetch = true) {
         }
     });
 
-    if (ships.hasOwnProperty("station")) station = ships.station;
-
     center = {};
     if (String(settings.center_point).toUpperCase() == "STATION") {
         center = station;
@@ -3003,7 +2943,7 @@ async function fetchShips(noDoubleFetch = true) {
         center = { lat: ship.lat, lon: ship.lon };
     }
 
-    tab_title_count = ships.values.length;
+    tab_title_count = values.length;
     updateTitle();
 
     return true;
@@ -3011,10 +2951,11 @@ async function fetchShips(noDoubleFetch = true) {
 
 async function fetchPlanes() {
 
-    let planes = {};
+    let buffer;
 
     try {
-        response = await fetch("api/planes_array.json");
+        response = await fetch("api/planes.bin");
+        buffer = await response.arrayBuffer();
     } catch (error) {
         setPulseError();
         console.log("failed loading planes: " + error);
@@ -3022,37 +2963,22 @@ async function fetchPlanes() {
     } finally {
     }
 
-    planes = await response.json();
+    const r = new BinaryReader(buffer);
+    if (readBinaryHeader(r) != 2) {
+        setPulseError();
+        console.log("failed loading planes: unsupported format");
+        return false;
+    }
+
     setPulseOk();
 
-    const keys = [
-        "hexident",
-        "lat",
-        "lon",
-        "altitude",
-        "speed",
-        "heading",
-        "vertrate",
-        "squawk",
-        "callsign",
-        "airborne",
-        "nMessages",
-        "last_signal",
-        "category",
-        "level",
-        "country",
-        "distance",
-        "message_types",
-        "message_subtypes",
-        "group_mask",
-        "last_group",
-        "bearing"
-    ];
+    const time = r.uint64();
+    r.int32(); // count
 
     planesDB = {};
 
-    planes.values.forEach((v) => {
-        const p = Object.fromEntries(keys.map((k, i) => [k, v[i]]));
+    while (r.more()) {
+        const p = readBinaryPlane(r, time);
 
         p.shipclass = ShippingClass.PLANE;
 
@@ -3063,7 +2989,7 @@ async function fetchPlanes() {
         const entry = {};
         entry.raw = p;
         planesDB[p.hexident] = entry;
-    });
+    }
 
 
     return true;
@@ -17,18 +17,233 @@
 
 #pragma once
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ctime>
 
 #include "MsgOut.h"
+#include "ZIP.h"
+#include "Uring.h"
 
 namespace IO
 {
+	// Writes messages to file. By default lines are written on the calling thread, in
+	// ASYNC mode records are collected in memory and written by a separate thread every
+	// FLUSH seconds so that slow storage does not hold up the decoders.
 	class FileOutput : public OutputMessage
 	{
 		std::ofstream file;
-		std::string filename;
+		std::string filename, current;
+		std::string record;
 
 		bool append_mode = true;
 
+		bool async = false, compress = false;
+		int flush_interval = 5;
+		size_t buffer_size = 4 * 1024 * 1024;
+
+		// rotation: a new file is started after ROTATE_SIZE bytes or ROTATE_TIME seconds
+		long long rotate_size = 0, file_bytes = 0;
+		int rotate_time = 0;
+		std::time_t file_opened = 0;
+		int sequence = 0;
+		// the file of the last rotation could not be opened, records are dropped until the next one
+		bool suspended = false;
+
+		std::string buffer, writing;
+		std::mutex buffer_mutex;
+		std::condition_variable signal;
+		std::thread writer;
+		Util::ThreadPolicy policy;
+		bool running = false, terminate = false;
+		long dropped = 0;
+
+		ZIP zip;
+
+		// IO_URING: the blocks are written by the shared io_uring thread instead of the ofstream
+		bool uring = false;
+		int uring_fd = -1;
+
+		bool rotating() const { return rotate_size > 0 || rotate_time > 0; }
+
+		std::string getFilename(std::time_t t, int n) const
+		{
+			if (!rotating())
+				return filename;
+
+			char stamp[24];
+			std::strftime(stamp, sizeof(stamp), "_%Y%m%d_%H%M%S", std::gmtime(&t));
+
+			std::string suffix = n ? std::string(stamp) + "_" + std::to_string(n) : std::string(stamp);
+
+			std::size_t dot = filename.find_last_of('.');
+			std::size_t slash = filename.find_last_of("/\\");
+
+			if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+				return filename + suffix;
+
+			return filename.substr(0, dot) + suffix + filename.substr(dot);
+		}
+
+		// false if the file cannot be opened, the next rotation is still timed from now
+		bool open()
+		{
+			std::time_t now = std::time(nullptr);
+
+			// rotating more than once per second adds a sequence number
+			sequence = now == file_opened ? sequence + 1 : 0;
+			current = getFilename(now, sequence);
+
+			file_bytes = 0;
+			file_opened = now;
+
+			if (uring)
+			{
+				if (uring_fd != -1)
+					Uring::getInstance().closeFile(uring_fd);
+
+				uring_fd = Uring::getInstance().openFile(current, append_mode);
+				return uring_fd != -1;
+			}
+
+			if (file.is_open())
+				file.close();
+
+			file.clear();
+			file.open(current, (append_mode ? std::ios::app : std::ios::out) | (compress ? std::ios::binary : std::ios::openmode()));
+			return (bool)file;
+		}
+
+		void rotate()
+		{
+			if (!rotating())
+				return;
+
+			if ((rotate_size > 0 && file_bytes >= rotate_size) || (rotate_time > 0 && std::time(nullptr) - file_opened >= rotate_time))
+			{
+				bool ok = open();
+
+				if (!ok)
+					Error() << "File: failed to open file - " << current << ", output suspended until the next rotation.";
+				else if (suspended)
+					Info() << "File: writing to " << current << " again.";
+
+				suspended = !ok;
+			}
+		}
+
+		// writes a block to the current file, compressed blocks are separate gzip members
+		// which concatenate into a valid gzip file
+		bool writeBlock(const std::string &data)
+		{
+			if (data.empty())
+				return true;
+
+			rotate();
+
+			// counted, so that a size based rotation tries again
+			if (suspended)
+			{
+				file_bytes += data.size();
+				return true;
+			}
+
+			if (compress)
+			{
+				if (!zip.zip(data))
+					return false;
+
+				return put(zip.getOutputPtr(), zip.getOutputLength());
+			}
+
+			return put(data.data(), data.size());
+		}
+
+		bool put(const char *data, std::size_t length)
+		{
+			file_bytes += length;
+
+			if (uring)
+				return Uring::getInstance().write(uring_fd, data, length) && Uring::getInstance().getError(uring_fd) == 0;
+
+			file.write(data, length);
+			file.flush();
+			return !file.fail();
+		}
+
+		void output(const std::string &s)
+		{
+			if (!async)
+			{
+				record += s;
+				return;
+			}
+
+			const std::lock_guard<std::mutex> lock(buffer_mutex);
+
+			if (buffer.size() + s.size() > buffer_size)
+			{
+				dropped++;
+				return;
+			}
+
+			buffer += s;
+
+			if (buffer.size() > buffer_size / 2)
+				signal.notify_one();
+		}
+
+		// synchronous mode: the records of one call are written in one go
+		void commit()
+		{
+			if (async || record.empty())
+				return;
+
+			bool ok = writeBlock(record);
+			record.clear();
+
+			if (!ok)
+			{
+				Error() << "File: cannot write to file.";
+				StopRequest();
+			}
+		}
+
+		void process()
+		{
+			policy.apply("File");
+			std::unique_lock<std::mutex> lock(buffer_mutex);
+
+			while (true)
+			{
+				signal.wait_for(lock, std::chrono::seconds(flush_interval), [this]
+								{ return terminate || buffer.size() > buffer_size / 2; });
+
+				std::swap(buffer, writing);
+				long lost = dropped;
+				dropped = 0;
+				bool stop = terminate;
+
+				lock.unlock();
+
+				if (lost)
+					Warning() << "File: writing to file too slow, " << lost << " messages lost.";
+
+				if (!writeBlock(writing))
+				{
+					Error() << "File: cannot write to file.";
+					StopRequest();
+				}
+				writing.clear();
+
+				lock.lock();
+
+				if (stop)
+					break;
+			}
+		}
+
 	public:
 		FileOutput() : OutputMessage() { fmt = MessageFormat::NMEA; }
 
@@ -39,18 +254,42 @@ namespace IO
 
 		void Start()
 		{
-			file.open(filename, append_mode ? std::ios::app : std::ios::out);
+			if (uring && !Uring::getInstance().isAvailable())
+				uring = false;
+
+			suspended = false;
+			if (!open())
+				throw std::runtime_error("File: failed to open file - " + current);
 
-			if (!file)
+			if (async && !running)
 			{
-				throw std::runtime_error("File: failed to open file - " + filename);
+				terminate = false;
+				running = true;
+				writer = std::thread(&FileOutput::process, this);
 			}
 		}
 
 		void Stop()
 		{
+			if (running)
+			{
+				{
+					const std::lock_guard<std::mutex> lock(buffer_mutex);
+					terminate = true;
+				}
+				signal.notify_one();
+				writer.join();
+				running = false;
+			}
+
 			if (file.is_open())
 				file.close();
+
+			if (uring_fd != -1)
+			{
+				Uring::getInstance().closeFile(uring_fd);
+				uring_fd = -1;
+			}
 		}
 
 		void Receive(const AIS::Message *data, int len, TAG &tag)
@@ -64,7 +303,7 @@ namespace IO
 
 					for (const auto &s : data[i].NMEA)
 					{
-						file << s << std::endl;
+						output(s + '\n');
 					}
 				}
 			}
@@ -75,7 +314,7 @@ namespace IO
 					if (!filter.include(data[i]))
 						continue;
 
-					file << data[i].getNMEATagBlock();
+					output(data[i].getNMEATagBlock());
 				}
 			}
 			else if (fmt == MessageFormat::BINARY_NMEA)
@@ -85,8 +324,7 @@ namespace IO
 					if (!filter.include(data[i]))
 						continue;
 
-					std::string binary_packet = data[i].getBinaryNMEA(tag);
-					file.write(binary_packet.c_str(), binary_packet.length());
+					output(data[i].getBinaryNMEA(tag));
 				}
 			}
 			else
@@ -96,15 +334,11 @@ namespace IO
 					if (!filter.include(data[i]))
 						continue;
 
-					file << data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, false, tag.ipv4, "") << std::endl;
+					output(data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, false, tag.ipv4, "") + '\n');
 				}
 			}
 
-			if (file.fail())
-			{
-				Error() << "File: cannot write to file.";
-				StopRequest();
-			}
+			commit();
 		}
 
 		void Receive(const JSON::JSON *data, int len, TAG &tag)
@@ -114,15 +348,13 @@ namespace IO
 				if (filter.include(*(AIS::Message *)data[i].binary))
 				{
 					json.clear();
-					builder.stringify(data[i], json);
-					file << json << std::endl;
+					builder.stringifyCached(data[i], json);
+					json += '\n';
+					output(json);
 				}
 			}
-			if (file.fail())
-			{
-				Error() << "File: cannot write to file.";
-				StopRequest();
-			}
+
+			commit();
 		}
 
 		Setting &Set(std::string option, std::string arg)
@@ -147,6 +379,49 @@ namespace IO
 
 				append_mode = arg == "APPEND" || arg == "APP";
 			}
+			else if (option == "ASYNC")
+			{
+				async = Util::Parse::Switch(arg);
+			}
+			else if (option == "FLUSH")
+			{
+				flush_interval = Util::Parse::Integer(arg, 1, 3600, option);
+			}
+			else if (option == "BUFFER")
+			{
+				buffer_size = (size_t)Util::Parse::Integer(arg, 64, 1024 * 1024, option) * 1024;
+			}
+			else if (option == "ROTATE_SIZE")
+			{
+				rotate_size = (long long)Util::Parse::Integer(arg, 0, 1024 * 1024, option) * 1024 * 1024;
+			}
+			else if (option == "ROTATE_TIME")
+			{
+				rotate_time = Util::Parse::Integer(arg, 0, 7 * 24 * 3600, option);
+			}
+			else if (option == "COMPRESS")
+			{
+				Util::Convert::toUpper(arg);
+
+				if (arg == "GZIP" || Util::Parse::Switch(arg))
+				{
+					if (!ZIP::installed())
+						throw std::runtime_error("File output - compression requires zlib support.");
+
+					// compression works on blocks, so each flush becomes one gzip member
+					compress = async = true;
+				}
+				else
+					compress = false;
+			}
+			else if (option == "IO_URING")
+			{
+				uring = Util::Parse::Switch(arg);
+			}
+			else if (option == "AFFINITY" || option == "PRIORITY")
+			{
+				policy.Set(option, arg);
+			}
 			else if (!OutputMessage::setOption(option, arg))
 			{
 				throw std::runtime_error("File output - unknown option: " + option);
@@ -98,7 +98,7 @@ namespace IO
 		message = msg;
 	}
 
-	void HTTPClient::createHeader(bool gzip, bool multipart)
+	void HTTPClient::createHeader(size_t length, const std::string &encoding, bool multipart)
 	{
 
 		header = "POST " + path + " HTTP/1.1\r\nHost: " + host + ":" + port + "\r\nAccept: */*\r\n";
@@ -110,103 +110,248 @@ namespace IO
 		if (!multipart)
 		{
 			header += "Content-Type: application/json\r\n";
-			if (gzip)
-				header += "Content-Encoding: gzip\r\n";
+			if (!encoding.empty())
+				header += "Content-Encoding: " + encoding + "\r\n";
 		}
 		else
 		{
 			header += "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n";
 		}
 
-		header += "Content-Length: " + std::to_string(getMessageLength(gzip)) + "\r\n\r\n";
+		header += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+		header += "Content-Length: " + std::to_string(length) + "\r\n\r\n";
 	}
 
-	int HTTPClient::Post(const std::string &msg, bool gzip, bool multipart, const std::string &copyname)
+	std::unique_ptr<HTTPConnection> HTTPConnectionPool::acquire(const std::string &key)
 	{
+		std::unique_ptr<HTTPConnection> c;
+		std::lock_guard<std::mutex> lock(mtx);
 
-		createMessageBody(msg, gzip, multipart, copyname);
-		createHeader(gzip, multipart);
+		auto it = idle.find(key);
+		if (it == idle.end())
+			return c;
+
+		// most recently used first, connections closed in the meantime are discarded
+		while (!it->second.empty() && !c)
+		{
+			c = std::move(it->second.back());
+			it->second.pop_back();
+
+			if (!c->top->isConnected())
+			{
+				c->top->disconnect();
+				c.reset();
+			}
+		}
+
+		return c;
+	}
+
+	void HTTPConnectionPool::release(const std::string &key, std::unique_ptr<HTTPConnection> c)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		auto &list = idle[key];
+
+		if ((int)list.size() >= MAX_IDLE)
+		{
+			list.front()->top->disconnect();
+			list.erase(list.begin());
+		}
+
+		list.push_back(std::move(c));
+	}
+
+	bool HTTPClient::connect(bool &reused)
+	{
+		reused = false;
+
+		if (keep_alive)
+		{
+			std::unique_ptr<HTTPConnection> c = HTTPConnectionPool::get().acquire(getPoolKey());
+
+			if (c)
+			{
+				conn = std::move(c);
+				connection = conn->top;
+				reused = true;
+				return true;
+			}
+		}
+
+		if (!conn)
+			conn.reset(new HTTPConnection());
 
 		// Set up protocol chain: TCP -> TLS (if secure)
-		tcp.setValue("HOST", host);
-		tcp.setValue("PORT", port);
-		tcp.setValue("PERSISTENT", "false");
-		tcp.setValue("TIMEOUT", "1");
+		conn->tcp.setValue("HOST", host);
+		conn->tcp.setValue("PORT", port);
+		conn->tcp.setValue("PERSISTENT", "false");
+		conn->tcp.setValue("TIMEOUT", "1");
 
 		if (secure)
 		{
-			connection = tcp.add(&tls);
+			conn->top = conn->tcp.add(&conn->tls);
 		}
 		else
 		{
-			connection = &tcp;
+			conn->top = &conn->tcp;
 		}
 
+		connection = conn->top;
+
 		if (!connection->connect())
 		{
 			Error() << "HTTP Client [" << host << "]: error connecting to server.";
 			connection->disconnect();
-			return HTTP_CONNECTION_FAILED;
+			return false;
 		}
 
-		buffer.clear();
-		buffer.resize(8192); // Start with 8KB buffer
-
-		// Send header
-		if (connection->send(header.c_str(), header.length()) < 0)
-		{
-			Error() << "HTTP Client [" << host << "]: write failed";
-			connection->disconnect();
-			return HTTP_CONNECTION_FAILED;
-		}
+		return true;
+	}
 
-		// Send body
-		if (connection->send(getMessagePtr(gzip), (int)getMessageLength(gzip)) < 0)
-		{
-			Error() << "HTTP Client [" << host << "]: write failed";
-			connection->disconnect();
-			return HTTP_CONNECTION_FAILED;
-		}
+	void HTTPClient::release()
+	{
+		HTTPConnectionPool::get().release(getPoolKey(), std::move(conn));
+		connection = nullptr;
+	}
 
-		// Read response - read until connection closes or timeout
+	// reads until the response is complete based on Content-Length or the final chunk,
+	// otherwise until the server closes the connection
+	bool HTTPClient::readResponse()
+	{
 		message.clear();
-		int totalBytes = 0;
+		buffer.resize(8192);
+
+		std::size_t header_end = std::string::npos;
+		long content_length = -1;
+		bool chunked = false;
 		int emptyReads = 0;
+
+		server_close = false;
+
 		while (emptyReads < 5)
 		{
-			int bytes_read = connection->read(&buffer[0], buffer.size(), 1, true);
+			int bytes_read = connection->read(&buffer[0], buffer.size(), 1, false);
+
 			if (bytes_read > 0)
 			{
 				message.append(buffer.data(), bytes_read);
-				totalBytes += bytes_read;
 				emptyReads = 0;
-				if (totalBytes > 1 * 1024 * 1024)
+
+				if (message.size() > 1 * 1024 * 1024)
 				{
 					Error() << "HTTP Client [" << host << "]: response too large";
+					server_close = true;
 					break;
 				}
 			}
 			else if (bytes_read == 0)
 			{
 				emptyReads++;
+				continue;
 			}
 			else
 			{
 				// Error or connection closed
+				server_close = true;
 				break;
 			}
+
+			if (header_end == std::string::npos)
+			{
+				header_end = message.find("\r\n\r\n");
+
+				if (header_end == std::string::npos)
+					continue;
+
+				std::string headers = message.substr(0, header_end);
+				Util::Convert::toUpper(headers);
+
+				std::size_t p = headers.find("\r\nCONTENT-LENGTH:");
+				if (p != std::string::npos)
+					content_length = std::strtol(headers.c_str() + p + 17, nullptr, 10);
+
+				chunked = headers.find("\r\nTRANSFER-ENCODING: CHUNKED") != std::string::npos;
+				server_close = headers.find("\r\nCONNECTION: CLOSE") != std::string::npos;
+
+				header_end += 4;
+			}
+
+			if (content_length >= 0 && message.size() >= header_end + content_length)
+				break;
+
+			if (chunked && message.size() >= header_end + 5 && message.compare(message.size() - 5, 5, "0\r\n\r\n") == 0)
+				break;
 		}
 
-		if (totalBytes == 0)
+		if (emptyReads >= 5)
+			server_close = true;
+
+		return !message.empty();
+	}
+
+	int HTTPClient::transmit(const void *body, size_t length, const std::string &encoding, bool multipart)
+	{
+		createHeader(length, encoding, multipart);
+
+		// a kept-alive connection might have been closed by the server, try once more on a new one
+		for (int attempt = 0; attempt < 2; attempt++)
 		{
-			Error() << "HTTP Client [" << host << "]: read failed";
-			connection->disconnect();
-			return HTTP_CONNECTION_FAILED;
+			bool reused;
+
+			if (!connect(reused))
+				return HTTP_CONNECTION_FAILED;
+
+			if (connection->send(header.c_str(), header.length()) < 0 || connection->send(body, (int)length) < 0)
+			{
+				connection->disconnect();
+
+				if (reused)
+					continue;
+
+				Error() << "HTTP Client [" << host << "]: write failed";
+				return HTTP_CONNECTION_FAILED;
+			}
+
+			if (!readResponse())
+			{
+				connection->disconnect();
+
+				if (reused)
+					continue;
+
+				Error() << "HTTP Client [" << host << "]: read failed";
+				return HTTP_CONNECTION_FAILED;
+			}
+
+			int status = parseResponse();
+
+			if (!keep_alive || server_close)
+				connection->disconnect();
+			else
+				release();
+
+			return status;
 		}
 
-		int status = parseResponse();
-		connection->disconnect();
+		Error() << "HTTP Client [" << host << "]: write failed";
+		return HTTP_CONNECTION_FAILED;
+	}
+
+	int HTTPClient::Post(const std::string &msg, bool gzip, bool multipart, const std::string &copyname)
+	{
+		createMessageBody(msg, gzip, multipart, copyname);
+
+		if (gzip && !multipart)
+			return transmit(zip.getOutputPtr(), zip.getOutputLength(), "gzip", multipart);
 
-		return status;
+		// message is reused for the response
+		request.swap(message);
+		return transmit(request.c_str(), request.length(), "", multipart);
+	}
+
+	int HTTPClient::PostEncoded(const std::string &body, const std::string &encoding)
+	{
+		return transmit(body.c_str(), body.length(), encoding, false);
 	}
 }
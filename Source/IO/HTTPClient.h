@@ -19,6 +19,10 @@
 
 #include <iostream>
 #include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #ifdef HASOPENSSL
 #include <openssl/ssl.h>
@@ -40,27 +44,69 @@ namespace IO
 		HTTP_CONNECTION_FAILED = -4
 	};
 
+	struct HTTPConnection
+	{
+		Protocol::TCP tcp;
+		Protocol::TLS tls;
+		Protocol::ProtocolBase *top = nullptr;
+	};
+
+	// open keep-alive connections not in use, shared by all clients posting to the same server
+	class HTTPConnectionPool
+	{
+		const int MAX_IDLE = 4;
+
+		std::mutex mtx;
+		std::map<std::string, std::vector<std::unique_ptr<HTTPConnection>>> idle;
+
+	public:
+		static HTTPConnectionPool &get()
+		{
+			static HTTPConnectionPool pool;
+			return pool;
+		}
+
+		std::unique_ptr<HTTPConnection> acquire(const std::string &key);
+		void release(const std::string &key, std::unique_ptr<HTTPConnection> c);
+	};
+
 	class HTTPClient
 	{
 		ZIP zip;
 		std::string boundary = "------------------------2e45e7d128457b6d";
-		std::string message, header;
+		std::string message, header, request;
 		std::string buffer;
 
-	Protocol::TCP tcp;
-	Protocol::TLS tls;
+	std::unique_ptr<HTTPConnection> conn;
 	Protocol::ProtocolBase *connection = nullptr;
 
+	// with keep-alive the connection is returned to the pool after a post and reused for the next one
+	bool keep_alive = false;
+	bool server_close = false;
+
+	std::string getPoolKey() { return protocol + "://" + host + ":" + port; }
+
 	void createMessageBody(const std::string &msg, bool gzip, bool multipart, const std::string &copyname);
-	const void* getMessagePtr(bool gzip) const { return gzip ? zip.getOutputPtr() : message.c_str(); }
-	size_t getMessageLength(bool gzip) const { return gzip ? zip.getOutputLength() : message.length(); }
-	void createHeader(bool gzip, bool multipart);
+	void createHeader(size_t length, const std::string &encoding, bool multipart);
+	bool connect(bool &reused);
+	void release();
+	bool readResponse();
 	int parseResponse();
+	int transmit(const void *body, size_t length, const std::string &encoding, bool multipart);
 
 	public:
 		std::string protocol, host, port, path, userpwd;
 		bool secure = false;
 
+		~HTTPClient() { disconnect(); }
+
+		void setKeepAlive(bool b) { keep_alive = b; }
+		void disconnect()
+		{
+			if (connection)
+				connection->disconnect();
+		}
+
 		const std::string& getResponse() const { return message; }
 
 		void setUserPwd(const std::string &up)
@@ -90,5 +136,8 @@ namespace IO
 		}
 
 		int Post(const std::string &msg, bool gzip = false, bool multipart = false, const std::string &copyname = "");
+
+		// body is sent as is, compressed with encoding (gzip, zstd) unless empty
+		int PostEncoded(const std::string &body, const std::string &encoding = "");
 	};
 }
@@ -0,0 +1,343 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#ifdef HASCURL
+#include <curl/curl.h>
+#endif
+
+#include "HTTPMulti.h"
+#include "HTTPClient.h"
+#include "Logger.h"
+#include "Wakeups.h"
+
+// curl_multi_poll and curl_multi_wakeup
+#if defined(HASCURL) && LIBCURL_VERSION_NUM >= 0x074400
+#define HTTP_MULTI
+#endif
+
+namespace IO
+{
+	HTTPMulti &HTTPMulti::getInstance()
+	{
+		static HTTPMulti instance;
+		return instance;
+	}
+
+	bool HTTPMulti::isAvailable()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+#ifdef HTTP_MULTI
+		if (!multi && !failed)
+		{
+			if (curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK)
+				multi = curl_multi_init();
+
+			if (!multi)
+			{
+				failed = true;
+				Warning() << "HTTP: cannot set up libcurl, outputs post from their own thread.";
+				return false;
+			}
+
+			curl_multi_setopt((CURLM *)multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+
+			const curl_version_info_data *v = curl_version_info(CURLVERSION_NOW);
+			Info() << "HTTP: outputs post from one thread, libcurl " << v->version << ((v->features & CURL_VERSION_HTTP2) ? " with HTTP/2" : "") << ".";
+		}
+		return multi != nullptr;
+#else
+		return false;
+#endif
+	}
+
+	void HTTPMulti::add(HTTPMultiClient *c, int interval)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		entries.emplace_back();
+		Entry &e = entries.back();
+		e.client = c;
+		e.interval = std::chrono::seconds(interval);
+		e.due = std::chrono::steady_clock::now() + e.interval;
+
+		if (!worker.joinable())
+		{
+			terminate = false;
+			worker = std::thread(&HTTPMulti::run, this);
+		}
+#ifdef HTTP_MULTI
+		else
+			curl_multi_wakeup((CURLM *)multi);
+#endif
+	}
+
+	void HTTPMulti::remove(HTTPMultiClient *c)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		auto find = [&]()
+		{ return std::find_if(entries.begin(), entries.end(), [&](const Entry &e)
+							  { return e.client == c; }); };
+
+		auto it = find();
+		if (it == entries.end())
+			return;
+
+		it->removed = true;
+
+#ifdef HTTP_MULTI
+		curl_multi_wakeup((CURLM *)multi);
+#endif
+		removed.wait(lock, [&]()
+					 { return find() == entries.end(); });
+	}
+
+	void HTTPMulti::stop()
+	{
+		bool running;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			terminate = true;
+			running = worker.joinable();
+#ifdef HTTP_MULTI
+			if (multi)
+				curl_multi_wakeup((CURLM *)multi);
+#endif
+		}
+
+		if (running)
+			worker.join();
+
+#ifdef HTTP_MULTI
+		for (auto &e : entries)
+			cleanup(e);
+		entries.clear();
+
+		if (multi)
+		{
+			curl_multi_cleanup((CURLM *)multi);
+			multi = nullptr;
+			curl_global_cleanup();
+		}
+#endif
+	}
+
+#ifdef HTTP_MULTI
+	static size_t onResponse(char *data, size_t size, size_t n, void *user)
+	{
+		std::string &response = *(std::string *)user;
+
+		if (response.size() + size * n > 1 * 1024 * 1024)
+			return 0;
+
+		response.append(data, size * n);
+		return size * n;
+	}
+
+	void HTTPMulti::start(Entry &e)
+	{
+		HTTPRequest &r = e.request;
+
+		r.body.clear();
+		r.part.clear();
+
+		if (!e.client->prepare(r))
+			return;
+
+		CURL *easy = curl_easy_init();
+		if (!easy)
+		{
+			finish(e, HTTP_CONNECTION_FAILED);
+			return;
+		}
+
+		e.easy = easy;
+		e.error[0] = 0;
+		e.response.clear();
+
+		curl_easy_setopt(easy, CURLOPT_PRIVATE, &e);
+		curl_easy_setopt(easy, CURLOPT_URL, r.url.c_str());
+		curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, e.error);
+		curl_easy_setopt(easy, CURLOPT_TIMEOUT, (long)r.timeout);
+		curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+		curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+		curl_easy_setopt(easy, CURLOPT_FORBID_REUSE, r.keep_alive ? 0L : 1L);
+		curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, onResponse);
+		curl_easy_setopt(easy, CURLOPT_WRITEDATA, &e.response);
+
+		if (!r.userpwd.empty())
+		{
+			curl_easy_setopt(easy, CURLOPT_HTTPAUTH, (long)CURLAUTH_BASIC);
+			curl_easy_setopt(easy, CURLOPT_USERPWD, r.userpwd.c_str());
+		}
+
+		struct curl_slist *headers = curl_slist_append(nullptr, "Expect:");
+
+		if (!r.part.empty())
+		{
+			curl_mime *mime = curl_mime_init(easy);
+			curl_mimepart *part = curl_mime_addpart(mime);
+			curl_mime_name(part, r.part.c_str());
+			curl_mime_type(part, "application/json");
+			curl_mime_data(part, r.body.data(), r.body.size());
+
+			curl_easy_setopt(easy, CURLOPT_MIMEPOST, mime);
+			e.mime = mime;
+		}
+		else
+		{
+			headers = curl_slist_append(headers, "Content-Type: application/json");
+			if (!r.encoding.empty())
+				headers = curl_slist_append(headers, ("Content-Encoding: " + r.encoding).c_str());
+
+			// the body stays in the request until the post is finished
+			curl_easy_setopt(easy, CURLOPT_POSTFIELDS, r.body.data());
+			curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)r.body.size());
+		}
+
+		curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headers);
+		e.headers = headers;
+
+		curl_multi_add_handle((CURLM *)multi, easy);
+		posts++;
+	}
+
+	void HTTPMulti::finish(Entry &e, int status)
+	{
+		if (status < 0)
+		{
+			errors++;
+			Error() << "HTTP Client [" << e.request.url << "]: " << (e.error[0] ? e.error : "connection failed");
+		}
+
+		cleanup(e);
+
+		if (!e.removed)
+			e.client->completed(status, e.response);
+	}
+
+	void HTTPMulti::cleanup(Entry &e)
+	{
+		if (e.easy)
+		{
+			curl_multi_remove_handle((CURLM *)multi, (CURL *)e.easy);
+			curl_easy_cleanup((CURL *)e.easy);
+			e.easy = nullptr;
+		}
+
+		curl_slist_free_all((struct curl_slist *)e.headers);
+		e.headers = nullptr;
+
+		curl_mime_free((curl_mime *)e.mime);
+		e.mime = nullptr;
+	}
+
+	void HTTPMulti::run()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (!terminate)
+		{
+			bool erased = false;
+			for (auto it = entries.begin(); it != entries.end();)
+			{
+				if (it->removed)
+				{
+					cleanup(*it);
+					it = entries.erase(it);
+					erased = true;
+				}
+				else
+					it++;
+			}
+
+			if (erased)
+				removed.notify_all();
+
+			// the thread ends with the last client, a new one starts with the next
+			if (entries.empty())
+			{
+				worker.detach();
+				break;
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			auto next = now + std::chrono::seconds(1);
+
+			for (auto &e : entries)
+			{
+				if (now >= e.due)
+				{
+					e.due += e.interval;
+					if (e.due <= now)
+						e.due = now + e.interval;
+
+					Wakeups::add(Wakeups::OUTPUT);
+
+					if (e.easy)
+					{
+						skipped++;
+						Warning() << "HTTP Client [" << e.request.url << "]: previous post still running, messages go with the next one.";
+					}
+					else
+						start(e);
+				}
+				next = std::min(next, e.due);
+			}
+
+			int running = 0;
+			curl_multi_perform((CURLM *)multi, &running);
+
+			CURLMsg *m;
+			int queued;
+			while ((m = curl_multi_info_read((CURLM *)multi, &queued)))
+			{
+				if (m->msg != CURLMSG_DONE)
+					continue;
+
+				Entry *e = nullptr;
+				curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, (char **)&e);
+
+				long code = HTTP_CONNECTION_FAILED;
+				if (m->data.result == CURLE_OK)
+					curl_easy_getinfo(m->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+				else if (!e->error[0])
+					snprintf(e->error, sizeof(e->error), "%s", curl_easy_strerror(m->data.result));
+
+				finish(*e, (int)code);
+			}
+
+			int ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+
+			lock.unlock();
+			curl_multi_poll((CURLM *)multi, nullptr, 0, std::max(ms, 0), nullptr);
+			lock.lock();
+		}
+
+		Debug() << "HTTP: " << posts << " posts, " << errors << " failed, " << skipped << " intervals skipped.";
+	}
+#else
+	void HTTPMulti::run() {}
+	void HTTPMulti::start(Entry &e) {}
+	void HTTPMulti::finish(Entry &e, int status) {}
+	void HTTPMulti::cleanup(Entry &e) {}
+#endif
+}
@@ -0,0 +1,108 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Posts of the HTTP outputs go through one thread with the libcurl multi interface (HASCURL). The
+// outputs register with their interval, the thread asks each for its body when it is due and runs
+// the transfers of all outputs at the same time, so a slow server only holds up its own output.
+// Connections are kept in the cache of the multi handle and posts to the same HTTP/2 server share
+// one connection. An output has one post in flight, if that is not done at the next interval the
+// interval is skipped and its messages go with the next post. Without libcurl isAvailable() is
+// false and every output posts from its own thread with HTTPClient.
+
+namespace IO
+{
+	struct HTTPRequest
+	{
+		std::string url, userpwd;
+		std::string body;
+		// Content-Encoding of the body, empty if not compressed
+		std::string encoding;
+		// if set, the body is the part of a multipart form with this name
+		std::string part;
+		int timeout = 10;
+		bool keep_alive = true;
+	};
+
+	class HTTPMultiClient
+	{
+	public:
+		virtual ~HTTPMultiClient() {}
+
+		// on the shared thread when the interval is due, false if there is nothing to post
+		virtual bool prepare(HTTPRequest &r) = 0;
+		// status is the HTTP code or an HTTPStatus if there was no response
+		virtual void completed(int status, const std::string &response) = 0;
+	};
+
+	class HTTPMulti
+	{
+		struct Entry
+		{
+			HTTPMultiClient *client = nullptr;
+			std::chrono::steady_clock::duration interval;
+			std::chrono::steady_clock::time_point due;
+			bool removed = false;
+
+			HTTPRequest request;
+			std::string response;
+			void *easy = nullptr, *headers = nullptr, *mime = nullptr;
+			char error[256];
+		};
+
+		void *multi = nullptr;
+		bool failed = false;
+
+		std::list<Entry> entries;
+		std::mutex mtx;
+		std::condition_variable removed;
+		std::thread worker;
+		bool terminate = false;
+
+		uint64_t posts = 0, errors = 0, skipped = 0;
+
+		void run();
+		void start(Entry &e);
+		void finish(Entry &e, int status);
+		void cleanup(Entry &e);
+		void stop();
+
+		HTTPMulti() {}
+
+	public:
+		~HTTPMulti() { stop(); }
+
+		static HTTPMulti &getInstance();
+
+		// sets up libcurl on first use, false if the outputs have to post themselves
+		bool isAvailable();
+
+		// the thread starts with the first client and ends after the last is removed
+		void add(HTTPMultiClient *c, int interval);
+		// returns when no call to c is running or will follow, a post in flight is abandoned
+		void remove(HTTPMultiClient *c);
+	};
+}
@@ -16,19 +16,130 @@
 */
 
 #include <cstring>
+#include <algorithm>
+#include <sstream>
 
 #include "HTTPServer.h"
+#include "Protocol.h"
+#include "Clock.h"
 
 namespace IO
 {
+	std::string SSEEvent::toJSON(const std::vector<std::string> &fields) const
+	{
+		std::string json = "{";
+
+		for (auto &m : members)
+		{
+			if (!fields.empty() && !std::binary_search(fields.begin(), fields.end(), m.first))
+				continue;
+
+			if (json.size() > 1)
+				json += ',';
+			json += m.second;
+		}
+		return json + "}";
+	}
+
+	bool SSESubscription::parse(const std::string &query)
+	{
+		const int MAX_LIST = 1024;
+
+		std::stringstream ss(query);
+		std::string arg;
+
+		while (std::getline(ss, arg, '&'))
+		{
+			std::string::size_type eq = arg.find('=');
+			if (eq == std::string::npos)
+				continue;
+
+			std::string key = arg.substr(0, eq);
+			std::stringstream values(arg.substr(eq + 1));
+			std::string v;
+
+			if (key == "bbox")
+			{
+				char c1, c2, c3;
+				if (!(values >> lat_min >> c1 >> lon_min >> c2 >> lat_max >> c3 >> lon_max) || c1 != ',' || c2 != ',' || c3 != ',')
+					return false;
+
+				if (lat_min > lat_max || lat_min < -90 || lat_max > 90 || lon_min < -180 || lon_min > 180 || lon_max < -180 || lon_max > 180)
+					return false;
+
+				box = true;
+			}
+			else if (key == "mmsi")
+			{
+				while (std::getline(values, v, ','))
+				{
+					char *end;
+					unsigned long m = strtoul(v.c_str(), &end, 10);
+
+					if (v.empty() || *end || m > 999999999 || mmsi.size() >= MAX_LIST)
+						return false;
+
+					mmsi.push_back((uint32_t)m);
+				}
+			}
+			else if (key == "fields")
+			{
+				while (std::getline(values, v, ','))
+				{
+					if (v.empty() || fields.size() >= MAX_LIST)
+						return false;
+
+					fields.push_back(v);
+				}
+			}
+		}
+
+		std::sort(mmsi.begin(), mmsi.end());
+		std::sort(fields.begin(), fields.end());
+		fields.erase(std::unique(fields.begin(), fields.end()), fields.end());
+		return true;
+	}
+
+	// the MMSIs are followed in addition to the ships in the box
+	bool SSESubscription::match(const SSEEvent &e) const
+	{
+		if (!box && mmsi.empty())
+			return true;
+
+		if (box && e.position && e.lat >= lat_min && e.lat <= lat_max &&
+			(lon_min <= lon_max ? e.lon >= lon_min && e.lon <= lon_max : e.lon >= lon_min || e.lon <= lon_max))
+			return true;
+
+		return std::binary_search(mmsi.begin(), mmsi.end(), e.mmsi);
+	}
+
+	void SSEConnection::setSubscription(const SSESubscription &s)
+	{
+		subscription = s;
+		projection.clear();
+
+		for (auto &f : s.fields)
+			projection += f + ",";
+	}
+
 	// HTTP Server
-	void HTTPServer::processClients()
+	thread_local HTTPServer::HTTPListener *HTTPServer::current = nullptr;
+
+	void HTTPServer::processClients(Listener &listener)
 	{
 		static const std::string EOF_MSG = "\r\n\r\n";
 
-		for (auto &c : client)
+		HTTPListener &l = static_cast<HTTPListener &>(listener);
+		current = &l;
+
+		// completed work unlocks its connection so that waiting requests are handled below
+		runCompleted(l);
+		flushStreams(l);
+
+		for (auto &c : l.client)
 		{
-			if (c.isConnected())
+			// upgraded connections (SSE, websocket) no longer carry HTTP requests
+			if (c.isConnected() && !c.isLocked())
 			{
 
 				std::size_t pos = c.msg.find(EOF_MSG);
@@ -88,9 +199,23 @@ namespace IO
 					// Pass the entire message including body to Parse
 					Parse(c.msg.substr(0, required_length), request, gzip);
 					if (!request.empty())
+					{
+						const std::lock_guard<std::mutex> lock(request_mtx);
 						Request(c, request, gzip);
+					}
 
 					c.msg.erase(0, required_length);
+
+					// pipelined requests are answered in order, stop after an upgrade or close
+					if (!c.isConnected() || c.isLocked())
+						break;
+
+					if (!l.keep_alive)
+					{
+						c.CloseAfterSend();
+						break;
+					}
+
 					pos = c.msg.find(EOF_MSG);
 				}
 
@@ -102,20 +227,449 @@ namespace IO
 				}
 			}
 		}
+
+		flushSSE(l);
+		flushWebSocket(l);
+	}
+
+	const std::string &HTTPServer::getIfNoneMatch()
+	{
+		return current->if_none_match;
+	}
+
+	const std::string &HTTPServer::getWebSocketKey()
+	{
+		return current->ws_key;
+	}
+
+	void HTTPServer::cleanupSSE(HTTPListener &l)
+	{
+		uint32_t mask = 0;
+
+		for (auto it = l.sse.begin(); it != l.sse.end();)
+		{
+			if (!it->isConnected())
+			{
+				it->Close();
+				it = l.sse.erase(it);
+				l.sse_indexed = false;
+			}
+			else
+			{
+				mask |= 1u << MIN(it->getID(), 31);
+				++it;
+			}
+		}
+		l.sse_mask = mask;
+	}
+
+	IO::SSEConnection *HTTPServer::upgradeSSE(IO::TCPServerConnection &c, int id, const SSESubscription &subscription)
+	{
+		HTTPListener &l = *current;
+
+		cleanupSSE(l);
+
+		l.sse.emplace_back(&c, id);
+		auto &connection = l.sse.back();
+		connection.setSubscription(subscription);
+		connection.Start();
+		l.sse_mask |= 1u << MIN(id, 31);
+		l.sse_indexed = false;
+		return &connection;
+	}
+
+	void HTTPServer::indexSSE(HTTPListener &l)
+	{
+		const int rows = 180 / CELL, cols = 360 / CELL;
+
+		l.sse_cells.assign(rows * cols, std::vector<IO::SSEConnection *>());
+		l.sse_other.clear();
+
+		for (auto &s : l.sse)
+		{
+			const SSESubscription &sub = s.getSubscription();
+
+			int r0 = cellRow(sub.lat_min), r1 = cellRow(sub.lat_max);
+			int c0 = cellCol(sub.lon_min), c1 = cellCol(sub.lon_max);
+			int ncols = c0 <= c1 ? c1 - c0 + 1 : cols - c0 + c1 + 1;
+
+			// the MMSIs of a client are outside its viewport, it sees every event
+			if (!sub.box || !sub.mmsi.empty() || (r1 - r0 + 1) * ncols > MAX_CELLS)
+			{
+				l.sse_other.push_back(&s);
+				continue;
+			}
+
+			for (int r = r0; r <= r1; r++)
+				for (int i = 0; i < ncols; i++)
+					l.sse_cells[r * cols + (c0 + i) % cols].push_back(&s);
+		}
+		l.sse_indexed = true;
+	}
+
+	void HTTPServer::sendSSE(int id, const std::string &event, const std::string &data)
+	{
+		const uint32_t bit = 1u << MIN(id, 31);
+		std::shared_ptr<const std::string> e;
+
+		for (auto &listener : listeners)
+		{
+			HTTPListener &l = static_cast<HTTPListener &>(*listener);
+
+			if (!(l.sse_mask & bit))
+				continue;
+
+			if (!e)
+				e = IO::SSEConnection::Encode(sse_topic[MIN(id, 4)], data);
+			{
+				std::lock_guard<std::mutex> lock(sse_mtx);
+
+				if (l.sse_pending.size() >= MAX_SSE_PENDING)
+					l.sse_pending.pop_front();
+
+				l.sse_pending.push_back({id, e, nullptr});
+			}
+			wake(l);
+		}
+	}
+
+	void HTTPServer::sendSSE(int id, const std::string &event, const std::shared_ptr<const SSEEvent> &e)
+	{
+		const uint32_t bit = 1u << MIN(id, 31);
+
+		for (auto &listener : listeners)
+		{
+			HTTPListener &l = static_cast<HTTPListener &>(*listener);
+
+			if (!(l.sse_mask & bit))
+				continue;
+			{
+				std::lock_guard<std::mutex> lock(sse_mtx);
+
+				if (l.sse_pending.size() >= MAX_SSE_PENDING)
+					l.sse_pending.pop_front();
+
+				l.sse_pending.push_back({id, nullptr, e});
+			}
+			wake(l);
+		}
+	}
+
+	void HTTPServer::sendWebSocket(int topics, const char *data, int len)
+	{
+		if (!hasWebSocket(topics))
+			return;
+
+		std::shared_ptr<const std::string> f = IO::WebSocketConnection::Encode(data, len);
+
+		for (auto &listener : listeners)
+		{
+			HTTPListener &l = static_cast<HTTPListener &>(*listener);
+
+			if (!(l.ws_mask & topics))
+				continue;
+			{
+				std::lock_guard<std::mutex> lock(sse_mtx);
+
+				if (l.ws_pending.size() >= MAX_SSE_PENDING)
+					l.ws_pending.pop_front();
+
+				l.ws_pending.emplace_back(topics, f);
+			}
+			wake(l);
+		}
+	}
+
+	void HTTPServer::flushSSE(HTTPListener &l)
+	{
+		std::deque<PendingSSE> events;
+		{
+			std::lock_guard<std::mutex> lock(sse_mtx);
+			events.swap(l.sse_pending);
+		}
+
+		if (!l.sse_indexed)
+			indexSSE(l);
+
+		// encodings of the current event by projection
+		std::vector<std::pair<const std::string *, std::shared_ptr<const std::string>>> encoded;
+
+		auto route = [&](IO::SSEConnection &s, const PendingSSE &e)
+		{
+			if (s.getID() != e.id || !s.getSubscription().match(*e.event))
+				return;
+
+			for (auto &p : encoded)
+				if (*p.first == s.getProjection())
+				{
+					s.Queue(p.second);
+					return;
+				}
+
+			encoded.emplace_back(&s.getProjection(), IO::SSEConnection::Encode(sse_topic[MIN(e.id, 4)], e.event->toJSON(s.getSubscription().fields)));
+			s.Queue(encoded.back().second);
+		};
+
+		for (auto &e : events)
+		{
+			if (!e.event)
+			{
+				for (auto &s : l.sse)
+					if (e.id == s.getID())
+						s.Queue(e.encoded);
+				continue;
+			}
+
+			encoded.clear();
+
+			for (auto *s : l.sse_other)
+				route(*s, e);
+
+			if (e.event->position)
+				for (auto *s : l.sse_cells[cellRow(e.event->lat) * (360 / CELL) + cellCol(e.event->lon)])
+					route(*s, e);
+		}
+
+		for (auto &s : l.sse)
+			s.Flush();
+
+		cleanupSSE(l);
+	}
+
+	void HTTPServer::cleanupWebSocket(HTTPListener &l)
+	{
+		int mask = 0;
+
+		for (auto it = l.ws.begin(); it != l.ws.end();)
+		{
+			if (!it->isConnected())
+			{
+				it->Close();
+				it = l.ws.erase(it);
+			}
+			else
+			{
+				mask |= it->getTopics();
+				++it;
+			}
+		}
+		l.ws_mask = mask;
+
+		for (auto &other : listeners)
+			mask |= static_cast<HTTPListener &>(*other).ws_mask;
+		ws_mask = mask;
+	}
+
+	void HTTPServer::flushWebSocket(HTTPListener &l)
+	{
+		std::deque<std::pair<int, std::shared_ptr<const std::string>>> frames;
+		{
+			std::lock_guard<std::mutex> lock(sse_mtx);
+			frames.swap(l.ws_pending);
+		}
+
+		for (auto &w : l.ws)
+		{
+			w.Read();
+
+			for (auto &f : frames)
+				if (f.first & w.getTopics())
+					w.Queue(f.second);
+
+			w.Flush();
+		}
+
+		cleanupWebSocket(l);
+	}
+
+	IO::WebSocketConnection *HTTPServer::upgradeWebSocket(IO::TCPServerConnection &c, int topics)
+	{
+		HTTPListener &l = *current;
+
+		cleanupWebSocket(l);
+
+		if (l.ws_key.empty())
+		{
+			std::string r = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			Send(c, r.c_str(), r.length());
+			c.CloseAfterSend();
+			return nullptr;
+		}
+
+		l.ws.emplace_back(&c, topics);
+		auto &connection = l.ws.back();
+
+		if (!connection.Start(l.ws_key))
+		{
+			l.ws.pop_back();
+			return nullptr;
+		}
+
+		l.ws_mask |= topics;
+		ws_mask |= topics;
+		return &connection;
+	}
+
+	// Websocket connection
+	bool WebSocketConnection::Start(const std::string &key)
+	{
+		if (!connection)
+			return false;
+
+		connection->Lock();
+
+		std::string accept = Util::Convert::BASE64toString(Protocol::WebSocket::sha1Hash(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+
+		std::string headers = "HTTP/1.1 101 Switching Protocols\r\n";
+		headers += "Upgrade: websocket\r\n";
+		headers += "Connection: Upgrade\r\n";
+		headers += "Sec-WebSocket-Accept: " + accept + "\r\n\r\n";
+
+		return connection->SendDirect(headers.c_str(), headers.length());
+	}
+
+	void WebSocketConnection::Close()
+	{
+		if (connection)
+		{
+			connection->Unlock();
+			connection->Close();
+			connection = nullptr;
+		}
+	}
+
+	std::shared_ptr<const std::string> WebSocketConnection::Encode(const char *data, int len, int opcode)
+	{
+		std::string frame;
+		frame.reserve(len + 10);
+
+		frame.push_back((char)(0x80 | opcode));
+
+		if (len <= 125)
+		{
+			frame.push_back((char)len);
+		}
+		else if (len <= 65535)
+		{
+			frame.push_back((char)126);
+			frame.push_back((char)(len >> 8));
+			frame.push_back((char)(len & 0xFF));
+		}
+		else
+		{
+			frame.push_back((char)127);
+			for (int i = 7; i >= 0; i--)
+				frame.push_back((char)(((uint64_t)len >> (i * 8)) & 0xFF));
+		}
+
+		frame.append(data, len);
+		return std::make_shared<const std::string>(std::move(frame));
+	}
+
+	void WebSocketConnection::Queue(const std::shared_ptr<const std::string> &frame)
+	{
+		if (queue.size() >= MAX_QUEUE)
+		{
+			Close();
+			return;
+		}
+
+		queue.push_back(frame);
+	}
+
+	void WebSocketConnection::Flush()
+	{
+		while (connection && !queue.empty() && !connection->hasSendBuffer())
+		{
+			const std::string &f = *queue.front();
+			connection->SendDirect(f.c_str(), f.length());
+			queue.pop_front();
+		}
+	}
+
+	// https://datatracker.ietf.org/doc/html/rfc6455#section-5.2, frames from the client are masked
+	void WebSocketConnection::Read()
+	{
+		if (!connection)
+			return;
+
+		std::string &msg = connection->msg;
+
+		while (msg.size() >= 2)
+		{
+			const uint8_t *p = (const uint8_t *)msg.data();
+			int opcode = p[0] & 0x0F;
+			bool masked = p[1] & 0x80;
+			uint64_t len = p[1] & 0x7F;
+			std::size_t header = 2;
+
+			if (len == 126)
+			{
+				if (msg.size() < 4)
+					return;
+				len = (p[2] << 8) | p[3];
+				header = 4;
+			}
+			else if (len == 127)
+			{
+				if (msg.size() < 10)
+					return;
+				len = 0;
+				for (int i = 0; i < 8; i++)
+					len = (len << 8) | p[2 + i];
+				header = 10;
+			}
+
+			if (!masked || len > 65536)
+			{
+				Close();
+				return;
+			}
+
+			if (msg.size() < header + 4 + len)
+				return;
+
+			std::string payload = msg.substr(header + 4, len);
+			for (std::size_t i = 0; i < payload.size(); i++)
+				payload[i] ^= msg[header + (i & 3)];
+
+			msg.erase(0, header + 4 + len);
+
+			if (opcode == 0x8)
+			{
+				// echo the close and drop the connection
+				connection->SendDirect("\x88\x00", 2);
+				Close();
+				return;
+			}
+			else if (opcode == 0x9)
+			{
+				std::shared_ptr<const std::string> pong = Encode(payload.c_str(), payload.size(), 0xA);
+				connection->SendDirect(pong->c_str(), pong->length());
+			}
+		}
 	}
 
 	void HTTPServer::Request(IO::TCPServerConnection &c, const std::string &, bool)
 	{
 		std::string r = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nContent-Length: 15\r\nConnection: close\r\n\r\nPage not found.";
 		Send(c, r.c_str(), r.length());
-		c.Close();
+		c.CloseAfterSend();
 	}
 
 	void HTTPServer::Parse(const std::string &s, std::string &get, bool &accept_gzip)
 	{
+		std::string &if_none_match = current->if_none_match;
+		std::string &ws_key = current->ws_key;
+		bool &keep_alive = current->keep_alive;
 
 		get.clear();
+		if_none_match.clear();
+		ws_key.clear();
+		keep_alive = true;
 		accept_gzip = false;
+		current->accept_zstd = current->accept_gzip = false;
+		bool upgrade = false;
 
 		std::istringstream iss(s);
 		std::string line;
@@ -134,17 +688,52 @@ namespace IO
 			{
 				std::getline(line_stream, value, ' ');
 				get = value;
+				std::getline(line_stream, value);
+				keep_alive = value.find("HTTP/1.0") == std::string::npos;
 			}
 			else if (key == "POST")
 			{
 				std::getline(line_stream, value, ' ');
 				url = value;
 				is_post = true;
+				std::getline(line_stream, value);
+				keep_alive = value.find("HTTP/1.0") == std::string::npos;
+			}
+			else if (key == "CONNECTION:")
+			{
+				std::getline(line_stream, value);
+				Util::Convert::toLower(value);
+				if (value.find("close") != std::string::npos)
+					keep_alive = false;
+				else if (value.find("keep-alive") != std::string::npos)
+					keep_alive = true;
 			}
 			else if (key == "ACCEPT-ENCODING:")
 			{
 				std::getline(line_stream, value);
-				accept_gzip = value.find("gzip") != std::string::npos;
+				current->accept_gzip = value.find("gzip") != std::string::npos;
+				current->accept_zstd = ZSTD::installed() && value.find("zstd") != std::string::npos;
+				accept_gzip = current->accept_gzip || current->accept_zstd;
+			}
+			else if (key == "IF-NONE-MATCH:")
+			{
+				std::getline(line_stream, value);
+				if (!value.empty() && value.back() == '\r')
+					value.pop_back();
+				if_none_match = value;
+			}
+			else if (key == "UPGRADE:")
+			{
+				std::getline(line_stream, value);
+				Util::Convert::toLower(value);
+				upgrade = value.find("websocket") != std::string::npos;
+			}
+			else if (key == "SEC-WEBSOCKET-KEY:")
+			{
+				std::getline(line_stream, value);
+				if (!value.empty() && value.back() == '\r')
+					value.pop_back();
+				ws_key = value;
 			}
 			else if (key == "CONTENT-LENGTH:")
 			{
@@ -164,6 +753,9 @@ namespace IO
 			}
 		}
 
+		if (!upgrade)
+			ws_key.clear();
+
 		if (is_post && content_length > 0)
 		{
 			size_t body_start = s.find("\r\n\r\n");
@@ -182,8 +774,13 @@ namespace IO
 
 	void HTTPServer::Response(IO::TCPServerConnection &c, const std::string &type, const std::string &content, bool gzip, bool cache)
 	{
+		if (gzip && current->accept_zstd && zstd.zip(content))
+		{
+			ResponseEncoded(c, type, zstd.getOutputPtr(), (int)zstd.getOutputLength(), "zstd", cache);
+			return;
+		}
 #ifdef HASZLIB
-		if (gzip)
+		if (gzip && current->accept_gzip)
 		{
 			zip.zip(content);
 			ResponseRaw(c, type, (const char *)zip.getOutputPtr(), zip.getOutputLength(), true, cache);
@@ -196,8 +793,13 @@ namespace IO
 
 	void HTTPServer::Response(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, bool gzip, bool cache)
 	{
+		if (gzip && current->accept_zstd && zstd.zip(data, len))
+		{
+			ResponseEncoded(c, type, zstd.getOutputPtr(), (int)zstd.getOutputLength(), "zstd", cache);
+			return;
+		}
 #ifdef HASZLIB
-		if (gzip)
+		if (gzip && current->accept_gzip)
 		{
 			zip.zip(data, len);
 			ResponseRaw(c, type, (const char *)zip.getOutputPtr(), zip.getOutputLength(), true, cache);
@@ -208,12 +810,20 @@ namespace IO
 		ResponseRaw(c, type, data, len);
 	}
 
-	void HTTPServer::ResponseRaw(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, bool gzip, bool cache)
+	void HTTPServer::ResponseRaw(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, bool gzip, bool cache, const std::string &etag, const std::string &extra)
+	{
+		ResponseEncoded(c, type, data, len, gzip ? "gzip" : nullptr, cache, etag, extra);
+	}
+
+	void HTTPServer::ResponseEncoded(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, const char *encoding, bool cache, const std::string &etag, const std::string &extra)
 	{
 
 		std::string header = "HTTP/1.1 200 OK\r\nServer: AIS-catcher\r\nContent-Type: " + type;
-		if (gzip)
-			header += "\r\nContent-Encoding: gzip";
+		if (encoding)
+			header += std::string("\r\nContent-Encoding: ") + encoding;
+
+		if (!etag.empty())
+			header += "\r\nETag: " + etag;
 
 		if (cache)
 		{
@@ -223,13 +833,49 @@ namespace IO
 			strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&now));
 			header += "\r\nExpires: " + std::string(buf);
 		}
+		else if (!etag.empty())
+		{
+			// keep a copy but revalidate with the ETag on every use
+			header += "\r\nCache-Control: no-cache";
+		}
 		else
 		{
 			header += "\r\nCache-Control: private, no-store, max-age=0, s-maxage=0";
 			header += "\r\nPragma: no-cache";
 		}
 
-		header += "\r\nConnection: keep-alive\r\nContent-Length: " + std::to_string(len) + "\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+		header += extra + connectionHeader() + "\r\nContent-Length: " + std::to_string(len) + "\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+
+		if (!c.SendDirect(header.c_str(), header.length(), data, len))
+		{
+			Error() << "Server: closing client socket.";
+			c.Close();
+		}
+	}
+
+	std::string HTTPServer::connectionHeader()
+	{
+		if (!current->keep_alive)
+			return "\r\nConnection: close";
+
+		return "\r\nConnection: keep-alive\r\nKeep-Alive: timeout=" + std::to_string(timeout);
+	}
+
+	void HTTPServer::ResponseChunked(IO::TCPServerConnection &c, const std::string &type, BodySource source, bool gzip)
+	{
+#ifndef HASZLIB
+		gzip = false;
+#endif
+		// the parts are only compressed with gzip
+		gzip = gzip && current->accept_gzip;
+
+		std::string header = "HTTP/1.1 200 OK\r\nServer: AIS-catcher\r\nContent-Type: " + type;
+		if (gzip)
+			header += "\r\nContent-Encoding: gzip";
+
+		header += "\r\nCache-Control: private, no-store, max-age=0, s-maxage=0";
+		header += "\r\nPragma: no-cache";
+		header += connectionHeader() + "\r\nTransfer-Encoding: chunked\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
 
 		if (!Send(c, header.c_str(), header.length()))
 		{
@@ -237,11 +883,298 @@ namespace IO
 			c.Close();
 			return;
 		}
-		if (!Send(c, data, len))
+
+		c.Lock();
+
+		HTTPListener &l = *current;
+
+		l.streams.emplace_back();
+		ChunkedStream &stream = l.streams.back();
+		stream.c = &c;
+		stream.source = std::move(source);
+		stream.gzip = gzip;
+		stream.close = !l.keep_alive;
+
+		flushStreams(l);
+	}
+
+	void HTTPServer::flushStreams(HTTPListener &l)
+	{
+		static const std::string LAST_CHUNK = "0\r\n\r\n";
+
+		for (auto it = l.streams.begin(); it != l.streams.end();)
+		{
+			ChunkedStream &stream = *it;
+			IO::TCPServerConnection &c = *stream.c;
+			bool done = false;
+
+			while (!stream.busy)
+			{
+				if (!stream.chunk.empty())
+				{
+					char size[16];
+					int n = snprintf(size, sizeof(size), "%zx\r\n", stream.chunk.size());
+					stream.chunk += "\r\n";
+
+					c.SendDirect(size, n, stream.chunk.data(), (int)stream.chunk.size());
+					stream.chunk.clear();
+				}
+
+				if (stream.finished)
+					c.SendDirect(LAST_CHUNK.data(), (int)LAST_CHUNK.size());
+
+				if (stream.finished || !c.isConnected())
+				{
+					done = true;
+					break;
+				}
+
+				// the next part is only written when the client has taken most of the previous ones
+				if (c.getQueued() >= STREAM_QUEUE)
+					break;
+
+				stream.busy = true;
+				post([&stream]()
+					 {
+						std::string part;
+
+						// a source that throws ends the stream
+						stream.finished = true;
+						bool more = stream.source(part);
+
+						if (!stream.gzip)
+							stream.chunk.swap(part);
+						else
+						{
+							stream.zip.add(part);
+							if (more)
+								stream.zip.take(stream.chunk);
+							else
+								stream.zip.finish(stream.chunk);
+						}
+						stream.finished = !more; },
+					 [&stream]()
+					 { stream.busy = false; });
+			}
+
+			if (done)
+			{
+				c.Unlock();
+				if (stream.close && c.isConnected())
+					c.CloseAfterSend();
+
+				it = l.streams.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	void HTTPServer::ResponseDeferred(IO::TCPServerConnection &c, const std::string &type, std::function<std::string()> build, bool gzip)
+	{
+		struct Result
+		{
+			std::string content;
+			bool gzip, zstd, close;
+			int64_t queued = 0, started = 0, built = 0;
+		};
+
+		std::shared_ptr<Result> result = std::make_shared<Result>();
+		result->gzip = gzip && current->accept_gzip;
+		result->zstd = gzip && current->accept_zstd;
+		result->close = !current->keep_alive;
+		result->queued = Util::Clock::micros();
+
+		// pipelined requests wait until the response is sent
+		c.Lock();
+
+		post([result, build]()
+			 {
+				result->started = Util::Clock::micros();
+				result->content = build();
+
+				// the compression contexts are kept per worker thread
+				if (result->zstd)
+				{
+					ZSTD &zstd = ZSTD::local();
+					result->zstd = zstd.zip(result->content);
+					if (result->zstd)
+						result->content.assign(zstd.getOutputPtr(), zstd.getOutputLength());
+				}
+#ifdef HASZLIB
+				if (result->gzip && !result->zstd)
+				{
+					ZIP &zip = ZIP::local();
+					result->gzip = zip.zip(result->content);
+					if (result->gzip)
+						result->content.assign(zip.getOutputPtr(), zip.getOutputLength());
+				}
+#else
+				result->gzip = false;
+#endif
+				result->built = Util::Clock::micros(); },
+			 [this, &c, type, result]()
+			 {
+				c.Unlock();
+				if (!c.isConnected())
+					return;
+
+				// build() threw, the time up to here counts as build time
+				if (!result->built)
+					result->built = Util::Clock::micros();
+
+				char timing[96];
+				snprintf(timing, sizeof(timing), "\r\nServer-Timing: queue;dur=%.1f, build;dur=%.1f", (result->started - result->queued) / 1000.0, (result->built - result->started) / 1000.0);
+
+				bool keep = current->keep_alive;
+				current->keep_alive = !result->close;
+				ResponseEncoded(c, type, result->content.data(), (int)result->content.size(), result->zstd ? "zstd" : (result->gzip ? "gzip" : nullptr), false, "", timing);
+				current->keep_alive = keep;
+
+				if (result->close)
+					c.CloseAfterSend(); });
+	}
+
+	void HTTPServer::post(std::function<void()> work, std::function<void()> done)
+	{
+		if (n_workers <= 0)
+		{
+			work();
+			done();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(task_mtx);
+
+			if (workers_stop)
+				return;
+
+			if (workers.empty())
+				for (int i = 0; i < n_workers; i++)
+					workers.emplace_back(&HTTPServer::runWorker, this);
+
+			tasks.push_back({std::move(work), std::move(done), current});
+		}
+		task_cv.notify_one();
+	}
+
+	void HTTPServer::runWorker()
+	{
+		std::unique_lock<std::mutex> lock(task_mtx);
+
+		while (true)
+		{
+			task_cv.wait(lock, [this]
+						 { return workers_stop || !tasks.empty(); });
+
+			if (workers_stop)
+				return;
+
+			Task task = std::move(tasks.front());
+			tasks.pop_front();
+
+			lock.unlock();
+			try
+			{
+				task.work();
+			}
+			catch (const std::exception &e)
+			{
+				Error() << "Server: exception in worker: " << e.what();
+			}
+			lock.lock();
+
+			task.l->completed.push_back(std::move(task.done));
+			wake(*task.l);
+		}
+	}
+
+	void HTTPServer::runCompleted(HTTPListener &l)
+	{
+		std::deque<std::function<void()>> list;
+		{
+			std::lock_guard<std::mutex> lock(task_mtx);
+			list.swap(l.completed);
+		}
+
+		for (auto &done : list)
+			done();
+	}
+
+	void HTTPServer::stopWorkers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(task_mtx);
+			workers_stop = true;
+		}
+		task_cv.notify_all();
+
+		for (auto &w : workers)
+			if (w.joinable())
+				w.join();
+
+		workers.clear();
+	}
+
+	void HTTPServer::writeClients(Listener &listener)
+	{
+		HTTPListener &l = static_cast<HTTPListener &>(listener);
+
+		TCPServer::writeClients(l);
+
+		// a stream whose client emptied the queue needs another round to produce the next part, as do
+		// upgraded connections with events waiting for the socket
+		bool more = false;
+
+		for (auto &s : l.streams)
+			more |= !s.busy && s.c->getQueued() < STREAM_QUEUE;
+
+		for (auto &s : l.sse)
+			more |= s.hasQueue() && s.isConnected();
+
+		for (auto &w : l.ws)
+			more |= w.hasQueue() && w.isConnected();
+
+		if (more)
+			wake(l);
+	}
+
+	void HTTPServer::ResponseNotModified(IO::TCPServerConnection &c, const std::string &etag)
+	{
+		std::string header = "HTTP/1.1 304 Not Modified\r\nServer: AIS-catcher\r\nETag: " + etag + connectionHeader() + "\r\nContent-Length: 0\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+
+		if (!Send(c, header.c_str(), header.length()))
 		{
 			Error() << "Server: closing client socket.";
 			c.Close();
-			return;
 		}
 	}
+
+	const char *HTTPServer::Compress(const std::string &content, std::string &out)
+	{
+		if (current->accept_zstd && zstd.zip(content))
+		{
+			out.assign(zstd.getOutputPtr(), zstd.getOutputLength());
+			return "zstd";
+		}
+#ifdef HASZLIB
+		if (current->accept_gzip && zip.zip(content))
+		{
+			out.assign(zip.getOutputPtr(), zip.getOutputLength());
+			return "gzip";
+		}
+#endif
+		return nullptr;
+	}
+
+	bool HTTPServer::acceptsZstd()
+	{
+		return current->accept_zstd;
+	}
+
+	bool HTTPServer::acceptsGzip()
+	{
+		return current->accept_gzip;
+	}
 }
\ No newline at end of file
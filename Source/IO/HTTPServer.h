@@ -16,9 +16,15 @@
 */
 
 #pragma once
+#include <functional>
 #include <list>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <vector>
 #include <time.h>
 
 #ifdef _WIN32
@@ -44,14 +50,51 @@
 
 namespace IO
 {
+	// event about a ship, routed by its position and reduced to the fields a client asked for
+	struct SSEEvent
+	{
+		uint32_t mmsi = 0;
+		float lat = 0, lon = 0;
+		bool position = false;
+
+		// "key":value fragments in the order of the full event
+		std::vector<std::pair<std::string, std::string>> members;
+
+		void add(const std::string &key, std::string fragment) { members.emplace_back(key, std::move(fragment)); }
+
+		// object with the members in fields, all members if fields is empty
+		std::string toJSON(const std::vector<std::string> &fields) const;
+	};
 
-class SSEConnection
+	// what an SSE client subscribed to: ships in a bounding box and/or a list of MMSIs, and the fields of
+	// the events. Without box and MMSIs all events are sent, without fields the full event.
+	struct SSESubscription
+	{
+		bool box = false;
+		float lat_min = 0, lon_min = 0, lat_max = 0, lon_max = 0;
+		std::vector<uint32_t> mmsi;
+		std::vector<std::string> fields;
+
+		// "bbox=lat_min,lon_min,lat_max,lon_max&mmsi=a,b,c&fields=mmsi,lat,lon", lon_min > lon_max crosses the antimeridian
+		bool parse(const std::string &query);
+		bool match(const SSEEvent &e) const;
+	};
+
+	class SSEConnection
 	{
 	protected:
 		bool running = false;
 		IO::TCPServerConnection *connection;
 		int _id = 0;
 
+		SSESubscription subscription;
+		// the fields joined, clients with the same projection share the serialization of an event
+		std::string projection;
+
+		// events waiting for the socket, the oldest are dropped if the client does not keep up
+		std::deque<std::shared_ptr<const std::string>> queue;
+		const static int MAX_QUEUE = 256;
+
 	public:
 		SSEConnection(IO::TCPServerConnection *c, int id) : connection(c), _id(id) { c->setVerbosity(false); }
 		~SSEConnection() { Close(); }
@@ -61,6 +104,10 @@ class SSEConnection
 			return _id;
 		}
 
+		void setSubscription(const SSESubscription &s);
+		const SSESubscription &getSubscription() { return subscription; }
+		const std::string &getProjection() { return projection; }
+
 		void Start()
 		{
 			if (!connection)
@@ -95,77 +142,243 @@ class SSEConnection
 			}
 		}
 
-		void SendEvent(const std::string &eventName, const std::string &eventData, const std::string &eventId = "")
+		static std::shared_ptr<const std::string> Encode(const std::string &eventName, const std::string &eventData, const std::string &eventId = "")
 		{
-			if (connection && running)
+			std::string eventStr = "event: " + eventName + "\r\n";
+			if (!eventId.empty())
 			{
-				std::string eventStr = "event: " + eventName + "\r\n";
-				if (!eventId.empty())
-				{
-					eventStr += "id: " + eventId + "\r\n";
-				}
-				eventStr += "data: " + eventData + "\r\n\r\n";
-
-				connection->SendDirect(eventStr.c_str(), eventStr.length());
+				eventStr += "id: " + eventId + "\r\n";
 			}
+			eventStr += "data: " + eventData + "\r\n\r\n";
+
+			return std::make_shared<const std::string>(std::move(eventStr));
+		}
+
+		void Queue(const std::shared_ptr<const std::string> &event)
+		{
+			if (queue.size() >= MAX_QUEUE)
+				queue.pop_front();
+
+			queue.push_back(event);
 		}
+
+		// write queued events as long as the socket accepts them without buffering
+		void Flush()
+		{
+			while (connection && running && !queue.empty() && !connection->hasSendBuffer())
+			{
+				const std::string &e = *queue.front();
+				connection->SendDirect(e.c_str(), e.length());
+				queue.pop_front();
+			}
+		}
+
+		void SendEvent(const std::string &eventName, const std::string &eventData, const std::string &eventId = "")
+		{
+			Queue(Encode(eventName, eventData, eventId));
+		}
+
+		// events that wait for the socket to take the previous ones
+		bool hasQueue() { return !queue.empty(); }
+	};
+
+	// server side of RFC 6455 for pushing data, messages from the client are only read for control frames
+	class WebSocketConnection
+	{
+	protected:
+		IO::TCPServerConnection *connection;
+		int _topics = 0;
+
+		// frames waiting for the socket, a client that falls this far behind is disconnected
+		// as dropping frames would leave it with an inconsistent view
+		std::deque<std::shared_ptr<const std::string>> queue;
+		const static int MAX_QUEUE = 64;
+
+	public:
+		WebSocketConnection(IO::TCPServerConnection *c, int topics) : connection(c), _topics(topics) { c->setVerbosity(false); }
+		~WebSocketConnection() { Close(); }
+
+		int getTopics() { return _topics; }
+		bool isConnected() { return connection && connection->isConnected(); }
+
+		bool Start(const std::string &key);
+		void Close();
+
+		// complete unmasked frame with FIN set, opcode 0x1 is text, 0x2 binary and 0xA pong
+		static std::shared_ptr<const std::string> Encode(const char *data, int len, int opcode = 0x2);
+
+		void Queue(const std::shared_ptr<const std::string> &frame);
+		void Flush();
+		void Read();
+
+		bool hasQueue() { return !queue.empty(); }
 	};
 
 	class HTTPServer : public IO::TCPServer
 	{
-		std::array<std::string, 4> sse_topic = {"aiscatcher", "nmea", "nmea", "log"};
+		std::array<std::string, 5> sse_topic = {"aiscatcher", "nmea", "nmea", "log", "spectrum"};
+
+		struct HTTPListener;
 
 	public:
+		~HTTPServer() { stopWorkers(); }
+
+		// accept_gzip: the client takes a compressed response, gzip or (if built in) zstd
 		virtual void Request(IO::TCPServerConnection &c, const std::string &msg, bool accept_gzip);
 
 		void Response(IO::TCPServerConnection &c, const std::string &type, const std::string &content, bool gzip = false, bool cache = false);
 		void Response(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, bool gzip = false, bool cache = false);
-		void ResponseRaw(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, bool gzip = false, bool cache = false);
+		void ResponseRaw(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, bool gzip = false, bool cache = false, const std::string &etag = "", const std::string &extra = "");
+		// encoding is the Content-Encoding of data, nullptr if not compressed
+		void ResponseEncoded(IO::TCPServerConnection &c, const std::string &type, const char *data, int len, const char *encoding, bool cache = false, const std::string &etag = "", const std::string &extra = "");
+		void ResponseNotModified(IO::TCPServerConnection &c, const std::string &etag);
+
+		// body written in parts by source while the client keeps up, sent with chunked transfer encoding
+		typedef std::function<bool(std::string &)> BodySource;
+		void ResponseChunked(IO::TCPServerConnection &c, const std::string &type, BodySource source, bool gzip = false);
+
+		// body built and compressed by a worker, the server thread only sends it. The time waiting for a
+		// worker and building is reported in a Server-Timing header.
+		void ResponseDeferred(IO::TCPServerConnection &c, const std::string &type, std::function<std::string()> build, bool gzip = false);
+
+		// threads that build deferred responses and the parts of chunked responses, 0 for the server thread
+		void setWorkers(int n) { n_workers = n; }
+		// waits for running work, queued work is dropped
+		void stopWorkers();
+
+		// compresses content into out, with zstd if the request being handled accepts it and gzip otherwise.
+		// Returns the Content-Encoding, nullptr if no compression is available.
+		const char *Compress(const std::string &content, std::string &out);
+		// the request being handled accepts zstd
+		bool acceptsZstd();
+		// the request being handled accepts gzip, for content that is stored gzipped
+		bool acceptsGzip();
+
+		// If-None-Match of the request being handled, empty if not provided
+		const std::string &getIfNoneMatch();
+		// Sec-WebSocket-Key of a websocket upgrade request, empty otherwise
+		const std::string &getWebSocketKey();
+
+		IO::SSEConnection *upgradeSSE(IO::TCPServerConnection &c, int id, const SSESubscription &subscription = SSESubscription());
 
-		void cleanupSSE()
+		// can be called from any thread, the event is encoded once and shared by all subscribers
+		void sendSSE(int id, const std::string &event, const std::string &data);
+		// as above for an event about a ship, only sent to the subscribers that match and encoded once per projection
+		void sendSSE(int id, const std::string &event, const std::shared_ptr<const SSEEvent> &e);
+
+		// topics is a bit mask of the streams the client receives, returns nullptr if the handshake failed
+		IO::WebSocketConnection *upgradeWebSocket(IO::TCPServerConnection &c, int topics);
+
+		// true if a websocket client is subscribed to one of the topics
+		bool hasWebSocket(int topics) { return (ws_mask & topics) != 0; }
+
+		// can be called from any thread, the frame is encoded once and shared by all subscribers
+		void sendWebSocket(int topics, const char *data, int len);
+
+	private:
+		// chunked responses in progress, the connection is locked so that pipelined requests wait
+		struct ChunkedStream
 		{
-			for (auto it = sse.begin(); it != sse.end();)
-			{
-				if (!it->isConnected())
-				{
-					it->Close();
-					it = sse.erase(it);
-				}
-				else
-				{
-					++it;
-				}
-			}
-		}
+			IO::TCPServerConnection *c;
+			BodySource source;
+			ZIPStream zip;
+			bool gzip, close;
 
-		IO::SSEConnection *upgradeSSE(IO::TCPServerConnection &c, int id)
+			// a worker is producing the next chunk
+			bool busy = false, finished = false;
+			std::string chunk;
+		};
+
+		// SSE event handed to a listener, either encoded or a ship event that is encoded per projection
+		struct PendingSSE
 		{
-			cleanupSSE();
+			int id;
+			std::shared_ptr<const std::string> encoded;
+			std::shared_ptr<const SSEEvent> event;
+		};
 
-			sse.emplace_back(&c, id);
-			auto &connection = sse.back();
-			connection.Start();
-			return &connection;
-		}
+		// the viewports of the SSE clients are indexed on a grid of CELL degrees, a viewport that covers
+		// more than MAX_CELLS cells is checked for every event as are the clients without one
+		const static int CELL = 10;
+		const static int MAX_CELLS = 64;
 
-		void sendSSE(int id, const std::string &event, const std::string &data)
+		static int cellRow(float lat) { return MAX(0, MIN(180 / CELL - 1, (int)((lat + 90) / CELL))); }
+		static int cellCol(float lon) { return MAX(0, MIN(360 / CELL - 1, (int)((lon + 180) / CELL))); }
+
+		// upgraded connections, responses in progress and the request being handled of one listener
+		struct HTTPListener : public Listener
 		{
+			std::list<IO::SSEConnection> sse;
+			std::list<IO::WebSocketConnection> ws;
+			std::deque<PendingSSE> sse_pending;
+			std::deque<std::pair<int, std::shared_ptr<const std::string>>> ws_pending;
+			std::atomic<uint32_t> sse_mask{0};
+			std::atomic<int> ws_mask{0};
 
-			for (auto it = sse.begin(); it != sse.end(); ++it)
-			{
-				if (it->getID() == id)
-					it->SendEvent(sse_topic[MIN(id, 3)], data);
-			}
-			cleanupSSE();
-		}
+			std::vector<std::vector<IO::SSEConnection *>> sse_cells;
+			std::vector<IO::SSEConnection *> sse_other;
+			bool sse_indexed = false;
 
-	private:
-		std::string ret, header;
-		std::list<IO::SSEConnection> sse;
+			std::list<ChunkedStream> streams;
+			std::deque<std::function<void()>> completed;
+
+			std::string if_none_match, ws_key;
+			// persistent connection requested for the request being handled, idle connections close after timeout
+			bool keep_alive = true;
+			// the request being handled accepts zstd, compressed responses use it instead of gzip
+			bool accept_zstd = false, accept_gzip = false;
+		};
+
+		Listener *newListener() override { return new HTTPListener(); }
+
+		// the listener served by the calling thread
+		static thread_local HTTPListener *current;
+
+		std::string connectionHeader();
+
+		// masks of all listeners
+		std::atomic<int> ws_mask{0};
+
+		std::mutex sse_mtx;
+		const static int MAX_SSE_PENDING = 4096;
+
+		// the handlers share their buffers and caches, requests of the listeners are handled one at a time
+		std::mutex request_mtx;
+
+		// SSE connections are only touched by the thread of their listener, other threads hand over events via sse_pending
+		void cleanupSSE(HTTPListener &l);
+		void indexSSE(HTTPListener &l);
+		void flushSSE(HTTPListener &l);
+		void flushWebSocket(HTTPListener &l);
+		void cleanupWebSocket(HTTPListener &l);
+
+		const static std::size_t STREAM_QUEUE = 256 * 1024;
+
+		void flushStreams(HTTPListener &l);
+		void writeClients(Listener &l) override;
+
+		// work runs on a worker, done afterwards on the thread of the listener that posted it
+		struct Task
+		{
+			std::function<void()> work, done;
+			HTTPListener *l;
+		};
+
+		int n_workers = 2;
+		bool workers_stop = false;
+		std::vector<std::thread> workers;
+		std::deque<Task> tasks;
+		std::mutex task_mtx;
+		std::condition_variable task_cv;
+
+		void post(std::function<void()> work, std::function<void()> done);
+		void runWorker();
+		void runCompleted(HTTPListener &l);
 
 		void Parse(const std::string &s, std::string &get, bool &accept_gzip);
-		void processClients();
+		void processClients(Listener &l) override;
 
 		ZIP zip;
+		ZSTD zstd;
 	};
 }
@@ -0,0 +1,398 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include "IQLink.h"
+#include "Logger.h"
+
+namespace IO
+{
+	// quotients from ESCAPE onwards are sent as ESCAPE ones followed by the zigzag value in bits + 1 bits
+	static const int ESCAPE = 16;
+	static const uint8_t RAW_VALUES = 0xFF;
+
+	static void putUint32(std::string &s, uint32_t v)
+	{
+		s += (char)(v >> 24);
+		s += (char)(v >> 16);
+		s += (char)(v >> 8);
+		s += (char)v;
+	}
+
+	static uint32_t getUint32(const uint8_t *p)
+	{
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	}
+
+	//---------------------------------------
+	// IQEncoder
+
+	void IQEncoder::put(uint32_t v, int n)
+	{
+		acc = (acc << n) | (v & ((1ull << n) - 1));
+		nacc += n;
+
+		while (nacc >= 8)
+		{
+			nacc -= 8;
+			payload.push_back((uint8_t)(acc >> nacc));
+		}
+	}
+
+	void IQEncoder::flush()
+	{
+		if (nacc > 0)
+			payload.push_back((uint8_t)(acc << (8 - nacc)));
+
+		acc = 0;
+		nacc = 0;
+	}
+
+	void IQEncoder::encode(const CFLOAT32 *data, int len, uint32_t rate, std::string &frame)
+	{
+		len = MIN(len, MAX_COUNT);
+
+		// block floating point, the largest component maps to the largest value
+		float peak = 0;
+		for (int i = 0; i < len; i++)
+			peak = MAX(peak, MAX(std::abs(data[i].real()), std::abs(data[i].imag())));
+
+		const int max_value = (1 << (bits - 1)) - 1;
+		float scale = peak > 0 ? peak / max_value : 1.0f;
+
+		values.resize(2 * len);
+		for (int i = 0; i < len; i++)
+		{
+			values[2 * i] = (int32_t)std::lround(data[i].real() / scale);
+			values[2 * i + 1] = (int32_t)std::lround(data[i].imag() / scale);
+		}
+
+		// zigzag values and pick the Rice parameter with the shortest output
+		uint64_t best = (uint64_t)2 * len * bits;
+		uint8_t k_best = RAW_VALUES;
+
+		for (int k = 0; k <= bits; k++)
+		{
+			uint64_t cost = 0;
+			for (int32_t v : values)
+			{
+				uint32_t u = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+				uint32_t q = u >> k;
+				cost += q < ESCAPE ? q + 1 + k : ESCAPE + bits + 1;
+			}
+
+			if (cost < best)
+			{
+				best = cost;
+				k_best = k;
+			}
+		}
+
+		payload.clear();
+		acc = 0;
+		nacc = 0;
+
+		if (k_best == RAW_VALUES)
+		{
+			for (int32_t v : values)
+				put((uint32_t)v, bits);
+		}
+		else
+		{
+			for (int32_t v : values)
+			{
+				uint32_t u = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+				uint32_t q = u >> k_best;
+
+				if (q < ESCAPE)
+				{
+					put((1u << (q + 1)) - 2, q + 1);
+					put(u, k_best);
+				}
+				else
+				{
+					put((1u << ESCAPE) - 1, ESCAPE);
+					put(u, bits + 1);
+				}
+			}
+		}
+		flush();
+
+		uint32_t scale_bits;
+		std::memcpy(&scale_bits, &scale, sizeof(scale_bits));
+
+		frame.clear();
+		frame += "AIQ";
+		frame += (char)1;
+		frame += (char)bits;
+		frame += (char)k_best;
+		frame += (char)0;
+		frame += (char)0;
+		putUint32(frame, rate);
+		putUint32(frame, len);
+		putUint32(frame, scale_bits);
+		putUint32(frame, payload.size());
+		frame.append((const char *)payload.data(), payload.size());
+	}
+
+	//---------------------------------------
+	// IQDecoder
+
+	void IQDecoder::compact()
+	{
+		if (start > 0 && start >= in.size() / 2)
+		{
+			in.erase(in.begin(), in.begin() + start);
+			start = 0;
+		}
+	}
+
+	void IQDecoder::push(const char *data, int len)
+	{
+		compact();
+		in.insert(in.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+	}
+
+	bool IQDecoder::next(std::vector<CFLOAT32> &out)
+	{
+		while (in.size() - start >= IQEncoder::HEADER_SIZE)
+		{
+			const uint8_t *h = in.data() + start;
+
+			int bits = h[4];
+			uint8_t k = h[5];
+			uint32_t count = getUint32(h + 12);
+			uint32_t length = getUint32(h + 20);
+
+			// resynchronize on the next byte if this is not a valid header
+			if (std::memcmp(h, "AIQ\1", 4) != 0 || (bits != 4 && bits != 8) || (k != RAW_VALUES && k > bits) || count > IQEncoder::MAX_COUNT || length > (uint32_t)IQEncoder::MAX_COUNT * 2 * (ESCAPE + bits + 1) / 8 + 1)
+			{
+				start++;
+				continue;
+			}
+
+			if (in.size() - start < IQEncoder::HEADER_SIZE + length)
+				return false;
+
+			rate = getUint32(h + 8);
+
+			uint32_t scale_bits = getUint32(h + 16);
+			float scale;
+			std::memcpy(&scale, &scale_bits, sizeof(scale));
+
+			const uint8_t *p = h + IQEncoder::HEADER_SIZE;
+			const uint8_t *end = p + length;
+
+			uint64_t acc = 0;
+			int nacc = 0;
+			bool valid = true;
+
+			auto get = [&](int n) -> uint32_t
+			{
+				while (nacc < n)
+				{
+					if (p == end)
+					{
+						valid = false;
+						return 0;
+					}
+					acc = (acc << 8) | *p++;
+					nacc += 8;
+				}
+				nacc -= n;
+				return (uint32_t)(acc >> nacc) & (uint32_t)((1ull << n) - 1);
+			};
+
+			std::size_t first = out.size();
+			out.resize(first + count);
+
+			for (uint32_t i = 0; i < 2 * count && valid; i++)
+			{
+				int32_t v;
+
+				if (k == RAW_VALUES)
+				{
+					uint32_t u = get(bits);
+					v = (int32_t)(u << (32 - bits)) >> (32 - bits);
+				}
+				else
+				{
+					uint32_t q = 0;
+					while (q < ESCAPE && get(1) && valid)
+						q++;
+
+					uint32_t u = q < ESCAPE ? (q << k) | get(k) : get(bits + 1);
+					v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+				}
+
+				float f = v * scale;
+				CFLOAT32 &c = out[first + i / 2];
+				c = (i & 1) ? CFLOAT32(c.real(), f) : CFLOAT32(f, 0);
+			}
+
+			start += IQEncoder::HEADER_SIZE + length;
+
+			if (!valid)
+			{
+				out.resize(first);
+				Warning() << "IQ link: corrupt frame skipped.";
+				continue;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	//---------------------------------------
+	// IQLinkServer
+
+	void IQLinkServer::open()
+	{
+		Info() << "IQ link: serving " << rate / 1000 << "K band at port " << port << ", " << encoder.getBits() << "-bit samples.";
+
+		if (!TCPServer::start(port))
+			throw std::runtime_error("IQ link: cannot open port " + std::to_string(port));
+	}
+
+	void IQLinkServer::Receive(const CFLOAT32 *data, int len, TAG &tag)
+	{
+		block.insert(block.end(), data, data + len);
+
+		if (block.size() < IQEncoder::MAX_COUNT)
+			return;
+
+		int n = (int)block.size() - (int)block.size() % IQEncoder::MAX_COUNT;
+
+		int clients;
+		std::size_t queued, max_queued;
+		uint64_t dropped;
+
+		getQueueStats(clients, queued, max_queued, dropped);
+
+		if (clients > 0)
+		{
+			for (int i = 0; i < n; i += IQEncoder::MAX_COUNT)
+			{
+				encoder.encode(block.data() + i, IQEncoder::MAX_COUNT, rate, frame);
+				SendAllShared(std::make_shared<const std::string>(frame));
+			}
+		}
+
+		block.erase(block.begin(), block.begin() + n);
+	}
+
+	// rtl_tcp header: magic, tuner type (R820T) and the number of gain steps, big endian
+	static const uint8_t RTLTCP_HEADER[12] = {'R', 'T', 'L', '0', 0, 0, 0, 5, 0, 0, 0, 29};
+
+	void RTLTCPServer::open(uint32_t sample_rate, uint32_t freq)
+	{
+		rate = sample_rate;
+		frequency = freq;
+		greeting = std::make_shared<const std::string>((const char *)RTLTCP_HEADER, sizeof(RTLTCP_HEADER));
+
+		// clients mostly listen, they are not dropped for being silent
+		timeout = 0;
+
+		Info() << "RTL-TCP server: serving " << rate / 1000 << "K samples at " << frequency / 1000 << " kHz on port " << port << ".";
+
+		if (!TCPServer::start(port))
+			throw std::runtime_error("RTL-TCP server: cannot open port " + std::to_string(port));
+	}
+
+	// commands are five bytes, the command and a big endian parameter
+	void RTLTCPServer::processClients(Listener &l)
+	{
+		for (auto &c : l.client)
+		{
+			if (!c.isConnected())
+				continue;
+
+			std::size_t n = c.msg.size() - c.msg.size() % 5;
+
+			for (std::size_t i = 0; i < n; i += 5)
+			{
+				uint8_t cmd = c.msg[i];
+				uint32_t param = ((uint8_t)c.msg[i + 1] << 24) | ((uint8_t)c.msg[i + 2] << 16) | ((uint8_t)c.msg[i + 3] << 8) | (uint8_t)c.msg[i + 4];
+
+				if (cmd == 0x01 && frequency && param != frequency)
+					Warning() << "RTL-TCP server: client asks for " << param / 1000 << " kHz, the device is shared and stays at " << frequency / 1000 << " kHz.";
+				else if (cmd == 0x02 && rate && param != rate)
+					Warning() << "RTL-TCP server: client asks for " << param / 1000 << "K samples/s, the device is shared and stays at " << rate / 1000 << "K.";
+			}
+
+			c.msg.erase(0, n);
+		}
+	}
+
+	void RTLTCPServer::Receive(const RAW *data, int len, TAG &tag)
+	{
+		int clients;
+		std::size_t queued, max_queued;
+		uint64_t dropped;
+
+		getQueueStats(clients, queued, max_queued, dropped);
+
+		if (clients == 0)
+			return;
+
+		for (int i = 0; i < len; i++)
+		{
+			const RAW &r = data[i];
+			std::string block;
+
+			switch (r.format)
+			{
+			case Format::CU8:
+				block.assign((const char *)r.data, r.size);
+				break;
+			case Format::CS8:
+				block.resize(r.size);
+				for (int j = 0; j < r.size; j++)
+					block[j] = (char)(((const uint8_t *)r.data)[j] ^ 0x80);
+				break;
+			case Format::CS16:
+			{
+				const int16_t *in = (const int16_t *)r.data;
+				block.resize(r.size / 2);
+				for (std::size_t j = 0; j < block.size(); j++)
+					block[j] = (char)((in[j] >> 8) + 128);
+				break;
+			}
+			case Format::CF32:
+			{
+				const float *in = (const float *)r.data;
+				block.resize(r.size / 4);
+				for (std::size_t j = 0; j < block.size(); j++)
+				{
+					float v = in[j] * 128.0f + 127.5f;
+					block[j] = (char)(uint8_t)(v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v);
+				}
+				break;
+			}
+			default:
+				continue;
+			}
+
+			SendAllShared(std::make_shared<const std::string>(std::move(block)));
+		}
+	}
+}
@@ -0,0 +1,125 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "Stream.h"
+#include "Common.h"
+#include "TCPServer.h"
+
+// Compressed IQ link between AIS-catcher instances. The remote end streams the 96K band around
+// the AIS channels after decimation, every frame is quantized to 4 or 8 bits against its own peak
+// and Rice coded. Frame layout, all fields big endian:
+//
+//   "AIQ" version(1) | bits(1) | k(1) | reserved(2) | rate(4) | count(4) | scale(4, float) | payload length(4) | payload
+//
+// k is the Rice parameter, 0xFF means the payload holds the plain two's complement values.
+
+namespace IO
+{
+	class IQEncoder
+	{
+		int bits = 8;
+
+		std::vector<int32_t> values;
+		std::vector<uint8_t> payload;
+
+		uint64_t acc = 0;
+		int nacc = 0;
+
+		void put(uint32_t v, int n);
+		void flush();
+
+	public:
+		static const int HEADER_SIZE = 24;
+		static const int MAX_COUNT = 4096;
+
+		void setBits(int b) { bits = b; }
+		int getBits() { return bits; }
+
+		// encodes up to MAX_COUNT samples into one frame
+		void encode(const CFLOAT32 *data, int len, uint32_t rate, std::string &frame);
+	};
+
+	class IQDecoder
+	{
+		std::vector<uint8_t> in;
+		std::size_t start = 0;
+
+		uint32_t rate = 0;
+
+		void compact();
+
+	public:
+		void clear()
+		{
+			in.clear();
+			start = 0;
+		}
+
+		void push(const char *data, int len);
+
+		// decodes the next complete frame and appends the samples, false if more data is needed
+		bool next(std::vector<CFLOAT32> &out);
+
+		uint32_t getRate() { return rate; }
+	};
+
+	// streams the encoded band to all connected clients, frames are dropped for clients that lag behind
+	class IQLinkServer : public StreamIn<CFLOAT32>, public TCPServer
+	{
+		IQEncoder encoder;
+		std::vector<CFLOAT32> block;
+		std::string frame;
+
+		int port = 0;
+		uint32_t rate = 96000;
+
+	public:
+		void setPort(int p) { port = p; }
+		int getPort() { return port; }
+		void setBits(int b) { encoder.setBits(b); }
+		void setRate(uint32_t r) { rate = r; }
+
+		void open();
+		void Receive(const CFLOAT32 *data, int len, TAG &tag);
+	};
+
+	// Serves the raw samples of the device with the rtl_tcp protocol so that other decoders can use
+	// the same dongle. Every block is converted to CU8 once and shared by all clients, each client
+	// has its own position in the queue and loses whole blocks if it lags behind. The device is
+	// shared, so tuning commands of the clients are not applied, a client that asks for another
+	// frequency or rate than the device runs at is warned about once.
+	class RTLTCPServer : public StreamIn<RAW>, public TCPServer
+	{
+		int port = 0;
+		uint32_t rate = 0, frequency = 0;
+
+		void processClients(Listener &l) override;
+
+	public:
+		void setPort(int p) { port = p; }
+		int getPort() { return port; }
+
+		void open(uint32_t sample_rate, uint32_t freq);
+		void Receive(const RAW *data, int len, TAG &tag);
+	};
+}
@@ -22,26 +22,43 @@
 
 namespace IO
 {
+	std::string getProfileName()
+	{
+		static std::atomic<int> n{0};
+		return "output " + std::to_string(++n);
+	}
 
 	void OutputMessage::ConnectMessage(Receiver &r)
 	{
+		StreamIn<AIS::Message> *um = (StreamIn<AIS::Message> *)&*this;
+		StreamIn<AIS::Message> *in = connectStages<AIS::Message>(um, profile, probe_msg, latency, latency_msg, false);
+
+		if (queue_size > 0 && !queue)
+		{
+			queue.reset(new Util::AsyncStream<AIS::Message>());
+			queue->setQueueSize(queue_size);
+			queue->setBatch(queue_batch);
+			queue->setOverflow(queue_overflow);
+			queue->setShared(queue_shared);
+			queue->out.Connect(in);
+		}
 
 		for (int j = 0; j < r.Count(); j++)
 		{
-			StreamIn<AIS::Message> *um = (StreamIn<AIS::Message> *)&*this;
 			if (r.Output(j).canConnect(um->getGroupsIn()))
-				r.Output(j).Connect(um);
+				r.Output(j).Connect(queue ? (StreamIn<AIS::Message> *)queue.get() : in);
 		}
 	}
 
 	void OutputMessage::ConnectJSON(Receiver &r)
 	{
+		StreamIn<JSON::JSON> *um = (StreamIn<JSON::JSON> *)&*this;
+		StreamIn<JSON::JSON> *in = connectStages<JSON::JSON>(um, profile, probe_json, latency, latency_json, true);
 
 		for (int j = 0; j < r.Count(); j++)
 		{
-			StreamIn<JSON::JSON> *um = (StreamIn<JSON::JSON> *)&*this;
 			if (r.Output(j).canConnect(um->getGroupsIn()))
-				r.OutputJSON(j).Connect(um);
+				r.OutputJSON(j).Connect(in);
 		}
 	}
 
@@ -49,7 +66,12 @@ namespace IO
 	{
 
 		if (fmt == MessageFormat::JSON_FULL || fmt == MessageFormat::JSON_ANNOTATED || fmt == MessageFormat::JSON_SPARSE)
+		{
+			// decoded JSON refers to data owned by the sender and cannot be queued
+			if (queue_size > 0)
+				throw std::runtime_error("ASYNC_QUEUE requires an NMEA or binary message format.");
 			ConnectJSON(r);
+		}
 		else
 			ConnectMessage(r);
 
@@ -62,14 +84,61 @@ namespace IO
 		}
 	}
 
+	void OutputMessage::Disconnect(Receiver &r)
+	{
+		for (int j = 0; j < r.Count(); j++)
+		{
+			Connection<AIS::Message> &m = r.Output(j);
+			m.Disconnect(this);
+			m.Disconnect(&probe_msg);
+			m.Disconnect(&latency_msg);
+			if (queue)
+				m.Disconnect(queue.get());
+
+			Connection<JSON::JSON> &js = r.OutputJSON(j);
+			js.Disconnect(this);
+			js.Disconnect(&probe_json);
+			js.Disconnect(&latency_json);
+
+			r.OutputGPS(j).Disconnect(this);
+		}
+	}
+
+	std::string OutputMessage::getQueuePrometheus(const std::vector<OutputMessage *> &outputs)
+	{
+		std::string depth, depth_max, delivered, dropped;
+
+		for (int i = 0; i < (int)outputs.size(); i++)
+		{
+			Util::AsyncStream<AIS::Message> *q = outputs[i]->getQueue();
+			if (!q)
+				continue;
+
+			std::string label = "{output=\"" + std::to_string(i) + "\"} ";
+			depth += "ais_output_queue_depth" + label + std::to_string(q->getDepth()) + "\n";
+			depth_max += "ais_output_queue_depth_max" + label + std::to_string(q->getMaxDepth()) + "\n";
+			delivered += "ais_output_queue_delivered" + label + std::to_string(q->getDelivered()) + "\n";
+			dropped += "ais_output_queue_dropped" + label + std::to_string(q->getDropped()) + "\n";
+		}
+
+		if (depth.empty())
+			return "";
+
+		return "# HELP ais_output_queue_depth Blocks waiting in the output queue\n# TYPE ais_output_queue_depth gauge\n" + depth +
+			   "# HELP ais_output_queue_depth_max Largest number of blocks waiting in the output queue\n# TYPE ais_output_queue_depth_max gauge\n" + depth_max +
+			   "# HELP ais_output_queue_delivered Blocks passed on to the output\n# TYPE ais_output_queue_delivered counter\n" + delivered +
+			   "# HELP ais_output_queue_dropped Blocks dropped because the output queue was full\n# TYPE ais_output_queue_dropped counter\n" + dropped;
+	}
+
 	void OutputJSON::Connect(Receiver &r)
 	{
+		StreamIn<JSON::JSON> *um = (StreamIn<JSON::JSON> *)&*this;
+		StreamIn<JSON::JSON> *in = connectStages<JSON::JSON>(um, profile, probe_json, latency, latency_json, true);
 
 		for (int j = 0; j < r.Count(); j++)
 		{
-			StreamIn<JSON::JSON> *um = (StreamIn<JSON::JSON> *)&*this;
 			if (r.Output(j).canConnect(um->getGroupsIn()))
-				r.OutputJSON(j).Connect(um);
+				r.OutputJSON(j).Connect(in);
 
 			StreamIn<AIS::GPS> *ug = (StreamIn<AIS::GPS> *)&*this;
 			if (r.OutputGPS(j).canConnect(ug->getGroupsIn()))
@@ -77,4 +146,16 @@ namespace IO
 		}
 	}
 
+	void OutputJSON::Disconnect(Receiver &r)
+	{
+		for (int j = 0; j < r.Count(); j++)
+		{
+			Connection<JSON::JSON> &js = r.OutputJSON(j);
+			js.Disconnect(this);
+			js.Disconnect(&probe_json);
+			js.Disconnect(&latency_json);
+
+			r.OutputGPS(j).Disconnect(this);
+		}
+	}
 }
@@ -19,6 +19,7 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <memory>
 
 #include "Common.h"
 #include "Stream.h"
@@ -26,6 +27,7 @@
 #include "Parse.h"
 #include "ADSB.h"
 #include "Keys.h"
+#include "StreamHelpers.h"
 #include "JSON/JSON.h"
 #include "JSON/StringBuilder.h"
 
@@ -34,12 +36,63 @@ class Receiver;
 namespace IO
 {
 
+	// default stage name for an output with PROFILE or LATENCY on
+	std::string getProfileName();
+
+	// inserts the optional profiler and latency stages in front of the output, returns the new input
+	template <typename T>
+	StreamIn<T> *connectStages(StreamIn<T> *in, bool profile, Util::Probe<T> &probe, bool latency, Util::Latency<T> &lat, bool json)
+	{
+		if (!profile && !latency)
+			return in;
+
+		std::string name = probe.getName().empty() ? lat.getName() : probe.getName();
+		if (name.empty())
+			name = getProfileName();
+
+		if (profile)
+		{
+			if (!probe.out.isConnected())
+			{
+				probe.attach(name);
+				probe.out.Connect(in);
+			}
+			in = &probe;
+		}
+
+		if (latency)
+		{
+			if (!lat.out.isConnected())
+			{
+				lat.attach(name, json);
+				lat.out.Connect(in);
+			}
+			in = &lat;
+		}
+
+		return in;
+	}
+
 	class OutputJSON : public StreamIn<JSON::JSON>, public StreamIn<AIS::GPS>, public Setting
 	{
+	protected:
+		// PROFILE: time spent per message in the output, reported on /api/perf
+		bool profile = false;
+		Util::Probe<JSON::JSON> probe_json;
+
+		// LATENCY: time from the capture of the samples to the send, reported on /api/stat.json
+		bool latency = false;
+		Util::Latency<JSON::JSON> latency_json;
+
 	public:
 		virtual void Start() {}
 		virtual void Stop() {}
 		void Connect(Receiver &r);
+		// with the message lock held when the receiver is running
+		void Disconnect(Receiver &r);
+
+		// statistics in Prometheus text format, added to /metrics of the web viewer
+		virtual std::string getPrometheus() { return ""; }
 
 		virtual ~OutputJSON() { Stop(); }
 	};
@@ -53,6 +106,22 @@ namespace IO
 
 		MessageFormat fmt = MessageFormat::JSON_FULL;
 
+		// optional queue between the receivers and this output, see ASYNC_QUEUE
+		std::unique_ptr<Util::AsyncStream<AIS::Message>> queue;
+		int queue_size = 0, queue_batch = 16;
+		Util::AsyncStream<AIS::Message>::Overflow queue_overflow = Util::AsyncStream<AIS::Message>::Overflow::BLOCK;
+		bool queue_shared = false;
+
+		// PROFILE: time spent per message in the output, reported on /api/perf
+		bool profile = false;
+		Util::Probe<AIS::Message> probe_msg;
+		Util::Probe<JSON::JSON> probe_json;
+
+		// LATENCY: time from the capture of the samples to the send, reported on /api/stat.json
+		bool latency = false;
+		Util::Latency<AIS::Message> latency_msg;
+		Util::Latency<JSON::JSON> latency_json;
+
 		void ConnectMessage(Receiver &r);
 		void ConnectJSON(Receiver &r);
 
@@ -60,10 +129,25 @@ namespace IO
 		virtual void Start() {}
 		virtual void Stop() {}
 		void Connect(Receiver &r);
+		// with the message lock held when the receiver is running, the queue keeps what it holds
+		void Disconnect(Receiver &r);
 
 		OutputMessage() : builder(&AIS::KeyMap, JSON_DICT_FULL) {}
 		virtual ~OutputMessage() { Stop(); }
 
+		// statistics in Prometheus text format, added to /metrics of the web viewer
+		virtual std::string getPrometheus() { return ""; }
+
+		// delivers what is queued, to be called after the receivers have stopped
+		void StopQueue()
+		{
+			if (queue)
+				queue->stop();
+		}
+
+		Util::AsyncStream<AIS::Message> *getQueue() { return queue.get(); }
+		static std::string getQueuePrometheus(const std::vector<OutputMessage *> &outputs);
+
 
 		bool setOption(std::string option, std::string arg)
 		{
@@ -94,6 +178,46 @@ namespace IO
 
 				return true;
 			}
+			else if (option == "ASYNC_QUEUE")
+			{
+				queue_size = Util::Parse::Integer(arg, 0, 1000000, option);
+				return true;
+			}
+			else if (option == "ASYNC_BATCH")
+			{
+				queue_batch = Util::Parse::Integer(arg, 1, 1024, option);
+				return true;
+			}
+			else if (option == "ASYNC_OVERFLOW")
+			{
+				Util::Convert::toUpper(arg);
+
+				if (arg == "BLOCK")
+					queue_overflow = Util::AsyncStream<AIS::Message>::Overflow::BLOCK;
+				else if (arg == "DROP_OLDEST")
+					queue_overflow = Util::AsyncStream<AIS::Message>::Overflow::DROP_OLDEST;
+				else if (arg == "DROP_NEWEST")
+					queue_overflow = Util::AsyncStream<AIS::Message>::Overflow::DROP_NEWEST;
+				else
+					throw std::runtime_error("Unknown overflow policy: " + arg);
+
+				return true;
+			}
+			else if (option == "ASYNC_SHARED")
+			{
+				queue_shared = Util::Parse::Switch(arg);
+				return true;
+			}
+			else if (option == "PROFILE")
+			{
+				profile = Util::Parse::Switch(arg);
+				return true;
+			}
+			else if (option == "LATENCY")
+			{
+				latency = Util::Parse::Switch(arg);
+				return true;
+			}
 			return filter.SetOption(option, arg);
 		}
 	};
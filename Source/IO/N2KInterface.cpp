@@ -30,9 +30,12 @@
 
 #include <iostream>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <net/if.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
@@ -86,11 +89,55 @@ namespace N2K
 		if (r < 0 || fcntl(skt, F_SETFL, r | O_NONBLOCK) < 0)
 			return false;
 
+		if (!setFilter())
+			Warning() << "NMEA2000: cannot set CAN filter, receiving all traffic.";
+
+		received.clear();
+		received_pos = 0;
+
 		return true;
 	}
 
+	void tNMEA2000_SKTCAN::setReceiveFilter(const unsigned long *pgns)
+	{
+		filter.clear();
+		for (; *pgns; pgns++)
+			filter.push_back(*pgns);
+	}
+
+	// the PGN sits in bits 8 to 25 of the 29 bit identifier, for PDU1 formats (PF < 240) the low byte is the
+	// destination address and not part of the PGN. Priority and source address are not matched.
+	bool tNMEA2000_SKTCAN::setFilter()
+	{
+		if (filter.empty())
+			return true;
+
+		std::vector<struct can_filter> f(filter.size());
+
+		for (std::size_t i = 0; i < filter.size(); i++)
+		{
+			unsigned long pgn = filter[i];
+			unsigned long mask = ((pgn >> 8) & 0xFF) < 240 ? 0x3FF00 : 0x3FFFF;
+
+			f[i].can_id = ((pgn & mask) << 8) | CAN_EFF_FLAG;
+			f[i].can_mask = (mask << 8) | CAN_EFF_FLAG;
+		}
+
+		return setsockopt(skt, SOL_CAN_RAW, CAN_RAW_FILTER, f.data(), f.size() * sizeof(struct can_filter)) == 0;
+	}
+
 	bool tNMEA2000_SKTCAN::CANSendFrame(unsigned long id, unsigned char len, const unsigned char *buf, bool wait_sent)
 	{
+		if (batching)
+		{
+			Frame f;
+			f.id = id;
+			f.len = len;
+			memcpy(f.data, buf, 8);
+			batch.push_back(f);
+			return true;
+		}
+
 		struct can_frame frame_wr = {0};
 
 		frame_wr.can_id = id | CAN_EFF_FLAG;
@@ -102,31 +149,92 @@ namespace N2K
 
 	bool tNMEA2000_SKTCAN::CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf)
 	{
-		struct can_frame frame_rd;
-		struct timeval tv = {0, 0};
-		fd_set fds;
+		// ParseMessages asks for frames until there are none, so all waiting frames are fetched at once
+		if (received_pos == received.size())
+		{
+			const int MAX_FRAMES = 64;
 
-		FD_ZERO(&fds);
-		FD_SET(skt, &fds);
+			struct can_frame frames[MAX_FRAMES];
+			struct iovec iov[MAX_FRAMES];
+			struct mmsghdr msgs[MAX_FRAMES];
 
-		if (select((skt + 1), &fds, NULL, NULL, &tv) < 0)
-			return false;
+			received.clear();
+			received_pos = 0;
 
-		if (FD_ISSET(skt, &fds))
-		{
-			if (read(skt, &frame_rd, sizeof(frame_rd)) > 0)
+			if (skt == -1)
+				return false;
+
+			for (int i = 0; i < MAX_FRAMES; i++)
 			{
-				memcpy(buf, frame_rd.data, 8);
-				len = frame_rd.can_dlc;
-				id = frame_rd.can_id;
-				return true;
+				iov[i].iov_base = &frames[i];
+				iov[i].iov_len = sizeof(frames[i]);
+
+				memset(&msgs[i], 0, sizeof(msgs[i]));
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
 			}
+
+			int r = recvmmsg(skt, msgs, MAX_FRAMES, MSG_DONTWAIT, NULL);
+
+			if (r <= 0)
+				return false;
+
+			reads++;
+
+			for (int i = 0; i < r; i++)
+			{
+				if (msgs[i].msg_len != sizeof(struct can_frame))
+					continue;
+
+				Frame f;
+				f.id = frames[i].can_id;
+				f.len = frames[i].can_dlc;
+				memcpy(f.data, frames[i].data, 8);
+				received.push_back(f);
+			}
+
+			frames_received += received.size();
+
+			if (received.empty())
+				return false;
 		}
-		return false;
+
+		const Frame &f = received[received_pos++];
+
+		memcpy(buf, f.data, 8);
+		len = f.len;
+		id = f.id;
+		return true;
 	}
 
 	// additions not in tNMEA2000
 	void tNMEA2000_SKTCAN::waitForFrame(int milliseconds)
+	{
+		struct timeval tv = {milliseconds / 1000, (milliseconds % 1000) * 1000};
+		fd_set fds;
+		int max_fd = -1;
+
+		FD_ZERO(&fds);
+		if (skt != -1)
+		{
+			FD_SET(skt, &fds);
+			max_fd = skt;
+		}
+		if (wake_fd[0] != -1)
+		{
+			FD_SET(wake_fd[0], &fds);
+			max_fd = MAX(max_fd, wake_fd[0]);
+		}
+
+		if (select(max_fd + 1, &fds, NULL, NULL, &tv) > 0 && wake_fd[0] != -1 && FD_ISSET(wake_fd[0], &fds))
+		{
+			char buf[64];
+			while (read(wake_fd[0], buf, sizeof(buf)) > 0)
+				;
+		}
+	}
+
+	void tNMEA2000_SKTCAN::waitForWrite(int milliseconds)
 	{
 		struct timeval tv = {0, milliseconds * 1000};
 		fd_set fds;
@@ -134,7 +242,83 @@ namespace N2K
 		FD_ZERO(&fds);
 		FD_SET(skt, &fds);
 
-		select((skt + 1), &fds, NULL, NULL, &tv);
+		select((skt + 1), NULL, &fds, NULL, &tv);
+	}
+
+	void tNMEA2000_SKTCAN::flushBatch()
+	{
+		const int MAX_FRAMES = 64;
+
+		struct can_frame frames[MAX_FRAMES];
+		struct iovec iov[MAX_FRAMES];
+		struct mmsghdr msgs[MAX_FRAMES];
+
+		batching = false;
+
+		std::size_t done = 0;
+		int retries = 0;
+
+		while (done < batch.size() && skt != -1)
+		{
+			int n = MIN((int)(batch.size() - done), MAX_FRAMES);
+
+			for (int i = 0; i < n; i++)
+			{
+				const Frame &f = batch[done + i];
+
+				memset(&frames[i], 0, sizeof(frames[i]));
+				frames[i].can_id = f.id | CAN_EFF_FLAG;
+				frames[i].can_dlc = f.len;
+				memcpy(frames[i].data, f.data, 8);
+
+				iov[i].iov_base = &frames[i];
+				iov[i].iov_len = sizeof(frames[i]);
+
+				memset(&msgs[i], 0, sizeof(msgs[i]));
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			int r = sendmmsg(skt, msgs, n, 0);
+
+			if (r > 0)
+			{
+				done += r;
+				writes++;
+				continue;
+			}
+
+			// the interface queue is full, give the bus a moment to catch up
+			if (r < 0 && (errno == EAGAIN || errno == ENOBUFS) && retries++ < 10)
+			{
+				waitForWrite(5);
+				continue;
+			}
+			break;
+		}
+
+		frames_sent += done;
+		frames_dropped += batch.size() - done;
+		batch.clear();
+	}
+
+	void tNMEA2000_SKTCAN::openWakeup()
+	{
+		if (wake_fd[0] != -1 || pipe(wake_fd) != 0)
+			return;
+
+		for (int fd : wake_fd)
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	}
+
+	void tNMEA2000_SKTCAN::wakeup()
+	{
+		if (wake_fd[1] != -1)
+		{
+			char c = 0;
+			if (write(wake_fd[1], &c, 1) < 0)
+				return;
+		}
 	}
 
 	void tNMEA2000_SKTCAN::Close()
@@ -142,6 +326,16 @@ namespace N2K
 		if (skt != -1)
 		{
 			close(skt);
+			skt = -1;
+		}
+
+		for (int &fd : wake_fd)
+		{
+			if (fd != -1)
+			{
+				close(fd);
+				fd = -1;
+			}
 		}
 	}
 
@@ -174,6 +368,11 @@ namespace N2K
 
 	const unsigned long SupportedMessages[] = {129038L, 129793L, 129794L, 129798L, 129039L, 129040L, 129809L, 129810L, 129041L, 129802L, 129802L, 0};
 
+	// what reaches user space: the AIS PGNs and what the library needs to take part in the network,
+	// ISO acknowledgement, request, transport protocol, address claim and the group and product information
+	const unsigned long ReceivedMessages[] = {129038L, 129793L, 129794L, 129798L, 129039L, 129040L, 129809L, 129810L, 129041L, 129802L,
+											  59392L, 59904L, 60160L, 60416L, 60928L, 65240L, 126208L, 126464L, 126993L, 126996L, 126998L, 0};
+
 	void N2KHubInterfaceHub::Start()
 	{
 
@@ -192,10 +391,19 @@ namespace N2K
 			if (input)
 				NMEA2000.ExtendReceiveMessages(SupportedMessages);
 
+			NMEA2000.setReceiveFilter(ReceivedMessages);
 			NMEA2000.SetMode(tNMEA2000::N2km_ListenAndNode, 23);
 			NMEA2000.SetOnOpen(&N2KHubInterfaceHub::onOpenStatic);
 			NMEA2000.SetMsgHandler(onMsgStatic);
 
+			for (auto &r : ring)
+				r.init(queue_size);
+			outgoing.reserve(2 * queue_size);
+
+			budget = frame_rate;
+			last_drain = std::chrono::steady_clock::now();
+			NMEA2000.openWakeup();
+
 			Debug() << "Opening NMEA2000 network \"" + network + "\"...";
 
 			if (!NMEA2000.Open())
@@ -209,33 +417,168 @@ namespace N2K
 
 	void N2KHubInterfaceHub::Stop()
 	{
-		NMEA2000.Close();
 		if (running)
 		{
 			running = false;
+			NMEA2000.wakeup();
 			run_thread.join();
 		}
+		NMEA2000.Close();
+	}
+
+	int N2KHubInterfaceHub::getPriority(const tN2kMsg &msg)
+	{
+		switch (msg.PGN)
+		{
+		case 129038L:
+		case 129039L:
+		case 129040L:
+		case 129798L:
+		case 129802L:
+			return PRIORITY_POSITION;
+		default:
+			return PRIORITY_STATIC;
+		}
+	}
+
+	// all AIS PGNs are fast packets: 6 data bytes in the first frame, 7 in the ones that follow
+	int N2KHubInterfaceHub::countFrames(const tN2kMsg &msg)
+	{
+		return msg.DataLen <= 6 ? 1 : 1 + (msg.DataLen - 6 + 6) / 7;
 	}
 
 	void N2KHubInterfaceHub::sendMsg(const tN2kMsg &N2kMsg)
 	{
-		if (running)
+		if (!running)
+			return;
+
+		int p = getPriority(N2kMsg);
+
 		{
-			std::lock_guard<std::mutex> lock(mtx);
-			NMEA2000.SendMsg(N2kMsg);
+			std::lock_guard<std::mutex> lock(queue_mtx);
+			Ring &r = ring[p];
+
+			if (r.full())
+			{
+				// a newer position supersedes the oldest one, statics are dropped on arrival
+				if (p == PRIORITY_STATIC)
+				{
+					dropped_static++;
+					return;
+				}
+				r.pop();
+				dropped_position++;
+			}
+			r.push(N2kMsg);
+
+			int backlog = ring[0].size() + ring[1].size();
+			if (backlog > max_backlog)
+				max_backlog = backlog;
 		}
+
+		NMEA2000.wakeup();
+	}
+
+	// returns true if statics are held back for lack of bus budget
+	bool N2KHubInterfaceHub::drain()
+	{
+		auto now = std::chrono::steady_clock::now();
+		budget = MIN((double)frame_rate, budget + std::chrono::duration<double>(now - last_drain).count() * frame_rate);
+		last_drain = now;
+
+		bool pending;
+
+		outgoing.clear();
+		{
+			std::lock_guard<std::mutex> lock(queue_mtx);
+
+			Ring &position = ring[PRIORITY_POSITION];
+			Ring &statics = ring[PRIORITY_STATIC];
+
+			// positions always go out, statics only while the frame budget for the bus allows
+			while (position.size())
+			{
+				budget -= countFrames(position.front());
+				outgoing.push_back(position.front());
+				position.pop();
+			}
+
+			while (statics.size() && budget > 0)
+			{
+				budget -= countFrames(statics.front());
+				outgoing.push_back(statics.front());
+				statics.pop();
+			}
+
+			pending = statics.size() > 0;
+		}
+
+		if (!outgoing.empty())
+		{
+			NMEA2000.beginBatch();
+			for (const tN2kMsg &msg : outgoing)
+				NMEA2000.SendMsg(msg);
+			NMEA2000.flushBatch();
+
+			sent += outgoing.size();
+		}
+
+		return pending;
 	}
 
 	void N2KHubInterfaceHub::run()
 	{
 		while (running)
 		{
+			bool pending = false;
 			{
 				std::unique_lock<std::mutex> lck(mtx);
 				NMEA2000.ParseMessages();
+				if (output)
+					pending = drain();
 			}
-			NMEA2000.waitForFrame(250);
+			NMEA2000.waitForFrame(pending ? 20 : 250);
+		}
+	}
+
+	std::string N2KHubInterfaceHub::getPrometheus()
+	{
+		int queued, backlog;
+		{
+			std::lock_guard<std::mutex> lock(queue_mtx);
+			queued = ring[0].size() + ring[1].size();
+			backlog = max_backlog;
 		}
+
+		std::string element;
+
+		element += "# HELP ais_n2k_queued Messages waiting for the NMEA2000 bus\n";
+		element += "# TYPE ais_n2k_queued gauge\n";
+		element += "ais_n2k_queued " + std::to_string(queued) + "\n";
+		element += "# HELP ais_n2k_max_backlog Largest number of messages waiting for the NMEA2000 bus\n";
+		element += "# TYPE ais_n2k_max_backlog gauge\n";
+		element += "ais_n2k_max_backlog " + std::to_string(backlog) + "\n";
+		element += "# HELP ais_n2k_sent Messages sent to the NMEA2000 bus\n";
+		element += "# TYPE ais_n2k_sent counter\n";
+		element += "ais_n2k_sent " + std::to_string(sent.load()) + "\n";
+		element += "# HELP ais_n2k_dropped Messages dropped because the NMEA2000 queue was full\n";
+		element += "# TYPE ais_n2k_dropped counter\n";
+		element += "ais_n2k_dropped{class=\"position\"} " + std::to_string(dropped_position.load()) + "\n";
+		element += "ais_n2k_dropped{class=\"static\"} " + std::to_string(dropped_static.load()) + "\n";
+		element += "# HELP ais_n2k_frames_sent CAN frames written to the NMEA2000 interface\n";
+		element += "# TYPE ais_n2k_frames_sent counter\n";
+		element += "ais_n2k_frames_sent " + std::to_string(NMEA2000.frames_sent.load()) + "\n";
+		element += "# HELP ais_n2k_frames_dropped CAN frames the NMEA2000 interface did not accept\n";
+		element += "# TYPE ais_n2k_frames_dropped counter\n";
+		element += "ais_n2k_frames_dropped " + std::to_string(NMEA2000.frames_dropped.load()) + "\n";
+		element += "# HELP ais_n2k_frames_received CAN frames received from the NMEA2000 interface after the kernel filter\n";
+		element += "# TYPE ais_n2k_frames_received counter\n";
+		element += "ais_n2k_frames_received " + std::to_string(NMEA2000.frames_received.load()) + "\n";
+		element += "# HELP ais_n2k_reads Batched reads from the NMEA2000 interface\n";
+		element += "# TYPE ais_n2k_reads counter\n";
+		element += "ais_n2k_reads " + std::to_string(NMEA2000.reads.load()) + "\n";
+
+		return element;
 	}
 }
 
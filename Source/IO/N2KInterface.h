@@ -25,6 +25,8 @@
 #include <list>
 #include <chrono>
 #include <condition_variable>
+#include <atomic>
+#include <vector>
 
 #ifdef HASNMEA2000
 #include <NMEA2000.h>
@@ -47,18 +49,51 @@ namespace N2K
 		bool CANGetFrame(unsigned long &id, unsigned char &len, unsigned char *buf);
 
 		int skt = -1;
+		int wake_fd[2] = {-1, -1};
 		std::string CANinterface;
 
 		bool OpenInterface(const std::string &port);
 
+		// frames sent between beginBatch and flushBatch are collected and written with a single sendmmsg
+		struct Frame
+		{
+			unsigned long id;
+			unsigned char len;
+			unsigned char data[8];
+		};
+
+		std::vector<Frame> batch;
+		bool batching = false;
+
+		void waitForWrite(int milliseconds);
+
+		// received frames are read in batches with recvmmsg and handed to the library one at a time
+		std::vector<Frame> received;
+		std::size_t received_pos = 0;
+
+		// PGNs passed by the kernel filter on the socket, all traffic if empty
+		std::vector<unsigned long> filter;
+		bool setFilter();
+
 	public:
 		virtual ~tNMEA2000_SKTCAN() {}
 
+		std::atomic<uint64_t> frames_sent{0}, frames_dropped{0}, writes{0};
+		std::atomic<uint64_t> frames_received{0}, reads{0};
+
 		// additions to support the N2KHub class
 		void waitForFrame(int m);
 		void Close();
 
+		void openWakeup();
+		void wakeup();
+
+		void beginBatch() { batching = true; }
+		void flushBatch();
+
 		void setNetwork(std::string n) { CANinterface = n; }
+		// zero terminated list, set before opening
+		void setReceiveFilter(const unsigned long *pgns);
 	};
 
 	extern tNMEA2000_SKTCAN NMEA2000;
@@ -79,6 +114,59 @@ namespace N2K
 
 		bool connected = false;
 
+		// outgoing messages wait in preallocated rings, positions and safety messages before statics
+		class Ring
+		{
+			std::vector<tN2kMsg> slots;
+			int head = 0, count = 0;
+
+		public:
+			void init(int n)
+			{
+				slots.resize(n);
+				head = count = 0;
+			}
+
+			int size() { return count; }
+			bool full() { return count == (int)slots.size(); }
+			tN2kMsg &front() { return slots[head]; }
+
+			void pop()
+			{
+				head = (head + 1) % slots.size();
+				count--;
+			}
+
+			void push(const tN2kMsg &msg)
+			{
+				slots[(head + count) % slots.size()] = msg;
+				count++;
+			}
+		};
+
+		enum
+		{
+			PRIORITY_POSITION = 0,
+			PRIORITY_STATIC = 1
+		};
+
+		std::mutex queue_mtx;
+		Ring ring[2];
+		std::vector<tN2kMsg> outgoing;
+
+		int queue_size = 256;
+		int frame_rate = 1000;
+		double budget = 0;
+		std::chrono::steady_clock::time_point last_drain;
+
+		std::atomic<uint64_t> sent{0}, dropped_position{0}, dropped_static{0};
+		int max_backlog = 0;
+
+		static int getPriority(const tN2kMsg &msg);
+		static int countFrames(const tN2kMsg &msg);
+
+		bool drain();
+
 		void onOpen();
 		static void onOpenStatic();
 
@@ -128,6 +216,11 @@ namespace N2K
 		}
 
 		void sendMsg(const tN2kMsg &N2kMsg);
+
+		void setQueueSize(int n) { queue_size = n; }
+		void setFrameRate(int r) { frame_rate = r; }
+
+		std::string getPrometheus();
 	};
 
 #else
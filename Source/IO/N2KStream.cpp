@@ -754,6 +754,10 @@ namespace IO {
 		}
 	}
 
+	std::string N2KStreamer::getPrometheus() {
+		return N2K::N2KInterface.getPrometheus();
+	}
+
 	Setting& N2KStreamer::Set(std::string option, std::string arg) {
 		Util::Convert::toUpper(option);
 
@@ -764,6 +768,18 @@ namespace IO {
 		else if (option == "DEVICE") {
 			dev = arg;
 		}
+		else if (option == "QUEUE") {
+			N2K::N2KInterface.setQueueSize(Util::Parse::Integer(arg, 16, 65536, option));
+		}
+		else if (option == "FRAME_RATE") {
+			N2K::N2KInterface.setFrameRate(Util::Parse::Integer(arg, 100, 10000, option));
+		}
+		else if (option == "PROFILE") {
+			profile = Util::Parse::Switch(arg);
+		}
+		else if (option == "LATENCY") {
+			latency = Util::Parse::Switch(arg);
+		}
 		else if (!filter.SetOption(option, arg)) {
 			throw std::runtime_error("JSON output - unknown option: " + option);
 		}
@@ -47,8 +47,6 @@ namespace IO {
 		void Start();
 		void Stop();
 
-		void pushQueue(tN2kMsg* N2kMsg);
-		
 		void sendType123(const AIS::Message& ais, const JSON::JSON* data);
 
 		void sendType4(const AIS::Message& ais, const JSON::JSON* data);
@@ -62,6 +60,7 @@ namespace IO {
 
 		void Receive(const JSON::JSON* data, int ln, TAG& tag);
 		Setting& Set(std::string option, std::string arg);
+		std::string getPrometheus() override;
 #else
 	public:
 		void Start() { std::cout << "NMEA2000 support not included in this build." << std::endl; }
@@ -17,12 +17,19 @@
 
 #include <cstring>
 
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#endif
+
 #include "AIS-catcher.h"
 #include "Network.h"
 #include "Convert.h"
 #include "Parse.h"
 #include "Helper.h"
 #include "Receiver.h"
+#include "Wakeups.h"
 
 namespace IO
 {
@@ -49,9 +56,16 @@ namespace IO
 			running = true;
 			terminate = false;
 
-			run_thread = std::thread(&HTTPStreamer::process, this);
+			http.setKeepAlive(keep_alive);
+
+			multi = shared && HTTPMulti::getInstance().isAvailable();
+			if (multi)
+				HTTPMulti::getInstance().add(this, INTERVAL);
+			else
+				run_thread = std::thread(&HTTPStreamer::process, this);
+
 			std::string filter_str = filter.Get();
-			Debug() << "HTTP: start thread (" << url << ")" << (!filter_str.empty() ? ", " + filter_str : "");
+			Debug() << "HTTP: start " << (multi ? "shared client" : "thread") << " (" << url << ")" << (!filter_str.empty() ? ", " + filter_str : "");
 		}
 	}
 
@@ -61,13 +75,57 @@ namespace IO
 		{
 
 			running = false;
-			terminate = true;
-			run_thread.join();
 
-			Debug() << "HTTP: stop thread (" << url << ").";
+			if (multi)
+				HTTPMulti::getInstance().remove(this);
+			else
+			{
+				{
+					std::lock_guard<std::mutex> lock(terminate_mtx);
+					terminate = true;
+				}
+				terminate_cv.notify_all();
+				run_thread.join();
+				http.disconnect();
+			}
+
+			Debug() << "HTTP: stop " << (multi ? "shared client" : "thread") << " (" << url << ").";
 		}
 	}
 
+	// adds a message to the body, the caller holds msg_list_mutex
+	void HTTPStreamer::append(const std::string &s)
+	{
+		std::string element;
+
+		if (protocol == PROTOCOL::AISCATCHER || protocol == PROTOCOL::AIRFRAMES)
+		{
+			if (!body_count)
+			{
+				const std::string now = Util::Convert::toTimeStr(std::time(0));
+
+				element = "{\"protocol\":\"" + protocol_string + "\",\"encodetime\":\"" + now + "\",\"stationid\":" + stationid + ",\"station_lat\":" + lat +
+						  ",\"station_lon\":" + lon + ",\"receiver\":{\"description\":\"AIS-catcher " VERSION "\",\"version\":";
+				Util::Convert::appendInt(element, VERSION_NUMBER);
+				element += ",\"engine\":" + model + ",\"setting\":" + model_setting + "},\"device\":{\"product\":" + product + ",\"vendor\":" + vendor +
+						   ",\"serial\":" + serial + ",\"setting\":" + device_setting + "},\"msgs\":[ ";
+			}
+			else
+				element = ",";
+
+			element += "\n" + s;
+		}
+		else
+			element = s + "\n";
+
+		if (gzip)
+			body_zip.add(element);
+		else
+			body += element;
+
+		body_count++;
+	}
+
 	void HTTPStreamer::Receive(const JSON::JSON *data, int len, TAG &tag)
 	{
 
@@ -77,21 +135,25 @@ namespace IO
 			{
 				if (protocol == PROTOCOL::NMEA)
 				{
-					const std::vector<std::string> &nmea = ((AIS::Message *)data[i].binary)->NMEA;
+					const StringList &nmea = ((AIS::Message *)data[i].binary)->NMEA;
 					const std::lock_guard<std::mutex> lock(msg_list_mutex);
 
 					for (int j = 0; j < nmea.size(); j++)
 					{
-						msg_list.push_back(nmea[j]);
+						append(nmea[j]);
 					}
 				}
 				else
 				{
 					json.clear();
-					builder.stringify(data[i], json);
+					builder.stringifyCached(data[i], json);
 					{
 						const std::lock_guard<std::mutex> lock(msg_list_mutex);
-						msg_list.push_back(json);
+
+						if (streaming())
+							append(json);
+						else
+							msg_list.push_back(json);
 					}
 				}
 			}
@@ -100,91 +162,133 @@ namespace IO
 
 	void HTTPStreamer::Receive(const AIS::GPS *data, int len, TAG &tag)
 	{
-		lat = std::to_string(data->getLat());
-		lon = std::to_string(data->getLon());
+		lat.clear();
+		lon.clear();
+		Util::Convert::appendFixed(lat, data->getLat());
+		Util::Convert::appendFixed(lon, data->getLon());
 	}
 
-	void HTTPStreamer::post()
+	// the body of the next post, false if there are no messages
+	bool HTTPStreamer::prepare(HTTPRequest &r)
 	{
-		if (!msg_list.size())
-			return;
-
-		std::list<std::string> send_list;
+		r.url = url;
+		r.userpwd = userpwd;
+		r.timeout = TIMEOUT;
+		r.keep_alive = keep_alive;
 
+		if (streaming())
 		{
-			const std::lock_guard<std::mutex> lock(msg_list_mutex);
-			send_list.splice(send_list.begin(), msg_list);
-		}
+			{
+				const std::lock_guard<std::mutex> lock(msg_list_mutex);
 
-		oss.str("");
-		int r;
+				if (!body_count)
+					return false;
 
-		if (protocol == PROTOCOL::AISCATCHER || protocol == PROTOCOL::AIRFRAMES)
-		{
-			const std::string now = Util::Convert::toTimeStr(std::time(0));
+				if (protocol == PROTOCOL::AISCATCHER || protocol == PROTOCOL::AIRFRAMES)
+				{
+					if (gzip)
+						body_zip.add("\n]}\n");
+					else
+						body += "\n]}\n";
+				}
 
-			oss << "{\"protocol\":\"" << protocol_string << "\"," << "\"encodetime\":\"" << now << "\"," << "\"stationid\":" << stationid << "," << "\"station_lat\":" << lat << ","
-				<< "\"station_lon\":" << lon << "," << "\"receiver\":{\"description\":\"AIS-catcher " VERSION "\"," << "\"version\":" << VERSION_NUMBER << ",\"engine\":" << model
-				<< ",\"setting\":" << model_setting << "},\"device\":{\"product\":" << product << ",\"vendor\":" << vendor << ",\"serial\":" << serial << ",\"setting\":" << device_setting << "},\"msgs\":[";
+				if (gzip)
+					body_zip.finish(r.body);
+				else
+					r.body.swap(body);
 
-			char delim = ' ';
-			for (const auto &m : send_list)
-			{
-				oss << delim << "\n"
-					<< m;
-				delim = ',';
+				body.clear();
+				body_count = 0;
 			}
 
-			oss << "\n]}\n";
+			r.encoding = gzip ? "gzip" : "";
+			r.part.clear();
 
-			r = http.Post(oss.str(), gzip, false, "");
+			// zstd compresses the whole body at once, with the context of this thread
+			if (zstd)
+			{
+				ZSTD &z = ZSTD::local();
+				if (z.zip(r.body))
+				{
+					r.body.assign(z.getOutputPtr(), z.getOutputLength());
+					r.encoding = "zstd";
+				}
+			}
+			return true;
 		}
-		else if (PROTOCOL::APRS == protocol)
+
+		if (!msg_list.size())
+			return false;
+
+		std::list<std::string> send_list;
+
 		{
-			const std::string now = Util::Convert::toTimeStr(std::time(0));
+			const std::lock_guard<std::mutex> lock(msg_list_mutex);
+			send_list.splice(send_list.begin(), msg_list);
+		}
 
-			oss << "{\"protocol\":\"jsonais\"," << "\"encodetime\":\"" << now << "\"," << "\"groups\":[{\"path\":[{\"name\":" << stationid << ",\"url\":" << url_json << "}],\"msgs\":[";
+		const std::string now = Util::Convert::toTimeStr(std::time(0));
 
-			char delim = ' ';
+		std::size_t size = 128 + stationid.size() + url_json.size();
+		for (const auto &m : send_list)
+			size += m.size() + 2;
 
-			for (const auto &m : send_list)
-			{
-				oss << delim << "\n"
-					<< m;
-				delim = ',';
-			}
+		std::string &buffer = r.body;
 
-			oss << "\n]}]}";
+		buffer.clear();
+		buffer.reserve(size);
+		buffer += "{\"protocol\":\"jsonais\",\"encodetime\":\"" + now + "\",\"groups\":[{\"path\":[{\"name\":" + stationid + ",\"url\":" + url_json + "}],\"msgs\":[";
 
-			r = http.Post(oss.str(), gzip, true, "jsonais");
-		}
-		else
-		{
-			for (const auto &m : send_list)
-			{
-				oss << m << "\n";
-			}
+		char delim = ' ';
 
-			r = http.Post(oss.str(), gzip, false, "");
+		for (const auto &m : send_list)
+		{
+			buffer += delim;
+			buffer += '\n';
+			buffer += m;
+			delim = ',';
 		}
 
-		if (r < 200 || r > 299)
-			Error() << "HTTP Client [" << url << "]: return code " << r;
+		buffer += "\n]}]}";
+
+		// the multipart form is not compressed
+		r.encoding.clear();
+		r.part = "jsonais";
+		return true;
+	}
+
+	void HTTPStreamer::completed(int status, const std::string &response)
+	{
+		if (status < 200 || status > 299)
+			Error() << "HTTP Client [" << url << "]: return code " << status;
 		else if (show_response)
-			Info() << "HTTP Client [" << url << "]: return code " << r;
+			Info() << "HTTP Client [" << url << "]: return code " << status;
 	}
+
+	void HTTPStreamer::post()
+	{
+		if (!prepare(request))
+			return;
+
+		int r = request.part.empty() ? http.PostEncoded(request.body, request.encoding) : http.Post(request.body, false, true, request.part);
+		completed(r, http.getResponse());
+	}
+
 	void HTTPStreamer::process()
 	{
+		policy.apply("HTTP");
 
-		while (!terminate)
+		while (true)
 		{
-
-			for (int i = 0; i < INTERVAL; i++)
 			{
-				SleepSystem(1000);
-				if (terminate)
+				std::unique_lock<std::mutex> lock(terminate_mtx);
+				if (terminate_cv.wait_for(lock, std::chrono::seconds(INTERVAL), [this]
+										  { return terminate; }))
 					break;
 			}
+
+			Wakeups::add(Wakeups::OUTPUT);
+
 			if (!url.empty())
 				post();
 		}
@@ -217,6 +321,10 @@ namespace IO
 		{
 			TIMEOUT = Util::Parse::Integer(arg, 1, 30, option);
 		}
+		else if (option == "SHARED")
+		{
+			shared = Util::Parse::Switch(arg);
+		}
 		else if (option == "MODEL")
 		{
 			model = JSON::StringBuilder::stringify(arg);
@@ -241,6 +349,18 @@ namespace IO
 		{
 			lat = std::to_string(Util::Parse::Float(arg));
 		}
+		else if (option == "PROFILE")
+		{
+			profile = Util::Parse::Switch(arg);
+		}
+		else if (option == "LATENCY")
+		{
+			latency = Util::Parse::Switch(arg);
+		}
+		else if (option == "AFFINITY" || option == "PRIORITY")
+		{
+			policy.Set(option, arg);
+		}
 		else if (option == "GROUPS_IN")
 		{
 			StreamIn<JSON::JSON>::setGroupsIn(Util::Parse::Integer(arg));
@@ -263,11 +383,25 @@ namespace IO
 				gzip = Util::Parse::Switch(arg);
 				if (gzip && !zip.installed())
 					throw std::runtime_error("HTTP: ZLIB not installed");
+				if (gzip)
+					zstd = false;
+			}
+			else if (option == "ZSTD")
+			{
+				zstd = Util::Parse::Switch(arg);
+				if (zstd && !ZSTD::installed())
+					throw std::runtime_error("HTTP: ZSTD not installed");
+				if (zstd)
+					gzip = false;
 			}
 			else if (option == "RESPONSE")
 			{
 				show_response = Util::Parse::Switch(arg);
 			}
+			else if (option == "KEEP_ALIVE")
+			{
+				keep_alive = Util::Parse::Switch(arg);
+			}
 			else if (option == "PROTOCOL")
 			{
 
@@ -337,6 +471,12 @@ namespace IO
 
 				Info() << "UDP: recreate socket (" << host << ":" << port << ")";
 
+				std::lock_guard<std::mutex> lock(batch_mtx);
+				Flush();
+
+				if (uring)
+					Uring::getInstance().detach(sock);
+
 				closesocket(sock);
 				sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
 
@@ -345,11 +485,104 @@ namespace IO
 					Critical() << "UDP: cannot recreate socket. Requesting termination.";
 					StopRequest();
 				}
+				else
+				{
+					if (multicast)
+						setMulticast();
+					if (uring)
+						attachUring();
+				}
+
 				last_reconnect = now;
 			}
 		}
 	}
 
+	void UDPStreamer::Queue(const std::string &str)
+	{
+		std::lock_guard<std::mutex> lock(batch_mtx);
+
+		// the batch thread sleeps until the first line of a batch arrives
+		if (pending_count == 0)
+			batch_cv.notify_one();
+
+		if (!pack || pending_count == 0 || pending[pending_count - 1].size() + str.size() > MAX_DATAGRAM)
+		{
+			if (pending_count == batch)
+				Flush();
+
+			if (pending_count == pending.size())
+				pending.emplace_back();
+
+			pending[pending_count++].clear();
+		}
+
+		pending[pending_count - 1] += str;
+
+		if (!pack && pending_count == batch)
+			Flush();
+	}
+
+	// batch_mtx must be held
+	void UDPStreamer::Flush()
+	{
+		if (sock != -1 && pending_count > 0 && uring)
+		{
+			for (int i = 0; i < pending_count; i++)
+				Uring::getInstance().write(sock, pending[i].data(), pending[i].size());
+		}
+		else if (sock != -1 && pending_count > 0)
+		{
+#ifdef __linux__
+			std::vector<struct mmsghdr> msgs(pending_count);
+			std::vector<struct iovec> iov(pending_count);
+
+			memset(msgs.data(), 0, pending_count * sizeof(struct mmsghdr));
+			for (int i = 0; i < pending_count; i++)
+			{
+				iov[i].iov_base = (void *)pending[i].data();
+				iov[i].iov_len = pending[i].size();
+				msgs[i].msg_hdr.msg_name = address->ai_addr;
+				msgs[i].msg_hdr.msg_namelen = address->ai_addrlen;
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			// the socket is non-blocking, what cannot be sent is dropped as with a failing sendto
+			int sent = 0;
+			while (sent < pending_count)
+			{
+				int r = sendmmsg(sock, msgs.data() + sent, pending_count - sent, 0);
+				if (r <= 0)
+					break;
+				sent += r;
+			}
+#else
+			for (int i = 0; i < pending_count; i++)
+				sendto(sock, pending[i].c_str(), (int)pending[i].length(), 0, address->ai_addr, (int)address->ai_addrlen);
+#endif
+		}
+		pending_count = 0;
+	}
+
+	void UDPStreamer::process()
+	{
+		policy.apply("UDP");
+		std::unique_lock<std::mutex> lock(batch_mtx);
+
+		while (!batch_terminate)
+		{
+			batch_cv.wait(lock, [this]
+						  { return batch_terminate || pending_count > 0; });
+
+			Wakeups::add(Wakeups::OUTPUT);
+
+			if (!batch_terminate)
+				batch_cv.wait_for(lock, std::chrono::milliseconds(batch_time));
+			Flush();
+		}
+	}
+
 	void UDPStreamer::Receive(const AIS::GPS *data, int len, TAG &tag)
 	{
 
@@ -432,12 +665,70 @@ namespace IO
 			if (filter.include(*(AIS::Message *)data[i].binary))
 			{
 				json.clear();
-				builder.stringify(data[i], json);
+				builder.stringifyCached(data[i], json);
 				SendTo((json + "\r\n").c_str());
 			}
 		}
 	}
 
+	// interface for IPv4 groups is the address of the interface, for IPv6 groups its name or index
+	void UDPStreamer::setMulticast()
+	{
+		unsigned char loop_opt = loop ? 1 : 0;
+
+		if (address->ai_family == AF_INET)
+		{
+			unsigned char ttl_opt = (unsigned char)ttl;
+
+			if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (char *)&ttl_opt, sizeof(ttl_opt)) < 0)
+				throw std::runtime_error("UDP: cannot set multicast TTL.");
+
+			setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, (char *)&loop_opt, sizeof(loop_opt));
+
+			if (!iface.empty())
+			{
+				struct in_addr a;
+				if (inet_pton(AF_INET, iface.c_str(), &a) != 1)
+					throw std::runtime_error("UDP: multicast interface needs to be an IPv4 address: " + iface);
+
+				if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, (char *)&a, sizeof(a)) < 0)
+					throw std::runtime_error("UDP: cannot select multicast interface " + iface);
+			}
+		}
+		else if (address->ai_family == AF_INET6)
+		{
+			int hops = ttl;
+			unsigned int loop6 = loop ? 1 : 0;
+
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (char *)&hops, sizeof(hops)) < 0)
+				throw std::runtime_error("UDP: cannot set multicast hop limit.");
+
+			setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (char *)&loop6, sizeof(loop6));
+
+			if (!iface.empty())
+			{
+				unsigned int index = 0;
+#ifndef _WIN32
+				index = if_nametoindex(iface.c_str());
+#endif
+				if (index == 0)
+					index = (unsigned int)Util::Parse::Integer(iface, 1, 1 << 30, "INTERFACE");
+
+				if (setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, (char *)&index, sizeof(index)) < 0)
+					throw std::runtime_error("UDP: cannot select multicast interface " + iface);
+			}
+		}
+	}
+
+	// a connected socket takes plain writes, which the ring can submit with registered buffers
+	void UDPStreamer::attachUring()
+	{
+		if (connect(sock, address->ai_addr, (int)address->ai_addrlen) != 0)
+			throw std::runtime_error("UDP: cannot connect socket for io_uring to " + host + " port " + port);
+
+		Uring::getInstance().attach(sock, true);
+	}
+
 	void UDPStreamer::Start()
 	{
 		std::stringstream ss;
@@ -449,6 +740,12 @@ namespace IO
 			ss << ", reset: " << reset;
 		if (!uuid.empty())
 			ss << ", uuid: " << uuid;
+		if (batch > 1)
+			ss << ", batch: " << batch << " (" << batch_time << " ms)";
+		if (pack)
+			ss << ", pack: true";
+		if (uring)
+			ss << ", io_uring: true";
 		std::string filter_str = filter.Get();
 		if (!filter_str.empty())
 			ss << ", " << filter_str;
@@ -484,6 +781,17 @@ namespace IO
 			throw std::runtime_error("cannot create socket for UDP " + host + " port " + port);
 		}
 
+		if (address->ai_family == AF_INET)
+			multicast = IN_MULTICAST(ntohl(((struct sockaddr_in *)address->ai_addr)->sin_addr.s_addr));
+		else if (address->ai_family == AF_INET6)
+			multicast = IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)address->ai_addr)->sin6_addr);
+
+		if (multicast)
+		{
+			setMulticast();
+			Info() << "UDP: multicast to group " << host << ", ttl: " << ttl << (iface.empty() ? "" : ", interface: " + iface) << (loop ? "" : ", loop: off");
+		}
+
 #ifndef _WIN32
 		int r = fcntl(sock, F_GETFL, 0);
 		r = fcntl(sock, F_SETFL, r | O_NONBLOCK);
@@ -506,16 +814,41 @@ namespace IO
 		}
 #endif
 
+		if (uring && Uring::getInstance().isAvailable())
+			attachUring();
+		else
+			uring = false;
+
 		if (reset > 0)
 			last_reconnect = (long)std::time(nullptr);
+
+		if (isBatching())
+		{
+			batch_terminate = false;
+			batch_thread = std::thread(&UDPStreamer::process, this);
+		}
 	}
 
 	void UDPStreamer::Stop()
 	{
 		Debug() << "UDP: close socket for host: " << host << ", port: " << port;
 
+		if (batch_thread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(batch_mtx);
+				batch_terminate = true;
+				Flush();
+			}
+			batch_cv.notify_all();
+			batch_thread.join();
+		}
+
 		if (sock != -1)
 		{
+			if (uring)
+				Uring::getInstance().detach(sock);
+
 			closesocket(sock);
 			sock = -1;
 		}
@@ -542,6 +875,18 @@ namespace IO
 		{
 			broadcast = Util::Parse::Switch(arg);
 		}
+		else if (option == "TTL")
+		{
+			ttl = Util::Parse::Integer(arg, 0, 255, option);
+		}
+		else if (option == "INTERFACE")
+		{
+			iface = arg;
+		}
+		else if (option == "LOOP")
+		{
+			loop = Util::Parse::Switch(arg);
+		}
 		else if (option == "GROUPS_IN")
 		{
 			StreamIn<AIS::Message>::setGroupsIn(Util::Parse::Integer(arg));
@@ -562,6 +907,26 @@ namespace IO
 		{
 			include_sample_start = Util::Parse::Switch(arg);
 		}
+		else if (option == "BATCH")
+		{
+			batch = Util::Parse::Integer(arg, 1, 1024, option);
+		}
+		else if (option == "BATCH_TIME")
+		{
+			batch_time = Util::Parse::Integer(arg, 1, 1000, option);
+		}
+		else if (option == "PACK")
+		{
+			pack = Util::Parse::Switch(arg);
+		}
+		else if (option == "IO_URING")
+		{
+			uring = Util::Parse::Switch(arg);
+		}
+		else if (option == "AFFINITY" || option == "PRIORITY")
+		{
+			policy.Set(option, arg);
+		}
 		else if (!OutputMessage::setOption(option, arg))
 		{
 			throw std::runtime_error("UDP output - unknown option: " + option);
@@ -584,14 +949,7 @@ namespace IO
 			for (int i = 0; i < len; i++)
 			{
 
-				if (SendTo((data[i].getNMEA() + "\r\n").c_str()) < 0)
-				{
-					if (!persistent)
-					{
-						Error() << "TCP feed: requesting termination.";
-						StopRequest();
-					}
-				}
+				SendTo((data[i].getNMEA() + "\r\n").c_str());
 			}
 		}
 		else
@@ -599,14 +957,7 @@ namespace IO
 			for (int i = 0; i < len; i++)
 			{
 
-				if (SendTo((data[i].getJSON() + "\r\n").c_str()) < 0)
-				{
-					if (!persistent)
-					{
-						Error() << "TCP feed: requesting termination.";
-						StopRequest();
-					}
-				}
+				SendTo((data[i].getJSON() + "\r\n").c_str());
 			}
 		}
 	}
@@ -622,14 +973,7 @@ namespace IO
 
 				for (const auto &s : data[i].NMEA)
 				{
-					if (SendTo((s + "\r\n").c_str()) < 0)
-					{
-						if (!persistent)
-						{
-							Error() << "TCP feed: requesting termination.";
-							StopRequest();
-						}
-					}
+					SendTo((s + "\r\n").c_str());
 				}
 			}
 		}
@@ -640,14 +984,7 @@ namespace IO
 				if (!filter.include(data[i]))
 					continue;
 
-				if (SendTo(data[i].getNMEATagBlock()) < 0)
-				{
-					if (!persistent)
-					{
-						Error() << "TCP feed: requesting termination.";
-						StopRequest();
-					}
-				}
+				SendTo(data[i].getNMEATagBlock());
 			}
 		}
 		else if ((fmt == MessageFormat::COMMUNITY_HUB && !isFirstDataSend() && lines_sent % 100 != 0) || fmt == MessageFormat::BINARY_NMEA)
@@ -658,14 +995,7 @@ namespace IO
 					continue;
 
 				std::string binary_packet = data[i].getBinaryNMEA(tag);
-				if (SendTo(binary_packet) < 0)
-				{
-					if (!persistent)
-					{
-						Error() << "TCP feed: requesting termination.";
-						StopRequest();
-					}
-				}
+				SendTo(binary_packet);
 			}
 		}
 		else
@@ -675,14 +1005,7 @@ namespace IO
 				if (!filter.include(data[i]))
 					continue;
 
-				if (SendTo((data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, include_sample_start, tag.ipv4, uuid) + "\r\n").c_str()) < 0)
-				{
-					if (!persistent)
-					{
-						Error() << "TCP feed: requesting termination.";
-						StopRequest();
-					}
-				}
+				SendTo((data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, include_sample_start, tag.ipv4, uuid) + "\r\n").c_str());
 			}
 		}
 	}
@@ -695,13 +1018,8 @@ namespace IO
 			if (filter.include(*(AIS::Message *)data[i].binary))
 			{
 				json.clear();
-				builder.stringify(data[i], json);
-				if (SendTo((json + "\r\n").c_str()) < 0)
-					if (!persistent)
-					{
-						Critical() << "TCP feed: requesting termination.";
-						StopRequest();
-					}
+				builder.stringifyCached(data[i], json);
+				SendTo((json + "\r\n").c_str());
 			}
 		}
 	}
@@ -731,8 +1049,10 @@ namespace IO
 
 		connection = &tcp;
 
+		spool.open(spool_size, spool_file);
+
 		if (connection->connect())
-			ss << "connected\n";
+			ss << "connected";
 		else
 		{
 			if (!persistent)
@@ -744,13 +1064,191 @@ namespace IO
 				ss << "pending";
 		}
 
+		if (spool_on)
+		{
+			ss << ", spool: " << spool_size << " bytes";
+			if (spool.isMapped())
+				ss << " in " << spool_file;
+			if (replay_rate > 0)
+				ss << ", replay at " << replay_rate << " lines/s";
+		}
+
 		Info() << ss.str();
+
+		terminate = false;
+		send_thread = std::thread(&TCPClientStreamer::process, this);
 	}
 
 	void TCPClientStreamer::Stop()
 	{
+		if (send_thread.joinable())
+		{
+			{
+				std::unique_lock<std::mutex> lock(spool_mtx);
+
+				// give the send thread a moment to deliver what is queued, a spool file keeps it anyway
+				if (!spool.isMapped())
+					spool_cv.wait_for(lock, std::chrono::seconds(1), [this]
+									  { return spool.empty(); });
+
+				terminate = true;
+			}
+			spool_cv.notify_all();
+			send_thread.join();
+		}
+
 		if (connection)
 			connection->disconnect();
+
+		spool.close();
+	}
+
+	void TCPClientStreamer::SendTo(const char *str, int len)
+	{
+		lines_sent++;
+
+		{
+			const std::lock_guard<std::mutex> lock(spool_mtx);
+			spool.push(str, len);
+		}
+		spool_cv.notify_one();
+	}
+
+	void TCPClientStreamer::process()
+	{
+		std::string record;
+		uint64_t pos = 0;
+		int offset = 0;
+		bool pending = false;
+
+		bool connected = connection->isConnected();
+		uint64_t replay_until = 0;
+
+		auto next_send = std::chrono::steady_clock::now();
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(spool_mtx);
+
+				if (!pending)
+				{
+					spool_cv.wait(lock, [this]
+								  { return terminate || !spool.empty(); });
+					Wakeups::add(Wakeups::OUTPUT);
+				}
+
+				if (terminate)
+					break;
+
+				if (!pending)
+				{
+					if (!spool.front(record, pos))
+						continue;
+
+					pending = true;
+					offset = 0;
+				}
+			}
+
+			// throttle the backlog that built up during an outage so the receiving end is not flooded
+			if (replay_rate > 0 && pos < replay_until)
+			{
+				auto now = std::chrono::steady_clock::now();
+				if (now < next_send)
+				{
+					std::unique_lock<std::mutex> lock(spool_mtx);
+					spool_cv.wait_until(lock, next_send, [this]
+										{ return terminate; });
+					continue;
+				}
+				next_send = std::max(next_send, now - std::chrono::seconds(1)) + std::chrono::microseconds(1000000 / replay_rate);
+			}
+
+			int r = connection->send(record.data() + offset, (int)record.length() - offset);
+
+			if (r < 0)
+			{
+				Error() << "TCP feed: requesting termination.";
+				StopRequest();
+				break;
+			}
+
+			if (r == 0)
+			{
+				if (connection->isConnected())
+				{
+					// socket buffer full, try again shortly
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+					continue;
+				}
+
+				connected = false;
+
+				std::unique_lock<std::mutex> lock(spool_mtx);
+
+				if (!spool_on)
+				{
+					spool.clear();
+					pending = false;
+				}
+
+				// the socket reconnects on the next send attempt, wait until then
+				spool_cv.wait_for(lock, std::chrono::milliseconds(100), [this]
+								  { return terminate; });
+				continue;
+			}
+
+			if (!connected)
+			{
+				connected = true;
+
+				const std::lock_guard<std::mutex> lock(spool_mtx);
+				replay_until = spool.getTail();
+				next_send = std::chrono::steady_clock::now();
+
+				if (spool_on && spool.bytes() > record.length())
+					Info() << "TCP feed: reconnected, replaying " << spool.bytes() << " bytes.";
+			}
+
+			offset += r;
+
+			if (offset == (int)record.length())
+			{
+				const std::lock_guard<std::mutex> lock(spool_mtx);
+				spool.pop(pos);
+				pending = false;
+				sent++;
+
+				if (spool.empty())
+					spool_cv.notify_all();
+			}
+		}
+	}
+
+	std::string TCPClientStreamer::getPrometheus()
+	{
+		uint64_t bytes, dropped;
+		{
+			const std::lock_guard<std::mutex> lock(spool_mtx);
+			bytes = spool.bytes();
+			dropped = spool.getDropped();
+		}
+
+		std::string label = "{host=\"" + host + "\",port=\"" + port + "\"}";
+		std::string element;
+
+		element += "# HELP ais_tcp_client_spool Bytes waiting to be sent to the server\n";
+		element += "# TYPE ais_tcp_client_spool gauge\n";
+		element += "ais_tcp_client_spool" + label + " " + std::to_string(bytes) + "\n";
+		element += "# HELP ais_tcp_client_sent Lines sent to the server\n";
+		element += "# TYPE ais_tcp_client_sent counter\n";
+		element += "ais_tcp_client_sent" + label + " " + std::to_string(sent) + "\n";
+		element += "# HELP ais_tcp_client_dropped Lines dropped while disconnected or because the spool was full\n";
+		element += "# TYPE ais_tcp_client_dropped counter\n";
+		element += "ais_tcp_client_dropped" + label + " " + std::to_string(dropped) + "\n";
+
+		return element;
 	}
 
 	Setting &TCPClientStreamer::Set(std::string option, std::string arg)
@@ -789,6 +1287,23 @@ namespace IO
 		{
 			include_sample_start = Util::Parse::Switch(arg);
 		}
+		else if (option == "SPOOL")
+		{
+			spool_on = Util::Parse::Switch(arg);
+		}
+		else if (option == "SPOOL_SIZE")
+		{
+			spool_size = (uint64_t)Util::Parse::Integer(arg, 64, 1 << 20, option) * 1024;
+		}
+		else if (option == "SPOOL_FILE")
+		{
+			spool_file = arg;
+			spool_on = true;
+		}
+		else if (option == "REPLAY_RATE")
+		{
+			replay_rate = Util::Parse::Integer(arg, 0, 100000, option);
+		}
 		else if (!OutputMessage::setOption(option, arg))
 		{
 			throw std::runtime_error("TCP client - unknown option: " + option);
@@ -834,6 +1349,10 @@ namespace IO
 		{
 			include_sample_start = Util::Parse::Switch(arg);
 		}
+		else if (option == "LISTENERS")
+		{
+			setListeners(Util::Parse::Integer(arg, 1, 64, option));
+		}
 		else if (!OutputMessage::setOption(option, arg))
 		{
 			throw std::runtime_error("TCP listener - unknown option: " + option);
@@ -917,17 +1436,126 @@ namespace IO
 			if (filter.include(*(AIS::Message *)data[i].binary))
 			{
 				json.clear();
-				builder.stringify(data[i], json);
+				builder.stringifyCached(data[i], json);
 				SendAllDirect((json + "\r\n").c_str());
 			}
 		}
 	}
 
+	std::string TCPlistenerStreamer::getPrometheus()
+	{
+		int clients;
+		std::size_t queued, max_queued;
+		uint64_t dropped;
+
+		getQueueStats(clients, queued, max_queued, dropped);
+
+		std::string label = "{port=\"" + std::to_string(port) + "\"}";
+		std::string element;
+
+		element += "# HELP ais_tcp_listener_clients Connected clients\n";
+		element += "# TYPE ais_tcp_listener_clients gauge\n";
+		element += "ais_tcp_listener_clients" + label + " " + std::to_string(clients) + "\n";
+		element += "# HELP ais_tcp_listener_queued Bytes waiting to be written to clients\n";
+		element += "# TYPE ais_tcp_listener_queued gauge\n";
+		element += "ais_tcp_listener_queued" + label + " " + std::to_string(queued) + "\n";
+		element += "# HELP ais_tcp_listener_max_backlog Largest output backlog of a connected client in bytes\n";
+		element += "# TYPE ais_tcp_listener_max_backlog gauge\n";
+		element += "ais_tcp_listener_max_backlog" + label + " " + std::to_string(max_queued) + "\n";
+		element += "# HELP ais_tcp_listener_dropped Messages skipped for clients that are not reading\n";
+		element += "# TYPE ais_tcp_listener_dropped counter\n";
+		element += "ais_tcp_listener_dropped" + label + " " + std::to_string(dropped) + "\n";
+
+		return element;
+	}
+
 	void MQTTStreamer::Stop()
 	{
+		if (running)
+		{
+			{
+				const std::lock_guard<std::mutex> lock(queue_mutex);
+				terminate = true;
+			}
+			queue_signal.notify_one();
+			publisher.join();
+			running = false;
+		}
+
 		session->disconnect();
 	}
 
+	void MQTTStreamer::publish(const std::string &topic, const std::string &payload)
+	{
+		if (!async)
+		{
+			((Protocol::MQTT *)session)->send(payload.c_str(), payload.length(), topic);
+			return;
+		}
+
+		{
+			const std::lock_guard<std::mutex> lock(queue_mutex);
+
+			if (queue.size() >= queue_size)
+			{
+				dropped++;
+				return;
+			}
+
+			queue.push_back({topic, payload});
+		}
+
+		queue_signal.notify_one();
+	}
+
+	void MQTTStreamer::process()
+	{
+		policy.apply("MQTT");
+		Protocol::MQTT *m = (Protocol::MQTT *)session;
+		std::unique_lock<std::mutex> lock(queue_mutex);
+
+		while (!terminate || !queue.empty())
+		{
+			queue_signal.wait_for(lock, std::chrono::milliseconds(100), [this]
+								  { return terminate || !queue.empty(); });
+
+			if (queue.empty())
+			{
+				lock.unlock();
+				session->read(nullptr, 0, 0, false);
+				inflight = m->getInflight();
+				lock.lock();
+				continue;
+			}
+
+			// consecutive messages for the same topic are combined, up to the maximum packet size
+			Publication p = std::move(queue.front());
+			queue.pop_front();
+
+			for (int n = 1; n < batch && !queue.empty() && queue.front().topic == p.topic && p.payload.size() + queue.front().payload.size() <= Protocol::MQTT::MAX_LENGTH; n++)
+			{
+				p.payload += queue.front().payload;
+				queue.pop_front();
+			}
+
+			lock.unlock();
+
+			// wait for acknowledgements when the window is full, the read processes the PUBACKs
+			for (int i = 0; i < 5 && !terminate && m->getQoS() > 0 && m->getInflight() >= window && session->isConnected(); i++)
+				session->read(nullptr, 0, 1, false);
+
+			if (m->send(p.payload.c_str(), p.payload.length(), p.topic) > 0)
+				published++;
+			else
+				dropped++;
+
+			session->read(nullptr, 0, 0, false);
+			inflight = m->getInflight();
+
+			lock.lock();
+		}
+	}
+
 	void MQTTStreamer::Start()
 	{
 		std::stringstream ss;
@@ -979,6 +1607,15 @@ namespace IO
 		{
 			throw std::runtime_error("MQTT: cannot connect to " + session->getHost() + " port " + session->getPort());
 		}
+
+		if (async && !running)
+		{
+			ss << ", async: queue " << queue_size << ", window " << window << ", batch " << batch;
+
+			terminate = false;
+			running = true;
+			publisher = std::thread(&MQTTStreamer::process, this);
+		}
 		Info() << ss.str();
 	}
 
@@ -993,22 +1630,21 @@ namespace IO
 			{
 				for (const auto &s : data[i].NMEA)
 				{
-					((Protocol::MQTT *)session)->send((s + "\r\n").c_str(), s.length() + 2, topic_template.get(tag, data[0]));
+					publish(topic_template.get(tag, data[i]), s + "\r\n");
 				}
 			}
 			else if (fmt == MessageFormat::BINARY_NMEA)
 			{
-				std::string binary = data[i].getBinaryNMEA(tag);
-				((Protocol::MQTT *)session)->send(binary.c_str(), binary.length(), topic_template.get(tag, data[0]));
+				publish(topic_template.get(tag, data[i]), data[i].getBinaryNMEA(tag));
 			}
 			else
 			{
-				std::string s = data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, tag.ipv4) + "\n";
-				((Protocol::MQTT *)session)->send(s.c_str(), s.length(), topic_template.get(tag, data[0]));
+				publish(topic_template.get(tag, data[i]), data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, tag.ipv4) + "\n");
 			}
 		}
 
-		session->read(nullptr, 0, 0, false);
+		if (!async)
+			session->read(nullptr, 0, 0, false);
 	}
 
 	void MQTTStreamer::Receive(const JSON::JSON *data, int len, TAG &tag)
@@ -1018,13 +1654,43 @@ namespace IO
 			if (filter.include(*(AIS::Message *)data[i].binary))
 			{
 				json.clear();
-				builder.stringify(data[i], json);
+				builder.stringifyCached(data[i], json);
 				json += "\n";
-				((Protocol::MQTT *)session)->send(json.c_str(), json.length(), topic_template.get(tag, *((AIS::Message *)data[0].binary)));
+				publish(topic_template.get(tag, *((AIS::Message *)data[i].binary)), json);
 			}
 		}
 
-		session->read(nullptr, 0, 0, false);
+		if (!async)
+			session->read(nullptr, 0, 0, false);
+	}
+
+	std::string MQTTStreamer::getPrometheus()
+	{
+		if (!async)
+			return "";
+
+		int depth;
+		{
+			const std::lock_guard<std::mutex> lock(queue_mutex);
+			depth = queue.size();
+		}
+
+		std::string element;
+
+		element += "# HELP ais_mqtt_queue Messages waiting to be published\n";
+		element += "# TYPE ais_mqtt_queue gauge\n";
+		element += "ais_mqtt_queue " + std::to_string(depth) + "\n";
+		element += "# HELP ais_mqtt_inflight Published messages waiting for acknowledgement\n";
+		element += "# TYPE ais_mqtt_inflight gauge\n";
+		element += "ais_mqtt_inflight " + std::to_string(inflight) + "\n";
+		element += "# HELP ais_mqtt_published Packets published\n";
+		element += "# TYPE ais_mqtt_published counter\n";
+		element += "ais_mqtt_published " + std::to_string(published) + "\n";
+		element += "# HELP ais_mqtt_dropped Messages dropped because the queue was full or the broker not connected\n";
+		element += "# TYPE ais_mqtt_dropped counter\n";
+		element += "ais_mqtt_dropped " + std::to_string(dropped) + "\n";
+
+		return element;
 	}
 
 	Setting &MQTTStreamer::Set(std::string option, std::string arg)
@@ -1073,6 +1739,26 @@ namespace IO
 			mqtt.setValue("TOPIC", arg);
 			topic_template.set(arg);
 		}
+		else if (option == "ASYNC")
+		{
+			async = Util::Parse::Switch(arg);
+		}
+		else if (option == "QUEUE")
+		{
+			queue_size = Util::Parse::Integer(arg, 1, 1000000, option);
+		}
+		else if (option == "WINDOW")
+		{
+			window = Util::Parse::Integer(arg, 1, 1024, option);
+		}
+		else if (option == "BATCH")
+		{
+			batch = Util::Parse::Integer(arg, 1, 100, option);
+		}
+		else if (option == "AFFINITY" || option == "PRIORITY")
+		{
+			policy.Set(option, arg);
+		}
 		else if (!tcp.setValue(option, arg) && !mqtt.setValue(option, arg) && !ws.setValue(option, arg) && !OutputMessage::setOption(option, arg))
 		{
 			throw std::runtime_error("MQTT output - unknown option: " + option);
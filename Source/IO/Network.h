@@ -17,8 +17,12 @@
 
 #pragma once
 #include <list>
+#include <vector>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
 #include <sstream>
 
 #include "TemplateString.h"
@@ -43,16 +47,19 @@
 #include "Library/ZIP.h"
 #include "HTTPServer.h"
 #include "HTTPClient.h"
+#include "HTTPMulti.h"
 #include "Protocol.h"
 
 #include "JSON/JSON.h"
 #include "JSON/StringBuilder.h"
 #include "MsgOut.h"
+#include "Spool.h"
+#include "Uring.h"
 
 namespace IO
 {
 
-	class HTTPStreamer : public OutputJSON
+	class HTTPStreamer : public OutputJSON, public HTTPMultiClient
 	{
 
 		JSON::StringBuilder builder;
@@ -62,13 +69,26 @@ namespace IO
 		std::string json;
 
 		std::thread run_thread;
+		Util::ThreadPolicy policy;
 		bool terminate = false, running = false;
+		std::mutex terminate_mtx;
+		std::condition_variable terminate_cv;
 
 		ZIP zip;
-		std::ostringstream oss;
+		// the next post, the allocation of the body is kept between posts
+		HTTPRequest request;
+
+		// SHARED: post from the thread of the libcurl client shared by all HTTP outputs, if available
+		bool shared = true, multi = false;
+
+		// body of the next post, built and compressed while the messages arrive
+		std::string body;
+		ZIPStream body_zip;
+		int body_count = 0;
 
 		std::string url, url_json, userpwd;
-		bool gzip = false, show_response = true;
+		// ZSTD: the body is compressed with zstd, for servers that accept it, instead of gzip
+		bool gzip = false, zstd = false, show_response = true, keep_alive = true;
 		int INTERVAL = 60;
 		int TIMEOUT = 10;
 
@@ -90,6 +110,12 @@ namespace IO
 		void post();
 		void process();
 
+		bool prepare(HTTPRequest &r);
+		void completed(int status, const std::string &response);
+
+		void append(const std::string &s);
+		bool streaming() const { return protocol != PROTOCOL::APRS; }
+
 		void Receive(const JSON::JSON *data, int len, TAG &tag);
 		void Receive(const AIS::GPS *data, int len, TAG &tag);
 
@@ -137,6 +163,38 @@ namespace IO
 		std::string uuid;
 		bool include_sample_start = false;
 
+		// multicast: one datagram reaches every member of the group, TTL limits how many routers it crosses
+		bool multicast = false;
+		int ttl = 1;
+		bool loop = true;
+		std::string iface;
+
+		void setMulticast();
+
+		// IO_URING: the socket is connected and datagrams are written by the shared io_uring thread
+		bool uring = false;
+		void attachUring();
+
+		// optional coalescing of the output: up to batch datagrams are sent per call (sendmmsg on Linux)
+		// and flushed at least every batch_time ms, with pack lines share a datagram up to MAX_DATAGRAM bytes
+		int batch = 1;
+		int batch_time = 5;
+		bool pack = false;
+		const static int MAX_DATAGRAM = 1472;
+
+		std::vector<std::string> pending;
+		int pending_count = 0;
+		std::mutex batch_mtx;
+		std::condition_variable batch_cv;
+		std::thread batch_thread;
+		Util::ThreadPolicy policy;
+		bool batch_terminate = false;
+
+		bool isBatching() { return batch > 1 || pack; }
+		void Queue(const std::string &str);
+		void Flush();
+		void process();
+
 		void ResetIfNeeded();
 
 	public:
@@ -157,9 +215,14 @@ namespace IO
 			Start();
 		}
 		void Stop();
-		void SendTo(std::string str)
+		void SendTo(const std::string &str)
 		{
-			sendto(sock, str.c_str(), (int)str.length(), 0, address->ai_addr, (int)address->ai_addrlen);
+			if (isBatching())
+				Queue(str);
+			else if (uring)
+				Uring::getInstance().write(sock, str.c_str(), str.length());
+			else
+				sendto(sock, str.c_str(), (int)str.length(), 0, address->ai_addr, (int)address->ai_addrlen);
 		}
 	};
 
@@ -175,8 +238,25 @@ namespace IO
 		bool include_sample_start = false;
 		unsigned long lines_sent = 0;
 
+		// lines are queued and written by the send thread so the decoders never wait for the network,
+		// with SPOOL on they are kept while disconnected (optionally in SPOOL_FILE) and replayed after a reconnect
+		Spool spool;
+		bool spool_on = false;
+		uint64_t spool_size = 4 * 1024 * 1024;
+		std::string spool_file;
+		int replay_rate = 0;
+
+		std::mutex spool_mtx;
+		std::condition_variable spool_cv;
+		std::thread send_thread;
+		bool terminate = false;
+		std::atomic<uint64_t> sent{0};
+
+		void process();
+
 	public:
 		TCPClientStreamer() : OutputMessage() { fmt = MessageFormat::NMEA; }
+		~TCPClientStreamer() { Stop(); }
 
 		Setting &Set(std::string option, std::string arg);
 
@@ -187,31 +267,16 @@ namespace IO
 		void Start();
 		void Stop();
 
-		int SendTo(std::string str)
-		{
-			if (connection)
-			{
-				lines_sent++;
-				return connection->send(str.c_str(), (int)str.length());
-			}
-
-			return -1;
-		}
-
-		int SendTo(const char *str)
-		{
-			if (connection)
-			{
-				lines_sent++;
-				return connection->send(str, strlen(str));
-			}
-			return -1;
-		}
+		void SendTo(const std::string &str) { SendTo(str.c_str(), (int)str.length()); }
+		void SendTo(const char *str) { SendTo(str, (int)strlen(str)); }
+		void SendTo(const char *str, int len);
 
 		bool isFirstDataSend()
 		{
 			return tcp.getBytesSent() == 0;
 		}
+
+		std::string getPrometheus() override;
 	};
 
 	class TCPlistenerStreamer : public OutputMessage, public IO::TCPServer
@@ -233,6 +298,8 @@ namespace IO
 
 		void Start();
 		void Stop() {}
+
+		std::string getPrometheus() override;
 	};
 
 	class MQTTStreamer : public OutputMessage
@@ -249,12 +316,36 @@ namespace IO
 		std::string json;
 		Util::TemplateString topic_template;
 
+		// ASYNC mode: messages are queued and published from a separate thread with
+		// up to WINDOW unacknowledged QoS 1/2 messages in flight
+		struct Publication
+		{
+			std::string topic, payload;
+		};
+
+		std::deque<Publication> queue;
+		std::mutex queue_mutex;
+		std::condition_variable queue_signal;
+		std::thread publisher;
+		Util::ThreadPolicy policy;
+
+		bool async = false, running = false, terminate = false;
+		int queue_size = 1000, window = 16, batch = 1;
+
+		std::atomic<long> published{0}, dropped{0};
+		std::atomic<int> inflight{0};
+
+		void publish(const std::string &topic, const std::string &payload);
+		void process();
+
 	public:
 		MQTTStreamer() : OutputMessage(), topic_template("ais/data")
 		{
 			fmt = MessageFormat::JSON_FULL;
 		}
 
+		~MQTTStreamer() { Stop(); }
+
 		void Start();
 		void Stop();
 
@@ -262,5 +353,6 @@ namespace IO
 		void Receive(const JSON::JSON *data, int len, TAG &tag);
 
 		Setting &Set(std::string option, std::string arg);
+		std::string getPrometheus() override;
 	};
 }
@@ -66,6 +66,9 @@ namespace Protocol
 
 #ifdef HASOPENSSL
 	std::once_flag TLS::ssl_init_flag;
+	std::mutex TLS::session_mtx;
+	SSL_CTX *TLS::shared_ctx[2] = {nullptr, nullptr};
+	std::map<std::string, SSL_SESSION *> TLS::sessions;
 #endif
 
 	void TCP::disconnect()
@@ -217,6 +220,7 @@ namespace Protocol
 		if (r != -1)
 		{
 			state = READY;
+			failures = 0;
 
 			Debug() << "TCP (" << host << ":" << port << "): connected.";
 			onConnect();
@@ -243,6 +247,15 @@ namespace Protocol
 		return isConnected(timeout) || persistent;
 	}
 
+	void TCP::backoff()
+	{
+		int wait = RECONNECT_TIME << MIN(failures, 5);
+		wait = MIN(wait, RECONNECT_TIME_MAX);
+
+		retry_wait = std::uniform_int_distribution<int>(wait / 2, wait)(rng);
+		failures++;
+	}
+
 	bool TCP::isConnected(int t)
 	{
 		if (state == READY)
@@ -281,6 +294,7 @@ namespace Protocol
 			}
 
 			state = READY;
+			failures = 0;
 
 			Debug() << "TCP (" << host << ":" << port << "): connected.";
 			onConnect();
@@ -302,7 +316,7 @@ namespace Protocol
 
 		else if (state == DISCONNECTED)
 		{
-			if (std::difftime(time(nullptr), stamp) > RECONNECT_TIME)
+			if (std::difftime(time(nullptr), stamp) > retry_wait)
 			{
 				Warning() << "TCP (" << host << ":" << port << "): not connected, reconnecting.";
 				reconnect();
@@ -313,7 +327,7 @@ namespace Protocol
 		{
 			bool connected = isConnected(0);
 
-			if (!connected && std::difftime(time(nullptr), stamp) > RECONNECT_TIME)
+			if (!connected && std::difftime(time(nullptr), stamp) > retry_wait)
 			{
 				Warning() << "TCP (" << host << ":" << port << "): timeout connecting to server, reconnect.";
 				reconnect();
@@ -356,6 +370,45 @@ namespace Protocol
 		return sent;
 	}
 
+	int IQLink::read(void *data, int length, int t, bool wait)
+	{
+		if (!prev)
+			return -1;
+
+		const std::size_t available = (samples.size() - offset) * sizeof(CFLOAT32);
+
+		if (available == 0)
+		{
+			samples.clear();
+			offset = 0;
+
+			while (!decoder.next(samples))
+			{
+				if (buffer.empty())
+					buffer.resize(16384);
+
+				int len = prev->read(buffer.data(), buffer.size(), t, wait);
+				if (len <= 0)
+					return len;
+
+				decoder.push(buffer.data(), len);
+			}
+
+			if (decoder.getRate() != expected_rate && !rate_warning)
+			{
+				Warning() << "IQ link: remote sends at " << decoder.getRate() << " Hz, expected " << expected_rate << " Hz.";
+				rate_warning = true;
+			}
+		}
+
+		// whole samples only, the caller can pass any length
+		int n = MIN((std::size_t)length / sizeof(CFLOAT32), samples.size() - offset);
+		std::memcpy(data, samples.data() + offset, n * sizeof(CFLOAT32));
+		offset += n;
+
+		return n * sizeof(CFLOAT32);
+	}
+
 	int TCP::read(void *data, int length, int timeout, bool wait)
 	{
 		updateState();
@@ -459,19 +512,22 @@ namespace Protocol
 #endif
 	}
 
-	void TLS::onConnect()
+	SSL_CTX *TLS::getContext(bool verify)
 	{
-		// Create SSL context
+		std::lock_guard<std::mutex> lock(session_mtx);
+
+		SSL_CTX *&ctx = shared_ctx[verify ? 1 : 0];
+		if (ctx)
+			return ctx;
+
 		ctx = SSL_CTX_new(TLS_client_method());
 		if (!ctx)
-		{
-			Error() << "TLS: Failed to create SSL context for " << getHost() << ":" << getPort();
-		}
+			return nullptr;
 
 		// Disable weak SSL/TLS protocols (SSLv2, SSLv3, TLS 1.0, TLS 1.1)
 		SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
 
-		if (verify_certificates)
+		if (verify)
 		{
 			SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
 			SSL_CTX_set_default_verify_paths(ctx);
@@ -479,9 +535,57 @@ namespace Protocol
 		else
 		{
 			SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
-			Warning() << "TLS: Certificate verification DISABLED for " << getHost() << ":" << getPort();
 		}
 
+		// sessions (IDs and TLS 1.3 tickets) are handed to onNewSession and stored per host by us
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, onNewSession);
+
+		return ctx;
+	}
+
+	int TLS::onNewSession(SSL *ssl, SSL_SESSION *session)
+	{
+		TLS *tls = (TLS *)SSL_get_app_data(ssl);
+		if (!tls)
+			return 0;
+
+		std::lock_guard<std::mutex> lock(session_mtx);
+
+		SSL_SESSION *&stored = sessions[tls->getSessionKey()];
+		if (stored)
+			SSL_SESSION_free(stored);
+		stored = session;
+
+		// we keep the reference
+		return 1;
+	}
+
+	void TLS::dropSession()
+	{
+		std::lock_guard<std::mutex> lock(session_mtx);
+
+		auto it = sessions.find(getSessionKey());
+		if (it != sessions.end())
+		{
+			SSL_SESSION_free(it->second);
+			sessions.erase(it);
+		}
+	}
+
+	void TLS::onConnect()
+	{
+		ctx = getContext(verify_certificates);
+		if (!ctx)
+		{
+			Error() << "TLS: Failed to create SSL context for " << getHost() << ":" << getPort();
+			disconnect();
+			return;
+		}
+
+		if (!verify_certificates)
+			Warning() << "TLS: Certificate verification DISABLED for " << getHost() << ":" << getPort();
+
 		// Create SSL object
 		ssl = SSL_new(ctx);
 		if (!ssl)
@@ -491,9 +595,20 @@ namespace Protocol
 			return;
 		}
 
+		SSL_set_app_data(ssl, this);
+
 		// Set SNI (Server Name Indication) hostname
 		SSL_set_tlsext_host_name(ssl, getHost().c_str());
 
+		// offer the last session with this host for an abbreviated handshake
+		{
+			std::lock_guard<std::mutex> lock(session_mtx);
+
+			auto it = sessions.find(getSessionKey());
+			if (it != sessions.end())
+				SSL_set_session(ssl, it->second);
+		}
+
 		// Enable hostname verification (protection against MitM attacks)
 		if (verify_certificates)
 		{
@@ -524,11 +639,7 @@ namespace Protocol
 			SSL_free(ssl);
 			ssl = nullptr;
 		}
-		if (ctx)
-		{
-			SSL_CTX_free(ctx);
-			ctx = nullptr;
-		}
+		ctx = nullptr;
 
 		handshake_complete = false;
 		tls_state = TLS_DISCONNECTED;
@@ -586,8 +697,8 @@ namespace Protocol
 		if (!isConnected())
 			return 0;
 
-		// do not block if we are not waiting
-		if (!wait || timeout <= 0)
+		// do not block without a timeout
+		if (timeout <= 0)
 		{
 			int pending = SSL_pending(ssl);
 			if (pending > 0)
@@ -621,7 +732,7 @@ namespace Protocol
 				if (r > 0)
 				{
 					total_received += r;
-					if (total_received >= length)
+					if (total_received >= length || !wait)
 						return total_received;
 
 					continue;
@@ -659,7 +770,7 @@ namespace Protocol
 			if (r > 0)
 			{
 				total_received += r;
-				if (total_received >= length)
+				if (total_received >= length || !wait)
 				{
 					return total_received;
 				}
@@ -713,7 +824,7 @@ namespace Protocol
 			handshake_complete = true;
 			tls_state = TLS_CONNECTED;
 
-			Debug() << "TLS: Connected to " << getHost() << ":" << getPort() << " using " << SSL_get_version(ssl) << " with " << SSL_get_cipher(ssl);
+			Debug() << "TLS: Connected to " << getHost() << ":" << getPort() << " using " << SSL_get_version(ssl) << " with " << SSL_get_cipher(ssl) << (SSL_session_reused(ssl) ? " (session resumed)" : "");
 
 			ProtocolBase::onConnect();
 			return true;
@@ -747,6 +858,7 @@ namespace Protocol
 				Error() << "TLS (" << getHost() << ":" << getPort() << "): System error during handshake: " << strerror(errno);
 			}
 
+			dropSession();
 			disconnect();
 			return false;
 		}
@@ -763,6 +875,7 @@ namespace Protocol
 				Error() << "TLS (" << getHost() << ":" << getPort() << "): SSL Error details: " << err_buf;
 			}
 
+			dropSession();
 			disconnect();
 			return false;
 		}
@@ -1009,6 +1122,9 @@ namespace Protocol
 
 		performHandshake();
 
+		if (connected)
+			resendUnacked();
+
 		ProtocolBase::onConnect();
 	}
 
@@ -1051,7 +1167,7 @@ namespace Protocol
 		if (!isConnected())
 			return 0;
 
-		if (length > 2048)
+		if (length > MAX_LENGTH)
 		{
 			Warning() << "MQTT: message too long, skipped";
 			return -1;
@@ -1065,13 +1181,41 @@ namespace Protocol
 		pushString(tpc);
 
 		if (qos > 0)
-			pushInt(packet_id++);
+		{
+			pushInt(packet_id);
+
+			if (unacked.size() >= MAX_UNACKED)
+				unacked.erase(unacked.begin());
+
+			unacked[packet_id] = packet;
+			unacked[packet_id].insert(unacked[packet_id].end(), (char *)str, (char *)str + length);
+
+			// packet identifiers are non-zero 16 bit
+			packet_id = packet_id % 65535 + 1;
+		}
 
 		packet.insert(packet.end(), (char *)str, (char *)str + length);
 
 		return prev->send(packet.data(), packet.size());
 	}
 
+	void MQTT::resendUnacked()
+	{
+		if (unacked.empty())
+			return;
+
+		Debug() << "MQTT: resending " << unacked.size() << " unacknowledged messages";
+
+		for (auto &p : unacked)
+		{
+			// set DUP flag
+			p.second[0] |= 0x08;
+
+			if (prev->send(p.second.data(), p.second.size()) < 0)
+				return;
+		}
+	}
+
 	int MQTT::send(const void *str, int length)
 	{
 		return send(str, length, topic);
@@ -1189,8 +1333,12 @@ namespace Protocol
 				if (prev->send(packet.data(), packet.size()) != packet.size())
 					return -1;
 
+				acknowledge((buffer[i] << 8) + buffer[i + 1]);
 				break;
 			case PacketType::PUBACK:
+				if (length >= 2)
+					acknowledge((buffer[i] << 8) + buffer[i + 1]);
+				break;
 			case PacketType::DISCONNECT:
 			case PacketType::PUBCOMP:
 			case PacketType::SUBACK:
@@ -23,9 +23,11 @@
 #include <mutex>
 #include <array>
 #include <vector>
+#include <map>
 #include <functional>
 #include <cstring>
 #include <iomanip>
+#include <random>
 
 #ifdef _WIN32
 
@@ -58,6 +60,7 @@
 #include "Parse.h"
 #include "Convert.h"
 #include "Common.h"
+#include "IQLink.h"
 
 namespace Protocol
 {
@@ -220,6 +223,7 @@ namespace Protocol
 	class TCP : public ProtocolBase
 	{
 		const int RECONNECT_TIME = 10;
+		const int RECONNECT_TIME_MAX = 300;
 
 	public:
 		enum State
@@ -306,13 +310,21 @@ namespace Protocol
 		State state = DISCONNECTED;
 		time_t stamp = 0;
 
+		// wait before the next attempt, doubles with every failed attempt and is randomized so that
+		// clients that lost the same server do not all come back at the same moment
+		int failures = 0;
+		int retry_wait = RECONNECT_TIME;
+		std::minstd_rand rng{std::random_device{}()};
+
 		void updateState();
 		bool isConnected(int t);
+		void backoff();
 
 		bool reconnect()
 		{
 			Debug() << "TCP: Reconnecting to " << host << ":" << port;
 			disconnect();
+			backoff();
 			return connect();
 		}
 
@@ -343,6 +355,17 @@ namespace Protocol
 
 		bool verify_certificates = true;
 
+		// contexts are shared by all connections and sessions are kept per host to resume the handshake on a reconnect
+		static std::mutex session_mtx;
+		static SSL_CTX *shared_ctx[2];
+		static std::map<std::string, SSL_SESSION *> sessions;
+
+		static SSL_CTX *getContext(bool verify);
+		static int onNewSession(SSL *ssl, SSL_SESSION *session);
+
+		std::string getSessionKey() { return getHost() + ":" + getPort() + (verify_certificates ? "" : ":noverify"); }
+		void dropSession();
+
 		enum TLS_STATE
 		{
 			TLS_DISCONNECTED,
@@ -427,6 +450,13 @@ namespace Protocol
 		bool connected = false;
 		bool subscribe = false;
 
+		// QoS 1/2 publications waiting for acknowledgement, resent after a reconnect
+		std::map<int, std::vector<uint8_t>> unacked;
+		const int MAX_UNACKED = 1024;
+
+		void acknowledge(int id) { unacked.erase(id); }
+		void resendUnacked();
+
 		void pushVariableLength(int length);
 		void pushByte(uint8_t byte);
 		void pushInt(int length);
@@ -448,6 +478,11 @@ namespace Protocol
 		int send(const void *str, int length) override;
 		int read(void *data, int data_len, int t = 1, bool wait = false) override;
 
+		static const int MAX_LENGTH = 2048;
+
+		int getQoS() const { return qos; }
+		int getInflight() const { return unacked.size(); }
+
 		std::string getValues() override;
 	};
 
@@ -604,6 +639,39 @@ namespace Protocol
 		}
 	};
 
+	// decodes the compressed IQ frames from a remote AIS-catcher into CF32 samples
+	class IQLink : public ProtocolBase
+	{
+		IO::IQDecoder decoder;
+		std::vector<CFLOAT32> samples;
+		std::size_t offset = 0;
+		std::vector<char> buffer;
+
+		uint32_t expected_rate = 96000;
+		bool rate_warning = false;
+
+	public:
+		IQLink() : ProtocolBase("IQLINK") {};
+
+		void onConnect() override
+		{
+			decoder.clear();
+			samples.clear();
+			offset = 0;
+			ProtocolBase::onConnect();
+		}
+
+		int read(void *data, int length, int t = 1, bool wait = false) override;
+
+		bool setValue(const std::string &key, const std::string &value) override
+		{
+			if (key == "RATE" || key == "SAMPLE_RATE")
+				expected_rate = Util::Parse::Integer(value, 0, 20000000);
+
+			return false;
+		}
+	};
+
 	class WebSocket : public ProtocolBase
 	{
 	private:
@@ -637,11 +705,11 @@ namespace Protocol
 		int getFrames(void *data, int length, int t = 1, bool wait = false);
 		int populateData(void *data, int length);
 
-		std::string sha1Hash(const std::string &data);
-
 	public:
 		WebSocket() : ProtocolBase("WS") {};
 
+		static std::string sha1Hash(const std::string &data);
+
 		void onConnect() override;
 		void onDisconnect() override;
 		bool isConnected() override;
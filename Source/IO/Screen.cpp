@@ -16,6 +16,7 @@
 */
 
 #include "Screen.h"
+#include "Convert.h"
 
 namespace IO
 {
@@ -65,22 +66,39 @@ namespace IO
 				case MessageFormat::FULL:
 					for (const auto &s : data[i].NMEA)
 					{
-
-						std::cout << s << " ( ";
+						// one write per line, the numbers as an ostream would print them
+						line.assign(s);
+						line += " ( ";
 
 						if (data[i].getLength() > 0)
-							std::cout << "MSG: " << data[i].type() << ", REPEAT: " << data[i].repeat() << ", MMSI: " << data[i].mmsi();
+						{
+							line += "MSG: ";
+							Util::Convert::appendInt(line, data[i].type());
+							line += ", REPEAT: ";
+							Util::Convert::appendInt(line, data[i].repeat());
+							line += ", MMSI: ";
+							Util::Convert::appendInt(line, data[i].mmsi());
+						}
 						else
-							std::cout << "empty";
+							line += "empty";
 
 						if (tag.mode & 1 && tag.ppm != PPM_UNDEFINED && tag.level != LEVEL_UNDEFINED)
-							std::cout << ", signalpower: " << tag.level << ", ppm: " << tag.ppm;
+						{
+							line += ", signalpower: ";
+							Util::Convert::appendGeneral(line, tag.level);
+							line += ", ppm: ";
+							Util::Convert::appendGeneral(line, tag.ppm);
+						}
 						if (tag.mode & 2)
-							std::cout << ", timestamp: " << data[i].getRxTime();
+							line += ", timestamp: " + data[i].getRxTime();
 						if (data[i].getStation())
-							std::cout << ", ID: " << data[i].getStation();
+						{
+							line += ", ID: ";
+							Util::Convert::appendInt(line, data[i].getStation());
+						}
 
-						std::cout << ")" << std::endl;
+						line += ")";
+						std::cout << line << std::endl;
 					}
 					break;
 				case MessageFormat::JSON_NMEA:
@@ -100,7 +118,7 @@ namespace IO
 			if (filter.include(*(AIS::Message *)data[i].binary))
 			{
 				json.clear();
-				builder.stringify(data[i], json);
+				builder.stringifyCached(data[i], json);
 				std::cout << json << std::endl;
 			}
 		}
@@ -26,6 +26,7 @@ namespace IO
 	{
 	private:
 		bool include_sample_start = false;
+		std::string line;
 
 	public:
 		int verboseUpdateTime = 3;
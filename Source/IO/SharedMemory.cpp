@@ -0,0 +1,190 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <stdexcept>
+
+#include "SharedMemory.h"
+#include "Clock.h"
+
+namespace IO
+{
+	void SharedMemoryOutput::Start()
+	{
+		if (!region.create(name, SharedRing::HEADER_SIZE + capacity))
+			throw std::runtime_error("Shared memory: cannot create \"" + name + "\" of " + std::to_string(capacity / 1024) + " KB.");
+
+		header = (SharedRing::Header *)region.data();
+		ring = region.data() + SharedRing::HEADER_SIZE;
+
+		std::memset(region.data(), 0, SharedRing::HEADER_SIZE);
+		std::memcpy(header->magic, SharedRing::MAGIC, sizeof(SharedRing::MAGIC));
+		header->version = SharedRing::LAYOUT_VERSION;
+		header->header_size = SharedRing::HEADER_SIZE;
+		header->capacity = capacity;
+		if (fmt == MessageFormat::NMEA || fmt == MessageFormat::NMEA_TAG)
+			header->format = SharedRing::NMEA;
+		else if (fmt == MessageFormat::BINARY_NMEA)
+			header->format = SharedRing::BINARY;
+		else
+			header->format = SharedRing::JSON;
+		header->session = (uint64_t)Util::Clock::micros();
+		header->state.store(1, std::memory_order_release);
+
+		Info() << "Shared memory: publishing to \"" << name << "\" with " << capacity / 1024 << " KB ring.";
+	}
+
+	void SharedMemoryOutput::Stop()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (!header)
+			return;
+
+		// readers still hold their mapping and learn from the state that they should reopen
+		header->state.store(0, std::memory_order_release);
+		header = nullptr;
+		ring = nullptr;
+
+		region.close();
+		SharedRing::Region::remove(name);
+	}
+
+	void SharedMemoryOutput::publish(const std::string &s)
+	{
+		uint64_t need = SharedRing::align(SharedRing::RECORD_HEADER + s.size());
+
+		if (!header || need > capacity / 2)
+		{
+			dropped++;
+			return;
+		}
+
+		uint64_t mask = capacity - 1;
+		uint64_t pos = header->head.load(std::memory_order_relaxed);
+		uint64_t offset = pos & mask;
+		uint64_t start = offset + need > capacity ? pos + capacity - offset : pos;
+
+		// announce the bytes that will be overwritten before touching them
+		header->reserve.store(start + need, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		if (start != pos)
+			std::memcpy(ring + offset, &SharedRing::WRAP, sizeof(uint32_t));
+
+		uint32_t rh[2] = {(uint32_t)s.size(), (uint32_t)records};
+		std::memcpy(ring + (start & mask), rh, sizeof(rh));
+		std::memcpy(ring + (start & mask) + SharedRing::RECORD_HEADER, s.data(), s.size());
+
+		header->records.store(++records, std::memory_order_relaxed);
+		header->head.store(start + need, std::memory_order_release);
+
+		bytes += s.size();
+	}
+
+	void SharedMemoryOutput::Receive(const AIS::Message *data, int len, TAG &tag)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		for (int i = 0; i < len; i++)
+		{
+			if (!filter.include(data[i]))
+				continue;
+
+			if (fmt == MessageFormat::NMEA)
+			{
+				record.clear();
+				for (const auto &s : data[i].NMEA)
+				{
+					record += s;
+					record += '\n';
+				}
+				publish(record);
+			}
+			else if (fmt == MessageFormat::NMEA_TAG)
+				publish(data[i].getNMEATagBlock());
+			else if (fmt == MessageFormat::BINARY_NMEA)
+				publish(data[i].getBinaryNMEA(tag));
+			else
+				publish(data[i].getNMEAJSON(tag.mode, tag.level, tag.ppm, tag.status, tag.hardware, tag.version, tag.driver, false, tag.ipv4, "") + '\n');
+		}
+	}
+
+	void SharedMemoryOutput::Receive(const JSON::JSON *data, int len, TAG &tag)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		for (int i = 0; i < len; i++)
+		{
+			if (!filter.include(*(AIS::Message *)data[i].binary))
+				continue;
+
+			json.clear();
+			builder.stringifyCached(data[i], json);
+			json += '\n';
+			publish(json);
+		}
+	}
+
+	Setting &SharedMemoryOutput::Set(std::string option, std::string arg)
+	{
+		Util::Convert::toUpper(option);
+
+		if (option == "GROUPS_IN")
+		{
+			StreamIn<AIS::Message>::setGroupsIn(Util::Parse::Integer(arg));
+			StreamIn<AIS::GPS>::setGroupsIn(Util::Parse::Integer(arg));
+		}
+		else if (option == "NAME")
+		{
+			if (arg.empty() || arg.find_first_of("/\\") != std::string::npos)
+				throw std::runtime_error("Shared memory: invalid name \"" + arg + "\".");
+			name = arg;
+		}
+		else if (option == "SIZE")
+		{
+			// in KB, rounded up to a power of two so positions map with a mask
+			uint64_t size = (uint64_t)Util::Parse::Integer(arg, 64, 1024 * 1024, option) * 1024;
+			for (capacity = 64 * 1024; capacity < size; capacity <<= 1)
+				;
+		}
+		else if (!OutputMessage::setOption(option, arg))
+		{
+			throw std::runtime_error("Shared memory output - unknown option: " + option);
+		}
+		return *this;
+	}
+
+	std::string SharedMemoryOutput::getPrometheus()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		std::string label = "{name=\"" + name + "\"}";
+		std::string element;
+
+		element += "# HELP ais_shm_records Records published to the shared memory ring\n";
+		element += "# TYPE ais_shm_records counter\n";
+		element += "ais_shm_records" + label + " " + std::to_string(records) + "\n";
+		element += "# HELP ais_shm_bytes Payload bytes published to the shared memory ring\n";
+		element += "# TYPE ais_shm_bytes counter\n";
+		element += "ais_shm_bytes" + label + " " + std::to_string(bytes) + "\n";
+		element += "# HELP ais_shm_dropped Records too large for the shared memory ring\n";
+		element += "# TYPE ais_shm_dropped counter\n";
+		element += "ais_shm_dropped" + label + " " + std::to_string(dropped) + "\n";
+		return element;
+	}
+}
@@ -0,0 +1,59 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <string>
+
+#include "MsgOut.h"
+#include "SharedRing.h"
+
+namespace IO
+{
+	// Publishes messages into a ring in shared memory for consumers on the same host, see SharedRing.h
+	// for the layout and the reader. Every message is one record in the selected format. The receivers
+	// take turns to write, readers never take a lock.
+	class SharedMemoryOutput : public OutputMessage
+	{
+		SharedRing::Region region;
+		SharedRing::Header *header = nullptr;
+		uint8_t *ring = nullptr;
+
+		std::string name = "ais-catcher";
+		uint64_t capacity = 4 * 1024 * 1024;
+
+		std::mutex mtx;
+		std::string record;
+		uint64_t records = 0, bytes = 0, dropped = 0;
+
+		void publish(const std::string &s);
+
+	public:
+		SharedMemoryOutput() : OutputMessage() { fmt = MessageFormat::NMEA; }
+		~SharedMemoryOutput() { Stop(); }
+
+		void Start();
+		void Stop();
+
+		void Receive(const AIS::Message *data, int len, TAG &tag);
+		void Receive(const JSON::JSON *data, int len, TAG &tag);
+
+		Setting &Set(std::string option, std::string arg);
+		std::string getPrometheus();
+	};
+}
@@ -0,0 +1,299 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Ring of records in shared memory with one writer (AIS-catcher) and any number of readers on the same
+// host. Readers only map the memory read-only and keep their own position, so they never slow down the
+// writer or each other. A reader that falls more than the capacity behind is lapped and notices it.
+// This header has no other dependencies so consumers can copy it into their own code.
+//
+// Layout, native byte order:
+//
+//	offset  0  char[8]  magic "AISRING\0"
+//	        8  u32      layout version (1)
+//	       12  u32      header size, offset of the data area (128)
+//	       16  u64      capacity of the data area in bytes, a power of two
+//	       24  u32      record format (0 = NMEA lines, 1 = JSON lines, 2 = binary NMEA)
+//	       28  u32      state (1 = writer running, 0 = writer closed, reopen to follow a new writer)
+//	       32  u64      session, the start time of the writer in microseconds
+//	       64  u64      reserve: end position of the record being written
+//	       72  u64      head: end position of the last complete record
+//	       80  u64      records written
+//
+// Positions grow without bounds, the byte at position p is at data[p & (capacity - 1)]. A record is
+// a u32 payload length and a u32 sequence number (low bits of the record count) followed by the
+// payload, padded to a multiple of 8 bytes. A record never wraps: if it does not fit before the end
+// of the data area, a length of 0xFFFFFFFF marks the rest as unused and the record starts at offset 0.
+//
+// The writer raises reserve before it overwrites anything and publishes head after the record is
+// complete. A reader copies a record and then checks that reserve has not come within the capacity of
+// it, otherwise the copy may be torn and the reader restarts at head (seqlock).
+
+namespace IO
+{
+	namespace SharedRing
+	{
+		static const char MAGIC[8] = {'A', 'I', 'S', 'R', 'I', 'N', 'G', '\0'};
+		static const uint32_t LAYOUT_VERSION = 1;
+		static const uint32_t HEADER_SIZE = 128;
+		static const uint32_t RECORD_HEADER = 8;
+		static const uint32_t WRAP = 0xFFFFFFFF;
+
+		enum Format : uint32_t
+		{
+			NMEA = 0,
+			JSON = 1,
+			BINARY = 2
+		};
+
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t header_size;
+			uint64_t capacity;
+			uint32_t format;
+			std::atomic<uint32_t> state;
+			uint64_t session;
+			uint8_t pad[24];
+
+			// written by the writer only, on their own cache line
+			std::atomic<uint64_t> reserve;
+			std::atomic<uint64_t> head;
+			std::atomic<uint64_t> records;
+		};
+
+		static_assert(sizeof(std::atomic<uint64_t>) == 8, "shared ring needs plain 64-bit atomics");
+		static_assert(sizeof(Header) <= HEADER_SIZE, "shared ring header too large");
+
+		inline uint64_t align(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+		// maps a named shared memory object, created by the writer and opened by the readers
+		class Region
+		{
+			uint8_t *map = nullptr;
+			uint64_t length = 0;
+#ifdef _WIN32
+			HANDLE mapping = NULL;
+#endif
+		public:
+			~Region() { close(); }
+
+			uint8_t *data() { return map; }
+			uint64_t size() { return length; }
+
+			// the writer creates the object with a fixed size, readers map what is there
+			bool create(const std::string &name, uint64_t size)
+			{
+				close();
+				length = size;
+#ifdef _WIN32
+				mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, ("Local\\" + name).c_str());
+				if (mapping != NULL)
+					map = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+#else
+				// start from a new object so readers of a previous run keep their own copy
+				shm_unlink(("/" + name).c_str());
+				int fd = shm_open(("/" + name).c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+				if (fd < 0)
+					return false;
+
+				if (ftruncate(fd, (off_t)size) == 0)
+				{
+					void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+					if (p != MAP_FAILED)
+						map = (uint8_t *)p;
+				}
+				::close(fd);
+#endif
+				if (!map)
+					close();
+				return map != nullptr;
+			}
+
+			bool open(const std::string &name)
+			{
+				close();
+#ifdef _WIN32
+				mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, ("Local\\" + name).c_str());
+				if (mapping == NULL)
+					return false;
+
+				map = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				if (map)
+				{
+					MEMORY_BASIC_INFORMATION info;
+					VirtualQuery(map, &info, sizeof(info));
+					length = info.RegionSize;
+				}
+#else
+				int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+				if (fd < 0)
+					return false;
+
+				struct stat st;
+				if (fstat(fd, &st) == 0 && st.st_size >= HEADER_SIZE)
+				{
+					void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+					if (p != MAP_FAILED)
+					{
+						map = (uint8_t *)p;
+						length = st.st_size;
+					}
+				}
+				::close(fd);
+#endif
+				if (!map)
+					close();
+				return map != nullptr;
+			}
+
+			void close()
+			{
+#ifdef _WIN32
+				if (map)
+					UnmapViewOfFile(map);
+				if (mapping != NULL)
+					CloseHandle(mapping);
+				mapping = NULL;
+#else
+				if (map)
+					munmap(map, length);
+#endif
+				map = nullptr;
+				length = 0;
+			}
+
+			static void remove(const std::string &name)
+			{
+#ifndef _WIN32
+				shm_unlink(("/" + name).c_str());
+#endif
+			}
+		};
+
+		// Follows the ring from the newest record on. next() does not block, a reader polls it or
+		// sleeps briefly when there is nothing new. Call open() again after closed() to follow a
+		// restarted writer.
+		class Reader
+		{
+			Region region;
+			const Header *header = nullptr;
+			const uint8_t *ring = nullptr;
+			uint64_t mask = 0, pos = 0, session = 0;
+			uint64_t lost = 0;
+
+		public:
+			bool open(const std::string &name)
+			{
+				header = nullptr;
+				if (!region.open(name))
+					return false;
+
+				const Header *h = (const Header *)region.data();
+				if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->version != LAYOUT_VERSION || h->header_size + h->capacity > region.size())
+				{
+					region.close();
+					return false;
+				}
+
+				header = h;
+				ring = region.data() + h->header_size;
+				mask = h->capacity - 1;
+				session = h->session;
+				pos = h->head.load(std::memory_order_acquire);
+				return true;
+			}
+
+			bool isOpen() const { return header != nullptr; }
+			bool closed() const { return !header || header->state.load(std::memory_order_acquire) == 0 || header->session != session; }
+
+			uint32_t format() const { return header ? header->format : 0; }
+
+			// records skipped because the reader was lapped by the writer
+			uint64_t getLost() const { return lost; }
+
+			// copies the next record into out, false if there is none
+			bool next(std::string &out)
+			{
+				if (!header)
+					return false;
+
+				while (true)
+				{
+					uint64_t head = header->head.load(std::memory_order_acquire);
+
+					if (pos == head)
+						return false;
+
+					if (pos > head || head - pos > header->capacity)
+					{
+						lost++;
+						pos = head;
+						return false;
+					}
+
+					uint32_t len;
+					std::memcpy(&len, ring + (pos & mask), sizeof(len));
+
+					if (len == WRAP)
+					{
+						pos = (pos | mask) + 1;
+						continue;
+					}
+
+					uint64_t end = pos + align(RECORD_HEADER + (uint64_t)len);
+					if (end > head || (pos & mask) + RECORD_HEADER + len > header->capacity)
+					{
+						lost++;
+						pos = head;
+						return false;
+					}
+
+					out.assign((const char *)ring + (pos & mask) + RECORD_HEADER, len);
+
+					// the copy is valid if the writer has not started to overwrite it in the meantime
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (header->reserve.load(std::memory_order_relaxed) - pos > header->capacity)
+					{
+						lost++;
+						pos = header->head.load(std::memory_order_acquire);
+						return false;
+					}
+
+					pos = end;
+					return true;
+				}
+			}
+		};
+	}
+}
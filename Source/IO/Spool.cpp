@@ -0,0 +1,222 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Spool.h"
+#include "Logger.h"
+
+namespace IO
+{
+	static const char MAGIC[8] = {'A', 'I', 'S', 'S', 'P', 'O', 'O', 'L'};
+
+	void Spool::open(uint64_t capacity, const std::string &filename)
+	{
+		close();
+
+		if (!filename.empty())
+		{
+			mapFile(filename, capacity);
+			return;
+		}
+
+		memory.assign(capacity, 0);
+		ring = memory.data();
+
+		header = &local;
+		std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+		header->capacity = capacity;
+		header->head = header->tail = 0;
+	}
+
+	void Spool::mapFile(const std::string &filename, uint64_t capacity)
+	{
+		map_length = HEADER_SIZE + capacity;
+
+#ifdef _WIN32
+		file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("spool: cannot open \"" + filename + "\".");
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(map_length >> 32), (DWORD)map_length, NULL);
+		if (mapping != NULL)
+			map = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)map_length);
+#else
+		int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+			throw std::runtime_error("spool: cannot open \"" + filename + "\".");
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || ((uint64_t)st.st_size != map_length && ftruncate(fd, map_length) != 0))
+		{
+			::close(fd);
+			throw std::runtime_error("spool: cannot set size of \"" + filename + "\".");
+		}
+
+		void *p = mmap(NULL, map_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (p != MAP_FAILED)
+			map = (uint8_t *)p;
+#endif
+		if (!map)
+		{
+			close();
+			throw std::runtime_error("spool: cannot map \"" + filename + "\" into memory.");
+		}
+
+		header = (Header *)map;
+		ring = map + HEADER_SIZE;
+
+		// continue with the records left by a previous run if the layout matches
+		if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->capacity == capacity && header->head <= header->tail && header->tail - header->head <= capacity)
+		{
+			uint64_t pos = header->head;
+			while (pos < header->tail && header->tail - pos >= sizeof(uint32_t))
+				pos += sizeof(uint32_t) + recordLength(pos);
+
+			if (pos == header->tail)
+			{
+				if (!empty())
+					Info() << "spool: " << bytes() << " bytes left from previous run in \"" << filename << "\".";
+				return;
+			}
+
+			Warning() << "spool: \"" << filename << "\" is corrupt, starting empty.";
+		}
+
+		std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+		header->capacity = capacity;
+		header->head = header->tail = 0;
+	}
+
+	void Spool::close()
+	{
+#ifdef _WIN32
+		if (map)
+			UnmapViewOfFile(map);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (map)
+			munmap(map, map_length);
+#endif
+		map = nullptr;
+		map_length = 0;
+
+		memory.clear();
+		ring = nullptr;
+
+		header = &local;
+		header->capacity = 0;
+		header->head = header->tail = 0;
+	}
+
+	void Spool::write(uint64_t pos, const void *data, uint64_t len)
+	{
+		uint64_t offset = pos % header->capacity;
+		uint64_t first = std::min(len, header->capacity - offset);
+
+		std::memcpy(ring + offset, data, first);
+		std::memcpy(ring, (const uint8_t *)data + first, len - first);
+	}
+
+	void Spool::read(uint64_t pos, void *data, uint64_t len)
+	{
+		uint64_t offset = pos % header->capacity;
+		uint64_t first = std::min(len, header->capacity - offset);
+
+		std::memcpy(data, ring + offset, first);
+		std::memcpy((uint8_t *)data + first, ring, len - first);
+	}
+
+	uint32_t Spool::recordLength(uint64_t pos)
+	{
+		uint32_t len;
+		read(pos, &len, sizeof(len));
+		return len;
+	}
+
+	bool Spool::push(const char *data, int len)
+	{
+		uint64_t needed = sizeof(uint32_t) + len;
+
+		if (!ring || needed > header->capacity)
+		{
+			dropped++;
+			return false;
+		}
+
+		while (header->capacity - bytes() < needed)
+		{
+			header->head += sizeof(uint32_t) + recordLength(header->head);
+			dropped++;
+		}
+
+		uint32_t l = len;
+		write(header->tail, &l, sizeof(l));
+		write(header->tail + sizeof(l), data, len);
+		header->tail += needed;
+
+		return true;
+	}
+
+	bool Spool::front(std::string &out, uint64_t &pos)
+	{
+		if (empty())
+			return false;
+
+		pos = header->head;
+
+		uint32_t len = recordLength(pos);
+		out.resize(len);
+		if (len)
+			read(pos + sizeof(uint32_t), &out[0], len);
+
+		return true;
+	}
+
+	void Spool::pop(uint64_t pos)
+	{
+		// the record might have been dropped to make room in the meantime
+		if (!empty() && header->head == pos)
+			header->head += sizeof(uint32_t) + recordLength(pos);
+	}
+
+	void Spool::clear()
+	{
+		while (!empty())
+		{
+			header->head += sizeof(uint32_t) + recordLength(header->head);
+			dropped++;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Bounded FIFO of output records (formatted lines) in a ring buffer. The ring is kept in memory or in a
+// memory mapped file, in which case records that were not delivered survive a restart. When the ring is
+// full the oldest records are dropped. Every record is stored as a 4 byte length followed by the bytes.
+
+namespace IO
+{
+	class Spool
+	{
+		struct Header
+		{
+			char magic[8];
+			uint64_t capacity;
+			uint64_t head;
+			uint64_t tail;
+		};
+
+		static const int HEADER_SIZE = 64;
+
+		Header local;
+		Header *header = &local;
+		uint8_t *ring = nullptr;
+
+		std::vector<uint8_t> memory;
+
+		uint8_t *map = nullptr;
+		uint64_t map_length = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#endif
+
+		uint64_t dropped = 0;
+
+		void write(uint64_t pos, const void *data, uint64_t len);
+		void read(uint64_t pos, void *data, uint64_t len);
+		uint32_t recordLength(uint64_t pos);
+		void mapFile(const std::string &filename, uint64_t capacity);
+
+	public:
+		~Spool() { close(); }
+
+		// a non-empty filename keeps the ring in that file
+		void open(uint64_t capacity, const std::string &filename = "");
+		void close();
+
+		bool push(const char *data, int len);
+
+		// copies the oldest record, pos identifies it for pop
+		bool front(std::string &out, uint64_t &pos);
+		void pop(uint64_t pos);
+		void clear();
+
+		bool empty() { return header->head == header->tail; }
+		uint64_t bytes() { return header->tail - header->head; }
+		uint64_t getHead() { return header->head; }
+		uint64_t getTail() { return header->tail; }
+		uint64_t getDropped() { return dropped; }
+		bool isMapped() { return map != nullptr; }
+	};
+}
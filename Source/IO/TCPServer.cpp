@@ -20,6 +20,7 @@
 
 #ifndef _WIN32
 #include <arpa/inet.h> // For inet_addr() and INADDR_ANY
+#include <sys/uio.h>
 #endif
 
 #ifdef _WIN32
@@ -56,9 +57,33 @@
 #endif
 
 #include "TCPServer.h"
+#include "Wakeups.h"
+
+#if defined(TCPSERVER_EPOLL)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif defined(TCPSERVER_KQUEUE)
+#include <sys/event.h>
+#include <sys/time.h>
+#elif defined(TCPSERVER_IOCP)
+#include <mswsock.h>
+#endif
 
 namespace IO
 {
+#ifdef TCPSERVER_IOCP
+	// an AcceptEx (c is nullptr) or zero byte receive that signals data on the socket of c
+	struct IOCPOperation
+	{
+		OVERLAPPED ov;
+		SOCKET sock;
+		TCPServerConnection *c;
+		char address[2 * (sizeof(sockaddr_in) + 16)];
+	};
+
+	// completion key of the operations, wake-ups are posted with key 0 and no OVERLAPPED
+	static const ULONG_PTR IOCP_OPERATION = 1;
+#endif
 
 	const int TCPServer::MAX_CONN;
 	std::vector<int> TCPServer::active_ports;
@@ -87,14 +112,29 @@ namespace IO
 			sock = -1;
 		}
 		msg.clear();
-		out.clear();
+		clearQueue();
 	}
 
-	void TCPServerConnection::Start(SOCKET s)
+	void TCPServerConnection::Start(SOCKET s, const std::shared_ptr<const std::string> &greeting)
 	{
+		std::lock_guard<std::mutex> lock(mtx);
+
 		msg.clear();
-		out.clear();
+		clearQueue();
+		closing = false;
+		sent_bytes = dropped = 0;
+		max_queued = 0;
 		stamp = std::time(nullptr);
+		poll_sock = -1;
+		poll_write = false;
+#ifdef TCPSERVER_IOCP
+		iocp_sock = -1;
+#endif
+
+		// queued before the socket is set so that broadcasts cannot overtake it
+		if (greeting)
+			push(greeting);
+
 		sock = s;
 	}
 
@@ -133,36 +173,134 @@ namespace IO
 			stamp = std::time(0);
 		}
 	}
-}	void TCPServerConnection::SendBuffer()
+}
+
+	void TCPServerConnection::clearQueue()
 	{
-		std::lock_guard<std::mutex> lock(mtx);
+		out.clear();
+		out_offset = 0;
+		MemoryBudget::add(MemoryBudget::CLIENTS, -(int64_t)out_bytes);
+		out_bytes = 0;
+	}
 
-		if (isConnected() && hasSendBuffer())
-		{
+	void TCPServerConnection::push(std::shared_ptr<const std::string> m, std::size_t offset)
+	{
+		if (m->size() <= (out.empty() ? offset : 0))
+			return;
 
-			int bytes = ::send(sock, out.data(), out.size(), 0);
+		if (out.empty())
+			out_offset = offset;
 
-			if (bytes < 0)
+		std::size_t n = m->size() - (out.empty() ? offset : 0);
+		out_bytes += n;
+		MemoryBudget::add(MemoryBudget::CLIENTS, (int64_t)n);
+		out.push_back(std::move(m));
+		max_queued = MAX(max_queued, out_bytes);
+	}
+
+	// writes as much of the queue as the socket accepts in one gather call, returns false on a socket error
+	bool TCPServerConnection::writeQueue()
+	{
+		const static int MAX_IOV = 64;
+
+		while (!out.empty())
+		{
+			// an entry with nothing left to write would never be taken off below
+			if (out.front()->size() <= out_offset)
 			{
+				out.pop_front();
+				out_offset = 0;
+				continue;
+			}
+
+			int n = 0;
+			std::size_t offered = 0;
 #ifdef _WIN32
+			WSABUF iov[MAX_IOV];
+
+			for (auto it = out.begin(); it != out.end() && n < MAX_IOV; ++it, ++n)
+			{
+				std::size_t skip = n == 0 ? out_offset : 0;
+				iov[n].buf = (char *)(*it)->data() + skip;
+				iov[n].len = (ULONG)((*it)->size() - skip);
+				offered += iov[n].len;
+			}
+
+			DWORD sent = 0;
+			if (WSASend(sock, iov, n, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+			{
 				if (WSAGetLastError() != WSAEWOULDBLOCK)
-				{
 #else
+			struct iovec iov[MAX_IOV];
+
+			for (auto it = out.begin(); it != out.end() && n < MAX_IOV; ++it, ++n)
+			{
+				std::size_t skip = n == 0 ? out_offset : 0;
+				iov[n].iov_base = (void *)((*it)->data() + skip);
+				iov[n].iov_len = (*it)->size() - skip;
+				offered += iov[n].iov_len;
+			}
+
+			struct msghdr mh;
+			memset(&mh, 0, sizeof(mh));
+			mh.msg_iov = iov;
+			mh.msg_iovlen = n;
+
+			int sent = sendmsg(sock, &mh, 0);
+			if (sent < 0)
+			{
 				if (errno != EWOULDBLOCK && errno != EAGAIN)
-				{
 #endif
+				{
 					if (verbose)
 						Error() << "TCP Connection: error message to client: " << strerror(errno);
 
-					CloseUnsafe();
+					return false;
 				}
+				return true;
 			}
-			else if (bytes < out.size())
-				out.erase(out.begin(), out.begin() + bytes);
-			else
-				out.clear();
+
+			std::size_t bytes = (std::size_t)sent;
+			out_bytes -= bytes;
+			MemoryBudget::add(MemoryBudget::CLIENTS, -(int64_t)bytes);
+			sent_bytes += bytes;
+
+			while (bytes > 0)
+			{
+				std::size_t left = out.front()->size() - out_offset;
+
+				if (bytes < left)
+				{
+					out_offset += bytes;
+					break;
+				}
+
+				bytes -= left;
+				out.pop_front();
+				out_offset = 0;
+			}
+
+			// the socket did not take everything offered
+			if ((std::size_t)sent < offered)
+				return true;
+		}
+
+		return true;
+	}
+
+	void TCPServerConnection::SendBuffer()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (isConnected() && hasSendBuffer())
+		{
+			if (!writeQueue())
+				CloseUnsafe();
+			else if (!hasSendBuffer() && closing)
+				CloseUnsafe();
 		}
 	}
+
 	bool TCPServerConnection::Send(const char *data, int length)
 	{
 		std::lock_guard<std::mutex> lock(mtx);
@@ -170,94 +308,146 @@ namespace IO
 		if (!isConnected())
 			return false;
 
-		if (out.size() + length > MAX_BUFFER_SIZE)
+		if (out_bytes + length > maxBufferSize())
 			return false;
 
-		out.insert(out.end(), data, data + length);
+		bool wakeup = out.empty();
+		push(std::make_shared<const std::string>(data, length));
+
+		if (notify && wakeup)
+			notify();
 		return true;
 	}
 
-	bool TCPServerConnection::SendRaw(const char *data, int length)
+	bool TCPServerConnection::Queue(const std::shared_ptr<const std::string> &m, bool &wakeup)
 	{
 		std::lock_guard<std::mutex> lock(mtx);
 
 		if (!isConnected())
 			return false;
 
-		int bytes = ::send(sock, data, length, 0);
-
-		if (bytes < 0)
+		if (out_bytes + m->size() > maxBufferSize())
 		{
-#ifdef _WIN32
-			if (WSAGetLastError() != WSAEWOULDBLOCK)
-			{
-#else
-			if (errno != EWOULDBLOCK && errno != EAGAIN)
-			{
-#endif
-				if (verbose)
-					Error() << "TCP Connection: error message to client: " << strerror(errno);
-
-				CloseUnsafe();
-				return false;
-			}
+			dropped++;
+			return false;
 		}
+
+		wakeup |= out.empty();
+		push(m);
 		return true;
 	}
 
 	bool TCPServerConnection::SendDirect(const char *data, int length)
+	{
+		return SendDirect(data, length, nullptr, 0);
+	}
+
+	// header and body are written from the buffers of the caller with one gather call if nothing is
+	// queued, only what the socket does not take is copied into the queue, header and body separately
+	bool TCPServerConnection::SendDirect(const char *header, int header_length, const char *data, int length)
 	{
 		std::lock_guard<std::mutex> lock(mtx);
 
 		if (!isConnected())
 			return false;
 
-		int bytes = 0;
+		bool wakeup = out.empty();
+		std::size_t bytes = 0;
 
-		if (!hasSendBuffer())
+		if (wakeup)
 		{
-			bytes = ::send(sock, data, length, 0);
-
-			if (bytes < 0)
-			{
+			int n = length > 0 ? 2 : 1;
 #ifdef _WIN32
+			WSABUF iov[2];
+			iov[0].buf = (char *)header;
+			iov[0].len = (ULONG)header_length;
+			iov[1].buf = (char *)data;
+			iov[1].len = (ULONG)length;
+
+			DWORD sent = 0;
+			if (WSASend(sock, iov, n, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+			{
 				if (WSAGetLastError() != WSAEWOULDBLOCK)
-				{
 #else
+			struct iovec iov[2];
+			iov[0].iov_base = (void *)header;
+			iov[0].iov_len = header_length;
+			iov[1].iov_base = (void *)data;
+			iov[1].iov_len = length;
+
+			struct msghdr mh;
+			memset(&mh, 0, sizeof(mh));
+			mh.msg_iov = iov;
+			mh.msg_iovlen = n;
+
+			int sent = sendmsg(sock, &mh, 0);
+			if (sent < 0)
+			{
 				if (errno != EWOULDBLOCK && errno != EAGAIN)
-				{
 #endif
+				{
 					if (verbose)
 						Error() << "TCP Connection: error message to client: " << strerror(errno);
 
 					CloseUnsafe();
 					return false;
 				}
-				bytes = 0;
+				sent = 0;
 			}
+
+			bytes = (std::size_t)sent;
+			sent_bytes += bytes;
 		}
 
-		if (bytes < length)
-			out.insert(out.end(), data + bytes, data + length - bytes);
+		if (bytes < (std::size_t)header_length)
+			push(std::make_shared<const std::string>(header + bytes, header_length - bytes));
+
+		std::size_t skip = bytes > (std::size_t)header_length ? bytes - header_length : 0;
+		if (skip < (std::size_t)length)
+			push(std::make_shared<const std::string>(data + skip, length - skip));
+
+		if (hasSendBuffer())
+		{
+			if (notify && wakeup)
+				notify();
+		}
+		else if (closing)
+			CloseUnsafe();
 
 		return true;
 	}
 
+	void TCPServerConnection::CloseAfterSend()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (out.empty())
+			CloseUnsafe();
+		else
+			closing = true;
+	}
+
 	// TCP Server
 
 	TCPServer::~TCPServer()
 	{
 		stop = true;
+		// the loops only wake up for events
+		wake();
+
+		for (auto &l : listeners)
+			for (auto &c : l->client)
+				c.Close();
 
-		for (auto &c : client)
+		for (auto &l : listeners)
 		{
-			c.Close();
-		}
+			if (l->run_thread.joinable())
+				l->run_thread.join();
+			if (l->sock != -1)
+				closesocket(l->sock);
 
-		if (run_thread.joinable())
-			run_thread.join();
-		if (sock != -1)
-			closesocket(sock);
+			closePoll(*l);
+		}
 
 		// Remove port from active_ports
 		if (listening_port != -1)
@@ -276,97 +466,132 @@ namespace IO
 	int TCPServer::numberOfClients()
 	{
 		int n = 0;
-		for (auto &c : client)
-			if (c.isConnected())
-				n++;
+		for (auto &l : listeners)
+			for (auto &c : l->client)
+				if (c.isConnected())
+					n++;
 		return n;
 	}
 
-	int TCPServer::findFreeClient()
+	int TCPServer::findFreeClient(Listener &l)
 	{
-		for (int i = 0; i < MAX_CONN; i++)
+		std::deque<TCPServerConnection> &client = l.client;
+
+		for (int i = 0; i < client.size(); i++)
 			if (!client[i].isLocked() && !client[i].isConnected())
 				return i;
-		return -1;
+
+		if (client.size() >= max_conn)
+		{
+			// all slots in use, recycle the connection that has been idle the longest
+			int idle = -1;
+			std::time_t now = time(nullptr);
+
+			for (int i = 0; i < client.size(); i++)
+				if (!client[i].isLocked() && client[i].msg.empty() && !client[i].hasSendBuffer() && (idle == -1 || client[i].Inactive(now) > client[idle].Inactive(now)))
+					idle = i;
+
+			if (idle != -1)
+				client[idle].Close();
+
+			return idle;
+		}
+
+		std::lock_guard<std::mutex> lock(l.client_mtx);
+
+		client.emplace_back();
+		client.back().notify = [this, &l]()
+		{ wake(l); };
+
+		return client.size() - 1;
 	}
 
-	void TCPServer::acceptClients()
+	void TCPServer::acceptClients(Listener &l)
 	{
-		int addrlen = sizeof(service);
-		SOCKET conn_socket;
+		while (!stop)
+		{
+			sockaddr_in service;
+			int addrlen = sizeof(service);
+			SOCKET conn_socket;
 
-		conn_socket = accept(sock, (SOCKADDR *)&service, (socklen_t *)&addrlen);
+#ifdef TCPSERVER_IOCP
+			if (!l.accepted.empty())
+			{
+				conn_socket = l.accepted.back();
+				l.accepted.pop_back();
+			}
+			else
+#endif
+			conn_socket = accept(l.sock, (SOCKADDR *)&service, (socklen_t *)&addrlen);
 #ifdef _WIN32
-		if (conn_socket == SOCKET_ERROR)
-		{
-			if (WSAGetLastError() != WSAEWOULDBLOCK)
-				Error() << "TCP listener: error accepting connection. " << strerror(WSAGetLastError());
-			return;
-		}
+			if (conn_socket == SOCKET_ERROR)
+			{
+				if (WSAGetLastError() != WSAEWOULDBLOCK)
+					Error() << "TCP listener: error accepting connection. " << strerror(WSAGetLastError());
+				return;
+			}
 #else
-		if (conn_socket == -1)
-		{
-			if (errno != EWOULDBLOCK && errno != EAGAIN)
-				Error() << "TCP Server: error accepting connection. " << strerror(errno);
-			return;
-		}
+			if (conn_socket == -1)
+			{
+				if (errno != EWOULDBLOCK && errno != EAGAIN)
+					Error() << "TCP Server: error accepting connection. " << strerror(errno);
+				return;
+			}
 #endif
-		else
-		{
-			int ptr = findFreeClient();
+			int ptr = findFreeClient(l);
 			if (ptr == -1)
 			{
-				Error() << "TCP Server: max connections reached (" << MAX_CONN << ", closing socket.";
+				Error() << "TCP Server: max connections reached (" << max_conn << "), closing socket.";
 				closesocket(conn_socket);
+				continue;
 			}
-			else
-			{
-				client[ptr].Start(conn_socket);
 
-				int flag = 1;
-				if (setsockopt(conn_socket, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag)) != 0)
-				{
-					Error() << "TCP Server: cannot set TCP_NODELAY on client socket.";
-					client[ptr].Close();
-					return;
-				}
+			TCPServerConnection &c = l.client[ptr];
+			c.Start(conn_socket, greeting);
 
-				if (!setNonBlock(conn_socket))
-				{
-					Error() << "TCP Server: cannot make client socket non-blocking.";
-					client[ptr].Close();
-				}
+			int flag = 1;
+			if (setsockopt(conn_socket, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag)) != 0)
+			{
+				Error() << "TCP Server: cannot set TCP_NODELAY on client socket.";
+				c.Close();
+				continue;
+			}
+
+			if (!setNonBlock(conn_socket))
+			{
+				Error() << "TCP Server: cannot make client socket non-blocking.";
+				c.Close();
 			}
 		}
 	}
 
-	void TCPServer::cleanUp()
+	void TCPServer::cleanUp(Listener &l)
 	{
 
-		for (auto &c : client)
+		for (auto &c : l.client)
 			if (c.isConnected() && timeout && c.Inactive(time(0)) > timeout && !c.isLocked())
 			{
 				c.Close();
 			}
 	}
 
-	void TCPServer::readClients()
+	void TCPServer::readClients(Listener &l)
 	{
 
-		for (auto &c : client)
+		for (auto &c : l.client)
 			c.Read();
 	}
 
-	void TCPServer::writeClients()
+	void TCPServer::writeClients(Listener &l)
 	{
 
-		for (auto &c : client)
+		for (auto &c : l.client)
 			c.SendBuffer();
 	}
 
-	void TCPServer::processClients()
+	void TCPServer::processClients(Listener &l)
 	{
-		for (auto &c : client)
+		for (auto &c : l.client)
 		{
 			if (c.isConnected())
 			{
@@ -375,45 +600,386 @@ namespace IO
 		}
 	}
 
-	void TCPServer::Run()
+	void TCPServer::Run(Listener &l)
 	{
 		while (!stop)
 		{
 			try
 			{
-				acceptClients();
-				readClients();
-				processClients();
-				writeClients();
-				cleanUp();
+				acceptClients(l);
+				readClients(l);
+				processClients(l);
+				writeClients(l);
+				cleanUp(l);
 			}
 			catch (const std::exception &e)
 			{
 				Error() << "TCP Server: exception in main loop: " << e.what() << ", closing all connections";
-				for (auto &c : client)
+				for (auto &c : l.client)
 					c.Close();
 			}
 
 			if (!stop)
-				SleepAndWait();
+				SleepAndWait(l);
 		}
 
 		Debug() << "TCP Server: thread ending.\n";
 	}
 
-	void TCPServer::SleepAndWait()
+	bool TCPServer::initPoll(Listener &l)
+	{
+#if defined(TCPSERVER_EPOLL)
+		l.poll_fd = epoll_create1(EPOLL_CLOEXEC);
+		l.wake_fd[0] = l.wake_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		if (l.poll_fd == -1 || l.wake_fd[0] == -1)
+		{
+			closePoll(l);
+			return false;
+		}
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+
+		ev.data.fd = l.sock;
+		epoll_ctl(l.poll_fd, EPOLL_CTL_ADD, l.sock, &ev);
+		ev.data.fd = l.wake_fd[0];
+		epoll_ctl(l.poll_fd, EPOLL_CTL_ADD, l.wake_fd[0], &ev);
+
+		return true;
+#elif defined(TCPSERVER_KQUEUE)
+		l.poll_fd = kqueue();
+
+		if (l.poll_fd == -1 || pipe(l.wake_fd) != 0)
+		{
+			closePoll(l);
+			return false;
+		}
+
+		setNonBlock(l.wake_fd[0]);
+		setNonBlock(l.wake_fd[1]);
+
+		struct kevent ev[2];
+		EV_SET(&ev[0], l.sock, EVFILT_READ, EV_ADD, 0, 0, NULL);
+		EV_SET(&ev[1], l.wake_fd[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+		kevent(l.poll_fd, ev, 2, NULL, 0, NULL);
+
+		return true;
+#elif defined(TCPSERVER_IOCP)
+		l.iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+
+		if (l.iocp == NULL || CreateIoCompletionPort((HANDLE)l.sock, (HANDLE)l.iocp, IOCP_OPERATION, 0) == NULL)
+		{
+			closePoll(l);
+			return false;
+		}
+
+		GUID guid = WSAID_ACCEPTEX;
+		LPFN_ACCEPTEX accept_ex = NULL;
+		DWORD bytes = 0;
+
+		if (WSAIoctl(l.sock, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &accept_ex, sizeof(accept_ex), &bytes, NULL, NULL) != 0)
+		{
+			closePoll(l);
+			return false;
+		}
+
+		l.accept_ex = (void *)accept_ex;
+		postAccept(l);
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+#ifdef TCPSERVER_IOCP
+	void TCPServer::postAccept(Listener &l)
 	{
+		IOCPOperation *op = new IOCPOperation();
+		op->c = nullptr;
+		op->sock = socket(AF_INET, SOCK_STREAM, 0);
+
+		DWORD bytes = 0;
+		const DWORD size = sizeof(sockaddr_in) + 16;
+
+		if (op->sock == INVALID_SOCKET ||
+			(!((LPFN_ACCEPTEX)l.accept_ex)(l.sock, op->sock, op->address, 0, size, size, &bytes, &op->ov) && WSAGetLastError() != ERROR_IO_PENDING))
+		{
+			Error() << "TCP Server: cannot post AcceptEx, connections are accepted once per second.";
+			if (op->sock != INVALID_SOCKET)
+				closesocket(op->sock);
+			delete op;
+			return;
+		}
+		l.inflight++;
+	}
+#endif
+
+	void TCPServer::closePoll(Listener &l)
+	{
+#ifdef TCPSERVER_IOCP
+		if (l.iocp != nullptr)
+		{
+			// with the sockets closed the operations in flight complete with an error
+			while (l.inflight > 0)
+			{
+				OVERLAPPED_ENTRY events[64];
+				ULONG n = 0;
+
+				if (!GetQueuedCompletionStatusEx((HANDLE)l.iocp, events, 64, &n, 100, FALSE))
+					break;
+
+				for (ULONG i = 0; i < n; i++)
+				{
+					IOCPOperation *op = (IOCPOperation *)events[i].lpOverlapped;
+					if (op == nullptr)
+						continue;
+
+					if (op->c == nullptr)
+						closesocket(op->sock);
+					delete op;
+					l.inflight--;
+				}
+			}
+
+			CloseHandle((HANDLE)l.iocp);
+			l.iocp = nullptr;
+		}
+
+		for (SOCKET s : l.accepted)
+			closesocket(s);
+		l.accepted.clear();
+#endif
+#ifndef _WIN32
+		if (l.wake_fd[1] != -1 && l.wake_fd[1] != l.wake_fd[0])
+			close(l.wake_fd[1]);
+		if (l.wake_fd[0] != -1)
+			close(l.wake_fd[0]);
+		if (l.poll_fd != -1)
+			close(l.poll_fd);
+#endif
+		l.wake_fd[0] = l.wake_fd[1] = l.poll_fd = -1;
+	}
+
+	void TCPServer::wake(Listener &l)
+	{
+#if defined(TCPSERVER_EPOLL)
+		if (l.wake_fd[1] != -1)
+		{
+			uint64_t one = 1;
+			if (write(l.wake_fd[1], &one, sizeof(one)) < 0)
+				return;
+		}
+#elif defined(TCPSERVER_KQUEUE)
+		if (l.wake_fd[1] != -1)
+		{
+			char one = 1;
+			if (write(l.wake_fd[1], &one, sizeof(one)) < 0)
+				return;
+		}
+#elif defined(TCPSERVER_IOCP)
+		if (l.iocp != nullptr)
+			PostQueuedCompletionStatus((HANDLE)l.iocp, 0, 0, NULL);
+#endif
+	}
+
+	void TCPServer::wake()
+	{
+		for (auto &l : listeners)
+			wake(*l);
+	}
+
+	// (re)register the client socket, a closed socket is removed from the backend by the kernel
+	void TCPServer::updatePoll(Listener &l, TCPServerConnection &c)
+	{
+#if defined(TCPSERVER_IOCP)
+		// completions only tell that data arrived, a zero byte receive is kept pending for that
+		if (c.poll_sock == c.sock)
+			return;
+
+		if (c.iocp_sock != c.sock)
+		{
+			if (CreateIoCompletionPort((HANDLE)c.sock, (HANDLE)l.iocp, IOCP_OPERATION, 0) == NULL)
+				return;
+			c.iocp_sock = c.sock;
+		}
+
+		IOCPOperation *op = new IOCPOperation();
+		op->c = &c;
+		op->sock = c.sock;
+
+		WSABUF buffer = {0, NULL};
+		DWORD flags = 0;
+
+		if (WSARecv(c.sock, &buffer, 1, NULL, &flags, &op->ov, NULL) != 0 && WSAGetLastError() != WSA_IO_PENDING)
+		{
+			delete op;
+			return;
+		}
+
+		l.inflight++;
+		c.poll_sock = c.sock;
+#else
+		bool w = c.hasSendBuffer();
+
+		if (c.poll_sock == c.sock && c.poll_write == w)
+			return;
+
+#if defined(TCPSERVER_EPOLL)
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | (w ? EPOLLOUT : 0);
+		ev.data.fd = c.sock;
+
+		epoll_ctl(l.poll_fd, c.poll_sock == c.sock ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, c.sock, &ev);
+#elif defined(TCPSERVER_KQUEUE)
+		struct kevent ev[2];
+		int n = 0;
+
+		if (c.poll_sock != c.sock)
+		{
+			EV_SET(&ev[n++], c.sock, EVFILT_READ, EV_ADD, 0, 0, NULL);
+			c.poll_write = false;
+		}
+		if (c.poll_write != w)
+			EV_SET(&ev[n++], c.sock, EVFILT_WRITE, w ? EV_ADD : EV_DELETE, 0, 0, NULL);
+
+		kevent(l.poll_fd, ev, n, NULL, 0, NULL);
+#endif
+		c.poll_sock = c.sock;
+		c.poll_write = w;
+#endif
+	}
+
+	int TCPServer::idleWait(Listener &l)
+	{
+		if (!timeout)
+			return -1;
+
+		std::time_t now = time(nullptr);
+		int wait = -1;
+
+		for (auto &c : l.client)
+			if (c.isConnected() && !c.isLocked())
+			{
+				int left = MAX(timeout - c.Inactive(now) + 1, 1) * 1000;
+				if (wait == -1 || left < wait)
+					wait = left;
+			}
+
+		return wait;
+	}
+
+	// without timers in between, the loop only runs for socket events, wake-ups and the connection timeouts
+	void TCPServer::SleepAndWait(Listener &l)
+	{
+		Wakeups::add(Wakeups::SERVER);
+
+#if defined(TCPSERVER_IOCP)
+		if (l.iocp != nullptr)
+		{
+			// there is no completion for a socket that can take more data, clients with
+			// a backlog are retried after a short wait as with the select() fallback
+			int idle = idleWait(l);
+			DWORD wait = idle < 0 ? INFINITE : (DWORD)idle;
+
+			for (auto &c : l.client)
+				if (c.isConnected())
+				{
+					updatePoll(l, c);
+					if (c.hasSendBuffer())
+						wait = 10;
+				}
+
+			const int MAX_EVENTS = 64;
+			OVERLAPPED_ENTRY events[MAX_EVENTS];
+			ULONG n = 0;
+
+			if (!GetQueuedCompletionStatusEx((HANDLE)l.iocp, events, MAX_EVENTS, &n, wait, FALSE))
+				return;
+
+			for (ULONG i = 0; i < n; i++)
+			{
+				IOCPOperation *op = (IOCPOperation *)events[i].lpOverlapped;
+				if (op == nullptr)
+					continue;
+
+				l.inflight--;
+
+				if (op->c == nullptr)
+				{
+					if (!stop && op->ov.Internal == 0 && setsockopt(op->sock, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char *)&l.sock, sizeof(l.sock)) == 0)
+						l.accepted.push_back(op->sock);
+					else
+						closesocket(op->sock);
+
+					if (!stop)
+						postAccept(l);
+				}
+				else if (op->c->poll_sock == op->sock)
+					op->c->poll_sock = -1;
+
+				delete op;
+			}
+			return;
+		}
+#elif defined(TCPSERVER_EPOLL) || defined(TCPSERVER_KQUEUE)
+		if (l.poll_fd != -1)
+		{
+			for (auto &c : l.client)
+				if (c.isConnected())
+					updatePoll(l, c);
+
+			const int MAX_EVENTS = 64;
+			bool woken = false;
+
+#if defined(TCPSERVER_EPOLL)
+			struct epoll_event events[MAX_EVENTS];
+			int n = epoll_wait(l.poll_fd, events, MAX_EVENTS, idleWait(l));
+
+			for (int i = 0; i < n; i++)
+				if (events[i].data.fd == l.wake_fd[0])
+					woken = true;
+
+			if (woken)
+			{
+				uint64_t count;
+				if (read(l.wake_fd[0], &count, sizeof(count)) < 0)
+					return;
+			}
+#else
+			struct kevent events[MAX_EVENTS];
+			int idle = idleWait(l);
+			struct timespec ts = {idle / 1000, (idle % 1000) * 1000000L};
+			int n = kevent(l.poll_fd, NULL, 0, events, MAX_EVENTS, idle < 0 ? NULL : &ts);
+
+			for (int i = 0; i < n; i++)
+				if ((int)events[i].ident == l.wake_fd[0])
+					woken = true;
+
+			if (woken)
+			{
+				char buffer[64];
+				while (read(l.wake_fd[0], buffer, sizeof(buffer)) > 0)
+					;
+			}
+#endif
+			return;
+		}
+#endif
 		struct timeval tv;
 		fd_set fds, fdw;
 
 		FD_ZERO(&fds);
-		FD_SET(sock, &fds);
+		FD_SET(l.sock, &fds);
 
 		FD_ZERO(&fdw);
 
-		int maxfds = sock;
+		int maxfds = l.sock;
 
-		for (auto &c : client)
+		for (auto &c : l.client)
 		{
 			if (c.isConnected())
 			{
@@ -432,40 +998,86 @@ namespace IO
 		select(maxfds + 1, &fds, &fdw, NULL, &tv);
 	}
 
-	bool TCPServer::SendAll(const std::string &m)
+	// one refcounted copy of the message is shared by all client queues, clients that lag
+	// behind more than maxBufferSize() skip messages instead of stalling the others
+	void TCPServer::SendAllShared(const std::shared_ptr<const std::string> &m)
 	{
-		for (auto &c : client)
+		for (auto &l : listeners)
 		{
-			if (c.isConnected())
+			bool wakeup = false;
 			{
-				if (!c.Send(m.c_str(), m.length()))
+				std::lock_guard<std::mutex> lock(l->client_mtx);
+
+				for (auto &c : l->client)
 				{
-					c.Close();
-					Error() << "TCP listener: client not reading, close connection.";
-					return false;
+					if (c.isConnected())
+						c.Queue(m, wakeup);
 				}
 			}
+
+			if (wakeup)
+				wake(*l);
 		}
+	}
+
+	bool TCPServer::SendAll(const std::string &m)
+	{
+		SendAllShared(std::make_shared<const std::string>(m));
 		return true;
 	}
 
 	bool TCPServer::SendAllDirect(const std::string &m)
 	{
-		for (auto &c : client)
+		auto shared = std::make_shared<const std::string>(m);
+
+		for (auto &l : listeners)
 		{
-			if (c.isConnected())
+			bool wakeup = false;
+
+			std::lock_guard<std::mutex> lock(l->client_mtx);
+
+			for (auto &c : l->client)
 			{
-				if (!c.SendRaw(m.c_str(), m.length()))
+				if (c.isConnected())
 				{
-					c.Close();
-					Error() << "TCP listener: client not reading, close connection.";
-					return false;
+					bool first = false;
+					if (c.Queue(shared, first) && first)
+					{
+						c.SendBuffer();
+						wakeup |= c.hasSendBuffer();
+					}
 				}
 			}
+
+			if (wakeup)
+				wake(*l);
 		}
 		return true;
 	}
 
+	void TCPServer::getQueueStats(int &clients, std::size_t &queued, std::size_t &max_queued, uint64_t &dropped)
+	{
+		clients = 0;
+		queued = max_queued = 0;
+		dropped = 0;
+
+		for (auto &l : listeners)
+		{
+			std::lock_guard<std::mutex> lock(l->client_mtx);
+
+			for (auto &c : l->client)
+			{
+				if (c.isConnected())
+				{
+					clients++;
+					queued += c.getQueued();
+					max_queued = MAX(max_queued, c.max_queued);
+					dropped += c.dropped;
+				}
+			}
+		}
+	}
+
 	bool TCPServer::setNonBlock(SOCKET s)
 	{
 
@@ -482,29 +1094,20 @@ namespace IO
 		return true;
 	}
 
-	bool TCPServer::start(int port)
+	SOCKET TCPServer::openSocket(int port, bool reuse)
 	{
-		// Check if port is already in use
-		for (const auto &p : active_ports)
-		{
-			if (p == port)
-			{
-				Error() << "TCP Server: port " << port << " is already in use by another server instance";
-				return false;
-			}
-		}
-
-		sock = socket(AF_INET, SOCK_STREAM, 0);
+		SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
 		if (sock < 0)
-			return false;
+			return -1;
 
 #ifndef _WIN32
-		if (reuse_port)
+		if (reuse)
 		{
 			int optval = 1;
 			setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
 		}
 #endif
+		sockaddr_in service;
 		memset(&service, 0, sizeof(service));
 		service.sin_family = AF_INET;
 
@@ -521,25 +1124,80 @@ namespace IO
 		service.sin_port = htons(port);
 
 		int r = bind(sock, (SOCKADDR *)&service, sizeof(service));
-		if (r == SOCKET_ERROR)
+		if (r == SOCKET_ERROR || listen(sock, 511) < 0)
 		{
 			closesocket(sock);
-			sock = -1;
-			return false;
+			return -1;
 		}
 
-		if (listen(sock, 511) < 0)
-			return false;
+		if (!setNonBlock(sock))
+		{
+			Error() << "TCP Server: cannot set socket to non-blocking\n";
+		}
+
+		return sock;
+	}
 
-		for (auto &c : client)
+	bool TCPServer::start(int port)
+	{
+		// Check if port is already in use
+		for (const auto &p : active_ports)
 		{
-			c.Close();
-			c.Unlock();
+			if (p == port)
+			{
+				Error() << "TCP Server: port " << port << " is already in use by another server instance";
+				return false;
+			}
 		}
 
-		if (!setNonBlock(sock))
+		int n = n_listeners;
+#ifdef __linux__
+		if (n > 1 && !reuse_port)
 		{
-			Error() << "TCP Server: cannot set socket to non-blocking\n";
+			Warning() << "TCP Server: multiple listeners need REUSE_PORT on, using one.";
+			n = 1;
+		}
+#else
+		if (n > 1)
+		{
+			Warning() << "TCP Server: multiple listeners are only supported on Linux, using one.";
+			n = 1;
+		}
+#endif
+
+		for (auto &l : listeners)
+			for (auto &c : l->client)
+			{
+				c.Close();
+				c.Unlock();
+			}
+
+		while (listeners.size() < n)
+		{
+			listeners.emplace_back(newListener());
+			listeners.back()->id = listeners.size() - 1;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			Listener &l = *listeners[i];
+
+			l.sock = openSocket(port, reuse_port);
+			if (l.sock == -1)
+			{
+				for (int j = 0; j < i; j++)
+				{
+					closesocket(listeners[j]->sock);
+					listeners[j]->sock = -1;
+					closePoll(*listeners[j]);
+				}
+				return false;
+			}
+
+#if defined(TCPSERVER_EPOLL) || defined(TCPSERVER_KQUEUE) || defined(TCPSERVER_IOCP)
+			if (!initPoll(l))
+				Warning() << "TCP Server: cannot create event queue, falling back to select().";
+#endif
 		}
 		stop = false;
 
@@ -548,11 +1206,15 @@ namespace IO
 		else
 			Debug() << "TCP Server: start thread at IP " << IP_BIND << " port " << port;
 
+		if (n > 1)
+			Debug() << "TCP Server: " << n << " listeners at port " << port;
+
 		listening_port = port;
 		active_ports.push_back(port);
 
-		run_thread = std::thread(&TCPServer::Run, this);
+		for (int i = 0; i < n; i++)
+			listeners[i]->run_thread = std::thread(&TCPServer::Run, this, std::ref(*listeners[i]));
 
 		return true;
 	}
-}
\ No newline at end of file
+}
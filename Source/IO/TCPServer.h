@@ -22,7 +22,10 @@
 #include <thread>
 #include <mutex>
 #include <array>
+#include <deque>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <functional>
 
 #ifdef _WIN32
@@ -49,7 +52,20 @@
 #include <netinet/in.h>
 #endif
 
+// event notification backend of the server loop, select() is the portable fallback
+// the I/O completion port backend on Windows is opt-in with TCPSERVER_IOCP until it has been verified there
+#if defined(__linux__)
+#define TCPSERVER_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define TCPSERVER_KQUEUE
+#endif
+
+#if defined(TCPSERVER_IOCP) && !defined(_WIN32)
+#undef TCPSERVER_IOCP
+#endif
+
 #include "Common.h"
+#include "MemoryBudget.h"
 
 namespace IO
 {
@@ -59,18 +75,49 @@ namespace IO
 	private:
 		std::mutex mtx;
 		void CloseUnsafe();
-		const static int MAX_BUFFER_SIZE = 1024 * 1024 * 8;
+		// output queue limit per client, a quarter of the share for clients with a memory budget
+		static std::size_t maxBufferSize()
+		{
+			const static std::size_t n = MIN(MAX(MemoryBudget::limit(MemoryBudget::CLIENTS, 0) / 4, (std::size_t)64 * 1024), (std::size_t)8 * 1024 * 1024);
+			return MemoryBudget::isSet() ? n : (std::size_t)8 * 1024 * 1024;
+		}
 		bool verbose = true;
 
+		// output queue, broadcast messages are shared between connections. out_offset is
+		// the part of the first message already written, out_bytes what is left in total
+		std::deque<std::shared_ptr<const std::string>> out;
+		std::size_t out_offset = 0;
+		std::size_t out_bytes = 0;
+
+		void clearQueue();
+		void push(std::shared_ptr<const std::string> m, std::size_t offset = 0);
+		bool writeQueue();
+
 	public:
 		~TCPServerConnection() { Close(); }
 
 		SOCKET sock = -1;
 
 		std::string msg;
-		std::vector<char> out;
 		std::time_t stamp;
+
+		// bytes written, peak of the output queue and broadcast messages dropped since Start
+		uint64_t sent_bytes = 0, dropped = 0;
+		std::size_t max_queued = 0;
 		bool is_locked = false;
+		// close once the output buffer is written out
+		bool closing = false;
+
+		// called when data is queued, wakes up the server loop to write it out
+		std::function<void()> notify;
+
+		// socket and write interest as registered with the event backend
+		SOCKET poll_sock = -1;
+		bool poll_write = false;
+#ifdef TCPSERVER_IOCP
+		// socket associated with the completion port, poll_sock is the socket with a zero byte receive pending
+		SOCKET iocp_sock = -1;
+#endif
 
 		void Lock();
 		void Unlock();
@@ -80,14 +127,21 @@ namespace IO
 		}
 
 		void Close();
-		void Start(SOCKET s);
+		// greeting is queued before anything else is sent to the client
+		void Start(SOCKET s, const std::shared_ptr<const std::string> &greeting = nullptr);
 		int Inactive(std::time_t now);
 		bool isConnected() { return sock != -1; }
-		bool hasSendBuffer() { return !out.empty(); }
+		bool hasSendBuffer() { return out_bytes > 0; }
+		std::size_t getQueued() { return out_bytes; }
 		void SendBuffer();
 		bool Send(const char *buffer, int length);
+		// queue a shared message without copying, dropped if the client lags too far behind. wakeup is
+		// set when the queue was empty so the caller can wake up the server loop once for all clients
+		bool Queue(const std::shared_ptr<const std::string> &m, bool &wakeup);
 		bool SendDirect(const char *buffer, int length);
-		bool SendRaw(const char *buffer, int length);
+		// writes header and body with one gather call, the unsent remainder is buffered
+		bool SendDirect(const char *header, int header_length, const char *buffer, int length);
+		void CloseAfterSend();
 		void Read();
 		void setVerbosity(bool v) { verbose = v; }
 	};
@@ -100,42 +154,100 @@ namespace IO
 		bool start(int port);
 		bool SendAll(const std::string &m);
 		bool SendAllDirect(const std::string &m);
+		void SendAllShared(const std::shared_ptr<const std::string> &m);
+
+		// connected clients, bytes waiting to be written, largest client backlog and messages dropped
+		void getQueueStats(int &clients, std::size_t &queued, std::size_t &max_queued, uint64_t &dropped);
 
 		void setReusePort(bool b) { reuse_port = b; }
+		// listening sockets on the port, each with its own thread and connections. With SO_REUSEPORT
+		// the kernel spreads new connections over them (Linux only, otherwise there is one)
+		void setListeners(int n) { n_listeners = n; }
 		bool setNonBlock(SOCKET sock);
 		void setIP(std::string ip) { IP_BIND = ip; }
+		void setMaxConnections(int n) { max_conn = n; }
 
 	protected:
-		SOCKET sock = -1;
 		int timeout = 30;
 		bool reuse_port = true;
 		std::string IP_BIND;
 		int listening_port = -1;
 
+		// sent first to every client that connects, e.g. a protocol header
+		std::shared_ptr<const std::string> greeting;
+
 		static std::vector<int> active_ports;
 
+#if defined(TCPSERVER_EPOLL) || defined(TCPSERVER_KQUEUE) || defined(TCPSERVER_IOCP)
+		const static int MAX_CONN = 1024;
+#else
 		const static int MAX_CONN = 16;
-		std::array<TCPServerConnection, MAX_CONN> client;
+#endif
+		// per listener
+		int max_conn = MAX_CONN;
+
+		// a listening socket and the connections it accepted, only touched by its own thread
+		// except for the broadcasts, which hold client_mtx
+		struct Listener
+		{
+			virtual ~Listener() {}
+
+			int id = 0;
+			SOCKET sock = -1;
+
+			// connections are created on demand and never move, growing is guarded by client_mtx
+			std::deque<TCPServerConnection> client;
+			std::mutex client_mtx;
+
+			int poll_fd = -1;
+			int wake_fd[2] = {-1, -1};
+#ifdef TCPSERVER_IOCP
+			// completion port with an AcceptEx pending on sock, accepted sockets wait for acceptClients.
+			// The operations in flight are freed when they complete, the last ones when the port closes
+			void *iocp = nullptr;
+			void *accept_ex = nullptr;
+			std::vector<SOCKET> accepted;
+			int inflight = 0;
+#endif
+
+			std::thread run_thread;
+		};
 
-		std::thread run_thread;
+		std::vector<std::unique_ptr<Listener>> listeners;
+		int n_listeners = 1;
+
+		// servers with state per listener derive from Listener
+		virtual Listener *newListener() { return new Listener(); }
 
 		std::atomic<bool> stop{false};
 
-		void Run();
-		sockaddr_in service;
+		void Run(Listener &l);
 
 		bool Send(TCPServerConnection &c, const char *data, int len)
 		{
 			return c.Send(data, len);
 		}
 
-		int findFreeClient();
+		SOCKET openSocket(int port, bool reuse);
+		int findFreeClient(Listener &l);
 		int numberOfClients();
-		void acceptClients();
-		void readClients();
-		void writeClients();
-		virtual void processClients();
-		void cleanUp();
-		void SleepAndWait();
+		void acceptClients(Listener &l);
+		void readClients(Listener &l);
+		virtual void writeClients(Listener &l);
+		virtual void processClients(Listener &l);
+		void cleanUp(Listener &l);
+		void SleepAndWait(Listener &l);
+		// ms until the first connection of the listener times out, -1 if none can
+		int idleWait(Listener &l);
+
+		bool initPoll(Listener &l);
+		void closePoll(Listener &l);
+		void updatePoll(Listener &l, TCPServerConnection &c);
+#ifdef TCPSERVER_IOCP
+		void postAccept(Listener &l);
+#endif
+		void wake(Listener &l);
+		// wakes up all listeners
+		void wake();
 	};
 }
\ No newline at end of file
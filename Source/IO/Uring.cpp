@@ -0,0 +1,490 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef HASIOURING
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "Uring.h"
+#include "Logger.h"
+
+namespace IO
+{
+	Uring &Uring::getInstance()
+	{
+		static Uring instance;
+		return instance;
+	}
+
+	bool Uring::isAvailable()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (!started && !failed)
+		{
+			if (setup())
+			{
+				started = true;
+				worker = std::thread(&Uring::run, this);
+				Info() << "io_uring: " << ENTRIES << " entries, " << SLOTS << " buffers of " << SLOT_SIZE / 1024 << " KB" << (fixed ? " (registered)" : "") << ".";
+			}
+			else
+			{
+				failed = true;
+				Warning() << "io_uring: not available, outputs write directly.";
+			}
+		}
+		return started;
+	}
+
+	void Uring::attach(int fd, bool datagram)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		Sink &s = sinks[fd];
+		s.datagram = datagram;
+		s.error = 0;
+	}
+
+	void Uring::drain(int fd)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		if (idle)
+			work.notify_one();
+
+		drained.wait(lock, [&]
+					 {
+						 auto it = sinks.find(fd);
+						 return !started || it == sinks.end() || (it->second.queue.empty() && it->second.inflight == 0); });
+	}
+
+	void Uring::detach(int fd)
+	{
+		drain(fd);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		sinks.erase(fd);
+	}
+
+	int Uring::openFile(const std::string &filename, bool append)
+	{
+#ifdef HASIOURING
+		int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+		if (fd >= 0)
+			attach(fd, false);
+		return fd;
+#else
+		return -1;
+#endif
+	}
+
+	void Uring::closeFile(int fd)
+	{
+		detach(fd);
+#ifdef HASIOURING
+		close(fd);
+#endif
+	}
+
+	bool Uring::write(int fd, const char *data, std::size_t length)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		auto it = sinks.find(fd);
+		if (it == sinks.end())
+			return false;
+
+		Sink &s = it->second;
+
+		if ((s.datagram && length > SLOT_SIZE) || s.queued + length > MAX_QUEUED)
+		{
+			dropped++;
+			return false;
+		}
+
+		// stream data is coalesced anyway, fewer and larger entries save allocations
+		if (!s.datagram && !s.queue.empty() && s.queue.back().size() < SLOT_SIZE)
+			s.queue.back().append(data, length);
+		else
+			s.queue.emplace_back(data, length);
+
+		s.queued += length;
+
+		if (idle)
+			work.notify_one();
+
+		return true;
+	}
+
+	int Uring::getError(int fd)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		auto it = sinks.find(fd);
+		return it == sinks.end() ? 0 : it->second.error;
+	}
+
+	std::string Uring::getPrometheus()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (!started)
+			return "";
+
+		std::string element;
+		element += "# HELP ais_uring_enters System calls made to submit and complete writes\n";
+		element += "# TYPE ais_uring_enters counter\n";
+		element += "ais_uring_enters " + std::to_string(enters) + "\n";
+		element += "# HELP ais_uring_writes Writes submitted to the ring\n";
+		element += "# TYPE ais_uring_writes counter\n";
+		element += "ais_uring_writes " + std::to_string(ops) + "\n";
+		element += "# HELP ais_uring_bytes Bytes written through the ring\n";
+		element += "# TYPE ais_uring_bytes counter\n";
+		element += "ais_uring_bytes " + std::to_string(bytes) + "\n";
+		element += "# HELP ais_uring_errors Writes that failed\n";
+		element += "# TYPE ais_uring_errors counter\n";
+		element += "ais_uring_errors " + std::to_string(errors) + "\n";
+		element += "# HELP ais_uring_dropped Writes dropped because the sink was too far behind\n";
+		element += "# TYPE ais_uring_dropped counter\n";
+		element += "ais_uring_dropped " + std::to_string(dropped) + "\n";
+		return element;
+	}
+
+#ifdef HASIOURING
+
+	bool Uring::setup()
+	{
+		struct io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+
+		ring_fd = (int)syscall(__NR_io_uring_setup, ENTRIES, &p);
+		if (ring_fd < 0)
+			return false;
+
+		// writes go to the current file position (offset -1), kernels before 5.6 reject them with
+		// -EINVAL, IORING_OP_WRITE came with the same release
+#ifdef IORING_FEAT_RW_CUR_POS
+		if (!(p.features & IORING_FEAT_RW_CUR_POS))
+#endif
+		{
+			close(ring_fd);
+			ring_fd = -1;
+			return false;
+		}
+
+		sq_length = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_length = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+		sqe_length = p.sq_entries * sizeof(struct io_uring_sqe);
+
+		bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+		if (single)
+			sq_length = cq_length = std::max(sq_length, cq_length);
+
+		sq_map = mmap(NULL, sq_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		cq_map = single ? sq_map : mmap(NULL, cq_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		sqe_map = mmap(NULL, sqe_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+		if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqe_map == MAP_FAILED)
+		{
+			shutdown();
+			return false;
+		}
+
+		char *sq = (char *)sq_map, *cq = (char *)cq_map;
+
+		sq_head = (unsigned *)(sq + p.sq_off.head);
+		sq_tail = (unsigned *)(sq + p.sq_off.tail);
+		sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+		sq_array = (unsigned *)(sq + p.sq_off.array);
+		sq_entries = p.sq_entries;
+		sqes = sqe_map;
+
+		cq_head = (unsigned *)(cq + p.cq_off.head);
+		cq_tail = (unsigned *)(cq + p.cq_off.tail);
+		cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+		cqes = cq + p.cq_off.cqes;
+
+#ifdef IORING_FEAT_EXT_ARG
+		ext_arg = p.features & IORING_FEAT_EXT_ARG;
+#endif
+
+		pool.reset(new char[(std::size_t)SLOTS * SLOT_SIZE]);
+		slots.assign(SLOTS, Slot());
+		free_slots.clear();
+		for (int i = SLOTS - 1; i >= 0; i--)
+			free_slots.push_back(i);
+
+		// registered buffers save the kernel mapping the pages on every write, without (memlock
+		// limit) the same buffers are used with plain writes
+		struct iovec iov = {pool.get(), (std::size_t)SLOTS * SLOT_SIZE};
+		fixed = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+
+		return true;
+	}
+
+	void Uring::shutdown()
+	{
+		if (worker.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				terminate = true;
+			}
+			work.notify_one();
+			worker.join();
+		}
+
+		if (sq_map && sq_map != MAP_FAILED)
+			munmap(sq_map, sq_length);
+		if (cq_map && cq_map != MAP_FAILED && cq_map != sq_map)
+			munmap(cq_map, cq_length);
+		if (sqe_map && sqe_map != MAP_FAILED)
+			munmap(sqe_map, sqe_length);
+
+		sq_map = cq_map = sqe_map = nullptr;
+
+		if (ring_fd >= 0)
+			close(ring_fd);
+
+		ring_fd = -1;
+		started = false;
+		drained.notify_all();
+	}
+
+	bool Uring::hasSpace()
+	{
+		return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) < sq_entries;
+	}
+
+	void Uring::prepare(int i)
+	{
+		Slot &slot = slots[i];
+
+		unsigned tail = *sq_tail;
+		unsigned index = tail & *sq_mask;
+		struct io_uring_sqe *sqe = (struct io_uring_sqe *)sqes + index;
+
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->fd = slot.fd;
+		sqe->addr = (uint64_t)(uintptr_t)(pool.get() + (std::size_t)i * SLOT_SIZE + slot.done);
+		sqe->len = slot.length - slot.done;
+		sqe->off = (uint64_t)-1; // current position, files are opened for appending
+		sqe->buf_index = 0;
+		sqe->user_data = (uint64_t)i;
+
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		ops++;
+	}
+
+	// moves queued data into free buffers, returns the number of writes prepared
+	int Uring::fill()
+	{
+		int n = 0;
+
+		while (!retry.empty() && hasSpace())
+		{
+			prepare(retry.back());
+			retry.pop_back();
+			n++;
+		}
+
+		for (auto &kv : sinks)
+		{
+			Sink &s = kv.second;
+
+			while (!s.queue.empty() && !free_slots.empty() && hasSpace() && (s.datagram || s.inflight == 0))
+			{
+				int i = free_slots.back();
+				free_slots.pop_back();
+
+				Slot &slot = slots[i];
+				char *buffer = pool.get() + (std::size_t)i * SLOT_SIZE;
+
+				slot.fd = kv.first;
+				slot.length = slot.done = 0;
+
+				if (s.datagram)
+				{
+					const std::string &d = s.queue.front();
+					std::memcpy(buffer, d.data(), d.size());
+					slot.length = (uint32_t)d.size();
+					s.queued -= d.size();
+					s.queue.pop_front();
+				}
+				else
+				{
+					while (!s.queue.empty() && slot.length < SLOT_SIZE)
+					{
+						const std::string &d = s.queue.front();
+						std::size_t take = std::min(d.size() - s.offset, (std::size_t)(SLOT_SIZE - slot.length));
+
+						std::memcpy(buffer + slot.length, d.data() + s.offset, take);
+						slot.length += (uint32_t)take;
+						s.offset += take;
+						s.queued -= take;
+
+						if (s.offset == d.size())
+						{
+							s.queue.pop_front();
+							s.offset = 0;
+						}
+					}
+				}
+
+				s.inflight++;
+				inflight++;
+				prepare(i);
+				n++;
+			}
+		}
+
+		return n;
+	}
+
+	// submits what is prepared and, with writes in flight, waits up to a millisecond for a completion
+	void Uring::enter(bool wait)
+	{
+		unsigned submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+		unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+		int r;
+
+#ifdef IORING_FEAT_EXT_ARG
+		if (wait && ext_arg)
+		{
+			struct __kernel_timespec ts = {0, 1000000};
+			struct io_uring_getevents_arg arg;
+			std::memset(&arg, 0, sizeof(arg));
+			arg.sigmask_sz = _NSIG / 8;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+
+			r = (int)syscall(__NR_io_uring_enter, ring_fd, submit, 1, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		}
+		else
+#endif
+			r = (int)syscall(__NR_io_uring_enter, ring_fd, submit, 0, flags, NULL, 0);
+
+		enters++;
+
+		if (r < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY)
+			Error() << "io_uring: enter failed: " << strerror(errno);
+	}
+
+	void Uring::reap()
+	{
+		unsigned head = *cq_head;
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++)
+		{
+			struct io_uring_cqe *cqe = (struct io_uring_cqe *)cqes + (head & *cq_mask);
+			complete((int)cqe->user_data, cqe->res);
+		}
+
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	void Uring::complete(int i, int res)
+	{
+		Slot &slot = slots[i];
+		Sink &s = sinks[slot.fd];
+
+		if (res == -EINTR || (res == -EAGAIN && !s.datagram))
+		{
+			retry.push_back(i);
+			return;
+		}
+
+		// as with sendto on a non-blocking socket, and nobody listening is not an error of the sender
+		if (s.datagram && (res == -EAGAIN || res == -ECONNREFUSED))
+			dropped++;
+		else if (res < 0 || (res == 0 && !s.datagram))
+		{
+			errors++;
+			s.error = res < 0 ? -res : EIO;
+		}
+		else
+		{
+			bytes += res;
+			slot.done += res;
+
+			// the rest of a short write goes out before anything else of the stream
+			if (!s.datagram && slot.done < slot.length)
+			{
+				retry.push_back(i);
+				return;
+			}
+		}
+
+		s.inflight--;
+		inflight--;
+		free_slots.push_back(i);
+
+		if (s.inflight == 0 && s.queue.empty())
+			drained.notify_all();
+	}
+
+	void Uring::run()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			reap();
+			int n = fill();
+
+			if (n == 0 && inflight == 0)
+			{
+				if (terminate)
+					break;
+
+				idle = true;
+				work.wait(lock);
+				idle = false;
+				continue;
+			}
+
+			lock.unlock();
+			enter(inflight > 0);
+			lock.lock();
+
+			// without a timeout on the wait the kernel only gets the submissions, poll for completions
+			if (!ext_arg && n == 0)
+				work.wait_for(lock, std::chrono::milliseconds(1));
+		}
+	}
+
+#else
+
+	bool Uring::setup() { return false; }
+	void Uring::shutdown() {}
+	void Uring::run() {}
+
+#endif
+}
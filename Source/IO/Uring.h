@@ -0,0 +1,125 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Writes of the outputs that enable IO_URING go through one io_uring instance (Linux, HASIOURING).
+// The outputs only queue their data, one thread copies it into registered buffers and submits the
+// writes of all sinks with a single system call per round, which also collects the completions.
+// A stream sink (file) has one write in flight at a time so the data stays in order, the queued
+// data is coalesced into the next buffer. A datagram sink (connected UDP socket) gets one write per
+// datagram. Without io_uring support isAvailable() is false and the outputs write as before.
+
+namespace IO
+{
+	class Uring
+	{
+		struct Sink
+		{
+			bool datagram = false;
+			std::deque<std::string> queue;
+			std::size_t offset = 0; // part of the first entry of a stream already taken
+			std::size_t queued = 0;
+			int inflight = 0;
+			int error = 0;
+		};
+
+		struct Slot
+		{
+			int fd = -1;
+			uint32_t length = 0, done = 0;
+		};
+
+		static const unsigned ENTRIES = 256;
+		static const int SLOTS = 128;
+		static const int SLOT_SIZE = 16384;
+		static const std::size_t MAX_QUEUED = 8 * 1024 * 1024;
+
+		int ring_fd = -1;
+		bool started = false, failed = false;
+		bool fixed = false, ext_arg = false;
+
+		void *sq_map = nullptr, *cq_map = nullptr, *sqe_map = nullptr;
+		std::size_t sq_length = 0, cq_length = 0, sqe_length = 0;
+		unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+		unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+		unsigned sq_entries = 0;
+		void *sqes = nullptr, *cqes = nullptr;
+
+		std::unique_ptr<char[]> pool;
+		std::vector<Slot> slots;
+		std::vector<int> free_slots, retry;
+
+		std::unordered_map<int, Sink> sinks;
+		std::mutex mtx;
+		std::condition_variable work, drained;
+		std::thread worker;
+		bool terminate = false, idle = false;
+		int inflight = 0;
+
+		uint64_t enters = 0, ops = 0, bytes = 0, errors = 0, dropped = 0;
+
+		bool setup();
+		void shutdown();
+		void run();
+
+		bool hasSpace();
+		void prepare(int slot);
+		int fill();
+		void enter(bool wait);
+		void reap();
+		void complete(int slot, int res);
+
+		Uring() {}
+
+	public:
+		~Uring() { shutdown(); }
+
+		static Uring &getInstance();
+
+		// sets up the ring on first use, false if io_uring cannot be used here
+		bool isAvailable();
+
+		void attach(int fd, bool datagram);
+		// waits until the queued data of fd is written and forgets it, call before closing fd
+		void detach(int fd);
+		// waits until the queued data of fd is written
+		void drain(int fd);
+
+		// opens a file as stream sink, appending or truncated, -1 on failure
+		int openFile(const std::string &filename, bool append);
+		// detaches and closes a file from openFile
+		void closeFile(int fd);
+
+		// false if the data is dropped because the sink is too far behind
+		bool write(int fd, const char *data, std::size_t length);
+		// errno of the last failed write of fd, zero if none
+		int getError(int fd);
+
+		std::string getPrometheus();
+	};
+}
@@ -19,9 +19,55 @@
 #include <cmath>
 
 #include "JSON.h"
+#include "Convert.h"
 
 namespace JSON {
 
+	// strings and arrays from the pools of o are duplicated, external items are shared
+	Value JSON::copyValue(const JSON& o, Value v, bool all) {
+		if (v.isString()) {
+			if (all)
+				v.setString(newString(*v.data.s));
+			else
+				for (int i = 0; i < o.strings_used; i++)
+					if (&o.strings[i] == v.data.s) {
+						v.setString(newString(*v.data.s));
+						break;
+					}
+		}
+		else if (v.isArray()) {
+			std::vector<Value>* a = newArray();
+			for (const Value& e : *v.data.a)
+				a->push_back(copyValue(o, e, all));
+			v.setArray(a);
+		}
+		return v;
+	}
+
+	void JSON::copyAll(const JSON& o) {
+		if (this == &o) return;
+
+		clear();
+		binary = o.binary;
+		objects = o.objects;
+
+		for (const Property& p : o.properties)
+			properties.push_back(Property(p.Key(), copyValue(o, p.Get(), true)));
+	}
+
+	JSON& JSON::operator=(const JSON& o) {
+		if (this == &o) return *this;
+
+		clear();
+		binary = o.binary;
+		objects = o.objects;
+
+		for (const Property& p : o.properties)
+			properties.push_back(Property(p.Key(), copyValue(o, p.Get())));
+
+		return *this;
+	}
+
 	void Value::to_string(std::string& str) const {
 		switch (type) {
 		case Value::Type::STRING:
@@ -31,10 +77,10 @@ namespace JSON {
 			str += data.b ? "true" : "false";
 			break;
 		case Value::Type::INT:
-			str += std::to_string(data.i);
+			Util::Convert::appendInt(str, data.i);
 			break;
 		case Value::Type::FLOAT:
-			str += std::to_string(data.f);
+			Util::Convert::appendFixed(str, data.f);
 			break;
 		case Value::Type::EMPTY:
 			str += "null";
@@ -51,4 +97,15 @@ namespace JSON {
 			break;
 		}
 	}
+
+	bool KeySet::getKeys(const std::vector<StreamIn<JSON> *> &consumers, std::vector<int> &keys)
+	{
+		for (auto c : consumers)
+		{
+			KeySet *k = dynamic_cast<KeySet *>(c);
+			if (!k || !k->getKeys(keys))
+				return false;
+		}
+		return true;
+	}
 }
@@ -18,10 +18,14 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
 
 #include "Common.h"
+#include "Stream.h"
+#include "StringList.h"
 
 namespace JSON
 {
@@ -32,6 +36,7 @@ namespace JSON
 	// JSON value item, 8 bytes (32 bits), 16 bytes (64 bits)
 	class Value
 	{
+		friend class JSON;
 
 		enum class Type
 		{
@@ -51,7 +56,7 @@ namespace JSON
 			long int i;
 			double f;
 			std::string *s;
-			std::vector<std::string> *as;
+			StringList *as;
 			std::vector<Value> *a;
 			JSON *o;
 		} data;
@@ -60,7 +65,7 @@ namespace JSON
 		double getFloat(double d = 0.0f) const { return isFloat() ? data.f : (isInt() ? (double)(data.i) : d); }
 		long int getInt(long int d = 0) const { return isInt() ? data.i : d; }
 		bool getBool(bool d = false) const { return isBool() ? data.b : d; }
-		const std::vector<std::string> &getStringArray() const { return *data.as; }
+		const StringList &getStringArray() const { return *data.as; }
 		const std::vector<Value> &getArray() const { return *data.a; }
 		const std::string getString() const { return isString() ? *data.s : std::string(""); }
 		const JSON &getObject() const { return *data.o; }
@@ -95,7 +100,7 @@ namespace JSON
 			data.a = v;
 			type = Type::ARRAY;
 		}
-		void setStringArray(std::vector<std::string> *v)
+		void setStringArray(StringList *v)
 		{
 			data.as = v;
 			type = Type::ARRAY_STRING;
@@ -152,7 +157,7 @@ namespace JSON
 			key = p;
 			value.setString(v);
 		}
-		Property(int p, std::vector<std::string> *v)
+		Property(int p, StringList *v)
 		{
 			key = p;
 			value.setStringArray(v);
@@ -182,19 +187,110 @@ namespace JSON
 		// memory to pointers containing objects, strings and arrays
 		// Property and Value can therefore only contain pointers and basic data types
 		std::vector<std::shared_ptr<JSON>> objects;
-		std::vector<std::shared_ptr<std::string>> strings;
-		std::vector<std::shared_ptr<std::vector<Value>>> arrays;
+
+		// strings and arrays are taken from pools that are kept over clear(), a JSON object that is
+		// reused for every message stops allocating once the pools have grown to size
+		std::deque<std::string> strings;
+		std::deque<std::vector<Value>> arrays;
+		int strings_used = 0;
+		int arrays_used = 0;
+
+		std::string *newString(const std::string &s)
+		{
+			if (strings_used == strings.size())
+				strings.emplace_back();
+
+			std::string *p = &strings[strings_used++];
+			p->assign(s);
+			return p;
+		}
+
+		std::string *newString(const char *s, std::size_t len)
+		{
+			if (strings_used == strings.size())
+				strings.emplace_back();
+
+			std::string *p = &strings[strings_used++];
+			p->assign(s, len);
+			return p;
+		}
+
+		std::vector<Value> *newArray()
+		{
+			if (arrays_used == arrays.size())
+				arrays.emplace_back();
+
+			std::vector<Value> *p = &arrays[arrays_used++];
+			p->clear();
+			return p;
+		}
+
+		Value copyValue(const JSON &o, Value v, bool all = false);
+
+		// serialized versions of this object, shared by all outputs that use the same keymap and settings
+		struct Serialized
+		{
+			const void *map;
+			int dict;
+			bool enhanced;
+			int size;
+			std::string text;
+		};
+
+		mutable std::vector<Serialized> serialized;
+		mutable int serialized_used = 0;
+		mutable std::mutex serialized_mtx;
 
 	public:
 		void *binary = NULL;
-		
+
+		JSON() {}
+
+		// properties can point into the pools, a copy gets its own
+		JSON(const JSON &o) { *this = o; }
+		JSON &operator=(const JSON &o);
+
+		// also copies the strings that are referenced rather than pooled, for use after the source has moved on
+		void copyAll(const JSON &o);
+
 		void clear()
 		{
 			properties.clear();
 
 			objects.clear();
-			strings.clear();
-			arrays.clear();
+			strings_used = 0;
+			arrays_used = 0;
+			serialized_used = 0;
+		}
+
+		// outputs on different threads can serialize the same object, the cache is only used with this held
+		std::mutex &getSerializedMutex() const { return serialized_mtx; }
+
+		// returns the cached serialization or nullptr, properties can only be added so the size tells if it is still valid
+		const std::string *getSerialized(const void *map, int dict, bool enhanced) const
+		{
+			for (int i = 0; i < serialized_used; i++)
+			{
+				const Serialized &s = serialized[i];
+				if (s.map == map && s.dict == dict && s.enhanced == enhanced && s.size == properties.size())
+					return &s.text;
+			}
+			return nullptr;
+		}
+
+		std::string *newSerialized(const void *map, int dict, bool enhanced) const
+		{
+			if (serialized_used == serialized.size())
+				serialized.push_back(Serialized());
+
+			Serialized &s = serialized[serialized_used++];
+			s.map = map;
+			s.dict = dict;
+			s.enhanced = enhanced;
+			s.size = properties.size();
+			s.text.clear();
+
+			return &s.text;
 		}
 
 		const std::vector<Property> &getProperties() const { return properties; }
@@ -233,8 +329,7 @@ namespace JSON
 
 		void Add(int p, const std::string &v)
 		{
-			strings.push_back(std::shared_ptr<std::string>(new std::string(v)));
-			properties.push_back(Property(p, (std::string *)strings.back().get()));
+			properties.push_back(Property(p, newString(v)));
 		}
 
 		void Add(int p)
@@ -253,9 +348,23 @@ namespace JSON
 			properties.push_back(Property(p, (std::string *)v));
 		}
 
-		void Add(int p, const std::vector<std::string> *v)
+		void Add(int p, const StringList *v)
 		{
-			properties.push_back(Property(p, (std::vector<std::string> *)v));
+			properties.push_back(Property(p, (StringList *)v));
 		}
 	};
+
+	// optional interface for consumers that only read a subset of the keys,
+	// allows the producer to skip decoding of fields that nobody uses
+	class KeySet
+	{
+	public:
+		virtual ~KeySet() {}
+
+		// appends the keys needed, returns false if all keys are needed
+		virtual bool getKeys(std::vector<int> &keys) = 0;
+
+		// union over a list of consumers, consumers without a key set need all keys
+		static bool getKeys(const std::vector<StreamIn<JSON> *> &consumers, std::vector<int> &keys);
+	};
 }
@@ -15,6 +15,9 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <chrono>
+#include <sstream>
+
 #include "AIS.h"
 
 // Sources:
@@ -24,6 +27,7 @@
 
 #include "JSONAIS.h"
 #include "AIS-catcher.h"
+#include "Clock.h"
 
 #ifdef _WIN32
 #pragma warning(disable : 4996)
@@ -51,124 +55,132 @@ namespace AIS
 	{
 		unsigned u = msg.getUint(start, len);
 		if (u != undefined)
-			json.Add(p, (int)u);
+			Add(p, (int)u);
 	}
 
 	void JSONAIS::US(const AIS::Message &msg, int p, int start, int len, int b, unsigned undefined)
 	{
 		unsigned u = msg.getUint(start, len);
 		if (u != undefined)
-			json.Add(p, (int)(u + b));
+			Add(p, (int)(u + b));
 	}
 
 	void JSONAIS::UL(const AIS::Message &msg, int p, int start, int len, float a, float b, unsigned undefined)
 	{
 		unsigned u = msg.getUint(start, len);
 		if (u != undefined)
-			json.Add(p, u * a + b);
+			Add(p, u * a + b);
 	}
 
 	void JSONAIS::S(const AIS::Message &msg, int p, int start, int len, int undefined)
 	{
 		int u = msg.getInt(start, len);
 		if (u != undefined)
-			json.Add(p, u);
+			Add(p, u);
 	}
 
 	void JSONAIS::SL(const AIS::Message &msg, int p, int start, int len, float a, float b, int undefined)
 	{
 		int s = msg.getInt(start, len);
 		if (s != undefined)
-			json.Add(p, s * a + b);
+			Add(p, s * a + b);
 	}
 
 	void JSONAIS::E(const AIS::Message &msg, int p, int start, int len, int pmap, const std::vector<std::string> *map)
 	{
 		unsigned u = msg.getUint(start, len);
-		json.Add(p, (int)u);
+		Add(p, (int)u);
 		if (map)
 		{
 			if (u < map->size())
-				json.Add(pmap, &(*map)[u]);
+				Add(pmap, &(*map)[u]);
 			else
-				json.Add(pmap, &undefined);
+				Add(pmap, &undefined);
 		}
 	}
 
 	void JSONAIS::TURN(const AIS::Message &msg, int p, int start, int len, unsigned undefined)
 	{
 		int u = msg.getInt(start, len);
-		json.Add(AIS::KEY_TURN_UNSCALED, u);
+		Add(AIS::KEY_TURN_UNSCALED, u);
 
 		if (u == -128)
 			// json.Add(p, &nan);
-			json.Add(p, (int)-128);
+			Add(p, (int)-128);
 		else if (u == -127)
 			// json.Add(p, &fastleft);
-			json.Add(p, (int)-127);
+			Add(p, (int)-127);
 		else if (u == 127)
 			// json.Add(p, &fastright);
-			json.Add(p, (int)127);
+			Add(p, (int)127);
 		else
 		{
 			double rot = u / 4.733;
 			rot = (u < 0) ? -rot * rot : rot * rot;
-			json.Add(p, (int)(rot + 0.5));
+			Add(p, (int)(rot + 0.5));
 		}
 	}
 
 	void JSONAIS::B(const AIS::Message &msg, int p, int start, int len)
 	{
 		unsigned u = msg.getUint(start, len);
-		json.Add(p, (bool)u);
+		Add(p, (bool)u);
 	}
 
 	void JSONAIS::TIMESTAMP(const AIS::Message &msg, int p, int start, int len, std::string &str)
 	{
-		if (len != 40)
+		if (len != 40 || skip(p))
 			return;
 
 		std::stringstream s;
 		s << std::setfill('0') << std::setw(4) << msg.getUint(start, 14) << "-" << std::setw(2) << msg.getUint(start + 14, 4) << "-" << std::setw(2) << msg.getUint(start + 18, 5) << "T"
 		  << std::setw(2) << msg.getUint(start + 23, 5) << ":" << std::setw(2) << msg.getUint(start + 28, 6) << ":" << std::setw(2) << msg.getUint(start + 34, 6) << "Z";
 		str = std::string(s.str());
-		json.Add(p, &str);
+		Add(p, &str);
 	}
 
 	void JSONAIS::ETA(const AIS::Message &msg, int p, int start, int len, std::string &str)
 	{
-		if (len != 20)
+		if (len != 20 || skip(p))
 			return;
 
 		std::stringstream s;
 		s << std::setfill('0') << std::setw(2) << msg.getUint(start, 4) << "-" << std::setw(2) << msg.getUint(start + 4, 5) << "T"
 		  << std::setw(2) << msg.getUint(start + 9, 5) << ":" << std::setw(2) << msg.getUint(start + 14, 6) << "Z";
 		str = std::string(s.str());
-		json.Add(p, &str);
+		Add(p, &str);
 	}
 
 	void JSONAIS::T(const AIS::Message &msg, int p, int start, int len, std::string &str)
 	{
+		if (skip(p))
+			return;
+
 		msg.getText(start, len, str);
 		while (!str.empty() && str[str.length() - 1] == ' ')
 			str.resize(str.length() - 1);
-		json.Add(p, &str);
+		Add(p, &str);
 	}
 
 	void JSONAIS::D(const AIS::Message &msg, int p, int start, int len, std::string &str)
 	{
+		if (skip(p))
+			return;
+
 		str = std::to_string(len) + ':';
 		for (int i = start; i < start + len; i += 4)
 		{
 			char c = msg.getUint(i, 4);
 			str += (char)(c < 10 ? c + '0' : c + 'a' - 10);
 		}
-		json.Add(p, &str);
+		Add(p, &str);
 	}
 
 	// Refernce: https://www.itu.int/dms_pubrec/itu-r/rec/m/R-REC-M.585-9-202205-I!!PDF-E.pdf
 	void JSONAIS::COUNTRY(const AIS::Message &msg)
 	{
+		if (skip(AIS::KEY_COUNTRY) && skip(AIS::KEY_COUNTRY_CODE))
+			return;
 
 		uint32_t mid = msg.mmsi();
 		while (mid > 1000)
@@ -202,23 +214,95 @@ namespace AIS
 			}
 			if (JSON_MAP_MID[l].MID == mid)
 			{
-				json.Add(AIS::KEY_COUNTRY, &JSON_MAP_MID[l].country);
-				json.Add(AIS::KEY_COUNTRY_CODE, &JSON_MAP_MID[l].code);
+				Add(AIS::KEY_COUNTRY, &JSON_MAP_MID[l].country);
+				Add(AIS::KEY_COUNTRY_CODE, &JSON_MAP_MID[l].code);
 			}
 		}
 	}
 
+	const JSON::JSON &JSONAIS::Decode(const AIS::Message &msg, TAG &tag)
+	{
+		json.clear();
+		if (decode)
+		{
+			if (timing)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				ProcessMsg(msg, tag);
+				decode_timing += 1e-6f * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+				decode_count++;
+			}
+			else
+				ProcessMsg(msg, tag);
+		}
+		json.binary = (void *)&msg;
+		return json;
+	}
+
 	void JSONAIS::Receive(const AIS::Message *data, int len, TAG &tag)
 	{
 		for (int i = 0; i < len; i++)
 		{
-			json.clear();
-			ProcessMsg(data[i], tag);
-			json.binary = (void *)&data[i];
+			if (!include(data[i]))
+				continue;
+
+			Decode(data[i], tag);
+
+			tag.json_us = Util::Clock::steady();
 			Send(&json, 1, tag);
 		}
 	}
 
+	std::string JSONAIS::getTimingDetails()
+	{
+		if (decode_count == 0)
+			return "";
+
+		double speed = decode_timing > 0 ? decode_count / (decode_timing / 1000.0) : 0;
+
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1) << " (JSON decoder " << decode_timing << " ms for " << decode_count << " msgs, " << speed / 1e3 << "k msgs/s)";
+
+		return ss.str();
+	}
+
+	void JSONAIS::setKeys(const std::vector<int> &k)
+	{
+		keys.clear();
+		decode = !k.empty();
+
+		for (int p : k)
+		{
+			if (p >= (int)keys.size())
+				keys.resize(p + 1, false);
+			keys[p] = true;
+		}
+	}
+
+	void JSONAIS::setAllKeys()
+	{
+		keys.clear();
+		decode = true;
+	}
+
+	bool JSONAIS::covers(const std::vector<int> &k, bool all) const
+	{
+		if (!decode)
+			return !all && k.empty();
+
+		if (keys.empty())
+			return true;
+
+		if (all)
+			return false;
+
+		for (int p : k)
+			if (p >= (int)keys.size() || !keys[p])
+				return false;
+
+		return true;
+	}
+
 	void JSONAIS::ProcessMsg6Data(const AIS::Message &msg)
 	{
 		int dac = msg.getUint(72, 10);
@@ -269,7 +353,7 @@ namespace AIS
 				datastring += msg.getUint(88 + i, 1) ? '1' : '0';
 			}
 
-			json.Add(AIS::KEY_AI_AVAILABLE, &datastring);
+			Add(AIS::KEY_AI_AVAILABLE, &datastring);
 		}
 		else if (dac == 1 && (fid == 16 || fid == 40))
 		{
@@ -859,19 +943,19 @@ namespace AIS
 
 		if (radio_value != 0 && len == 19)
 		{
-			json.Add(AIS::KEY_RADIO, (int)radio_value);
+			Add(AIS::KEY_RADIO, (int)radio_value);
 
 			unsigned sync_state = (radio_value >> 17) & 0x03;
-			json.Add(AIS::KEY_SYNC_STATE, (int)sync_state);
+			Add(AIS::KEY_SYNC_STATE, (int)sync_state);
 
 			unsigned slot_timeout = (radio_value >> 14) & 0x07;
-			json.Add(AIS::KEY_SLOT_TIMEOUT, (int)slot_timeout);
+			Add(AIS::KEY_SLOT_TIMEOUT, (int)slot_timeout);
 
 			unsigned sub_msg = radio_value & 0x3FFF;
 
 			if (slot_timeout == 0)
 			{
-				json.Add(AIS::KEY_SLOT_OFFSET, (int)sub_msg);
+				Add(AIS::KEY_SLOT_OFFSET, (int)sub_msg);
 			}
 			else if (slot_timeout == 1)
 			{
@@ -880,56 +964,61 @@ namespace AIS
 
 				if (utc_hour < 24 && utc_minute < 60)
 				{
-					json.Add(AIS::KEY_UTC_HOUR, utc_hour);
-					json.Add(AIS::KEY_UTC_MINUTE, utc_minute);
+					Add(AIS::KEY_UTC_HOUR, utc_hour);
+					Add(AIS::KEY_UTC_MINUTE, utc_minute);
 				}
 			}
 			else if (slot_timeout == 2 || slot_timeout == 4 || slot_timeout == 6)
 			{
-				json.Add(AIS::KEY_SLOT_NUMBER, (int)sub_msg);
+				Add(AIS::KEY_SLOT_NUMBER, (int)sub_msg);
 			}
 			else if (slot_timeout == 3 || slot_timeout == 5 || slot_timeout == 7)
 			{
-				json.Add(AIS::KEY_RECEIVED_STATIONS, (int)sub_msg);
+				Add(AIS::KEY_RECEIVED_STATIONS, (int)sub_msg);
 			}
 		}
 		else
 		{
-			json.Add(AIS::KEY_RADIO, 0);
+			Add(AIS::KEY_RADIO, 0);
 		}
 	}
 	void JSONAIS::ProcessMsg(const AIS::Message &msg, TAG &tag)
 	{
 
-		rxtime = msg.getRxTime();
+		// binary payloads are kept as a whole by consumers, so no filtering for these
+		filter = !keys.empty() && msg.type() != 6 && msg.type() != 8;
+
 		channel = std::string(1, msg.getChannel());
 
-		json.Add(AIS::KEY_CLASS, &class_str);
-		json.Add(AIS::KEY_DEVICE, &device);
-		json.Add(AIS::KEY_VERSION, tag.version);
-		json.Add(AIS::KEY_DRIVER, (int)tag.driver);
-		json.Add(AIS::KEY_HARDWARE, tag.hardware);
+		Add(AIS::KEY_CLASS, &class_str);
+		Add(AIS::KEY_DEVICE, &device);
+		Add(AIS::KEY_VERSION, tag.version);
+		Add(AIS::KEY_DRIVER, (int)tag.driver);
+		Add(AIS::KEY_HARDWARE, tag.hardware);
 
-		if (tag.mode & 2)
-			json.Add(AIS::KEY_RXTIME, &rxtime);
+		if ((tag.mode & 2) && !skip(AIS::KEY_RXTIME))
+		{
+			rxtime = msg.getRxTime();
+			Add(AIS::KEY_RXTIME, &rxtime);
+		}
 
-		json.Add(AIS::KEY_SCALED, true);
+		Add(AIS::KEY_SCALED, true);
 
 		if (tag.error != MESSAGE_ERROR_NONE)
-			json.Add(AIS::KEY_ERROR, (int)tag.error);
+			Add(AIS::KEY_ERROR, (int)tag.error);
 
-		json.Add(AIS::KEY_CHANNEL, &channel);
-		json.Add(AIS::KEY_NMEA, &msg.NMEA);
+		Add(AIS::KEY_CHANNEL, &channel);
+		Add(AIS::KEY_NMEA, &msg.NMEA);
 
 		if (tag.mode & 1)
 		{
-			json.Add(AIS::KEY_SIGNAL_POWER, tag.level);
-			json.Add(AIS::KEY_PPM, tag.ppm);
+			Add(AIS::KEY_SIGNAL_POWER, tag.level);
+			Add(AIS::KEY_PPM, tag.ppm);
 		}
 
 		if (msg.getStation())
 		{
-			json.Add(AIS::KEY_STATION_ID, msg.getStation());
+			Add(AIS::KEY_STATION_ID, msg.getStation());
 		}
 
 		if (msg.getLength() > 0)
@@ -23,6 +23,7 @@
 #include "JSON/JSON.h"
 #include "Keys.h"
 #include "AIS.h"
+#include "Aggregator.h"
 
 namespace AIS {
 	class JSONAIS : public SimpleStreamInOut<Message, JSON::JSON> {
@@ -40,6 +41,27 @@ namespace AIS {
 		std::string channel, timestamp, datastring, rxtime;
 		std::string eta, text, callsign, shipname, destination, name, vendorid;
 
+		// keys requested by the consumers, empty if all keys are needed
+		std::vector<bool> keys;
+		bool decode = true, filter = false;
+
+		bool skip(int p) const { return filter && (p >= (int)keys.size() || !keys[p]); }
+
+		// copies of a transmission already passed on by another input are not decoded
+		Aggregator *aggregator = nullptr;
+
+		// decoding time for -b
+		bool timing = false;
+		float decode_timing = 0.0;
+		uint64_t decode_count = 0;
+
+		template <typename T>
+		void Add(int p, const T &v)
+		{
+			if (!skip(p))
+				json.Add(p, v);
+		}
+
 	protected:
 		void ProcessMsg8Data(const AIS::Message& msg);
 		void ProcessMsg6Data(const AIS::Message& msg);
@@ -67,5 +89,21 @@ namespace AIS {
 		virtual ~JSONAIS() {}
 
 		void Receive(const AIS::Message* data, int len, TAG& tag);
+
+		// decode without sending, the result is valid until the next call
+		const JSON::JSON& Decode(const AIS::Message& msg, TAG& tag);
+
+		// restrict decoding to a set of keys, an empty set skips decoding altogether
+		void setKeys(const std::vector<int>& k);
+		void setAllKeys();
+		// true if the decoded fields include keys k, or all keys if all is set
+		bool covers(const std::vector<int>& k, bool all) const;
+
+		void setTiming(bool b) { timing = b; }
+		void setAggregator(Aggregator *a) { aggregator = a; }
+
+		// false if msg is a copy that merged into one received earlier via another input
+		bool include(const AIS::Message &msg) { return !aggregator || aggregator->accept(msg, out.getGroupOut()); }
+		std::string getTimingDetails();
 	};
 }
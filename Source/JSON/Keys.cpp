@@ -15,6 +15,8 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
+
 #include "Keys.h"
 
 namespace AIS
@@ -50,9 +52,12 @@ namespace AIS
 		{"", "", "", "", "airspyhf", ""},												// KEY_SETTING_AIRSPYHF
 		{"", "", "", "", "allow_type", ""},												// KEY_SETTING_ALLOW_TYPE
 		{"", "", "", "", "antenna", ""},												// KEY_SETTING_ANTENNA
+		{"", "", "", "", "async", ""},													// KEY_SETTING_ASYNC
 		{"", "", "", "", "author", ""},													// KEY_SETTING_AUTHOR
 		{"", "", "", "", "backup", ""},													// KEY_SETTING_BACKUP
 		{"", "", "", "", "bandwidth", ""},												// KEY_SETTING_BANDWIDTH
+		{"", "", "", "", "batch", ""},													// KEY_SETTING_BATCH
+		{"", "", "", "", "batch_time", ""},												// KEY_SETTING_BATCH_TIME
 		{"", "", "", "", "baudrate", ""},												// KEY_SETTING_BAUDRATE
 		{"", "", "", "", "biastee", ""},												// KEY_SETTING_BIASTEE
 		{"", "", "", "", "binary", ""},													// KEY_SETTING_BINARY
@@ -112,6 +117,7 @@ namespace AIS
 		{"", "", "", "", "mode", ""},													// KEY_SETTING_MODE
 		{"", "", "", "", "model", ""},													// KEY_SETTING_MODEL
 		{"", "", "", "", "msg", ""},													// KEY_SETTING_MSG
+		{"", "", "", "", "msg_buffer", ""},												// KEY_SETTING_MSG_BUFFER
 		{"", "", "", "", "msgformat", ""},												// KEY_SETTING_MSGFORMAT
 		{"", "", "", "", "msg_output", ""},												// KEY_SETTING_MSG_OUTPUT
 		{"", "", "", "", "mqtt", ""},													// KEY_SETTING_MQTT
@@ -120,6 +126,7 @@ namespace AIS
 		{"", "", "", "", "origin", ""},													// KEY_SETTING_ORIGIN
 		{"", "", "", "", "output", ""},													// KEY_SETTING_OUTPUT
 		{"", "", "", "", "own_mmsi", ""},												// KEY_SETTING_OWN_MMSI
+		{"", "", "", "", "pack", ""},													// KEY_SETTING_PACK
 		{"", "", "", "", "password", ""},												// KEY_SETTING_PASSWORD
 		{"", "", "", "", "persist", ""},												// KEY_SETTING_PERSIST
 		{"", "", "", "", "plugin", ""},													// KEY_SETTING_PLUGIN
@@ -133,6 +140,7 @@ namespace AIS
 		{"", "", "", "", "protocol", ""},												// KEY_SETTING_PROTOCOL
 		{"", "", "", "", "protocols", ""},												// KEY_SETTING_PROTOCOLS
 		{"", "", "", "", "ps_ema", ""},													// KEY_SETTING_PS_EMA
+		{"", "", "", "", "rcvbuf", ""},													// KEY_SETTING_RCVBUF
 		{"", "", "", "", "realtime", ""},												// KEY_SETTING_REALTIME
 		{"", "", "", "", "receiver", ""},												// KEY_SETTING_RECEIVER
 		{"", "", "", "", "reset", ""},													// KEY_SETTING_RESET
@@ -152,6 +160,8 @@ namespace AIS
 		{"", "", "", "", "share_loc", ""},												// KEY_SETTING_SHARE_LOC
 		{"", "", "", "", "sharing", ""},												// KEY_SETTING_SHARING
 		{"", "", "", "", "sharing_key", ""},											// KEY_SETTING_SHARING_KEY
+		{"", "", "", "", "simd", ""},													// KEY_SETTING_SIMD
+		{"", "", "", "", "fast_fm", ""},												// KEY_SETTING_FAST_FM
 		{"", "", "", "", "soapysdr", ""},												// KEY_SETTING_SOAPYSDR
 		{"", "", "", "", "soxr", ""},													// KEY_SETTING_SOXR
 		{"", "", "", "", "spyserver", ""},												// KEY_SETTING_SPYSERVER
@@ -165,6 +175,12 @@ namespace AIS
 		{"", "", "", "", "test", ""},													// KEY_SETTING_TEST
 		{"", "", "", "", "timeout", ""},												// KEY_SETTING_TIMEOUT
 		{"", "", "", "", "threshold", ""},												// KEY_SETTING_THRESHOLD
+		{"", "", "", "", "threads", ""},												// KEY_SETTING_THREADS
+		{"", "", "", "", "tile_cache", ""},												// KEY_SETTING_TILE_CACHE
+		{"", "", "", "", "executor_workers", ""},										// KEY_SETTING_EXECUTOR_WORKERS
+		{"", "", "", "", "executor_affinity", ""},										// KEY_SETTING_EXECUTOR_AFFINITY
+		{"", "", "", "", "workers", ""},												// KEY_SETTING_WORKERS
+		{"", "", "", "", "dedup", ""},													// KEY_SETTING_DEDUP
 		{"", "", "", "", "topic", ""},													// KEY_SETTING_TOPIC
 		{"", "", "", "", "tuner", ""},													// KEY_SETTING_TUNER
 		{"", "", "", "", "udp", ""},													// KEY_SETTING_UDP
@@ -178,7 +194,11 @@ namespace AIS
 		{"", "", "", "", "version", ""},												// KEY_SETTING_VERSION
 		{"", "", "", "", "vga", ""},													// KEY_SETTING_VGA
 		{"", "", "", "", "wavfile", ""},												// KEY_SETTING_WAVFILE
+		{"", "", "", "", "websocket", ""},												// KEY_SETTING_WEBSOCKET
+		{"", "", "", "", "window", ""},													// KEY_SETTING_WINDOW
 		{"", "", "", "", "qos", ""},													// KEY_SETTING_QOS
+		{"", "", "", "", "queue", ""},													// KEY_SETTING_QUEUE
+		{"", "", "", "", "zero_copy", ""},												// KEY_SETTING_ZERO_COPY
 		{"", "", "", "", "zlib", ""},													// KEY_SETTING_ZLIB
 		{"", "", "", "", "zmq", ""},													// KEY_SETTING_ZMQ
 		{"accuracy", "", "accuracy", "", "", ""},										// KEY_ACCURACY
@@ -741,9 +761,12 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_AIRSPYHF
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_ALLOW_TYPE
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_ANTENNA
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_ASYNC
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_AUTHOR
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_BACKUP
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_BANDWIDTH
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_BATCH
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_BATCH_TIME
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_BAUDRATE
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_BIASTEE
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_BINARY
@@ -803,6 +826,7 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_MODE
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_MODEL
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_MSG
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_MSG_BUFFER
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_MSGFORMAT
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_MSG_OUTPUT
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_MQTT
@@ -811,6 +835,7 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_ORIGIN
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_OUTPUT
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_OWN_MMSI
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_PACK
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_PASSWORD
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_PERSIST
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_PLUGIN
@@ -824,6 +849,7 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_PROTOCOL
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_PROTOCOLS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_PS_EMA
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_RCVBUF
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_REALTIME
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_RECEIVER
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_RESET
@@ -843,6 +869,8 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_SHARE_LOC
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_SHARING
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_SHARING_KEY
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_SIMD
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_FAST_FM
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_SOAPYSDR
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_SOXR
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_SPYSERVER
@@ -856,6 +884,12 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_TEST
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_TIMEOUT
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_THRESHOLD
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_THREADS
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_TILE_CACHE
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_EXECUTOR_WORKERS
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_EXECUTOR_AFFINITY
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_WORKERS
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_DEDUP
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_TOPIC
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_TUNER
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_UDP
@@ -869,7 +903,11 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_VERSION
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_VGA
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_WAVFILE
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_WEBSOCKET
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_WINDOW
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_QOS
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_QUEUE
+		KeyInfo("", "", nullptr),																							// KEY_SETTING_ZERO_COPY
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_ZLIB
 		KeyInfo("", "", nullptr),																							// KEY_SETTING_ZMQ
 		KeyInfo("", "Position Accuracy; 1 indicates DGPS-quality (< 10m), 0 indicates unaugmented GNSS (> 10m).", nullptr), // KEY_ACCURACY
@@ -1141,4 +1179,93 @@ namespace AIS
 		KeyInfo("", "", nullptr),																							// KEY_TYPE_TEXT
 		KeyInfo("", "", nullptr),																							// KEY_WAKE_VORTEX
 	};
+
+	uint32_t KeyIndex::hash(const char *s, std::size_t len, uint32_t seed)
+	{
+		uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+		for (std::size_t i = 0; i < len; i++)
+		{
+			h ^= (unsigned char)s[i];
+			h *= 16777619u;
+		}
+		return h ^ (h >> 15);
+	}
+
+	// try seeds until every name in the dictionary has its own slot, the table is at least twice the number of names
+	KeyIndex::KeyIndex(const std::vector<std::vector<std::string>> *map, int d) : keymap(map), dict(d)
+	{
+		std::vector<int> keys;
+
+		for (int i = 0; i < keymap->size(); i++)
+		{
+			if (dict >= (*keymap)[i].size() || (*keymap)[i][dict].empty())
+				continue;
+
+			// the first key wins if a name is used twice
+			bool duplicate = false;
+			for (int k : keys)
+				if ((*keymap)[k][dict] == (*keymap)[i][dict])
+					duplicate = true;
+
+			if (!duplicate)
+				keys.push_back(i);
+		}
+
+		uint32_t size = 16;
+		while (size < 2 * keys.size())
+			size <<= 1;
+
+		for (seed = 0;; seed++)
+		{
+			// grow the table if no perfect seed is found
+			if (seed && (seed & 0xFFF) == 0)
+				size <<= 1;
+
+			mask = size - 1;
+			slots.assign(size, -1);
+
+			bool perfect = true;
+			for (int k : keys)
+			{
+				const std::string &name = (*keymap)[k][dict];
+				int &slot = slots[hash(name.c_str(), name.size(), seed) & mask];
+
+				if (slot != -1)
+				{
+					perfect = false;
+					break;
+				}
+				slot = k;
+			}
+
+			if (perfect)
+				return;
+		}
+	}
+
+	const KeyIndex &KeyIndex::get(int dict)
+	{
+		static const std::vector<KeyIndex> index = []()
+		{
+			std::vector<KeyIndex> v;
+			for (int d = 0; d < KeyMap[0].size(); d++)
+				v.emplace_back(&KeyMap, d);
+			return v;
+		}();
+
+		return index.at(dict);
+	}
+
+	int KeyIndex::find(const char *s, std::size_t len) const
+	{
+		int p = slots[hash(s, len, seed) & mask];
+
+		if (p >= 0)
+		{
+			const std::string &name = (*keymap)[p][dict];
+			if (name.size() == len && std::memcmp(name.c_str(), s, len) == 0)
+				return p;
+		}
+		return -1;
+	}
 }
@@ -19,6 +19,7 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 
 #define JSON_DICT_FULL 0
 #define JSON_DICT_MINIMAL 1
@@ -54,6 +55,29 @@ namespace AIS
 	extern const std::vector<std::string> LookupTable_station_types;
 	extern const std::vector<std::string> LookupTable_txrx_types;
 
+	// Name to key lookup for one dictionary of a key map through a perfect hash: the seed is chosen so every
+	// name has its own slot and a lookup is one hash and one compare. The tables for KeyMap are built once.
+	class KeyIndex
+	{
+		const std::vector<std::vector<std::string>> *keymap;
+		int dict;
+
+		std::vector<int> slots;
+		uint32_t seed = 0;
+		uint32_t mask = 0;
+
+		static uint32_t hash(const char *s, std::size_t len, uint32_t seed);
+
+	public:
+		KeyIndex(const std::vector<std::vector<std::string>> *map, int d);
+
+		static const KeyIndex &get(int dict);
+
+		// returns the key or -1 if the name is not in the dictionary
+		int find(const char *s, std::size_t len) const;
+		int find(const std::string &s) const { return find(s.c_str(), s.size()); }
+	};
+
 	// JSON keys
 	enum Keys
 	{
@@ -86,9 +110,12 @@ namespace AIS
 		KEY_SETTING_AIRSPYHF,
 		KEY_SETTING_ALLOW_TYPE,
 		KEY_SETTING_ANTENNA,
+		KEY_SETTING_ASYNC,
 		KEY_SETTING_AUTHOR,
 		KEY_SETTING_BACKUP,
 		KEY_SETTING_BANDWIDTH,
+		KEY_SETTING_BATCH,
+		KEY_SETTING_BATCH_TIME,
 		KEY_SETTING_BAUDRATE,
 		KEY_SETTING_BIASTEE,
 		KEY_SETTING_BINARY,
@@ -148,6 +175,7 @@ namespace AIS
 		KEY_SETTING_MODE,
 		KEY_SETTING_MODEL,
 		KEY_SETTING_MSG,
+		KEY_SETTING_MSG_BUFFER,
 		KEY_SETTING_MSGFORMAT,
 		KEY_SETTING_MSG_OUTPUT,
 		KEY_SETTING_MQTT,
@@ -156,6 +184,7 @@ namespace AIS
 		KEY_SETTING_ORIGIN,
 		KEY_SETTING_OUTPUT,
 		KEY_SETTING_OWN_MMSI,
+		KEY_SETTING_PACK,
 		KEY_SETTING_PASSWORD,
 		KEY_SETTING_PERSIST,
 		KEY_SETTING_PLUGIN,
@@ -169,6 +198,7 @@ namespace AIS
 		KEY_SETTING_PROTOCOL,
 		KEY_SETTING_PROTOCOLS,
 		KEY_SETTING_PS_EMA,
+		KEY_SETTING_RCVBUF,
 		KEY_SETTING_REALTIME,
 		KEY_SETTING_RECEIVER,
 		KEY_SETTING_RESET,
@@ -188,6 +218,8 @@ namespace AIS
 		KEY_SETTING_SHARE_LOC,
 		KEY_SETTING_SHARING,
 		KEY_SETTING_SHARING_KEY,
+		KEY_SETTING_SIMD,
+		KEY_SETTING_FAST_FM,
 		KEY_SETTING_SOAPYSDR,
 		KEY_SETTING_SOXR,
 		KEY_SETTING_SPYSERVER,
@@ -201,6 +233,12 @@ namespace AIS
 		KEY_SETTING_TEST,
 		KEY_SETTING_TIMEOUT,
 		KEY_SETTING_THRESHOLD,
+		KEY_SETTING_THREADS,
+		KEY_SETTING_TILE_CACHE,
+		KEY_SETTING_EXECUTOR_WORKERS,
+		KEY_SETTING_EXECUTOR_AFFINITY,
+		KEY_SETTING_WORKERS,
+		KEY_SETTING_DEDUP,
 		KEY_SETTING_TOPIC,
 		KEY_SETTING_TUNER,
 		KEY_SETTING_UDP,
@@ -214,7 +252,11 @@ namespace AIS
 		KEY_SETTING_VERSION,
 		KEY_SETTING_VGA,
 		KEY_SETTING_WAVFILE,
+		KEY_SETTING_WEBSOCKET,
+		KEY_SETTING_WINDOW,
 		KEY_SETTING_QOS,
+		KEY_SETTING_QUEUE,
+		KEY_SETTING_ZERO_COPY,
 		KEY_SETTING_ZLIB,
 		KEY_SETTING_ZMQ,
 		KEY_ACCURACY,
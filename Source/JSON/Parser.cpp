@@ -16,6 +16,9 @@
 */
 
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
 #include <cmath>
 
 #include "Parser.h"
@@ -26,16 +29,17 @@ namespace JSON
 
 	// Parser -- Build JSON object from String
 
-	void Parser::error(const std::string &err, int pos)
+	void Parser::error(const std::string &err, const char *p)
 	{
 		const int char_limit = 40;
+		int pos = (int)(p - begin);
 		int from = MAX(pos - char_limit, 0);
-		int to = MIN(pos + char_limit, json.size());
+		int to = MIN(pos + char_limit, (int)(end - begin));
 
 		std::stringstream ss;
 		for (int i = from; i < to; i++)
 		{
-			char c = json[i];
+			char c = begin[i];
 			char d = (c == '\t' || c == '\r' || c == '\n') ? ' ' : c;
 			ss << d;
 		}
@@ -45,328 +49,323 @@ namespace JSON
 		throw std::runtime_error("syntax error in JSON: " + err);
 	}
 
-	// Lex analysis
+	// Key lookup
 
-	void Parser::skip_whitespace(int &ptr)
+	void Parser::buildIndex()
 	{
-		while (ptr < json.size() && std::isspace(json[ptr]))
-			ptr++;
-	}
-
-	void Parser::tokenizer()
-	{
-
-		tokens.clear();
-		std::string s;
-		int ptr = 0;
-
-		while (ptr < json.size())
+		if (keymap == &AIS::KeyMap)
 		{
+			index = &AIS::KeyIndex::get(dict);
+			owned.reset();
+		}
+		else
+		{
+			owned = std::make_shared<AIS::KeyIndex>(keymap, dict);
+			index = owned.get();
+		}
+	}
 
-			skip_whitespace(ptr);
-			if (ptr == json.size())
-				break;
-
-			char c = json[ptr];
-
-			// number
-			if (std::isdigit(c) || c == '-')
-			{
-				bool floating = false;
-				int start_idx = ptr;
-				bool scientific = false;
-
-				s.clear();
-
-				do
-				{
-					if (json[ptr] == '.')
-					{
-						if (floating || start_idx == ptr || !std::isdigit(json[ptr - 1]))
-							error("malformed number", ptr);
-						else
-							floating = true;
-					}
-					else if ((json[ptr] == 'e' || json[ptr] == 'E') && !scientific)
-					{
-						if (!std::isdigit(json[ptr - 1]) && json[ptr - 1] != '.')
-							error("malformed number", ptr);
-
-						scientific = floating = true;
-
-						s += json[ptr++];
-						if (ptr != json.size() && (json[ptr] == '+' || json[ptr] == '-'))
-						{
-							s += json[ptr++];
-						}
+	// Scanning
 
-						if (ptr == json.size() || !std::isdigit(json[ptr]))
-							error("malformed number", ptr);
-					}
+	void Parser::skip_whitespace()
+	{
+		while (ptr < end && std::isspace((unsigned char)*ptr))
+			ptr++;
+	}
 
-					s += json[ptr++];
+	// next non-whitespace character without consuming it, 0 at the end of the input
+	char Parser::peek()
+	{
+		skip_whitespace();
+		return ptr < end ? *ptr : 0;
+	}
 
-				} while (ptr != json.size() && (std::isdigit(json[ptr]) || json[ptr] == '.' || json[ptr] == 'e' || json[ptr] == 'E'));
+	void Parser::must_match(char c, const std::string &err)
+	{
+		if (peek() != c)
+			error(ptr < end ? err : "unexpected end in input", ptr);
+		ptr++;
+	}
 
-				tokens.push_back(Token(floating ? TokenType::FloatingPoint : TokenType::Integer, s, ptr));
-			}
-			// string
-			else if (c == '\"')
-			{
-				s.clear();
-				ptr++;
+	bool Parser::keyword(const char *word, std::size_t len)
+	{
+		if (end - ptr < (std::ptrdiff_t)len || std::memcmp(ptr, word, len) != 0)
+			return false;
+		if (ptr + len < end && std::isalpha((unsigned char)ptr[len]))
+			return false;
 
-				while (ptr != json.size() && json[ptr] != '\"' && json[ptr] != '\n' && json[ptr] != '\r')
-				{
-					char c = json[ptr];
-					if (c == '\\')
-					{
-						if (++ptr == json.size())
-							error("line ends in string literal escape sequence", ptr);
-						c = json[ptr];
-						switch (c)
-						{
-						case '\"':
-							break;
-						case '\\':
-							break;
-						case '/':
-							break;
-						case 'b':
-							c = '\b';
-							break;
-						case 'f':
-							c = '\f';
-							break;
-						case 'n':
-							c = '\n';
-							break;
-						case 'r':
-							c = '\r';
-							break;
-						case 't':
-							c = '\t';
-							break;
-						case 'u':
-						{
-							if (ptr + 4 >= json.size())
-								error("line ends in string literal unicode escape sequence", ptr);
-							std::string hex = json.substr(ptr + 1, 4);
-							for (int i = 0; i < 4; i++)
-								if (!std::isxdigit(hex[i]))
-									error("illegal unicode escape sequence", ptr);
-							c = std::stoi(hex, nullptr, 16);
-							ptr += 4;
-							break;
-						}
-						default:
-							error("illegal escape sequence " + std::to_string((int)(c)), ptr);
-						}
-					}
-					s += c;
-					ptr++;
-				};
+		ptr += len;
+		return true;
+	}
 
-				if (json.size() == ptr || json[ptr] != '\"')
-					error("line ends in string literal", ptr);
+	// returns the string in place if it has no escape sequences, otherwise decoded in scratch
+	void Parser::parse_string(const char *&s, std::size_t &len)
+	{
+		const char *start = ++ptr;
 
-				tokens.push_back(Token(TokenType::String, s, ptr));
-				ptr++;
-			}
-			// keyword
-			else if (isalpha(c))
-			{
+		while (ptr < end && *ptr != '\"' && *ptr != '\\' && *ptr != '\n' && *ptr != '\r')
+			ptr++;
 
-				s.clear();
+		if (ptr < end && *ptr == '\"')
+		{
+			s = start;
+			len = ptr++ - start;
+			return;
+		}
 
-				while (ptr != json.size() && isalpha(json[ptr]))
-					s += json[ptr++];
+		scratch.assign(start, ptr - start);
 
-				if (s == "true")
-					tokens.push_back(Token(TokenType::True, "", ptr));
-				else if (s == "false")
-					tokens.push_back(Token(TokenType::False, "", ptr));
-				else if (s == "null")
-					tokens.push_back(Token(TokenType::Null, "", ptr));
-				else
-					error("illegal identifier : \"" + s + "\"", ptr);
-			}
-			// special characters
-			else
+		while (ptr < end && *ptr != '\"' && *ptr != '\n' && *ptr != '\r')
+		{
+			char c = *ptr;
+			if (c == '\\')
 			{
+				if (++ptr == end)
+					error("line ends in string literal escape sequence", ptr);
+				c = *ptr;
 				switch (c)
 				{
-				case '{':
-					tokens.push_back(Token(TokenType::LeftBrace, "", ptr));
+				case '\"':
 					break;
-				case '}':
-					tokens.push_back(Token(TokenType::RightBrace, "", ptr));
+				case '\\':
 					break;
-				case '[':
-					tokens.push_back(Token(TokenType::LeftBracket, "", ptr));
+				case '/':
 					break;
-				case ']':
-					tokens.push_back(Token(TokenType::RightBracket, "", ptr));
+				case 'b':
+					c = '\b';
 					break;
-				case ':':
-					tokens.push_back(Token(TokenType::Colon, "", ptr));
+				case 'f':
+					c = '\f';
 					break;
-				case ',':
-					tokens.push_back(Token(TokenType::Comma, "", ptr));
+				case 'n':
+					c = '\n';
 					break;
-				default:
-					error("illegal character '" + std::string(1, c) + "'", ptr);
+				case 'r':
+					c = '\r';
+					break;
+				case 't':
+					c = '\t';
+					break;
+				case 'u':
+				{
+					if (end - ptr <= 4)
+						error("line ends in string literal unicode escape sequence", ptr);
+
+					int code = 0;
+					for (int i = 1; i <= 4; i++)
+					{
+						char h = ptr[i];
+						if (!std::isxdigit((unsigned char)h))
+							error("illegal unicode escape sequence", ptr);
+						code = code * 16 + (std::isdigit((unsigned char)h) ? h - '0' : (std::tolower((unsigned char)h) - 'a' + 10));
+					}
+					c = (char)code;
+					ptr += 4;
 					break;
 				}
-				ptr++;
+				default:
+					error("illegal escape sequence " + std::to_string((int)(c)), ptr);
+				}
 			}
+			scratch += c;
+			ptr++;
 		}
-		tokens.push_back(Token(TokenType::End, "", ptr));
-	}
 
-	// Parsing functions
+		if (ptr == end || *ptr != '\"')
+			error("line ends in string literal", ptr);
 
-	void Parser::error_parser(const std::string &err)
-	{
-		error(err, tokens[MIN(tokens.size() - 1, idx)].pos);
+		ptr++;
+		s = scratch.c_str();
+		len = scratch.size();
 	}
 
-	bool Parser::is_match(TokenType t)
+	void Parser::parse_number(Value &v)
 	{
-		if (idx >= tokens.size())
-			error_parser("unexpected end in input");
-		return tokens[idx].type == t;
-	}
+		const char *start = ptr;
+		bool floating = false;
+		bool scientific = false;
 
-	void Parser::must_match(TokenType t, const std::string &err)
-	{
-		if (!is_match(t))
-			error_parser(err);
-	}
+		if (*ptr == '-')
+			ptr++;
 
-	void Parser::next()
-	{
-		idx++;
-		if (idx >= tokens.size())
-			error_parser("unexpected end in input");
-	}
+		if (ptr == end || !std::isdigit((unsigned char)*ptr))
+			error("malformed number", ptr);
 
-	// search for keyword in "map", returns index in map or -1 if not found
-	int Parser::search(const std::string &s)
-	{
-		int p = -1;
-		for (int i = 0; i < keymap->size(); i++)
-			if (dict < (*keymap)[i].size() && (*keymap)[i][dict] == s)
+		while (ptr < end && (std::isdigit((unsigned char)*ptr) || *ptr == '.' || *ptr == 'e' || *ptr == 'E'))
+		{
+			if (*ptr == '.')
 			{
-				p = i;
-				break;
+				if (floating || !std::isdigit((unsigned char)ptr[-1]))
+					error("malformed number", ptr);
+				floating = true;
 			}
-		return p;
+			else if (*ptr == 'e' || *ptr == 'E')
+			{
+				if (scientific)
+					break;
+
+				if (!std::isdigit((unsigned char)ptr[-1]) && ptr[-1] != '.')
+					error("malformed number", ptr);
+
+				scientific = floating = true;
+
+				if (++ptr != end && (*ptr == '+' || *ptr == '-'))
+					ptr++;
+
+				if (ptr == end || !std::isdigit((unsigned char)*ptr))
+					error("malformed number", ptr);
+			}
+			ptr++;
+		}
+
+		// the input does not have to be terminated after the number
+		char number[64];
+		std::size_t len = ptr - start;
+
+		if (len >= sizeof(number))
+			error("malformed number", start);
+
+		std::memcpy(number, start, len);
+		number[len] = 0;
+
+		char *stop;
+		errno = 0;
+
+		if (floating)
+			v.setFloat(std::strtod(number, &stop));
+		else
+			v.setInt(std::strtol(number, &stop, 10));
+
+		if (errno == ERANGE || stop != number + len)
+			error("malformed number", start);
 	}
 
-	Value Parser::parse_value(std::shared_ptr<JSON> o)
+	// Parsing functions
+
+	Value Parser::parse_value(JSON &o)
 	{
 		Value v = Value();
 		v.setNull();
-		switch (tokens[idx].type)
+
+		char c = peek();
+
+		switch (c)
 		{
-		case TokenType::Integer:
-			v.setInt(Util::Parse::Integer(tokens[idx].text));
-			break;
-		case TokenType::FloatingPoint:
-			v.setFloat(Util::Parse::Float(tokens[idx].text));
-			break;
-		case TokenType::True:
-			v.setBool(true);
-			break;
-		case TokenType::LeftBrace:
-			o->objects.push_back(parse_core());
-			v.setObject(o->objects.back().get());
-			break;
-		case TokenType::False:
-			v.setBool(false);
+		case '\"':
+		{
+			const char *s;
+			std::size_t len;
+
+			parse_string(s, len);
+			v.setString(o.newString(s, len));
 			break;
-		case TokenType::Null:
-			v.setNull();
+		}
+		case '{':
+		{
+			o.objects.push_back(std::shared_ptr<JSON>(new JSON()));
+			parse_object(*o.objects.back());
+			v.setObject(o.objects.back().get());
 			break;
-		case TokenType::String:
-
-			o->strings.push_back(std::shared_ptr<std::string>(new std::string(tokens[idx].text)));
-			v.setString(o->strings.back().get());
+		}
+		case '[':
+		{
+			std::vector<Value> *a = o.newArray();
 
-			break;
-		case TokenType::LeftBracket:
-			o->arrays.push_back(std::shared_ptr<std::vector<Value>>(new std::vector<Value>()));
+			ptr++;
+			if (peek() != ']')
+			{
+				while (true)
+				{
+					a->push_back(parse_value(o));
 
-			next();
+					if (peek() != ',')
+						break;
+					ptr++;
 
-			while (!is_match(TokenType::RightBracket))
-			{
-				o->arrays.back()->push_back(parse_value(o));
-				next();
-				if (!is_match(TokenType::Comma))
-					break;
-				next();
-				if (is_match(TokenType::RightBracket))
-					error_parser("comma cannot be followed by ']'");
+					if (peek() == ']')
+						error("comma cannot be followed by ']'", ptr);
+				}
 			}
 
-			must_match(TokenType::RightBracket, "expected ']'");
-			v.setArray(o->arrays.back().get());
-
+			must_match(']', "expected ']'");
+			v.setArray(a);
+			break;
+		}
+		case 0:
+			error("unexpected end of file", ptr);
 			break;
-		case TokenType::End:
-			error_parser("unexpected end of file");
-
 		default:
-			error_parser("value parse not implemented");
+			if (std::isdigit((unsigned char)c) || c == '-')
+				parse_number(v);
+			else if (keyword("true", 4))
+				v.setBool(true);
+			else if (keyword("false", 5))
+				v.setBool(false);
+			else if (keyword("null", 4))
+				v.setNull();
+			else if (std::isalpha((unsigned char)c))
+			{
+				const char *start = ptr;
+				while (ptr < end && std::isalpha((unsigned char)*ptr))
+					ptr++;
+				error("illegal identifier : \"" + std::string(start, ptr - start) + "\"", ptr);
+			}
+			else
+				error("illegal character '" + std::string(1, c) + "'", ptr);
 			break;
 		}
 		return v;
 	}
 
-	std::shared_ptr<JSON> Parser::parse_core()
+	void Parser::parse_object(JSON &o)
 	{
-		std::shared_ptr<JSON> o = std::shared_ptr<JSON>(new JSON());
-
-		must_match(TokenType::LeftBrace, "expected '{'");
-		next();
+		must_match('{', "expected '{'");
 
-		while (is_match(TokenType::String))
+		if (peek() == '\"')
 		{
-			int p = search(tokens[idx].text);
-			if (p < 0)
+			while (true)
 			{
-				if (!skipUnknownKeys)
-					error_parser("\"" + tokens[idx].text + "\" is not an allowed \"key\"");
-			}
-			next();
+				const char *s;
+				std::size_t len;
+
+				parse_string(s, len);
 
-			must_match(TokenType::Colon, "expected \':\'");
-			next();
+				int p = index->find(s, len);
+				if (p < 0 && !skipUnknownKeys)
+					error("\"" + std::string(s, len) + "\" is not an allowed \"key\"", ptr);
 
-			o->Add(p, parse_value(o));
-			next();
+				must_match(':', "expected \':\'");
+
+				o.Add(p, parse_value(o));
+
+				if (peek() != ',')
+					break;
+				ptr++;
 
-			if (!is_match(TokenType::Comma))
-				break;
-			next();
-			if (!is_match(TokenType::String))
-				error_parser("comma needs to be followed by property");
+				if (peek() != '\"')
+					error("comma needs to be followed by property", ptr);
+			}
 		}
 
-		must_match(TokenType::RightBrace, "expected '}'");
-		return o;
+		must_match('}', "expected '}'");
 	}
-	std::shared_ptr<JSON> Parser::parse(const std::string &j)
+
+	void Parser::parse(const std::string &j, JSON &o)
 	{
-		json = j;
-		idx = 0;
-		tokenizer();
-		auto result = parse_core();
-		next();
-		must_match(TokenType::End, "expected END");
+		begin = ptr = j.c_str();
+		end = begin + j.size();
+
+		o.clear();
+		parse_object(o);
 
+		if (peek() != 0)
+			error("expected END", ptr);
+	}
+
+	std::shared_ptr<JSON> Parser::parse(const std::string &j)
+	{
+		std::shared_ptr<JSON> result = std::shared_ptr<JSON>(new JSON());
+		parse(j, *result);
 		return result;
 	}
 }
@@ -22,72 +22,54 @@
 #include <memory>
 
 #include "JSON.h"
+#include "Keys.h"
 
 namespace JSON {
 
+	// Single pass parser that reads the input in place. Keys are resolved through a perfect hash of the
+	// dictionary, strings are only copied into the pools of the resulting object.
 	class Parser {
 	private:
-		struct Token;
-
 		const std::vector<std::vector<std::string>>* keymap = nullptr;
 		int dict = 0;
 		bool skipUnknownKeys = false;
 
-		std::string json;
-		std::vector<Token> tokens;
-
-		enum class TokenType {
-			LeftBrace,
-			RightBrace,
-			LeftBracket,
-			RightBracket,
-			Integer,
-			FloatingPoint,
-			Colon,
-			Comma,
-			True,
-			False,
-			Null,
-			String,
-			End
-		};
-
-		struct Token {
-			int pos = 0;
-			TokenType type;
-			std::string text;
-
-			Token(TokenType t, const std::string& x, int p) {
-				pos = p;
-				type = t;
-				text = x;
-			}
-		};
-
-		void error(const std::string& err, int pos);
-
-		// tokenizer
-		void skip_whitespace(int&);
-		void tokenizer();
-
-		// parser
-		int idx = 0;
-
-		void error_parser(const std::string& err);
-		bool is_match(TokenType t);
-		void must_match(TokenType t, const std::string& err);
-		int search(const std::string& s);
-		void next();
-		std::shared_ptr<JSON> parse_core();
-		Value parse_value(std::shared_ptr<JSON>);
+		// perfect hash of the key names, shared for AIS::KeyMap and owned for other maps
+		const AIS::KeyIndex* index = nullptr;
+		std::shared_ptr<AIS::KeyIndex> owned;
+
+		void buildIndex();
+
+		// input being parsed, strings with escape sequences are decoded into scratch
+		const char* begin = nullptr;
+		const char* ptr = nullptr;
+		const char* end = nullptr;
+		std::string scratch;
+
+		void error(const std::string& err, const char* pos);
+
+		void skip_whitespace();
+		char peek();
+		void must_match(char c, const std::string& err);
+		bool keyword(const char* word, std::size_t len);
+
+		void parse_string(const char*& s, std::size_t& len);
+		void parse_number(Value& v);
+		void parse_object(JSON& o);
+		Value parse_value(JSON& o);
 
 	public:
-		Parser(const std::vector<std::vector<std::string>>* map, int d) : keymap(map), dict(d) {}
-		Parser(const std::vector<std::vector<std::string>>* map) : keymap(map) {}
+		Parser(const std::vector<std::vector<std::string>>* map, int d) : keymap(map), dict(d) { buildIndex(); }
+		Parser(const std::vector<std::vector<std::string>>* map) : keymap(map) { buildIndex(); }
 
 		std::shared_ptr<JSON> parse(const std::string& j);
+		// parse into an existing object, which is cleared first and keeps its pools
+		void parse(const std::string& j, JSON& o);
 		void setSkipUnknown(bool b) { skipUnknownKeys = b; }
 		// dictionary to use
-		void setMap(int d) { dict = d; }
+		void setMap(int d) {
+			dict = d;
+			buildIndex();
+		}
 	};
 }
@@ -17,14 +17,26 @@
 
 #include <string>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 
 #include "StringBuilder.h"
 #include "Keys.h"
+#include "Convert.h"
 
 namespace JSON {
 
 	// StringBuilder - Build string from JSON object
 
+	void StringBuilder::buildKeys() {
+		keys.resize(keymap->size());
+
+		for (int i = 0; i < keymap->size(); i++) {
+			const std::string& key = (*keymap)[i][dict];
+			keys[i] = key.empty() ? std::string() : "\"" + key + "\":";
+		}
+	}
+
 	void StringBuilder::stringify(const std::string& str, std::string& json, bool esc) {
 		if (esc) json += '\"';
 		for (char c : str) {
@@ -94,7 +106,7 @@ namespace JSON {
 		}
 		else if (v.isArrayString()) {
 
-			const std::vector<std::string>& as = v.getStringArray();
+			const StringList& as = v.getStringArray();
 
 			json += '[';
 
@@ -109,6 +121,12 @@ namespace JSON {
 
 			json += ']';
 		}
+		else if (v.isInt()) {
+			Util::Convert::appendInt(json, v.getInt());
+		}
+		else if (v.isFloat()) {
+			Util::Convert::appendFixed(json, v.getFloat());
+		}
 		else if (v.isArray()) {
 
 			const std::vector<Value>& a = v.getArray();
@@ -130,22 +148,38 @@ namespace JSON {
 			v.to_string(json);
 	}
 
+	void StringBuilder::stringifyCached(const JSON& object, std::string& json) {
+		std::lock_guard<std::mutex> lock(object.getSerializedMutex());
+
+		const std::string* cached = object.getSerialized(keymap, dict, stringify_enhanced);
+
+		if (!cached) {
+			std::string* s = object.newSerialized(keymap, dict, stringify_enhanced);
+			stringify(object, *s);
+			cached = s;
+		}
+		json += *cached;
+	}
+
 	void StringBuilder::stringify(const JSON& object, std::string& json) {
 		bool first = true;
+
+		if (keys.size() != keymap->size()) buildKeys();
+
 		json += '{';
 		for (const Property& p : object.getProperties()) {
 
 			// Skip invalid keys to avoid out-of-bounds access
-			if (p.Key() < 0 || p.Key() >= keymap->size()) continue;
+			if (p.Key() < 0 || p.Key() >= keys.size()) continue;
 
-			const std::string& key = (*keymap)[p.Key()][dict];
+			const std::string& key = keys[p.Key()];
 
 			if (!key.empty()) {
 
 				if (!first) json += ',';
 				first = false;
 
-				json += "\"" + key + "\":";
+				json += key;
 				
 				if (stringify_enhanced) {
 					to_string_enhanced(json, p.Get(), p.Key());
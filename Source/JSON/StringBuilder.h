@@ -40,6 +40,11 @@ namespace JSON
 		int dict = 0;
 		bool stringify_enhanced = false;
 
+		// "key": fragments for the active dictionary, built on first use
+		std::vector<std::string> keys;
+		void buildKeys();
+
+
 	public:
 		StringBuilder(const std::vector<std::vector<std::string>> *map, int d) : keymap(map), dict(d) {}
 		StringBuilder(const std::vector<std::vector<std::string>> *map) : keymap(map) {}
@@ -47,6 +52,8 @@ namespace JSON
 		void to_string(std::string &json, const Value &v);
 		void to_string_enhanced(std::string &json, const Value &v, int key_index);
 		void stringify(const JSON &properties, std::string &json);
+		// as stringify, the result is stored with the object and reused by builders with the same settings
+		void stringifyCached(const JSON &properties, std::string &json);
 		static void stringify(const std::string &str, std::string &json, bool esc = true);
 
 		static std::string stringify(const std::string &str, bool esc = true)
@@ -57,7 +64,11 @@ namespace JSON
 		}
 
 		// dictionary to use
-		void setMap(int d) { dict = d; }
+		void setMap(int d)
+		{
+			dict = d;
+			keys.clear();
+		}
 		
 		// enable/disable enhanced output with metadata
 		void setStringifyEnhanced(bool enhanced) { stringify_enhanced = enhanced; }
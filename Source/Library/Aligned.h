@@ -0,0 +1,108 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Sample buffers for the DSP stages: cache line aligned so blocks start on a SIMD boundary and no two
+// buffers share a line. With huge pages enabled, buffers of 2 MB and more are aligned to 2 MB and
+// advised as transparent huge pages (Linux only).
+
+namespace Util
+{
+	namespace AlignedMemory
+	{
+		static const std::size_t ALIGNMENT = 64;
+		static const std::size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+		inline std::atomic<bool> &hugePages()
+		{
+			static std::atomic<bool> on{false};
+			return on;
+		}
+
+		inline void *allocate(std::size_t size)
+		{
+#ifdef _WIN32
+			return _aligned_malloc(size ? size : 1, ALIGNMENT);
+#else
+			void *p = nullptr;
+			bool huge = hugePages() && size >= HUGE_PAGE;
+
+			if (huge)
+				size = (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+
+			if (posix_memalign(&p, huge ? HUGE_PAGE : ALIGNMENT, size ? size : 1))
+				return nullptr;
+#ifdef MADV_HUGEPAGE
+			if (huge)
+				madvise(p, size, MADV_HUGEPAGE);
+#endif
+			return p;
+#endif
+		}
+
+		inline void release(void *p)
+		{
+#ifdef _WIN32
+			_aligned_free(p);
+#else
+			free(p);
+#endif
+		}
+	}
+
+	template <class T>
+	class AlignedAllocator
+	{
+	public:
+		typedef T value_type;
+
+		AlignedAllocator() {}
+		template <class U>
+		AlignedAllocator(const AlignedAllocator<U> &) {}
+
+		T *allocate(std::size_t n)
+		{
+			void *p = AlignedMemory::allocate(n * sizeof(T));
+			if (!p)
+				throw std::bad_alloc();
+			return static_cast<T *>(p);
+		}
+
+		void deallocate(T *p, std::size_t) { AlignedMemory::release(p); }
+	};
+
+	template <class T, class U>
+	bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &) { return true; }
+	template <class T, class U>
+	bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &) { return false; }
+
+	template <class T>
+	using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+}
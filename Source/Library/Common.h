@@ -88,7 +88,8 @@ enum class PROTOCOL
 	TLS,
 	TCP,
 	MQTTS,
-	WSSMQTT
+	WSSMQTT,
+	IQLINK
 };
 
 enum class Type
@@ -226,6 +227,9 @@ struct TAG
 	uint32_t ipv4 = 0;
 	uint32_t error = MESSAGE_ERROR_NONE;
 
+	// steady clock in microseconds, zero if not set: arrival of the device block, message decoded and JSON built
+	int64_t capture_us = 0, decode_us = 0, json_us = 0;
+
 	void clear()
 	{
 		// driver = Type::NONE;
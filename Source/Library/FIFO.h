@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 
@@ -24,69 +25,186 @@
 #include <chrono>
 #include <cstring>
 
+#include "Histogram.h"
+#include "Wakeups.h"
+#include "MemoryBudget.h"
+
 // FIFO implementation: input (Push) can be any size, output (Pop) will be of size BLOCK_SIZE
+//
+// Single producer (Push/PushFinished) and single consumer (Wait/Front/Pop). The block counter is
+// atomic so the common path takes no lock: the tail is only touched by the producer, the head only
+// by the consumer. The mutex/condition variables are only used when one side actually has to sleep,
+// and a notification is only sent when the other side has announced it is waiting.
+//
+// With setMaxBlocks the ring grows on overrun: the producer doubles it once the consumer is asleep on
+// an empty FIFO, the only moment neither side holds a pointer into the buffer.
 
 class FIFO
 {
 	std::vector<char> _data;
+	std::size_t memory_reported = 0;
 
 	int head = 0;
 	int tail = 0;
-	bool last_input = false;
 
-	int blocks_filled = 0;
+	std::atomic<int> blocks_filled{0};
+	std::atomic<bool> last_input{false};
+	std::atomic<bool> halted{false};
+
+	std::atomic<bool> consumer_waiting{false};
+	std::atomic<bool> producer_waiting{false};
 
 	std::mutex fifo_mutex;
 	std::condition_variable cv_ready;
 	std::condition_variable cv_has_space;
 
 	int BLOCK_SIZE = 16 * 16384;
-	int N_BLOCKS = 2;
+	std::atomic<int> N_BLOCKS{2};
+
+	int max_blocks = 0;
+	std::atomic<bool> grow_pending{false};
+	std::atomic<int> grows{0};
+
+	// overrun accounting, and the time from the push of a block until it has been processed and popped;
+	// blocks of a few bytes (text input) are not timed
+	std::vector<int64_t> stamps;
+	std::atomic<long> overruns{0};
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<int> max_filled{0};
+	LogHistogram latency;
+
+	bool timed() { return BLOCK_SIZE >= 512; }
+
+	static int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
 
-	const static int timeout = 1500;
+	// ms without data before Wait gives up, 0 waits until data arrives, the input ends or Halt
+	int timeout = 1500;
+
+	void grow()
+	{
+		std::lock_guard<std::mutex> lock(fifo_mutex);
+
+		if (!consumer_waiting || blocks_filled != 0 || halted)
+			return;
+
+		int n = 2 * N_BLOCKS > max_blocks ? max_blocks : 2 * N_BLOCKS.load();
+		int partial = tail % BLOCK_SIZE;
+
+		// the consumer is at the start of the partially filled tail block, move it to the front
+		std::vector<char> d((int)(n * BLOCK_SIZE));
+		std::memcpy(d.data(), _data.data() + tail - partial, partial);
+		_data.swap(d);
+		MemoryBudget::account(MemoryBudget::FIFO, memory_reported, _data.size());
+
+		head = 0;
+		tail = partial;
+		N_BLOCKS = n;
+		stamps.assign(timed() ? n : 0, 0);
+
+		grows++;
+		grow_pending = false;
+	}
+
+	void notifyConsumer()
+	{
+		if (consumer_waiting.load())
+		{
+			std::lock_guard<std::mutex> lock(fifo_mutex);
+			cv_ready.notify_one();
+		}
+	}
+
+	void notifyProducer()
+	{
+		if (producer_waiting.load())
+		{
+			std::lock_guard<std::mutex> lock(fifo_mutex);
+			cv_has_space.notify_one();
+		}
+	}
 
 public:
+	~FIFO() { MemoryBudget::account(MemoryBudget::FIFO, memory_reported, 0); }
+
 	void Init(int bs = 16 * 16384, int fs = 2)
 	{
 		BLOCK_SIZE = bs;
 		N_BLOCKS = fs;
-		blocks_filled = head = tail = 0;
+		head = tail = 0;
+		blocks_filled = 0;
 		last_input = false;
+		halted = false;
 
 		_data.resize((int)(N_BLOCKS * BLOCK_SIZE));
+		MemoryBudget::account(MemoryBudget::FIFO, memory_reported, _data.size());
+
+		stamps.assign(timed() ? N_BLOCKS.load() : 0, 0);
+		overruns = 0;
+		dropped = 0;
+		max_filled = 0;
+		latency.clear();
+
+		grow_pending = false;
+		grows = 0;
 	}
 
+	// for inputs that can be silent for a long time, e.g. text, so the consumer does not wake up idle
+	void setTimeout(int ms) { timeout = ms; }
+
+	// ring may grow up to n blocks on overrun, 0 keeps it fixed (call before Init)
+	void setMaxBlocks(int n) { max_blocks = n; }
+
 	int BlockSize()
 	{
 		return BLOCK_SIZE;
 	}
 
+	int Blocks() { return N_BLOCKS; }
+	long getOverruns() { return overruns; }
+	uint64_t getDropped() { return dropped; }
+	int getMaxFilled() { return max_filled; }
+	int getGrows() { return grows; }
+	LogHistogram &getLatency() { return latency; }
+
+	// steady clock in microseconds when the block at the front was completed, zero if not timed
+	int64_t getStamp() { return timed() ? stamps[head / BLOCK_SIZE] : 0; }
+
 	void Halt()
 	{
 		std::lock_guard<std::mutex> lock(fifo_mutex);
 
-		blocks_filled = -1;
+		halted = true;
 		cv_ready.notify_one();
 		cv_has_space.notify_one();
 	}
 
 	void PushFinished()
 	{
-		std::lock_guard<std::mutex> lock(fifo_mutex);
 		last_input = true;
-		cv_ready.notify_one();		
+		notifyConsumer();
 	}
 
 	bool Wait()
 	{
-		std::unique_lock<std::mutex> lock(fifo_mutex);
-
-		if (blocks_filled == 0 && !last_input)
+		if (blocks_filled.load(std::memory_order_acquire) == 0 && !last_input && !halted)
 		{
-			cv_ready.wait_for(lock, std::chrono::milliseconds((int)(timeout)), [this]
-							  { return blocks_filled != 0 || last_input; });
+			std::unique_lock<std::mutex> lock(fifo_mutex);
+
+			consumer_waiting = true;
+			if (timeout > 0)
+				cv_ready.wait_for(lock, std::chrono::milliseconds(timeout), [this]
+								  { return blocks_filled != 0 || last_input || halted; });
+			else
+				cv_ready.wait(lock, [this]
+							  { return blocks_filled != 0 || last_input || halted; });
+			consumer_waiting = false;
+
+			Wakeups::add(Wakeups::FIFO);
 		}
-		return blocks_filled > 0;
+		return !halted && blocks_filled.load(std::memory_order_acquire) > 0;
 	}
 
 	char *Front()
@@ -97,42 +215,46 @@ public:
 	char *Front(int &requested)
 	{
 		int to_wrap = ((_data.size() - head) / BLOCK_SIZE);
+		int filled = blocks_filled.load(std::memory_order_acquire);
 
 		if (requested < 0)
 			requested = to_wrap;
-		if (blocks_filled < requested)
-			requested = blocks_filled;
+		if (filled < requested)
+			requested = filled;
 
 		return _data.data() + head;
 	}
 
 	void Pop(int count = 1)
 	{
-		std::unique_lock<std::mutex> lock(fifo_mutex);
+		int filled = blocks_filled.load(std::memory_order_acquire);
 
-		if (blocks_filled < count)
-			count = blocks_filled;
+		if (filled < count)
+			count = filled;
 
 		if (count > 0)
 		{
+			if (timed())
+			{
+				int64_t t = now();
+				for (int i = 0, b = head / BLOCK_SIZE; i < count; i++, b = (b + 1) % N_BLOCKS)
+					latency.add(t - stamps[b]);
+			}
+
 			head = (head + count * BLOCK_SIZE) % (int)_data.size();
-			blocks_filled -= count;
+			blocks_filled.fetch_sub(count);
 
-			cv_has_space.notify_one();
+			notifyProducer();
 		}
 	}
 
 	bool Full()
 	{
-		std::unique_lock<std::mutex> lock(fifo_mutex);
-
-		return blocks_filled == N_BLOCKS;
+		return blocks_filled.load(std::memory_order_acquire) == N_BLOCKS;
 	}
 
 	bool Push(char *data, int sz, bool wait = false)
 	{
-		std::unique_lock<std::mutex> lock(fifo_mutex);
-
 		if (sz <= 0)
 			return true;
 
@@ -141,22 +263,36 @@ public:
 		int blocks_needed = (tail % BLOCK_SIZE + sz - 1) / BLOCK_SIZE + 1;
 		int wrap = tail + sz - (int)_data.size();
 
-		if (blocks_filled == -1)
+		if (halted)
 			return false;
 
-		if (blocks_filled + blocks_needed > N_BLOCKS)
+		if (grow_pending)
 		{
-			if (wait)
-			{
-				while (blocks_filled != -1 && (blocks_filled + blocks_needed > N_BLOCKS))
-				{
-					cv_has_space.wait(lock);
-				}
-			}
-			else
+			grow();
+			wrap = tail + sz - (int)_data.size();
+		}
+
+		if (blocks_filled.load(std::memory_order_acquire) + blocks_needed > N_BLOCKS)
+		{
+			if (!wait)
 			{
+				overruns++;
+				dropped += sz;
+
+				if (N_BLOCKS < max_blocks)
+					grow_pending = true;
 				return false;
 			}
+
+			std::unique_lock<std::mutex> lock(fifo_mutex);
+
+			producer_waiting = true;
+			cv_has_space.wait(lock, [this, blocks_needed]
+							  { return halted || blocks_filled + blocks_needed <= N_BLOCKS; });
+			producer_waiting = false;
+
+			if (halted)
+				return false;
 		}
 
 		if (wrap <= 0)
@@ -169,12 +305,21 @@ public:
 			std::memcpy(_data.data(), data + sz - wrap, wrap);
 		}
 
+		if (blocks_ready > 0 && timed())
+		{
+			int64_t t = now();
+			for (int i = 0, b = tail / BLOCK_SIZE; i < blocks_ready; i++, b = (b + 1) % N_BLOCKS)
+				stamps[b] = t;
+		}
+
 		tail = (tail + sz) % (int)_data.size();
 
 		if (blocks_ready > 0)
 		{
-			blocks_filled += blocks_ready;
-			cv_ready.notify_one();
+			int filled = blocks_filled.fetch_add(blocks_ready) + blocks_ready;
+			if (filled > max_filled)
+				max_filled = filled;
+			notifyConsumer();
 		}
 		return true;
 	}
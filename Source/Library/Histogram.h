@@ -0,0 +1,162 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+// Counts of values on a log2 scale, bucket b holds [2^b, 2^(b+1)), to report percentiles of
+// durations without keeping them. Updates are relaxed atomics so readers on other threads are safe.
+// toPrometheus renders the histogram sample lines, the caller writes HELP and TYPE once per metric.
+
+class LogHistogram
+{
+	std::atomic<uint32_t> buckets[64];
+	std::atomic<uint64_t> n{0}, largest{0}, sum{0};
+
+public:
+	LogHistogram() { clear(); }
+
+	void clear()
+	{
+		for (auto &b : buckets)
+			b = 0;
+		n = largest = sum = 0;
+	}
+
+	void add(uint64_t v)
+	{
+		int b = 0;
+		while (b < 63 && (v >> (b + 1)))
+			b++;
+
+		buckets[b].fetch_add(1, std::memory_order_relaxed);
+		n.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(v, std::memory_order_relaxed);
+		if (v > largest)
+			largest = v;
+	}
+
+	uint64_t getCount() { return n; }
+	uint64_t getMax() { return largest; }
+	uint64_t getSum() { return sum; }
+
+	// buckets with upper bound 2^(lo+1) ... 2^hi, labels without braces
+	std::string toPrometheus(const std::string &name, const std::string &labels, int lo, int hi)
+	{
+		std::string str, sep = labels.empty() ? "" : ",";
+		uint64_t cumulative = 0;
+
+		for (int b = 0; b < 64; b++)
+		{
+			cumulative += buckets[b];
+			if (b >= lo && b < hi)
+				str += name + "_bucket{" + labels + sep + "le=\"" + std::to_string((uint64_t)1 << (b + 1)) + "\"} " + std::to_string(cumulative) + "\n";
+		}
+
+		std::string braces = labels.empty() ? "" : "{" + labels + "}";
+		return str + name + "_bucket{" + labels + sep + "le=\"+Inf\"} " + std::to_string(cumulative) + "\n" +
+			   name + "_sum" + braces + " " + std::to_string(getSum()) + "\n" +
+			   name + "_count" + braces + " " + std::to_string(cumulative) + "\n";
+	}
+
+	// interpolates linearly within the bucket that holds the p-th percentile
+	uint64_t percentile(int p)
+	{
+		uint64_t total = 0, h[64];
+
+		for (int i = 0; i < 64; i++)
+			total += h[i] = buckets[i];
+
+		if (total == 0)
+			return 0;
+
+		uint64_t target = (total * p + 99) / 100, seen = 0;
+		for (int b = 0; b < 64; b++)
+		{
+			if (h[b] && seen + h[b] >= target)
+			{
+				uint64_t lo = b ? (uint64_t)1 << b : 0, width = b ? lo : 2;
+				uint64_t v = lo + (uint64_t)((double)width * (target - seen) / h[b]);
+				return v < largest ? v : (uint64_t)largest;
+			}
+			seen += h[b];
+		}
+		return 0;
+	}
+};
+
+// Counts against fixed upper bounds, rendered as a Prometheus histogram. Values above the last bound
+// only count towards +Inf.
+
+class BucketHistogram
+{
+	std::vector<double> bounds;
+	std::unique_ptr<std::atomic<uint64_t>[]> counts;
+	std::atomic<double> sum{0};
+
+	static std::string format(double v)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%g", v);
+		return buf;
+	}
+
+public:
+	BucketHistogram(const std::vector<double> &b) : bounds(b), counts(new std::atomic<uint64_t>[b.size() + 1]) { clear(); }
+
+	void clear()
+	{
+		for (int i = 0; i <= (int)bounds.size(); i++)
+			counts[i] = 0;
+		sum = 0;
+	}
+
+	void add(double v)
+	{
+		int i = (int)(std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin());
+		counts[i].fetch_add(1, std::memory_order_relaxed);
+
+		double s = sum.load(std::memory_order_relaxed);
+		while (!sum.compare_exchange_weak(s, s + v, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	std::string toPrometheus(const std::string &name)
+	{
+		std::string str;
+		uint64_t cumulative = 0;
+
+		for (int i = 0; i < (int)bounds.size(); i++)
+		{
+			cumulative += counts[i];
+			str += name + "_bucket{le=\"" + format(bounds[i]) + "\"} " + std::to_string(cumulative) + "\n";
+		}
+		cumulative += counts[bounds.size()];
+
+		return str + name + "_bucket{le=\"+Inf\"} " + std::to_string(cumulative) + "\n" +
+			   name + "_sum " + format(sum) + "\n" +
+			   name + "_count " + std::to_string(cumulative) + "\n";
+	}
+};
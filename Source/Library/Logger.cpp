@@ -36,6 +36,7 @@
 
 #include "Logger.h"
 #include "Convert.h"
+#include "Parse.h"
 #include "StringBuilder.h"
 
 std::unique_ptr<Logger> Logger::instance_ = nullptr;
@@ -143,6 +144,10 @@ Setting &Logger::Set(std::string option, std::string arg)
 	{
 		setLogToSystem("aiscatcher");
 	}
+	else if (option == "ASYNC")
+	{
+		async_ = Util::Parse::Switch(arg);
+	}
 	else if (option == "LEVEL")
 	{
 		Util::Convert::toUpper(arg);
@@ -171,9 +176,8 @@ void Logger::setLogToSystem(std::string ident)
 	Logger::getInstance().addLogListener(SyslogHandler(ident));
 }
 
-std::string Logger::getCurrentTime()
+std::string Logger::formatTime(std::chrono::system_clock::time_point now)
 {
-	auto now = std::chrono::system_clock::now();
 	std::time_t now_time_t = std::chrono::system_clock::to_time_t(now);
 	char time_buffer[20];
 
@@ -201,7 +205,11 @@ void Logger::storeMessage(const LogMessage &msg)
 	if (!message_buffer_.size())
 		return;
 
-	message_buffer_[buffer_position_] = msg;
+	LogMessage &m = message_buffer_[buffer_position_];
+	std::size_t old = m.message.capacity() + m.time.capacity();
+	m = msg;
+	MemoryBudget::account(MemoryBudget::LOG, memory_reported_, memory_reported_ + m.message.capacity() + m.time.capacity() - old);
+
 	buffer_position_ = (buffer_position_ + 1) % message_buffer_.size();
 }
 
@@ -260,8 +268,9 @@ void Logger::notifyListeners(const LogMessage &msg)
 {
 	static std::atomic<bool> in_notify(false);
 	bool is_notifying = in_notify.exchange(true);
-	
-    if(is_notifying) return;
+
+	if (is_notifying)
+		return;
 
 	std::lock_guard<std::mutex> lock(mutex_);
 
@@ -272,26 +281,173 @@ void Logger::notifyListeners(const LogMessage &msg)
 	in_notify.store(false);
 }
 
+bool Logger::push(LogLevel level, const std::string &message, size_t &ticket)
+{
+	size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+	Slot *slot;
+
+	while (true)
+	{
+		slot = &ring_[pos % RING_SIZE];
+		intptr_t diff = (intptr_t)slot->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+
+		if (diff == 0)
+		{
+			if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+			return false;
+		else
+			pos = enqueue_pos_.load(std::memory_order_relaxed);
+	}
+
+	slot->level = level;
+	slot->message = message;
+	slot->time = std::chrono::system_clock::now();
+	slot->seq.store(pos + 1, std::memory_order_release);
+
+	ticket = pos + 1;
+
+	if (dispatcher_waiting_)
+	{
+		std::lock_guard<std::mutex> lock(wait_mutex_);
+		cv_work_.notify_one();
+	}
+	return true;
+}
+
+bool Logger::pop(LogMessage &msg)
+{
+	Slot &slot = ring_[dequeue_pos_ % RING_SIZE];
+
+	if (slot.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+		return false;
+
+	msg = LogMessage(slot.level, std::move(slot.message), formatTime(slot.time));
+	slot.seq.store(dequeue_pos_ + RING_SIZE, std::memory_order_release);
+	dequeue_pos_++;
+	return true;
+}
+
+void Logger::dispatch()
+{
+	LogMessage msg;
+
+	while (true)
+	{
+		while (pop(msg))
+		{
+			storeMessage(msg);
+			notifyListeners(msg);
+			delivered_++;
+		}
+
+		long d = dropped_;
+		if (d != reported_dropped_)
+		{
+			msg = LogMessage(LogLevel::__WARNING, "Logger: " + std::to_string(d - reported_dropped_) + " messages dropped, queue full.", formatTime(std::chrono::system_clock::now()));
+			reported_dropped_ = d;
+			storeMessage(msg);
+			notifyListeners(msg);
+		}
+
+		std::unique_lock<std::mutex> lock(wait_mutex_);
+		cv_done_.notify_all();
+
+		if (stop_ && ring_[dequeue_pos_ % RING_SIZE].seq.load() != dequeue_pos_ + 1)
+			break;
+
+		dispatcher_waiting_ = true;
+		cv_work_.wait_for(lock, std::chrono::milliseconds(100), [this]
+						  { return stop_ || ring_[dequeue_pos_ % RING_SIZE].seq.load() == dequeue_pos_ + 1; });
+		dispatcher_waiting_ = false;
+	}
+}
+
+void Logger::startDispatcher()
+{
+	if (!async_ || running_)
+		return;
+
+	ring_.reset(new Slot[RING_SIZE]);
+	for (size_t i = 0; i < RING_SIZE; i++)
+		ring_[i].seq = i;
+
+	enqueue_pos_ = 0;
+	dequeue_pos_ = 0;
+	delivered_ = 0;
+	stop_ = false;
+
+	dispatcher_ = std::thread(&Logger::dispatch, this);
+	running_ = true;
+}
+
+void Logger::stopDispatcher()
+{
+	if (!running_)
+		return;
+
+	running_ = false;
+	{
+		std::lock_guard<std::mutex> lock(wait_mutex_);
+		stop_ = true;
+		cv_work_.notify_one();
+	}
+
+	if (dispatcher_.joinable())
+		dispatcher_.join();
+
+	// messages queued while the dispatcher was stopping
+	LogMessage msg;
+	while (pop(msg))
+	{
+		storeMessage(msg);
+		notifyListeners(msg);
+	}
+}
+
+// waits, at most a second, until the message with this ticket has been delivered
+void Logger::flush(size_t ticket)
+{
+	std::unique_lock<std::mutex> lock(wait_mutex_);
+	cv_done_.wait_for(lock, std::chrono::seconds(1), [this, ticket]
+					  { return delivered_ >= ticket || stop_; });
+}
+
 void Logger::log(LogLevel level, const std::string &message)
 {
 	if (level < min_level_)
 		return;
 
-	std::string time_str = getCurrentTime();
-	LogMessage log_msg(level, message, time_str);
+	// messages from the listeners themselves are stored but not dispatched again
+	if (running_ && std::this_thread::get_id() != dispatcher_.get_id())
+	{
+		size_t ticket;
+
+		if (!push(level, message, ticket))
+			dropped_++;
+		else if (level >= LogLevel::__ERROR)
+			flush(ticket);
+		return;
+	}
+
+	LogMessage log_msg(level, message, formatTime(std::chrono::system_clock::now()));
 
 	storeMessage(log_msg);
-	notifyListeners(log_msg);
+	if (!running_)
+		notifyListeners(log_msg);
 }
 
 LogStream::LogStream(LogLevel level)
-	: level_(level), stream_(new std::ostringstream())
+	: level_(level), stream_(Logger::getInstance().isEnabled(level) ? new std::ostringstream() : nullptr)
 {
 }
 
 LogStream::~LogStream()
 {
-	Logger::getInstance().log(level_, stream_->str());
+	if (stream_)
+		Logger::getInstance().log(level_, stream_->str());
 }
 
 // Convenience functions
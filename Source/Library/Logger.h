@@ -23,8 +23,13 @@
 #include <vector>
 #include <memory>
 #include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
 
 #include "Common.h"
+#include "MemoryBudget.h"
 
 enum class LogLevel
 {
@@ -55,7 +60,7 @@ class Logger : public Setting
 public:
     static Logger &getInstance();
 
-    ~Logger() = default;
+    ~Logger() { stopDispatcher(); }
 
     typedef std::function<void(const LogMessage &)> LogCallback;
     void log(LogLevel level, const std::string &message);
@@ -68,12 +73,21 @@ public:
     {
         std::lock_guard<std::mutex> lock(mutex_);
         message_buffer_.resize(size);
+        reportMemory();
     }
 
     void setLogToSystem(std::string ident = "aiscatcher");
 
     void setMinLevel(LogLevel level) { min_level_ = level; }
     LogLevel getMinLevel() const { return min_level_; }
+    bool isEnabled(LogLevel level) const { return level >= min_level_; }
+
+    // from startDispatcher on, log() only queues the message and listeners run on a dispatcher thread;
+    // errors and critical messages wait until they have been delivered
+    void startDispatcher();
+    void stopDispatcher();
+    void flush(size_t ticket);
+    long getDropped() const { return dropped_; }
 
     Setting &Set(std::string option, std::string arg);
 
@@ -84,21 +98,57 @@ private:
         LogCallback callback;
     };
 
-    std::string getCurrentTime();
-
     std::mutex mutex_;
-    LogLevel min_level_ = LogLevel::__INFO;
+    std::atomic<LogLevel> min_level_{LogLevel::__INFO};
 
     static std::unique_ptr<Logger> instance_;
 
     std::vector<LogMessage> message_buffer_;
     int buffer_position_ = 0;
+    std::size_t memory_reported_ = 0;
+
+    // kept messages for the web viewer, caller holds mutex_
+    void reportMemory()
+    {
+        std::size_t n = message_buffer_.size() * sizeof(LogMessage);
+        for (const auto &m : message_buffer_)
+            n += m.message.capacity() + m.time.capacity();
+        MemoryBudget::account(MemoryBudget::LOG, memory_reported_, n);
+    }
     std::vector<LogListener> log_listeners_;
 
     void storeMessage(const LogMessage &msg);
     void notifyListeners(const LogMessage &msg);
 
     int id = 1;
+
+    // bounded multi-producer ring with a sequence number per slot, a full ring drops the message
+    struct Slot
+    {
+        std::atomic<size_t> seq{0};
+        LogLevel level = LogLevel::__EMPTY;
+        std::string message;
+        std::chrono::system_clock::time_point time;
+    };
+
+    static const size_t RING_SIZE = 1024;
+    std::unique_ptr<Slot[]> ring_;
+    std::atomic<size_t> enqueue_pos_{0};
+    size_t dequeue_pos_ = 0;
+
+    bool async_ = true;
+    std::thread dispatcher_;
+    std::atomic<bool> running_{false}, stop_{false}, dispatcher_waiting_{false};
+    std::atomic<size_t> delivered_{0};
+    std::atomic<long> dropped_{0};
+    long reported_dropped_ = 0;
+    std::mutex wait_mutex_;
+    std::condition_variable cv_work_, cv_done_;
+
+    bool push(LogLevel level, const std::string &message, size_t &ticket);
+    bool pop(LogMessage &msg);
+    void dispatch();
+    static std::string formatTime(std::chrono::system_clock::time_point now);
 };
 
 class LogStream
@@ -113,17 +163,20 @@ public:
     LogStream(LogStream &&) = default;
     LogStream &operator=(LogStream &&) = default;
 
+    // nothing is formatted for a level below the minimum of the logger
     template <typename T>
     LogStream &operator<<(const T &msg)
     {
-        (*stream_) << msg;
+        if (stream_)
+            (*stream_) << msg;
         return *this;
     }
 
     typedef std::ostream &(*Manipulator)(std::ostream &);
     LogStream &operator<<(Manipulator manip)
     {
-        manip(*stream_);
+        if (stream_)
+            manip(*stream_);
         return *this;
     }
 
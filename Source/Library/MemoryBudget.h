@@ -0,0 +1,123 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// Memory budget for the tables, buffers and caches (-J), each subsystem takes a fixed share of it. Without
+// a budget the subsystems keep their defaults, builds for small boards (ARMV6) come with a budget set.
+// The subsystems report the memory they hold, whether or not a budget is set. The queues and the log
+// are only accounted, what the heap holds beyond all parts is reported as unattributed.
+
+class MemoryBudget
+{
+public:
+	enum Part
+	{
+		SHIPS = 0, // ship table, paths and message buffer, per web server
+		PLANES,	   // plane table and trails, per web server
+		FIFO,	   // sample buffer, per input
+		CLIENTS,   // output queues of TCP clients, per client a quarter
+		CACHE,	   // response cache, per web server
+		QUEUES,	   // queued messages of async outputs and database writers, accounted only
+		LOG,	   // log messages kept for the web viewer, accounted only
+		COUNT
+	};
+
+	static void set(std::size_t bytes) { budget() = bytes; }
+	static std::size_t get() { return budget(); }
+	static bool isSet() { return budget() != 0; }
+
+	// the share of the budget for a part, or def without a budget
+	static std::size_t limit(Part p, std::size_t def)
+	{
+		static const int share[COUNT] = {40, 20, 25, 10, 5, 0, 0};
+		return isSet() ? get() / 100 * share[p] : def;
+	}
+
+	static const char *name(Part p)
+	{
+		static const char *names[COUNT] = {"ships", "planes", "fifo", "clients", "cache", "queues", "log"};
+		return names[p];
+	}
+
+	static void add(Part p, int64_t bytes) { counters()[p].fetch_add(bytes, std::memory_order_relaxed); }
+	static uint64_t getUsage(Part p) { return (uint64_t)counters()[p].load(std::memory_order_relaxed); }
+
+	static uint64_t getTotal()
+	{
+		uint64_t n = 0;
+		for (int i = 0; i < COUNT; i++)
+			n += getUsage((Part)i);
+		return n;
+	}
+
+	// bytes in use on the heap, 0 where the C library does not tell
+	static uint64_t getHeap()
+	{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+		struct mallinfo2 mi = mallinfo2();
+		return (uint64_t)mi.uordblks + (uint64_t)mi.hblkhd;
+#else
+		return 0;
+#endif
+	}
+
+	// moves the usage of one holder from reported to bytes
+	static void account(Part p, std::size_t &reported, std::size_t bytes)
+	{
+		add(p, (int64_t)bytes - (int64_t)reported);
+		reported = bytes;
+	}
+
+	static std::string toPrometheus()
+	{
+		std::string s = "# HELP ais_memory_budget_bytes Memory budget for tables, buffers and caches, 0 if not set\n# TYPE ais_memory_budget_bytes gauge\n";
+		s += "ais_memory_budget_bytes " + std::to_string(get()) + "\n";
+		s += "# HELP ais_memory_bytes Memory held by subsystem\n# TYPE ais_memory_bytes gauge\n";
+		for (int i = 0; i < COUNT; i++)
+			s += "ais_memory_bytes{part=\"" + std::string(name((Part)i)) + "\"} " + std::to_string(getUsage((Part)i)) + "\n";
+		s += "# HELP ais_memory_heap_bytes Bytes in use on the heap, 0 if not available\n# TYPE ais_memory_heap_bytes gauge\n";
+		s += "ais_memory_heap_bytes " + std::to_string(getHeap()) + "\n";
+		return s;
+	}
+
+private:
+	static std::size_t &budget()
+	{
+#ifdef MEMORY_BUDGET_MB
+		static std::size_t b = (std::size_t)MEMORY_BUDGET_MB << 20;
+#else
+		static std::size_t b = 0;
+#endif
+		return b;
+	}
+
+	static std::atomic<int64_t> *counters()
+	{
+		static std::atomic<int64_t> c[COUNT];
+		return c;
+	}
+};
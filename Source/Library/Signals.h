@@ -23,7 +23,8 @@
 enum class DecoderSignals {
 	StopTraining,
 	StartTraining,
-	Reset
+	Reset,
+	CRCError
 };
 enum class SystemSignal {
 	Stop
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 
@@ -37,6 +38,15 @@ public:
 	void setGroupsIn(uint64_t g) { groups_in = g; }
 };
 
+// optional for receivers that can pass over samples without per-sample work,
+// Skip returns how many leading samples of data were consumed (0 if none)
+template <typename T>
+class StreamSkip {
+public:
+	virtual ~StreamSkip() {}
+	virtual int Skip(const T* data, int len) { return 0; }
+};
+
 template <typename S>
 class Connection {
 	std::vector<StreamIn<S>*> connections;
@@ -65,10 +75,16 @@ public:
 		connections.push_back(s);
 	}
 
+	// removes all connections to s, the sender must not be running or hold a lock that excludes it
+	void Disconnect(StreamIn<S>* s) {
+		connections.erase(std::remove(connections.begin(), connections.end(), s), connections.end());
+	}
+
 	void setGroupOut(uint32_t g) { groups = g; }
 	uint64_t getGroupOut() { return groups; }
 	bool canConnect(uint64_t m) { return (groups & m) > 0; }
 	bool isConnected() { return connections.size() > 0; }
+	const std::vector<StreamIn<S>*>& getConnections() const { return connections; }
 	void clear() { connections.resize(0); }
 };
 
@@ -0,0 +1,117 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+// List of strings that keeps the strings it held after clear(), so that refilling it or assigning
+// another list of similar lines to it reuses their buffers instead of allocating.
+
+class StringList
+{
+	std::vector<std::string> items;
+	int n = 0;
+
+public:
+	typedef std::vector<std::string>::const_iterator const_iterator;
+
+	StringList() {}
+	StringList(const StringList &o) : items(o.begin(), o.end()), n(o.n) {}
+
+	StringList &operator=(const StringList &o)
+	{
+		if (this != &o)
+		{
+			if ((int)items.size() < o.n)
+				items.resize(o.n);
+
+			for (int i = 0; i < o.n; i++)
+				items[i].assign(o.items[i]);
+
+			n = o.n;
+		}
+		return *this;
+	}
+
+	const_iterator begin() const { return items.begin(); }
+	const_iterator end() const { return items.begin() + n; }
+
+	int size() const { return n; }
+	bool empty() const { return n == 0; }
+	void clear() { n = 0; }
+
+	const std::string &operator[](int i) const { return items[i]; }
+	const std::string &back() const { return items[n - 1]; }
+
+	void push_back(const std::string &s) { append().assign(s); }
+	void push_back(const char *s, int len) { append().assign(s, len); }
+
+	// next string of the list, with the contents of the string that last held this place
+	std::string &append()
+	{
+		if (n == (int)items.size())
+			items.emplace_back();
+		return items[n++];
+	}
+};
+
+// Free list of objects so the buffers inside them are reused, for objects that are in flight between
+// threads or stages. get() returns a recycled object or a new one, put() hands it back.
+
+template <typename T>
+class ObjectPool
+{
+	std::vector<std::unique_ptr<T>> free;
+	std::mutex mtx;
+	int limit;
+
+public:
+	ObjectPool(int max = 1024) : limit(max) {}
+
+	std::unique_ptr<T> get()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+
+			if (!free.empty())
+			{
+				std::unique_ptr<T> p = std::move(free.back());
+				free.pop_back();
+				return p;
+			}
+		}
+		return std::unique_ptr<T>(new T());
+	}
+
+	void put(std::unique_ptr<T> p)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if ((int)free.size() < limit && p)
+			free.push_back(std::move(p));
+	}
+
+	int getFree()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return (int)free.size();
+	}
+};
@@ -0,0 +1,96 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Returns from the blocking waits of the threads, by kind of thread. On an idle station every
+// wake-up is a thread that runs without work, which costs power on battery or solar supplies.
+
+class Wakeups
+{
+public:
+	enum Source
+	{
+		FIFO = 0,
+		SERVER,
+		OUTPUT,
+		SERVICE,
+		CLOCK,
+		COUNT
+	};
+
+	static void add(Source s) { counters()[s].fetch_add(1, std::memory_order_relaxed); }
+	static uint64_t get(Source s) { return counters()[s].load(std::memory_order_relaxed); }
+
+	static uint64_t total()
+	{
+		uint64_t n = 0;
+		for (int s = 0; s < COUNT; s++)
+			n += get((Source)s);
+		return n;
+	}
+
+	static const char *name(Source s)
+	{
+		static const char *names[COUNT] = {"fifo", "server", "output", "service", "clock"};
+		return names[s];
+	}
+
+	// wake-ups per second since the previous call that was at least a second ago
+	static float getRate()
+	{
+		static std::mutex mtx;
+		static auto last = std::chrono::steady_clock::now();
+		static uint64_t last_total = 0;
+		static float rate = 0;
+
+		std::lock_guard<std::mutex> lock(mtx);
+
+		auto now = std::chrono::steady_clock::now();
+		float dt = std::chrono::duration<float>(now - last).count();
+
+		if (dt >= 1.0f)
+		{
+			uint64_t n = total();
+			rate = (n - last_total) / dt;
+			last_total = n;
+			last = now;
+		}
+		return rate;
+	}
+
+	static std::string toPrometheus()
+	{
+		std::string s = "# HELP ais_wakeups_total Returns from blocking waits by kind of thread\n# TYPE ais_wakeups_total counter\n";
+		for (int i = 0; i < COUNT; i++)
+			s += "ais_wakeups_total{source=\"" + std::string(name((Source)i)) + "\"} " + std::to_string(get((Source)i)) + "\n";
+		return s;
+	}
+
+private:
+	static std::atomic<uint64_t> *counters()
+	{
+		static std::atomic<uint64_t> c[COUNT];
+		return c;
+	}
+};
@@ -27,16 +27,42 @@
 #define GZIP_ENCODING 16
 #endif
 
+#ifdef HASZSTD
+#include <zstd.h>
+#endif
+
+// gzip of a whole buffer, the deflate state is set up once and reset for every next call
 class ZIP
 {
 
 #ifdef HASZLIB
 	z_stream strm;
+	bool initialized = false;
 #endif
 
 	std::vector<unsigned char> output;
 
 public:
+	ZIP() {}
+	// the deflate state points back to strm
+	ZIP(const ZIP &) = delete;
+	ZIP &operator=(const ZIP &) = delete;
+
+	~ZIP()
+	{
+#ifdef HASZLIB
+		if (initialized)
+			deflateEnd(&strm);
+#endif
+	}
+
+	// a context per thread for the places that compress now and then
+	static ZIP &local()
+	{
+		static thread_local ZIP zip;
+		return zip;
+	}
+
 	static bool installed()
 	{
 #ifdef HASZLIB
@@ -60,11 +86,18 @@ public:
 
 		try
 		{
-			strm.zalloc = Z_NULL;
-			strm.zfree = Z_NULL;
-			strm.opaque = Z_NULL;
+			if (!initialized)
+			{
+				strm.zalloc = Z_NULL;
+				strm.zfree = Z_NULL;
+				strm.opaque = Z_NULL;
 
-			if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits | GZIP_ENCODING, 8, Z_DEFAULT_STRATEGY) < 0)
+				if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits | GZIP_ENCODING, 8, Z_DEFAULT_STRATEGY) < 0)
+					return false;
+
+				initialized = true;
+			}
+			else if (deflateReset(&strm) != Z_OK)
 				return false;
 
 			strm.next_in = (unsigned char *)data;
@@ -77,7 +110,6 @@ public:
 			strm.next_out = (unsigned char *)output.data();
 
 			int result = deflate(&strm, Z_FINISH);
-			deflateEnd(&strm);
 
 			if (result != Z_STREAM_END)
 				throw std::runtime_error("ZLIB: deflate did not complete");
@@ -94,4 +126,186 @@ public:
 		return false;
 #endif
 	}
-};
\ No newline at end of file
+};
+
+// zstd of a whole buffer, the context is kept between calls
+class ZSTD
+{
+#ifdef HASZSTD
+	ZSTD_CCtx *ctx = nullptr;
+#endif
+	// the zstd default, several times faster than deflate at a similar ratio for JSON
+	static const int LEVEL = 3;
+
+	std::vector<unsigned char> output;
+
+public:
+	ZSTD() {}
+	ZSTD(const ZSTD &) = delete;
+	ZSTD &operator=(const ZSTD &) = delete;
+
+	~ZSTD()
+	{
+#ifdef HASZSTD
+		ZSTD_freeCCtx(ctx);
+#endif
+	}
+
+	static bool installed()
+	{
+#ifdef HASZSTD
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static ZSTD &local()
+	{
+		static thread_local ZSTD zstd;
+		return zstd;
+	}
+
+	size_t getOutputLength() const { return output.size(); }
+	const char *getOutputPtr() const { return (const char *)output.data(); }
+
+	bool zip(const std::string &input)
+	{
+		return zip(input.c_str(), input.length());
+	}
+
+	bool zip(const char *data, int len)
+	{
+#ifdef HASZSTD
+		if (!ctx && !(ctx = ZSTD_createCCtx()))
+			return false;
+
+		output.resize(ZSTD_compressBound(len));
+
+		size_t n = ZSTD_compressCCtx(ctx, output.data(), output.size(), data, len, LEVEL);
+		if (ZSTD_isError(n))
+		{
+			output.clear();
+			return false;
+		}
+
+		output.resize(n);
+		return true;
+#else
+		return false;
+#endif
+	}
+};
+
+// gzip stream that is compressed incrementally as data is added
+class ZIPStream
+{
+#ifdef HASZLIB
+	z_stream strm;
+#endif
+	bool active = false;
+	std::string output;
+	// compressed bytes in output that were not taken yet
+	std::size_t used = 0;
+
+	bool deflateAll(const char *data, int len, int flush)
+	{
+#ifdef HASZLIB
+		strm.next_in = (unsigned char *)data;
+		strm.avail_in = len;
+
+		do
+		{
+			if (output.size() - used < 1024)
+				output.resize(output.size() + 16384);
+
+			strm.next_out = (unsigned char *)&output[used];
+			strm.avail_out = output.size() - used;
+
+			int result = deflate(&strm, flush);
+			used = output.size() - strm.avail_out;
+
+			if (result == Z_STREAM_ERROR)
+				return false;
+
+			if (flush == Z_FINISH && result == Z_STREAM_END)
+				break;
+
+		} while (strm.avail_in > 0 || strm.avail_out == 0 || flush == Z_FINISH);
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+public:
+	~ZIPStream() { clear(); }
+
+	bool empty() const { return !active; }
+
+	bool add(const std::string &data) { return add(data.c_str(), data.length()); }
+
+	bool add(const char *data, int len)
+	{
+#ifdef HASZLIB
+		if (!active)
+		{
+			strm.zalloc = Z_NULL;
+			strm.zfree = Z_NULL;
+			strm.opaque = Z_NULL;
+
+			if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits | GZIP_ENCODING, 8, Z_DEFAULT_STRATEGY) < 0)
+				return false;
+
+			output.clear();
+			used = 0;
+			active = true;
+		}
+
+		return deflateAll(data, len, Z_NO_FLUSH);
+#else
+		return false;
+#endif
+	}
+
+	// moves the compressed data produced so far into out, the stream continues
+	void take(std::string &out)
+	{
+		out.assign(output.data(), used);
+		used = 0;
+	}
+
+	// completes the stream and moves the compressed data into out
+	bool finish(std::string &out)
+	{
+#ifdef HASZLIB
+		if (!active)
+			return false;
+
+		bool ok = deflateAll(nullptr, 0, Z_FINISH);
+
+		output.resize(used);
+		deflateEnd(&strm);
+		active = false;
+
+		out.swap(output);
+		output.clear();
+
+		return ok;
+#else
+		return false;
+#endif
+	}
+
+	void clear()
+	{
+#ifdef HASZLIB
+		if (active)
+			deflateEnd(&strm);
+#endif
+		active = false;
+		output.clear();
+		used = 0;
+	}
+};
@@ -51,15 +51,12 @@ namespace AIS
 		}
 	}
 
+	// the CRC is updated as bits are stored in DATAFCS, crc[i] holds the CRC over the first i bits
 	bool Decoder::CRC16(int len)
 	{
-		const uint16_t checksum = ~0x0F47, poly = 0x8408;
-		uint16_t CRC = 0xFFFF;
+		const uint16_t checksum = ~0x0F47;
 
-		for (int i = 0; i < len; i++)
-			CRC = ((uint16_t)msg.getBit(i) ^ CRC) & 1 ? (CRC >> 1) ^ poly : CRC >> 1;
-
-		return CRC == checksum;
+		return crc[len] == checksum;
 	}
 
 	bool Decoder::processData(int len, TAG &tag)
@@ -73,7 +70,10 @@ namespace AIS
 			if (tag.mode & 1 && tag.level != 0.0)
 				tag.level = 10.0f * log10(tag.level);
 			if (tag.mode & 2)
+			{
 				msg.Stamp();
+				msg.setRxTimeMicros(sample_clock.getMicros(start_idx, tag.sample_idx));
+			}
 
 			// Populate Byte array and send msg, exclude 16 FCS bits
 			msg.setChannel(channel);
@@ -85,6 +85,9 @@ namespace AIS
 			if (msg.validate())
 			{
 				msg.buildNMEA(tag);
+
+				tag.decode_us = Util::Clock::steady();
+				tag.json_us = 0;
 				Send(&msg, 1, tag);
 			}
 			else
@@ -141,8 +144,94 @@ namespace AIS
 		return false;
 	}
 
+	static inline int lowestBit(uint64_t w)
+	{
+		int i = 0;
+		while (!(w & 1))
+		{
+			w >>= 1;
+			i++;
+		}
+		return i;
+	}
+
+	// fast-forwards through TRAINING without running the state machine per bit. The bits are packed in
+	// words and alternations are found as d[i] ^ d[i-2]; a repeat after more than MIN_TRAINING_BITS
+	// alternations is a candidate start flag. The last samples before a candidate (or the end of the block)
+	// are left to Receive so that Reset signals during the skip do not change the outcome.
+	int Decoder::Skip(const FLOAT32 *data, int len)
+	{
+		const int margin = MIN_TRAINING_BITS + 1;
+
+		if (state != State::TRAINING || len <= margin || hold > 0)
+			return 0;
+
+		const BIT d_1 = prev, d_2 = prev ^ !lastBit;
+
+		// bit 0 and 1 hold the two samples before the word, the alternations before the block count as set bits
+		uint64_t hist = (uint64_t)d_2 | (uint64_t)d_1 << 1;
+		uint64_t E_prev = position == 0 ? 0 : ~(uint64_t)0 << (64 - std::min(position, margin));
+		int end = len;
+
+		for (int w = 0; w < len; w += 64)
+		{
+			const int n = std::min(64, len - w);
+
+			uint64_t D = 0;
+			for (int i = 0; i < n; i++)
+				D |= (uint64_t)(data[w + i] > 0) << i;
+
+			uint64_t E = D ^ (D << 2 | hist);
+			uint64_t run = ~(uint64_t)0;
+
+			for (int k = 1; k <= margin; k++)
+				run &= E << k | E_prev >> (64 - k);
+
+			uint64_t cand = ~E & run;
+			if (n < 64)
+				cand &= ((uint64_t)1 << n) - 1;
+
+			if (cand)
+			{
+				end = w + lowestBit(cand);
+				break;
+			}
+
+			E_prev = E;
+			hist = D >> 62;
+		}
+
+		const int m = end - margin;
+		if (m <= 0)
+		{
+			hold = end;
+			return 0;
+		}
+
+		auto bit = [&](int i) -> BIT { return i >= 0 ? (BIT)(data[i] > 0) : (i == -1 ? d_1 : d_2); };
+
+		int run = 0, i = m - 1;
+		while (i >= 0 && (bit(i) ^ bit(i - 2)))
+		{
+			run++;
+			i--;
+		}
+
+		position = i < 0 ? position + run : run;
+		lastBit = !(bit(m - 1) ^ bit(m - 2));
+		prev = bit(m - 1);
+
+		return m;
+	}
+
 	void Decoder::Receive(const FLOAT32 *data, int len, TAG &tag)
 	{
+		// all decoders of a model see their first samples in the same block and share the anchor
+		if (!sample_clock.isAnchored())
+			sample_clock.anchor(tag.sample_idx);
+
+		hold = std::max(0, hold - len);
+
 		for (int i = 0; i < len; i++)
 		{
 			// NRZI
@@ -178,6 +267,7 @@ namespace AIS
 					{
 						NextState(State::DATAFCS, 0); // 0111111*0....
 						level = 0.0f;
+						crc[0] = 0xFFFF;
 					}
 					else
 						NextState(State::TRAINING, 0);
@@ -192,7 +282,9 @@ namespace AIS
 				break;
 			case State::DATAFCS:
 
-				msg.setBit(position++, Bit);
+				msg.setBit(position, Bit);
+				crc[position + 1] = (Bit ^ crc[position]) & 1 ? (crc[position] >> 1) ^ CRC_POLY : crc[position] >> 1;
+				position++;
 
 				// add power of signal of bit length
 				if (tag.mode & 1)
@@ -207,6 +299,8 @@ namespace AIS
 						end_idx = tag.sample_idx;
 						if (processData(position - 7, tag))
 							NextState(State::FOUNDMESSAGE, 0);
+						else if (position - 7 >= MIN_CRC_BITS)
+							DecoderMessage.Send(DecoderSignals::CRCError);
 						NextState(State::TRAINING, 0);
 					}
 					else
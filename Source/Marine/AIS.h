@@ -35,7 +35,7 @@ namespace AIS
 		FOUNDMESSAGE
 	};
 
-	class Decoder : public SimpleStreamInOut<FLOAT32, Message>, public SignalIn<DecoderSignals>
+	class Decoder : public SimpleStreamInOut<FLOAT32, Message>, public SignalIn<DecoderSignals>, public StreamSkip<FLOAT32>
 	{
 		char channel = '?';
 		int station = 0;
@@ -43,6 +43,8 @@ namespace AIS
 
 		const int MaxBits = MAX_AIS_LENGTH;
 		const int MIN_TRAINING_BITS = 4;
+		// frames from this length on that fail the checksum are signalled as CRCError
+		const int MIN_CRC_BITS = 56;
 
 		bool QuickReset = true;
 		State state = State::TRAINING;
@@ -55,8 +57,12 @@ namespace AIS
 
 		int position = 0;
 		int one_seq_count = 0;
+		int hold = 0; // samples before Skip can look for a new candidate
 		FLOAT32 level = 0.0f;
 
+		const uint16_t CRC_POLY = 0x8408;
+		uint16_t crc[MAX_AIS_LENGTH + 1];
+
 		void NextState(State s, int pos);
 
 		bool CRC16(int len);
@@ -69,6 +75,9 @@ namespace AIS
 		long start_idx = 0;
 		long end_idx = 0;
 
+		// wall clock time of start_idx at the precision of the sample clock
+		Util::SampleClock sample_clock;
+
 	public:
 		virtual ~Decoder() {}
 
@@ -80,6 +89,7 @@ namespace AIS
 		}
 
 		void Receive(const FLOAT32 *data, int len, TAG &tag);
+		int Skip(const FLOAT32 *data, int len);
 
 		// MessageIn
 		virtual void Signal(const DecoderSignals &in);
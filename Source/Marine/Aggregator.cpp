@@ -0,0 +1,86 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iomanip>
+#include <sstream>
+
+#include "Aggregator.h"
+#include "Clock.h"
+
+namespace AIS
+{
+	static inline uint32_t slot(uint64_t hash, int bits)
+	{
+		return (uint32_t)((hash * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+	}
+
+	bool Aggregator::accept(const Message &msg, uint64_t group)
+	{
+		uint64_t hash = msg.getHash();
+		int64_t now = Util::Clock::micros();
+
+		std::lock_guard<std::mutex> lock(mtx);
+		Entry &e = table[slot(hash, TABLE_BITS)];
+
+		if (e.hash == hash && now - e.time_us <= window_us)
+		{
+			// a station that repeats its own copy does not add coverage
+			if (e.stations & group)
+				repeated++;
+			else
+				merged++;
+
+			e.stations |= group;
+			return false;
+		}
+
+		e.hash = hash;
+		e.stations = group;
+		e.time_us = now;
+		canonical++;
+		return true;
+	}
+
+	std::string Aggregator::getStatus()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		std::stringstream ss;
+		ss << "canonical: " << canonical << " msgs, merged: " << merged << " msgs, repeated: " << repeated << " msgs";
+		if (canonical)
+			ss << ", stations per msg: " << std::fixed << std::setprecision(2) << (double)(canonical + merged) / canonical;
+
+		return ss.str();
+	}
+
+	std::string Aggregator::getPrometheus()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		std::string element;
+		element += "# HELP ais_aggregator_canonical Messages passed on as the first copy of a transmission\n";
+		element += "# TYPE ais_aggregator_canonical counter\n";
+		element += "ais_aggregator_canonical " + std::to_string(canonical) + "\n";
+		element += "# HELP ais_aggregator_merged Copies from other stations merged into an earlier copy and not decoded\n";
+		element += "# TYPE ais_aggregator_merged counter\n";
+		element += "ais_aggregator_merged " + std::to_string(merged) + "\n";
+		element += "# HELP ais_aggregator_repeated Copies repeated by a station that already reported the transmission\n";
+		element += "# TYPE ais_aggregator_repeated counter\n";
+		element += "ais_aggregator_repeated " + std::to_string(repeated) + "\n";
+		return element;
+	}
+}
@@ -0,0 +1,65 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Message.h"
+
+// Merges the copies of one transmission that arrive through several inputs (stations) before they
+// are decoded to JSON. A copy is identified by the message hash (mmsi, channel, type and payload) and
+// counts as the same transmission when it arrives within the window after the first one. The first
+// copy is canonical and is passed on, later copies only add their output group to its station bitmap.
+// The table is direct mapped, a collision replaces the older entry which at worst lets a copy through.
+
+namespace AIS
+{
+	class Aggregator
+	{
+		struct Entry
+		{
+			uint64_t hash = 0;
+			uint64_t stations = 0;
+			int64_t time_us = 0;
+		};
+
+		static const int TABLE_BITS = 14;
+
+		std::vector<Entry> table;
+		std::mutex mtx;
+
+		int64_t window_us = 2000000;
+
+		uint64_t canonical = 0, merged = 0, repeated = 0;
+
+	public:
+		Aggregator() : table(1 << TABLE_BITS) {}
+
+		void setWindow(int ms) { window_us = (int64_t)ms * 1000; }
+		int getWindow() { return (int)(window_us / 1000); }
+
+		// true for the canonical copy, false if the message merged into an earlier copy
+		bool accept(const Message &msg, uint64_t group);
+
+		std::string getStatus();
+		std::string getPrometheus();
+	};
+}
@@ -0,0 +1,192 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "Merge.h"
+#include "Clock.h"
+#include "Wakeups.h"
+
+namespace AIS
+{
+	MessageMerge::MessageMerge(int size) : items(size)
+	{
+		heap.reserve(size);
+		spare.reserve(size);
+		for (int i = size - 1; i >= 0; i--)
+			spare.push_back(i);
+	}
+
+	void MessageMerge::push(Connection<Message> &out, const Message &msg, const TAG &tag)
+	{
+		int64_t now = Util::Clock::micros();
+
+		std::unique_lock<std::mutex> lock(mtx);
+
+		if (spare.empty())
+		{
+			blocked++;
+			cv_space.wait(lock, [this]
+						  { return !spare.empty() || stopping; });
+		}
+
+		if (stopping)
+		{
+			lock.unlock();
+			std::lock_guard<std::mutex> l(*downstream);
+			Message m = msg;
+			TAG t = tag;
+			out.Send(&m, 1, t);
+			return;
+		}
+
+		int i = spare.back();
+		spare.pop_back();
+
+		Item &item = items[i];
+		item.out = &out;
+		item.msg = msg;
+		item.tag = tag;
+		item.time_us = msg.getRxTimeMicros() ? msg.getRxTimeMicros() : now;
+		item.due_us = Util::Clock::steady() + window_us;
+
+		if (item.time_us < last_in)
+			reordered++;
+		else
+			last_in = item.time_us;
+
+		heap.push_back(i);
+		std::push_heap(heap.begin(), heap.end(), [this](int a, int b)
+					   { return later(a, b); });
+
+		merged++;
+		depth_max = std::max(depth_max, (int)heap.size());
+
+		cv_data.notify_one();
+	}
+
+	void MessageMerge::loop()
+	{
+		auto order = [this](int a, int b)
+		{ return later(a, b); };
+
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			if (heap.empty())
+			{
+				if (stopping)
+					break;
+
+				cv_data.wait(lock);
+				Wakeups::add(Wakeups::OUTPUT);
+				continue;
+			}
+
+			// the earliest message waits until it is window old, unless we are stopping
+			int64_t wait = items[heap.front()].due_us - Util::Clock::steady();
+
+			if (wait > 0 && !stopping)
+			{
+				cv_data.wait_for(lock, std::chrono::microseconds(wait));
+				Wakeups::add(Wakeups::OUTPUT);
+				continue;
+			}
+
+			std::pop_heap(heap.begin(), heap.end(), order);
+			int i = heap.back();
+			heap.pop_back();
+
+			Item &item = items[i];
+
+			if (item.time_us < last_out)
+				late++;
+			else
+				last_out = item.time_us;
+
+			// the slot is not reused before it is back on the free list
+			lock.unlock();
+			{
+				std::lock_guard<std::mutex> l(*downstream);
+				item.out->Send(&item.msg, 1, item.tag);
+			}
+			lock.lock();
+
+			spare.push_back(i);
+			cv_space.notify_one();
+		}
+	}
+
+	void MessageMerge::start(std::mutex &d)
+	{
+		downstream = &d;
+
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = false;
+
+		if (!worker.joinable())
+			worker = std::thread(&MessageMerge::loop, this);
+	}
+
+	void MessageMerge::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+			cv_data.notify_one();
+			cv_space.notify_all();
+		}
+
+		if (worker.joinable())
+			worker.join();
+	}
+
+	std::string MessageMerge::getStatus()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		std::stringstream ss;
+		ss << "merged: " << merged << " msgs, reordered: " << reordered << " msgs, late: " << late << " msgs, max depth: " << depth_max;
+		if (blocked)
+			ss << ", full: " << blocked << " times";
+
+		return ss.str();
+	}
+
+	std::string MessageMerge::getPrometheus()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		std::string element;
+		element += "# HELP ais_merge_messages Messages passed through the time ordered merge of the receivers\n";
+		element += "# TYPE ais_merge_messages counter\n";
+		element += "ais_merge_messages " + std::to_string(merged) + "\n";
+		element += "# HELP ais_merge_reordered Messages that arrived after a later message and were put back in order\n";
+		element += "# TYPE ais_merge_reordered counter\n";
+		element += "ais_merge_reordered " + std::to_string(reordered) + "\n";
+		element += "# HELP ais_merge_late Messages that arrived too late for the window and were passed on out of order\n";
+		element += "# TYPE ais_merge_late counter\n";
+		element += "ais_merge_late " + std::to_string(late) + "\n";
+		element += "# HELP ais_merge_full Times a receiver waited because all slots of the merge were taken\n";
+		element += "# TYPE ais_merge_full counter\n";
+		element += "ais_merge_full " + std::to_string(blocked) + "\n";
+		return element;
+	}
+}
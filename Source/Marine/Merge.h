@@ -0,0 +1,86 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Stream.h"
+#include "Message.h"
+
+// Merges the decoded messages of all receivers into one stream ordered by reception time. The time is
+// the sample clock of the message, or the arrival for inputs without one. A message is held until it
+// is window old, so a copy from a slower receiver still comes out in order, and is then passed on by
+// one thread to the output of the model it came from. The aggregator and the JSON decoding downstream
+// thus see the copies of a transmission in time order and are not entered by several threads at once.
+
+namespace AIS
+{
+	class MessageMerge
+	{
+		struct Item
+		{
+			Connection<Message> *out = nullptr;
+			Message msg;
+			TAG tag;
+			int64_t time_us = 0, due_us = 0;
+		};
+
+		// slots are recycled so the messages keep their allocations, the heap orders them by time
+		std::vector<Item> items;
+		std::vector<int> heap, spare;
+
+		std::mutex mtx;
+		std::mutex *downstream = nullptr;
+		std::condition_variable cv_data, cv_space;
+		std::thread worker;
+		bool stopping = false;
+
+		int64_t window_us = 100000;
+		int64_t last_in = 0, last_out = 0;
+
+		uint64_t merged = 0, reordered = 0, late = 0, blocked = 0;
+		int depth_max = 0;
+
+		// heap order, the earliest message on top
+		bool later(int a, int b) const { return items[a].time_us > items[b].time_us; }
+		void loop();
+
+	public:
+		MessageMerge(int size = 4096);
+		~MessageMerge() { stop(); }
+
+		void setWindow(int ms) { window_us = (int64_t)ms * 1000; }
+		int getWindow() { return (int)(window_us / 1000); }
+
+		// from the model threads, waits if all slots are taken
+		void push(Connection<Message> &out, const Message &msg, const TAG &tag);
+
+		// downstream is held while a message is passed on, for the paths that bypass the merge
+		void start(std::mutex &downstream);
+		// passes on what is held and ends the thread
+		void stop();
+
+		std::string getStatus();
+		std::string getPrometheus();
+	};
+}
@@ -15,14 +15,19 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cstdlib>
+
 #include "Message.h"
 #include "Parse.h"
 #include "Helper.h"
+#include "Convert.h"
 
 namespace AIS
 {
 
 	int Message::ID = 0;
+	const int Message::MAX_NMEA_CHARS;
 
 	static int NMEAchecksum(const std::string &s)
 	{
@@ -79,60 +84,96 @@ namespace AIS
 
 	std::string Message::getNMEAJSON(unsigned mode, float level, float ppm, int status, const std::string &hardware, int version, Type driver, bool include_ssl, uint32_t ipv4, const std::string &uuid) const
 	{
-		std::stringstream ss;
+		using Util::Convert;
+
+		std::string s;
+		s.reserve(256);
 
-		ss << "{\"class\":\"AIS\",\"device\":\"AIS-catcher\",\"version\":" << version << ",\"driver\":" << (int)driver << ",\"hardware\":\"" << hardware << "\",\"channel\":\"" << getChannel() << "\",\"repeat\":" << repeat();
+		s += "{\"class\":\"AIS\",\"device\":\"AIS-catcher\",\"version\":";
+		Convert::appendInt(s, version);
+		s += ",\"driver\":";
+		Convert::appendInt(s, (int)driver);
+		s += ",\"hardware\":\"" + hardware + "\",\"channel\":\"";
+		s += getChannel();
+		s += "\",\"repeat\":";
+		Convert::appendInt(s, repeat());
 
 		if (include_ssl)
-			ss << ",\"ssc\":" << start_idx << ",\"sl\":" << (end_idx - start_idx);
+		{
+			s += ",\"ssc\":";
+			Convert::appendInt(s, start_idx);
+			s += ",\"sl\":";
+			Convert::appendInt(s, end_idx - start_idx);
+			if (rxtime_us)
+			{
+				s += ",\"rxtime_us\":";
+				Convert::appendInt(s, rxtime_us);
+			}
+		}
 
 		if (status)
 		{
-			ss << ",\"msg_status\":" << status;
+			s += ",\"msg_status\":";
+			Convert::appendInt(s, status);
 		}
 
 		if (mode & 2)
 		{
-			ss << ",\"rxuxtime\":" << getRxTimeUnix();
-			ss << ",\"rxtime\":\"" << getRxTime() << "\"";
+			s += ",\"rxuxtime\":";
+			Convert::appendInt(s, getRxTimeUnix());
+			s += ",\"rxtime\":\"" + getRxTime() + "\"";
 		}
 
 		if (!uuid.empty())
-			ss << ",\"uuid\":\"" << uuid << "\"";
+			s += ",\"uuid\":\"" + uuid + "\"";
 
 		if (ipv4)
-			ss << ",\"ipv4\":" << ipv4;
+		{
+			s += ",\"ipv4\":";
+			Convert::appendInt(s, ipv4);
+		}
 
 		if (mode & 1)
 		{
-			ss << ",\"signalpower\":";
+			s += ",\"signalpower\":";
 			if (level == LEVEL_UNDEFINED)
-				ss << "null";
+				s += "null";
 			else
-				ss << level;
-			ss << ",\"ppm\":";
+				Convert::appendGeneral(s, level);
+			s += ",\"ppm\":";
 			if (ppm == PPM_UNDEFINED)
-				ss << "null";
+				s += "null";
 			else
-				ss << ppm;
+				Convert::appendGeneral(s, ppm);
 		}
 
 		if (getStation())
-			ss << ",\"station_id\":" << getStation();
+		{
+			s += ",\"station_id\":";
+			Convert::appendInt(s, getStation());
+		}
 
 		if (getLength() > 0)
-			ss << ",\"mmsi\":" << mmsi() << ",\"type\":" << type();
+		{
+			s += ",\"mmsi\":";
+			Convert::appendInt(s, mmsi());
+			s += ",\"type\":";
+			Convert::appendInt(s, type());
+		}
 
-		ss << ",\"nmea\":[";
+		s += ",\"nmea\":[";
 		const char *delim = "";
 		for (const auto &n : NMEA)
 		{
-			ss << delim << "\"" << n << "\"";
+			s += delim;
+			s += '"';
+			s += n;
+			s += '"';
 			delim = ",";
 		}
-		ss << "]}";
+		s += "]}";
 
-		return ss.str();
+		return s;
 	}
 
 	std::string Message::getNMEATagBlock() const
@@ -272,36 +313,27 @@ namespace AIS
 		return true;
 	}
 
+	// big endian load of the 8 bytes starting at p
+	static inline uint64_t window(const uint8_t *p)
+	{
+		uint64_t w;
+		std::memcpy(&w, p, sizeof(w));
+#if defined(_MSC_VER)
+		return _byteswap_uint64(w);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		return w;
+#else
+		return __builtin_bswap64(w);
+#endif
+	}
+
 	unsigned Message::getUint(int start, int len) const
 	{
-		if (start + len > MAX_AIS_LENGTH || start < 0)
+		if (start + len > MAX_AIS_LENGTH || start < 0 || len <= 0)
 			return 0;
 
-		// we start 2nd part of first byte and stop first part of last byte
-		int x = start >> 3, y = start & 7;
-		unsigned u = data[x] & (0xFF >> y);
-		int remaining = len - 8 + y;
-
-		// first byte is last byte
-		if (remaining <= 0)
-		{
-			return u >> (-remaining);
-		}
-		// add full bytes
-		while (remaining >= 8)
-		{
-			u <<= 8;
-			u |= data[++x];
-			remaining -= 8;
-		}
-		// make room for last bits if needed
-		if (remaining > 0)
-		{
-			u <<= remaining;
-			u |= data[++x] >> (8 - remaining);
-		}
-
-		return u;
+		// the window holds at least 57 bits from start, enough for any field up to 32 bits
+		return (unsigned)((window(data + (start >> 3)) << (start & 7)) >> (64 - len));
 	}
 
 	bool Message::setUint(int start, int len, unsigned val)
@@ -346,8 +378,8 @@ namespace AIS
 		const unsigned ones = ~0;
 		unsigned u = getUint(start, len);
 
-		// extend sign bit for the full bit
-		if (u & (1 << (len - 1)))
+		// extend sign bit for the full bit, a 32 bit field has nothing to extend
+		if (len < 32 && (u & (1U << (len - 1))))
 			u |= ones << len;
 
 		return (int)u;
@@ -358,31 +390,73 @@ namespace AIS
 		return setUint(start, len, (unsigned)val);
 	}
 
+	// 0       ->   @ and ends the string
+	// 1 - 31  ->   65+ ( i.e. setting bit 6 )
+	// 32 - 63 ->   32+ ( i.e. doing nothing )
+	static const char SIXBIT[64] = {
+		'@', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
+		'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '[', '\\', ']', '^', '_',
+		' ', '!', '"', '#', '$', '%', '&', '\'', '(', ')', '*', '+', ',', '-', '.', '/',
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ';', '<', '=', '>', '?'};
+
+	// NMEA armoring of 6-bit values: 0 - 39 -> '0' - 'W', 40 - 63 -> '`' - 'w'
+	static const char ARMOR[64] = {
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ';', '<', '=', '>', '?',
+		'@', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
+		'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', '`', 'a', 'b', 'c', 'd', 'e', 'f', 'g',
+		'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w'};
+
+	static const char HEX[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+	// inverse of ARMOR for any input character, same mapping as setLetter
+	static const struct Dearmor
+	{
+		uint8_t value[256];
+
+		Dearmor()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				char c = (char)i;
+				value[i] = (c >= 96 ? c - 56 : c - 48) & 0b00111111;
+			}
+		}
+	} DEARMOR;
+
 	void Message::getText(int start, int len, std::string &str) const
 	{
 		const int end = start + len;
 		str.clear();
 
-		if (end >= MAX_AIS_LENGTH || start < 0)
+		if (end >= MAX_AIS_LENGTH || start < 0 || len <= 0)
 			return;
 
-		while (start < end)
-		{
-			int c = getUint(start, 6);
+		// a trailing partial character is read as a full one, as long as it fits in the message
+		int count = MIN((len + 5) / 6, (MAX_AIS_LENGTH - start) / 6);
 
-			// 0       ->   @ and ends the string
-			// 1 - 31  ->   65+ ( i.e. setting bit 6 )
-			// 32 - 63 ->   32+ ( i.e. doing nothing )
+		char buffer[MAX_AIS_LENGTH / 6 + 1];
+		int n = 0;
 
-			if (!c)
-				break;
-			if (!(c & 32))
-				c |= 64;
+		// eight characters per window load
+		while (n < count)
+		{
+			uint64_t w = window(data + (start >> 3)) << (start & 7);
+			int batch = MIN(8, count - n);
 
-			str += (char)c;
-			start += 6;
+			for (int i = 0; i < batch; i++, w <<= 6)
+			{
+				int c = (int)(w >> 58);
+				if (!c)
+				{
+					str.assign(buffer, n);
+					return;
+				}
+				buffer[n++] = SIXBIT[c];
+			}
+			start += 6 * batch;
 		}
-		return;
+
+		str.assign(buffer, n);
 	}
 
 	void Message::setText(int start, int len, const char *str)
@@ -436,6 +510,8 @@ namespace AIS
 		int nAISletters = (length + 6 - 1) / 6;
 		int nSentences = (nAISletters == 0) ? 1 : (nAISletters + MAX_NMEA_CHARS - 1) / MAX_NMEA_CHARS;
 
+		// longest line, the header up to the sentence count is fixed
+		static thread_local std::string line = "!AIVDM,X,X,X,X," + std::string(MAX_NMEA_CHARS, '.') + ",X*XX\n\r";
 		line.resize(11);
 
 		line[IDX_OWN_MMSI] = own_mmsi == mmsi() ? 'O' : 'M';
@@ -459,19 +535,28 @@ namespace AIS
 		for (int s = 0, l = 0; s < nSentences; s++)
 		{
 
-			line.resize(header);
+			int n = MIN(nAISletters - l, MAX_NMEA_CHARS);
+
+			// payload, fill bits and checksum are written in one pass over the line
+			line.resize(header + n + 5);
 			line[IDX_NUMBER]++;
 
-			for (int i = 0; l < nAISletters && i < MAX_NMEA_CHARS; i++, l++)
-				line += getLetter(l);
+			int c = 0;
+			for (int i = 1; i < header; i++)
+				c ^= line[i];
 
-			line += comma;
-			line += (char)(((s == nSentences - 1) ? nAISletters * 6 - length : 0) + '0');
+			char *p = &line[header];
+			c ^= getLetters(l, n, p);
+			l += n;
+			p += n;
 
-			int c = NMEAchecksum(line);
-			line += '*';
-			line += (c >> 4) < 10 ? (c >> 4) + '0' : (c >> 4) + 'A' - 10;
-			line += (c & 0xF) < 10 ? (c & 0xF) + '0' : (c & 0xF) + 'A' - 10;
+			*p++ = comma;
+			*p = (char)(((s == nSentences - 1) ? nAISletters * 6 - length : 0) + '0');
+			c ^= comma ^ *p++;
+
+			*p++ = '*';
+			*p++ = HEX[c >> 4];
+			*p = HEX[c & 0xF];
 			NMEA.push_back(line);
 		}
 	}
@@ -499,6 +584,60 @@ namespace AIS
 		return l < 40 ? (char)(l + 48) : (char)(l + 56);
 	}
 
+	int Message::getLetters(int pos, int n, char *out) const
+	{
+		int check = 0;
+
+		// eight letters per window load
+		for (int i = 0; i < n;)
+		{
+			const int start = (pos + i) * 6;
+			uint64_t w = window(data + (start >> 3)) << (start & 7);
+			int batch = MIN(8, n - i);
+
+			for (int j = 0; j < batch; j++, i++, w <<= 6)
+			{
+				out[i] = ARMOR[w >> 58];
+				check ^= out[i];
+			}
+		}
+
+		// the last letter might run past the length or the buffer, getLetter takes care of that
+		if (n > 0 && (pos + n) * 6 > length)
+		{
+			check ^= out[n - 1];
+			out[n - 1] = getLetter(pos + n - 1);
+			check ^= out[n - 1];
+		}
+
+		return check;
+	}
+
+	void Message::appendLetters(const char *s, int n)
+	{
+		int i = 0;
+
+		// letter by letter up to a 24 bit boundary, then four letters make three bytes
+		while (i < n && length % 24 != 0)
+			appendLetter(s[i++]);
+
+		while (n - i >= 4 && length + 24 <= MAX_AIS_LENGTH)
+		{
+			uint32_t v = (DEARMOR.value[(uint8_t)s[i]] << 18) | (DEARMOR.value[(uint8_t)s[i + 1]] << 12) | (DEARMOR.value[(uint8_t)s[i + 2]] << 6) | DEARMOR.value[(uint8_t)s[i + 3]];
+
+			uint8_t *p = data + (length >> 3);
+			p[0] = (uint8_t)(v >> 16);
+			p[1] = (uint8_t)(v >> 8);
+			p[2] = (uint8_t)v;
+
+			length += 24;
+			i += 4;
+		}
+
+		while (i < n)
+			appendLetter(s[i++]);
+	}
+
 	void Message::setLetter(int pos, char c)
 	{
 		const int start = pos * 6;
@@ -534,6 +673,23 @@ namespace AIS
 		}
 	}
 
+	void Filter::addList(std::vector<int> &list, const std::string &arg, int max)
+	{
+		std::stringstream ss(arg);
+		std::string str;
+
+		while (getline(ss, str, ','))
+			list.push_back(Util::Parse::Integer(str, 0, max));
+
+		std::sort(list.begin(), list.end());
+		list.erase(std::unique(list.begin(), list.end()), list.end());
+	}
+
+	bool Filter::contains(const std::vector<int> &list, int v)
+	{
+		return std::binary_search(list.begin(), list.end(), v);
+	}
+
 	bool Filter::SetOption(std::string option, std::string arg)
 	{
 		Util::Convert::toUpper(option);
@@ -641,12 +797,7 @@ namespace AIS
 		}
 		else if (option == "ID" || option == "SELECT_ID")
 		{
-			std::stringstream ss(arg);
-			std::string id_str;
-			while (getline(ss, id_str, ','))
-			{
-				ID_allowed.push_back(Util::Parse::Integer(id_str, 0, 999999));
-			}
+			addList(ID_allowed, arg, 999999);
 			return true;
 		}
 		else if (option == "ALLOW_CHANNEL" || option == "SELECT_CHANNEL")
@@ -655,26 +806,20 @@ namespace AIS
 			allowed_channels = arg;
 			Util::Convert::toUpper(allowed_channels);
 
+			channel_mask.reset();
+			for (char c : allowed_channels)
+				channel_mask.set((unsigned char)c);
+
 			return true;
 		}
 		else if (option == "ALLOW_MMSI" || option == "SELECT_MMSI")
 		{
-			std::stringstream ss(arg);
-			std::string mmsi_str;
-			while (getline(ss, mmsi_str, ','))
-			{
-				MMSI_allowed.push_back(Util::Parse::Integer(mmsi_str, 0, 999999999));
-			}
+			addList(MMSI_allowed, arg, 999999999);
 			return true;
 		}
 		else if (option == "BLOCK_MMSI")
 		{
-			std::stringstream ss(arg);
-			std::string mmsi_str;
-			while (getline(ss, mmsi_str, ','))
-			{
-				MMSI_blocked.push_back(Util::Parse::Integer(mmsi_str, 0, 999999999));
-			}
+			addList(MMSI_blocked, arg, 999999999);
 			return true;
 		}
 		else if (option == "REMOVE_EMPTY")
@@ -803,84 +948,24 @@ namespace AIS
 				return false;
 		}
 
-		bool ID_ok = true;
-		if (ID_allowed.size())
-		{
+		// bitmask tests first, the list lookups only for messages that pass them
+		unsigned type = msg.type() & 31;
+		unsigned repeat = msg.repeat() & 3;
 
-			ID_ok = false;
-			for (auto id : ID_allowed)
-			{
-				if (msg.getStation() == id)
-				{
-					ID_ok = true;
-					break;
-				}
-			}
-		}
-		if (!ID_ok)
-		{
+		if (!((1U << type) & allow) || !((1U << repeat) & allow_repeat))
 			return false;
-		}
 
-		bool CH_ok = true;
-		if (!allowed_channels.empty())
-		{
-			CH_ok = false;
-			for (char c : allowed_channels)
-			{
-				if (msg.getChannel() == c)
-				{
-					CH_ok = true;
-					break;
-				}
-			}
-		}
-
-		if (!CH_ok)
-		{
+		if (!allowed_channels.empty() && !channel_mask.test((unsigned char)msg.getChannel()))
 			return false;
-		}
-
-		bool MMSI_ok = true;
-		if (!MMSI_allowed.empty())
-		{
-			MMSI_ok = false;
-			for (auto mmsi : MMSI_allowed)
-			{
-				if (msg.mmsi() == mmsi)
-				{
-					MMSI_ok = true;
-					break;
-				}
-			}
-		}
 
-		if (!MMSI_ok)
-		{
+		if (!ID_allowed.empty() && !contains(ID_allowed, msg.getStation()))
 			return false;
-		}
 
-		if (!MMSI_blocked.empty())
-		{
-			for (auto mmsi : MMSI_blocked)
-			{
-				if (msg.mmsi() == mmsi)
-				{
-					return false;
-				}
-			}
-		}
-
-		unsigned type = msg.type() & 31;
-		unsigned repeat = msg.repeat() & 3;
-
-		bool type_ok = ((1U << type) & allow) != 0;
-		bool repeat_ok = ((1U << repeat) & allow_repeat) != 0;
+		if (!MMSI_allowed.empty() && !contains(MMSI_allowed, msg.mmsi()))
+			return false;
 
-		if (!(type_ok && repeat_ok))
-		{
+		if (!MMSI_blocked.empty() && contains(MMSI_blocked, msg.mmsi()))
 			return false;
-		}
 
 		return true;
 	}
@@ -20,13 +20,16 @@
 #include <string>
 #include <time.h>
 #include <vector>
+#include <bitset>
 #include <iomanip>
 #include <sstream>
 #include <cstring>
 #include <iostream>
 
 #include "Convert.h"
+#include "Clock.h"
 #include "MessageHistory.h"
+#include "StringList.h"
 
 namespace AIS
 {
@@ -52,15 +55,19 @@ namespace AIS
 		const std::string getJSON() const;
 	};
 
+	// Fixed-size payload and reception data plus the NMEA lines. The lines are a StringList so that
+	// assigning a message to one that is reused (pools, queues) does not allocate, they are built in
+	// a buffer per thread.
 	class Message
 	{
 	protected:
-		const int MAX_NMEA_CHARS = 56;
+		static const int MAX_NMEA_CHARS = 56;
 		static int ID;
-		std::string line = "!AIVDM,X,X,X,X," + std::string(MAX_NMEA_CHARS, '.') + ",X*XX\n\r"; // longest line
 
-		uint8_t data[MAX_AIS_BYTES + 1];
+		// padded so that an 8 byte window can be loaded at any byte of the message
+		uint8_t data[MAX_AIS_BYTES + 8];
 		std::time_t rxtime;
+		int64_t rxtime_us = 0; // from the sample clock, zero if not available
 		int length;
 		char channel;
 		long start_idx, end_idx;
@@ -68,11 +75,12 @@ namespace AIS
 		int own_mmsi = -1;
 
 	public:
-		std::vector<std::string> NMEA;
+		StringList NMEA;
 
 		void Stamp(std::time_t t = (std::time_t)0L)
 		{
-			std::time(&rxtime);
+			rxtime = Util::Clock::now();
+			rxtime_us = 0;
 
 			if ((long int)t != 0 && t < rxtime)
 				setRxTimeUnix(t);
@@ -97,6 +105,9 @@ namespace AIS
 			rxtime = t;
 		}
 
+		int64_t getRxTimeMicros() const { return rxtime_us; }
+		void setRxTimeMicros(int64_t t) { rxtime_us = t; }
+
 		void setStartIdx(long s)
 		{
 			start_idx = s;
@@ -107,11 +118,14 @@ namespace AIS
 			end_idx = e;
 		}
 
+		long getStartIdx() const { return start_idx; }
+		long getEndIdx() const { return end_idx; }
+
 		void clear()
 		{
 			length = 0;
-			NMEA.resize(0);
-			std::memset(data, 0, 128);
+			NMEA.clear();
+			std::memset(data, 0, sizeof(data));
 		}
 
 		bool validate();
@@ -161,6 +175,10 @@ namespace AIS
 		char getLetter(int pos) const;
 		void setLetter(int pos, char c);
 		void appendLetter(char c) { setLetter(length / 6, c); }
+		void appendLetters(const char *s, int n);
+
+		// writes n armored letters from letter pos and returns their XOR for the NMEA checksum
+		int getLetters(int pos, int n, char *out) const;
 		void reduceLength(int l) { length = MAX(length - l, 0); }
 
 		void setLength(int l)
@@ -170,6 +188,15 @@ namespace AIS
 		}
 		int getLength() const { return length; }
 
+		// raw payload, used to store messages in binary form
+		const uint8_t *getData() const { return data; }
+		void setData(const uint8_t *d, int bits)
+		{
+			clear();
+			length = MAX(0, MIN(bits, MAX_AIS_LENGTH));
+			std::memcpy(data, d, (length + 7) / 8);
+		}
+
 		void setChannel(char c) { channel = c; }
 		char getChannel() const { return channel; }
 
@@ -221,10 +248,16 @@ namespace AIS
 		uint32_t allow_repeat = all;
 		bool on = false;
 		bool GPS = true, AIS = true;
+
+		// id and mmsi lists are kept sorted for binary search, channels as a bitmask on the channel character
 		std::vector<int> ID_allowed;
 		std::vector<int> MMSI_allowed;
 		std::vector<int> MMSI_blocked;
 		std::string allowed_channels;
+		std::bitset<256> channel_mask;
+
+		static void addList(std::vector<int> &list, const std::string &arg, int max);
+		static bool contains(const std::vector<int> &list, int v);
 
 		long int last_VDO = 0;
 
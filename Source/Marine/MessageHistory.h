@@ -18,13 +18,14 @@
 #pragma once
 
 #include <vector>
-#include <algorithm>
-#include <iostream>
+#include <cstdint>
 #include "Common.h"
 
 namespace AIS
 {
-    // Circular buffer for tracking key-timestamp pairs with automatic aging
+    // Last time a key was accepted, in an open-addressing table with linear probing. Entries older than the
+    // interval count as free: a probe reuses the first one it passes and a rehash, when the table fills up,
+    // drops them. The table grows with the number of keys seen within the interval, without a cap.
     template <typename KeyType>
     struct MessageHistory
     {
@@ -32,135 +33,92 @@ namespace AIS
         {
             KeyType key = 0;
             uint32_t timestamp = 0;
+            bool used = false;
         };
 
         std::vector<Entry> entries;
-        size_t head = 0;
-        size_t tail = 0;
+        size_t mask;
         size_t count = 0;
-        size_t capacity;
-        size_t max_capacity;
-        bool max_capacity_warning_shown = false;
 
-        MessageHistory(size_t initial_cap = 128, size_t max_cap = 32768)
-            : capacity(initial_cap), max_capacity(max_cap)
+        MessageHistory(size_t initial_cap = 128) : entries(initial_cap), mask(initial_cap - 1) {}
+
+        static size_t hash(uint64_t key)
         {
-            entries.resize(capacity);
+            key *= 0x9E3779B97F4A7C15ULL;
+            return (size_t)(key ^ (key >> 32));
         }
 
-        // Expand buffer capacity by factor of 2, up to max_capacity
-        bool expandCapacity()
+        static bool expired(const Entry &e, uint32_t now, uint32_t max_age)
         {
-            if (capacity >= max_capacity)
-            {
-                if (!max_capacity_warning_shown)
+            return now - e.timestamp >= max_age;
+        }
+
+        void rehash(uint32_t now, uint32_t max_age)
+        {
+            size_t live = 0;
+            for (const Entry &e : entries)
+                if (e.used && !expired(e, now, max_age))
+                    live++;
+
+            size_t capacity = entries.size();
+            while (live * 4 > capacity)
+                capacity *= 2;
+
+            std::vector<Entry> old(capacity);
+            old.swap(entries);
+            mask = capacity - 1;
+            count = 0;
+
+            for (const Entry &e : old)
+                if (e.used && !expired(e, now, max_age))
                 {
-                    Error() << "Message History buffer reached maximum capacity (" << max_capacity << "), oldest entry will be overwritten";
-                    max_capacity_warning_shown = true;
+                    size_t i = hash(e.key) & mask;
+                    while (entries[i].used)
+                        i = (i + 1) & mask;
+                    entries[i] = e;
+                    count++;
                 }
-                return false;
-            }
-
-            size_t new_capacity = MIN(capacity * 2, max_capacity);
-
-            entries.resize(new_capacity);
-
-            // If buffer wraps around, move wrapped portion to the end and clear old slots
-            if (head <= tail && count > 0)
-            {
-                // Move elements from [0, head) to [capacity, capacity + head)
-                std::copy(entries.begin(), entries.begin() + head, entries.begin() + capacity);
-                // Clear the old slots to avoid dirty data
-                std::fill(entries.begin(), entries.begin() + head, Entry{});
-                head = capacity + head;
-            }
-
-            capacity = new_capacity;
 
-            Debug() << "Message History buffer expanded capacity to " << capacity;
-
-            return true;
+            if (capacity > old.size())
+                Debug() << "Message History table expanded capacity to " << capacity;
         }
 
-        uint32_t findAge(KeyType key, uint32_t current_time, uint32_t max_age)
+        // Returns true if should be included (not accepted within the last threshold seconds)
+        bool check(KeyType key, uint32_t timestamp, uint32_t threshold)
         {
-            if (count == 0)
-                return 0xFFFFFFFF; // Empty
+            if ((count + 1) * 10 > entries.size() * 7)
+                rehash(timestamp, threshold);
 
-            // Walk backward from most recent
-            size_t idx = (head - 1 + capacity) % capacity;
-            size_t items_checked = 0;
+            size_t i = hash(key) & mask;
+            Entry *free = nullptr;
 
-            while (items_checked < count)
+            for (; entries[i].used; i = (i + 1) & mask)
             {
-                const Entry &e = entries[idx];
-
-                // Check if entry is too old
-                if (current_time - e.timestamp > max_age)
-                {
-                    // Age out this and all older entries
-                    count = items_checked;
-                    tail = (idx + 1) % capacity;
-                    break;
-                }
+                Entry &e = entries[i];
 
                 if (e.key == key)
                 {
-                    return current_time - e.timestamp;
+                    if (!expired(e, timestamp, threshold))
+                        return false;
+
+                    e.timestamp = timestamp;
+                    return true;
                 }
 
-                idx = (idx - 1 + capacity) % capacity;
-                items_checked++;
+                if (!free && expired(e, timestamp, threshold))
+                    free = &e;
             }
 
-            return 0xFFFFFFFF;
-        }
-
-        // Returns true if should be included (age >= threshold or not found)
-        bool check(KeyType key, uint32_t timestamp, uint32_t threshold)
-        {
-            uint32_t age = findAge(key, timestamp, threshold);
-
-            if (age >= threshold)
+            if (!free)
             {
-                add(key, timestamp, threshold);
-                return true;
+                free = &entries[i];
+                free->used = true;
+                count++;
             }
 
-            return false;
-        }
-
-        void add(KeyType key, uint32_t timestamp, uint32_t max_age)
-        {
-            if (count == capacity)
-            {
-                const Entry &e = entries[tail];
-                if (timestamp - e.timestamp < max_age)
-                {
-                    if (!expandCapacity())
-                    {
-                        tail = (tail + 1) % capacity;
-                        count--;
-                    }
-                }
-                else
-                {
-                    tail = (tail + 1) % capacity;
-                    count--;
-
-#ifdef DEBUG_HISTORY
-                    if (!validate())
-                    {
-                        std::cerr << "ERROR: Buffer validation failed after add()" << std::endl;
-                    }
-#endif
-                }
-            }
-
-            entries[head].key = key;
-            entries[head].timestamp = timestamp;
-            head = (head + 1) % capacity;
-            count++;
+            free->key = key;
+            free->timestamp = timestamp;
+            return true;
         }
     };
 
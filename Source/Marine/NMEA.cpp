@@ -15,10 +15,13 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <chrono>
+
 #include "NMEA.h"
 #include "Parse.h"
 #include "Convert.h"
 #include "Helper.h"
+#include "Clock.h"
 
 namespace AIS
 {
@@ -32,50 +35,41 @@ namespace AIS
 		prev = c;
 	}
 
-	void NMEA::clean(char c, int t, int groupId)
+	uint64_t NMEA::fragmentKey(const AIVDM &a, int thisstation)
 	{
-		auto i = queue.begin();
-		uint64_t now = time(nullptr);
-		while (i != queue.end())
-		{
-			// Match by groupId if available, otherwise by channel+talkerID
-			bool match = (groupId != 0 && i->groupId == groupId) ||
-						 (groupId == 0 && i->channel == c && i->talkerID == t);
-			if (match || (i->timestamp + 3 < now))
-				i = queue.erase(i);
-			else
-				i++;
-		}
+		uint64_t key = (uint64_t)(uint32_t)thisstation << 32;
+
+		if (a.groupId != 0)
+			return key | 0x80000000 | ((uint32_t)a.groupId & 0x7FFFFFFF);
+
+		return key | ((uint32_t)(a.talkerID & 0xFFFF) << 15) | ((uint32_t)(unsigned char)a.channel << 7) | (uint32_t)(a.ID & 0x7F);
 	}
 
-	int NMEA::search(const AIVDM &a)
+	// drop incomplete messages of which the first fragment is too old, at most once per second
+	void NMEA::expireFragments()
 	{
-		// multiline message, find previous lines with matching group
-		// return: 0 = Not Found, -1: Found but inconsistent with input, >0: number of previous message
-		int lastNumber = 0;
-		for (auto it = queue.rbegin(); it != queue.rend(); it++)
-		{
-			// Match by groupId if available, otherwise by channel+talkerID
-			bool match = (aivdm.groupId != 0 && it->groupId == aivdm.groupId) ||
-						 (aivdm.groupId == 0 && it->channel == aivdm.channel && it->talkerID == aivdm.talkerID);
-			if (match)
-			{
-				if (it->count != aivdm.count || it->ID != aivdm.ID)
-					lastNumber = -1;
-				else
-					lastNumber = it->number;
-				break;
-			}
+		uint64_t now = Util::Clock::now();
+
+		if (now == last_expiry)
+			return;
+
+		last_expiry = now;
+
+		for (auto it = fragments.begin(); it != fragments.end();)
+		{
+			if (it->second.empty() || it->second.front().timestamp + FRAGMENT_TIMEOUT < now)
+				it = fragments.erase(it);
+			else
+				++it;
 		}
-		return lastNumber;
 	}
 
-	int NMEA::NMEAchecksum(std::string s)
+	int NMEA::NMEAchecksum(const Span &s)
 	{
 		int c = 0;
-		if (s.length() > 4) // Need at least "$X*XX" format
+		if (s.size() > 4) // Need at least "$X*XX" format
 		{
-			for (size_t i = 1; i < s.length() - 3; i++)
+			for (int i = 1; i < s.size() - 3; i++)
 				c ^= s[i];
 		}
 		return c;
@@ -83,12 +77,12 @@ namespace AIS
 
 	void NMEA::submitAIS(TAG &tag, long t, uint64_t ssc, uint16_t sl, int thisstation)
 	{
-		bool checksum_error = aivdm.checksum != NMEAchecksum(aivdm.sentence);
+		bool checksum_error = aivdm.checksum != NMEAchecksum(sentence);
 
 		if (checksum_error)
 		{
 			if (warnings)
-				Warning() << "NMEA: incorrect checksum [" << aivdm.sentence << "] from station " << (thisstation == -1 ? station : thisstation) << ".";
+				Warning() << "NMEA: incorrect checksum [" << sentence.str() << "] from station " << (thisstation == -1 ? station : thisstation) << ".";
 
 			if (crc_check)
 				return;
@@ -100,21 +94,31 @@ namespace AIS
 		{
 			tag.error = aivdm.message_error;
 
+			auto start = timing ? std::chrono::high_resolution_clock::now() : std::chrono::high_resolution_clock::time_point();
+
 			msg.clear();
 			msg.Stamp(stamp ? 0 : t);
 			msg.setOrigin(aivdm.channel, thisstation == -1 ? station : thisstation, own_mmsi);
 			msg.setStartIdx(ssc);
 			msg.setEndIdx(ssc + sl);
 
-			addline(aivdm);
+			addline(payload, aivdm.count, aivdm.number, aivdm.fillbits);
 
 			if (msg.validate())
 			{
 				if (regenerate)
 					msg.buildNMEA(tag);
 				else
-					msg.NMEA.push_back(aivdm.sentence);
+					msg.NMEA.push_back(sentence.str());
 
+				if (timing)
+				{
+					ais_timing += 1e-6f * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+					ais_count++;
+				}
+
+				tag.decode_us = Util::Clock::steady();
+				tag.json_us = 0;
 				Send(&msg, 1, tag);
 			}
 			else if (msg.getLength() > 0)
@@ -125,40 +129,47 @@ namespace AIS
 			return;
 		}
 
-		int result = search(aivdm);
+		expireFragments();
+
+		uint64_t key = fragmentKey(aivdm, thisstation == -1 ? station : thisstation);
+		std::vector<AIVDM> &parts = fragments[key];
+
+		// the new fragment should continue the stored ones, otherwise start over
+		int result = parts.empty() ? 0 : (parts.back().count != aivdm.count || parts.back().ID != aivdm.ID ? -1 : parts.back().number);
 
 		if (aivdm.number != result + 1 || result == -1)
 		{
-			clean(aivdm.channel, aivdm.talkerID, aivdm.groupId);
+			parts.clear();
 			if (aivdm.number != 1)
 			{
+				fragments.erase(key);
 				return;
 			}
 		}
 
-		queue.push_back(aivdm);
+		// fragments are copied out of the input buffer for reassembly
+		parts.push_back(aivdm);
+		parts.back().sentence.assign(sentence.ptr, sentence.len);
+		parts.back().data.assign(payload.ptr, payload.len);
+
 		if (aivdm.number != aivdm.count)
 			return;
 
 		// multiline messages are now complete and in the right order
 		// we create a message and add the payloads to it
+		auto start = timing ? std::chrono::high_resolution_clock::now() : std::chrono::high_resolution_clock::time_point();
+
 		msg.clear();
 		msg.Stamp(stamp ? 0 : t);
 		msg.setOrigin(aivdm.channel, thisstation == -1 ? station : thisstation, own_mmsi);
 
-		for (auto it = queue.begin(); it != queue.end(); it++)
+		for (auto it = parts.begin(); it != parts.end(); it++)
 		{
-			// Match by groupId if available, otherwise by channel+talkerID
-			bool match = (aivdm.groupId != 0 && it->groupId == aivdm.groupId) ||
-						 (aivdm.groupId == 0 && it->channel == aivdm.channel && it->talkerID == aivdm.talkerID);
-			if (match && it->count == aivdm.count && it->ID == aivdm.ID)
-			{
-				tag.error |= it->message_error;
+			tag.error |= it->message_error;
 
-				addline(*it);
-				if (!regenerate)
-					msg.NMEA.push_back(it->sentence);
-			}
+			addline(it->data, it->count, it->number, it->fillbits);
+			if (!regenerate)
+				msg.NMEA.push_back(it->sentence);
 		}
 
 		if (msg.validate())
@@ -166,20 +177,27 @@ namespace AIS
 			if (regenerate)
 				msg.buildNMEA(tag, aivdm.ID);
 
+			if (timing)
+			{
+				ais_timing += 1e-6f * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+				ais_count++;
+			}
+
+			tag.decode_us = Util::Clock::steady();
+			tag.json_us = 0;
 			Send(&msg, 1, tag);
 		}
 		else if (warnings)
 			Warning() << "NMEA: invalid message of type " << msg.type() << " and length " << msg.getLength();
 
-		clean(aivdm.channel, aivdm.talkerID, aivdm.groupId);
+		fragments.erase(key);
 	}
 
-	void NMEA::addline(const AIVDM &a)
+	void NMEA::addline(const Span &data, int count, int number, int fillbits)
 	{
-		for (char d : a.data)
-			msg.appendLetter(d);
-		if (a.count == a.number)
-			msg.reduceLength(a.fillbits);
+		msg.appendLetters(data.ptr, data.size());
+		if (count == number)
+			msg.reduceLength(fillbits);
 	}
 
 	void NMEA::split(const std::string &s)
@@ -194,6 +212,23 @@ namespace AIS
 		}
 	}
 
+	// same splitting as split() but without copies, every ',' starts a new token
+	void NMEA::tokenize(const Span &s)
+	{
+		tokens.clear();
+
+		int start = 0;
+		for (int i = 0; i < s.size(); i++)
+		{
+			if (s[i] == ',')
+			{
+				tokens.push_back(Span(s.ptr + start, i - start));
+				start = i + 1;
+			}
+		}
+		tokens.push_back(Span(s.ptr + start, s.size() - start));
+	}
+
 	std::string NMEA::trim(const std::string &s)
 	{
 		std::string r;
@@ -255,7 +290,7 @@ namespace AIS
 		const std::string &crc = parts[14];
 		int checksum = crc.size() > 2 ? (fromHEX(crc[crc.length() - 2]) << 4) | fromHEX(crc[crc.length() - 1]) : -1;
 
-		if (checksum != NMEAchecksum(line))
+		if (checksum != NMEAchecksum(s))
 		{
 			if (crc_check)
 			{
@@ -314,7 +349,7 @@ namespace AIS
 		const std::string &crc = parts[parts.size() - 1];
 		int checksum = crc.size() > 2 ? (fromHEX(crc[crc.length() - 2]) << 4) | fromHEX(crc[crc.length() - 1]) : -1;
 
-		if (checksum != NMEAchecksum(line))
+		if (checksum != NMEAchecksum(s))
 		{
 			if (crc_check)
 			{
@@ -363,10 +398,10 @@ namespace AIS
 		const std::string &crc = parts[7];
 		int checksum = crc.size() > 2 ? (fromHEX(crc[crc.length() - 2]) << 4) | fromHEX(crc[crc.length() - 1]) : -1;
 
-		if (checksum != NMEAchecksum(line))
+		if (checksum != NMEAchecksum(s))
 		{
 			if (warnings && !crc_check)
-				Warning() << "NMEA: incorrect checksum [" << line << "].";
+				Warning() << "NMEA: incorrect checksum [" << s << "].";
 
 			if (crc_check)
 			{
@@ -398,15 +433,18 @@ namespace AIS
 		return true;
 	}
 
-	bool NMEA::processAIS(const std::string &str, TAG &tag, long t, uint64_t ssc, uint16_t sl, int thisstation, int groupId, std::string &error_msg)
+	bool NMEA::processAIS(const Span &str, TAG &tag, long t, uint64_t ssc, uint16_t sl, int thisstation, int groupId, std::string &error_msg)
 	{
-		int pos = str.find_first_of("$!");
-		if (pos == std::string::npos)
+		int pos = 0;
+		while (pos < str.size() && str[pos] != '$' && str[pos] != '!')
+			pos++;
+
+		if (pos == str.size())
 		{
 			error_msg = "NMEA: no $ or ! in AIS sentence";
 			return false;
 		}
-		std::string nmea = str.substr(pos);
+		Span nmea(str.ptr + pos, str.size() - pos);
 
 		bool isNMEA = nmea.size() > 10 && (nmea[3] == 'V' && nmea[4] == 'D' && (nmea[5] == 'M' || nmea[5] == 'O'));
 		if (!isNMEA)
@@ -414,9 +452,11 @@ namespace AIS
 			return true; // no NMEA -> ignore
 		}
 
-		split(nmea);
+		tokenize(nmea);
 		aivdm.reset();
 
+		const std::vector<Span> &parts = tokens;
+
 		if (parts.size() != 7 || parts[0].size() != 6 || parts[1].size() != 1 || parts[2].size() != 1 || parts[3].size() > 1 || parts[4].size() > 1 || parts[6].size() != 4)
 		{
 			error_msg = "NMEA: AIS sentence does not have 7 parts or has invalid part sizes";
@@ -446,15 +486,16 @@ namespace AIS
 		aivdm.ID = parts[3].size() > 0 ? parts[3][0] - '0' : 0;
 		aivdm.channel = parts[4].size() > 0 ? parts[4][0] : '?';
 
-		for (auto c : parts[5])
+		for (int i = 0; i < parts[5].size(); i++)
 		{
+			char c = parts[5][i];
 			if (!isNMEAchar(c))
 			{
 				error_msg = "NMEA: AIS sentence contains invalid NMEA character '" + std::string(1, c) + "'";
 				return false;
 			}
 		}
-		aivdm.data = parts[5];
+		payload = parts[5];
 		aivdm.fillbits = parts[6][0] - '0';
 
 		if (!isHEX(parts[6][2]) || !isHEX(parts[6][3]))
@@ -464,7 +505,7 @@ namespace AIS
 		}
 		aivdm.checksum = (fromHEX(parts[6][2]) << 4) | fromHEX(parts[6][3]);
 
-		aivdm.sentence = nmea;
+		sentence = nmea;
 		aivdm.groupId = groupId;
 
 		submitAIS(tag, t, ssc, sl, thisstation);
@@ -479,9 +520,15 @@ namespace AIS
 		{
 			try
 			{
-				// JSON::Parser parser(&AIS::KeyMap, JSON_DICT_FULL);
-				// parser.setSkipUnknown(true);
-				std::shared_ptr<JSON::JSON> j = parser.parse(s);
+				if (timing)
+				{
+					auto start = std::chrono::high_resolution_clock::now();
+					parser.parse(s, json_input);
+					json_timing += 1e-3f * std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+					json_count++;
+				}
+				else
+					parser.parse(s, json_input);
 
 				std::string cls = "";
 				std::string dev = "";
@@ -494,7 +541,7 @@ namespace AIS
 				t = 0;
 
 				// phase 1, get the meta data in place
-				for (const auto &p : j->getProperties())
+				for (const auto &p : json_input.getProperties())
 				{
 					switch (p.Key())
 					{
@@ -546,7 +593,7 @@ namespace AIS
 				if (cls == "AIS" && dev == "AIS-catcher" && (uuid.empty() || suuid == uuid))
 				{
 
-					for (const auto &p : j->getProperties())
+					for (const auto &p : json_input.getProperties())
 					{
 						if (p.Key() == AIS::KEY_NMEA)
 						{
@@ -588,7 +635,7 @@ namespace AIS
 				{
 					float lat = 0, lon = 0;
 
-					for (const auto &p : j->getProperties())
+					for (const auto &p : json_input.getProperties())
 					{
 						if (p.Key() == AIS::KEY_LAT)
 						{
@@ -714,6 +761,9 @@ namespace AIS
 				return false;
 			}
 			msg.buildNMEA(tag);
+
+			tag.decode_us = Util::Clock::steady();
+			tag.json_us = 0;
 			Send(&msg, 1, tag);
 			return true;
 		}
@@ -822,7 +872,7 @@ namespace AIS
 		return true;
 	}
 
-	bool NMEA::isCompleteNMEA(const std::string &s, bool newline)
+	bool NMEA::isCompleteNMEA(const Span &s, bool newline)
 	{
 		if (s.size() < 7)
 			return false;
@@ -841,20 +891,49 @@ namespace AIS
 		return newline;
 	}
 
-	bool NMEA::processNMEAline(const std::string &s, TAG &tag, long t, int thisstation, int groupId, std::string &error_msg)
+	// find the end of the NMEA sentence starting at data[start], following the same rules as the
+	// character based parser in Receive. Returns the index of the last character consumed and the
+	// length of the sentence, or -1 if the sentence is not contiguous and complete within the buffer.
+	int NMEA::scanNMEA(const char *data, int start, int size, int &len)
+	{
+		len = 1;
+
+		for (int k = start + 1; k < size; k++)
+		{
+			char c = data[k];
+
+			if (c == '\r' || c == '\n' || c == '\t' || c == '\0')
+				return len < 7 ? -1 : k;
+
+			len++;
+
+			if (isCompleteNMEA(Span(data + start, len), false))
+				return k;
+
+			if (len > 1024)
+				return -1;
+		}
+		return -1;
+	}
+
+	bool NMEA::processNMEAline(const Span &s, TAG &tag, long t, int thisstation, int groupId, std::string &error_msg)
 	{
-		std::string type = s.size() > 5 ? s.substr(3, 3) : "";
+		if (s.size() <= 5)
+			return true;
 
-		if (type == "VDM")
+		auto is = [&s](const char *type)
+		{ return s[3] == type[0] && s[4] == type[1] && s[5] == type[2]; };
+
+		if (is("VDM"))
 			return processAIS(s, tag, t, 0, 0, thisstation, groupId, error_msg);
-		if (type == "VDO" && VDO)
+		if (is("VDO") && VDO)
 			return processAIS(s, tag, t, 0, 0, thisstation, groupId, error_msg);
-		if (type == "GGA")
-			return processGGA(s, tag, t, error_msg);
-		if (type == "RMC")
-			return processRMC(s, tag, t, error_msg);
-		if (type == "GLL")
-			return processGLL(s, tag, t, error_msg);
+		if (is("GGA"))
+			return processGGA(s.str(), tag, t, error_msg);
+		if (is("RMC"))
+			return processRMC(s.str(), tag, t, error_msg);
+		if (is("GLL"))
+			return processGLL(s.str(), tag, t, error_msg);
 
 		return true; // Unknown type, ignore
 	}
@@ -899,6 +978,29 @@ namespace AIS
 						}
 						else if (c == '$' || c == '!')
 						{
+							int len, end = scanNMEA((const char *)data[j].data, i, data[j].size, len);
+
+							if (end != -1)
+							{
+								// complete sentence within the buffer, processed in place
+								Span s((const char *)data[j].data + i, len);
+								std::string error = "unspecified error";
+								tag.clear();
+								t = 0;
+
+								if (!processNMEAline(s, tag, t, -1, 0, error))
+								{
+									if (warnings)
+									{
+										Warning() << "NMEA: error processing NMEA line " << s.str();
+										Warning() << "NMEA [" << error << " (" << s.str() << ")";
+									}
+								}
+								i = end;
+								prev = ((char *)(data[j].data))[end];
+								continue;
+							}
+
 							line = c;
 							state = ParseState::NMEA;
 						}
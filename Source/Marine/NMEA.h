@@ -18,6 +18,7 @@
 #pragma once
 
 #include <iomanip>
+#include <unordered_map>
 
 #include "Message.h"
 #include "Stream.h"
@@ -45,10 +46,26 @@ namespace AIS
 			TAG_BLOCK
 		};
 
+		// part of the input buffer, sentences are tokenized in place and only copied when stored
+		struct Span
+		{
+			const char *ptr = nullptr;
+			int len = 0;
+
+			Span() {}
+			Span(const char *p, int l) : ptr(p), len(l) {}
+			Span(const std::string &s) : ptr(s.data()), len((int)s.size()) {}
+
+			char operator[](int i) const { return ptr[i]; }
+			int size() const { return len; }
+			bool empty() const { return len == 0; }
+			std::string str() const { return std::string(ptr, len); }
+		};
+
 		struct AIVDM
 		{
+			// only filled when the fragment is queued for reassembly
 			std::string sentence;
-			std::string line;
 			std::string data;
 
 			uint64_t timestamp;
@@ -58,7 +75,7 @@ namespace AIS
 			{
 				sentence.clear();
 				data.clear();
-				timestamp = time(nullptr);
+				timestamp = Util::Clock::now();
 				groupId = 0;
 				message_error = 0;
 			}
@@ -73,6 +90,8 @@ namespace AIS
 		} aivdm;
 
 		std::vector<std::string> parts;
+		std::vector<Span> tokens;
+		Span sentence, payload;
 
 		char prev = '\n';
 		ParseState state = ParseState::IDLE;
@@ -80,19 +99,22 @@ namespace AIS
 		int count;
 		int own_mmsi = -1;
 
-		std::vector<AIVDM> queue;
+		// fragments of incomplete multipart messages by station, talker, channel and sequence ID (or tag block group)
+		std::unordered_map<uint64_t, std::vector<AIVDM>> fragments;
+		uint64_t last_expiry = 0;
+		const int FRAGMENT_TIMEOUT = 3;
 
 		void submitAIS(TAG &tag, long int t, uint64_t ssc, uint16_t sl, int thisstation);
-		void addline(const AIVDM &a);
+		void addline(const Span &data, int count, int number, int fillbits);
 		void reset(char);
-		void clean(char, int, int groupId = 0);
-		int search(const AIVDM &a);
+		uint64_t fragmentKey(const AIVDM &a, int thisstation);
+		void expireFragments();
 
 		bool isNMEAchar(char c) { return (c >= 40 && c < 88) || (c >= 96 && c <= 56 + 0x3F); }
 		bool isHEX(char c) { return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f'); }
 		int fromHEX(char c) { return (c >= '0' && c <= '9') ? (c - '0') : ((c >= 'A' && c <= 'F') ? (c - 'A' + 10) : (c - 'a' + 10)); }
 
-		int NMEAchecksum(std::string s);
+		int NMEAchecksum(const Span &s);
 
 		float GpsToDecimal(const char *, char, bool &error);
 
@@ -105,19 +127,29 @@ namespace AIS
 		bool includeGPS = true;
 
 		JSON::Parser parser;
+		JSON::JSON json_input;
+
+		// time spent parsing JSON input and assembling AIS payloads, for -b
+		bool timing = false;
+		float json_timing = 0.0;
+		long json_count = 0;
+		float ais_timing = 0.0;
+		long ais_count = 0;
 
 		void split(const std::string &);
+		void tokenize(const Span &);
 		std::string trim(const std::string &);
 		void processJSONsentence(const std::string &s, TAG &tag, long t);
-		bool processAIS(const std::string &s, TAG &tag, long t, uint64_t ssc, uint16_t sl, int thisstation, int groupId, std::string &error_msg);
+		bool processAIS(const Span &s, TAG &tag, long t, uint64_t ssc, uint16_t sl, int thisstation, int groupId, std::string &error_msg);
 		bool processGGA(const std::string &s, TAG &tag, long t, std::string &error_msg);
 		bool processGLL(const std::string &s, TAG &tag, long t, std::string &error_msg);
 		bool processRMC(const std::string &s, TAG &tag, long t, std::string &error_msg);
 		bool processBinaryPacket(const std::string &packet, TAG &tag, std::string &error_msg);
 		bool parseTagBlock(const std::string &s, std::string &nmea, long &timestamp, int &thisstation, int &groupId, std::string &error_msg);
 		bool processTagBlock(const std::string &s, TAG &tag, long &t, std::string &error_msg);
-		bool processNMEAline(const std::string &s, TAG &tag, long t, int thisstation, int groupId, std::string &error_msg);
-		bool isCompleteNMEA(const std::string &s, bool newline);
+		bool processNMEAline(const Span &s, TAG &tag, long t, int thisstation, int groupId, std::string &error_msg);
+		bool isCompleteNMEA(const Span &s, bool newline);
+		int scanNMEA(const char *data, int start, int size, int &len);
 
 	public:
 		NMEA() : parser(&AIS::KeyMap, JSON_DICT_FULL)
@@ -148,6 +180,12 @@ namespace AIS
 		bool getStamp() { return stamp; }
 		void setOwnMMSI(int m) { own_mmsi = m; }
 
+		void setTiming(bool b) { timing = b; }
+		float getJSONTiming() { return json_timing; }
+		long getJSONCount() { return json_count; }
+		float getAISTiming() { return ais_timing; }
+		long getAISCount() { return ais_count; }
+
 		Connection<GPS> outGPS;
 	};
 }
@@ -17,30 +17,58 @@
 
 #include "AIS-catcher.h"
 #include "DB.h"
+#include "MemoryBudget.h"
 
 #include <fstream>
+#include <algorithm>
+#include <type_traits>
 
 //-----------------------------------
 // simple ship database
 
+DB::~DB()
+{
+	MemoryBudget::account(MemoryBudget::SHIPS, memory_reported, 0);
+}
+
 void DB::setup()
 {
+	Nships = SHIPS_INIT;
+	Npaths = PATHS_INIT;
 
 	if (server_mode)
 	{
 		Nships *= 32;
 		Npaths *= 32;
 
-		Info() << "DB: internal ship database extended to " << Nships << " ships and " << Npaths << " path points";
+		Info() << "DB: internal ship database extended to " << Nships << " ships and " << Npaths * PathBlock::SIZE << " path points";
+	}
+
+	// with a memory budget the tables start at no more than a quarter of their share and grow up to it
+	std::size_t budget = MemoryBudget::limit(MemoryBudget::SHIPS, 0);
+	msg_buffer.clear();
+
+	while (budget && Nships > 256 && getMemory(Nships, Npaths) + (msg_save && msg_buffer_size <= 0 ? Nships * 512 : 0) > budget / 4)
+	{
+		Nships /= 2;
+		Npaths /= 2;
 	}
 
 	ships.resize(Nships);
 	paths.resize(Npaths);
+	messages.assign(Nships, MessageRef());
+	msg_buffer.assign(msg_save ? (msg_buffer_size > 0 ? msg_buffer_size : Nships * 512) : 0, 0);
+	msg_pos = 0;
 
 	first = Nships - 1;
 	last = 0;
 	count = 0;
 
+	update_seq = removed_seq = expired_seq = 0;
+	expired_ptr = -1;
+	epoch = MAX(epoch + 1, Util::Clock::now());
+	version++;
+
 	// set up linked list
 	for (int i = 0; i < Nships; i++)
 	{
@@ -48,6 +76,88 @@ void DB::setup()
 		ships[i].prev = i + 1;
 	}
 	ships[Nships - 1].prev = -1;
+
+	uint32_t N = indexSize(Nships);
+
+	index.assign(N, -1);
+	index_mask = N - 1;
+
+	grid.assign(N, -1);
+	grid_mask = N - 1;
+	grid_next.assign(Nships, -1);
+	grid_prev.assign(Nships, -1);
+	grid_bucket.assign(Nships, -1);
+
+	memory_limit = memory_cap ? memory_cap : (budget ? budget : 8 * getMemory());
+	grow_count = 0;
+
+	MemoryBudget::account(MemoryBudget::SHIPS, memory_reported, getMemory());
+}
+
+// index has at least twice the number of slots to keep probe sequences short, the grid has as many buckets
+uint32_t DB::indexSize(int n)
+{
+	uint32_t N = 1;
+	while (N < 2 * (uint32_t)n)
+		N <<= 1;
+	return N;
+}
+
+std::size_t DB::getMemory(int n_ships, int n_paths)
+{
+	std::size_t per_ship = sizeof(Ship) + sizeof(MessageRef) + 3 * sizeof(int);
+	return n_ships * per_ship + 2 * indexSize(n_ships) * sizeof(int) + n_paths * sizeof(PathBlock) + msg_buffer.size();
+}
+
+// new slots are appended to the end of the list where createShip takes them first
+bool DB::growShips()
+{
+	int n = Nships + Nships / 2;
+	if (getMemory(n, Npaths) > memory_limit)
+		return false;
+
+	ships.resize(n);
+	messages.resize(n, MessageRef());
+
+	for (int i = Nships; i < n; i++)
+	{
+		ships[i].prev = i == Nships ? last : i - 1;
+		ships[i].next = i + 1 < n ? i + 1 : -1;
+	}
+	ships[last].next = Nships;
+	last = n - 1;
+	Nships = n;
+
+	// index and grid are sized on the number of ships, so rebuild both
+	uint32_t N = indexSize(Nships);
+
+	index.assign(N, -1);
+	index_mask = N - 1;
+
+	grid.assign(N, -1);
+	grid_mask = N - 1;
+	grid_next.assign(Nships, -1);
+	grid_prev.assign(Nships, -1);
+	grid_bucket.assign(Nships, -1);
+
+	// expired ships are not in the grid
+	bool active = true;
+	for (int ptr = first; ptr != -1; ptr = ships[ptr].next)
+	{
+		active &= ptr != expired_ptr;
+
+		if (ships[ptr].mmsi == 0)
+			continue;
+
+		indexInsert(ships[ptr].mmsi, ptr);
+		if (active)
+			gridUpdate(ptr);
+	}
+
+	grow_count++;
+	MemoryBudget::account(MemoryBudget::SHIPS, memory_reported, getMemory());
+	Info() << "DB: ship database grown to " << Nships << " ships (" << getMemory() / 1024 << " of " << memory_limit / 1024 << " KB)";
+	return true;
 }
 
 bool DB::isValidCoord(float lat, float lon)
@@ -55,6 +165,155 @@ bool DB::isValidCoord(float lat, float lon)
 	return !(lat == 0 && lon == 0) && lat != 91 && lon != 181;
 }
 
+bool Area::parse(const std::string &s)
+{
+	std::stringstream ss;
+	char c1, c2, c3;
+
+	if (s.compare(0, 5, "bbox=") == 0)
+	{
+		ss.str(s.substr(5));
+		if (!(ss >> lat_min >> c1 >> lon_min >> c2 >> lat_max >> c3 >> lon_max) || c1 != ',' || c2 != ',' || c3 != ',')
+			return false;
+
+		if (lat_min > lat_max || lat_min < -90 || lat_max > 90 || lon_min < -180 || lon_min > 180 || lon_max < -180 || lon_max > 180)
+			return false;
+
+		circle = false;
+		return true;
+	}
+
+	if (s.compare(0, 7, "radius=") == 0)
+	{
+		ss.str(s.substr(7));
+		if (!(ss >> lat >> c1 >> lon >> c2 >> radius) || c1 != ',' || c2 != ',')
+			return false;
+
+		if (lat < -90 || lat > 90 || lon < -180 || lon > 180 || radius <= 0)
+			return false;
+
+		// bounding box of the circle, one minute of latitude is a nautical mile
+		float dlat = radius / 60.0f;
+		lat_min = MAX(-90.0f, lat - dlat);
+		lat_max = MIN(90.0f, lat + dlat);
+
+		float c = cos(MAX(fabs(lat_min), fabs(lat_max)) * PI / 180.0f);
+		float dlon = c > 0 ? dlat / c : 180.0f;
+
+		if (dlon >= 180.0f || lat_max >= 90.0f || lat_min <= -90.0f)
+		{
+			lon_min = -180.0f;
+			lon_max = 180.0f;
+		}
+		else
+		{
+			lon_min = lon - dlon;
+			lon_max = lon + dlon;
+			if (lon_min < -180.0f)
+				lon_min += 360.0f;
+			if (lon_max > 180.0f)
+				lon_max -= 360.0f;
+		}
+
+		circle = true;
+		return true;
+	}
+	return false;
+}
+
+bool Area::inBox(float la, float lo) const
+{
+	if (la < lat_min || la > lat_max)
+		return false;
+
+	if (lon_min <= lon_max)
+		return lo >= lon_min && lo <= lon_max;
+
+	return lo >= lon_min || lo <= lon_max;
+}
+
+// fields that can be projected, the names are those of ships_full.json
+enum ShipField
+{
+	FIELD_MMSI = 0,
+	FIELD_LAT,
+	FIELD_LON,
+	FIELD_DISTANCE,
+	FIELD_BEARING,
+	FIELD_LEVEL,
+	FIELD_COUNT,
+	FIELD_PPM,
+	FIELD_GROUP_MASK,
+	FIELD_APPROX,
+	FIELD_HEADING,
+	FIELD_COG,
+	FIELD_SPEED,
+	FIELD_TO_BOW,
+	FIELD_TO_STERN,
+	FIELD_TO_STARBOARD,
+	FIELD_TO_PORT,
+	FIELD_SHIPTYPE,
+	FIELD_MMSI_TYPE,
+	FIELD_SHIPCLASS,
+	FIELD_VALIDATED,
+	FIELD_MSG_TYPE,
+	FIELD_CHANNELS,
+	FIELD_COUNTRY,
+	FIELD_STATUS,
+	FIELD_DRAUGHT,
+	FIELD_ETA_MONTH,
+	FIELD_ETA_DAY,
+	FIELD_ETA_HOUR,
+	FIELD_ETA_MINUTE,
+	FIELD_IMO,
+	FIELD_CALLSIGN,
+	FIELD_SHIPNAME,
+	FIELD_DESTINATION,
+	FIELD_REPEAT,
+	FIELD_LAST_SIGNAL,
+	FIELD_LAST_GROUP,
+	FIELD_FLAGS,
+	FIELD_ALTITUDE,
+	FIELD_RECEIVED_STATIONS,
+	FIELD_COUNT_ALL
+};
+
+static const char *field_names[FIELD_COUNT_ALL] = {
+	"mmsi", "lat", "lon", "distance", "bearing", "level", "count", "ppm", "group_mask", "approx",
+	"heading", "cog", "speed", "to_bow", "to_stern", "to_starboard", "to_port", "shiptype", "mmsi_type", "shipclass",
+	"validated", "msg_type", "channels", "country", "status", "draught", "eta_month", "eta_day", "eta_hour", "eta_minute",
+	"imo", "callsign", "shipname", "destination", "repeat", "last_signal", "last_group", "flags", "altitude", "received_stations"};
+
+const char *Projection::name(int field)
+{
+	return field_names[field];
+}
+
+bool Projection::parse(const std::string &s)
+{
+	std::stringstream ss(s);
+	std::string f;
+	uint64_t seen = 0;
+
+	fields.clear();
+
+	while (std::getline(ss, f, ','))
+	{
+		int i = 0;
+		while (i < FIELD_COUNT_ALL && f != field_names[i])
+			i++;
+
+		if (i == FIELD_COUNT_ALL || (seen & ((uint64_t)1 << i)))
+			return false;
+
+		seen |= (uint64_t)1 << i;
+		fields.push_back(i);
+	}
+
+	key = s;
+	return !fields.empty();
+}
+
 // https://www.movable-type.co.uk/scripts/latlong.html
 void DB::getDistanceAndBearing(float lat1, float lon1, float lat2, float lon2, float &distance, int &bearing)
 {
@@ -79,10 +338,53 @@ void DB::getDistanceAndBearing(float lat1, float lon1, float lat2, float lon2, f
 
 void DB::getBinary(std::vector<char> &v)
 {
-	std::lock_guard<std::mutex> lock(mtx);
+	std::shared_ptr<const Snapshot> snap = getSnapshot(true);
+
+	Util::Serialize::Uint64(Util::Clock::now(), v);
+	Util::Serialize::Int32(snap->count, v);
+
+	if (latlon_share && isValidCoord(lat, lon))
+	{
+		Util::Serialize::Int8(1, v);
+		Util::Serialize::LatLon(lat, lon, v);
+		Util::Serialize::Uint32(own_mmsi, v);
+	}
+	else
+	{
+		Util::Serialize::Int8(0, v);
+	}
+
+	// one pass for the size so the ships are stored without regrowing the buffer
+	std::size_t size = 0;
+	for (const Ship &ship : snap->ships)
+		size += ship.serializedSize();
+
+	Util::Serialize::Writer w(v);
+	w.reserve(size);
+
+	for (const Ship &ship : snap->ships)
+		ship.Serialize(w);
+}
+
+// getBinary header extended with the change set of getJSONdelta, the ships follow up to the end of
+// the buffer each with its sequence number appended. epoch and seq are updated to the state encoded.
+void DB::getBinaryDelta(std::vector<char> &v, std::time_t &since_epoch, uint64_t &since_seq)
+{
+	std::shared_ptr<const Snapshot> snap = getSnapshot(false);
+
+	bool full = since_epoch != snap->epoch || since_seq > snap->update_seq;
+	if (full)
+		since_seq = 0;
+
+	std::time_t tm = Util::Clock::now();
+	uint64_t removed = MAX(snap->removed_seq, snap->expired_seq);
 
-	Util::Serialize::Uint64(time(nullptr), v);
-	Util::Serialize::Int32(count, v);
+	Util::Serialize::Uint64(tm, v);
+	Util::Serialize::Uint64(snap->epoch, v);
+	Util::Serialize::Uint64(snap->update_seq, v);
+	Util::Serialize::Uint64(removed, v);
+	Util::Serialize::Int8(full ? 1 : 0, v);
+	Util::Serialize::Int32(snap->count, v);
 
 	if (latlon_share && isValidCoord(lat, lon))
 	{
@@ -95,132 +397,415 @@ void DB::getBinary(std::vector<char> &v)
 		Util::Serialize::Int8(0, v);
 	}
 
-	int ptr = first;
+	// ships are ordered by last update, the changed ones are the first n
+	int n = 0;
+	std::size_t size = 0;
+	for (; n < snap->active && snap->ships[n].seq > since_seq; n++)
+		size += snap->ships[n].serializedSize() + 8;
 
-	delim = "";
-	while (ptr != -1)
+	Util::Serialize::Writer w(v);
+	w.reserve(size);
+
+	for (int i = 0; i < n; i++)
 	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
-		{
-			ship.Serialize(v);
-		}
-		ptr = ships[ptr].next;
+		snap->ships[i].Serialize(w);
+		w.Uint64(snap->ships[i].seq);
 	}
+
+	since_epoch = snap->epoch;
+	since_seq = snap->update_seq;
 }
 
 // add member to get JSON in form of array with values and keys separately
 std::string DB::getJSONcompact(bool full)
 {
-	std::lock_guard<std::mutex> lock(mtx);
+	std::shared_ptr<const Snapshot> snap = getSnapshot(full);
+	return getJSONcompact(snap->ships, full ? (int)snap->ships.size() : snap->active, snap->count);
+}
 
-	const std::string null_str = "null";
+std::string DB::getJSONcompact(const Area &area)
+{
+	std::vector<Ship> list;
+	int n = getShips(area, list);
+	return getJSONcompact(list, (int)list.size(), n);
+}
+
+std::string DB::getJSONcompact(const std::vector<Ship> &list, int n, int count)
+{
 	const std::string comma = ",";
-	std::string str;
 
-	content = "{\"count\":" + std::to_string(count) + comma;
+	std::string content = "{\"count\":" + std::to_string(count) + comma;
 	if (latlon_share && isValidCoord(lat, lon))
 		content += "\"station\":{\"lat\":" + std::to_string(lat) + ",\"lon\":" + std::to_string(lon) + ",\"mmsi\":" + std::to_string(own_mmsi) + "},";
 
 	content += "\"values\":[";
 
-	std::time_t tm = time(nullptr);
-	int ptr = first;
+	std::time_t tm = Util::Clock::now();
 
-	delim = "";
-	while (ptr != -1)
+	std::string delim = "";
+	for (int i = 0; i < n; i++)
 	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
-		{
-			long int delta_time = (long int)tm - (long int)ship.last_signal;
-			if (!full && delta_time > TIME_HISTORY)
-				break;
+		const Ship &ship = list[i];
+		long int delta_time = (long int)tm - (long int)ship.last_signal;
 
-			content += delim + "[" + std::to_string(ship.mmsi) + comma;
-			if (isValidCoord(ship.lat, ship.lon))
-			{
-				content += std::to_string(ship.lat) + comma;
-				content += std::to_string(ship.lon) + comma;
-
-				if (ship.distance != DISTANCE_UNDEFINED && ship.angle != ANGLE_UNDEFINED)
-				{
-					content += std::to_string(ship.distance) + comma;
-					content += std::to_string(ship.angle) + comma;
-				}
-				else
-				{
-					content += null_str + comma;
-					content += null_str + comma;
-				}
-			}
-			else
-			{
-				content += null_str + comma;
-				content += null_str + comma;
-				content += null_str + comma;
-				content += null_str + comma;
-			}
+		content += delim;
+		getShipCompactJSON(ship, content, delta_time);
+		content += "]";
+		delim = comma;
+	}
+	content += "],\"error\":false}\n\n";
+	return content;
+}
+
+// appends the values of a ship as an array, without the closing bracket
+void DB::getShipCompactJSON(const Ship &ship, std::string &content, long int delta_time)
+{
+	using Util::Convert;
+
+	// each value followed by a comma, the numbers as std::to_string writes them
+	auto real = [&content](double v)
+	{ Convert::appendFixed(content, v); content += ','; };
+	auto integer = [&content](long long v)
+	{ Convert::appendInt(content, v); content += ','; };
+	auto optReal = [&](bool defined, double v)
+	{ if (defined) real(v); else content += "null,"; };
+	auto optInt = [&](bool defined, long long v)
+	{ if (defined) integer(v); else content += "null,"; };
+
+	std::string str;
+
+	content += '[';
+	integer(ship.mmsi);
+	if (isValidCoord(ship.lat, ship.lon))
+	{
+		real(ship.lat);
+		real(ship.lon);
 
-			content += (ship.level == LEVEL_UNDEFINED ? null_str : std::to_string(ship.level)) + comma;
-			content += std::to_string(ship.count) + comma;
-			content += (ship.ppm == PPM_UNDEFINED ? null_str : std::to_string(ship.ppm)) + comma;
-			content += std::string(ship.getApproximate() ? "true" : "false") + comma;
+		bool distance = ship.distance != DISTANCE_UNDEFINED && ship.angle != ANGLE_UNDEFINED;
+		optReal(distance, ship.distance);
+		optInt(distance, ship.angle);
+	}
+	else
+		content += "null,null,null,null,";
 
-			content += ((ship.heading == HEADING_UNDEFINED) ? null_str : std::to_string(ship.heading)) + comma;
-			content += ((ship.cog == COG_UNDEFINED) ? null_str : std::to_string(ship.cog)) + comma;
-			content += ((ship.speed == SPEED_UNDEFINED) ? null_str : std::to_string(ship.speed)) + comma;
+	optReal(ship.level != LEVEL_UNDEFINED, ship.level);
+	integer(ship.count);
+	optReal(ship.ppm != PPM_UNDEFINED, ship.ppm);
+	content += ship.getApproximate() ? "true," : "false,";
 
-			content += ((ship.to_bow == DIMENSION_UNDEFINED) ? null_str : std::to_string(ship.to_bow)) + comma;
-			content += ((ship.to_stern == DIMENSION_UNDEFINED) ? null_str : std::to_string(ship.to_stern)) + comma;
-			content += ((ship.to_starboard == DIMENSION_UNDEFINED) ? null_str : std::to_string(ship.to_starboard)) + comma;
-			content += ((ship.to_port == DIMENSION_UNDEFINED) ? null_str : std::to_string(ship.to_port)) + comma;
+	optInt(ship.heading != HEADING_UNDEFINED, ship.heading);
+	optReal(ship.cog != COG_UNDEFINED, ship.cog);
+	optReal(ship.speed != SPEED_UNDEFINED, ship.speed);
 
-			content += std::to_string(ship.last_group) + comma;
-			content += std::to_string(ship.group_mask) + comma;
+	optInt(ship.to_bow != DIMENSION_UNDEFINED, ship.to_bow);
+	optInt(ship.to_stern != DIMENSION_UNDEFINED, ship.to_stern);
+	optInt(ship.to_starboard != DIMENSION_UNDEFINED, ship.to_starboard);
+	optInt(ship.to_port != DIMENSION_UNDEFINED, ship.to_port);
 
-			content += std::to_string(ship.shiptype) + comma;
-			content += std::to_string(ship.mmsi_type) + comma;
-			content += std::to_string(ship.shipclass) + comma;
+	Convert::appendUInt(content, ship.last_group);
+	content += ',';
+	Convert::appendUInt(content, ship.group_mask);
+	content += ',';
 
-			content += std::to_string(ship.msg_type) + comma;
-			content += "\"" + std::string(ship.country_code) + "\",";
-			content += std::to_string(ship.status) + comma;
+	integer(ship.shiptype);
+	integer(ship.mmsi_type);
+	integer(ship.shipclass);
 
-			content += ((ship.draught == DRAUGHT_UNDEFINED) ? null_str : std::to_string(ship.draught)) + comma;
-			content += ((ship.month == ETA_MONTH_UNDEFINED) ? null_str : std::to_string(ship.month)) + comma;
-			content += ((ship.day == ETA_DAY_UNDEFINED) ? null_str : std::to_string(ship.day)) + comma;
-			content += ((ship.hour == ETA_HOUR_UNDEFINED) ? null_str : std::to_string(ship.hour)) + comma;
-			content += ((ship.minute == ETA_MINUTE_UNDEFINED) ? null_str : std::to_string(ship.minute)) + comma;
+	integer(ship.msg_type);
+	content += '"';
+	content += ship.country_code;
+	content += "\",";
+	integer(ship.status);
 
-			content += ((ship.IMO == IMO_UNDEFINED) ? null_str : std::to_string(ship.IMO)) + comma;
+	optReal(ship.draught != DRAUGHT_UNDEFINED, ship.draught);
+	optInt(ship.month != ETA_MONTH_UNDEFINED, ship.month);
+	optInt(ship.day != ETA_DAY_UNDEFINED, ship.day);
+	optInt(ship.hour != ETA_HOUR_UNDEFINED, ship.hour);
+	optInt(ship.minute != ETA_MINUTE_UNDEFINED, ship.minute);
 
-			str = std::string(ship.callsign);
-			JSON::StringBuilder::stringify(str, content);
+	optInt(ship.IMO != IMO_UNDEFINED, ship.IMO);
 
-			content += comma;
-			str = std::string(ship.shipname) + (ship.getVirtualAid() ? std::string(" [V]") : std::string(""));
-			JSON::StringBuilder::stringify(str, content);
+	str = std::string(ship.callsign);
+	JSON::StringBuilder::stringify(str, content);
 
-			content += comma;
-			str = std::string(ship.destination);
-			JSON::StringBuilder::stringify(str, content);
+	content += ',';
+	str = std::string(ship.shipname) + (ship.getVirtualAid() ? std::string(" [V]") : std::string(""));
+	JSON::StringBuilder::stringify(str, content);
+
+	content += ',';
+	str = std::string(ship.destination);
+	JSON::StringBuilder::stringify(str, content);
+
+	content += ',';
+	integer(delta_time);
+	integer(ship.flags.getPackedValue());
+	integer(ship.getValidated());
+	integer(ship.getChannels());
+	optInt(ship.altitude != ALT_UNDEFINED, ship.altitude);
+
+	if (ship.received_stations == RECEIVED_STATIONS_UNDEFINED)
+		content += "null";
+	else
+		Convert::appendInt(content, ship.received_stations);
+}
 
-			content += comma + std::to_string(delta_time);
-			content += comma + std::to_string(ship.flags.getPackedValue());
-			content += comma + std::to_string(ship.getValidated());
-			content += comma + std::to_string(ship.getChannels());
-			content += comma + ((ship.altitude == ALT_UNDEFINED) ? null_str : std::to_string(ship.altitude));
-			content += comma + ((ship.received_stations == RECEIVED_STATIONS_UNDEFINED) ? null_str : std::to_string(ship.received_stations)) + "]";
+void DB::getShipField(const Ship &ship, int field, std::string &content, long int delta_time)
+{
+	const std::string null_str = "null";
+	const bool position = isValidCoord(ship.lat, ship.lon);
+	const bool distance = position && ship.distance != DISTANCE_UNDEFINED && ship.angle != ANGLE_UNDEFINED;
+	std::string str;
 
-			delim = comma;
+	switch (field)
+	{
+	case FIELD_MMSI:
+		content += std::to_string(ship.mmsi);
+		break;
+	case FIELD_LAT:
+		content += position ? std::to_string(ship.lat) : null_str;
+		break;
+	case FIELD_LON:
+		content += position ? std::to_string(ship.lon) : null_str;
+		break;
+	case FIELD_DISTANCE:
+		content += distance ? std::to_string(ship.distance) : null_str;
+		break;
+	case FIELD_BEARING:
+		content += distance ? std::to_string(ship.angle) : null_str;
+		break;
+	case FIELD_LEVEL:
+		content += ship.level == LEVEL_UNDEFINED ? null_str : std::to_string(ship.level);
+		break;
+	case FIELD_COUNT:
+		content += std::to_string(ship.count);
+		break;
+	case FIELD_PPM:
+		content += ship.ppm == PPM_UNDEFINED ? null_str : std::to_string(ship.ppm);
+		break;
+	case FIELD_GROUP_MASK:
+		content += std::to_string(ship.group_mask);
+		break;
+	case FIELD_APPROX:
+		content += ship.getApproximate() ? "true" : "false";
+		break;
+	case FIELD_HEADING:
+		content += ship.heading == HEADING_UNDEFINED ? null_str : std::to_string(ship.heading);
+		break;
+	case FIELD_COG:
+		content += ship.cog == COG_UNDEFINED ? null_str : std::to_string(ship.cog);
+		break;
+	case FIELD_SPEED:
+		content += ship.speed == SPEED_UNDEFINED ? null_str : std::to_string(ship.speed);
+		break;
+	case FIELD_TO_BOW:
+		content += ship.to_bow == DIMENSION_UNDEFINED ? null_str : std::to_string(ship.to_bow);
+		break;
+	case FIELD_TO_STERN:
+		content += ship.to_stern == DIMENSION_UNDEFINED ? null_str : std::to_string(ship.to_stern);
+		break;
+	case FIELD_TO_STARBOARD:
+		content += ship.to_starboard == DIMENSION_UNDEFINED ? null_str : std::to_string(ship.to_starboard);
+		break;
+	case FIELD_TO_PORT:
+		content += ship.to_port == DIMENSION_UNDEFINED ? null_str : std::to_string(ship.to_port);
+		break;
+	case FIELD_SHIPTYPE:
+		content += std::to_string(ship.shiptype);
+		break;
+	case FIELD_MMSI_TYPE:
+		content += std::to_string(ship.mmsi_type);
+		break;
+	case FIELD_SHIPCLASS:
+		content += std::to_string(ship.shipclass);
+		break;
+	case FIELD_VALIDATED:
+		content += std::to_string(ship.getValidated());
+		break;
+	case FIELD_MSG_TYPE:
+		content += std::to_string(ship.msg_type);
+		break;
+	case FIELD_CHANNELS:
+		content += std::to_string(ship.getChannels());
+		break;
+	case FIELD_COUNTRY:
+		content += "\"" + std::string(ship.country_code) + "\"";
+		break;
+	case FIELD_STATUS:
+		content += std::to_string(ship.status);
+		break;
+	case FIELD_DRAUGHT:
+		content += ship.draught == DRAUGHT_UNDEFINED ? null_str : std::to_string(ship.draught);
+		break;
+	case FIELD_ETA_MONTH:
+		content += ship.month == ETA_MONTH_UNDEFINED ? null_str : std::to_string(ship.month);
+		break;
+	case FIELD_ETA_DAY:
+		content += ship.day == ETA_DAY_UNDEFINED ? null_str : std::to_string(ship.day);
+		break;
+	case FIELD_ETA_HOUR:
+		content += ship.hour == ETA_HOUR_UNDEFINED ? null_str : std::to_string(ship.hour);
+		break;
+	case FIELD_ETA_MINUTE:
+		content += ship.minute == ETA_MINUTE_UNDEFINED ? null_str : std::to_string(ship.minute);
+		break;
+	case FIELD_IMO:
+		content += ship.IMO == IMO_UNDEFINED ? null_str : std::to_string(ship.IMO);
+		break;
+	case FIELD_CALLSIGN:
+		str = std::string(ship.callsign);
+		JSON::StringBuilder::stringify(str, content);
+		break;
+	case FIELD_SHIPNAME:
+		str = std::string(ship.shipname) + (ship.getVirtualAid() ? std::string(" [V]") : std::string(""));
+		JSON::StringBuilder::stringify(str, content);
+		break;
+	case FIELD_DESTINATION:
+		str = std::string(ship.destination);
+		JSON::StringBuilder::stringify(str, content);
+		break;
+	case FIELD_REPEAT:
+		content += std::to_string(ship.getRepeat());
+		break;
+	case FIELD_LAST_SIGNAL:
+		content += std::to_string(delta_time);
+		break;
+	case FIELD_LAST_GROUP:
+		content += std::to_string(ship.last_group);
+		break;
+	case FIELD_FLAGS:
+		content += std::to_string(ship.flags.getPackedValue());
+		break;
+	case FIELD_ALTITUDE:
+		content += ship.altitude == ALT_UNDEFINED ? null_str : std::to_string(ship.altitude);
+		break;
+	case FIELD_RECEIVED_STATIONS:
+		content += ship.received_stations == RECEIVED_STATIONS_UNDEFINED ? null_str : std::to_string(ship.received_stations);
+		break;
+	}
+}
+
+// the ship as an object with keys or as an array of values
+void DB::getShipProjected(const Ship &ship, const Projection &p, bool keys, std::string &content, long int delta_time)
+{
+	content += keys ? '{' : '[';
+
+	for (std::size_t i = 0; i < p.fields.size(); i++)
+	{
+		if (i)
+			content += ',';
+
+		if (keys)
+		{
+			content += '"';
+			content += Projection::name(p.fields[i]);
+			content += "\":";
 		}
-		ptr = ships[ptr].next;
+		getShipField(ship, p.fields[i], content, delta_time);
+	}
+
+	content += keys ? '}' : ']';
+}
+
+std::string DB::getJSON(const Projection &p, bool full)
+{
+	std::shared_ptr<const Snapshot> snap = getSnapshot(full);
+
+	std::string content = "{\"count\":" + std::to_string(snap->count);
+	if (latlon_share)
+		content += ",\"station\":{\"lat\":" + std::to_string(lat) + ",\"lon\":" + std::to_string(lon) + ",\"mmsi\":" + std::to_string(own_mmsi) + "}";
+	content += ",\"ships\":[";
+
+	std::time_t tm = Util::Clock::now();
+	int n = full ? (int)snap->ships.size() : snap->active;
+
+	for (int i = 0; i < n; i++)
+	{
+		const Ship &ship = snap->ships[i];
+
+		if (i)
+			content += ',';
+		getShipProjected(ship, p, true, content, (long int)tm - (long int)ship.last_signal);
 	}
 	content += "],\"error\":false}\n\n";
 	return content;
 }
 
+std::string DB::getJSONcompact(const Projection &p, const Area *area)
+{
+	std::shared_ptr<const Snapshot> snap;
+	std::vector<Ship> list;
+	int messages = 0;
+
+	if (area)
+		messages = getShips(*area, list);
+	else
+		snap = getSnapshot(false);
+
+	const std::vector<Ship> &ships = area ? list : snap->ships;
+	const int n = area ? (int)list.size() : snap->active;
+
+	std::string content = "{\"count\":" + std::to_string(area ? messages : snap->count) + ",";
+	if (latlon_share && isValidCoord(lat, lon))
+		content += "\"station\":{\"lat\":" + std::to_string(lat) + ",\"lon\":" + std::to_string(lon) + ",\"mmsi\":" + std::to_string(own_mmsi) + "},";
+
+	content += "\"fields\":[";
+	for (std::size_t i = 0; i < p.fields.size(); i++)
+		content += std::string(i ? ",\"" : "\"") + Projection::name(p.fields[i]) + "\"";
+	content += "],\"values\":[";
+
+	std::time_t tm = Util::Clock::now();
+
+	for (int i = 0; i < n; i++)
+	{
+		if (i)
+			content += ',';
+		getShipProjected(ships[i], p, false, content, (long int)tm - (long int)ships[i].last_signal);
+	}
+	content += "],\"error\":false}\n\n";
+	return content;
+}
+
+std::string DB::getJSONdelta(std::time_t since_epoch, uint64_t since_seq)
+{
+	std::shared_ptr<const Snapshot> snap = getSnapshot(false);
+
+	const std::string comma = ",";
+
+	// client has to start over after a reset of the database
+	bool full = since_epoch != snap->epoch || since_seq > snap->update_seq;
+	if (full)
+		since_seq = 0;
+
+	std::string content = "{\"count\":" + std::to_string(snap->count) + comma;
+	if (latlon_share && isValidCoord(lat, lon))
+		content += "\"station\":{\"lat\":" + std::to_string(lat) + ",\"lon\":" + std::to_string(lon) + ",\"mmsi\":" + std::to_string(own_mmsi) + "},";
+
+	content += "\"values\":[";
+
+	std::time_t tm = Util::Clock::now();
+	uint64_t removed = MAX(snap->removed_seq, snap->expired_seq);
+
+	// ships are ordered by last update, so the changed ships come first and we stop at the first unchanged one
+	std::string delim = "";
+	for (int i = 0; i < snap->active && snap->ships[i].seq > since_seq; i++)
+	{
+		const Ship &ship = snap->ships[i];
+		long int delta_time = (long int)tm - (long int)ship.last_signal;
+
+		content += delim;
+		getShipCompactJSON(ship, content, delta_time);
+		content += comma + std::to_string(ship.seq) + "]";
+		delim = comma;
+	}
+
+	content += "],\"epoch\":" + std::to_string(snap->epoch);
+	content += ",\"seq\":" + std::to_string(snap->update_seq);
+	content += ",\"removed\":" + std::to_string(removed);
+	content += std::string(",\"full\":") + (full ? "true" : "false");
+	content += ",\"error\":false}\n\n";
+	return content;
+}
+
 void DB::getShipJSON(const Ship &ship, std::string &content, long int delta_time)
 {
 
@@ -305,34 +890,26 @@ void DB::getShipJSON(const Ship &ship, std::string &content, long int delta_time
 
 std::string DB::getJSON(bool full)
 {
-	std::lock_guard<std::mutex> lock(mtx);
-
-	const std::string null_str = "null";
-	std::string str;
+	std::shared_ptr<const Snapshot> snap = getSnapshot(full);
 
-	content = "{\"count\":" + std::to_string(count);
+	std::string content = "{\"count\":" + std::to_string(snap->count);
 	if (latlon_share)
 		content += ",\"station\":{\"lat\":" + std::to_string(lat) + ",\"lon\":" + std::to_string(lon) + ",\"mmsi\":" + std::to_string(own_mmsi) + "}";
 	content += ",\"ships\":[";
 
-	std::time_t tm = time(nullptr);
-	int ptr = first;
+	std::time_t tm = Util::Clock::now();
 
-	delim = "";
-	while (ptr != -1)
+	int n = full ? (int)snap->ships.size() : snap->active;
+
+	std::string delim = "";
+	for (int i = 0; i < n; i++)
 	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
-		{
-			long int delta_time = (long int)tm - (long int)ship.last_signal;
-			if (!full && delta_time > TIME_HISTORY)
-				break;
+		const Ship &ship = snap->ships[i];
+		long int delta_time = (long int)tm - (long int)ship.last_signal;
 
-			content += delim;
-			getShipJSON(ship, content, delta_time);
-			delim = ",";
-		}
-		ptr = ships[ptr].next;
+		content += delim;
+		getShipJSON(ship, content, delta_time);
+		delim = ",";
 	}
 	content += "],\"error\":false}\n\n";
 	return content;
@@ -347,122 +924,200 @@ std::string DB::getShipJSON(int mmsi)
 		return "{}";
 
 	const Ship &ship = ships[ptr];
-	long int delta_time = (long int)time(nullptr) - (long int)ship.last_signal;
+	long int delta_time = (long int)Util::Clock::now() - (long int)ship.last_signal;
 
 	std::string content;
 	getShipJSON(ship, content, delta_time);
 	return content;
 }
 
-std::string DB::getKML()
+DB::PartWriter DB::writeKML()
 {
-	std::lock_guard<std::mutex> lock(mtx);
-
-	std::string s = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><kml xmlns = \"http://www.opengis.net/kml/2.2\"><Document>";
-	int ptr = first;
-	std::time_t tm = time(nullptr);
+	std::shared_ptr<const Snapshot> snap = getSnapshot(false);
+	int i = -1;
 
-	while (ptr != -1)
+	return [snap, i](std::string &s) mutable
 	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
+		std::size_t start = s.size();
+
+		if (i == -1)
 		{
-			long int delta_time = (long int)tm - (long int)ship.last_signal;
-			if (delta_time > TIME_HISTORY)
-				break;
-			ship.getKML(s);
+			s += "<?xml version=\"1.0\" encoding=\"UTF-8\"?><kml xmlns = \"http://www.opengis.net/kml/2.2\"><Document>";
+			i = 0;
 		}
-		ptr = ships[ptr].next;
-	}
-	s += "</Document></kml>";
-	return s;
-}
 
-std::string DB::getGeoJSON()
-{
-	std::lock_guard<std::mutex> lock(mtx);
+		for (; i < snap->active && s.size() - start < PART_SIZE; i++)
+			snap->ships[i].getKML(s);
 
-	std::string s = "{\"type\":\"FeatureCollection\",\"time_span\":" + std::to_string(TIME_HISTORY) + ",\"features\":[";
-	int ptr = first;
-	std::time_t tm = time(nullptr);
+		if (i < snap->active)
+			return true;
+
+		s += "</Document></kml>";
+		return false;
+	};
+}
 
+DB::PartWriter DB::writeGeoJSON()
+{
+	std::shared_ptr<const Snapshot> snap = getSnapshot(false);
+	int history = TIME_HISTORY;
+	int i = -1;
 	bool addcomma = false;
-	while (ptr != -1)
+
+	return [snap, history, i, addcomma](std::string &s) mutable
 	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
+		std::size_t start = s.size();
+
+		if (i == -1)
 		{
-			long int delta_time = (long int)tm - (long int)ship.last_signal;
-			if (delta_time > TIME_HISTORY)
-				break;
+			s += "{\"type\":\"FeatureCollection\",\"time_span\":" + std::to_string(history) + ",\"features\":[";
+			i = 0;
+		}
 
+		for (; i < snap->active && s.size() - start < PART_SIZE; i++)
+		{
 			if (addcomma)
 				s += ",";
-			addcomma = ship.getGeoJSON(s);
+			addcomma = snap->ships[i].getGeoJSON(s);
 		}
-		ptr = ships[ptr].next;
+
+		if (i < snap->active)
+			return true;
+
+		s += "]}";
+		return false;
+	};
+}
+
+std::string DB::getGeoJSON(const Area &area)
+{
+	std::vector<Ship> list;
+	getShips(area, list);
+	return getGeoJSON(list, (int)list.size());
+}
+
+std::string DB::getGeoJSON(const std::vector<Ship> &list, int n)
+{
+	std::string s = "{\"type\":\"FeatureCollection\",\"time_span\":" + std::to_string(TIME_HISTORY) + ",\"features\":[";
+
+	bool addcomma = false;
+	for (int i = 0; i < n; i++)
+	{
+		if (addcomma)
+			s += ",";
+		addcomma = list[i].getGeoJSON(s);
 	}
 	s += "]}";
 	return s;
 }
 
-// needs fix, content is defined locally and in getSinglePathJSON member content is used as helper
-std::string DB::getAllPathJSON()
+DB::PartWriter DB::writeAllPathJSON()
 {
-	std::lock_guard<std::mutex> lock(mtx);
+	std::shared_ptr<const Snapshot> snap = getSnapshot(false, true);
+	int i = -1;
 
-	std::string content = "{";
+	return [this, snap, i](std::string &s) mutable
+	{
+		std::size_t start = s.size();
 
-	std::time_t tm = time(nullptr);
-	int ptr = first;
+		if (i == -1)
+		{
+			s += "{";
+			i = 0;
+		}
 
-	delim = "";
-	while (ptr != -1)
-	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
+		for (; i < snap->active && s.size() - start < PART_SIZE; i++)
 		{
-			long int delta_time = (long int)tm - (long int)ship.last_signal;
-			if (delta_time > TIME_HISTORY)
-				break;
+			const PathPoint *path = snap->paths.data() + snap->path_start[i];
+			int n = snap->path_start[i + 1] - snap->path_start[i];
 
-			content += delim + "\"" + std::to_string(ship.mmsi) + "\":" + getSinglePathJSON(ptr);
-			delim = ",";
+			if (i)
+				s += ",";
+			s += "\"" + std::to_string(snap->ships[i].mmsi) + "\":" + getSinglePathJSON(path, n);
 		}
-		ptr = ships[ptr].next;
-	}
-	content += "}\n\n";
-	return content;
+
+		if (i < snap->active)
+			return true;
+
+		s += "}\n\n";
+		return false;
+	};
 }
 
-std::string DB::getSinglePathJSON(int idx)
+void DB::getPath(int idx, std::vector<PathPoint> &path)
 {
-	const std::string null_str = "null";
-	std::string str;
-
 	uint32_t mmsi = ships[idx].mmsi;
 	int ptr = ships[idx].path_ptr;
 	int t = ships[idx].count + 1;
 
-	content = "[";
-
-	while (isNextPathPoint(ptr, mmsi, t))
+	while (isNextPathBlock(ptr, mmsi, t))
 	{
+		const PathBlock &b = paths[ptr];
+
+		for (int i = b.n - 1; i >= 0; i--)
+			path.push_back(getPathPoint(b, i));
+
+		t = b.count;
+		ptr = b.next;
+	}
+}
+
+static int32_t toFixed(float x)
+{
+	return (int32_t)std::lround((double)x * 100000.0);
+}
+
+PathPoint DB::getPathPoint(const PathBlock &b, int i)
+{
+	PathPoint p;
+
+	p.lat = (float)((b.lat + b.points[i].lat) / 100000.0);
+	p.lon = (float)((b.lon + b.points[i].lon) / 100000.0);
+	p.timestamp_start = b.timestamp + b.points[i].start;
+	p.timestamp_end = b.timestamp + b.points[i].end;
+
+	return p;
+}
+
+// returns false if the point is out of the range of the offsets of the block
+bool DB::setPathPoint(PathBlock &b, int i, float lat, float lon, std::time_t start, std::time_t end)
+{
+	int32_t dlat = toFixed(lat) - b.lat;
+	int32_t dlon = toFixed(lon) - b.lon;
+	long ds = (long)(start - b.timestamp);
+	long de = (long)(end - b.timestamp);
+
+	if (dlat < INT16_MIN || dlat > INT16_MAX || dlon < INT16_MIN || dlon > INT16_MAX)
+		return false;
+
+	if (ds < 0 || de < ds || de > UINT16_MAX)
+		return false;
 
-		if (isValidCoord(paths[ptr].lat, paths[ptr].lon))
+	b.points[i].lat = (int16_t)dlat;
+	b.points[i].lon = (int16_t)dlon;
+	b.points[i].start = (uint16_t)ds;
+	b.points[i].end = (uint16_t)de;
+	return true;
+}
+
+std::string DB::getSinglePathJSON(const PathPoint *p, int n)
+{
+	std::string content = "[";
+
+	for (int i = 0; i < n; i++)
+	{
+		if (isValidCoord(p[i].lat, p[i].lon))
 		{
 			content += "[";
-			content += std::to_string(paths[ptr].lat);
+			content += std::to_string(p[i].lat);
 			content += ",";
-			content += std::to_string(paths[ptr].lon);
+			content += std::to_string(p[i].lon);
 			content += ",";
-			content += std::to_string(paths[ptr].timestamp_start);
+			content += std::to_string(p[i].timestamp_start);
 			content += ",";
-			content += std::to_string(paths[ptr].timestamp_end);
+			content += std::to_string(p[i].timestamp_end);
 			content += "],";
 		}
-		t = paths[ptr].count;
-		ptr = paths[ptr].next;
 	}
 	if (content != "[")
 		content.pop_back();
@@ -470,20 +1125,16 @@ std::string DB::getSinglePathJSON(int idx)
 	return content;
 }
 
-std::string DB::getSinglePathGeoJSON(int idx)
+std::string DB::getSinglePathGeoJSON(uint32_t mmsi, const PathPoint *p, int n)
 {
-	uint32_t mmsi = ships[idx].mmsi;
-	int ptr = ships[idx].path_ptr;
-	int t = ships[idx].count + 1;
-
 	std::string geojson = "{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[";
 	std::string timestamps_start = "\"timestamps_start\":[";
 	std::string timestamps_end = "\"timestamps_end\":[";
 
 	bool hasCoordinates = false;
-	while (isNextPathPoint(ptr, mmsi, t))
+	for (int i = 0; i < n; i++)
 	{
-		if (isValidCoord(paths[ptr].lat, paths[ptr].lon))
+		if (isValidCoord(p[i].lat, p[i].lon))
 		{
 			if (hasCoordinates)
 			{
@@ -494,17 +1145,15 @@ std::string DB::getSinglePathGeoJSON(int idx)
 
 			// GeoJSON uses [longitude, latitude] format (note the order!)
 			geojson += "[";
-			geojson += std::to_string(paths[ptr].lon);
+			geojson += std::to_string(p[i].lon);
 			geojson += ",";
-			geojson += std::to_string(paths[ptr].lat);
+			geojson += std::to_string(p[i].lat);
 			geojson += "]";
 
-			timestamps_start += std::to_string(paths[ptr].timestamp_start);
-			timestamps_end += std::to_string(paths[ptr].timestamp_end);
+			timestamps_start += std::to_string(p[i].timestamp_start);
+			timestamps_end += std::to_string(p[i].timestamp_end);
 			hasCoordinates = true;
 		}
-		t = paths[ptr].count;
-		ptr = paths[ptr].next;
 	}
 
 	timestamps_start += "]";
@@ -516,82 +1165,378 @@ std::string DB::getSinglePathGeoJSON(int idx)
 
 std::string DB::getPathJSON(uint32_t mmsi)
 {
-	std::lock_guard<std::mutex> lock(mtx);
-	int idx = findShip(mmsi);
-	if (idx == -1)
-		return "[]";
-	return getSinglePathJSON(idx);
+	std::vector<PathPoint> path;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		int idx = findShip(mmsi);
+		if (idx == -1)
+			return "[]";
+		getPath(idx, path);
+	}
+	return getSinglePathJSON(path.data(), (int)path.size());
 }
 
 std::string DB::getPathGeoJSON(uint32_t mmsi)
+{
+	std::vector<PathPoint> path;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		int idx = findShip(mmsi);
+		if (idx == -1)
+			return "{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[]},\"properties\":{\"mmsi\":" + std::to_string(mmsi) + "}}";
+		getPath(idx, path);
+	}
+	return getSinglePathGeoJSON(mmsi, path.data(), (int)path.size());
+}
+
+DB::PartWriter DB::writeAllPathGeoJSON()
+{
+	std::shared_ptr<const Snapshot> snap = getSnapshot(false, true);
+	int i = -1;
+
+	return [this, snap, i](std::string &s) mutable
+	{
+		std::size_t start = s.size();
+
+		if (i == -1)
+		{
+			s += "{\"type\":\"FeatureCollection\",\"features\":[";
+			i = 0;
+		}
+
+		for (; i < snap->active && s.size() - start < PART_SIZE; i++)
+		{
+			const PathPoint *path = snap->paths.data() + snap->path_start[i];
+			int n = snap->path_start[i + 1] - snap->path_start[i];
+
+			if (i)
+				s += ",";
+			s += getSinglePathGeoJSON(snap->ships[i].mmsi, path, n);
+		}
+
+		if (i < snap->active)
+			return true;
+
+		s += "]}\n\n";
+		return false;
+	};
+}
+
+void DB::makeSnapshot(Snapshot &s, bool all, bool with_paths)
+{
+	s.version = version;
+	s.all = all;
+	s.with_paths = with_paths;
+	s.count = count;
+	s.update_seq = update_seq;
+	s.removed_seq = removed_seq;
+	s.expired_seq = expired_seq;
+	s.active = -1;
+	s.epoch = epoch;
+	s.paths.clear();
+	s.path_start.clear();
+
+	// assign into the existing elements to reuse their memory
+	int n = 0;
+	for (int ptr = first; ptr != -1; ptr = ships[ptr].next)
+	{
+		if (ptr == expired_ptr)
+		{
+			s.active = n;
+			if (!all)
+				break;
+		}
+
+		const Ship &ship = ships[ptr];
+		if (ship.mmsi == 0)
+			continue;
+
+		if (n < (int)s.ships.size())
+			s.ships[n] = ship;
+		else
+			s.ships.push_back(ship);
+		n++;
+
+		if (with_paths)
+		{
+			s.path_start.push_back((int)s.paths.size());
+			getPath(ptr, s.paths);
+		}
+	}
+	s.ships.resize(n);
+
+	if (s.active == -1)
+		s.active = n;
+
+	if (with_paths)
+		s.path_start.push_back((int)s.paths.size());
+}
+
+std::shared_ptr<const DB::Snapshot> DB::getSnapshot(bool all, bool with_paths)
+{
+	std::lock_guard<std::mutex> lock(snapshot_mtx);
+
+	checkExpiry();
+
+	if (snapshot)
+	{
+		if (snapshot->version == version && (snapshot->all || !all) && (snapshot->with_paths || !with_paths))
+			return snapshot;
+
+		// content requested once by a client is likely requested again
+		all |= snapshot->all;
+		with_paths |= snapshot->with_paths;
+	}
+
+	// reuse the current copy if no reader is using it anymore
+	std::shared_ptr<Snapshot> s = snapshot && snapshot.use_count() == 1 ? snapshot : std::make_shared<Snapshot>();
+
+	{
+		std::lock_guard<std::mutex> l(mtx);
+		makeSnapshot(*s, all, with_paths);
+	}
+
+	snapshot = s;
+	return snapshot;
+}
+
+std::string DB::getMessage(uint32_t mmsi)
 {
 	std::lock_guard<std::mutex> lock(mtx);
-	int idx = findShip(mmsi);
-	if (idx == -1)
-		return "{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[]},\"properties\":{\"mmsi\":" + std::to_string(mmsi) + "}}";
-	return getSinglePathGeoJSON(idx);
+	int ptr = findShip(mmsi);
+	if (ptr == -1)
+		return "";
+
+	const MessageRef &m = messages[ptr];
+	const uint64_t N = msg_buffer.size();
+
+	// overwritten by newer messages
+	if (m.length == 0 || msg_pos - m.pos > N)
+		return "";
+
+	return std::string(&msg_buffer[m.pos % N], m.length);
+}
+
+void DB::storeMessage(int ptr, const std::string &s)
+{
+	const uint64_t N = msg_buffer.size();
+
+	if (s.empty() || s.size() > N)
+	{
+		messages[ptr].length = 0;
+		return;
+	}
+
+	// a message is never split over the end of the buffer
+	uint64_t offset = msg_pos % N;
+	if (offset + s.size() > N)
+		msg_pos += N - offset;
+
+	std::memcpy(&msg_buffer[msg_pos % N], s.data(), s.size());
+
+	messages[ptr].pos = msg_pos;
+	messages[ptr].length = (int)s.size();
+	msg_pos += s.size();
 }
 
-std::string DB::getAllPathGeoJSON()
-{
-	std::lock_guard<std::mutex> lock(mtx);
+int DB::indexFind(uint32_t mmsi)
+{
+	for (uint32_t h = indexHash(mmsi);; h = (h + 1) & index_mask)
+	{
+		int ptr = index[h];
+		if (ptr == -1 || ships[ptr].mmsi == mmsi)
+			return ptr;
+	}
+}
+
+void DB::indexInsert(uint32_t mmsi, int ptr)
+{
+	uint32_t h = indexHash(mmsi);
+
+	while (index[h] != -1)
+		h = (h + 1) & index_mask;
+
+	index[h] = ptr;
+}
+
+// backward shift deletion, keeps all probe sequences intact without tombstones
+void DB::indexRemove(uint32_t mmsi)
+{
+	uint32_t h = indexHash(mmsi);
+
+	while (index[h] != -1 && ships[index[h]].mmsi != mmsi)
+		h = (h + 1) & index_mask;
+
+	if (index[h] == -1)
+		return;
+
+	for (uint32_t j = (h + 1) & index_mask; index[j] != -1; j = (j + 1) & index_mask)
+	{
+		uint32_t home = indexHash(ships[index[j]].mmsi);
+
+		// move entry j into the hole if its home position is not in (h, j]
+		if (((j - home) & index_mask) >= ((j - h) & index_mask))
+		{
+			index[h] = index[j];
+			h = j;
+		}
+	}
+	index[h] = -1;
+}
+
+int DB::gridX(float lon)
+{
+	int x = (int)((lon + 180.0f) * (GRID_CELLS_LON / 360.0f));
+	return MAX(0, MIN(GRID_CELLS_LON - 1, x));
+}
+
+int DB::gridY(float lat)
+{
+	int y = (int)((lat + 90.0f) * (GRID_CELLS_LAT / 180.0f));
+	return MAX(0, MIN(GRID_CELLS_LAT - 1, y));
+}
+
+void DB::gridRemove(int ptr)
+{
+	int b = grid_bucket[ptr];
+	if (b == -1)
+		return;
+
+	if (grid_prev[ptr] != -1)
+		grid_next[grid_prev[ptr]] = grid_next[ptr];
+	else
+		grid[b] = grid_next[ptr];
+
+	if (grid_next[ptr] != -1)
+		grid_prev[grid_next[ptr]] = grid_prev[ptr];
+
+	grid_bucket[ptr] = grid_next[ptr] = grid_prev[ptr] = -1;
+}
+
+void DB::gridUpdate(int ptr)
+{
+	const Ship &ship = ships[ptr];
+	int b = isValidCoord(ship.lat, ship.lon) ? (int)gridHash(gridX(ship.lon), gridY(ship.lat)) : -1;
+
+	if (b == grid_bucket[ptr])
+		return;
+
+	gridRemove(ptr);
+
+	if (b == -1)
+		return;
+
+	grid_bucket[ptr] = b;
+	grid_next[ptr] = grid[b];
+	grid_prev[ptr] = -1;
+
+	if (grid[b] != -1)
+		grid_prev[grid[b]] = ptr;
+	grid[b] = ptr;
+}
+
+// returns the message count, read under the same lock as the list
+int DB::getShips(const Area &area, std::vector<Ship> &list)
+{
+	// cell ranges, two in longitude when crossing the antimeridian
+	int y0 = gridY(area.lat_min), y1 = gridY(area.lat_max);
+	int x0 = gridX(area.lon_min), x1 = gridX(area.lon_max);
+	int nx = area.lon_min <= area.lon_max ? x1 - x0 + 1 : GRID_CELLS_LON - x0 + x1 + 1;
+	long int ncells = (long int)nx * (y1 - y0 + 1);
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	// the grid only holds active ships
+	expire(Util::Clock::now());
+
+	auto add = [&](int ptr)
+	{
+		const Ship &ship = ships[ptr];
+
+		if (!isValidCoord(ship.lat, ship.lon) || !area.inBox(ship.lat, ship.lon))
+			return;
+
+		if (area.circle)
+		{
+			float distance;
+			int bearing;
+			getDistanceAndBearing(area.lat, area.lon, ship.lat, ship.lon, distance, bearing);
+			if (distance > area.radius)
+				return;
+		}
+
+		list.push_back(ship);
+	};
+
+	if (ncells > (long int)grid.size())
+	{
+		// large area, cheaper to go through all ships
+		for (int ptr = first; ptr != expired_ptr; ptr = ships[ptr].next)
+			if (ships[ptr].mmsi != 0)
+				add(ptr);
+		return count;
+	}
+
+	std::vector<uint32_t> buckets;
+	buckets.reserve(ncells);
 
-	std::string content = "{\"type\":\"FeatureCollection\",\"features\":[";
+	for (int y = y0; y <= y1; y++)
+		for (int i = 0, x = x0; i < nx; i++, x = (x + 1) % GRID_CELLS_LON)
+			buckets.push_back(gridHash(x, y));
 
-	std::time_t tm = time(nullptr);
-	int ptr = first;
+	// cells can share a bucket
+	std::sort(buckets.begin(), buckets.end());
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
 
-	std::string delim = "";
-	while (ptr != -1)
-	{
-		const Ship &ship = ships[ptr];
-		if (ship.mmsi != 0)
-		{
-			long int delta_time = (long int)tm - (long int)ship.last_signal;
-			if (delta_time > TIME_HISTORY)
-				break;
+	for (uint32_t b : buckets)
+		for (int ptr = grid[b]; ptr != -1; ptr = grid_next[ptr])
+			add(ptr);
 
-			content += delim + getSinglePathGeoJSON(ptr);
-			delim = ",";
-		}
-		ptr = ships[ptr].next;
-	}
-	content += "]}\n\n";
-	return content;
-}
+	// same order as the full list, most recently updated first
+	std::sort(list.begin(), list.end(), [](const Ship &a, const Ship &b)
+			  { return a.seq > b.seq; });
 
-std::string DB::getMessage(uint32_t mmsi)
-{
-	std::lock_guard<std::mutex> lock(mtx);
-	int ptr = findShip(mmsi);
-	if (ptr == -1)
-		return "";
-	return ships[ptr].msg;
+	return count;
 }
 
 int DB::findShip(uint32_t mmsi)
 {
-	int ptr = first, cnt = count;
-	while (ptr != -1 && --cnt >= 0)
-	{
-		if (ships[ptr].mmsi == mmsi)
-			return ptr;
-		ptr = ships[ptr].next;
-	}
-	return -1;
+	return indexFind(mmsi);
 }
 
-int DB::createShip()
+int DB::createShip(uint32_t mmsi)
 {
+	if (count == Nships && isActive(ships[last].last_signal))
+		growShips();
+
 	int ptr = last;
+
+	// recycle the least recently updated slot
+	if (count == Nships)
+	{
+		indexRemove(ships[ptr].mmsi);
+		gridRemove(ptr);
+		removed_seq = MAX(removed_seq, ships[ptr].seq);
+
+		if (track_removed)
+			removed_mmsi.push_back(ships[ptr].mmsi);
+	}
+
 	count = MIN(count + 1, Nships);
 	ships[ptr].reset();
+	ships[ptr].mmsi = mmsi;
+	messages[ptr].length = 0;
+	indexInsert(mmsi, ptr);
 
 	return ptr;
 }
 
 void DB::moveShipToFront(int ptr)
 {
+	// the ship becomes active again
+	if (ptr == expired_ptr)
+		expired_ptr = ships[ptr].next;
+
 	if (ptr == first)
 		return;
 
@@ -610,6 +1555,47 @@ void DB::moveShipToFront(int ptr)
 	first = ptr;
 }
 
+void DB::expire(std::time_t now)
+{
+	expire_time = now;
+
+	int ptr = expired_ptr == -1 ? last : ships[expired_ptr].prev;
+	bool changed = false;
+
+	while (ptr != -1 && (ships[ptr].mmsi == 0 || (long int)now - (long int)ships[ptr].last_signal > TIME_HISTORY))
+	{
+		if (ships[ptr].mmsi != 0)
+		{
+			gridRemove(ptr);
+			expired_seq = MAX(expired_seq, ships[ptr].seq);
+			changed = true;
+		}
+
+		expired_ptr = ptr;
+		ptr = ships[ptr].prev;
+	}
+
+	if (changed)
+		version++;
+}
+
+// ships can expire without updates coming in, readers check at most once per second
+void DB::checkExpiry()
+{
+	std::time_t now = Util::Clock::now();
+	if (now == expire_time)
+		return;
+
+	std::lock_guard<std::mutex> lock(mtx);
+	expire(now);
+}
+
+uint64_t DB::getVersion()
+{
+	checkExpiry();
+	return version;
+}
+
 void DB::addToPath(int ptr)
 {
 
@@ -620,47 +1606,123 @@ void DB::addToPath(int ptr)
 	uint32_t mmsi = ships[ptr].mmsi;
 	std::time_t timestamp = ships[ptr].last_signal;
 
-	if (isNextPathPoint(idx, mmsi, count))
+	if (isNextPathBlock(idx, mmsi, count))
 	{
+		PathBlock &b = paths[idx];
+		int last = b.n - 1;
+		PathPoint p = getPathPoint(b, last);
+
 		// path exists and ship did not move
-		if (paths[idx].lat == lat && paths[idx].lon == lon)
+		if (toFixed(lat) == b.lat + b.points[last].lat && toFixed(lon) == b.lon + b.points[last].lon)
 		{
-			paths[idx].count = ships[ptr].count;
-			paths[idx].timestamp_end = timestamp; // Update end time, keep start time
-			return;
+			// Update end time, keep start time
+			if (setPathPoint(b, last, lat, lon, p.timestamp_start, timestamp))
+				return;
 		}
-		// if there exist a previous path point, check if ship moved more than 100 meters and, if not, update clustered path point
-		int next = paths[idx].next;
-		if (isNextPathPoint(next, mmsi, paths[idx].count))
+		else
 		{
-			float lat_prev = paths[next].lat;
-			float lon_prev = paths[next].lon;
+			// if there exist a previous path point, check if ship moved more than 100 meters and, if not, update clustered path point
+			bool previous = false;
+			PathPoint q;
 
-			float d = (lat_prev - lat) * (lat_prev - lat) + (lon_prev - lon) * (lon_prev - lon);
+			if (last > 0)
+			{
+				q = getPathPoint(b, last - 1);
+				previous = true;
+			}
+			else if (isNextPathBlock(b.next, mmsi, b.count))
+			{
+				q = getPathPoint(paths[b.next], paths[b.next].n - 1);
+				previous = true;
+			}
 
-			if (d < 0.000001)
+			if (previous)
 			{
+				float d = (q.lat - lat) * (q.lat - lat) + (q.lon - lon) * (q.lon - lon);
+
 				// Update clustered point: keep start time, update end time and position
-				paths[idx].lat = lat;
-				paths[idx].lon = lon;
-				paths[idx].count = ships[ptr].count;
-				paths[idx].timestamp_end = timestamp; // Keep timestamp_start unchanged
-				return;
+				if (d < 0.000001 && setPathPoint(b, last, lat, lon, p.timestamp_start, timestamp))
+					return;
 			}
 		}
+
+		// add new path point to the block
+		if (b.n < PathBlock::SIZE && setPathPoint(b, b.n, lat, lon, timestamp, timestamp))
+		{
+			b.n++;
+			return;
+		}
 	}
 
-	// create new path point
-	paths[path_idx].next = idx;
-	paths[path_idx].lat = lat;
-	paths[path_idx].lon = lon;
-	paths[path_idx].mmsi = ships[ptr].mmsi;
-	paths[path_idx].count = ships[ptr].count;
-	paths[path_idx].timestamp_start = timestamp; // New point: start and end are the same initially
-	paths[path_idx].timestamp_end = timestamp;
+	// start a new block with the point as reference
+	PathBlock &b = paths[path_idx];
+
+	b.mmsi = mmsi;
+	b.count = count;
+	b.next = idx;
+	b.n = 1;
+	b.lat = toFixed(lat);
+	b.lon = toFixed(lon);
+	b.timestamp = timestamp;
+	b.points[0] = {0, 0, 0, 0};
 
 	ships[ptr].path_ptr = path_idx;
-	path_idx = (path_idx + 1) % Npaths;
+	path_idx++;
+
+	// the oldest block is next, grow if it is still part of an active path
+	if (path_idx == Npaths && !(isActive(paths[0].timestamp) && growPaths()))
+		path_idx = 0;
+}
+
+// new blocks are appended to the ring right where path_idx continues
+bool DB::growPaths()
+{
+	int n = Npaths + Npaths / 2;
+	if (getMemory(Nships, n) > memory_limit)
+		return false;
+
+	paths.resize(n);
+	Npaths = n;
+
+	grow_count++;
+	MemoryBudget::account(MemoryBudget::SHIPS, memory_reported, getMemory());
+	Info() << "DB: path storage grown to " << Npaths * PathBlock::SIZE << " path points (" << getMemory() / 1024 << " of " << memory_limit / 1024 << " KB)";
+	return true;
+}
+
+std::string DB::getMemoryJSON()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	std::size_t ships = Nships * (sizeof(Ship) + sizeof(MessageRef) + 3 * sizeof(int));
+	std::size_t index = 2 * indexSize(Nships) * sizeof(int);
+	std::size_t paths = Npaths * sizeof(PathBlock);
+
+	return "{\"ships\":" + std::to_string(ships) + ",\"index\":" + std::to_string(index) + ",\"paths\":" + std::to_string(paths) +
+		   ",\"messages\":" + std::to_string(msg_buffer.size()) + ",\"limit\":" + std::to_string(memory_limit) + "}";
+}
+
+std::string DB::getPrometheus()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	std::string element;
+	element += "# HELP ais_db_size Number of ships the table can hold\n";
+	element += "# TYPE ais_db_size gauge\n";
+	element += "ais_db_size " + std::to_string(Nships) + "\n";
+	element += "# HELP ais_db_path_blocks Number of path blocks\n";
+	element += "# TYPE ais_db_path_blocks gauge\n";
+	element += "ais_db_path_blocks " + std::to_string(Npaths) + "\n";
+	element += "# HELP ais_db_memory_bytes Memory used by the ship database\n";
+	element += "# TYPE ais_db_memory_bytes gauge\n";
+	element += "ais_db_memory_bytes " + std::to_string(getMemory()) + "\n";
+	element += "# HELP ais_db_memory_limit_bytes Memory the ship database can grow to\n";
+	element += "# TYPE ais_db_memory_limit_bytes gauge\n";
+	element += "ais_db_memory_limit_bytes " + std::to_string(memory_limit) + "\n";
+	element += "# HELP ais_db_grow Number of times the ship database was grown\n";
+	element += "# TYPE ais_db_grow counter\n";
+	element += "ais_db_grow " + std::to_string(grow_count) + "\n";
+	return element;
 }
 
 bool DB::updateFields(const JSON::Property &p, const AIS::Message *msg, Ship &v, bool allowApproximate)
@@ -865,40 +1927,30 @@ bool DB::updateShip(const JSON::JSON &data, TAG &tag, Ship &ship)
 			lon = ship.lon;
 		}
 	}
-
-	if (msg_save)
-	{
-		ship.msg.clear();
-		builder.stringify(data, ship.msg);
-	}
 	return positionUpdated;
 }
 
-void DB::processBinaryMessage(const JSON::JSON &data, Ship &ship, bool &position_updated)
+void DB::processBinaryMessage(const JSON::JSON &data, TAG &tag, Ship &ship, bool &position_updated)
 {
 	const AIS::Message *msg = (AIS::Message *)data.binary;
 	int type = msg->type();
+	int dac = -1, fi = -1;
 	FLOAT32 loc_lat = LAT_UNDEFINED, loc_lon = LON_UNDEFINED;
 
 	// Only process binary message types 6 and 8
 	if (type != 6 && type != 8)
 		return;
 
-	BinaryMessage &binmsg = binaryMessages[binaryMsgIndex];
-	binmsg.Clear();
-
-	binmsg.type = type;
-
 	// Extract DAC and FI from message
 	for (const auto &p : data.getProperties())
 	{
 		if (p.Key() == AIS::KEY_DAC)
 		{
-			binmsg.dac = p.Get().getInt();
+			dac = p.Get().getInt();
 		}
 		else if (p.Key() == AIS::KEY_FID)
 		{
-			binmsg.fi = p.Get().getInt();
+			fi = p.Get().getInt();
 		}
 		else if (p.Key() == AIS::KEY_LAT)
 		{
@@ -910,12 +1962,34 @@ void DB::processBinaryMessage(const JSON::JSON &data, Ship &ship, bool &position
 		}
 	}
 
-	// if (binmsg.dac != -1 && binmsg.fi != -1)
-	if (binmsg.dac == 1 && binmsg.fi == 31)
+	// if (dac != -1 && fi != -1)
+	if (dac == 1 && fi == 31)
 	{
+		const uint64_t key = ((uint64_t)dac << 40) | ((uint64_t)fi << 32) | msg->mmsi();
+
+		auto it = binary_messages.find(key);
+
+		if (it == binary_messages.end() && (int)binary_messages.size() >= binary_max)
+		{
+			auto oldest = binary_messages.begin();
+			for (auto b = binary_messages.begin(); b != binary_messages.end(); ++b)
+				if (b->second.timestamp < oldest->second.timestamp)
+					oldest = b;
+
+			binary_messages.erase(oldest);
+		}
+
+		BinaryMessage &binmsg = binary_messages[key];
+
+		binmsg.msg = *msg;
+		binmsg.tag = tag;
+		binmsg.type = type;
+		binmsg.dac = dac;
+		binmsg.fi = fi;
 		binmsg.json.clear();
-		builder.stringify(data, binmsg.json);
-		binmsg.used = true;
+		binmsg.lat = LAT_UNDEFINED;
+		binmsg.lon = LON_UNDEFINED;
+
 		if (isValidCoord(loc_lat, loc_lon))
 		{
 			binmsg.lat = loc_lat;
@@ -930,43 +2004,76 @@ void DB::processBinaryMessage(const JSON::JSON &data, Ship &ship, bool &position
 			}
 		}
 		binmsg.timestamp = msg->getRxTimeUnix();
-		binaryMsgIndex = (binaryMsgIndex + 1) % MAX_BINARY_MESSAGES;
+		binary_version++;
 	}
 }
 
-std::string DB::getBinaryMessagesJSON() const
+std::string DB::getBinaryMessagesJSON()
 {
-	std::string result = "[";
-	bool first = true;
+	std::lock_guard<std::mutex> lock(mtx);
+
+	std::time_t tm = Util::Clock::now();
+
+	if (binary_json_version == binary_version && tm < binary_json_expires)
+		return binary_json;
+
+	// newest message first
+	std::vector<BinaryMessage *> list;
+	for (auto &b : binary_messages)
+		if ((long int)tm - (long int)b.second.timestamp <= TIME_HISTORY)
+			list.push_back(&b.second);
 
-	// Start from newest message and go backward
-	int startIndex = (binaryMsgIndex + MAX_BINARY_MESSAGES - 1) % MAX_BINARY_MESSAGES;
-	std::time_t tm = time(nullptr);
+	std::sort(list.begin(), list.end(), [](const BinaryMessage *a, const BinaryMessage *b)
+			  { return a->timestamp > b->timestamp; });
 
-	for (int i = 0; i < MAX_BINARY_MESSAGES; i++)
+	binary_json = "[";
+	binary_json_expires = tm + TIME_HISTORY + 1;
+
+	for (std::size_t i = 0; i < list.size(); i++)
 	{
-		int idx = (startIndex - i + MAX_BINARY_MESSAGES) % MAX_BINARY_MESSAGES;
-		const BinaryMessage &msg = binaryMessages[idx];
+		BinaryMessage &msg = *list[i];
 
-		if (!msg.used || (long int)tm - (long int)msg.timestamp > TIME_HISTORY)
-			continue;
+		if (msg.json.empty())
+		{
+			msg.json = "{\"type\":" + std::to_string(msg.type) + ",";
+			msg.json += "\"dac\":" + std::to_string(msg.dac) + ",";
+			msg.json += "\"fi\":" + std::to_string(msg.fi) + ",";
+			msg.json += "\"timestamp\":" + std::to_string(msg.timestamp) + ",";
+			msg.json += "\"message\":";
+			builder.stringify(binary_decoder.Decode(msg.msg, msg.tag), msg.json);
+			msg.json += "}";
+		}
 
-		if (!first)
-			result += ",";
-		else
-			first = false;
+		if (i)
+			binary_json += ",";
+		binary_json += msg.json;
 
-		result += "{";
-		result += "\"type\":" + std::to_string(msg.type) + ",";
-		result += "\"dac\":" + std::to_string(msg.dac) + ",";
-		result += "\"fi\":" + std::to_string(msg.fi) + ",";
-		result += "\"timestamp\":" + std::to_string(msg.timestamp) + ",";
-		result += "\"message\":" + msg.json;
-		result += "}";
+		binary_json_expires = MIN(binary_json_expires, (std::time_t)(msg.timestamp + TIME_HISTORY + 1));
 	}
 
-	result += "]";
-	return result;
+	binary_json += "]";
+	binary_json_version = binary_version;
+	return binary_json;
+}
+
+bool DB::getKeys(std::vector<int> &keys)
+{
+	// full message is stored
+	if (msg_save)
+		return false;
+
+	static const int fields[] = {
+		AIS::KEY_LAT, AIS::KEY_LON, AIS::KEY_SHIPTYPE, AIS::KEY_IMO, AIS::KEY_MONTH, AIS::KEY_DAY, AIS::KEY_HOUR, AIS::KEY_MINUTE,
+		AIS::KEY_HEADING, AIS::KEY_DRAUGHT, AIS::KEY_COURSE, AIS::KEY_SPEED, AIS::KEY_STATUS, AIS::KEY_TO_BOW, AIS::KEY_TO_STERN,
+		AIS::KEY_TO_PORT, AIS::KEY_TO_STARBOARD, AIS::KEY_RECEIVED_STATIONS, AIS::KEY_ALT, AIS::KEY_VIRTUAL_AID, AIS::KEY_CS,
+		AIS::KEY_RAIM, AIS::KEY_DTE, AIS::KEY_ASSIGNED, AIS::KEY_DISPLAY, AIS::KEY_DSC, AIS::KEY_BAND, AIS::KEY_MSG22,
+		AIS::KEY_OFF_POSITION, AIS::KEY_MANEUVER, AIS::KEY_NAME, AIS::KEY_SHIPNAME, AIS::KEY_CALLSIGN, AIS::KEY_COUNTRY_CODE,
+		AIS::KEY_DESTINATION, AIS::KEY_DAC, AIS::KEY_FID};
+
+	keys.insert(keys.end(), std::begin(fields), std::end(fields));
+
+	// messages are forwarded downstream
+	return JSON::KeySet::getKeys(out.getConnections(), keys);
 }
 
 void DB::Receive(const JSON::JSON *data, int len, TAG &tag)
@@ -982,16 +2089,20 @@ void DB::Receive(const JSON::JSON *data, int len, TAG &tag)
 	if (type < 1 || type > 27 || msg->mmsi() == 0)
 		return;
 
+	expire(Util::Clock::now());
+
 	// setup/find ship in database
 	int ptr = findShip(msg->mmsi());
 
 	if (ptr == -1)
-		ptr = createShip();
+		ptr = createShip(msg->mmsi());
 
 	moveShipToFront(ptr);
 
 	// update ship and tag data
 	Ship &ship = ships[ptr];
+	ship.seq = ++update_seq;
+	version++;
 
 	// save some data for later on
 	tag.previous_signal = ship.last_signal;
@@ -1000,13 +2111,21 @@ void DB::Receive(const JSON::JSON *data, int len, TAG &tag)
 	float lon_old = ship.lon;
 
 	bool position_updated = updateShip(data[0], tag, ship);
+	gridUpdate(ptr);
+
+	if (msg_save)
+	{
+		msg_scratch.clear();
+		builder.stringifyCached(data[0], msg_scratch);
+		storeMessage(ptr, msg_scratch);
+	}
 	position_updated &= isValidCoord(ship.lat, ship.lon);
 
 	if (type == 1 || type == 2 || type == 3 || type == 18 || type == 19 || type == 9)
 		addToPath(ptr);
 
 	if (type == 6 || type == 8)
-		processBinaryMessage(data[0], ship, position_updated);
+		processBinaryMessage(data[0], tag, ship, position_updated);
 
 	// update ship with distance and bearing if position is updated with message
 	if (position_updated && isValidCoord(lat, lon))
@@ -1058,67 +2177,207 @@ void DB::Receive(const JSON::JSON *data, int len, TAG &tag)
 	Send(data, len, tag);
 }
 
-bool DB::Save(std::ofstream &file)
+// the backup stores the ship table as one block of Ship records, oldest first. The
+// table is copied under the lock and written after the lock is released.
+static_assert(std::is_trivially_copyable<Ship>::value, "Ship is written to the backup as a block");
+
+// takes over a ship record from a backup or a replication source as the latest update
+int DB::storeShip(const Ship &ship)
+{
+	int ptr = findShip(ship.mmsi);
+	if (ptr == -1)
+		ptr = createShip(ship.mmsi);
+
+	moveShipToFront(ptr);
+
+	// copy ship data while preserving the links, paths are not part of the record
+	int next_ptr = ships[ptr].next;
+	int prev_ptr = ships[ptr].prev;
+	int path_ptr = ships[ptr].path_ptr;
+
+	ships[ptr] = ship;
+
+	ships[ptr].next = next_ptr;
+	ships[ptr].prev = prev_ptr;
+	ships[ptr].path_ptr = path_ptr;
+	ships[ptr].seq = ++update_seq;
+	version++;
+
+	gridUpdate(ptr);
+	return ptr;
+}
+
+// clears the slot and moves it to the end of the list, where createShip takes the next free slot
+void DB::removeShip(int ptr)
+{
+	indexRemove(ships[ptr].mmsi);
+	gridRemove(ptr);
+	removed_seq = MAX(removed_seq, ships[ptr].seq);
+
+	if (ptr == expired_ptr)
+		expired_ptr = ships[ptr].next;
+
+	if (ptr != last)
+	{
+		if (ships[ptr].prev != -1)
+			ships[ships[ptr].prev].next = ships[ptr].next;
+		else
+			first = ships[ptr].next;
+		ships[ships[ptr].next].prev = ships[ptr].prev;
+
+		ships[last].next = ptr;
+		ships[ptr].prev = last;
+		ships[ptr].next = -1;
+		last = ptr;
+	}
+
+	// a free slot counts as expired
+	if (expired_ptr == -1)
+		expired_ptr = ptr;
+
+	ships[ptr].reset();
+	messages[ptr].length = 0;
+	count--;
+	version++;
+}
+
+void DB::removeShips(const std::vector<uint32_t> &mmsi)
 {
 	std::lock_guard<std::mutex> lock(mtx);
 
-	// Write magic number and version
-	int magic = _DB_MAGIC;
-	int version = _DB_VERSION;
+	for (uint32_t m : mmsi)
+	{
+		int ptr = findShip(m);
+		if (ptr != -1)
+			removeShip(ptr);
+	}
+}
 
-	if (!file.write((const char *)&magic, sizeof(int)))
-		return false;
-	if (!file.write((const char *)&version, sizeof(int)))
-		return false;
+void DB::removeActiveUpTo(uint64_t seq)
+{
+	std::lock_guard<std::mutex> lock(mtx);
 
-	// Write ship count first
-	if (!file.write((const char *)&count, sizeof(int)))
-		return false;
+	expire(Util::Clock::now());
+
+	std::vector<int> stale;
+	for (int ptr = first; ptr != expired_ptr; ptr = ships[ptr].next)
+		if (ships[ptr].mmsi != 0 && ships[ptr].seq <= seq)
+			stale.push_back(ptr);
+
+	for (int ptr : stale)
+		removeShip(ptr);
+}
+
+void DB::setTrackRemoved(bool b)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	track_removed = b;
+	removed_mmsi.clear();
+}
+
+uint64_t DB::getUpdateSeq()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return update_seq;
+}
 
-	// Find the last ship by going count steps from first
-	int ptr = first;
-	for (int i = 1; i < count; i++)
+uint64_t DB::getChanges(std::vector<Ship> &list, std::vector<uint32_t> &removed, uint64_t since_seq)
+{
 	{
-		if (ptr == -1)
-			break;
-		ptr = ships[ptr].next;
+		std::lock_guard<std::mutex> lock(mtx);
+
+		removed.swap(removed_mmsi);
+		removed_mmsi.clear();
 	}
 
-	// Write ships from last ship backwards to first
-	int ships_written;
-	for (ships_written = 0; ships_written < count; ships_written++)
+	// a ship removed and back in between is in both lists, removals are applied first
+	return getChanges(list, since_seq);
+}
+
+uint64_t DB::getChanges(std::vector<Ship> &list, uint64_t since_seq)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	expire(Util::Clock::now());
+	list.clear();
+
+	// ships are ordered by last update, the changed ones come first
+	for (int ptr = first; ptr != expired_ptr && ships[ptr].seq > since_seq; ptr = ships[ptr].next)
+		if (ships[ptr].mmsi != 0)
+			list.push_back(ships[ptr]);
+
+	return update_seq;
+}
+
+void DB::applyChanges(const std::vector<Ship> &list)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	expire(Util::Clock::now());
+
+	// oldest first so that the update order is the same as on the source
+	for (auto it = list.rbegin(); it != list.rend(); ++it)
 	{
-		if (ptr == -1)
-			break;
+		int ptr = findShip(it->mmsi);
+		bool moved = ptr == -1 || ships[ptr].lat != it->lat || ships[ptr].lon != it->lon;
 
-		// Use Ship's Save method instead of direct binary write
-		if (!ships[ptr].Save(file))
-			return false;
+		ptr = storeShip(*it);
 
-		ptr = ships[ptr].prev;
+		if (moved && isValidCoord(ships[ptr].lat, ships[ptr].lon))
+			addToPath(ptr);
+	}
+}
+
+bool DB::Save(std::ofstream &file)
+{
+	std::vector<Ship> list;
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		list.reserve(count);
+		for (int ptr = first; ptr != -1 && (int)list.size() < count; ptr = ships[ptr].next)
+			list.push_back(ships[ptr]);
 	}
 
-	Info() << "DB: Saved " << ships_written << " ships to backup";
+	std::reverse(list.begin(), list.end());
+
+	int magic = _DB_MAGIC;
+	int version = _DB_VERSION;
+	int n = (int)list.size();
+	int size = (int)sizeof(Ship);
+
+	if (!file.write((const char *)&magic, sizeof(int)))
+		return false;
+	if (!file.write((const char *)&version, sizeof(int)))
+		return false;
+	if (!file.write((const char *)&n, sizeof(int)))
+		return false;
+	if (!file.write((const char *)&size, sizeof(int)))
+		return false;
+	if (!file.write((const char *)list.data(), (std::streamsize)n * size))
+		return false;
+
+	Info() << "DB: Saved " << n << " ships to backup";
 	return true;
 }
 
 bool DB::Load(std::ifstream &file)
 {
-	std::lock_guard<std::mutex> lock(mtx);
-
 	std::cerr << "Loading ships from backup file." << std::endl;
 
-	int magic = 0, version = 0;
+	int magic = 0, file_version = 0;
 
 	if (!file.read((char *)&magic, sizeof(int)))
 		return false;
-	if (!file.read((char *)&version, sizeof(int)))
+	if (!file.read((char *)&file_version, sizeof(int)))
 		return false;
 
-	if (magic != _DB_MAGIC || version != _DB_VERSION)
+	if (magic != _DB_MAGIC || (file_version != _DB_VERSION && file_version != 1))
 	{
 		Warning() << "DB: Invalid backup file format. Magic: " << std::hex << magic
-				  << ", Version: " << version;
+				  << ", Version: " << file_version;
 		return false;
 	}
 
@@ -1127,50 +2386,115 @@ bool DB::Load(std::ifstream &file)
 	if (!file.read((char *)&ship_count, sizeof(int)))
 		return false;
 
-	if (ship_count < 0 || ship_count > Nships)
+	if (ship_count < 0 || getMemory(ship_count, 0) > memory_limit)
 	{
 		Warning() << "DB: Invalid ship count in backup file: " << ship_count;
 		return false;
 	}
 
-	// Load ships and validate chronological order (oldest first, then newer)
-	std::time_t previous_signal = 0;
-	for (int i = 0; i < ship_count; i++)
+	std::vector<Ship> list(ship_count);
+
+	if (file_version == 1)
+	{
+		// ships written field by field
+		for (int i = 0; i < ship_count; i++)
+		{
+			if (!list[i].Load(file))
+			{
+				std::cout << "DB: Failed to read ship " << i << " from backup file." << std::endl;
+				return false;
+			}
+		}
+	}
+	else
 	{
-		Ship temp_ship;
+		int size = 0;
+		if (!file.read((char *)&size, sizeof(int)))
+			return false;
+
+		if (size != (int)sizeof(Ship))
+		{
+			Warning() << "DB: backup written with a different ship record layout, ignored.";
+			return false;
+		}
 
-		if (!temp_ship.Load(file))
+		if (!file.read((char *)list.data(), (std::streamsize)ship_count * size))
 		{
-			std::cout << "DB: Failed to read ship " << i << " from backup file." << std::endl;
+			std::cout << "DB: Failed to read ships from backup file." << std::endl;
 			return false;
 		}
+	}
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	while (Nships < ship_count && growShips())
+		;
 
-		// Validate chronological order - ships should be oldest first
-		if (i > 0 && temp_ship.last_signal < previous_signal)
+	// Validate chronological order - ships should be oldest first
+	for (int i = 1; i < ship_count; i++)
+	{
+		if (list[i].last_signal < list[i - 1].last_signal)
 		{
 			Error() << "DB: Ships not in chronological order at index " << i;
 			return false;
 		}
+	}
+
+	for (const Ship &ship : list)
+		storeShip(ship);
+
+	Info() << "DB: Restored " << ship_count << " ships from backup";
+	return true;
+}
+
+bool DB::SaveChanges(std::ofstream &file, uint64_t &seq)
+{
+	std::vector<Ship> list;
+	uint64_t next = getChanges(list, seq);
+
+	int magic = _DB_MAGIC;
+	int version = _DB_VERSION;
+	int n = (int)list.size();
+	int size = (int)sizeof(Ship);
+
+	if (!file.write((const char *)&magic, sizeof(int)))
+		return false;
+	if (!file.write((const char *)&version, sizeof(int)))
+		return false;
+	if (!file.write((const char *)&n, sizeof(int)))
+		return false;
+	if (!file.write((const char *)&size, sizeof(int)))
+		return false;
+	if (!file.write((const char *)list.data(), (std::streamsize)n * size))
+		return false;
+
+	seq = next;
+	return true;
+}
 
-		previous_signal = temp_ship.last_signal;
+bool DB::LoadChanges(std::ifstream &file)
+{
+	int magic = 0, version = 0, n = 0, size = 0;
 
-		// Find or create ship entry using existing mechanisms
-		int ptr = findShip(temp_ship.mmsi);
-		if (ptr == -1)
-			ptr = createShip();
+	if (!file.read((char *)&magic, sizeof(int)) || !file.read((char *)&version, sizeof(int)))
+		return false;
+	if (!file.read((char *)&n, sizeof(int)) || !file.read((char *)&size, sizeof(int)))
+		return false;
 
-		moveShipToFront(ptr);
+	if (magic != _DB_MAGIC || version != _DB_VERSION || size != (int)sizeof(Ship) || n < 0 || getMemory(n, 0) > memory_limit)
+		return false;
 
-		// Copy ship data while preserving linked list pointers
-		int next_ptr = ships[ptr].next;
-		int prev_ptr = ships[ptr].prev;
+	std::vector<Ship> list(n);
 
-		ships[ptr] = temp_ship;
+	if (!file.read((char *)list.data(), (std::streamsize)n * size))
+		return false;
 
-		ships[ptr].next = next_ptr;
-		ships[ptr].prev = prev_ptr;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		while (Nships < count + n && growShips())
+			;
 	}
 
-	Info() << "DB: Restored " << ship_count << " ships from backup";
+	applyChanges(list);
 	return true;
 }
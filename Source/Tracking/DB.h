@@ -19,6 +19,9 @@
 #include <iostream>
 #include <string.h>
 #include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
 
 #include "AIS.h"
 #include "JSONAIS.h"
@@ -31,43 +34,82 @@
 struct PathPoint
 {
 	float lat, lon;
-	uint32_t mmsi = 0;
 	std::time_t timestamp_start = 0;
 	std::time_t timestamp_end = 0;
+};
+
+// part of the track of one ship: up to SIZE points stored as offsets from the first point in 1e-5
+// degrees and seconds. Blocks of a ship are linked from new to old via next and are recycled in
+// order of allocation, count is the message count of the ship when the block was started.
+struct PathBlock
+{
+	static const int SIZE = 16;
+
+	uint32_t mmsi = 0;
 	int count = 0;
-	int next = 0;
+	int next = -1;
+	int n = 0;
+	int32_t lat = 0, lon = 0;
+	std::time_t timestamp = 0;
+
+	struct Point
+	{
+		int16_t lat, lon;
+		uint16_t start, end;
+	} points[SIZE];
 };
 
+// latest binary message of a (DAC, FI, MMSI), the message is kept as received and only decoded to JSON
+// when it is requested
 struct BinaryMessage
 {
+	AIS::Message msg;
+	TAG tag;
+	int type = -1;
+	int dac = -1;
+	int fi = -1;
+	FLOAT32 lat = LAT_UNDEFINED, lon = LON_UNDEFINED;
+	time_t timestamp = 0;
+
+	// the entry of /api/binmsgs.json, empty until rendered
 	std::string json;
-	int type;
-	int dac;
-	int fi;
-	FLOAT32 lat, lon;
-	time_t timestamp;
-	bool used;
+};
 
-	BinaryMessage() { Clear(); }
+// area for spatial queries, a bounding box or a circle with radius in nautical miles
+struct Area
+{
+	bool circle = false;
+	float lat_min = 0, lon_min = 0, lat_max = 0, lon_max = 0;
+	float lat = 0, lon = 0, radius = 0;
 
-	void Clear()
-	{
-		used = false;
-		type = dac = fi = -1;
-		lat = LAT_UNDEFINED;
-		lon = LON_UNDEFINED;
-	};
+	// "bbox=lat_min,lon_min,lat_max,lon_max" or "radius=lat,lon,nmi", lon_min > lon_max crosses the antimeridian
+	bool parse(const std::string &s);
+	bool inBox(float lat, float lon) const;
+};
+
+// fields of the ships in the JSON documents, parsed once per request into the list of fields to write
+struct Projection
+{
+	std::vector<int> fields;
+	// the names as requested, identifies the projection in caches
+	std::string key;
+
+	// "mmsi,lat,lon" with the names of ships_full.json, false if a name is unknown or repeated
+	bool parse(const std::string &s);
+	bool empty() const { return fields.empty(); }
+
+	static const char *name(int field);
 };
 
 class DB : public StreamIn<JSON::JSON>,
 		   public StreamIn<AIS::GPS>,
+		   public JSON::KeySet,
 		   public StreamOut<JSON::JSON>
 {
 
 	JSON::StringBuilder builder;
 
 	int first, last, count, path_idx = 0;
-	std::string content, delim;
 	float lat = LAT_UNDEFINED, lon = LON_UNDEFINED;
 	int TIME_HISTORY = 30 * 60;
 	bool latlon_share = false;
@@ -76,11 +118,118 @@ class DB : public StreamIn<JSON::JSON>,
 	bool use_GPS = true;
 	uint32_t own_mmsi = 0;
 
-	int Nships = 4096;
-	int Npaths = 4096 * 16;
+	static const int SHIPS_INIT = 4096;
+	static const int PATHS_INIT = 4096 * 4;
+
+	int Nships = SHIPS_INIT;
+	int Npaths = PATHS_INIT;
 
 	std::vector<Ship> ships;
-	std::vector<PathPoint> paths;
+	std::vector<PathBlock> paths;
+
+	// the tables grow by half instead of recycling ships or path blocks that are still within
+	// TIME_HISTORY, as long as the total stays under memory_limit. Slots are only appended so
+	// the prev/next/path_ptr links keep their meaning. memory_cap 0 is the share of the memory budget
+	// (MemoryBudget) if set, else 8 times the initial size.
+	std::size_t memory_cap = 0, memory_limit = 0;
+	int grow_count = 0;
+
+	static uint32_t indexSize(int n);
+	std::size_t getMemory(int n_ships, int n_paths);
+	std::size_t memory_reported = 0;
+	bool isActive(std::time_t t) { return (long int)Util::Clock::now() - (long int)t <= TIME_HISTORY; }
+	bool growShips();
+	bool growPaths();
+
+	// last message of ships[i] as JSON (only with msg_save), stored in a ring buffer with
+	// a fixed size so memory use does not grow, the oldest messages are overwritten first
+	struct MessageRef
+	{
+		uint64_t pos = 0;
+		int length = 0;
+	};
+
+	std::vector<MessageRef> messages;
+	std::vector<char> msg_buffer;
+	uint64_t msg_pos = 0;
+	int msg_buffer_size = 0;
+	std::string msg_scratch;
+
+	void storeMessage(int ptr, const std::string &s);
+
+	// update sequence for incremental clients: every ship update gets the next number,
+	// ships with a number up to removed_seq have been recycled, epoch changes on reset
+	uint64_t update_seq = 0, removed_seq = 0;
+	std::time_t epoch = 0;
+
+	// ships are ordered by last update so the ones older than TIME_HISTORY form the tail of the
+	// list, expired_ptr is the head of that tail (-1 if none). expire() moves the boundary up
+	// from the tail, every ship crosses it once per activation. Expired ships leave the grid
+	// and the highest sequence number among them is expired_seq.
+	int expired_ptr = -1;
+	uint64_t expired_seq = 0;
+	std::atomic<std::time_t> expire_time{0};
+
+	void expire(std::time_t now);
+	void checkExpiry();
+
+	// MMSI of the recycled ships, collected for replication only
+	bool track_removed = false;
+	std::vector<uint32_t> removed_mmsi;
+
+	void removeShip(int ptr);
+
+	// copy of the ship table for the web queries, these serialize from the copy so
+	// that slow clients do not hold up Receive. Rebuilt only when the table changed.
+	struct Snapshot
+	{
+		uint64_t version = 0;
+		bool all = false, with_paths = false;
+		int count = 0, active = 0;
+		uint64_t update_seq = 0, removed_seq = 0, expired_seq = 0;
+		std::time_t epoch = 0;
+
+		// ships by last update of which the first active ones are within TIME_HISTORY,
+		// path of ships[i] is paths[path_start[i]] up to paths[path_start[i + 1]]
+		std::vector<Ship> ships;
+		std::vector<PathPoint> paths;
+		std::vector<int> path_start;
+	};
+
+	std::atomic<uint64_t> version{0};
+	std::shared_ptr<Snapshot> snapshot;
+	std::mutex snapshot_mtx;
+
+	void makeSnapshot(Snapshot &s, bool all, bool with_paths);
+	std::shared_ptr<const Snapshot> getSnapshot(bool all, bool with_paths = false);
+
+	// first n ships of list
+	std::string getJSONcompact(const std::vector<Ship> &list, int n, int count);
+	std::string getGeoJSON(const std::vector<Ship> &list, int n);
+
+	// open addressing hash index from mmsi to slot in ships (linear probing, -1 is empty)
+	std::vector<int> index;
+	uint32_t index_mask = 0;
+
+	uint32_t indexHash(uint32_t mmsi) { return (mmsi * 2654435761u) & index_mask; }
+	int indexFind(uint32_t mmsi);
+	void indexInsert(uint32_t mmsi, int ptr);
+	void indexRemove(uint32_t mmsi);
+
+	// spatial hash grid on ship position: cells of 0.25 degrees are hashed into
+	// buckets, each bucket is a linked list of ships (grid_next/grid_prev, -1 is end)
+	static const int GRID_CELLS_LON = 1440;
+	static const int GRID_CELLS_LAT = 720;
+
+	std::vector<int> grid, grid_next, grid_prev, grid_bucket;
+	uint32_t grid_mask = 0;
+
+	static int gridX(float lon);
+	static int gridY(float lat);
+	uint32_t gridHash(int x, int y) { return ((x * 73856093u) ^ (y * 19349663u)) * 2654435761u >> 8 & grid_mask; }
+	void gridUpdate(int ptr);
+	void gridRemove(int ptr);
+	int getShips(const Area &area, std::vector<Ship> &list);
 
 	bool isValidCoord(float lat, float lon);
 
@@ -88,30 +237,45 @@ class DB : public StreamIn<JSON::JSON>,
 	static int rad2deg(float rad) { return (int)(360 + rad * 180 / PI) % 360; }
 
 	int findShip(uint32_t mmsi);
-	int createShip();
+	int createShip(uint32_t mmsi);
 	void moveShipToFront(int);
 	bool updateFields(const JSON::Property &p, const AIS::Message *msg, Ship &v, bool allowApproximate);
 
 	bool updateShip(const JSON::JSON &, TAG &, Ship &);
+	int storeShip(const Ship &ship);
 	void addToPath(int ptr);
 
 	static void getDistanceAndBearing(float lat1, float lon1, float lat2, float lon2, float &distance, int &bearing);
 
 	void getShipJSON(const Ship &ship, std::string &content, long int now);
-	std::string getSinglePathJSON(int);
-	std::string getSinglePathGeoJSON(int);
-	bool isNextPathPoint(int idx, uint32_t mmsi, int count) { return idx != -1 && paths[idx].mmsi == mmsi && paths[idx].count < count; }
+	void getShipCompactJSON(const Ship &ship, std::string &content, long int delta_time);
+	void getShipField(const Ship &ship, int field, std::string &content, long int delta_time);
+	void getShipProjected(const Ship &ship, const Projection &p, bool keys, std::string &content, long int delta_time);
+	void getPath(int idx, std::vector<PathPoint> &path);
+	std::string getSinglePathJSON(const PathPoint *p, int n);
+	std::string getSinglePathGeoJSON(uint32_t mmsi, const PathPoint *p, int n);
+	bool isNextPathBlock(int idx, uint32_t mmsi, int count) { return idx != -1 && paths[idx].mmsi == mmsi && paths[idx].count < count; }
+	static bool setPathPoint(PathBlock &b, int i, float lat, float lon, std::time_t start, std::time_t end);
+	static PathPoint getPathPoint(const PathBlock &b, int i);
 
 	AIS::Filter filter;
 
-	static const int MAX_BINARY_MESSAGES = 10;
-	BinaryMessage binaryMessages[MAX_BINARY_MESSAGES];
-	int binaryMsgIndex = 0;
+	// at most binary_max entries, the oldest is replaced when a new key arrives
+	int binary_max = 256;
+	std::unordered_map<uint64_t, BinaryMessage> binary_messages;
+	std::atomic<uint64_t> binary_version{0};
 
-	void processBinaryMessage(const JSON::JSON &data, Ship &ship, bool &position_updated);
+	// response of getBinaryMessagesJSON, valid for binary_version until the oldest entry in it expires
+	AIS::JSONAIS binary_decoder;
+	std::string binary_json;
+	uint64_t binary_json_version = ~(uint64_t)0;
+	std::time_t binary_json_expires = 0;
+
+	void processBinaryMessage(const JSON::JSON &data, TAG &tag, Ship &ship, bool &position_updated);
 
 public:
 	DB() : builder(&AIS::KeyMap, JSON_DICT_FULL) {}
+	~DB();
 
 	std::mutex mtx;
 
@@ -135,6 +299,7 @@ public:
 	void setOwnMMSI(uint32_t mmsi) { own_mmsi = mmsi; }
 
 	void Receive(const JSON::JSON *data, int len, TAG &tag);
+	bool getKeys(std::vector<int> &keys);
 	void Receive(const AIS::GPS *data, int len, TAG &tag)
 	{
 		if (use_GPS)
@@ -145,31 +310,80 @@ public:
 	}
 
 	void getBinary(std::vector<char> &);
+	void getBinaryDelta(std::vector<char> &, std::time_t &since_epoch, uint64_t &since_seq);
 	std::string getShipJSON(int mmsi);
 	std::string getJSON(bool full = false);
 	std::string getJSONcompact(bool full = false);
+	std::string getJSONcompact(const Area &area);
+	// only the fields of p, in its order. The compact form lists the fields once in "fields".
+	std::string getJSON(const Projection &p, bool full = false);
+	std::string getJSONcompact(const Projection &p, const Area *area = nullptr);
+	std::string getJSONdelta(std::time_t since_epoch, uint64_t since_seq);
 	std::string getPathJSON(uint32_t);
-	std::string getAllPathJSON();
 	std::string getPathGeoJSON(uint32_t);
-	std::string getAllPathGeoJSON();
 	std::string getMessage(uint32_t);
-	std::string getKML();
-	std::string getGeoJSON();
+	std::string getGeoJSON(const Area &area);
+
+	// the documents over all ships are written in parts from one snapshot so that they can be streamed,
+	// every call appends about PART_SIZE bytes and returns false once the document is complete
+	typedef std::function<bool(std::string &)> PartWriter;
+	static const int PART_SIZE = 64 * 1024;
+
+	PartWriter writeAllPathJSON();
+	PartWriter writeAllPathGeoJSON();
+	PartWriter writeKML();
+	PartWriter writeGeoJSON();
 
 	int getCount() { return count; }
+	// changes whenever the ship table changes, ships expiring included
+	uint64_t getVersion();
 	int getMaxCount() { return Nships; }
 
+	// in bytes, 0 is 8 times the initial size
+	void setMemoryCap(std::size_t n) { memory_cap = n; }
+	std::size_t getMemory() { return getMemory(Nships, Npaths); }
+	std::size_t getMemoryLimit() { return memory_limit; }
+	std::string getPrometheus();
+	// bytes per part of the database for /api/memory
+	std::string getMemoryJSON();
+
 	void setServerMode(bool b) { server_mode = b; }
 	void setMsgSave(bool b) { msg_save = b; }
+	// in bytes, 0 is 512 bytes per ship
+	void setMsgBufferSize(int n) { msg_buffer_size = n; }
 	void setFilterOption(std::string &opt, std::string &arg) { filter.SetOption(opt, arg); }
-
-	std::string getBinaryMessagesJSON() const;
+	void setBinaryMax(int n) { binary_max = n; }
+
+	std::string getBinaryMessagesJSON();
+	uint64_t getBinaryVersion() { return binary_version; }
+
+	// replication: copies of the active ships updated after since_seq, latest first, and optionally
+	// the ships recycled since the previous call (after setTrackRemoved), returns the update sequence.
+	// applyChanges takes over such a list as if the updates were received, removeShips drops ships
+	// by MMSI and removeActiveUpTo the active ships not updated after seq, e.g. after a full copy.
+	uint64_t getChanges(std::vector<Ship> &list, uint64_t since_seq);
+	uint64_t getChanges(std::vector<Ship> &list, std::vector<uint32_t> &removed, uint64_t since_seq);
+	void applyChanges(const std::vector<Ship> &list);
+	void removeShips(const std::vector<uint32_t> &mmsi);
+	void removeActiveUpTo(uint64_t seq);
+	void setTrackRemoved(bool b);
+	uint64_t getUpdateSeq();
+	std::time_t getEpoch() { return epoch; }
 
 	// Persistence functions for ship database
 	bool Save(std::ofstream &file);
 	bool Load(std::ifstream &file);
 
+	// backup journal: the ships updated after seq, which moves to the current update sequence on success
+	bool SaveChanges(std::ofstream &file, uint64_t &seq);
+	bool LoadChanges(std::ifstream &file);
+	uint64_t getSequence()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return update_seq;
+	}
+
 private:
 	static const int _DB_MAGIC = 0x41495346;
-	static const int _DB_VERSION = 1;
+	static const int _DB_VERSION = 2;
 };
@@ -22,25 +22,56 @@
 #include <memory>
 
 #include "Statistics.h"
+#include "Clock.h"
 
+// Receive only locks to open the bucket of a new interval, messages into the current bucket go to its
+// lock-free MessageStatistics. Readers and the rotation hold the mutex.
 template <int N, int INTERVAL>
-class History : public StreamIn<JSON::JSON> {
+class History : public StreamIn<JSON::JSON>, public JSON::KeySet {
 	std::mutex mtx;
 
 	struct {
-		long int time = {};
+		std::atomic<long int> time{0};
 		MessageStatistics stat;
 	} history[N];
 
-	int start, end;
+	int start;
+	std::atomic<int> end;
+
+	// buckets from this time on have changed since the last Save or SaveChanges
+	long int saved_time = 0;
+
+	// JSON of the closed buckets, valid while json_time matches the time of the bucket. Only the
+	// open bucket at end receives messages so the others are serialized once.
+	std::string json[N];
+	long int json_time[N];
+	std::string json_empty;
+
+	void invalidateJSON() {
+		for (int i = 0; i < N; i++) json_time[i] = -1;
+	}
+
+	const std::string& bucketJSON(int idx, std::string& open) {
+		if (idx == end) {
+			open = history[idx].stat.toJSON(false);
+			return open;
+		}
+
+		if (json_time[idx] != history[idx].time) {
+			json[idx] = history[idx].stat.toJSON(false);
+			json_time[idx] = history[idx].time;
+		}
+		return json[idx];
+	}
 
 	void create(long int t) {
-		history[end].time = t;
-		history[end].stat.Clear();
+		int e = end;
+		history[e].stat.Clear();
+		history[e].time = t;
 	}
 
 	bool readInteger(std::ifstream& file, int& dest, int check = -1) {
-		file.read((char*)&dest, sizeof(int));
+		if (!file.read((char*)&dest, sizeof(int))) return false;
 		if (check != -1 && dest != check) return false;
 		return true;
 	}
@@ -59,13 +90,14 @@ public:
 	void Clear() {
 		std::lock_guard<std::mutex> l{ this->mtx };
 
+		invalidateJSON();
 		start = end = 0;
-		create((long int)time(nullptr) / (long int)INTERVAL);
+		create((long int)Util::Clock::now() / (long int)INTERVAL);
 	}
 
-	void Receive(const JSON::JSON* j, int len, TAG& tag) {
-		std::lock_guard<std::mutex> l{ this->mtx };
+	bool getKeys(std::vector<int>& keys) { return true; }
 
+	void Receive(const JSON::JSON* j, int len, TAG& tag) {
 		for (int i = 0; i < len; i++) {
 			if (!j[i].binary) return;
 
@@ -73,13 +105,24 @@ public:
 			long int tm = ((long int)msg->getRxTimeUnix()) / (long int)INTERVAL;
 			long int tp = ((long int)tag.previous_signal) / (long int)INTERVAL;
 
-			if (history[end].time < tm) {
-				end = (end + 1) % N;
-				create(tm);
-				if (start == end) start = (start + 1) % N;
+			int e = end.load(std::memory_order_acquire);
+
+			if (history[e].time < tm) {
+				std::lock_guard<std::mutex> l{ this->mtx };
+
+				e = end;
+				if (history[e].time < tm) {
+					int next = (e + 1) % N;
+					if (start == next) start = (start + 1) % N;
+
+					history[next].stat.Clear();
+					history[next].time = tm;
+					end.store(next, std::memory_order_release);
+					e = next;
+				}
 			}
 
-			history[end].stat.Add(*msg, tag, tm != tp);
+			history[e].stat.Add(*msg, tag, tm != tp);
 		}
 	}
 
@@ -97,14 +140,81 @@ public:
 		file.write((const char*)&s, sizeof(int));
 		file.write((const char*)&i, sizeof(int));
 		file.write((const char*)&n, sizeof(int));
+		int e = end;
+
 		file.write((const char*)&start, sizeof(int));
-		file.write((const char*)&end, sizeof(int));
+		file.write((const char*)&e, sizeof(int));
 
 		for (int i = 0; i < N; i++) {
-			file.write((const char*)&history[i].time, sizeof(history[i].time));
+			long int t = history[i].time;
+			file.write((const char*)&t, sizeof(t));
 			history[i].stat.Save(file);
 		}
 
+		saved_time = history[e].time;
+		return true;
+	}
+
+	// backup journal: only the buckets that changed since the last save
+	bool SaveChanges(std::ofstream& file) {
+		std::lock_guard<std::mutex> l{ this->mtx };
+
+		int magic = 0x4f80c;
+		int i = INTERVAL;
+		int n = N;
+		int e = end;
+		int changed = 0;
+
+		for (int b = 0; b < N; b++)
+			if (history[b].time >= saved_time) changed++;
+
+		file.write((const char*)&magic, sizeof(int));
+		file.write((const char*)&i, sizeof(int));
+		file.write((const char*)&n, sizeof(int));
+		file.write((const char*)&start, sizeof(int));
+		file.write((const char*)&e, sizeof(int));
+		file.write((const char*)&changed, sizeof(int));
+
+		for (int b = 0; b < N; b++) {
+			long int t = history[b].time;
+			if (t < saved_time) continue;
+
+			file.write((const char*)&b, sizeof(int));
+			file.write((const char*)&t, sizeof(t));
+			history[b].stat.Save(file);
+		}
+
+		saved_time = history[e].time;
+		return (bool)file;
+	}
+
+	bool LoadChanges(std::ifstream& file) {
+		std::lock_guard<std::mutex> l{ this->mtx };
+
+		int s = 0, e = 0, changed = 0, tmp;
+
+		if (!readInteger(file, tmp, 0x4f80c)) return false;
+		if (!readInteger(file, tmp, INTERVAL)) return false;
+		if (!readInteger(file, tmp, N)) return false;
+		if (!readInteger(file, s) || !readInteger(file, e) || !readInteger(file, changed)) return false;
+		if (s < 0 || s >= N || e < 0 || e >= N || changed < 0 || changed > N) return false;
+
+		for (int c = 0; c < changed; c++) {
+			int b = 0;
+			long int t;
+
+			if (!readInteger(file, b) || b < 0 || b >= N) return false;
+			if (!file.read((char*)&t, sizeof(t))) return false;
+			history[b].time = t;
+			if (!history[b].stat.Load(file)) return false;
+		}
+
+		start = s;
+		end = e;
+		saved_time = history[e].time;
+		invalidateJSON();
+
+		history[e].stat.clearVessels();
 		return true;
 	}
 
@@ -119,16 +229,22 @@ public:
 		if (!readInteger(file, tmp, INTERVAL)) return false;
 		if (!readInteger(file, tmp, N)) return false;
 
+		int e = 0;
 		readInteger(file, start, -1);
-		readInteger(file, end, -1);
+		readInteger(file, e, -1);
+		end = e;
 
 		for (int i = 0; i < N; i++) {
-			if (!file.read((char*)&history[i].time, sizeof(history[i].time))) return false;
+			long int t;
+			if (!file.read((char*)&t, sizeof(t))) return false;
+			history[i].time = t;
 			if (!history[i].stat.Load(file)) return false;
 		}
 
 		// as database is not persistent we cannot combine old and new
 		history[end].stat.clearVessels();
+		saved_time = history[end].time;
+		invalidateJSON();
 		return true;
 	}
 
@@ -147,36 +263,29 @@ public:
 	std::string lastStatToJSON() {
 		std::lock_guard<std::mutex> l{ this->mtx };
 
-		long int tm = (long int) std::time(nullptr) / (long int)INTERVAL -1;
+		long int tm = (long int) Util::Clock::now() / (long int)INTERVAL -1;
 		if (start == end || tm  > history[(end + N - 1) % N].time) return history[0].stat.toJSON(true);
 
 		return history[(end + N - 1) % N].stat.toJSON(false);
 	}
 
-	std::string toJSON() {
+	// newest interval first, back to the interval that contains since (unix time, 0 is all). "until" is
+	// the start of the open interval, the since of the next call.
+	std::string toJSON(long int since = 0) {
 		std::lock_guard<std::mutex> l{ this->mtx };
 
-		std::string content;
-		long int tm_now = ((long int)time(nullptr)) / (long int)INTERVAL;
+		std::string time, stat, open;
+		long int tm_now = ((long int)Util::Clock::now()) / (long int)INTERVAL;
+		long int tm_since = since / (long int)INTERVAL;
 
-		content += "{\"time\":[";
-		for (int i = N, tm = tm_now, idx = end; i > 0; i--) {
-			bool new_tm = history[idx].time >= tm;
+		if (json_empty.empty()) json_empty = history[end].stat.toJSON(true);
 
-			content += std::to_string(i - N) + ",";
-
-			if (new_tm) {
-				if (idx == start) break;
-				idx = (idx + N - 1) % N;
-			}
-			tm--;
-		}
-		if (content[content.size() - 1] == ',') content.pop_back();
-		content += "],\"stat\":[";
-
-		for (int i = N, tm = tm_now, idx = end; i > 0; i--) {
+		int idx = end;
+		for (long int i = N, tm = tm_now; i > 0 && tm >= tm_since; i--) {
 			bool empty = history[idx].time < tm;
-			content += history[idx].stat.toJSON(empty) + ",";
+
+			time += std::to_string(i - N) + ",";
+			stat += (empty ? json_empty : bucketJSON(idx, open)) + ",";
 
 			if (!empty) {
 				if (idx == start) break;
@@ -184,8 +293,9 @@ public:
 			}
 			tm--;
 		}
-		if (content[content.size() - 1] == ',') content.pop_back();
-		content += "]}";
-		return content;
+		if (!time.empty()) time.pop_back();
+		if (!stat.empty()) stat.pop_back();
+
+		return "{\"time\":[" + time + "],\"stat\":[" + stat + "],\"until\":" + std::to_string(tm_now * (long int)INTERVAL) + "}";
 	}
 };
@@ -0,0 +1,537 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MessageLog.h"
+#include "JSONBuilder.h"
+#include "Helper.h"
+#include "Clock.h"
+#include "Logger.h"
+
+const std::string MessageLog::EXTENSION = ".aislog";
+
+static const int RECORD_ALIGN = 8;
+
+// position reports: bit offsets and resolution of longitude and latitude per message type
+static bool getPosition(const AIS::Message &msg, float &lat, float &lon)
+{
+	int lon_start, lat_start, lon_bits = 28, lat_bits = 27;
+	float scale = 600000.0f;
+
+	switch (msg.type())
+	{
+	case 1:
+	case 2:
+	case 3:
+	case 9:
+		lon_start = 61;
+		lat_start = 89;
+		break;
+	case 4:
+		lon_start = 79;
+		lat_start = 107;
+		break;
+	case 18:
+	case 19:
+		lon_start = 57;
+		lat_start = 85;
+		break;
+	case 21:
+		lon_start = 164;
+		lat_start = 192;
+		break;
+	case 27:
+		lon_start = 44;
+		lat_start = 62;
+		lon_bits = 18;
+		lat_bits = 17;
+		scale = 600.0f;
+		break;
+	default:
+		return false;
+	}
+
+	if (msg.getLength() < lat_start + lat_bits)
+		return false;
+
+	lon = msg.getInt(lon_start, lon_bits) / scale;
+	lat = msg.getInt(lat_start, lat_bits) / scale;
+
+	return lat >= -90.0f && lat <= 90.0f && lon >= -180.0f && lon <= 180.0f;
+}
+
+//---------------------------------------
+// Segment
+
+bool MessageLog::Segment::map_file(uint64_t size, bool writable)
+{
+#ifdef _WIN32
+	file = CreateFileA(filename.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL, writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!writable)
+	{
+		LARGE_INTEGER li;
+		size = GetFileSizeEx(file, &li) ? (uint64_t)li.QuadPart : 0;
+	}
+
+	if (size)
+	{
+		mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, (DWORD)(size >> 32), (DWORD)size, NULL);
+		if (mapping != NULL)
+			map = (uint8_t *)MapViewOfFile(mapping, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, (SIZE_T)size);
+	}
+#else
+	int fd = ::open(filename.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		size = 0;
+	else if (!writable)
+		size = (uint64_t)st.st_size;
+	else if ((uint64_t)st.st_size != size && ftruncate(fd, size) != 0)
+		size = 0;
+
+	if (size)
+	{
+		void *p = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED)
+			map = (uint8_t *)p;
+	}
+	::close(fd);
+#endif
+	if (!map)
+	{
+		unmap();
+		return false;
+	}
+
+	length = size;
+	return true;
+}
+
+void MessageLog::Segment::unmap()
+{
+#ifdef _WIN32
+	if (map)
+		UnmapViewOfFile(map);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (map)
+		munmap(map, length);
+#endif
+	map = nullptr;
+	length = 0;
+}
+
+static bool truncateFile(const std::string &filename, uint64_t size)
+{
+#ifdef _WIN32
+	HANDLE h = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER li;
+	li.QuadPart = (LONGLONG)size;
+	bool ok = SetFilePointerEx(h, li, NULL, FILE_BEGIN) && SetEndOfFile(h);
+	CloseHandle(h);
+	return ok;
+#else
+	return truncate(filename.c_str(), (off_t)size) == 0;
+#endif
+}
+
+//---------------------------------------
+// MessageLog
+
+void MessageLog::index(Segment &s, uint64_t offset, const Header &h)
+{
+	uint32_t b = (uint32_t)(offset >> BLOCK_BITS);
+	std::time_t t = (std::time_t)h.rxtime;
+
+	// records are much smaller than a block, so every block has a record that starts in it
+	if (b >= s.blocks.size())
+		s.blocks.push_back({(uint32_t)offset, t, t});
+	else
+	{
+		Block &block = s.blocks.back();
+		block.t_min = MIN(block.t_min, t);
+		block.t_max = MAX(block.t_max, t);
+	}
+
+	std::vector<uint32_t> &list = s.mmsi_blocks[h.mmsi];
+	if (list.empty() || list.back() != b)
+		list.push_back(b);
+
+	s.t_min = s.count ? MIN(s.t_min, t) : t;
+	s.t_max = s.count ? MAX(s.t_max, t) : t;
+	s.count++;
+}
+
+bool MessageLog::openSegment(const std::string &filename)
+{
+	std::unique_ptr<Segment> s(new Segment());
+	s->filename = filename;
+
+	if (!s->map_file(0, false))
+	{
+		Warning() << "Message log: cannot read \"" << filename << "\", skipping.";
+		return false;
+	}
+
+	uint64_t offset = 0;
+	Header h;
+
+	while (offset + sizeof(Header) <= s->length)
+	{
+		std::memcpy(&h, s->map + offset, sizeof(Header));
+
+		if (h.size < sizeof(Header) || offset + h.size > s->length || h.bits > MAX_AIS_LENGTH || sizeof(Header) + (h.bits + 7) / 8 > h.size)
+			break;
+
+		index(*s, offset, h);
+		offset += h.size;
+	}
+
+	s->used = offset;
+	s->sealed = true;
+
+	if (offset != s->length && s->length != segment_size)
+		Warning() << "Message log: \"" << filename << "\" ends with an invalid record, using the first " << offset << " bytes.";
+
+	// the segment that was written last continues if it was not full
+	if (s->length == segment_size && s->used + sizeof(Header) < segment_size)
+	{
+		s->unmap();
+		if (!s->map_file(segment_size, true))
+			return false;
+		s->sealed = false;
+	}
+
+	segments.push_back(std::move(s));
+	return true;
+}
+
+bool MessageLog::newSegment(std::time_t t)
+{
+	std::unique_ptr<Segment> s(new Segment());
+
+	// named after the time of creation so that the names sort in order
+	for (;; t++)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "ais-%012lld", (long long)t);
+		s->filename = directory + "/" + name + EXTENSION;
+
+		if (!std::ifstream(s->filename).good())
+			break;
+	}
+
+	if (!s->map_file(segment_size, true))
+	{
+		Error() << "Message log: cannot create \"" << s->filename << "\".";
+		return false;
+	}
+
+	segments.push_back(std::move(s));
+	return true;
+}
+
+void MessageLog::seal(Segment &s)
+{
+	// give back the unused part of the file and map what is left read-only
+	s.unmap();
+	s.sealed = true;
+
+	if (!truncateFile(s.filename, s.used))
+		Warning() << "Message log: cannot truncate \"" << s.filename << "\".";
+
+	if (s.used && !s.map_file(0, false))
+	{
+		Error() << "Message log: cannot map \"" << s.filename << "\", its messages are not available.";
+		s.used = s.count = 0;
+		s.blocks.clear();
+		s.mmsi_blocks.clear();
+	}
+}
+
+void MessageLog::expire(std::time_t now)
+{
+	std::time_t limit = now - (std::time_t)retention_days * 24 * 3600;
+	last_expire = now;
+
+	// the segment being written is never removed
+	while (segments.size() > 1 && segments.front()->sealed && (segments.front()->count == 0 || segments.front()->t_max < limit))
+	{
+		std::string filename = segments.front()->filename;
+		segments.erase(segments.begin());
+
+		if (std::remove(filename.c_str()) != 0)
+			Warning() << "Message log: cannot remove \"" << filename << "\".";
+	}
+}
+
+void MessageLog::open(const std::string &dir)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	directory = dir;
+	segments.clear();
+
+	std::vector<std::string> files = Util::Helper::getFilesWithExtension(directory, EXTENSION);
+	std::sort(files.begin(), files.end());
+
+	uint64_t count = 0;
+	for (const auto &f : files)
+		if (openSegment(f))
+			count += segments.back()->count;
+
+	// only the newest segment is written to
+	for (int i = 0; i + 1 < (int)segments.size(); i++)
+		if (!segments[i]->sealed)
+			seal(*segments[i]);
+
+	expire(Util::Clock::now());
+
+	if (segments.empty() || segments.back()->sealed)
+	{
+		if (!newSegment(Util::Clock::now()))
+		{
+			directory.clear();
+			throw std::runtime_error("Message log: cannot write to directory \"" + dir + "\".");
+		}
+	}
+
+	Info() << "Message log: " << count << " messages in " << segments.size() << " segments in \"" << dir << "\", retention " << retention_days << " days.";
+}
+
+void MessageLog::close()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if (!segments.empty() && !segments.back()->sealed)
+		seal(*segments.back());
+
+	segments.clear();
+	directory.clear();
+}
+
+void MessageLog::append(const AIS::Message &msg)
+{
+	Header h;
+	h.mmsi = msg.mmsi();
+	h.rxtime = (int64_t)msg.getRxTimeUnix();
+	h.station = msg.getStation();
+	h.bits = (uint16_t)msg.getLength();
+	h.channel = msg.getChannel();
+	h.type = (uint8_t)msg.type();
+
+	uint32_t bytes = (h.bits + 7) / 8;
+	h.size = (sizeof(Header) + bytes + RECORD_ALIGN - 1) & ~(uint32_t)(RECORD_ALIGN - 1);
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if (directory.empty())
+		return;
+
+	Segment *s = segments.empty() || segments.back()->sealed ? nullptr : segments.back().get();
+
+	if (!s || s->used + h.size > s->length)
+	{
+		if (s)
+			seal(*s);
+
+		expire(Util::Clock::now());
+
+		if (!newSegment(Util::Clock::now()))
+		{
+			dropped++;
+			return;
+		}
+		s = segments.back().get();
+	}
+
+	// the header goes last, a zero size marks the end if we stop halfway
+	uint8_t *p = s->map + s->used;
+	std::memcpy(p + sizeof(Header), msg.getData(), bytes);
+	std::memcpy(p, &h, sizeof(Header));
+
+	index(*s, s->used, h);
+	s->used += h.size;
+	appended++;
+}
+
+// a quiet station may not fill a segment for days, retention is then applied from here once an hour
+void MessageLog::tick()
+{
+	std::time_t now = Util::Clock::now();
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if (!directory.empty() && now - last_expire >= 3600)
+		expire(now);
+}
+
+void MessageLog::Receive(const JSON::JSON *data, int len, TAG &tag)
+{
+	for (int i = 0; i < len; i++)
+	{
+		const AIS::Message *msg = (const AIS::Message *)data[i].binary;
+		if (msg && msg->mmsi() != 0)
+			append(*msg);
+	}
+}
+
+std::string MessageLog::getJSON(uint32_t mmsi, std::time_t from, std::time_t to, int limit)
+{
+	// the matching records are copied under the lock and formatted after it, appends do not wait for this
+	std::vector<Header> headers;
+	std::vector<uint8_t> payload;
+	bool truncated = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		for (const auto &s : segments)
+		{
+			if (truncated || !s->count || s->t_max < from || s->t_min > to)
+				continue;
+
+			auto it = s->mmsi_blocks.find(mmsi);
+			if (it == s->mmsi_blocks.end())
+				continue;
+
+			for (uint32_t b : it->second)
+			{
+				const Block &block = s->blocks[b];
+				if (block.t_max < from || block.t_min > to)
+					continue;
+
+				uint64_t offset = block.offset;
+				uint64_t end = MIN(s->used, (uint64_t)(b + 1) << BLOCK_BITS);
+				Header h;
+
+				for (; offset < end; offset += h.size)
+				{
+					std::memcpy(&h, s->map + offset, sizeof(Header));
+
+					if (h.mmsi != mmsi || h.rxtime < from || h.rxtime > to)
+						continue;
+
+					if ((int)headers.size() == limit)
+					{
+						truncated = true;
+						break;
+					}
+
+					const uint8_t *data = s->map + offset + sizeof(Header);
+					headers.push_back(h);
+					payload.insert(payload.end(), data, data + (h.bits + 7) / 8);
+				}
+
+				if (truncated)
+					break;
+			}
+		}
+	}
+
+	JSON::JSONBuilder json;
+	AIS::Message msg;
+	TAG tag;
+	std::size_t pos = 0;
+
+	json.start().add("mmsi", mmsi).add("from", (long long)from).add("to", (long long)to);
+	json.key("messages").startArray();
+
+	for (const Header &h : headers)
+	{
+		msg.setData(payload.data() + pos, h.bits);
+		msg.setChannel(h.channel);
+		msg.buildNMEA(tag);
+		pos += (h.bits + 7) / 8;
+
+		json.start().add("rxtime", (long long)h.rxtime).add("type", (int)h.type).add("station", (int)h.station);
+		json.addString("channel", std::string(1, h.channel));
+
+		float lat, lon;
+		if (getPosition(msg, lat, lon))
+			json.add("lat", lat).add("lon", lon);
+
+		json.key("nmea").startArray();
+		for (const auto &line : msg.NMEA)
+			json.value(line);
+		json.endArray();
+		json.end();
+	}
+
+	json.endArray();
+	json.add("count", (int)headers.size()).add("truncated", truncated);
+	json.end();
+
+	return json.str();
+}
+
+std::string MessageLog::getPrometheus()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	uint64_t bytes = 0, count = 0;
+	for (const auto &s : segments)
+	{
+		bytes += s->used;
+		count += s->count;
+	}
+
+	std::string element;
+	element += "# HELP ais_log_messages Messages held in the on-disk message log\n";
+	element += "# TYPE ais_log_messages gauge\n";
+	element += "ais_log_messages " + std::to_string(count) + "\n";
+	element += "# HELP ais_log_bytes Bytes used by the on-disk message log\n";
+	element += "# TYPE ais_log_bytes gauge\n";
+	element += "ais_log_bytes " + std::to_string(bytes) + "\n";
+	element += "# HELP ais_log_segments Segment files of the on-disk message log\n";
+	element += "# TYPE ais_log_segments gauge\n";
+	element += "ais_log_segments " + std::to_string(segments.size()) + "\n";
+	element += "# HELP ais_log_appended Messages appended to the log since start\n";
+	element += "# TYPE ais_log_appended counter\n";
+	element += "ais_log_appended " + std::to_string(appended) + "\n";
+	element += "# HELP ais_log_dropped Messages that could not be written to the log\n";
+	element += "# TYPE ais_log_dropped counter\n";
+	element += "ais_log_dropped " + std::to_string(dropped) + "\n";
+	return element;
+}
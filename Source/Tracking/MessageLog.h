@@ -0,0 +1,121 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "Stream.h"
+#include "JSON.h"
+#include "Message.h"
+
+// Append-only log of the received messages on disk for history queries. The log is a directory of
+// segment files that are memory mapped, the newest one is written and the older ones are sealed and
+// only read. Every record is a fixed header followed by the raw payload. Per segment a sparse index
+// is kept in memory: the time range of every 64 KB block and for every MMSI the blocks that hold its
+// messages, so a query only reads the blocks of one ship. The index is rebuilt from the files on start.
+
+class MessageLog : public StreamIn<JSON::JSON>
+{
+	struct Header
+	{
+		uint32_t size; // of the record including header and padding, zero marks the end of a segment
+		uint32_t mmsi;
+		int64_t rxtime;
+		int32_t station;
+		uint16_t bits;
+		char channel;
+		uint8_t type;
+	};
+
+	struct Block
+	{
+		uint32_t offset; // first record that starts in the block
+		std::time_t t_min, t_max;
+	};
+
+	struct Segment
+	{
+		std::string filename;
+
+		uint8_t *map = nullptr;
+		uint64_t length = 0, used = 0;
+		bool sealed = false;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#endif
+
+		std::time_t t_min = 0, t_max = 0;
+		uint64_t count = 0;
+
+		std::vector<Block> blocks;
+		std::unordered_map<uint32_t, std::vector<uint32_t>> mmsi_blocks;
+
+		~Segment() { unmap(); }
+
+		bool map_file(uint64_t size, bool writable);
+		void unmap();
+	};
+
+	static const int BLOCK_BITS = 16;
+	static const std::string EXTENSION;
+
+	std::string directory;
+	uint64_t segment_size = 64 * 1024 * 1024;
+	int retention_days = 7;
+	std::time_t last_expire = 0;
+
+	std::vector<std::unique_ptr<Segment>> segments;
+	std::mutex mtx;
+
+	uint64_t appended = 0, dropped = 0;
+
+	void index(Segment &s, uint64_t offset, const Header &h);
+	bool openSegment(const std::string &filename);
+	bool newSegment(std::time_t t);
+	void seal(Segment &s);
+	void expire(std::time_t now);
+
+public:
+	~MessageLog() { close(); }
+
+	void setSegmentSize(uint64_t s) { segment_size = s; }
+	void setRetention(int days) { retention_days = days; }
+
+	void open(const std::string &dir);
+	void close();
+	bool isOpen() { return !directory.empty(); }
+
+	void append(const AIS::Message &msg);
+	void tick();
+	void Receive(const JSON::JSON *data, int len, TAG &tag);
+
+	// messages of one ship in [from, to], oldest first, at most limit
+	std::string getJSON(uint32_t mmsi, std::time_t from, std::time_t to, int limit);
+	std::string getPrometheus();
+};
@@ -1,7 +1,32 @@
 #include <array>
+#include <atomic>
+#include <cmath>
 
 #include "ADSB.h"
 #include "Stream.h"
+#include "Serialize.h"
+#include "MemoryBudget.h"
+
+// part of the trail of one plane: up to SIZE points stored as offsets from the first point in 1e-5
+// degrees, feet and seconds. Blocks of a plane are linked from new to old via next and are recycled in
+// order of allocation, count is the message count of the plane when the block was started.
+struct TrailBlock
+{
+    static const int SIZE = 16;
+
+    uint32_t hexident = 0;
+    long count = 0;
+    int next = -1;
+    int n = 0;
+    int32_t lat = 0, lon = 0, altitude = 0;
+    std::time_t timestamp = 0;
+
+    struct Point
+    {
+        int16_t lat, lon, altitude;
+        uint16_t time;
+    } points[SIZE];
+};
 
 class PlaneDB : public StreamIn<Plane::ADSB>
 {
@@ -15,14 +40,6 @@ private:
     const int END = -1;
     const int FREE = -2;
 
-    const static int CPR_CACHE_SIZE = 3;
-
-    Plane::CPR CPR_cache_even[CPR_CACHE_SIZE];
-    Plane::CPR CPR_cache_odd[CPR_CACHE_SIZE];
-
-    int CPR_cache_even_idx = 0;
-    int CPR_cache_odd_idx = 0;
-
     static float deg2rad(float deg) { return deg * PI / 180.0f; }
     static int rad2deg(float rad) { return (int)(360 + rad * 180 / PI) % 360; }
 
@@ -51,43 +68,167 @@ private:
     int first = -1;
     int last = -1;
     int count = 0;
+    std::atomic<uint64_t> version{0};
     std::vector<Plane::ADSB> items;
+
+    // the table doubles when the plane to be recycled was seen within ACTIVE_TIME of the latest one,
+    // up to N_max planes which follows from the memory cap if set
     const int N = 512;
-    std::array<LL, 512> hash_ll;
+    int N_max = 8192;
+    const int ACTIVE_TIME = 300;
+
+    // planes not heard of for ACTIVE_TIME form the tail of the time list, expired_ptr is its
+    // head (-1 if none) and is moved up from the tail by expire, readers stop there
+    int expired_ptr = -1;
+    std::atomic<std::time_t> expire_time{0};
+
+    // buckets, a power of 2 and doubled when the load factor exceeds 3/4
+    std::vector<LL> hash_ll;
+    int hash_bits = 0;
+    int rehash_count = 0;
 
     FLOAT32 station_lat = LAT_UNDEFINED, station_lon = LON_UNDEFINED;
 
-    // for debugging
-    void checkDepth()
+    // fields of a frame used by update, decoded into the scratch copy once the frame is accepted
+    static constexpr uint32_t FIELDS = Plane::FIELD_ALTITUDE | Plane::FIELD_SQUAWK | Plane::FIELD_IDENT | Plane::FIELD_VELOCITY | Plane::FIELD_POSITION;
+    Plane::ADSB decoded;
+
+    // trails of all planes share a pool of blocks that is allocated with the first point, a point is
+    // added at most every TRAIL_INTERVAL seconds
+    int TRAILS = 16384;
+    const int TRAIL_INTERVAL = 5;
+    static const int16_t TRAIL_NO_ALTITUDE = INT16_MIN;
+    std::vector<TrailBlock> trails;
+    int trail_idx = 0;
+
+    static int32_t toFixed(float x) { return (int32_t)std::lround((double)x * 100000.0); }
+
+    bool isNextTrailBlock(int idx, uint32_t hexident, long count) const { return idx != -1 && trails[idx].hexident == hexident && trails[idx].count < count; }
+
+    // returns false if the point is out of the range of the offsets of the block
+    static bool setTrailPoint(TrailBlock &b, int i, const Plane::ADSB &plane)
     {
+        int32_t dlat = toFixed(plane.lat) - b.lat;
+        int32_t dlon = toFixed(plane.lon) - b.lon;
+        long dt = (long)(plane.rxtime - b.timestamp);
+        int32_t dalt = plane.altitude != ALTITUDE_UNDEFINED ? plane.altitude - b.altitude : TRAIL_NO_ALTITUDE;
 
-        int m = 0, gc = 0;
-        for (int i = 0; i < N; i++)
+        if (dlat < INT16_MIN || dlat > INT16_MAX || dlon < INT16_MIN || dlon > INT16_MAX)
+            return false;
+
+        if (plane.altitude != ALTITUDE_UNDEFINED && (dalt <= INT16_MIN || dalt > INT16_MAX))
+            return false;
+
+        if (dt < 0 || dt > UINT16_MAX)
+            return false;
+
+        b.points[i].lat = (int16_t)dlat;
+        b.points[i].lon = (int16_t)dlon;
+        b.points[i].altitude = (int16_t)dalt;
+        b.points[i].time = (uint16_t)dt;
+        return true;
+    }
+
+    void addToTrail(int ptr)
+    {
+        Plane::ADSB &plane = items[ptr];
+        int idx = plane.trail_ptr;
+
+        if (isNextTrailBlock(idx, plane.hexident, plane.nMessages))
         {
-            int c = 0;
-            int ptr = hash_ll[i].next;
-            while (ptr != END)
+            TrailBlock &b = trails[idx];
+
+            if ((long)(plane.rxtime - b.timestamp) - b.points[b.n - 1].time < TRAIL_INTERVAL)
+                return;
+
+            if (b.n < TrailBlock::SIZE && setTrailPoint(b, b.n, plane))
             {
-                c++;
-                ptr = items[ptr].hash_ll.next;
+                b.n++;
+                return;
             }
-            if (c > m)
-                m = c;
+        }
 
-            gc += c;
+        if (trails.empty())
+        {
+            trails.resize(TRAILS);
+            reportMemory();
         }
-        std::cerr << "Max: " << m << " out of total " << gc << std::endl;
+
+        // start a new block with the point as reference
+        TrailBlock &b = trails[trail_idx];
+
+        b.hexident = plane.hexident;
+        b.count = plane.nMessages;
+        b.next = idx;
+        b.n = 1;
+        b.lat = toFixed(plane.lat);
+        b.lon = toFixed(plane.lon);
+        b.altitude = plane.altitude != ALTITUDE_UNDEFINED ? plane.altitude : 0;
+        b.timestamp = plane.rxtime;
+        setTrailPoint(b, 0, plane);
+
+        plane.trail_ptr = trail_idx;
+        trail_idx = (trail_idx + 1) % (int)trails.size();
     }
 
-    // FNV-1 hash
+    // FNV-1 hash, the upper bits depend on all bits of the address
     int hash(uint32_t hexident) const
     {
         const uint32_t PRIME = 16777619;
         uint32_t hash = 2166136261;
         hash = (hash ^ hexident) * PRIME;
-        return hash % N;
+        return hash >> (32 - hash_bits);
+    }
+
+    bool inHash(int ptr) const { return items[ptr].hash_ll.next != FREE || items[ptr].hash_ll.prev != FREE; }
+
+    void insertHash(int ptr, int h)
+    {
+        items[ptr].hash_ll.prev = END;
+        items[ptr].hash_ll.next = hash_ll[h].next;
+
+        if (hash_ll[h].next != END)
+            items[hash_ll[h].next].hash_ll.prev = ptr;
+
+        hash_ll[h].next = ptr;
+    }
+
+    void rehash(int bits)
+    {
+        hash_bits = bits;
+        hash_ll.assign(1 << bits, {END, END});
+
+        for (int i = 0; i < items.size(); i++)
+            if (inHash(i))
+                insertHash(i, hash(items[i].hexident));
     }
 
+    // append free entries at the end of the time list, these are used first by create
+    void grow(int n)
+    {
+        int old = items.size();
+        items.resize(n);
+
+        for (int i = old; i < n; i++)
+        {
+            items[i].time_ll.prev = i == old ? last : i - 1;
+            items[i].time_ll.next = i + 1 < n ? i + 1 : -1;
+
+            items[i].hash_ll.prev = FREE;
+            items[i].hash_ll.next = FREE;
+        }
+
+        items[last].time_ll.next = old;
+        last = n - 1;
+
+        reportMemory();
+    }
+
+    std::size_t memory_reported = 0;
+
+    std::size_t getMemory() const { return items.size() * sizeof(Plane::ADSB) + hash_ll.size() * sizeof(LL) + trails.size() * sizeof(TrailBlock); }
+    void reportMemory() { MemoryBudget::account(MemoryBudget::PLANES, memory_reported, getMemory()); }
+
 public:
     PlaneDB()
     {
@@ -108,19 +249,12 @@ public:
         }
         items[N - 1].time_ll.prev = -1;
 
-        for (int i = 0; i < N; i++)
-        {
-            hash_ll[i].prev = END;
-            hash_ll[i].next = END;
-        }
-
-        for (int i = 0; i < CPR_CACHE_SIZE; i++)
-        {
-            CPR_cache_even[i].clear();
-            CPR_cache_odd[i].clear();
-        }
+        rehash(10);
+        reportMemory();
     }
 
+    ~PlaneDB() { MemoryBudget::account(MemoryBudget::PLANES, memory_reported, 0); }
+
     void calcReferencePosition(TAG &tag, int ptr, FLOAT32 &lat, FLOAT32 &lon)
     {
         lat = station_lat;
@@ -138,8 +272,39 @@ public:
         }
     }
 
+    void expire(std::time_t now)
+    {
+        expire_time = now;
+
+        int ptr = expired_ptr == -1 ? last : items[expired_ptr].time_ll.prev;
+        bool changed = false;
+
+        while (ptr != -1 && (items[ptr].hexident == HEXIDENT_UNDEFINED || (long int)now - (long int)items[ptr].getRxTimeUnix() > ACTIVE_TIME))
+        {
+            changed |= items[ptr].hexident != HEXIDENT_UNDEFINED;
+            expired_ptr = ptr;
+            ptr = items[ptr].time_ll.prev;
+        }
+
+        if (changed)
+            version++;
+    }
+
+    void checkExpiry()
+    {
+        std::time_t now = Util::Clock::now();
+        if (now == expire_time)
+            return;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        expire(now);
+    }
+
     void moveToFront(int ptr)
     {
+        if (ptr == expired_ptr)
+            expired_ptr = items[ptr].time_ll.next;
+
         if (ptr == first)
             return;
 
@@ -161,13 +326,23 @@ public:
 
     int create(int hexident)
     {
+        if (inHash(last) && items.size() < N_max && items[first].rxtime - items[last].rxtime <= ACTIVE_TIME)
+            grow(MIN(2 * (int)items.size(), N_max));
+
+        if (4 * (count + 1) > 3 * (int)hash_ll.size())
+        {
+            rehash(hash_bits + 1);
+            rehash_count++;
+            reportMemory();
+        }
+
         int ptr = last;
 
         int oldhash = hash(items[ptr].hexident);
         int newhash = hash(hexident);
 
         // Remove from hash list if already present
-        if (items[ptr].hash_ll.next != FREE || items[ptr].hash_ll.prev != FREE)
+        if (inHash(ptr))
         {
             if (items[ptr].hash_ll.next != END)
                 items[items[ptr].hash_ll.next].hash_ll.prev = items[ptr].hash_ll.prev;
@@ -181,15 +356,9 @@ public:
         }
 
         // Insert into hash list (node is guaranteed to be removed already)
-        items[ptr].hash_ll.prev = END;
-        items[ptr].hash_ll.next = hash_ll[newhash].next;
-
-        if (hash_ll[newhash].next != END)
-            items[hash_ll[newhash].next].hash_ll.prev = ptr;
-
-        hash_ll[newhash].next = ptr;
+        insertHash(ptr, newhash);
 
-        count = MIN(count + 1, N);
+        count = MIN(count + 1, (int)items.size());
         items[ptr].clear();
         items[ptr].hexident = hexident;
 
@@ -213,40 +382,27 @@ public:
         return -1;
     }
 
-    bool checkInCPRCache(const Plane::CPR &cpr, bool even, FLOAT32 &lat)
+    // the same frame received via several inputs is only processed once, the last even and odd
+    // CPR are kept per plane so this does not depend on the traffic of other planes
+    static bool isDuplicateCPR(const Plane::CPR &last, const Plane::CPR &cpr)
     {
-        bool duplicate = false;
-        int &idx = even ? CPR_cache_even_idx : CPR_cache_odd_idx;
+        if (!last.Valid() || cpr.timestamp - last.timestamp > 2)
+            return false;
 
-        for (int i = 0; i < CPR_CACHE_SIZE && !duplicate; i++)
-        {
-            Plane::CPR &cache = even ? CPR_cache_even[i] : CPR_cache_odd[i];
-
-            if (!cache.Valid() || cpr.timestamp - cache.timestamp > 2)
-                continue;
-
-            duplicate = cache.lat == cpr.lat && cache.lon == cpr.lon && cache.airborne == cpr.airborne;
-        }
-
-        if (!duplicate)
-        {
-            (even ? CPR_cache_even[idx] : CPR_cache_odd[idx]) = cpr;
-            idx = (idx + 1) % CPR_CACHE_SIZE;
-        }
-
-        return duplicate;
+        return last.lat == cpr.lat && last.lon == cpr.lon && last.airborne == cpr.airborne;
     }
 
-    void Receive(const Plane::ADSB *msg, int len, TAG &tag)
+    // update the table with a single message, the caller holds the lock
+    void update(const Plane::ADSB *msg, TAG &tag)
     {
         bool position_updated = false;
 
-        std::lock_guard<std::mutex> lock(mtx);
-
         // Skip invalid messages
         if (msg->hexident == HEXIDENT_UNDEFINED || msg->status == STATUS_ERROR)
             return;
 
+        version++;
+
         // Find or create plane entry
         int ptr = find(msg->hexident);
 
@@ -259,6 +415,14 @@ public:
             ptr = create(msg->hexident);
         }
 
+        // frames from Beast and RAW1090 carry only their header so far
+        if (msg->fields_pending)
+        {
+            decoded = *msg;
+            decoded.DecodeFields(FIELDS);
+            msg = &decoded;
+        }
+
         // Move to front and update data
         moveToFront(ptr);
         Plane::ADSB &plane = items[ptr];
@@ -296,7 +460,7 @@ public:
         
         if (msg->even.Valid())
         {
-            if (!checkInCPRCache(msg->even, true, lat_new))
+            if (!isDuplicateCPR(plane.even, msg->even))
             {
                 plane.even.lat = msg->even.lat;
                 plane.even.lon = msg->even.lon;
@@ -313,7 +477,7 @@ public:
 
         if (msg->odd.Valid())
         {
-            if (!checkInCPRCache(msg->odd, false, lat_new))
+            if (!isDuplicateCPR(plane.odd, msg->odd))
             {
                 plane.odd.lat = msg->odd.lat;
                 plane.odd.lon = msg->odd.lon;
@@ -433,21 +597,44 @@ public:
         {
             plane.airborne = msg->airborne;
         }
+
+        if (position_updated && plane.position_timestamp == msg->rxtime && plane.lat != LAT_UNDEFINED && plane.lon != LON_UNDEFINED)
+            addToTrail(ptr);
     }
 
-    std::string getCompactArray(bool include_inactive = false)
+    // a batch of messages from a decoder is processed under a single lock
+    void Receive(const Plane::ADSB *msg, int len, TAG &tag)
     {
         std::lock_guard<std::mutex> lock(mtx);
 
+        expire(Util::Clock::now());
+
+        for (int i = 0; i < len; i++)
+            update(&msg[i], tag);
+    }
+
+    // changes whenever the plane table changes, planes expiring included
+    uint64_t getVersion()
+    {
+        checkExpiry();
+        return version;
+    }
+
+    std::string getCompactArray()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        std::time_t now = Util::Clock::now();
+        expire(now);
+
         const std::string null_str = "null";
         const std::string comma = ",";
         std::string content = "{\"count\":" + std::to_string(count) + ",\"values\":[";
 
-        std::time_t now = std::time(nullptr);
         int ptr = first;
         std::string delim = "";
 
-        while (ptr != -1)
+        while (ptr != expired_ptr)
         {
             const Plane::ADSB &plane = items[ptr];
 
@@ -455,13 +642,8 @@ public:
             {
                 long int time_since_update = now - plane.getRxTimeUnix();
 
-                // Skip inactive planes unless requested
-                if (!include_inactive && time_since_update > 300)
-                {
-                    break;
-                }
-
-                if (time_since_update <= 60 || (time_since_update <= 300 && plane.airborne == 0))
+                // planes on the ground are shown up to ACTIVE_TIME
+                if (time_since_update <= 60 || plane.airborne == 0)
                 {
                     content += delim + "[" +
                                std::to_string(plane.hexident) + comma +
@@ -493,6 +675,164 @@ public:
         return content;
     }
 
+    // binary form of getCompactArray with only the planes received at or after since, the
+    // planes follow up to the end of the buffer. Clients age out planes themselves.
+    void getBinaryDelta(std::vector<char> &v, std::time_t since)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        std::time_t now = Util::Clock::now();
+        expire(now);
+
+        Util::Serialize::Uint64(now, v);
+        Util::Serialize::Int32(count, v);
+
+        Util::Serialize::Writer w(v);
+
+        for (int ptr = first; ptr != expired_ptr; ptr = items[ptr].time_ll.next)
+        {
+            const Plane::ADSB &plane = items[ptr];
+
+            if (plane.hexident == HEXIDENT_UNDEFINED)
+                continue;
+
+            // planes are ordered by last update
+            if (plane.getRxTimeUnix() < since)
+                break;
+
+            long int time_since_update = now - plane.getRxTimeUnix();
+            if (time_since_update > 60 && plane.airborne != 0)
+                continue;
+
+            const std::size_t callsign_len = strlen(plane.callsign);
+
+            // fixed width fields plus the callsign with its length byte
+            w.reserve(75 + callsign_len);
+
+            w.Uint32(plane.hexident);
+            w.LatLon(plane.lat, plane.lon);
+            w.Int32(plane.altitude);
+            w.FloatLow(plane.speed);
+            w.FloatLow(plane.heading);
+            w.Int32(plane.vertrate);
+            w.Int32(plane.squawk);
+            w.String(plane.callsign, callsign_len);
+            w.Int8(plane.airborne);
+            w.Int32(plane.nMessages);
+            w.Uint64(plane.getRxTimeUnix());
+            w.Int16(plane.category);
+            w.FloatLow(plane.signalLevel);
+            w.Int8(plane.country_code[0]);
+            w.Int8(plane.country_code[1]);
+            w.FloatLow(plane.distance);
+            w.Uint32(plane.message_types);
+            w.Uint32(plane.message_subtypes);
+            w.Uint64(plane.group_mask);
+            w.Uint64(plane.last_group);
+            w.Int16(plane.angle);
+        }
+    }
+
+    // trail of a plane from new to old as [lat, lon, altitude, time]
+    std::string getTrailJSON(uint32_t hexident)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        int ptr = find(hexident);
+        if (ptr == -1)
+            return "[]";
+
+        std::string content = "[";
+        int idx = items[ptr].trail_ptr;
+        long t = items[ptr].nMessages + 1;
+
+        while (isNextTrailBlock(idx, hexident, t))
+        {
+            const TrailBlock &b = trails[idx];
+
+            for (int i = b.n - 1; i >= 0; i--)
+            {
+                const TrailBlock::Point &p = b.points[i];
+
+                content += "[" + std::to_string((b.lat + p.lat) / 100000.0) + "," + std::to_string((b.lon + p.lon) / 100000.0) + "," +
+                           (p.altitude != TRAIL_NO_ALTITUDE ? std::to_string(b.altitude + p.altitude) : "null") + "," +
+                           std::to_string(b.timestamp + p.time) + "],";
+            }
+
+            t = b.count;
+            idx = b.next;
+        }
+
+        if (content.size() > 1)
+            content.pop_back();
+        content += "]";
+        return content;
+    }
+
+    // bytes per part of the plane table for /api/memory
+    std::string getMemoryJSON()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        return "{\"planes\":" + std::to_string(items.size() * sizeof(Plane::ADSB)) + ",\"hash\":" + std::to_string(hash_ll.size() * sizeof(LL)) +
+               ",\"trails\":" + std::to_string(trails.size() * sizeof(TrailBlock)) + ",\"limit\":" + std::to_string(N_max * memoryPerPlane() + TRAILS * sizeof(TrailBlock)) + "}";
+    }
+
+    // chain lengths of the hash table, for monitoring
+    std::string getHashStatsPrometheus()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        int max_depth = 0, used = 0, total = 0;
+        for (int i = 0; i < hash_ll.size(); i++)
+        {
+            int depth = 0;
+            for (int ptr = hash_ll[i].next; ptr != END; ptr = items[ptr].hash_ll.next)
+                depth++;
+
+            max_depth = MAX(max_depth, depth);
+            used += depth > 0;
+            total += depth;
+        }
+
+        std::string element;
+        element += "# HELP adsb_db_size Number of planes the table can hold\n";
+        element += "# TYPE adsb_db_size gauge\n";
+        element += "adsb_db_size " + std::to_string(items.size()) + "\n";
+        element += "# HELP adsb_db_memory_bytes Memory used by the plane table\n";
+        element += "# TYPE adsb_db_memory_bytes gauge\n";
+        element += "adsb_db_memory_bytes " + std::to_string(getMemory()) + "\n";
+        element += "# HELP adsb_db_memory_limit_bytes Memory the plane table can grow to\n";
+        element += "# TYPE adsb_db_memory_limit_bytes gauge\n";
+        element += "adsb_db_memory_limit_bytes " + std::to_string(N_max * memoryPerPlane() + TRAILS * sizeof(TrailBlock)) + "\n";
+        element += "# HELP adsb_db_hash_buckets Number of hash buckets\n";
+        element += "# TYPE adsb_db_hash_buckets gauge\n";
+        element += "adsb_db_hash_buckets " + std::to_string(hash_ll.size()) + "\n";
+        element += "# HELP adsb_db_hash_depth_max Longest hash chain\n";
+        element += "# TYPE adsb_db_hash_depth_max gauge\n";
+        element += "adsb_db_hash_depth_max " + std::to_string(max_depth) + "\n";
+        element += "# HELP adsb_db_hash_depth_avg Average length of the non-empty hash chains\n";
+        element += "# TYPE adsb_db_hash_depth_avg gauge\n";
+        element += "adsb_db_hash_depth_avg " + std::to_string(used ? (float)total / used : 0.0f) + "\n";
+        element += "# HELP adsb_db_hash_rehash Number of times the hash table was resized\n";
+        element += "# TYPE adsb_db_hash_rehash counter\n";
+        element += "adsb_db_hash_rehash " + std::to_string(rehash_count) + "\n";
+        return element;
+    }
+
+    // per plane: the entry and on average up to two hash buckets
+    static std::size_t memoryPerPlane() { return sizeof(Plane::ADSB) + 2 * sizeof(LL); }
+
+    // in bytes, 0 keeps the defaults. A quarter goes to the trails, up to the default pool size.
+    void setMemoryCap(std::size_t n)
+    {
+        if (n)
+        {
+            N_max = (int)MAX((std::size_t)N, MIN(n / 4 * 3 / memoryPerPlane(), (std::size_t)(1 << 24)));
+            TRAILS = (int)MAX((std::size_t)256, MIN(n / 4 / sizeof(TrailBlock), (std::size_t)16384));
+        }
+    }
+
     int getFirst() const { return first; }
     int getLast() const { return last; }
     int getCount() const { return count; }
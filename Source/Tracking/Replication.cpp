@@ -0,0 +1,401 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "Replication.h"
+#include "Serialize.h"
+#include "Logger.h"
+
+namespace Replication
+{
+	static const char MAGIC[4] = {'A', 'I', 'S', 'R'};
+	static const uint8_t FRAME_VERSION = 3;
+	static const uint32_t MAX_PAYLOAD = MAX_RECORDS * Ship::MAX_RECORD_SIZE;
+
+	static uint32_t getUint32(const uint8_t *p)
+	{
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	}
+
+	//---------------------------------------
+	// Server
+
+	void Server::Start(DB *d, int port)
+	{
+		db = d;
+
+		// followers only listen, an idle connection is not a reason to close it
+		timeout = 0;
+
+		if (!TCPServer::start(port))
+			throw std::runtime_error("Replication: cannot start server at port " + std::to_string(port) + ".");
+
+		db->setTrackRemoved(true);
+
+		Info() << "Replication: publishing ship database at port " << port << ".";
+
+		running = true;
+		thread = std::thread(&Server::Run, this);
+	}
+
+	void Server::Stop()
+	{
+		running = false;
+
+		if (thread.joinable())
+			thread.join();
+	}
+
+	void Server::processClients(Listener &l)
+	{
+		// a follower sends a line when it (re)connects to ask for a full copy
+		for (auto &c : l.client)
+		{
+			if (c.isConnected() && !c.msg.empty())
+			{
+				sync_request = true;
+				c.msg.clear();
+			}
+		}
+	}
+
+	std::vector<char> Server::header(char type, uint32_t count)
+	{
+		std::vector<char> frame;
+
+		frame.insert(frame.end(), MAGIC, MAGIC + sizeof(MAGIC));
+		Util::Serialize::Uint8(FRAME_VERSION, frame);
+		Util::Serialize::Uint8((uint8_t)type, frame);
+		Util::Serialize::Uint32(frame_seq++, frame);
+		Util::Serialize::Uint64((uint64_t)last_epoch, frame);
+		Util::Serialize::Uint32(count, frame);
+		// payload length, filled in by send
+		Util::Serialize::Uint32(0, frame);
+
+		return frame;
+	}
+
+	void Server::send(std::vector<char> &frame)
+	{
+		uint32_t payload = (uint32_t)(frame.size() - HEADER_SIZE);
+		for (int i = 0; i < 4; i++)
+			frame[HEADER_SIZE - 4 + i] = (char)(payload >> (24 - 8 * i));
+
+		SendAllShared(std::make_shared<const std::string>(frame.data(), frame.size()));
+		frames++;
+	}
+
+	void Server::publish(bool full, const std::vector<Ship> &list)
+	{
+		// the list is latest first, the oldest chunk goes first so that the follower keeps the update order
+		std::size_t end = list.size();
+
+		do
+		{
+			uint32_t count = (uint32_t)std::min(end, (std::size_t)MAX_RECORDS);
+			std::size_t begin = end - count;
+
+			std::vector<char> frame = header(full ? (end == list.size() ? 'F' : 'C') : 'D', count);
+			frame.reserve(HEADER_SIZE + count * Ship::MAX_RECORD_SIZE);
+
+			{
+				Util::Serialize::Writer w(frame);
+				for (std::size_t i = begin; i < end; i++)
+				{
+					w.reserve(Ship::MAX_RECORD_SIZE);
+					list[i].SerializeRecord(w);
+				}
+			}
+
+			send(frame);
+
+			end = begin;
+			records += count;
+		} while (end > 0);
+
+		if (full)
+		{
+			std::vector<char> frame = header('E', 0);
+			send(frame);
+		}
+	}
+
+	void Server::publishRemoved(const std::vector<uint32_t> &removed)
+	{
+		for (std::size_t n = 0; n < removed.size(); n += MAX_RECORDS)
+		{
+			uint32_t count = (uint32_t)std::min(removed.size() - n, (std::size_t)MAX_RECORDS);
+
+			std::vector<char> frame = header('R', count);
+			for (uint32_t i = 0; i < count; i++)
+				Util::Serialize::Uint32(removed[n + i], frame);
+
+			send(frame);
+		}
+	}
+
+	void Server::Run()
+	{
+		std::vector<Ship> list;
+		std::vector<uint32_t> removed;
+
+		while (running)
+		{
+			std::time_t epoch = db->getEpoch();
+			bool full = sync_request.exchange(false) || epoch != last_epoch;
+
+			// a full copy goes to all followers, the records are idempotent for the ones already in sync
+			uint64_t seq = db->getChanges(list, removed, full ? 0 : last_seq);
+
+			last_epoch = epoch;
+			last_seq = seq;
+
+			// removals first, a recycled MMSI can be back in the list
+			if (!full)
+				publishRemoved(removed);
+
+			if (full || !list.empty())
+			{
+				publish(full, list);
+				if (full)
+					full_syncs++;
+			}
+
+			for (int i = 0; i < 10 && running; i++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	std::string Server::getPrometheus()
+	{
+		int clients;
+		std::size_t queued, max_queued;
+		uint64_t dropped;
+
+		getQueueStats(clients, queued, max_queued, dropped);
+
+		std::string element;
+		element += "# HELP ais_replication_followers Followers connected to the replication server\n";
+		element += "# TYPE ais_replication_followers gauge\n";
+		element += "ais_replication_followers " + std::to_string(clients) + "\n";
+		element += "# HELP ais_replication_frames_sent Replication frames published\n";
+		element += "# TYPE ais_replication_frames_sent counter\n";
+		element += "ais_replication_frames_sent " + std::to_string(frames) + "\n";
+		element += "# HELP ais_replication_records_sent Ship records published\n";
+		element += "# TYPE ais_replication_records_sent counter\n";
+		element += "ais_replication_records_sent " + std::to_string(records) + "\n";
+		element += "# HELP ais_replication_full_syncs Full copies of the ship database published\n";
+		element += "# TYPE ais_replication_full_syncs counter\n";
+		element += "ais_replication_full_syncs " + std::to_string(full_syncs) + "\n";
+		element += "# HELP ais_replication_dropped Frames dropped for followers that fell behind\n";
+		element += "# TYPE ais_replication_dropped counter\n";
+		element += "ais_replication_dropped " + std::to_string(dropped) + "\n";
+		return element;
+	}
+
+	//---------------------------------------
+	// Client
+
+	void Client::Start(DB *d, const std::string &source)
+	{
+		db = d;
+
+		std::size_t colon = source.rfind(':');
+		if (colon == std::string::npos || colon == 0 || colon == source.size() - 1)
+			throw std::runtime_error("Replication: source should be host:port, got \"" + source + "\".");
+
+		tcp.setValue("HOST", source.substr(0, colon));
+		tcp.setValue("PORT", source.substr(colon + 1));
+		tcp.setValue("PERSISTENT", "on");
+		tcp.setValue("KEEP_ALIVE", "on");
+		tcp.add(this);
+
+		Info() << "Replication: following ship database at " << source << ".";
+
+		tcp.connect();
+
+		running = true;
+		thread = std::thread(&Client::Run, this);
+	}
+
+	void Client::Stop()
+	{
+		running = false;
+
+		if (thread.joinable())
+			thread.join();
+
+		tcp.disconnect();
+	}
+
+	void Client::onConnect()
+	{
+		// frames do not continue over a reconnect, start over with a full copy
+		buffer.clear();
+		in_sequence = false;
+		in_full = false;
+
+		requestSync();
+	}
+
+	void Client::requestSync()
+	{
+		const char request[] = "SYNC\n";
+		prev->send(request, sizeof(request) - 1);
+	}
+
+	void Client::process()
+	{
+		std::size_t start = 0;
+
+		while (buffer.size() - start >= (std::size_t)HEADER_SIZE)
+		{
+			const uint8_t *h = (const uint8_t *)buffer.data() + start;
+
+			if (std::memcmp(h, MAGIC, sizeof(MAGIC)) != 0 || h[4] != FRAME_VERSION)
+			{
+				Error() << "Replication: invalid frame from source, reconnecting.";
+				buffer.clear();
+				tcp.disconnect();
+				return;
+			}
+
+			char type = (char)h[5];
+			uint32_t seq = getUint32(h + 6);
+			uint32_t count = getUint32(h + 18);
+			uint32_t payload = getUint32(h + 22);
+
+			if (count > (uint32_t)MAX_RECORDS || payload > MAX_PAYLOAD)
+			{
+				Error() << "Replication: invalid frame from source, reconnecting.";
+				buffer.clear();
+				tcp.disconnect();
+				return;
+			}
+
+			std::size_t length = HEADER_SIZE + (std::size_t)payload;
+			if (buffer.size() - start < length)
+				break;
+
+			frames++;
+
+			// a missing frame leaves ships out of date until they change again, get a full copy
+			if (in_sequence && seq != expected)
+			{
+				gaps++;
+				Warning() << "Replication: " << (uint32_t)(seq - expected) << " frame(s) from source missed, requesting a full copy.";
+				requestSync();
+				in_full = false;
+			}
+
+			expected = seq + 1;
+			in_sequence = true;
+
+			Util::Serialize::Reader r((const char *)h + HEADER_SIZE, payload);
+			bool valid = true;
+
+			if (type == 'R')
+			{
+				removed.resize(count);
+				for (uint32_t i = 0; i < count; i++)
+					removed[i] = r.Uint32();
+				valid = r.ok();
+			}
+			else
+			{
+				list.resize(count);
+				for (uint32_t i = 0; i < count && valid; i++)
+					valid = list[i].DeserializeRecord(r);
+			}
+
+			if (!valid || r.position() != payload)
+			{
+				if (rejected++ == 0)
+					Warning() << "Replication: invalid ship records from source, ignoring frame.";
+			}
+			else if (type == 'R')
+			{
+				db->removeShips(removed);
+			}
+			else if (type == 'E')
+			{
+				// ships the full copy did not touch are gone on the source
+				if (in_full)
+					db->removeActiveUpTo(full_mark);
+				in_full = false;
+			}
+			else
+			{
+				if (type == 'F')
+				{
+					in_full = true;
+					full_mark = db->getUpdateSeq();
+				}
+
+				db->applyChanges(list);
+				records += count;
+			}
+
+			start += length;
+		}
+
+		buffer.erase(buffer.begin(), buffer.begin() + start);
+	}
+
+	void Client::Run()
+	{
+		const int BUFFER_SIZE = 65536;
+		std::vector<char> data(BUFFER_SIZE);
+
+		while (running)
+		{
+			int len = tcp.read(data.data(), BUFFER_SIZE, 1, false);
+
+			if (len > 0)
+			{
+				buffer.insert(buffer.end(), data.begin(), data.begin() + len);
+				process();
+			}
+			else if (!tcp.isConnected())
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
+	std::string Client::getPrometheus()
+	{
+		std::string element;
+		element += "# HELP ais_replica_connected Connection to the replication source is up\n";
+		element += "# TYPE ais_replica_connected gauge\n";
+		element += "ais_replica_connected " + std::string(tcp.getState() == Protocol::TCP::READY ? "1" : "0") + "\n";
+		element += "# HELP ais_replica_frames Replication frames received\n";
+		element += "# TYPE ais_replica_frames counter\n";
+		element += "ais_replica_frames " + std::to_string(frames) + "\n";
+		element += "# HELP ais_replica_records Ship records applied from the source\n";
+		element += "# TYPE ais_replica_records counter\n";
+		element += "ais_replica_records " + std::to_string(records) + "\n";
+		element += "# HELP ais_replica_rejected Frames ignored because the records could not be read\n";
+		element += "# TYPE ais_replica_rejected counter\n";
+		element += "ais_replica_rejected " + std::to_string(rejected) + "\n";
+		element += "# HELP ais_replica_gaps Missed frames that led to a new full copy\n";
+		element += "# TYPE ais_replica_gaps counter\n";
+		element += "ais_replica_gaps " + std::to_string(gaps) + "\n";
+		return element;
+	}
+}
@@ -0,0 +1,115 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DB.h"
+#include "Protocol.h"
+#include "TCPServer.h"
+
+// Replication of the ship database to followers that serve the same map without decoding. The source
+// publishes the ship records that changed since the previous round once per second, a follower that
+// connects asks for a full copy first. A frame is "AISR", version, type, the frame sequence number,
+// the DB epoch, the record count and the payload length (big endian) followed by the payload. Types
+// 'D' (delta) and 'F'/'C' (first/next part of a full copy) carry records as written by
+// Ship::SerializeRecord, oldest first over the frames. 'R' carries the MMSIs (uint32) of the ships
+// removed on the source and 'E' ends a full copy, the follower then drops the ships the copy did not
+// include. A follower that misses a frame, for instance because the source dropped it when the
+// follower fell behind, asks for a full copy again.
+
+namespace Replication
+{
+	static const int HEADER_SIZE = 4 + 1 + 1 + 4 + 8 + 4 + 4;
+	static const int MAX_RECORDS = 1024;
+
+	class Server : public IO::TCPServer
+	{
+		DB *db = nullptr;
+
+		std::thread thread;
+		std::atomic<bool> running{false};
+		std::atomic<bool> sync_request{false};
+
+		uint64_t last_seq = 0;
+		std::time_t last_epoch = 0;
+		uint32_t frame_seq = 0;
+
+		uint64_t frames = 0, records = 0, full_syncs = 0;
+
+		std::vector<char> header(char type, uint32_t count);
+		void send(std::vector<char> &frame);
+		void publish(bool full, const std::vector<Ship> &list);
+		void publishRemoved(const std::vector<uint32_t> &removed);
+		void Run();
+
+	protected:
+		void processClients(Listener &l) override;
+
+	public:
+		~Server() { Stop(); }
+
+		void Start(DB *d, int port);
+		void Stop();
+
+		std::string getPrometheus();
+	};
+
+	class Client : public Protocol::ProtocolBase
+	{
+		DB *db = nullptr;
+		Protocol::TCP tcp;
+
+		std::thread thread;
+		std::atomic<bool> running{false};
+
+		std::vector<char> buffer;
+		std::vector<Ship> list;
+		std::vector<uint32_t> removed;
+
+		// sequence number of the next frame, unknown until the first frame after a connect
+		uint32_t expected = 0;
+		bool in_sequence = false;
+
+		// receiving a full copy, ships not updated after full_mark are not in it
+		bool in_full = false;
+		uint64_t full_mark = 0;
+
+		uint64_t frames = 0, records = 0, rejected = 0, gaps = 0;
+
+		void requestSync();
+		void process();
+		void Run();
+
+	public:
+		Client() : ProtocolBase("REPLICA") {}
+		~Client() { Stop(); }
+
+		void onConnect() override;
+
+		// source as host:port
+		void Start(DB *d, const std::string &source);
+		void Stop();
+
+		std::string getPrometheus();
+	};
+}
@@ -29,6 +29,7 @@ void Ship::reset()
 	path_ptr = -1;
 
 	mmsi = count = msg_type = shiptype = group_mask = 0;
+	seq = 0;
 	flags.reset();
 
 	heading = HEADING_UNDEFINED;
@@ -62,48 +63,161 @@ void Ship::reset()
 	memset(callsign, 0, sizeof(callsign));
 	memset(country_code, 0, sizeof(country_code));
 	last_group = GROUP_OUT_UNDEFINED;
+}
+
+static const char *VIRTUAL_SUFFIX = " [V]";
 
-	msg.clear();
+// fixed width fields plus the three strings, each with a length byte
+std::size_t Ship::serializedSize() const
+{
+	return 101 + strlen(callsign) + strlen(shipname) + (getVirtualAid() ? strlen(VIRTUAL_SUFFIX) : 0) + strlen(destination);
 }
 
-void Ship::Serialize(std::vector<char> &v) const
+void Ship::Serialize(Util::Serialize::Writer &w) const
 {
+	char name[sizeof(shipname) + 8];
+	std::size_t name_len = strlen(shipname);
+
+	memcpy(name, shipname, name_len);
+	if (getVirtualAid())
+	{
+		memcpy(name + name_len, VIRTUAL_SUFFIX, strlen(VIRTUAL_SUFFIX));
+		name_len += strlen(VIRTUAL_SUFFIX);
+	}
 
 	// Serialize the ship
-	Util::Serialize::Uint32(mmsi, v);
-	Util::Serialize::LatLon(lat, lon, v);
-	Util::Serialize::FloatLow(distance, v);
-	Util::Serialize::FloatLow(angle, v);
-	Util::Serialize::FloatLow(level, v);
-	Util::Serialize::Int16(count, v);
-	Util::Serialize::FloatLow(ppm, v);
-	Util::Serialize::Int8((getApproximate()) + (getValidated()), v);
-	Util::Serialize::FloatLow(heading, v);
-	Util::Serialize::FloatLow(cog, v);
-	Util::Serialize::FloatLow(speed, v);
-	Util::Serialize::Int16(to_bow, v);
-	Util::Serialize::Int16(to_stern, v);
-	Util::Serialize::Int16(to_starboard, v);
-	Util::Serialize::Int16(to_port, v);
-	Util::Serialize::Uint64(last_group, v);
-	Util::Serialize::Uint64(group_mask, v);
-	Util::Serialize::Int16(shiptype, v);
-	Util::Serialize::Int8((shipclass << 4) + mmsi_type, v);
-	Util::Serialize::Uint32(msg_type, v);
-	Util::Serialize::Int8(getChannels(), v);
-	Util::Serialize::Int8(country_code[0], v);
-	Util::Serialize::Int8(country_code[1], v);
-	Util::Serialize::Int8(status, v);
-	Util::Serialize::FloatLow(draught, v);
-	Util::Serialize::Int8(month, v);
-	Util::Serialize::Int8(day, v);
-	Util::Serialize::Int8(hour, v);
-	Util::Serialize::Int8(minute, v);
-	Util::Serialize::Int32(IMO, v);
-	Util::Serialize::String(std::string(callsign), v);
-	Util::Serialize::String(std::string(shipname) + (getVirtualAid() ? std::string(" [V]") : std::string("")), v);
-	Util::Serialize::String(std::string(destination), v);
-	Util::Serialize::Uint64(last_signal, v);
+	w.Uint32(mmsi);
+	w.LatLon(lat, lon);
+	// distance can exceed the range of FloatLow for ships shared over the network
+	w.Int32((int32_t)(distance * 10.0f));
+	w.FloatLow(angle);
+	w.FloatLow(level);
+	w.Int32(count);
+	w.FloatLow(ppm);
+	w.Int8(getApproximate() | (getValidated() << 1));
+	w.FloatLow(heading);
+	w.FloatLow(cog);
+	w.FloatLow(speed);
+	w.Int16(to_bow);
+	w.Int16(to_stern);
+	w.Int16(to_starboard);
+	w.Int16(to_port);
+	w.Uint64(last_group);
+	w.Uint64(group_mask);
+	w.Int16(shiptype);
+	w.Int8((shipclass << 4) + mmsi_type);
+	w.Uint32(msg_type);
+	w.Int8(getChannels());
+	w.Int8(country_code[0]);
+	w.Int8(country_code[1]);
+	w.Int8(status);
+	w.FloatLow(draught);
+	w.Int8(month);
+	w.Int8(day);
+	w.Int8(hour);
+	w.Int8(minute);
+	w.Int32(IMO);
+	w.String(callsign, strlen(callsign));
+	w.String(name, name_len);
+	w.String(destination, strlen(destination));
+	w.Uint64(last_signal);
+	w.Uint32(flags.getPackedValue());
+	w.Int32(altitude);
+	w.Int32(received_stations);
+}
+
+void Ship::SerializeRecord(Util::Serialize::Writer &w) const
+{
+	w.Uint32(mmsi);
+	w.Float32(lat);
+	w.Float32(lon);
+	w.Float32(speed);
+	w.Float32(cog);
+	w.Int64((int64_t)last_signal);
+
+	w.Int32(count);
+	w.Int32(msg_type);
+	w.Int32(shipclass);
+	w.Int32(mmsi_type);
+	w.Int32(shiptype);
+	w.Int32(heading);
+	w.Int32(status);
+	w.Int32(to_port);
+	w.Int32(to_bow);
+	w.Int32(to_starboard);
+	w.Int32(to_stern);
+	w.Int32(IMO);
+	w.Int32(angle);
+	w.Int32(altitude);
+	w.Int32(received_stations);
+
+	w.Int8(month);
+	w.Int8(day);
+	w.Int8(hour);
+	w.Int8(minute);
+
+	w.Float32(ppm);
+	w.Float32(level);
+	w.Float32(draught);
+	w.Float32(distance);
+	w.Int64((int64_t)last_direct_signal);
+	w.Uint64(last_group);
+	w.Uint64(group_mask);
+	w.Uint32(flags.getPackedValue());
+
+	w.String(shipname, strlen(shipname));
+	w.String(destination, strlen(destination));
+	w.String(callsign, strlen(callsign));
+	w.String(country_code, strlen(country_code));
+}
+
+bool Ship::DeserializeRecord(Util::Serialize::Reader &r)
+{
+	reset();
+
+	mmsi = r.Uint32();
+	lat = r.Float32();
+	lon = r.Float32();
+	speed = r.Float32();
+	cog = r.Float32();
+	last_signal = (std::time_t)r.Int64();
+
+	count = r.Int32();
+	msg_type = r.Int32();
+	shipclass = r.Int32();
+	mmsi_type = r.Int32();
+	shiptype = r.Int32();
+	heading = r.Int32();
+	status = r.Int32();
+	to_port = r.Int32();
+	to_bow = r.Int32();
+	to_starboard = r.Int32();
+	to_stern = r.Int32();
+	IMO = r.Int32();
+	angle = r.Int32();
+	altitude = r.Int32();
+	received_stations = r.Int32();
+
+	month = r.Int8();
+	day = r.Int8();
+	hour = r.Int8();
+	minute = r.Int8();
+
+	ppm = r.Float32();
+	level = r.Float32();
+	draught = r.Float32();
+	distance = r.Float32();
+	last_direct_signal = (std::time_t)r.Int64();
+	last_group = r.Uint64();
+	group_mask = r.Uint64();
+	flags.setPackedValue(r.Uint32());
+
+	r.String(shipname, sizeof(shipname));
+	r.String(destination, sizeof(destination));
+	r.String(callsign, sizeof(callsign));
+	r.String(country_code, sizeof(country_code));
+
+	return r.ok() && mmsi != 0;
 }
 
 std::string getSprite(const Ship *ship)
@@ -424,7 +538,7 @@ bool Ship::Save(std::ofstream &file) const
 	if (!file.write((const char *)&version, sizeof(version)))
 		return false;
 
-	// Write all ship data except the msg vector
+	// Write all ship data
 	if (!file.write((const char *)&mmsi, sizeof(mmsi)))
 		return false;
 	if (!file.write((const char *)&count, sizeof(count)))
@@ -522,7 +636,7 @@ bool Ship::Load(std::ifstream &file)
 	if (magic != _SHIP_MAGIC || version != _SHIP_VERSION)
 		return false;
 
-	// Read all ship data except the msg vector (which is skipped)
+	// Read all ship data
 	if (!file.read((char *)&mmsi, sizeof(mmsi)))
 		return false;
 	if (!file.read((char *)&count, sizeof(count)))
@@ -604,8 +718,5 @@ bool Ship::Load(std::ifstream &file)
 	if (!file.read((char *)&path_ptr, sizeof(path_ptr)))
 		return false;
 
-	// Clear the msg vector as it's not persisted
-	msg.clear();
-
 	return true;
 }
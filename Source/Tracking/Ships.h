@@ -35,26 +35,38 @@ const int BASESTATION_MASK = (1 << 4) | (1 << 16) | (1 << 17) | (1 << 20) | (1 <
 const int SAR_MASK = 1 << 9;
 const int ATON_MASK = 1 << 21;
 
+// plain data so the table can be copied with memcpy, the last message of a ship is kept in DB.
+// Fields used by the scans over the full table (expiry, snapshots, positions) come first.
 struct Ship
 {
     int prev, next;
     uint32_t mmsi;
+    float lat, lon, speed, cog;
+    std::time_t last_signal;
+    uint64_t seq;
+
     int count, msg_type, shipclass, mmsi_type, shiptype, heading, status, path_ptr;
     int to_port, to_bow, to_starboard, to_stern, IMO, angle, altitude, received_stations;
     char month, day, hour, minute;
-    float lat, lon, ppm, level, speed, cog, draught, distance;
-    std::time_t last_signal, last_direct_signal;
-    char shipname[21], destination[21], callsign[8], country_code[3];
-    std::string msg;
+    float ppm, level, draught, distance;
+    std::time_t last_direct_signal;
     uint64_t last_group, group_mask;
     Util::PackedInt flags;
 
+    char shipname[21], destination[21], callsign[8], country_code[3];
+
     void reset();
     int getMMSItype();
     int getShipTypeClassEri();
     int getShipTypeClass();
     void setType();
-    void Serialize(std::vector<char> &v) const;
+    // bytes written by Serialize
+    std::size_t serializedSize() const;
+    void Serialize(Util::Serialize::Writer &w) const;
+    // all fields except the links into the table, without loss and independent of the build
+    static const std::size_t MAX_RECORD_SIZE = 189;
+    void SerializeRecord(Util::Serialize::Writer &w) const;
+    bool DeserializeRecord(Util::Serialize::Reader &r);
     bool getKML(std::string &) const;
     bool getGeoJSON(std::string &) const;
 
@@ -20,6 +20,12 @@
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <ctime>
+#include <vector>
 
 #include "Stream.h"
 #include "JSONAIS.h"
@@ -31,7 +37,8 @@
 
 class MessageStatistics {
 
-	std::mutex mtx;
+	// Add runs without a lock from any number of message threads: counters are relaxed atomics and the
+	// level, distance and radar extremes are updated with compare-exchange. Readers take a snapshot.
 
 	static const int _MAGIC = 0x4f82b;
 	static const int _VERSION = 2;
@@ -39,13 +46,59 @@ class MessageStatistics {
 
 	int _LONG_RANGE_CUTOFF = 2500;
 
-	int _count, _exclude, _vessels;
-	int _msg[27];
-	int _channel[4];
+	std::atomic<int> _count, _exclude, _vessels;
+	std::atomic<int> _msg[27];
+	std::atomic<int> _channel[4];
 
-	float _level_min, _level_max, _ppm, _distance;
-	float _radarA[_RADAR_BUCKETS];
-	float _radarB[_RADAR_BUCKETS];
+	std::atomic<float> _level_min, _level_max, _ppm, _distance;
+	std::atomic<float> _radarA[_RADAR_BUCKETS];
+	std::atomic<float> _radarB[_RADAR_BUCKETS];
+
+	static void inc(std::atomic<int>& a) { a.fetch_add(1, std::memory_order_relaxed); }
+
+	static void add(std::atomic<float>& a, float v) {
+		float c = a.load(std::memory_order_relaxed);
+		while (!a.compare_exchange_weak(c, c + v, std::memory_order_relaxed)) {}
+	}
+
+	static void lower(std::atomic<float>& a, float v) {
+		float c = a.load(std::memory_order_relaxed);
+		while (v < c && !a.compare_exchange_weak(c, v, std::memory_order_relaxed)) {}
+	}
+
+	static void raise(std::atomic<float>& a, float v) {
+		float c = a.load(std::memory_order_relaxed);
+		while (v > c && !a.compare_exchange_weak(c, v, std::memory_order_relaxed)) {}
+	}
+
+	template <typename T>
+	static bool write(std::ofstream& file, const std::atomic<T>& a) {
+		T v = a.load();
+		return (bool)file.write((const char*)&v, sizeof(T));
+	}
+
+	template <typename T, int K>
+	static bool write(std::ofstream& file, const std::atomic<T> (&a)[K]) {
+		T v[K];
+		for (int i = 0; i < K; i++) v[i] = a[i].load();
+		return (bool)file.write((const char*)v, sizeof(v));
+	}
+
+	template <typename T>
+	static bool read(std::ifstream& file, std::atomic<T>& a) {
+		T v;
+		if (!file.read((char*)&v, sizeof(T))) return false;
+		a = v;
+		return true;
+	}
+
+	template <typename T, int K>
+	static bool read(std::ifstream& file, std::atomic<T> (&a)[K]) {
+		T v[K];
+		if (!file.read((char*)v, sizeof(v))) return false;
+		for (int i = 0; i < K; i++) a[i] = v[i];
+		return true;
+	}
 
 public:
 	MessageStatistics() { Clear(); }
@@ -55,12 +108,10 @@ public:
 	void clearVessels() { _vessels = 0; }
 
 	void Clear() {
-		std::lock_guard<std::mutex> l{ this->mtx };
-
-		std::memset(_msg, 0, sizeof(_msg));
-		std::memset(_channel, 0, sizeof(_channel));
-		std::memset(_radarA, 0, sizeof(_radarA));
-		std::memset(_radarB, 0, sizeof(_radarB));
+		for (auto& m : _msg) m = 0;
+		for (auto& c : _channel) c = 0;
+		for (auto& r : _radarA) r = 0;
+		for (auto& r : _radarB) r = 0;
 
 		_count = _vessels = _exclude = 0;
 		_distance = _ppm = 0;
@@ -70,22 +121,20 @@ public:
 
 	void Add(const AIS::Message& m, const TAG& tag, bool new_vessel = false) {
 
-		std::lock_guard<std::mutex> l{ this->mtx };
-
 		if (m.type() > 27 || m.type() < 1) return;
 
-		_count++;
-		if (new_vessel) _vessels++;
+		inc(_count);
+		if (new_vessel) inc(_vessels);
 
-		_msg[m.type() - 1]++;
-		if (m.getChannel() >= 'A' && m.getChannel() <= 'D') _channel[m.getChannel() - 'A']++;
+		inc(_msg[m.type() - 1]);
+		if (m.getChannel() >= 'A' && m.getChannel() <= 'D') inc(_channel[m.getChannel() - 'A']);
 
 		if (tag.level == LEVEL_UNDEFINED || tag.ppm == PPM_UNDEFINED)
-			_exclude++;
+			inc(_exclude);
 		else {
-			_level_min = MIN(_level_min, tag.level);
-			_level_max = MAX(_level_max, tag.level);
-			_ppm += tag.ppm;
+			lower(_level_min, tag.level);
+			raise(_level_max, tag.level);
+			add(_ppm, tag.ppm);
 		}
 
 		// for range we ignore atons
@@ -94,98 +143,90 @@ public:
 		if (!tag.validated || tag.distance > _LONG_RANGE_CUTOFF || m.repeat() > 0)
 			return;
 
-		if (tag.distance > _distance) {
-			_distance = tag.distance;
-		}
+		raise(_distance, tag.distance);
 
 		if (m.type() == 18 || m.type() == 19 || m.type() == 24) {
 			if (tag.angle >= 0 && tag.angle < 360) {
 				int bucket = tag.angle / (360 / _RADAR_BUCKETS);
-				if (tag.distance > _radarB[bucket])
-					_radarB[bucket] = tag.distance;
+				raise(_radarB[bucket], tag.distance);
 			}
 		}
 		else if (m.type() <= 3 || m.type() == 5 || m.type() == 27) {
 			if (tag.angle >= 0 && tag.angle < 360) {
 				int bucket = tag.angle / (360 / _RADAR_BUCKETS);
-				if (tag.distance > _radarA[bucket])
-					_radarA[bucket] = tag.distance;
+				raise(_radarA[bucket], tag.distance);
 			}
 		}
 	}
 
 	std::string toJSON(bool empty = false) {
-		std::lock_guard<std::mutex> l{ this->mtx };
 		static const std::string null_str = "null";
 		static const std::string comma = ",";
 
 		std::string element;
 
-		int c = _count - _exclude;
+		int count = _count;
+		int c = count - _exclude;
 
-		element += "{\"count\":" + std::to_string(empty ? 0 : _count) +
-				   ",\"vessels\":" + std::to_string(empty ? 0 : _vessels) +
-				   ",\"level_min\":" + ((empty || !c) ? null_str : Util::Convert::toString(_level_min)) +
-				   ",\"level_max\":" + ((empty || !c) ? null_str : Util::Convert::toString(_level_max)) +
+		element += "{\"count\":" + std::to_string(empty ? 0 : count) +
+				   ",\"vessels\":" + std::to_string(empty ? 0 : _vessels.load()) +
+				   ",\"level_min\":" + ((empty || !c) ? null_str : Util::Convert::toString(_level_min.load())) +
+				   ",\"level_max\":" + ((empty || !c) ? null_str : Util::Convert::toString(_level_max.load())) +
 				   ",\"ppm\":" + (empty || !c ? null_str : std::to_string(_ppm / c)) +
-				   ",\"dist\":" + (empty ? null_str : std::to_string(_distance)) +
+				   ",\"dist\":" + (empty ? null_str : std::to_string(_distance.load())) +
 				   ",\"channel\":[";
 
-		for (int i = 0; i < 4; i++) element += std::to_string(empty ? 0 : _channel[i]) + comma;
+		for (int i = 0; i < 4; i++) element += std::to_string(empty ? 0 : _channel[i].load()) + comma;
 		element.pop_back();
 		element += "],\"radar_a\":[";
-		for (int i = 0; i < _RADAR_BUCKETS; i++) element += std::to_string(empty ? 0 : _radarA[i]) + comma;
+		for (int i = 0; i < _RADAR_BUCKETS; i++) element += std::to_string(empty ? 0 : _radarA[i].load()) + comma;
 		element.pop_back();
 		element += "],\"radar_b\":[";
-		for (int i = 0; i < _RADAR_BUCKETS; i++) element += std::to_string(empty ? 0 : _radarB[i]) + comma;
+		for (int i = 0; i < _RADAR_BUCKETS; i++) element += std::to_string(empty ? 0 : _radarB[i].load()) + comma;
 		element.pop_back();
 		element += "],\"msg\":[";
-		for (int i = 0; i < 27; i++) element += std::to_string(empty ? 0 : _msg[i]) + comma;
+		for (int i = 0; i < 27; i++) element += std::to_string(empty ? 0 : _msg[i].load()) + comma;
 		element.pop_back();
 		element += "]}";
 		return element;
 	}
 
 	bool Save(std::ofstream& file) {
-		std::lock_guard<std::mutex> l{ this->mtx };
-
 		int magic = _MAGIC;
 		int version = _VERSION;
 
-		if (!file.write((const char*)&magic, sizeof(int))) return false;			 // Check magic number
-		if (!file.write((const char*)&version, sizeof(int))) return false;			 // Check version number
-		if (!file.write((const char*)&_count, sizeof(int))) return false;			 // Check count
-		if (!file.write((const char*)&_vessels, sizeof(int))) return false;			 // Check count
-		if (!file.write((const char*)&_msg, sizeof(_msg))) return false;			 // Check msg array
-		if (!file.write((const char*)&_channel, sizeof(_channel))) return false;	 // Check channel array
-		if (!file.write((const char*)&_level_min, sizeof(_level_min))) return false; // Check level
-		if (!file.write((const char*)&_level_max, sizeof(_level_max))) return false; // Check level
-		if (!file.write((const char*)&_ppm, sizeof(_ppm))) return false;			 // Check ppm
-		if (!file.write((const char*)&_distance, sizeof(_distance))) return false;	 // Check distance
-		if (!file.write((const char*)&_radarA, sizeof(_radarA))) return false;		 // Check radar array
-		if (!file.write((const char*)&_radarB, sizeof(_radarB))) return false;		 // Check radar array
+		if (!file.write((const char*)&magic, sizeof(int))) return false;	// Check magic number
+		if (!file.write((const char*)&version, sizeof(int))) return false;	// Check version number
+		if (!write(file, _count)) return false;								// Check count
+		if (!write(file, _vessels)) return false;							// Check count
+		if (!write(file, _msg)) return false;								// Check msg array
+		if (!write(file, _channel)) return false;							// Check channel array
+		if (!write(file, _level_min)) return false;							// Check level
+		if (!write(file, _level_max)) return false;							// Check level
+		if (!write(file, _ppm)) return false;								// Check ppm
+		if (!write(file, _distance)) return false;							// Check distance
+		if (!write(file, _radarA)) return false;							// Check radar array
+		if (!write(file, _radarB)) return false;							// Check radar array
 
 		return true;
 	}
 
 	bool Load(std::ifstream& file) {
-		std::lock_guard<std::mutex> l{ this->mtx };
-
 		int magic = 0, version = 0;
 		if (!file.read((char*)&magic, sizeof(int))) return false;	// Check count
 		if (!file.read((char*)&version, sizeof(int))) return false; // Check count
-		if (!file.read((char*)&_count, sizeof(int))) return false;	// Check count
+		if (!read(file, _count)) return false;						// Check count
 		if (version == _VERSION) {
-			if (!file.read((char*)&_vessels, sizeof(int))) return false; // Check count
+			if (!read(file, _vessels)) return false; // Check count
 		}
-		if (!file.read((char*)&_msg, sizeof(_msg))) return false;			  // Check msg array
-		if (!file.read((char*)&_channel, sizeof(_channel))) return false;	  // Check channel array
-		if (!file.read((char*)&_level_min, sizeof(_level_min))) return false; // Check level
-		if (!file.read((char*)&_level_max, sizeof(_level_max))) return false; // Check level
-		if (!file.read((char*)&_ppm, sizeof(_ppm))) return false;			  // Check ppm
-		if (!file.read((char*)&_distance, sizeof(_distance))) return false;	  // Check distance
-		if (!file.read((char*)&_radarA, sizeof(_radarA))) return false;		  // Check radar array
-		if (!file.read((char*)&_radarB, sizeof(_radarB))) return false;		  // Check radar array
+		if (!read(file, _msg)) return false;		// Check msg array
+		if (!read(file, _channel)) return false;	// Check channel array
+		if (!read(file, _level_min)) return false;	// Check level
+		if (!read(file, _level_max)) return false;	// Check level
+		if (!read(file, _ppm)) return false;		// Check ppm
+		if (!read(file, _distance)) return false;	// Check distance
+		if (!read(file, _radarA)) return false;		// Check radar array
+		if (!read(file, _radarB)) return false;		// Check radar array
 
 		if (false && !file.eof()) {
 			Warning() << "Statistics: error with incorrect file size.";
@@ -197,26 +238,200 @@ public:
 	}
 };
 
-class Counter : public StreamIn<JSON::JSON> {
+class Counter : public StreamIn<JSON::JSON>, public JSON::KeySet {
 	MessageStatistics stat;
+	std::atomic<uint64_t> version{0};
 
 public:
 	void setCutOff(int c) { stat.setCutoff(c); }
-	void Clear() { stat.Clear(); }
+	void Clear() {
+		stat.Clear();
+		version++;
+	}
 
-	bool Load(std::ifstream& file) { return stat.Load(file); }
+	bool Load(std::ifstream& file) {
+		version++;
+		return stat.Load(file);
+	}
 	bool Save(std::ofstream& file) { return stat.Save(file); }
 
-	void Receive(const JSON::JSON* msg, int len, TAG& tag) { stat.Add(*((AIS::Message*)msg[0].binary), tag); }
+	void Receive(const JSON::JSON* msg, int len, TAG& tag) {
+		stat.Add(*((AIS::Message*)msg[0].binary), tag);
+		version++;
+	}
+	bool getKeys(std::vector<int>& keys) { return true; }
+
+	// changes whenever the statistics change
+	uint64_t getVersion() const { return version; }
 
 	std::string toJSON(bool empty = false) { return stat.toJSON(empty); }
 };
 
+// ----------------------------
+// Counters per contributing station (tag block station ID), for a server that aggregates many stations
+
+class StationStatistics : public StreamIn<JSON::JSON>, public JSON::KeySet {
+
+	// Open addressing table keyed by station ID, a slot is claimed with compare-exchange and never
+	// released, so Receive needs no lock. A full table counts the message as dropped. Unique vessels are
+	// estimated with linear counting on a bitmap of MMSI hashes, the rate is the count of the last full
+	// minute of rx time; a message racing with the turn of the minute can be counted in the other one.
+
+	static const int EMPTY = INT_MIN;
+	static const int VESSEL_BITS = 1024;
+
+	struct Station {
+		std::atomic<int> id{EMPTY};
+		std::atomic<uint32_t> count{0}, levels{0}, current{0}, previous{0};
+		std::atomic<float> level_sum{0};
+		std::atomic<int64_t> first{0}, last{0}, minute{0};
+		std::atomic<uint64_t> vessels[VESSEL_BITS / 64];
+	};
+
+	std::unique_ptr<Station[]> table;
+	int size = 0;
+	std::atomic<int> used{0};
+	std::atomic<uint64_t> dropped{0}, version{0};
+
+	static uint32_t hash(uint32_t x) { return x * 0x9E3779B1u; }
+
+	Station* find(int id) {
+		int mask = size - 1;
+
+		for (int i = 0, p = hash((uint32_t)id) >> 16 & mask; i < size; i++, p = (p + 1) & mask) {
+			Station& s = table[p];
+			int k = s.id.load(std::memory_order_acquire);
+
+			if (k == EMPTY) {
+				if (s.id.compare_exchange_strong(k, id, std::memory_order_acq_rel)) {
+					used.fetch_add(1, std::memory_order_relaxed);
+					return &s;
+				}
+			}
+			if (k == id) return &s;
+		}
+		return nullptr;
+	}
+
+	static int estimateVessels(const Station& s) {
+		int zeros = 0;
+		for (const auto& w : s.vessels)
+			for (uint64_t v = ~w.load(std::memory_order_relaxed); v; v &= v - 1) zeros++;
+
+		if (zeros == 0) zeros = 1;
+		return (int)std::lround(-VESSEL_BITS * std::log((double)zeros / VESSEL_BITS));
+	}
+
+public:
+	// number of slots, rounded up to a power of two, 0 switches the table off (call before Start)
+	void setSize(int n) {
+		size = 0;
+		while (size < n) size = size ? size * 2 : 1;
+		table.reset(size ? new Station[size] : nullptr);
+		used = 0;
+		Clear();
+	}
+
+	void Clear() {
+		for (int i = 0; i < size; i++) {
+			Station& s = table[i];
+			s.count = s.levels = s.current = s.previous = 0;
+			s.level_sum = 0;
+			s.first = s.last = s.minute = 0;
+			for (auto& w : s.vessels) w = 0;
+		}
+		dropped = 0;
+		version++;
+	}
+
+	void Receive(const JSON::JSON* data, int len, TAG& tag) {
+		if (!size) return;
+
+		const AIS::Message& m = *((AIS::Message*)data[0].binary);
+		Station* s = find(m.getStation());
+
+		if (!s) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		int64_t t = (int64_t)m.getRxTimeUnix();
+		int64_t minute = t / 60, cur = s->minute.load(std::memory_order_relaxed);
+
+		if (minute > cur && s->minute.compare_exchange_strong(cur, minute, std::memory_order_relaxed)) {
+			uint32_t n = s->current.exchange(0, std::memory_order_relaxed);
+			s->previous.store(minute == cur + 1 ? n : 0, std::memory_order_relaxed);
+		}
+
+		s->current.fetch_add(1, std::memory_order_relaxed);
+		s->count.fetch_add(1, std::memory_order_relaxed);
+
+		int64_t zero = 0;
+		s->first.compare_exchange_strong(zero, t, std::memory_order_relaxed);
+		s->last.store(t, std::memory_order_relaxed);
+
+		if (tag.level != LEVEL_UNDEFINED) {
+			float c = s->level_sum.load(std::memory_order_relaxed);
+			while (!s->level_sum.compare_exchange_weak(c, c + tag.level, std::memory_order_relaxed)) {}
+			s->levels.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		uint32_t b = (hash(m.mmsi()) >> 16) % VESSEL_BITS;
+		s->vessels[b / 64].fetch_or(1ULL << (b % 64), std::memory_order_relaxed);
+
+		version.fetch_add(1, std::memory_order_relaxed);
+	}
+	bool getKeys(std::vector<int>& keys) { return true; }
+
+	uint64_t getVersion() const { return version; }
+
+	// stations by message count, page of page_size entries
+	std::string toJSON(int page, int page_size) {
+		std::vector<std::pair<uint32_t, int>> order;
+
+		for (int i = 0; i < size; i++)
+			if (table[i].id.load(std::memory_order_acquire) != EMPTY)
+				order.push_back({table[i].count.load(std::memory_order_relaxed), i});
+
+		std::sort(order.begin(), order.end(), [](const std::pair<uint32_t, int>& a, const std::pair<uint32_t, int>& b) { return a.first > b.first; });
+
+		int64_t now = (int64_t)std::time(nullptr) / 60;
+		// in 64 bits, page and page_size come from the request
+		int64_t first = MAX((int64_t)0, (int64_t)page * page_size);
+		int start = (int)MIN((int64_t)order.size(), first), end = (int)MIN((int64_t)order.size(), (int64_t)start + page_size);
+
+		std::string element = "{\"total\":" + std::to_string(order.size()) + ",\"size\":" + std::to_string(size) +
+							  ",\"dropped\":" + std::to_string(dropped.load()) + ",\"page\":" + std::to_string(page) +
+							  ",\"page_size\":" + std::to_string(page_size) + ",\"stations\":[";
+
+		for (int i = start; i < end; i++) {
+			const Station& s = table[order[i].second];
+
+			int64_t minute = s.minute.load(std::memory_order_relaxed);
+			uint32_t last_minute = minute == now ? s.previous.load() : (minute == now - 1 ? s.current.load() : 0);
+			uint32_t levels = s.levels.load();
+
+			element += "{\"id\":" + std::to_string(s.id.load()) +
+					   ",\"count\":" + std::to_string(order[i].first) +
+					   ",\"rate\":" + Util::Convert::toString(last_minute / 60.0f) +
+					   ",\"vessels\":" + std::to_string(estimateVessels(s)) +
+					   ",\"level\":" + (levels ? Util::Convert::toString(s.level_sum.load() / levels) : std::string("null")) +
+					   ",\"first_seen\":" + std::to_string(s.first.load()) +
+					   ",\"last_seen\":" + std::to_string(s.last.load()) + "},";
+		}
+		if (start < end) element.pop_back();
+		element += "]}";
+		return element;
+	}
+};
+
 struct ByteCounter : public StreamIn<RAW> {
 	AIS::Filter filter;
 	virtual ~ByteCounter() {}
 	uint64_t received = 0;
-	void Receive(const RAW* data, int len, TAG& tag) { received += data[0].size; }
+	void Receive(const RAW* data, int len, TAG& tag) {
+		for (int i = 0; i < len; i++) received += data[i].size;
+	}
 	void Reset() { received = 0; }
 	void setFilterOption(std::string &arg, std::string &opt) { filter.SetOption(arg, opt); }
 };
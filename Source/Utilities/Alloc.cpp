@@ -0,0 +1,53 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "Alloc.h"
+
+namespace Util
+{
+	std::atomic<bool> AllocCount::on{false};
+	std::atomic<uint64_t> AllocCount::count{0};
+}
+
+// replacements of the global operator new and delete, the array and nothrow forms call these
+void *operator new(std::size_t size)
+{
+	Util::AllocCount::add();
+
+	if (size == 0)
+		size = 1;
+
+	while (true)
+	{
+		void *p = std::malloc(size);
+		if (p)
+			return p;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
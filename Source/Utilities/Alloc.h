@@ -0,0 +1,46 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Counts the allocations through the global operator new for the benchmark (-b), to report the
+// allocations per message. The counting is off by default and then costs a relaxed load per
+// allocation. Allocations by C libraries (malloc) are not seen.
+
+namespace Util
+{
+	class AllocCount
+	{
+		static std::atomic<bool> on;
+		static std::atomic<uint64_t> count;
+
+	public:
+		static void start() { on.store(true, std::memory_order_relaxed); }
+		static void stop() { on.store(false, std::memory_order_relaxed); }
+
+		static uint64_t get() { return count.load(std::memory_order_relaxed); }
+
+		static void add()
+		{
+			if (on.load(std::memory_order_relaxed))
+				count.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+}
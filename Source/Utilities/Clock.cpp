@@ -0,0 +1,106 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+
+#include "Clock.h"
+#include "Wakeups.h"
+
+namespace Util
+{
+	std::atomic<std::time_t> Clock::seconds(0);
+	std::atomic<bool> Clock::running(false);
+
+	std::thread Clock::ticker;
+	std::mutex Clock::mtx;
+	std::condition_variable Clock::cv;
+	bool Clock::terminate = false;
+
+	void Clock::start()
+	{
+		if (ticker.joinable())
+			return;
+
+		seconds.store(std::time(nullptr));
+		terminate = false;
+		ticker = std::thread(run);
+		running.store(true);
+	}
+
+	void Clock::stop()
+	{
+		if (!ticker.joinable())
+			return;
+
+		running.store(false);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			terminate = true;
+		}
+		cv.notify_all();
+		ticker.join();
+	}
+
+	void Clock::run()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			// one wake-up per second, just after the second changed. The deadline is taken from the
+			// wall clock but waited for as a duration on the steady clock, a step back of the wall
+			// clock would otherwise stall the ticker until the old deadline
+			auto now = std::chrono::system_clock::now();
+			auto next = std::chrono::time_point_cast<std::chrono::seconds>(now) + std::chrono::seconds(1) + std::chrono::milliseconds(TICK_MS);
+
+			if (cv.wait_for(lock, next - now, []
+							{ return terminate; }))
+				break;
+
+			Wakeups::add(Wakeups::CLOCK);
+			seconds.store(std::time(nullptr), std::memory_order_relaxed);
+		}
+	}
+
+	int64_t Clock::micros()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	int64_t SampleClock::getMicros(long idx, long current)
+	{
+		int64_t t = anchor_us + (int64_t)(idx - anchor_idx) * 1000000 / rate;
+
+		// checked against the coarse clock, which is up to a second behind because of the truncation
+		int64_t drift = t - (int64_t)Clock::now() * 1000000;
+
+		if (!anchored || drift < -max_drift || drift > max_drift + 1000000)
+		{
+			anchor(current);
+			return anchor_us + (int64_t)(idx - anchor_idx) * 1000000 / rate;
+		}
+
+		return t;
+	}
+
+	void SampleClock::anchor(long current)
+	{
+		anchored = true;
+		anchor_idx = current;
+		anchor_us = Clock::micros();
+	}
+}
@@ -0,0 +1,92 @@
+/*
+	Copyright(c) 2021-2026 jvde.github@gmail.com
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Process wide coarse wall clock. Once started a ticker thread refreshes the time just after every
+// change of the second so that per message timestamps are an atomic load instead of a clock call.
+// Before start (or after stop) the calls fall back to the system clock.
+
+namespace Util
+{
+	class Clock
+	{
+		// ms after the second changed that the ticker wakes up
+		static const int TICK_MS = 2;
+
+		static std::atomic<std::time_t> seconds;
+		static std::atomic<bool> running;
+
+		static std::thread ticker;
+		static std::mutex mtx;
+		static std::condition_variable cv;
+		static bool terminate;
+
+		static void run();
+
+	public:
+		static void start();
+		static void stop();
+
+		// seconds since the epoch, at most TICK_MS (and the scheduling delay of the ticker) behind
+		static std::time_t now()
+		{
+			return running.load(std::memory_order_relaxed) ? seconds.load(std::memory_order_relaxed) : std::time(nullptr);
+		}
+
+		// microseconds since the epoch from the system clock, for sample clock anchors
+		static int64_t micros();
+
+		// microseconds of the steady clock, for the latency stamps in TAG
+		static int64_t steady()
+		{
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	};
+
+	// Maps a sample counter to wall clock time in microseconds. The anchor ties the sample being
+	// processed to the system clock and is only moved when the sample clock drifts more than
+	// max_drift away, e.g. after dropped samples or when a file is read faster than real-time,
+	// so consecutive timestamps keep the precision of the sample clock.
+	class SampleClock
+	{
+		int rate = 48000;
+		int64_t max_drift = 1000000;
+
+		bool anchored = false;
+		long anchor_idx = 0;
+		int64_t anchor_us = 0;
+
+	public:
+		void setRate(int r) { rate = r; }
+		void reset() { anchored = false; }
+
+		bool isAnchored() const { return anchored; }
+		void anchor(long current);
+
+		// time of sample idx while sample current is being processed
+		int64_t getMicros(long idx, long current);
+	};
+}
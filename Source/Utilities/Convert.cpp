@@ -18,6 +18,9 @@
 #include <iomanip>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 
 #include "Convert.h"
 
@@ -39,6 +42,149 @@ namespace Util
 		return std::string(str);
 	}
 
+	void Convert::appendInt(std::string &s, long long i)
+	{
+		char buffer[24];
+		char *p = buffer + sizeof(buffer);
+		unsigned long long u = i < 0 ? 0ULL - (unsigned long long)i : (unsigned long long)i;
+
+		do
+		{
+			*--p = '0' + (u % 10);
+			u /= 10;
+		} while (u);
+
+		if (i < 0)
+			*--p = '-';
+		s.append(p, buffer + sizeof(buffer) - p);
+	}
+
+	void Convert::appendUInt(std::string &s, unsigned long long u)
+	{
+		char buffer[24];
+		char *p = buffer + sizeof(buffer);
+
+		do
+		{
+			*--p = '0' + (u % 10);
+			u /= 10;
+		} while (u);
+
+		s.append(p, buffer + sizeof(buffer) - p);
+	}
+
+	static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+	// the digits of n with the last 'decimals' of them after the point, true if the scaled value a
+	// rounds to n for certain: a not too large and not within 1/1024 of a tie
+	static bool scaledDigits(double a, int decimals, bool negative, char *&p, long long &n)
+	{
+		const double LIMIT = (double)(1LL << 40);
+
+		if (!(a < LIMIT))
+			return false;
+
+		double r = std::nearbyint(a);
+		if (std::fabs(std::fabs(a - r) - 0.5) <= 1.0 / 1024)
+			return false;
+
+		n = (long long)r;
+		long long m = n;
+
+		for (int d = 0; d < decimals; d++, m /= 10)
+			*--p = '0' + (m % 10);
+		if (decimals)
+			*--p = '.';
+		do
+		{
+			*--p = '0' + (m % 10);
+			m /= 10;
+		} while (m);
+
+		if (negative)
+			*--p = '-';
+		return true;
+	}
+
+	// printf follows the locale of the C library, the output paths always use a point
+	static void appendPrintf(std::string &s, const char *format, int decimals, double f)
+	{
+		char buffer[512];
+		int len = std::snprintf(buffer, sizeof(buffer), format, decimals, f);
+		if (len <= 0)
+			return;
+
+		len = MIN(len, (int)sizeof(buffer) - 1);
+		for (int i = 0; i < len; i++)
+			if (buffer[i] == ',')
+				buffer[i] = '.';
+		s.append(buffer, len);
+	}
+
+	static bool isFinite(double f, bool &negative)
+	{
+		// sign and exponent from the bits, isfinite and signbit do not survive -ffast-math
+		uint64_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		negative = bits >> 63;
+		return ((bits >> 52) & 0x7FF) != 0x7FF;
+	}
+
+	void Convert::appendFixed(std::string &s, double f, int decimals)
+	{
+		bool negative;
+
+		if (decimals >= 0 && decimals <= 9 && isFinite(f, negative))
+		{
+			char buffer[32];
+			char *p = buffer + sizeof(buffer);
+			long long n;
+
+			if (scaledDigits(std::fabs(f) * POW10[decimals], decimals, negative, p, n))
+			{
+				s.append(p, buffer + sizeof(buffer) - p);
+				return;
+			}
+		}
+
+		appendPrintf(s, "%.*f", decimals, f);
+	}
+
+	void Convert::appendGeneral(std::string &s, double f)
+	{
+		bool negative;
+		double a = std::fabs(f);
+
+		// without exponent: 6 significant digits with the trailing zeros of the fraction removed
+		if (isFinite(f, negative) && a >= 1e-4 && a < 1e6)
+		{
+			int e = 5;
+			while (e > -4 && a < POW10[e + 4] * 1e-4)
+				e--;
+
+			const int decimals = 5 - e;
+			char buffer[32];
+			char *end = buffer + sizeof(buffer);
+			char *p = end;
+			long long n;
+
+			if (scaledDigits(a * POW10[decimals], decimals, negative, p, n) && n < 1000000)
+			{
+				if (decimals)
+				{
+					while (end[-1] == '0')
+						end--;
+					if (end[-1] == '.')
+						end--;
+				}
+				s.append(p, end - p);
+				return;
+			}
+		}
+
+		appendPrintf(s, "%.*g", 6, f);
+	}
+
 	std::string Convert::toHexString(uint64_t l)
 	{
 		std::stringstream s;
@@ -100,6 +246,8 @@ namespace Util
 			return "BEAST";
 		case PROTOCOL::RAW1090:
 			return "RAW1090";
+		case PROTOCOL::IQLINK:
+			return "IQLINK";
 		case PROTOCOL::TLS:
 			return "TLS";
 		case PROTOCOL::TCP:
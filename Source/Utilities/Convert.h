@@ -35,7 +35,8 @@ namespace Util
 		static std::string toString(bool b, FLOAT32 v) { return b ? std::string("AUTO") : std::to_string(v); }
 		static std::string toString(FLOAT32 f)
 		{
-			std::string s = std::to_string(f);
+			std::string s;
+			appendFixed(s, f);
 			if (s == "nan" || s == "-nan")
 				return "null";
 			return s;
@@ -53,6 +54,14 @@ namespace Util
 				   std::to_string(ipv4 & 0xFF);
 		}
 
+		// locale independent number formatting for the output paths, appended to s
+		static void appendInt(std::string &s, long long i);
+		static void appendUInt(std::string &s, unsigned long long u);
+		// as printf "%.<decimals>f" (std::to_string for decimals 6)
+		static void appendFixed(std::string &s, double f, int decimals = 6);
+		// as printf "%g", the default of an ostream
+		static void appendGeneral(std::string &s, double f);
+
 		static void toUpper(std::string &s);
 		static void toLower(std::string &s);
 		static void toFloat(CU8 *in, CFLOAT32 *out, int len);
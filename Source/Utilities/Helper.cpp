@@ -93,7 +93,7 @@ namespace Util
 
 	long Helper::getMemoryConsumption()
 	{
-		int memory = 0;
+		long memory = 0;
 #ifdef _WIN32
 		HANDLE hProcess = GetCurrentProcess();
 		PROCESS_MEMORY_COUNTERS_EX pmc;
@@ -286,6 +286,10 @@ namespace Util
 		{
 			protocol = PROTOCOL::RAW1090;
 		}
+		else if (arg == "IQLINK")
+		{
+			protocol = PROTOCOL::IQLINK;
+		}
 		else if (arg == "TLS")
 		{
 			protocol = PROTOCOL::TLS;
@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 
 #include "Stream.h"
 
@@ -40,5 +41,168 @@ namespace Util
 		static void LatLon(FLOAT32 lat, FLOAT32 lon, std::vector<char> &v);
 		static void Float(FLOAT32 f, std::vector<char> &v);
 		static void FloatLow(FLOAT32 f, std::vector<char> &v);
+
+		// Stores the same big-endian fields at a cursor into space claimed up front, for records of which
+		// the size is known: reserve(n) makes room for n more bytes, the stores after it must fit in them.
+		// The vector is trimmed to what was written when the writer goes out of scope.
+		class Writer
+		{
+			std::vector<char> &v;
+			std::size_t pos;
+
+			void put16(uint16_t i)
+			{
+				v[pos] = (char)(i >> 8);
+				v[pos + 1] = (char)i;
+				pos += 2;
+			}
+
+			void put32(uint32_t i)
+			{
+				v[pos] = (char)(i >> 24);
+				v[pos + 1] = (char)(i >> 16);
+				v[pos + 2] = (char)(i >> 8);
+				v[pos + 3] = (char)i;
+				pos += 4;
+			}
+
+		public:
+			Writer(std::vector<char> &out) : v(out), pos(out.size()) {}
+			~Writer() { v.resize(pos); }
+
+			void reserve(std::size_t n)
+			{
+				if (pos + n > v.size())
+					v.resize(pos + n);
+			}
+
+			void Uint8(uint8_t i) { v[pos++] = (char)i; }
+			void Uint16(uint16_t i) { put16(i); }
+			void Uint32(uint32_t i) { put32(i); }
+			void Uint64(uint64_t i)
+			{
+				put32((uint32_t)(i >> 32));
+				put32((uint32_t)i);
+			}
+			void Int8(int8_t i) { v[pos++] = (char)i; }
+			void Int16(int16_t i) { put16((uint16_t)i); }
+			void Int32(int32_t i) { put32((uint32_t)i); }
+			void Int64(int64_t i) { Uint64((uint64_t)i); }
+
+			// at most 255 characters
+			void String(const char *s, std::size_t len)
+			{
+				v[pos++] = (char)len;
+				std::memcpy(&v[pos], s, len);
+				pos += len;
+			}
+
+			void Float(FLOAT32 f) { Int16(f * 1000.0f); }
+			void FloatLow(FLOAT32 f) { Int16(f * 10.0f); }
+			// the bits of the float, no loss of precision
+			void Float32(float f)
+			{
+				uint32_t i;
+				std::memcpy(&i, &f, sizeof(i));
+				put32(i);
+			}
+
+			void LatLon(FLOAT32 lat, FLOAT32 lon)
+			{
+				if (!(lat == 0 && lon == 0) && lat != 91 && lon != 181)
+				{
+					Int32(lat * 6000000);
+					Int32(lon * 6000000);
+				}
+				else
+				{
+					Int32(91 * 6000000);
+					Int32(181 * 6000000);
+				}
+			}
+		};
+
+		// Reads the fields of a Writer back in the same order. Reading past the end gives zeros and
+		// clears ok(), so a record can be read in full and checked once.
+		class Reader
+		{
+			const char *data;
+			std::size_t length, pos = 0;
+			bool valid = true;
+
+			bool need(std::size_t n)
+			{
+				if (!valid || pos + n > length)
+				{
+					valid = false;
+					return false;
+				}
+				return true;
+			}
+
+			uint16_t get16()
+			{
+				if (!need(2))
+					return 0;
+
+				const uint8_t *p = (const uint8_t *)data + pos;
+				pos += 2;
+				return (uint16_t)((p[0] << 8) | p[1]);
+			}
+
+			uint32_t get32()
+			{
+				if (!need(4))
+					return 0;
+
+				const uint8_t *p = (const uint8_t *)data + pos;
+				pos += 4;
+				return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+			}
+
+		public:
+			Reader(const char *d, std::size_t len) : data(d), length(len) {}
+
+			bool ok() const { return valid; }
+			std::size_t position() const { return pos; }
+
+			uint8_t Uint8() { return need(1) ? (uint8_t)data[pos++] : 0; }
+			uint16_t Uint16() { return get16(); }
+			uint32_t Uint32() { return get32(); }
+			uint64_t Uint64()
+			{
+				uint64_t h = get32();
+				return (h << 32) | get32();
+			}
+			int8_t Int8() { return (int8_t)Uint8(); }
+			int16_t Int16() { return (int16_t)get16(); }
+			int32_t Int32() { return (int32_t)get32(); }
+			int64_t Int64() { return (int64_t)Uint64(); }
+
+			float Float32()
+			{
+				uint32_t i = get32();
+				float f;
+				std::memcpy(&f, &i, sizeof(f));
+				return f;
+			}
+
+			// into a buffer of size bytes, always terminated, longer strings are invalid
+			void String(char *s, std::size_t size)
+			{
+				std::size_t len = Uint8();
+
+				if (len >= size || !need(len))
+				{
+					valid = false;
+					s[0] = 0;
+					return;
+				}
+
+				std::memcpy(s, data + pos, len);
+				s[len] = 0;
+				pos += len;
+			}
+		};
 	};
 }
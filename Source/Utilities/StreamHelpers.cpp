@@ -15,13 +15,463 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <sstream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
 #include "StreamHelpers.h"
 #include "Logger.h"
 #include "Convert.h"
 #include "Parse.h"
+#include "Clock.h"
 
 namespace Util
 {
+	int bytesPerSample(Format f)
+	{
+		switch (f)
+		{
+		case Format::CU8:
+		case Format::CS8:
+			return 2;
+		case Format::CS16:
+			return 4;
+		case Format::CF32:
+			return 8;
+		default:
+			return 1;
+		}
+	}
+
+	int countSamples(const RAW *r, int len)
+	{
+		int n = 0;
+
+		for (int i = 0; i < len; i++)
+			n += r[i].size / bytesPerSample(r[i].format);
+
+		return n;
+	}
+
+	void ProbeStats::attach(const std::string &n)
+	{
+		// the name ends up as a Prometheus label value
+		name = n;
+		for (char &c : name)
+			if (c == '"' || c == '\\')
+				c = '\'';
+
+		if (!attached)
+			Perf::get().add(this);
+		attached = true;
+	}
+
+	void ProbeStats::detach()
+	{
+		if (attached)
+			Perf::get().remove(this);
+		attached = false;
+	}
+
+	void LatencyStats::record(const TAG &tag)
+	{
+		if (!tag.capture_us || !tag.decode_us)
+			return;
+
+		int64_t now = Clock::steady();
+		int64_t from = tag.decode_us;
+
+		decode.add((uint64_t)std::max((int64_t)0, tag.decode_us - tag.capture_us));
+
+		if (json && tag.json_us)
+		{
+			build.add((uint64_t)std::max((int64_t)0, tag.json_us - tag.decode_us));
+			from = tag.json_us;
+		}
+
+		send.add((uint64_t)std::max((int64_t)0, now - from));
+		total.add((uint64_t)std::max((int64_t)0, now - tag.capture_us));
+	}
+
+	void LatencyStats::attach(const std::string &n, bool has_json)
+	{
+		name = n;
+		for (char &c : name)
+			if (c == '"' || c == '\\')
+				c = '\'';
+
+		json = has_json;
+
+		if (!attached)
+			Perf::get().add(this);
+		attached = true;
+	}
+
+	void LatencyStats::detach()
+	{
+		if (attached)
+			Perf::get().remove(this);
+		attached = false;
+	}
+
+	Perf &Perf::get()
+	{
+		static Perf perf;
+		return perf;
+	}
+
+	void Perf::add(ProbeStats *p)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		// stages of several receivers can share a name
+		int same = 0;
+		for (auto q : probes)
+			if (q->name == p->name || q->name.compare(0, p->name.size() + 2, p->name + " #") == 0)
+				same++;
+
+		if (same)
+			p->name += " #" + std::to_string(same + 1);
+
+		probes.push_back(p);
+	}
+
+	void Perf::remove(ProbeStats *p)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		probes.erase(std::remove(probes.begin(), probes.end(), p), probes.end());
+	}
+
+	void Perf::add(LatencyStats *l)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		latencies.push_back(l);
+	}
+
+	void Perf::remove(LatencyStats *l)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		latencies.erase(std::remove(latencies.begin(), latencies.end(), l), latencies.end());
+	}
+
+	std::vector<Perf::Latency> Perf::getLatencies()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		std::vector<Latency> result;
+
+		for (auto l : latencies)
+			result.push_back({l->name, l->total.getCount(), l->decode.percentile(99), l->build.percentile(99), l->send.percentile(99),
+							  l->total.percentile(50), l->total.percentile(99), l->total.getMax()});
+
+		return result;
+	}
+
+	std::vector<Perf::Stage> Perf::getStages()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		std::vector<Stage> stages;
+
+		for (auto p : probes)
+			stages.push_back({p->getName(), p->getCalls(), p->getSamples(), p->getTotalNs(), p->getP99Ns()});
+
+		return stages;
+	}
+
+	std::string Perf::getPrometheus()
+	{
+		std::vector<Stage> stages = getStages();
+		std::string latency = getLatencyHistograms();
+
+		if (!latency.empty())
+			latency = "# HELP ais_output_latency_microseconds Latency of the messages of an output per step, from the capture of the samples to the send\n"
+					  "# TYPE ais_output_latency_microseconds histogram\n" + latency;
+
+		if (stages.empty())
+			return latency;
+
+		std::string calls, samples, total, p99;
+
+		for (auto &s : stages)
+		{
+			std::string label = "{stage=\"" + s.name + "\"} ";
+			calls += "ais_perf_calls" + label + std::to_string(s.calls) + "\n";
+			samples += "ais_perf_samples" + label + std::to_string(s.samples) + "\n";
+			total += "ais_perf_nanoseconds" + label + std::to_string(s.total_ns) + "\n";
+			p99 += "ais_perf_p99_nanoseconds" + label + std::to_string(s.p99_ns) + "\n";
+		}
+
+		return "# HELP ais_perf_calls Blocks passed through the stage\n# TYPE ais_perf_calls counter\n" + calls +
+			   "# HELP ais_perf_samples Samples or messages passed through the stage\n# TYPE ais_perf_samples counter\n" + samples +
+			   "# HELP ais_perf_nanoseconds Time spent in the stage and everything downstream of it\n# TYPE ais_perf_nanoseconds counter\n" + total +
+			   "# HELP ais_perf_p99_nanoseconds 99th percentile of the time per block\n# TYPE ais_perf_p99_nanoseconds gauge\n" + p99 +
+			   "# HELP ais_perf_block_nanoseconds Time per block in the stage, from 2 us to 1 s\n# TYPE ais_perf_block_nanoseconds histogram\n" + getHistograms() + latency;
+	}
+
+	std::string Perf::getHistograms()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		std::string str;
+
+		for (auto p : probes)
+			str += p->histogram.toPrometheus("ais_perf_block_nanoseconds", "stage=\"" + p->getName() + "\"", 10, 30);
+
+		return str;
+	}
+
+	// buckets from 64 us to 16 s
+	std::string Perf::getLatencyHistograms()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		std::string str;
+
+		for (auto l : latencies)
+		{
+			std::string output = "output=\"" + l->name + "\",stage=";
+
+			str += l->decode.toPrometheus("ais_output_latency_microseconds", output + "\"decode\"", 5, 24);
+			if (l->json)
+				str += l->build.toPrometheus("ais_output_latency_microseconds", output + "\"json\"", 5, 24);
+			str += l->send.toPrometheus("ais_output_latency_microseconds", output + "\"send\"", 5, 24);
+			str += l->total.toPrometheus("ais_output_latency_microseconds", output + "\"total\"", 5, 24);
+		}
+
+		return str;
+	}
+
+	bool ThreadPolicy::setAffinity(const std::vector<int> &cores)
+	{
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int c : cores)
+			CPU_SET(c, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+		DWORD_PTR mask = 0;
+		for (int c : cores)
+			mask |= (DWORD_PTR)1 << (c % 64);
+		return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool ThreadPolicy::setPriority(int priority)
+	{
+#if defined(__linux__)
+		sched_param param = {};
+		param.sched_priority = priority;
+		return pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param) == 0;
+#elif defined(_WIN32)
+		int level = priority >= 50 ? THREAD_PRIORITY_TIME_CRITICAL : priority > 0 ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_NORMAL;
+		return SetThreadPriority(GetCurrentThread(), level) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool ThreadPolicy::setBackground()
+	{
+#if defined(__linux__) && defined(SCHED_IDLE)
+		sched_param param = {};
+		return pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0;
+#elif defined(_WIN32)
+		return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool ThreadPolicy::Set(const std::string &option, const std::string &arg)
+	{
+		if (option == "AFFINITY")
+		{
+			cores.clear();
+
+			std::string a = arg;
+			Util::Convert::toUpper(a);
+			if (a == "OFF" || a == "NONE")
+				return true;
+
+			std::stringstream ss(arg);
+			std::string c;
+			while (std::getline(ss, c, ','))
+				cores.push_back(Util::Parse::Integer(c, 0, 1023, option));
+		}
+		else if (option == "PRIORITY")
+		{
+			priority = Util::Parse::Integer(arg, 0, 99, option);
+		}
+		else
+			return false;
+
+		return true;
+	}
+
+	void ThreadPolicy::apply(const std::string &name)
+	{
+		if (isDefault())
+			return;
+
+		bool ok = true;
+
+		if (!cores.empty() && !setAffinity(cores))
+		{
+			Warning() << name << " thread: cannot pin thread to the requested cores";
+			ok = false;
+		}
+		if (priority > 0 && !setPriority(priority))
+		{
+			Warning() << name << " thread: cannot set real-time priority " << priority << " (needs elevated rights)";
+			ok = false;
+		}
+
+		failed = !ok;
+		if (ok)
+			Info() << name << " thread:" << Get();
+	}
+
+	std::string ThreadPolicy::Get(const std::string &prefix)
+	{
+		std::string str;
+
+		if (!cores.empty())
+		{
+			str += " " + prefix + "affinity ";
+			for (int i = 0; i < (int)cores.size(); i++)
+				str += (i ? "," : "") + std::to_string(cores[i]);
+		}
+		if (priority > 0)
+			str += " " + prefix + "priority " + std::to_string(priority);
+		if (failed)
+			str += " (failed)";
+
+		return str;
+	}
+
+	Executor &Executor::get()
+	{
+		static Executor pool;
+		return pool;
+	}
+
+	int Executor::getWorkers()
+	{
+		return nworkers > 0 ? nworkers : MAX((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	void Executor::join()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (workers.empty())
+		{
+			int n = getWorkers();
+			for (int i = 0; i < n; i++)
+				workers.push_back(std::thread(&Executor::work, this, i));
+		}
+		users++;
+	}
+
+	void Executor::leave(Task *t)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+
+		cv_idle.wait(lock, [&]
+					 { return t->state == Task::State::IDLE; });
+
+		if (--users > 0)
+			return;
+
+		stopping = true;
+		cv_work.notify_all();
+
+		std::vector<std::thread> done;
+		done.swap(workers);
+		lock.unlock();
+
+		for (auto &w : done)
+			w.join();
+
+		lock.lock();
+		stopping = false;
+	}
+
+	void Executor::post(Task *t)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		switch (t->state)
+		{
+		case Task::State::IDLE:
+			t->state = Task::State::QUEUED;
+			ready.push_back(t);
+			cv_work.notify_one();
+			break;
+		case Task::State::RUNNING:
+			t->state = Task::State::AGAIN;
+			break;
+		default:
+			break;
+		}
+	}
+
+	static thread_local bool executor_worker = false;
+
+	bool Executor::onWorker()
+	{
+		return executor_worker;
+	}
+
+	void Executor::work(int id)
+	{
+		executor_worker = true;
+
+		if (affinity)
+		{
+			int core = id % MAX((int)std::thread::hardware_concurrency(), 1);
+			if (!ThreadPolicy::setAffinity({core}))
+				Warning() << "Executor: cannot pin worker " << id << " to core " << core;
+		}
+
+		std::unique_lock<std::mutex> lock(mtx);
+
+		while (true)
+		{
+			cv_work.wait(lock, [this]
+						 { return !ready.empty() || stopping; });
+
+			if (ready.empty())
+				break;
+
+			Task *t = ready.front();
+			ready.pop_front();
+			t->state = Task::State::RUNNING;
+			lock.unlock();
+
+			bool more = t->run();
+
+			lock.lock();
+			if (more || t->state == Task::State::AGAIN)
+			{
+				t->state = Task::State::QUEUED;
+				ready.push_back(t);
+				cv_work.notify_one();
+			}
+			else
+			{
+				t->state = Task::State::IDLE;
+				cv_idle.notify_all();
+			}
+		}
+	}
+
 	void RealPart::Receive(const CFLOAT32 *data, int len, TAG &tag)
 	{
 		if (output.size() < len)
@@ -65,6 +515,12 @@ namespace Util
 			return;
 		}
 
+		if (raw->format == Format::CS16 && outCS16.isConnected())
+		{
+			outCS16.Send((CS16 *)raw->data, raw->size / sizeof(CS16), tag);
+			return;
+		}
+
 		if (raw->format == Format::CF32 && out.isConnected())
 		{
 			out.Send((CFLOAT32 *)raw->data, raw->size / sizeof(CFLOAT32), tag);
@@ -179,6 +635,18 @@ namespace Util
 
 	WriteWAV::~WriteWAV()
 	{
+		if (writer.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				terminate = true;
+			}
+			cv.notify_one();
+			writer.join();
+		}
+
+		MemoryBudget::account(MemoryBudget::QUEUES, memory_reported, 0);
+
 		if (file.is_open())
 		{
 			// Get current position
@@ -197,36 +665,169 @@ namespace Util
 
 			file.close();
 		}
+
+		if (dropped)
+			Warning() << "WAV out: " << (dropped >> 20) << " MB of samples dropped for \"" << filename << "\", storage too slow.";
+		if (trigger)
+			Info() << "WAV out: " << bursts << " bursts, " << (written >> 10) << " KB written to \"" << filename << "\".";
 	}
 
-	void WriteWAV::Receive(const RAW *raw, int len, TAG &tag)
+	void WriteWAV::start(const RAW &raw)
 	{
-		if (stopping)
-			return;
+		format = raw.format;
 
-		format = raw->format;
+		int bytes = format == Format::CF32 ? 4 : format == Format::CS16 ? 2 : 1;
 
-		if (!file.is_open())
+		pre_bytes = (long)sample_rate * pre_ms / 1000 * 2 * bytes;
+		post_bytes = (long)sample_rate * post_ms / 1000 * 2 * bytes;
+
+		ring.resize(buffer_size);
+		if (trigger)
+			history.resize(pre_bytes);
+
+		MemoryBudget::account(MemoryBudget::QUEUES, memory_reported, ring.size() + history.size());
+
+		writer = std::thread(&WriteWAV::loop, this);
+	}
+
+	// producer side, a block that does not fit is dropped as a whole
+	void WriteWAV::push(const char *data, std::size_t len)
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+
+		if (h + len - tail.load(std::memory_order_acquire) > ring.size())
 		{
-			Open(filename, sample_rate);
+			dropped += len;
+			return;
 		}
 
-		if (!file.is_open() || stopping)
+		std::size_t pos = h % ring.size();
+		std::size_t n = MIN(len, ring.size() - pos);
+
+		std::memcpy(ring.data() + pos, data, n);
+		std::memcpy(ring.data(), data + n, len - n);
+
+		head.store(h + len, std::memory_order_release);
+		cv.notify_one();
+	}
+
+	// the last pre_bytes before a trigger
+	void WriteWAV::keep(const char *data, std::size_t len)
+	{
+		if (history.empty())
 			return;
 
-		// Write the data directly
-		try
+		if (len > history.size())
 		{
-			file.write(reinterpret_cast<const char *>(raw->data), raw->size);
+			data += len - history.size();
+			len = history.size();
 		}
-		catch (const std::exception &e)
+
+		std::size_t n = MIN(len, history.size() - history_pos);
+		std::memcpy(history.data() + history_pos, data, n);
+		std::memcpy(history.data(), data + n, len - n);
+
+		history_pos = (history_pos + len) % history.size();
+		history_len = MIN(history_len + len, history.size());
+	}
+
+	void WriteWAV::loop()
+	{
+		Open(filename, sample_rate);
+
+		while (!stopping)
 		{
-			Error() << "WAV out: " << e.what() << std::endl;
-			stopping = true;
-			StopRequest();
+			bool done;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				// the producer notifies without the lock, a missed notification costs at most the timeout
+				cv.wait_for(lock, std::chrono::milliseconds(100), [this]
+							{ return terminate || head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed); });
+				done = terminate;
+			}
+
+			uint64_t h = head.load(std::memory_order_acquire);
+			uint64_t t = tail.load(std::memory_order_relaxed);
+
+			while (t < h)
+			{
+				std::size_t pos = t % ring.size();
+				std::size_t n = (std::size_t)MIN(h - t, (uint64_t)(ring.size() - pos));
+
+				file.write(ring.data() + pos, n);
+				if (!file)
+				{
+					Error() << "WAV out: cannot write to \"" << filename << "\"." << std::endl;
+					stopping = true;
+					StopRequest();
+					return;
+				}
+
+				t += n;
+				written += n;
+				tail.store(t, std::memory_order_release);
+			}
+
+			if (done)
+				break;
 		}
 	}
 
+	void WriteWAV::Receive(const RAW *raw, int len, TAG &tag)
+	{
+		if (stopping)
+			return;
+
+		if (!writer.joinable())
+			start(*raw);
+
+		for (int i = 0; i < len; i++)
+		{
+			const char *data = (const char *)raw[i].data;
+			std::size_t size = raw[i].size;
+
+			if (!trigger)
+			{
+				push(data, size);
+				continue;
+			}
+
+			// the decoders run after this block, a trigger seen here is for a burst in the history
+			if (triggered.exchange(false, std::memory_order_relaxed))
+			{
+				if (post_left == 0)
+				{
+					if (history_len)
+					{
+						std::size_t start = (history_pos + history.size() - history_len) % history.size();
+						std::size_t n = MIN(history_len, history.size() - start);
+
+						push(history.data() + start, n);
+						push(history.data(), history_len - n);
+						history_len = 0;
+					}
+					bursts++;
+				}
+				post_left = post_bytes;
+			}
+
+			if (post_left > 0)
+			{
+				push(data, size);
+				post_left = MAX(0L, post_left - (long)size);
+			}
+			else
+				keep(data, size);
+		}
+	}
+
+	void WriteWAV::Signal(const DecoderSignals &in)
+	{
+		// Reset goes to the other decoders when a message is found
+		if ((in == DecoderSignals::Reset && trigger) || (in == DecoderSignals::CRCError && trigger == 2))
+			triggered.store(true, std::memory_order_relaxed);
+	}
+
 	bool WriteWAV::setValue(std::string option, std::string arg)
 	{
 		Util::Convert::toUpper(option);
@@ -241,6 +842,32 @@ namespace Util
 			sample_rate = Util::Parse::Integer(arg, 0, 1000000000, "RATE");
 			return true;
 		}
+		else if (option == "BUFFER")
+		{
+			buffer_size = (std::size_t)Util::Parse::Integer(arg, 1, 1024, option) << 20;
+			return true;
+		}
+		else if (option == "TRIGGER")
+		{
+			Util::Convert::toUpper(arg);
+			if (arg == "MSG")
+				trigger = 1;
+			else if (arg == "CRC")
+				trigger = 2;
+			else
+				trigger = Util::Parse::Switch(arg) ? 1 : 0;
+			return true;
+		}
+		else if (option == "PRE")
+		{
+			pre_ms = Util::Parse::Integer(arg, 0, 5000, option);
+			return true;
+		}
+		else if (option == "POST")
+		{
+			post_ms = Util::Parse::Integer(arg, 0, 5000, option);
+			return true;
+		}
 		return false;
 	}
 }
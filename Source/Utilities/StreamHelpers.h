@@ -21,9 +21,19 @@
 #include <fstream>
 #include <string>
 #include <cassert>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <functional>
 
 #include "Common.h"
 #include "Stream.h"
+#include "Signals.h"
+#include "Histogram.h"
+#include "Aligned.h"
+#include "MemoryBudget.h"
 
 namespace Util
 {
@@ -59,6 +69,7 @@ namespace Util
 	{
 		high_resolution_clock::time_point time_start;
 		float timing = 0.0;
+		long count = 0;
 
 		void tic()
 		{
@@ -74,18 +85,673 @@ namespace Util
 		virtual ~Timer() {}
 		virtual void Receive(const T *data, int len, TAG &tag)
 		{
+			count += len;
 			tic();
 			SimpleStreamInOut<T, T>::Send(data, len, tag);
 			toc();
 		}
 		virtual void Receive(T *data, int len, TAG &tag)
 		{
+			count += len;
 			tic();
 			SimpleStreamInOut<T, T>::Send(data, len, tag);
 			toc();
 		}
 
 		float getTotalTiming() { return timing; }
+		long getCount() { return count; }
+	};
+
+	// Counters of one stage for the profiler: calls, samples and the time spent downstream of the
+	// stage, with a histogram of the call durations in ns for the 99th percentile.
+	class ProbeStats
+	{
+		friend class Perf;
+
+		std::string name;
+		bool attached = false;
+
+		std::atomic<uint64_t> samples{0}, total_ns{0};
+		LogHistogram histogram;
+
+	protected:
+		void record(int len, uint64_t ns)
+		{
+			samples.fetch_add(len, std::memory_order_relaxed);
+			total_ns.fetch_add(ns, std::memory_order_relaxed);
+			histogram.add(ns);
+		}
+
+	public:
+		virtual ~ProbeStats() { detach(); }
+
+		// registers the stage with Perf, only attached stages are reported
+		void attach(const std::string &n);
+		void detach();
+
+		const std::string &getName() { return name; }
+		uint64_t getCalls() { return histogram.getCount(); }
+		uint64_t getSamples() { return samples; }
+		uint64_t getTotalNs() { return total_ns; }
+		uint64_t getP99Ns() { return histogram.percentile(99); }
+	};
+
+	// bytes per IQ sample of a RAW format, 1 for text and other formats
+	int bytesPerSample(Format f);
+
+	// samples in a block for the profiler, for RAW the IQ samples in the buffers
+	template <typename T>
+	inline int countSamples(const T *, int len) { return len; }
+	int countSamples(const RAW *r, int len);
+
+	// Pass-through that measures the time the downstream chain takes for each block
+	template <typename T>
+	class Probe : public SimpleStreamInOut<T, T>, public ProbeStats
+	{
+	public:
+		virtual ~Probe() {}
+
+		virtual void Receive(const T *data, int len, TAG &tag)
+		{
+			steady_clock::time_point t = steady_clock::now();
+			SimpleStreamInOut<T, T>::Send(data, len, tag);
+			record(countSamples(data, len), duration_cast<nanoseconds>(steady_clock::now() - t).count());
+		}
+		virtual void Receive(T *data, int len, TAG &tag)
+		{
+			steady_clock::time_point t = steady_clock::now();
+			SimpleStreamInOut<T, T>::Send(data, len, tag);
+			record(countSamples(data, len), duration_cast<nanoseconds>(steady_clock::now() - t).count());
+		}
+	};
+
+	// Latency of the messages that reach an output, from the stamps in TAG to the moment the output
+	// has handled the message: capture to decode, decode to JSON (JSON outputs only) and to the send.
+	class LatencyStats
+	{
+		friend class Perf;
+
+		std::string name;
+		bool attached = false;
+		bool json = false;
+
+		LogHistogram decode, build, send, total;
+
+	protected:
+		void record(const TAG &tag);
+
+	public:
+		virtual ~LatencyStats() { detach(); }
+
+		void attach(const std::string &n, bool has_json);
+		void detach();
+
+		const std::string &getName() { return name; }
+	};
+
+	// Pass-through that records the latency after the downstream chain has handled each message
+	template <typename T>
+	class Latency : public SimpleStreamInOut<T, T>, public LatencyStats
+	{
+	public:
+		virtual ~Latency() {}
+
+		virtual void Receive(const T *data, int len, TAG &tag)
+		{
+			SimpleStreamInOut<T, T>::Send(data, len, tag);
+			record(tag);
+		}
+		virtual void Receive(T *data, int len, TAG &tag)
+		{
+			SimpleStreamInOut<T, T>::Send(data, len, tag);
+			record(tag);
+		}
+	};
+
+	// Real-time load of everything downstream on the device thread: the time spent per block over the
+	// signal time of the block. Reported, and passed to the callback, once per interval of signal time.
+	class LoadMeter : public SimpleStreamInOut<RAW, RAW>
+	{
+		int rate = 0;
+		double interval = 1.0, busy = 0, signal = 0, total = 0;
+		std::atomic<float> load{0.0f};
+		std::function<void(float)> callback;
+
+		void measure(const RAW *data, int len, steady_clock::time_point t)
+		{
+			if (rate <= 0)
+				return;
+
+			busy += duration_cast<nanoseconds>(steady_clock::now() - t).count() * 1e-9;
+			double s = (double)countSamples(data, len) / rate;
+			signal += s;
+			total += s;
+
+			if (signal >= interval)
+			{
+				float l = (float)(busy / signal);
+				load = l;
+				busy = signal = 0;
+
+				if (callback)
+					callback(l);
+			}
+		}
+
+	public:
+		virtual ~LoadMeter() {}
+
+		void setRate(int r) { rate = r; }
+		void setCallback(std::function<void(float)> f) { callback = f; }
+
+		// 1.0 means the chain only just keeps up, 0 if not measured
+		float getLoad() { return load; }
+		// seconds of signal passed on since the start, read after the device has stopped
+		double getSignal() { return total; }
+
+		virtual void Receive(const RAW *data, int len, TAG &tag)
+		{
+			steady_clock::time_point t = steady_clock::now();
+			Send(data, len, tag);
+			measure(data, len, t);
+		}
+		virtual void Receive(RAW *data, int len, TAG &tag)
+		{
+			steady_clock::time_point t = steady_clock::now();
+			Send(data, len, tag);
+			measure(data, len, t);
+		}
+	};
+
+	// Pass-through that can be closed from another thread, to switch off an optional branch
+	template <typename T>
+	class Gate : public SimpleStreamInOut<T, T>
+	{
+		std::atomic<bool> open{true};
+
+	public:
+		virtual ~Gate() {}
+
+		void setOpen(bool b) { open = b; }
+		bool isOpen() { return open; }
+
+		virtual void Receive(const T *data, int len, TAG &tag)
+		{
+			if (open)
+				SimpleStreamInOut<T, T>::Send(data, len, tag);
+		}
+		virtual void Receive(T *data, int len, TAG &tag)
+		{
+			if (open)
+				SimpleStreamInOut<T, T>::Send(data, len, tag);
+		}
+	};
+
+	// Process-wide list of the attached probes, read for /api/perf and /metrics
+	class Perf
+	{
+		std::mutex mtx;
+		std::vector<ProbeStats *> probes;
+		std::vector<LatencyStats *> latencies;
+
+		std::string getHistograms();
+		std::string getLatencyHistograms();
+
+	public:
+		struct Stage
+		{
+			std::string name;
+			uint64_t calls, samples, total_ns, p99_ns;
+		};
+
+		// microseconds, the JSON step is zero for outputs without JSON
+		struct Latency
+		{
+			std::string name;
+			uint64_t count;
+			uint64_t decode_p99, json_p99, send_p99, total_p50, total_p99, total_max;
+		};
+
+		static Perf &get();
+
+		void add(ProbeStats *p);
+		void remove(ProbeStats *p);
+		void add(LatencyStats *l);
+		void remove(LatencyStats *l);
+
+		std::vector<Stage> getStages();
+		std::vector<Latency> getLatencies();
+		std::string getPrometheus();
+	};
+
+	// Cores and real-time priority for a thread the program starts, applied by that thread.
+	// A priority above 0 selects SCHED_FIFO on Linux and a raised thread priority on Windows.
+	class ThreadPolicy
+	{
+		std::vector<int> cores;
+		int priority = 0;
+		std::atomic<bool> failed{false};
+
+	public:
+		static bool setAffinity(const std::vector<int> &cores);
+		static bool setPriority(int priority);
+		// below normal priority for work that must never hold up the decoding
+		static bool setBackground();
+
+		// AFFINITY takes a comma separated list of cores or OFF, PRIORITY 0 (normal) to 99
+		bool Set(const std::string &option, const std::string &arg);
+		void apply(const std::string &name);
+
+		bool isDefault() { return cores.empty() && priority == 0; }
+		std::string Get(const std::string &prefix = "");
+	};
+
+	// Process-wide pool for the work the models of all receivers hand off, by default one worker
+	// per core, optionally pinned to a core. A task never runs on two workers at the same time
+	// so its work is done in order. Settings take effect when the first user joins.
+	class Executor
+	{
+	public:
+		class Task
+		{
+			friend class Executor;
+
+			enum class State
+			{
+				IDLE,
+				QUEUED,
+				RUNNING,
+				AGAIN
+			} state = State::IDLE;
+
+		public:
+			virtual ~Task() {}
+			// returns true if work is left, the task is then queued again behind the other tasks
+			virtual bool run() = 0;
+		};
+
+	private:
+		std::mutex mtx;
+		std::condition_variable cv_work, cv_idle;
+		std::deque<Task *> ready;
+		std::vector<std::thread> workers;
+
+		int nworkers = 0, users = 0;
+		bool affinity = false, stopping = false;
+
+		void work(int id);
+
+	public:
+		static Executor &get();
+		// true on the threads of the pool, these must never wait for another task to make progress
+		static bool onWorker();
+
+		void setWorkers(int n) { nworkers = n; }
+		void setAffinity(bool b) { affinity = b; }
+		int getWorkers();
+		bool getAffinity() { return affinity; }
+
+		void join();
+		// waits until t is no longer queued or running, the last user stops the workers
+		void leave(Task *t);
+		void post(Task *t);
+	};
+
+	// Hands blocks over to a worker thread that runs the downstream chain.
+	// The queue is bounded, the producer waits if the worker falls behind.
+	// With setShared the downstream chain runs as a task on the Executor instead.
+	template <typename T>
+	class AsyncPassThrough : public SimpleStreamInOut<T, T>, public Executor::Task
+	{
+		struct Block
+		{
+			std::vector<T> data;
+			TAG tag;
+		};
+
+		std::vector<Block> blocks = std::vector<Block>(8);
+		int head = 0, tail = 0, count = 0;
+		bool stopping = false;
+		bool shared = false, joined = false;
+
+		std::mutex mtx;
+		std::condition_variable cv_data, cv_space;
+		std::thread worker;
+
+		// Executor::Task, at most one round through the queue per call
+		bool run()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			for (int n = (int)blocks.size(); n > 0 && count > 0; n--)
+			{
+				Block &b = blocks[head];
+				lock.unlock();
+
+				SimpleStreamInOut<T, T>::Send(b.data.data(), (int)b.data.size(), b.tag);
+
+				lock.lock();
+				head = (head + 1) % (int)blocks.size();
+				count--;
+				cv_space.notify_one();
+			}
+			return count > 0;
+		}
+
+		void loop()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			while (true)
+			{
+				cv_data.wait(lock, [this]
+							 { return count > 0 || stopping; });
+
+				// drain the queue before stopping
+				if (count == 0)
+					break;
+
+				Block &b = blocks[head];
+				lock.unlock();
+
+				SimpleStreamInOut<T, T>::Send(b.data.data(), (int)b.data.size(), b.tag);
+
+				lock.lock();
+				head = (head + 1) % (int)blocks.size();
+				count--;
+				cv_space.notify_one();
+			}
+		}
+
+	public:
+		virtual ~AsyncPassThrough() { stop(); }
+
+		void setQueueSize(int n) { blocks.resize(MAX(n, 1)); }
+
+		void setShared(bool b)
+		{
+			shared = b;
+
+			if (shared && !joined)
+			{
+				Executor::get().join();
+				joined = true;
+			}
+		}
+
+		// accept blocks again after stop()
+		void start()
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = false;
+
+			if (shared && !joined)
+			{
+				Executor::get().join();
+				joined = true;
+			}
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				stopping = true;
+				cv_data.notify_one();
+				cv_space.notify_one();
+			}
+
+			if (worker.joinable())
+				worker.join();
+
+			// drain what is left and wait for the task to go idle
+			if (joined)
+			{
+				Executor::get().post(this);
+				Executor::get().leave(this);
+				joined = false;
+			}
+		}
+
+		virtual void Receive(const T *data, int len, TAG &tag)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			if (stopping)
+				return;
+
+			if (!shared && !worker.joinable())
+				worker = std::thread(&AsyncPassThrough::loop, this);
+
+			cv_space.wait(lock, [this]
+						  { return count < (int)blocks.size() || stopping; });
+
+			if (stopping)
+				return;
+
+			// only the producer writes to the tail block
+			Block &b = blocks[tail];
+			lock.unlock();
+
+			b.data.assign(data, data + len);
+			b.tag = tag;
+
+			lock.lock();
+			tail = (tail + 1) % (int)blocks.size();
+			count++;
+			cv_data.notify_one();
+			lock.unlock();
+
+			if (shared)
+				Executor::get().post(this);
+		}
+	};
+
+	// Decouples a subgraph that may block (network, databases) from the producer. Unlike
+	// AsyncPassThrough it accepts several producers and can drop blocks when the queue is full
+	// instead of holding up the producer. The worker takes up to batch blocks per wake up.
+	// Shared, a producer on an Executor worker never waits: BLOCK then drops the newest block.
+	template <typename T>
+	class AsyncStream : public SimpleStreamInOut<T, T>, public Executor::Task
+	{
+	public:
+		enum class Overflow
+		{
+			BLOCK,
+			DROP_OLDEST,
+			DROP_NEWEST
+		};
+
+	private:
+		// the slots keep their objects, refilling a block assigns to them
+		struct Block
+		{
+			std::vector<T> data;
+			int len = 0;
+			TAG tag;
+		};
+
+		std::vector<Block> blocks = std::vector<Block>(64), taken;
+		int head = 0, count = 0, batch = 16;
+		Overflow overflow = Overflow::BLOCK;
+		bool stopping = false, shared = false, joined = false;
+
+		std::mutex mtx;
+		std::condition_variable cv_data, cv_space;
+		std::thread worker;
+
+		std::atomic<long> received{0}, delivered{0}, dropped{0};
+		std::atomic<int> depth{0}, depth_max{0};
+
+		// moves up to batch blocks out of the queue so producers can refill it, caller holds the lock
+		int take()
+		{
+			int n = MIN(count, batch);
+
+			if ((int)taken.size() < n)
+				taken.resize(n);
+
+			int64_t bytes = 0;
+			for (int i = 0; i < n; i++)
+			{
+				std::swap(taken[i], blocks[head]);
+				head = (head + 1) % (int)blocks.size();
+				bytes += taken[i].len * sizeof(T);
+			}
+			count -= n;
+			MemoryBudget::add(MemoryBudget::QUEUES, -bytes);
+			depth = count;
+			cv_space.notify_all();
+			return n;
+		}
+
+		void deliver(int n)
+		{
+			for (int i = 0; i < n; i++)
+				SimpleStreamInOut<T, T>::Send(taken[i].data.data(), taken[i].len, taken[i].tag);
+
+			delivered += n;
+		}
+
+		// Executor::Task, delivers one batch per call
+		bool run()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			int n = take();
+			lock.unlock();
+
+			deliver(n);
+
+			lock.lock();
+			return count > 0;
+		}
+
+		void loop()
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			while (true)
+			{
+				cv_data.wait(lock, [this]
+							 { return count > 0 || stopping; });
+
+				// drain the queue before stopping
+				if (count == 0)
+					break;
+
+				int n = take();
+				lock.unlock();
+
+				deliver(n);
+
+				lock.lock();
+			}
+		}
+
+	public:
+		virtual ~AsyncStream() { stop(); }
+
+		void setQueueSize(int n) { blocks.resize(MAX(n, 1)); }
+		void setBatch(int n) { batch = MAX(n, 1); }
+		void setOverflow(Overflow o) { overflow = o; }
+
+		void setShared(bool b)
+		{
+			shared = b;
+
+			if (shared && !joined)
+			{
+				Executor::get().join();
+				joined = true;
+			}
+		}
+
+		int getQueueSize() { return (int)blocks.size(); }
+		int getDepth() { return depth; }
+		int getMaxDepth() { return depth_max; }
+		long getReceived() { return received; }
+		long getDelivered() { return delivered; }
+		long getDropped() { return dropped; }
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				stopping = true;
+				cv_data.notify_one();
+				cv_space.notify_all();
+			}
+
+			if (worker.joinable())
+				worker.join();
+
+			if (joined)
+			{
+				Executor::get().post(this);
+				Executor::get().leave(this);
+				joined = false;
+			}
+		}
+
+		virtual void Receive(const T *data, int len, TAG &tag)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			if (stopping)
+				return;
+
+			if (!shared && !worker.joinable())
+				worker = std::thread(&AsyncStream::loop, this);
+
+			received++;
+
+			if (count == (int)blocks.size())
+			{
+				switch (overflow)
+				{
+				case Overflow::DROP_NEWEST:
+					dropped++;
+					return;
+				case Overflow::DROP_OLDEST:
+					MemoryBudget::add(MemoryBudget::QUEUES, -(int64_t)(blocks[head].len * sizeof(T)));
+					head = (head + 1) % (int)blocks.size();
+					count--;
+					dropped++;
+					break;
+				default:
+					// the task that frees space would queue behind a producer that runs on the pool itself
+					if (shared && Executor::onWorker())
+					{
+						dropped++;
+						return;
+					}
+					cv_space.wait(lock, [this]
+								  { return count < (int)blocks.size() || stopping; });
+					if (stopping)
+						return;
+				}
+			}
+
+			Block &b = blocks[(head + count) % (int)blocks.size()];
+			if ((int)b.data.size() < len)
+				b.data.resize(len);
+			for (int i = 0; i < len; i++)
+				b.data[i] = data[i];
+			b.len = len;
+			b.tag = tag;
+
+			count++;
+			MemoryBudget::add(MemoryBudget::QUEUES, (int64_t)(len * sizeof(T)));
+			depth = count;
+			if (count > depth_max)
+				depth_max = count;
+
+			cv_data.notify_one();
+			lock.unlock();
+
+			if (shared)
+				Executor::get().post(this);
+		}
 	};
 
 	class ConvertToRAW : public SimpleStreamInOut<CFLOAT32, RAW>
@@ -107,17 +773,23 @@ namespace Util
 
 	class ConvertRAW : public SimpleStreamInOut<RAW, CFLOAT32>
 	{
-		std::vector<CFLOAT32> output;
+		Util::AlignedVector<CFLOAT32> output;
 
 	public:
 		virtual ~ConvertRAW() {}
 		Connection<CU8> outCU8;
 		Connection<CS8> outCS8;
+		Connection<CS16> outCS16;
 
 		void Receive(const RAW *raw, int len, TAG &tag);
 	};
 
-	class WriteWAV : public StreamIn<RAW>
+	// Writes the samples to a WAV file from a thread of its own. Receive only copies into a ring buffer
+	// (BUFFER in MB), what does not fit is dropped and counted so slow storage never holds up the DSP.
+	// With TRIGGER MSG the samples are kept in a history of PRE ms and only written around a decoded
+	// message, with TRIGGER CRC also around a failed checksum, until POST ms after the last trigger.
+	// The triggers come from the decoders as DecoderSignals, the bursts follow each other in the file.
+	class WriteWAV : public StreamIn<RAW>, public SignalIn<DecoderSignals>
 	{
 		struct WAVHeader
 		{
@@ -141,19 +813,45 @@ namespace Util
 			uint32_t data_chunk_size = 0;				// Size of data
 		} header;
 
-		std::vector<CFLOAT32> output;
 		std::ofstream file;
 		std::string filename;
 		Format format;
 		int sample_rate = -1;
-		bool stopping = false;
+		std::atomic<bool> stopping{false};
+
+		// single producer ring, head and tail count bytes since the start
+		std::vector<char> ring;
+		std::atomic<uint64_t> head{0}, tail{0};
+		std::size_t buffer_size = 16 << 20;
+		std::size_t memory_reported = 0;
+
+		std::thread writer;
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool terminate = false;
+
+		uint64_t written = 0, dropped = 0, bursts = 0;
+
+		// trigger mode: 0 off, 1 on messages, 2 also on CRC failures
+		int trigger = 0;
+		int pre_ms = 200, post_ms = 50;
+		std::atomic<bool> triggered{false};
+		std::vector<char> history;
+		std::size_t history_pos = 0, history_len = 0;
+		long post_left = 0, pre_bytes = 0, post_bytes = 0;
 
 		void Open(const std::string &filename, int sample_rate);
+		void start(const RAW &raw);
+		void push(const char *data, std::size_t len);
+		void keep(const char *data, std::size_t len);
+		void loop();
 
 	public:
 		virtual ~WriteWAV();
 		void Receive(const RAW *raw, int len, TAG &tag);
+		void Signal(const DecoderSignals &in);
 
 		bool setValue(std::string option, std::string arg);
+		int getTrigger() { return trigger; }
 	};
 }
@@ -23,74 +23,120 @@ namespace Util
 	void TemplateString::set(const std::string &t)
 	{
 		tpl = t;
+		compile();
 	}
 
-	std::string TemplateString::get(const TAG &tag, const AIS::Message &msg) const
+	void TemplateString::compile()
 	{
-		std::string out;
-		out.reserve(tpl.size() + 64);
+		segments.clear();
+		constant = true;
+		cached = false;
 
+		std::string literal;
 		int i = 0, n = tpl.size();
 
+		auto add = [&](Field f)
+		{
+			if (!literal.empty())
+				segments.push_back({Field::LITERAL, literal});
+			literal.clear();
+
+			segments.push_back({f, ""});
+
+			if (f != Field::STATION)
+				constant = false;
+		};
+
 		while (i < n)
 		{
 			if (tpl[i] != '%')
 			{
-				out.push_back(tpl[i++]);
+				literal.push_back(tpl[i++]);
+				continue;
 			}
+
+			int start = i + 1;
+			std::size_t end = tpl.find('%', start);
+
+			if (end == std::string::npos)
+			{
+				literal.push_back('%');
+				i = start;
+				continue;
+			}
+
+			std::string key = tpl.substr(start, end - start);
+			i = end + 1;
+
+			// substitutions:
+			if (key == "mmsi")
+				add(Field::MMSI);
+			else if (key == "ppm")
+				add(Field::PPM);
+			else if (key == "station")
+				add(Field::STATION);
+			else if (key == "type")
+				add(Field::TYPE);
+			else if (key == "repeat")
+				add(Field::REPEAT);
+			else if (key == "channel")
+				add(Field::CHANNEL);
+			else if (key == "rxtimeux")
+				add(Field::RXTIMEUX);
 			else
 			{
-				int start = i + 1;
-				int end = tpl.find('%', start);
-				if (end == std::string::npos)
-				{
-					out.push_back('%');
-					i = start;
-				}
-				else
-				{
-					std::string key = tpl.substr(start, end - start);
-					i = end + 1;
-
-					// substitutions:
-					if (key == "mmsi")
-					{
-						out += std::to_string(msg.mmsi());
-					}
-					else if (key == "ppm")
-					{
-						out += std::to_string(tag.ppm);
-					}
-					else if (key == "station")
-					{
-						out += std::to_string(msg.getStation());
-					}
-					else if (key == "type")
-					{
-						out += std::to_string(msg.type());
-					}
-					else if (key == "repeat")
-					{
-						out += std::to_string(msg.repeat());
-					}
-					else if (key == "channel")
-					{
-						out.push_back(msg.getChannel());
-					}
-					else if (key == "rxtimeux")
-					{
-						out += std::to_string(msg.getRxTimeUnix());
-					}
-					else
-					{
-						// unknown key → re-emit literally
-						out.push_back('%');
-						out += key;
-						out.push_back('%');
-					}
-				}
+				// unknown key → re-emit literally
+				literal.push_back('%');
+				literal += key;
+				literal.push_back('%');
+			}
+		}
+
+		if (!literal.empty())
+			segments.push_back({Field::LITERAL, literal});
+	}
+
+	const std::string &TemplateString::get(const TAG &tag, const AIS::Message &msg) const
+	{
+		if (constant && cached && cached_station == msg.getStation())
+			return out;
+
+		out.clear();
+
+		for (const Segment &s : segments)
+		{
+			switch (s.field)
+			{
+			case Field::LITERAL:
+				out += s.text;
+				break;
+			case Field::MMSI:
+				out += std::to_string(msg.mmsi());
+				break;
+			case Field::PPM:
+				out += std::to_string(tag.ppm);
+				break;
+			case Field::STATION:
+				out += std::to_string(msg.getStation());
+				break;
+			case Field::TYPE:
+				out += std::to_string(msg.type());
+				break;
+			case Field::REPEAT:
+				out += std::to_string(msg.repeat());
+				break;
+			case Field::CHANNEL:
+				out.push_back(msg.getChannel());
+				break;
+			case Field::RXTIMEUX:
+				out += std::to_string(msg.getRxTimeUnix());
+				break;
 			}
 		}
+
+		cached = true;
+		cached_station = msg.getStation();
+
 		return out;
 	}
 }
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 struct TAG;
 namespace AIS
@@ -27,14 +28,43 @@ namespace AIS
 
 namespace Util
 {
+	// The template is parsed once into literal and field segments. Rendering writes
+	// into an internal buffer, so the returned reference is valid until the next call.
 	class TemplateString
 	{
+		enum class Field
+		{
+			LITERAL,
+			MMSI,
+			PPM,
+			STATION,
+			TYPE,
+			REPEAT,
+			CHANNEL,
+			RXTIMEUX
+		};
+
+		struct Segment
+		{
+			Field field;
+			std::string text;
+		};
+
 		std::string tpl;
+		std::vector<Segment> segments;
+
+		// templates without fields or with only the station are rendered once per station
+		bool constant = true;
+		mutable bool cached = false;
+		mutable int cached_station = 0;
+		mutable std::string out;
+
+		void compile();
 
 	public:
-		TemplateString(const std::string &t) : tpl(t) {}
+		TemplateString(const std::string &t) : tpl(t) { compile(); }
 		void set(const std::string &t);
-		std::string get(const TAG &tag, const AIS::Message &msg) const;
+		const std::string &get(const TAG &tag, const AIS::Message &msg) const;
 		std::string getTemplate() const
 		{
 			return tpl;
@@ -74,7 +74,7 @@ process_file() {
     {
         echo "// File: $relative_path"
         echo "static const unsigned char data_${identifier}[] = {"
-        xxd -i < "$TEMP_FILE" | grep -v "unsigned" | head -n -1
+        xxd -i < "$TEMP_FILE" | grep -v "unsigned"
         echo "};"
         echo "static const size_t size_${identifier} = sizeof(data_${identifier});"
         echo
@@ -114,7 +114,9 @@ find "$BASE_DIR" -type f | while read -r file; do
     fi
     identifier=$(make_identifier "$relative_path")
     mime_type=$(get_mime_type "$file")
-    echo "    files.emplace(\"${relative_path}\", FileData(data_${identifier}, size_${identifier}, \"${mime_type}\"));" >> "$OUTPUT_FILE"
+    # ETag from the compressed content as served
+    etag=$(gzip -9 -n < "$file" | { md5sum 2>/dev/null || md5 -q; } | cut -c1-16)
+    echo "    files.emplace(\"${relative_path}\", FileData(data_${identifier}, size_${identifier}, \"${mime_type}\", \"\\\"${etag}\\\"\"));" >> "$OUTPUT_FILE"
 done
 
 # Close the initialization function and namespace